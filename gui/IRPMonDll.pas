@@ -535,6 +535,68 @@ Type
   DRIVER_NAME_WATCH_RECORD = _DRIVER_NAME_WATCH_RECORD;
   PDRIVER_NAME_WATCH_RECORD = ^DRIVER_NAME_WATCH_RECORD;
 
+  (** Describes one driver to hook by the @link(IRPMonDllHookBatch) function. *)
+  _IRPMON_HOOK_DRIVER_BATCH_ENTRY = Record
+    DriverName : PWideChar;
+    MonitorSettings : DRIVER_MONITOR_SETTINGS;
+    Result : Cardinal;
+    DriverHandle : THandle;
+    ObjectId : Pointer;
+    end;
+  IRPMON_HOOK_DRIVER_BATCH_ENTRY = _IRPMON_HOOK_DRIVER_BATCH_ENTRY;
+  PIRPMON_HOOK_DRIVER_BATCH_ENTRY = ^IRPMON_HOOK_DRIVER_BATCH_ENTRY;
+
+  (** Describes one device to hook by the @link(IRPMonDllHookBatch) function.
+    IRPSettings and FastIoSettings may be nil, the device then gets the settings
+    of its driver. *)
+  _IRPMON_HOOK_DEVICE_BATCH_ENTRY = Record
+    DeviceName : PWideChar;
+    DeviceAddress : Pointer;
+    IRPSettings : PByte;
+    FastIoSettings : PByte;
+    Result : Cardinal;
+    DeviceHandle : THandle;
+    ObjectId : Pointer;
+    end;
+  IRPMON_HOOK_DEVICE_BATCH_ENTRY = _IRPMON_HOOK_DEVICE_BATCH_ENTRY;
+  PIRPMON_HOOK_DEVICE_BATCH_ENTRY = ^IRPMON_HOOK_DEVICE_BATCH_ENTRY;
+
+  _IRPMON_BATCH_RECORD = Record
+    Header : PREQUEST_HEADER;
+    Size : Cardinal;
+    end;
+  IRPMON_BATCH_RECORD = _IRPMON_BATCH_RECORD;
+  PIRPMON_BATCH_RECORD = ^IRPMON_BATCH_RECORD;
+
+  _IRPMON_RECORD_BATCH = Record
+    Count : Cardinal;
+    Records : PIRPMON_BATCH_RECORD;
+    Length : Cardinal;
+    Data : Pointer;
+    end;
+  IRPMON_RECORD_BATCH = _IRPMON_RECORD_BATCH;
+  PIRPMON_RECORD_BATCH = ^IRPMON_RECORD_BATCH;
+
+  IRPMON_BATCH_CALLBACK = Procedure (ABatch:PIRPMON_RECORD_BATCH; AContext:Pointer); StdCall;
+
+  _IRPMON_MOCK_SETTINGS = Record
+    RecordsPerSecond : Cardinal;
+    QueueLimit : Cardinal;
+    DriverCount : Cardinal;
+    DevicesPerDriver : Cardinal;
+    end;
+  IRPMON_MOCK_SETTINGS = _IRPMON_MOCK_SETTINGS;
+  PIRPMON_MOCK_SETTINGS = ^IRPMON_MOCK_SETTINGS;
+
+  _IRPMON_MOCK_STATISTICS = Record
+    Generated : UInt64;
+    Delivered : UInt64;
+    Dropped : UInt64;
+    Pending : UInt64;
+    end;
+  IRPMON_MOCK_STATISTICS = _IRPMON_MOCK_STATISTICS;
+  PIRPMON_MOCK_STATISTICS = ^IRPMON_MOCK_STATISTICS;
+
 
 
 Function IRPMonDllDriverHooksEnumerate(Var AHookedDrivers:PHOOKED_DRIVER_UMINFO; Var ACount:Cardinal):Cardinal; StdCall;
@@ -551,13 +613,21 @@ Function IRPMonDllUnhookDevice(AHookHandle:THandle):Cardinal; StdCall;
 Function IRPMonDllHookedDeviceGetInfo(AHandle:THandle; AIRPSettings:PByte; AFastIOSettings:PByte; Var AMonitoringEnabled:ByteBool):Cardinal; StdCall;
 Function IRPMonDllHookedDeviceSetInfo(AHandle:THandle; AIRPSettings:PByte; AFastIOSettings:PByte; AMonitoringEnabled:ByteBool):Cardinal; StdCall;
 Function IRPMonDllHookedDriverGetInfo(AHandle:THandle; Var ASettings:DRIVER_MONITOR_SETTINGS; Var AMonitoringEnabled:ByteBool):Cardinal; StdCall;
+Function IRPMonDllHookBatch(ADrivers:PIRPMON_HOOK_DRIVER_BATCH_ENTRY; ADriverCount:Cardinal; ADevices:PIRPMON_HOOK_DEVICE_BATCH_ENTRY; ADeviceCount:Cardinal; AActivate:ByteBool):Cardinal; StdCall;
+Function IRPMonDllUnhookDriverBatch(ADriverHandles:PHandle; ACount:Cardinal; AResults:PCardinal):Cardinal; StdCall;
 
 Function IRPMonDllSnapshotRetrieve(Var ADriverInfo:PPIRPMON_DRIVER_INFO; Var ACount:Cardinal):Cardinal; StdCall;
 Procedure IRPMonDllSnapshotFree(ADriverInfo:PPIRPMON_DRIVER_INFO; ACount:Cardinal); StdCall;
+Function IRPMonDllSnapshotRetrieveEx(Var ADriverInfo:PPIRPMON_DRIVER_INFO; Var ACount:Cardinal; Var AGeneration:Cardinal):Cardinal; StdCall;
+Function IRPMonDllObjectChangesGet(Var AGeneration:Cardinal; Var AChanges:PIRPMON_RECORD_BATCH):Cardinal; StdCall;
+Procedure IRPMonDllObjectChangesFree(AChanges:PIRPMON_RECORD_BATCH); StdCall;
 
 Function IRPMonDllConnect(ASemaphore:THandle):Cardinal; StdCall;
 Function IRPMonDllDisconnect:Cardinal; StdCall;
 Function IRPMonDllGetRequest(ARequest:PREQUEST_HEADER; ASize:Cardinal):Cardinal; StdCall;
+Function IRPMonDllStartConsumer(ACallback:IRPMON_BATCH_CALLBACK; ABatchSize:Cardinal; AMaxLatency:Cardinal; AContext:Pointer):Cardinal; StdCall;
+Procedure IRPMonDllStopConsumer; StdCall;
+Procedure IRPMonDllConsumerBatchRelease(ABatch:PIRPMON_RECORD_BATCH); StdCall;
 
 Function IRPMonDllOpenHookedDriver(AObjectId:Pointer; Var AHandle:THandle):Cardinal; StdCall;
 Function IRPMonDllCloseHookedDriverHandle(AHandle:THandle):Cardinal; StdCall;
@@ -577,6 +647,8 @@ Procedure IRPMonDllDriverNameWatchEnumFree(AArray:PDRIVER_NAME_WATCH_RECORD; ACo
 
 
 Function IRPMonDllInitialize:Cardinal; StdCall;
+Function IRPMonDllInitializeMock(Var ASettings:IRPMON_MOCK_SETTINGS):Cardinal; StdCall;
+Function IRPMonDllMockStatistics(Var AStatistics:IRPMON_MOCK_STATISTICS):Cardinal; StdCall;
 Procedure IRPMonDllFinalize; StdCall;
 
 Implementation
@@ -600,13 +672,21 @@ Function IRPMonDllUnhookDevice(AHookHandle:THandle):Cardinal; StdCall; External
 Function IRPMonDllHookedDeviceGetInfo(AHandle:THandle; AIRPSettings:PByte; AFastIOSettings:PByte; Var AMonitoringEnabled:ByteBool):Cardinal; StdCall; External LibraryName;
 Function IRPMonDllHookedDeviceSetInfo(AHandle:THandle; AIRPSettings:PByte; AFastIOSettings:PByte; AMonitoringEnabled:ByteBool):Cardinal; StdCall; External LibraryName;
 Function IRPMonDllHookedDriverGetInfo(AHandle:THandle; Var ASettings:DRIVER_MONITOR_SETTINGS; Var AMonitoringEnabled:ByteBool):Cardinal; StdCall; External LibraryName;
+Function IRPMonDllHookBatch(ADrivers:PIRPMON_HOOK_DRIVER_BATCH_ENTRY; ADriverCount:Cardinal; ADevices:PIRPMON_HOOK_DEVICE_BATCH_ENTRY; ADeviceCount:Cardinal; AActivate:ByteBool):Cardinal; StdCall; External LibraryName;
+Function IRPMonDllUnhookDriverBatch(ADriverHandles:PHandle; ACount:Cardinal; AResults:PCardinal):Cardinal; StdCall; External LibraryName;
 
 Function IRPMonDllSnapshotRetrieve(Var ADriverInfo:PPIRPMON_DRIVER_INFO; Var ACount:Cardinal):Cardinal; StdCall; External LibraryName;
 Procedure IRPMonDllSnapshotFree(ADriverInfo:PPIRPMON_DRIVER_INFO; ACount:Cardinal); StdCall; External LibraryName;
+Function IRPMonDllSnapshotRetrieveEx(Var ADriverInfo:PPIRPMON_DRIVER_INFO; Var ACount:Cardinal; Var AGeneration:Cardinal):Cardinal; StdCall; External LibraryName;
+Function IRPMonDllObjectChangesGet(Var AGeneration:Cardinal; Var AChanges:PIRPMON_RECORD_BATCH):Cardinal; StdCall; External LibraryName;
+Procedure IRPMonDllObjectChangesFree(AChanges:PIRPMON_RECORD_BATCH); StdCall; External LibraryName;
 
 Function IRPMonDllConnect(ASemaphore:THandle):Cardinal; StdCall; External LibraryName;
 Function IRPMonDllDisconnect:Cardinal; StdCall; External LibraryName;
 Function IRPMonDllGetRequest(ARequest:PREQUEST_HEADER; ASize:Cardinal):Cardinal; StdCall; External LibraryName;
+Function IRPMonDllStartConsumer(ACallback:IRPMON_BATCH_CALLBACK; ABatchSize:Cardinal; AMaxLatency:Cardinal; AContext:Pointer):Cardinal; StdCall; External LibraryName;
+Procedure IRPMonDllStopConsumer; StdCall; External LibraryName;
+Procedure IRPMonDllConsumerBatchRelease(ABatch:PIRPMON_RECORD_BATCH); StdCall; External LibraryName;
 
 Function IRPMonDllOpenHookedDriver(AObjectId:Pointer; Var AHandle:THandle):Cardinal; StdCall; External LibraryName;
 Function IRPMonDllCloseHookedDriverHandle(AHandle:THandle):Cardinal; StdCall; External LibraryName;
@@ -626,6 +706,8 @@ Procedure IRPMonDllDriverNameWatchEnumFree(AArray:PDRIVER_NAME_WATCH_RECORD; ACo
 
 
 Function IRPMonDllInitialize:Cardinal; StdCall; External LibraryName;
+Function IRPMonDllInitializeMock(Var ASettings:IRPMON_MOCK_SETTINGS):Cardinal; StdCall; External LibraryName;
+Function IRPMonDllMockStatistics(Var AStatistics:IRPMON_MOCK_STATISTICS):Cardinal; StdCall; External LibraryName;
 Procedure IRPMonDllFinalize; StdCall; External LibraryName;
 
 {$ELSE}
@@ -644,13 +726,21 @@ Function IRPMonDllUnhookDevice(AHookHandle:THandle):Cardinal; StdCall; External
 Function IRPMonDllHookedDeviceGetInfo(AHandle:THandle; AIRPSettings:PByte; AFastIOSettings:PByte; Var AMonitoringEnabled:ByteBool):Cardinal; StdCall; External LibraryName name '_IRPMonDllHookedDeviceGetInfo@16';
 Function IRPMonDllHookedDeviceSetInfo(AHandle:THandle; AIRPSettings:PByte; AFastIOSettings:PByte; AMonitoringEnabled:ByteBool):Cardinal; StdCall; External LibraryName name '_IRPMonDllHookedDeviceSetInfo@16';
 Function IRPMonDllHookedDriverGetInfo(AHandle:THandle; Var ASettings:DRIVER_MONITOR_SETTINGS; Var AMonitoringEnabled:ByteBool):Cardinal; StdCall; External LibraryName name '_IRPMonDllHookedDriverGetInfo@12';
+Function IRPMonDllHookBatch(ADrivers:PIRPMON_HOOK_DRIVER_BATCH_ENTRY; ADriverCount:Cardinal; ADevices:PIRPMON_HOOK_DEVICE_BATCH_ENTRY; ADeviceCount:Cardinal; AActivate:ByteBool):Cardinal; StdCall; External LibraryName name '_IRPMonDllHookBatch@20';
+Function IRPMonDllUnhookDriverBatch(ADriverHandles:PHandle; ACount:Cardinal; AResults:PCardinal):Cardinal; StdCall; External LibraryName name '_IRPMonDllUnhookDriverBatch@12';
 
 Function IRPMonDllSnapshotRetrieve(Var ADriverInfo:PPIRPMON_DRIVER_INFO; Var ACount:Cardinal):Cardinal; StdCall; External LibraryName name '_IRPMonDllSnapshotRetrieve@8';
 Procedure IRPMonDllSnapshotFree(ADriverInfo:PPIRPMON_DRIVER_INFO; ACount:Cardinal); StdCall; External LibraryName name '_IRPMonDllSnapshotFree@8';
+Function IRPMonDllSnapshotRetrieveEx(Var ADriverInfo:PPIRPMON_DRIVER_INFO; Var ACount:Cardinal; Var AGeneration:Cardinal):Cardinal; StdCall; External LibraryName name '_IRPMonDllSnapshotRetrieveEx@12';
+Function IRPMonDllObjectChangesGet(Var AGeneration:Cardinal; Var AChanges:PIRPMON_RECORD_BATCH):Cardinal; StdCall; External LibraryName name '_IRPMonDllObjectChangesGet@8';
+Procedure IRPMonDllObjectChangesFree(AChanges:PIRPMON_RECORD_BATCH); StdCall; External LibraryName name '_IRPMonDllObjectChangesFree@4';
 
 Function IRPMonDllConnect(ASemaphore:THandle):Cardinal; StdCall; External LibraryName name '_IRPMonDllConnect@4';
 Function IRPMonDllDisconnect:Cardinal; StdCall; External LibraryName name '_IRPMonDllDisconnect@0';
 Function IRPMonDllGetRequest(ARequest:PREQUEST_HEADER; ASize:Cardinal):Cardinal; StdCall; External LibraryName name '_IRPMonDllGetRequest@8';
+Function IRPMonDllStartConsumer(ACallback:IRPMON_BATCH_CALLBACK; ABatchSize:Cardinal; AMaxLatency:Cardinal; AContext:Pointer):Cardinal; StdCall; External LibraryName name '_IRPMonDllStartConsumer@16';
+Procedure IRPMonDllStopConsumer; StdCall; External LibraryName name '_IRPMonDllStopConsumer@0';
+Procedure IRPMonDllConsumerBatchRelease(ABatch:PIRPMON_RECORD_BATCH); StdCall; External LibraryName name '_IRPMonDllConsumerBatchRelease@4';
 
 Function IRPMonDllOpenHookedDriver(AObjectId:Pointer; Var AHandle:THandle):Cardinal; StdCall; External LibraryName name '_IRPMonDllOpenHookedDriver@8';
 Function IRPMonDllCloseHookedDriverHandle(AHandle:THandle):Cardinal; StdCall; External LibraryName name '_IRPMonDllCloseHookedDriverHandle@4';
@@ -670,6 +760,8 @@ Procedure IRPMonDllDriverNameWatchEnumFree(AArray:PDRIVER_NAME_WATCH_RECORD; ACo
 
 
 Function IRPMonDllInitialize:Cardinal; StdCall; External LibraryName name '_IRPMonDllInitialize@0';
+Function IRPMonDllInitializeMock(Var ASettings:IRPMON_MOCK_SETTINGS):Cardinal; StdCall; External LibraryName name '_IRPMonDllInitializeMock@4';
+Function IRPMonDllMockStatistics(Var AStatistics:IRPMON_MOCK_STATISTICS):Cardinal; StdCall; External LibraryName name '_IRPMonDllMockStatistics@4';
 Procedure IRPMonDllFinalize; StdCall; External LibraryName name '_IRPMonDllFinalize@0';
 
 {$ENDIF}
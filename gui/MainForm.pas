@@ -77,7 +77,7 @@ Type
     procedure IrpMonAppEventsMessage(var Msg: tagMSG; var Handled: Boolean);
     Procedure IrpMonAppEventsException(Sender: TObject; E: Exception);
   Public
-    Procedure OnRequest(AList:TList<PREQUEST_GENERAL>);
+    Procedure OnRequest(AList:TList<PREQUEST_GENERAL>; ABatch:PIRPMON_RECORD_BATCH);
   end;
 
 Var
@@ -208,15 +208,11 @@ begin
 ErrorMessage(E.Message);
 end;
 
-Procedure TMainFrm.OnRequest(AList:TList<PREQUEST_GENERAL>);
-Var
-  rq : PREQUEST_GENERAL;
+Procedure TMainFrm.OnRequest(AList:TList<PREQUEST_GENERAL>; ABatch:PIRPMON_RECORD_BATCH);
 begin
 FModel.UpdateRequest := AList;
 FModel.Update;
-For rq In AList Do
-  FreeMem(rq);
-
+IRPMonDllConsumerBatchRelease(ABatch);
 AList.Free;
 end;
 
@@ -227,7 +223,7 @@ Var
 begin
 If Msg.message = FRequestMsgCode Then
   begin
-  OnRequest(TList<PREQUEST_GENERAL>(Msg.lParam));
+  OnRequest(TList<PREQUEST_GENERAL>(Msg.lParam), PIRPMON_RECORD_BATCH(Msg.wParam));
   Handled := True;
   end;
 end;
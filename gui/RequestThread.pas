@@ -15,11 +15,16 @@ Type
   Private
     FConnected : Boolean;
     FEvent : THandle;
-    FSemaphore : THandle;
     FMsgCode : Cardinal;
     FCurrentList : TList<PREQUEST_GENERAL>;
+    FCurrentBatch : PIRPMON_RECORD_BATCH;
+    FBatchLock : TRTLCriticalSection;
+    FBatchEvent : THandle;
+    FBatches : TList<PIRPMON_RECORD_BATCH>;
     Procedure PortablePostMessage;
     Procedure PostRequestList;
+    Procedure PostBatches;
+    Procedure ReleaseBatches;
   Protected
     Procedure Execute; Override;
   Public
@@ -36,7 +41,7 @@ Uses
 
 Procedure TRequestThread.PortablePostMessage;
 begin
-MainFrm.OnRequest(FCurrentList);
+MainFrm.OnRequest(FCurrentList, FCurrentBatch);
 end;
 
 Procedure TRequestThread.PostRequestList;
@@ -44,58 +49,86 @@ begin
 {$IFDEF FPC}
 Synchronize(PortablePostMessage);
 {$ELSE}
-PostMessage(Application.Handle, FMsgCode, 0, lParam(FCurrentList));
+PostMessage(Application.Handle, FMsgCode, wParam(FCurrentBatch), lParam(FCurrentList));
 {$ENDIF}
 end;
 
+(* Invoked by irpmondll from its consumer thread. The batch is only queued for
+   the request thread; waiting for the main thread here would block
+   IRPMonDllStopConsumer, which the request thread calls while the main thread
+   waits for it to finish. *)
+Procedure RequestBatchCallback(ABatch:PIRPMON_RECORD_BATCH; AContext:Pointer); StdCall;
+Var
+  t : TRequestThread;
+begin
+t := TRequestThread(AContext);
+EnterCriticalSection(t.FBatchLock);
+t.FBatches.Add(ABatch);
+LeaveCriticalSection(t.FBatchLock);
+SetEvent(t.FBatchEvent);
+end;
+
+(* Hands the queued batches to the main form. The records stay in the batch
+   until the main form returns it, so they are not copied. *)
+Procedure TRequestThread.PostBatches;
+Var
+  I : Integer;
+  J : Integer;
+  r : PIRPMON_BATCH_RECORD;
+  b : TList<PIRPMON_RECORD_BATCH>;
+begin
+b := TList<PIRPMON_RECORD_BATCH>.Create;
+EnterCriticalSection(FBatchLock);
+b.AddRange(FBatches);
+FBatches.Clear;
+LeaveCriticalSection(FBatchLock);
+For I := 0 To b.Count - 1 Do
+  begin
+  FCurrentBatch := b[I];
+  FCurrentList := TList<PREQUEST_GENERAL>.Create;
+  FCurrentList.Capacity := FCurrentBatch.Count;
+  r := FCurrentBatch.Records;
+  For J := 0 To Integer(FCurrentBatch.Count) - 1 Do
+    begin
+    FCurrentList.Add(PREQUEST_GENERAL(r.Header));
+    Inc(r);
+    end;
+
+  PostRequestList;
+  end;
+
+b.Free;
+end;
+
+(* Returns batches the main form will not receive. Called after the consumer
+   has stopped, so no batch can be queued any more. *)
+Procedure TRequestThread.ReleaseBatches;
+Var
+  I : Integer;
+begin
+For I := 0 To FBatches.Count - 1 Do
+  IRPMonDllConsumerBatchRelease(FBatches[I]);
+
+FBatches.Clear;
+end;
+
 Procedure TRequestThread.Execute;
 Var
-  rq : PREQUEST_GENERAL;
   err : Cardinal;
-  otw : Packed Array [0..1] Of THandle;
-  l : TList<PREQUEST_GENERAL>;
+  handles : Array [0..1] Of THandle;
 begin
 FreeOnTerminate := False;
-l := TList<PREQUEST_GENERAL>.Create;
-otw[0] := FSemaphore;
-otw[1] := FEvent;
-While Not Terminated  Do
+err := IRPMonDllStartConsumer(RequestBatchCallback, 64, 100, Self);
+If err = ERROR_SUCCESS Then
   begin
-  err := WaitForMultipleObjects(2, @otw, False, 100);
-  Case err Of
-    WAIT_OBJECT_0 : begin
-      rq := AllocMem(SizeOf(REQUEST_GENERAL));
-      If Assigned(rq) Then
-        begin
-        err := IRPMonDllGetRequest(@rq.Header, SizeOf(REQUEST_GENERAL));
-        If err = ERROR_SUCCESS Then
-          begin
-          l.Add(rq);
-          If l.Count > 20 Then
-            begin
-            FCurrentList := l;
-            PostRequestList;
-            l := TList<PREQUEST_GENERAL>.Create;
-            end;
-          end;
-
-        If err <> ERROR_SUCCESS Then
-          FreeMem(rq);
-        end;
-      end;
-    WAIT_TIMEOUT: begin
-      If l.Count > 0 Then
-        begin
-        FCurrentList := l;
-        PostRequestList;
-        l := TList<PREQUEST_GENERAL>.Create;
-        end;
-      end;
-    WAIT_OBJECT_0 + 1 : Terminate;
-    end;
-  end;
+  handles[0] := FEvent;
+  handles[1] := FBatchEvent;
+  While WaitForMultipleObjects(2, @handles, False, INFINITE) = WAIT_OBJECT_0 + 1 Do
+    PostBatches;
 
-l.Free;
+  IRPMonDllStopConsumer;
+  ReleaseBatches;
+  end;
 end;
 
 
@@ -112,17 +145,19 @@ begin
 Inherited Create(True);
 FConnected := False;
 FEvent := 0;
-FSemaphore := 0;
 FMsgCode := AMsgCode;
-FSemaphore := CreateSemaphore(Nil, 0, $7FFFFFFF, Nil);
-If FSemaphore = 0 Then
-  Raise Exception.Create(Format('CreateSemaphore: %u', [GetLastError]));
-
+FBatchEvent := 0;
+FBatches := TList<PIRPMON_RECORD_BATCH>.Create;
+InitializeCriticalSection(FBatchLock);
 FEvent := CreateEvent(Nil, False, False, Nil);
 If FEvent = 0 Then
   Raise Exception.Create(Format('CreateEvent: %u', [GetLastError]));
 
-err := IRPMonDllConnect(FSemaphore);
+FBatchEvent := CreateEvent(Nil, False, False, Nil);
+If FBatchEvent = 0 Then
+  Raise Exception.Create(Format('CreateEvent: %u', [GetLastError]));
+
+err := IRPMonDllConnect(0);
 If err <> ERROR_SUCCESS Then
   Raise Exception.Create(Format('IRPMonDllConnect: %u', [err]));
 
@@ -136,11 +171,17 @@ begin
 If FConnected Then
   IRPMonDllDisconnect;
 
+If FBatchEvent <> 0 Then
+  FileClose(FBatchEvent);
+
 If FEvent <> 0 Then
   FileClose(FEvent);{ *Převedeno z CloseHandle* }
 
-If FSemaphore <> 0 Then
-  FileClose(FSemaphore);{ *Převedeno z CloseHandle* }
+If Assigned(FBatches) Then
+  begin
+  DeleteCriticalSection(FBatchLock);
+  FBatches.Free;
+  end;
 
 Inherited Destroy;
 end;
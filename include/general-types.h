@@ -341,7 +341,87 @@ typedef struct _HOOKED_DRIVER_UMINFO {
 	PHOOKED_DEVICE_UMINFO HookedDevices;
 } HOOKED_DRIVER_UMINFO, *PHOOKED_DRIVER_UMINFO;
 
+/************************************************************************/
+/*                     HASH TABLE STATISTICS                            */
+/************************************************************************/
+
+/** Number of ChainLengthHistogram entries of the @link(HASH_TABLE_STATISTICS) structure. */
+#define HASH_TABLE_STATISTICS_HISTOGRAM_SIZE			8
+
+/** Describes distribution of items stored in a hash table. */
+typedef struct _HASH_TABLE_STATISTICS {
+	/** Number of items stored in the table. */
+	ULONG NumberOfItems;
+	/** Number of buckets. */
+	ULONG NumberOfBuckets;
+	/** Number of buckets of the old bucket array, nonzero only when the table is being rehashed. */
+	ULONG NumberOfOldBuckets;
+	/** Number of locks protecting the buckets. */
+	ULONG NumberOfLocks;
+	/** Number of nonempty buckets. */
+	ULONG UsedBuckets;
+	/** Length of the longest bucket chain. */
+	ULONG MaxChainLength;
+	/** Number of items per 100 buckets. */
+	ULONG LoadFactor;
+	/** Number of buckets with chains of given length. The last entry counts buckets
+	    with HASH_TABLE_STATISTICS_HISTOGRAM_SIZE - 1 or more items. */
+	ULONG ChainLengthHistogram[HASH_TABLE_STATISTICS_HISTOGRAM_SIZE];
+} HASH_TABLE_STATISTICS, *PHASH_TABLE_STATISTICS;
+
+/** Identifies hash tables of the IRPMon driver reporting their statistics. */
+typedef enum _EDriverHashTable {
+	/** Maps DRIVER_OBJECT addresses to driver hook records. */
+	edhtDriverHooks,
+	/** Validates addresses of driver hook records. */
+	edhtDriverValidation,
+	/** Validates addresses of device hook records. */
+	edhtDeviceValidation,
+	/** Maps process IDs to process database records. */
+	edhtProcessDatabase,
+	edhtMax,
+} EDriverHashTable, *PEDriverHashTable;
+
+/************************************************************************/
+/*                     ALLOCATOR STATISTICS                             */
+/************************************************************************/
+
+/** Determines how much work the memory allocator of the IRPMon driver does
+    on every allocation and deallocation. Each mode includes the work of the
+    preceding ones. */
+typedef enum _EDriverAllocatorMode {
+	/** Every block gets only a header and a footer. */
+	edamHeaderOnly,
+	/** Allocations, deallocations and live bytes are counted per call site. */
+	edamCounters,
+	/** Live blocks are linked into lists, the blocks not freed until the driver
+	    unloads are reported as memory leaks. */
+	edamTracking,
+	/** Validity of all live blocks is checked on every allocation and deallocation. */
+	edamValidation,
+	edamMax,
+} EDriverAllocatorMode, *PEDriverAllocatorMode;
+
+/** Maximum length of function names reported in @link(DRIVER_ALLOCATOR_SITE_STATISTICS),
+    including the terminating null character. */
+#define DRIVER_ALLOCATOR_FUNCTION_NAME_MAX			64
+
+/** Counters of one place in the IRPMon driver code that allocates memory. */
+typedef struct _DRIVER_ALLOCATOR_SITE_STATISTICS {
+	/** Name of the function performing the allocations, truncated if necessary. */
+	CHAR Function[DRIVER_ALLOCATOR_FUNCTION_NAME_MAX];
+	/** Source line performing the allocations. */
+	ULONG Line;
+	/** Number of blocks allocated. */
+	ULONG64 Allocations;
+	/** Number of blocks freed. */
+	ULONG64 Frees;
+	/** Bytes in blocks not freed yet. */
+	ULONG64 LiveBytes;
+	/** Highest value reached by the LiveBytes member. */
+	ULONG64 PeakBytes;
+} DRIVER_ALLOCATOR_SITE_STATISTICS, *PDRIVER_ALLOCATOR_SITE_STATISTICS;
 
 
 
-#endif 
+#endif
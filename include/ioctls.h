@@ -26,12 +26,34 @@
 #define IOCTL_IRPMNDRV_DRIVER_WATCH_REGISTER		   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x14, METHOD_NEITHER, FILE_WRITE_ACCESS)
 #define IOCTL_IRPMNDRV_DRIVER_WATCH_UNREGISTER		   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x15, METHOD_NEITHER, FILE_WRITE_ACCESS)
 #define IOCTL_IRPMNDRV_DRIVER_WATCH_ENUM			   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x16, METHOD_NEITHER, FILE_READ_ACCESS)
+#define IOCTL_IRPMNDRV_HOOK_BATCH                      CTL_CODE(FILE_DEVICE_UNKNOWN, 0x17, METHOD_NEITHER, FILE_WRITE_ACCESS)
+#define IOCTL_IRPMNDRV_UNHOOK_BATCH                    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x18, METHOD_NEITHER, FILE_WRITE_ACCESS)
+#define IOCTL_IRPMNDRV_HASH_TABLE_STATS                CTL_CODE(FILE_DEVICE_UNKNOWN, 0x19, METHOD_NEITHER, FILE_READ_ACCESS)
+#define IOCTL_IRPMNDRV_ALLOCATOR_STATS                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x1a, METHOD_NEITHER, FILE_READ_ACCESS)
+#define IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE              CTL_CODE(FILE_DEVICE_UNKNOWN, 0x1b, METHOD_NEITHER, FILE_WRITE_ACCESS)
+#define IOCTL_IRPMNDRV_GET_RECORD_PENDING              CTL_CODE(FILE_DEVICE_UNKNOWN, 0x1c, METHOD_OUT_DIRECT, FILE_READ_ACCESS)
+#define IOCTL_IRPMNDRV_GET_OBJECT_CHANGES              CTL_CODE(FILE_DEVICE_UNKNOWN, 0x1d, METHOD_NEITHER, FILE_READ_ACCESS)
 
 
 typedef struct _IOCTL_IRPMNDRV_CONNECT_INPUT {
 	HANDLE SemaphoreHandle;
 } IOCTL_IRPMNDRV_CONNECT_INPUT, *PIOCTL_IRPMNDRV_CONNECT_INPUT;
 
+/** Precedes every record returned by IOCTL_IRPMNDRV_GET_RECORD_PENDING. The request
+    is completed when at least one record is available and carries as many records
+    as fit into the output buffer. Each entry starts at an offset aligned to
+    IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT. If the first record does not fit,
+    the request fails with STATUS_BUFFER_TOO_SMALL and its Information member
+    contains the buffer size required. */
+typedef struct _IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY {
+	/** Size of the record following this structure, in bytes. */
+	ULONG Size;
+	ULONG Reserved;
+	// REQUEST_XXX
+} IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY, *PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY;
+
+#define IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT		sizeof(ULONG64)
+
 typedef struct _IOCTL_IRPMNDRV_HOOK_DRIVER_INPUT {
 	PWCHAR DriverName;
 	ULONG DriverNameLength;
@@ -125,6 +147,136 @@ typedef struct _IOCTL_IRPMONDRV_HOOK_CLOSE_INPUT {
 	HANDLE Handle;
 } IOCTL_IRPMONDRV_HOOK_CLOSE_INPUT, *PIOCTL_IRPMONDRV_HOOK_CLOSE_INPUT;
 
+/************************************************************************/
+/*                   BATCH HOOKING                                      */
+/************************************************************************/
+
+/** Activate monitoring of all drivers hooked by the batch. */
+#define HOOK_BATCH_FLAG_ACTIVATE			0x1
+
+/** Describes one driver to hook. The name is stored inside the input buffer,
+    at the given offset from its start. */
+typedef struct _IOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY {
+	ULONG DriverNameOffset;
+	ULONG DriverNameLength;
+	DRIVER_MONITOR_SETTINGS MonitorSettings;
+} IOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY, *PIOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY;
+
+/** Describes one device to hook. If DeviceNameLength is zero, the device is
+    identified by its address. The IRP and fast I/O settings apply only if
+    the corresponding Use flag is set, otherwise the device gets the settings
+    of its driver. */
+typedef struct _IOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY {
+	ULONG DeviceNameOffset;
+	ULONG DeviceNameLength;
+	PVOID DeviceAddress;
+	BOOLEAN UseIRPSettings;
+	BOOLEAN UseFastIoSettings;
+	UCHAR IRPSettings[0x1b + 1];
+	UCHAR FastIoSettings[FastIoMax];
+} IOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY, *PIOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY;
+
+/** The input buffer consists of this header, DriverCount driver entries,
+    DeviceCount device entries and the name strings. Devices are hooked after
+    all drivers are hooked (and activated, if requested), so they may belong
+    to drivers hooked by the same batch. A device of a driver that failed to
+    hook or activate is not hooked. */
+typedef struct _IOCTL_IRPMNDRV_HOOK_BATCH_INPUT {
+	ULONG Flags;
+	ULONG DriverCount;
+	ULONG DeviceCount;
+} IOCTL_IRPMNDRV_HOOK_BATCH_INPUT, *PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT;
+
+/** Result of one batch entry. */
+typedef struct _IOCTL_IRPMNDRV_HOOK_BATCH_RESULT {
+	NTSTATUS Status;
+	HANDLE Handle;
+	PVOID ObjectId;
+} IOCTL_IRPMNDRV_HOOK_BATCH_RESULT, *PIOCTL_IRPMNDRV_HOOK_BATCH_RESULT;
+
+/** The output buffer is an array of results, driver entries first, then
+    the device ones. */
+typedef struct _IOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT {
+	IOCTL_IRPMNDRV_HOOK_BATCH_RESULT Results[1];
+} IOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT, *PIOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT;
+
+typedef struct _IOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT {
+	ULONG Count;
+	HANDLE HookHandles[1];
+} IOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT, *PIOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT;
+
+typedef struct _IOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT {
+	NTSTATUS Statuses[1];
+} IOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT, *PIOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT;
+
+/************************************************************************/
+/*                   HASH TABLE STATISTICS                              */
+/************************************************************************/
+
+/** Statistics of the driver's hash tables, indexed by @link(EDriverHashTable) values. */
+typedef struct _IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT {
+	HASH_TABLE_STATISTICS Tables[edhtMax];
+} IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT, *PIOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT;
+
+/************************************************************************/
+/*                   DRIVER AND DEVICE SNAPSHOT                         */
+/************************************************************************/
+
+/** Starts the output of IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO. If the output buffer
+    is too small, the request fails with STATUS_BUFFER_TOO_SMALL and only the
+    RequiredLength member is filled, provided the buffer can hold it. */
+typedef struct _IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT {
+	/** Size of the whole snapshot, in bytes. */
+	ULONG RequiredLength;
+	/** Object change generation the snapshot is consistent with. Changes with
+	    higher generations may or may not be reflected in the snapshot. */
+	ULONG Generation;
+	ULONG DriverCount;
+	// PVOID DriverObject, ULONG DeviceCount, ULONG NameLength, WCHAR[] Name
+	//   PVOID DeviceObject, PVOID AttachedDevice, ULONG NameLength, WCHAR[] Name
+} IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT, *PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT;
+
+typedef struct _IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT {
+	/** Only changes with generations greater than this one are returned. */
+	ULONG Generation;
+} IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT, *PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT;
+
+/** Output of IOCTL_IRPMNDRV_GET_OBJECT_CHANGES. The header is followed by Count
+    driver and device detected records (REQUEST_DRIVER_DETECTED and
+    REQUEST_DEVICE_DETECTED), each preceded by IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY
+    and aligned the same way as the records of IOCTL_IRPMNDRV_GET_RECORD_PENDING.
+
+    The request fails with STATUS_NOT_FOUND when the driver no longer remembers all
+    changes after the given generation; a full snapshot must be taken instead. If
+    the output buffer is too small, the request fails with STATUS_BUFFER_TOO_SMALL
+    and only the RequiredLength member is filled. */
+typedef struct _IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT {
+	ULONG RequiredLength;
+	/** Generation of the last change returned, or the input generation if
+	    there are no changes. */
+	ULONG Generation;
+	ULONG Count;
+	ULONG Reserved;
+} IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT, *PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT;
+
+/************************************************************************/
+/*                   ALLOCATOR STATISTICS                               */
+/************************************************************************/
+
+/** Counters of the driver's memory allocator. The Sites array is as long as the
+    output buffer allows; SiteCount is set even if the buffer is too small. */
+typedef struct _IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT {
+	/** Current mode of the allocator. */
+	EDriverAllocatorMode Mode;
+	/** Number of call sites known to the allocator. */
+	ULONG SiteCount;
+	DRIVER_ALLOCATOR_SITE_STATISTICS Sites[1];
+} IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, *PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT;
+
+typedef struct _IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT {
+	EDriverAllocatorMode Mode;
+} IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT, *PIOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT;
+
 /************************************************************************/
 /*                   CLASS WATCH                                        */
 /************************************************************************/
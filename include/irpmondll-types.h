@@ -35,6 +35,45 @@ typedef struct _IRPMON_DRIVER_INFO {
 	PIRPMON_DEVICE_INFO *Devices;
 } IRPMON_DRIVER_INFO, *PIRPMON_DRIVER_INFO;
 
+/************************************************************************/
+/*                         BATCH HOOKING                                */
+/************************************************************************/
+
+/** Describes one driver to hook by the @link(IRPMonDllHookBatch) function. */
+typedef struct _IRPMON_HOOK_DRIVER_BATCH_ENTRY {
+	/** Name of the driver object, e.g. "\Driver\disk". */
+	PWCHAR DriverName;
+	/** Monitoring settings of the driver. */
+	DRIVER_MONITOR_SETTINGS MonitorSettings;
+	/** Receives result of the hook operation for this driver (Win32 error code). */
+	DWORD Result;
+	/** Receives handle to the hooked driver. Valid only if Result is ERROR_SUCCESS. */
+	HANDLE DriverHandle;
+	/** Receives ID of the hooked driver. Valid only if Result is ERROR_SUCCESS. */
+	PVOID ObjectId;
+} IRPMON_HOOK_DRIVER_BATCH_ENTRY, *PIRPMON_HOOK_DRIVER_BATCH_ENTRY;
+
+/** Describes one device to hook by the @link(IRPMonDllHookBatch) function. */
+typedef struct _IRPMON_HOOK_DEVICE_BATCH_ENTRY {
+	/** Name of the device object. If set to NULL, the device is identified
+	    by the DeviceAddress member. */
+	PWCHAR DeviceName;
+	/** Address of the device object. Used only when DeviceName is NULL. */
+	PVOID DeviceAddress;
+	/** Optional array of IRP_MJ_MAXIMUM_FUNCTION + 1 entries, indicating which
+	    IRP types are monitored. If NULL, the device gets the settings of its driver. */
+	PUCHAR IRPSettings;
+	/** Optional array of FastIoMax entries, indicating which fast I/O types
+	    are monitored. If NULL, the device gets the settings of its driver. */
+	PUCHAR FastIoSettings;
+	/** Receives result of the hook operation for this device (Win32 error code). */
+	DWORD Result;
+	/** Receives handle to the hooked device. Valid only if Result is ERROR_SUCCESS. */
+	HANDLE DeviceHandle;
+	/** Receives ID of the hooked device. Valid only if Result is ERROR_SUCCESS. */
+	PVOID ObjectId;
+} IRPMON_HOOK_DEVICE_BATCH_ENTRY, *PIRPMON_HOOK_DEVICE_BATCH_ENTRY;
+
 /************************************************************************/
 /*                  CLASS WATCHES                                       */
 /************************************************************************/
@@ -55,6 +94,77 @@ typedef struct _DRIVER_NAME_WATCH_RECORD {
 	PWCHAR DriverName;
 } DRIVER_NAME_WATCH_RECORD, *PDRIVER_NAME_WATCH_RECORD;
 
+/************************************************************************/
+/*                OVERLAPPED RECORD RETRIEVAL                           */
+/************************************************************************/
+
+/** Receives one record retrieved by the overlapped record fetching (see
+ *  @link(IRPMonDllFetchStart)).
+ *
+ *  @param Request The record. The memory is valid only during the call.
+ *  @param Size Size of the record, in bytes.
+ *  @param Context Value passed to @link(IRPMonDllFetchStart).
+ */
+typedef VOID (WINAPI IRPMON_RECORD_CALLBACK)(PREQUEST_HEADER Request, ULONG Size, PVOID Context);
+
+/** One record of a batch delivered by the record consumer. */
+typedef struct _IRPMON_BATCH_RECORD {
+	/** The record, points into the Data block of the batch. */
+	PREQUEST_HEADER Header;
+	/** Size of the record, in bytes. */
+	ULONG Size;
+} IRPMON_BATCH_RECORD, *PIRPMON_BATCH_RECORD;
+
+/** A batch of records delivered by the record consumer (see
+ *  @link(IRPMonDllStartConsumer)). The batch is read-only and remains valid
+ *  until it is returned by @link(IRPMonDllConsumerBatchRelease).
+ */
+typedef struct _IRPMON_RECORD_BATCH {
+	/** Number of records in the batch. */
+	ULONG Count;
+	/** The records, in the queue order. */
+	PIRPMON_BATCH_RECORD Records;
+	/** Number of bytes occupied by the records in the Data block. */
+	ULONG Length;
+	/** Contiguous memory block holding all the records. */
+	PVOID Data;
+} IRPMON_RECORD_BATCH, *PIRPMON_RECORD_BATCH;
+
+/** Receives one batch of records from the record consumer.
+ *
+ *  @param Batch The batch. The consumer owns it until it is returned by
+ *  @link(IRPMonDllConsumerBatchRelease), possibly from another thread.
+ *  @param Context Value passed to @link(IRPMonDllStartConsumer).
+ */
+typedef VOID (WINAPI IRPMON_BATCH_CALLBACK)(PIRPMON_RECORD_BATCH Batch, PVOID Context);
+
+/************************************************************************/
+/*                       MOCK DRIVER                                    */
+/************************************************************************/
+
+/** Configures the in-process mock driver (see @link(IRPMonDllInitializeMock)). */
+typedef struct _IRPMON_MOCK_SETTINGS {
+	/** Number of records produced per second after the connection. Zero means
+	    records are always available and the consumer determines the rate. */
+	ULONG RecordsPerSecond;
+	/** Maximum number of records waiting for retrieval. Newer records are dropped
+	    when the limit is reached. Zero means no limit. */
+	ULONG QueueLimit;
+	/** Number of drivers reported by the snapshot. */
+	ULONG DriverCount;
+	/** Number of devices of each driver. */
+	ULONG DevicesPerDriver;
+} IRPMON_MOCK_SETTINGS, *PIRPMON_MOCK_SETTINGS;
+
+/** Counters of the mock driver. Generated equals the sum of the other members. */
+typedef struct _IRPMON_MOCK_STATISTICS {
+	ULONGLONG Generated;
+	ULONGLONG Delivered;
+	/** Records dropped because of the queue limit or the disconnection. */
+	ULONGLONG Dropped;
+	ULONGLONG Pending;
+} IRPMON_MOCK_STATISTICS, *PIRPMON_MOCK_STATISTICS;
+
 
 
 #endif 
@@ -39,6 +39,8 @@
  *   * Disconnect the process by calling the @link(IRPMonDllDisconnect) function.
  *   * Retrieve individual events from the queue via the @link(IRPMonDllGetRequest)
  *     function.
+ *   * Alternatively, let @link(IRPMonDllStartConsumer) deliver the events in batches. The semaphore
+ *     is not needed in that case.
  */
 
 #ifndef __IRPMONDLL_H__
@@ -78,7 +80,8 @@
  *
  *  @remark
  *  When the caller no longer needs the retrieved information, it must free it by calling
- *  the @link(IRPMonDllDriverHooksFree) procedure.
+ *  the @link(IRPMonDllDriverHooksFree) procedure. The structures, device arrays and names
+ *  share one memory block, so none of them can be freed separately.
  */
 IRPMONDLL_API DWORD WINAPI IRPMonDllDriverHooksEnumerate(PHOOKED_DRIVER_UMINFO *HookedDrivers, PULONG Count);
 
@@ -211,6 +214,50 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllDriverSetInfo(HANDLE DriverHandle, PDRIVER_M
 IRPMONDLL_API DWORD WINAPI IRPMonDllUnhookDriver(HANDLE DriverHandle);
 
 
+/** Hooks multiple drivers and devices in a single round-trip to the IRPMon driver.
+ *
+ *  @param Drivers Array of drivers to hook. Upon return, each entry contains result of
+ *  the operation, hook handle and object ID of the driver.
+ *  @param DriverCount Number of entries in the Drivers array.
+ *  @param Devices Array of devices to hook. Upon return, each entry contains result of
+ *  the operation, hook handle and object ID of the device. Can be NULL if DeviceCount is zero.
+ *  @param DeviceCount Number of entries in the Devices array.
+ *  @param Activate Start monitoring of all successfully hooked drivers.
+ *
+ *  @return
+ *  The function may return one of the following error codes:
+ *  @value ERROR_SUCCESS The batch has been processed. Results of individual operations
+ *  are stored in the Result members of the array entries.
+ *  @value Other The batch could not be processed, no driver or device has been hooked.
+ *
+ *  @remark
+ *  All drivers are hooked first (the IRPMon driver inserts them into its tables during
+ *  a single lock acquisition) and activated, devices are hooked afterwards, so they may belong
+ *  to the drivers from the same batch. If activation of a driver fails, the driver is unhooked
+ *  and the failure is reported in its Result member; its devices are not hooked then.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllHookBatch(PIRPMON_HOOK_DRIVER_BATCH_ENTRY Drivers, ULONG DriverCount, PIRPMON_HOOK_DEVICE_BATCH_ENTRY Devices, ULONG DeviceCount, BOOLEAN Activate);
+
+
+/** Unhooks multiple drivers in a single round-trip to the IRPMon driver.
+ *
+ *  @param DriverHandles Array of handles to the hooked drivers.
+ *  @param Count Number of handles in the array.
+ *  @param Results Optional array that receives a Win32 error code for each handle.
+ *
+ *  @return
+ *  The function may return one of the following error codes:
+ *  @value ERROR_SUCCESS The batch has been processed. Results of individual operations
+ *  are stored in the Results array.
+ *  @value Other The batch could not be processed.
+ *
+ *  @remark
+ *  Unlike @link(IRPMonDllUnhookDriver), the monitoring needs not to be stopped
+ *  before the call. Handles of successfully unhooked drivers become invalid.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllUnhookDriverBatch(PHANDLE DriverHandles, ULONG Count, PDWORD Results);
+
+
 /** Starts monitoring events related to a given device, identified by its object name.
  *
  *  @param DeviceName Name of the device object to be monitored. It can be obtained from
@@ -289,6 +336,8 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllUnhookDevice(HANDLE HookHandle);
  *  @remark
  *  When the caller no longer needs the information retrieved by the routine,
  *  it must free it by calling the @link(IRPMonDllSnapshotFree) procedure.
+ *  The array, the structures and their names share one memory block, so
+ *  no part of the snapshot can be freed or kept separately.
  */
 IRPMONDLL_API DWORD WINAPI IRPMonDllSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG Count);
 
@@ -305,6 +354,56 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllSnapshotRetrieve(PIRPMON_DRIVER_INFO **Drive
 IRPMONDLL_API VOID WINAPI IRPMonDllSnapshotFree(PIRPMON_DRIVER_INFO *DriverInfo, ULONG Count);
 
 
+/** Retrieves information about driver and device objects currently present
+ *  in the system, together with the object change generation the information
+ *  is consistent with.
+ *
+ *  @param DriverInfo Address of variable that receives address of an array of
+ *  pointers to IRPMON_DRIVER_INFO structures. Free it by @link(IRPMonDllSnapshotFree).
+ *  @param Count Address of variable that receives the number of structures in the 
+ *  array.
+ *  @param Generation Address of variable that receives the generation. Pass it to
+ *  @link(IRPMonDllObjectChangesGet) to learn about objects detected later.
+ *
+ *  @return
+ *  The routine may return one of the following values:
+ *  @value ERROR_SUCCESS The snapshot has been retrieved successfully.
+ *  @value Other An error occurred.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllSnapshotRetrieveEx(PIRPMON_DRIVER_INFO **DriverInfo, PULONG Count, PULONG Generation);
+
+
+/** Retrieves driver and device detected records of objects that appeared
+ *  after a given generation.
+ *
+ *  @param Generation Address of variable that holds the generation returned by
+ *  @link(IRPMonDllSnapshotRetrieveEx) or by the previous call of this routine.
+ *  On success, it receives the generation of the last returned change.
+ *  @param Changes Address of variable that receives the records (REQUEST_DRIVER_DETECTED
+ *  and REQUEST_DEVICE_DETECTED), in the order they were detected. Free them
+ *  by @link(IRPMonDllObjectChangesFree).
+ *
+ *  @return
+ *  The routine may return one of the following values:
+ *  @value ERROR_SUCCESS The changes have been retrieved. The batch may be empty.
+ *  @value ERROR_NOT_FOUND Some of the changes are no longer remembered by the
+ *  driver. Retrieve a new snapshot instead.
+ *  @value Other An error occurred.
+ *
+ *  @remark
+ *  The driver remembers only a limited number of recent changes and it does not
+ *  report objects that have been deleted.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllObjectChangesGet(PULONG Generation, PIRPMON_RECORD_BATCH *Changes);
+
+
+/** Frees records returned by @link(IRPMonDllObjectChangesGet).
+ *
+ *  @param Changes The records to free.
+ */
+IRPMONDLL_API VOID WINAPI IRPMonDllObjectChangesFree(PIRPMON_RECORD_BATCH Changes);
+
+
 /** Connects the current thread (the calling one) to the queue
  *  of events detected by the IRPMon driver.
  *
@@ -355,6 +454,98 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllDisconnect(VOID);
 IRPMONDLL_API DWORD WINAPI IRPMonDllGetRequest(PREQUEST_HEADER Request, DWORD Size);
 
 
+/** Starts retrieving records from the IRPMon Event Queue by overlapped requests.
+ *
+ *  @param PendingRequests Number of record requests kept pending in the driver.
+ *  @param BufferSize Size of the buffer of each request, in bytes. One request
+ *  can return multiple records.
+ *  @param ThreadCount Number of threads processing the completed requests.
+ *  @param Callback Routine invoked for every record retrieved.
+ *  @param Context Value passed to the Callback routine.
+ *
+ *  @return
+ *  Returns one of the following error codes:
+ *  @value ERROR_SUCCESS The record retrieval has started.
+ *  @value ERROR_BUSY The record retrieval is already running.
+ *  @value ERROR_INVALID_PARAMETER The buffer is too small to hold the largest
+ *  fixed size record, or the request or thread count is zero.
+ *  @value Other An error occurred.
+ *
+ *  @remark
+ *  The process must be connected to the queue by @link(IRPMonDllConnect), the
+ *  semaphore handle may be NULL. The driver completes the requests as soon as
+ *  records arrive and the requests are sent again after their records are
+ *  processed, so the retrieval overlaps with the processing and no semaphore
+ *  wait is needed.
+ *
+ *  Records of one request are delivered in the queue order. When ThreadCount
+ *  is greater than one, the Callback routine is invoked concurrently and records
+ *  of different requests may be delivered out of order; the Id member of their
+ *  headers reflects the original order.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllFetchStart(ULONG PendingRequests, ULONG BufferSize, ULONG ThreadCount, IRPMON_RECORD_CALLBACK *Callback, PVOID Context);
+
+
+/** Stops the record retrieval started by @link(IRPMonDllFetchStart).
+ *
+ *  @remark
+ *  The pending requests are cancelled and the function waits until all the
+ *  threads processing records terminate. No callback is invoked after the
+ *  function returns. The function must not be called from the callback.
+ */
+IRPMONDLL_API VOID WINAPI IRPMonDllFetchStop(VOID);
+
+
+/** Starts delivering records of the IRPMon Event Queue in batches.
+ *
+ *  @param Callback Routine receiving the batches.
+ *  @param BatchSize Number of records after which a batch is delivered.
+ *  @param MaxLatency Maximum time a record may wait in a batch before
+ *  the batch is delivered, in milliseconds.
+ *  @param Context Value passed to the Callback routine.
+ *
+ *  @return
+ *  Returns one of the following error codes:
+ *  @value ERROR_SUCCESS The consumer has started.
+ *  @value ERROR_BUSY A consumer is already running.
+ *  @value ERROR_INVALID_PARAMETER The callback is NULL, the batch size is zero
+ *  or the latency is INFINITE.
+ *  @value Other An error occurred.
+ *
+ *  @remark
+ *  The process must be connected to the queue by @link(IRPMonDllConnect), the
+ *  semaphore handle may be NULL.
+ *
+ *  The library owns a thread that retrieves the records directly into buffers
+ *  of a small pool and invokes the Callback routine from that thread. The records
+ *  of a batch are stored in one contiguous block, in the queue order, and must not
+ *  be modified. The caller returns each batch by @link(IRPMonDllConsumerBatchRelease)
+ *  when it is done with it, from any thread. While all the buffers are held by the
+ *  caller, no records are retrieved and they wait in the queue.
+ *
+ *  A batch may contain more than BatchSize records when they arrive together, and
+ *  fewer of them when MaxLatency elapses or a large record does not fit.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllStartConsumer(IRPMON_BATCH_CALLBACK *Callback, ULONG BatchSize, ULONG MaxLatency, PVOID Context);
+
+
+/** Stops the consumer started by @link(IRPMonDllStartConsumer).
+ *
+ *  @remark
+ *  No callback is invoked after the function returns. Batches not returned yet
+ *  remain valid and must still be released by @link(IRPMonDllConsumerBatchRelease).
+ *  The function must not be called from the callback.
+ */
+IRPMONDLL_API VOID WINAPI IRPMonDllStopConsumer(VOID);
+
+
+/** Returns a batch delivered by the consumer to its buffer pool.
+ *
+ *  @param Batch The batch. It must not be accessed after the call.
+ */
+IRPMONDLL_API VOID WINAPI IRPMonDllConsumerBatchRelease(PIRPMON_RECORD_BATCH Batch);
+
+
 /** Open a handle to a given driver monitored by the IRPMon driver.
  *
  *  @param ObjectId ID of the target driver. IDs can be obtained from the
@@ -433,6 +624,62 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllDriverNameWatchUnregister(PWCHAR DriverName)
 IRPMONDLL_API DWORD WINAPI IRPMonDllDriverNameWatchEnum(PDRIVER_NAME_WATCH_RECORD *Array, PULONG Count);
 IRPMONDLL_API VOID WINAPI IRPMonDllDriverNameWatchEnumFree(PDRIVER_NAME_WATCH_RECORD Array, ULONG Count);
 
+/** Retrieves statistics of hash tables maintained by the IRPMon driver.
+ *
+ *  @param Statistics Array of edhtMax structures. The structure at index given by
+ *  a @link(EDriverHashTable) value receives statistics of the corresponding table.
+ *
+ *  @return
+ *  Returns one of the following error codes:
+ *  @value ERROR_SUCCESS The statistics have been retrieved.
+ *  @value Other An error occurred.
+ *
+ *  @remark
+ *  The statistics (chain length histogram, maximum chain length, load factor) are
+ *  meant for diagnostics of hash function quality and table sizing.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllHashTableStatistics(PHASH_TABLE_STATISTICS Statistics);
+
+/** Retrieves counters of places in the IRPMon driver code that allocate memory.
+ *
+ *  @param Mode Address of variable that receives the current mode of the driver's
+ *  memory allocator.
+ *  @param Sites Address of variable that receives array of the counters. The array
+ *  must be freed by @link(IRPMonDllAllocatorStatisticsFree) when no longer needed.
+ *  @param Count Address of variable that receives number of elements in the array.
+ *
+ *  @return
+ *  Returns one of the following error codes:
+ *  @value ERROR_SUCCESS The counters have been retrieved.
+ *  @value Other An error occurred.
+ *
+ *  @remark
+ *  The counters are maintained only for allocations made while the allocator
+ *  was in edamCounters or a higher mode (see @link(IRPMonDllAllocatorSetMode)).
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllAllocatorStatistics(PEDriverAllocatorMode Mode, PDRIVER_ALLOCATOR_SITE_STATISTICS *Sites, PULONG Count);
+
+/** Frees an array returned by @link(IRPMonDllAllocatorStatistics).
+ *
+ *  @param Sites The array to free. Can be NULL.
+ */
+IRPMONDLL_API VOID WINAPI IRPMonDllAllocatorStatisticsFree(PDRIVER_ALLOCATOR_SITE_STATISTICS Sites);
+
+/** Changes the amount of bookkeeping the IRPMon driver's memory allocator does.
+ *
+ *  @param Mode The new mode.
+ *
+ *  @return
+ *  Returns one of the following error codes:
+ *  @value ERROR_SUCCESS The mode has been changed.
+ *  @value Other An error occurred.
+ *
+ *  @remark
+ *  The mode applies to blocks allocated after the change. The edamHeaderOnly mode
+ *  is the cheapest one and the default for release builds of the driver.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllAllocatorSetMode(EDriverAllocatorMode Mode);
+
 
 /************************************************************************/
 /*           INITIALIZATION AND FINALIZATION                            */
@@ -454,6 +701,40 @@ IRPMONDLL_API VOID WINAPI IRPMonDllDriverNameWatchEnumFree(PDRIVER_NAME_WATCH_RE
 IRPMONDLL_API DWORD WINAPI IRPMonDllInitialize(VOID);
 
 
+/** Initializes the IRPMon library on top of an in-process mock driver instead
+ *  of the IRPMon driver.
+ *
+ *  @param Settings Determines the drivers and devices reported by the mock driver
+ *  and the rate at which it produces IRP records once a client connects.
+ *
+ *  @return
+ *  Returns one of the following error codes:
+ *  @value ERROR_SUCCESS The operation succeeded.
+ *  @value Other The initialization failed. No other library functions may be
+ *  called.
+ *
+ *  @remark
+ *  The mock driver needs neither the driver nor administrator privileges and
+ *  is intended for testing and measuring the record consumer (see
+ *  @link(IRPMonDllStartConsumer)). It supports connection, record retrieval,
+ *  snapshots and change queries; requests that change the system, such as hooking,
+ *  fail with ERROR_NOT_SUPPORTED, as does @link(IRPMonDllFetchStart).
+ *  The library is finalized by @link(IRPMonDllFinalize) as usual.
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllInitializeMock(PIRPMON_MOCK_SETTINGS Settings);
+
+
+/** Retrieves counters of the mock driver.
+ *
+ *  @param Statistics Receives the counters.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_NOT_SUPPORTED if the library was not initialized
+ *  by @link(IRPMonDllInitializeMock).
+ */
+IRPMONDLL_API DWORD WINAPI IRPMonDllMockStatistics(PIRPMON_MOCK_STATISTICS Statistics);
+
+
 /** Disconnects the current process from the IRPMon driver and cleans up
  *  resources used by the library.
  *
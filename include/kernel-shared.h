@@ -16,6 +16,10 @@
 
 /** Name of the communication device visible for user mode applications. */
 #define IRPMNDRV_USER_DEVICE_NAME      L"\\\\.\\IRPMnDrv"
+/** File name appended to the device name to open a handle used only for overlapped
+    record retrieval (IOCTL_IRPMNDRV_GET_RECORD_PENDING). Closing such handle does
+    not disconnect the process from the IRPMon Event Queue. */
+#define IRPMNDRV_RECORDS_FILE_NAME     L"\\Records"
 
 /************************************************************************/
 /*                   HOOKED DRIVERS AND DEVICES                         */
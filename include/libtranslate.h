@@ -114,9 +114,80 @@ typedef enum {
    ltivtDCCPPort,
    /** Windows error codes. */
    ltivtWindowsError,
+   /** IOCTL and FSCTL codes (IOCTL_XXX and FSCTL_XXX constants). Unknown codes
+       are decoded into their CTL_CODE parts. */
    ltivtDeviceControl,
 } ELibTranslateIntegerValueType, *PELibTranslateIntegerValueType;
 
+/** Defines sources of descriptions of NTSTATUS values and Windows error codes. */
+typedef enum {
+   /** The descriptions are retrieved from message tables of the system via the
+       FormatMessage routine. This is the default source. */
+   ltdsSystem,
+   /** The descriptions are looked up in a prebuilt description blob. */
+   ltdsBlob,
+   /** No descriptions are provided. NTSTATUS values are described as "N / A",
+       Windows error codes get empty descriptions. */
+   ltdsNone,
+} ELibTranslateDescriptionSource, *PELibTranslateDescriptionSource;
+
+/** Value of the Signature member of @link(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER) ('LTDB'). */
+#define LIBTRANSLATE_DESCRIPTION_BLOB_SIGNATURE      0x4244544C
+/** Current version of the description blob format. */
+#define LIBTRANSLATE_DESCRIPTION_BLOB_VERSION        1
+
+/** Starts a description blob.
+ *
+ *  The header is followed by NTSTATUSCount @link(LIBTRANSLATE_DESCRIPTION_BLOB_RECORD)
+ *  structures for NTSTATUS values and by WindowsErrorCount structures for Windows
+ *  error codes. Records of each group are sorted by the Code member in ascending order,
+ *  no code may appear twice within a group. The records are followed by the descriptions,
+ *  null-terminated UTF-16 strings. The blob must end with a null character.
+ */
+typedef struct _LIBTRANSLATE_DESCRIPTION_BLOB_HEADER {
+   /** Must be set to LIBTRANSLATE_DESCRIPTION_BLOB_SIGNATURE. */
+   ULONG32 Signature;
+   /** Must be set to LIBTRANSLATE_DESCRIPTION_BLOB_VERSION. */
+   ULONG32 Version;
+   /** Number of records describing NTSTATUS values. */
+   ULONG32 NTSTATUSCount;
+   /** Number of records describing Windows error codes. */
+   ULONG32 WindowsErrorCount;
+} LIBTRANSLATE_DESCRIPTION_BLOB_HEADER, *PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER;
+
+/** Maps one NTSTATUS value or Windows error code to its description inside a description blob. */
+typedef struct _LIBTRANSLATE_DESCRIPTION_BLOB_RECORD {
+   /** The NTSTATUS value or Windows error code. */
+   ULONG32 Code;
+   /** Offset of the description, relative to the start of the blob. Must be aligned
+       to the size of WCHAR. */
+   ULONG32 Offset;
+} LIBTRANSLATE_DESCRIPTION_BLOB_RECORD, *PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD;
+
+/** Number of ChainLengthHistogram entries of the @link(LIBTRANSLATE_HASH_TABLE_STATISTICS) structure. */
+#define LIBTRANSLATE_HASH_TABLE_HISTOGRAM_SIZE       8
+
+/** Describes distribution of items stored in one of the hash tables used by the library. */
+typedef struct _LIBTRANSLATE_HASH_TABLE_STATISTICS {
+   /** Number of items stored in the table. */
+   ULONG NumberOfItems;
+   /** Number of buckets. */
+   ULONG NumberOfBuckets;
+   /** Number of buckets of the old bucket array, nonzero only when the table is being rehashed. */
+   ULONG NumberOfOldBuckets;
+   /** Number of locks protecting the buckets. */
+   ULONG NumberOfLocks;
+   /** Number of nonempty buckets. */
+   ULONG UsedBuckets;
+   /** Length of the longest bucket chain. */
+   ULONG MaxChainLength;
+   /** Number of items per 100 buckets. */
+   ULONG LoadFactor;
+   /** Number of buckets with chains of given length. The last entry counts buckets
+       with LIBTRANSLATE_HASH_TABLE_HISTOGRAM_SIZE - 1 or more items. */
+   ULONG ChainLengthHistogram[LIBTRANSLATE_HASH_TABLE_HISTOGRAM_SIZE];
+} LIBTRANSLATE_HASH_TABLE_STATISTICS, *PLIBTRANSLATE_HASH_TABLE_STATISTICS;
+
 /** Converts a given system enumeration value to its string representation.
  *
  *  @param Type Type of the system enumeration value.
@@ -149,6 +220,17 @@ LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateEnumerationValueToString(ELibTranslate
  *  system constant type is specified, or the given system constant is not recognized by
  *  the library, the routine returns L"unknown" which must not bee freed and is also located
  *  in a read-only memory.
+ *
+ *  @remark
+ *  Descriptions of NTSTATUS values and Windows error codes are looked up when requested
+ *  for the first time (see @link(LibTranslateSetDescriptionSource)). The returned strings
+ *  remain valid until the library is finalized or the description source is changed.
+ *
+ *  IOCTL codes not known to the library are decoded into device type, function number,
+ *  transfer method and required access, such as
+ *  L"CTL_CODE(FILE_DEVICE_DISK, 0x801, METHOD_BUFFERED, FILE_ANY_ACCESS)". The decoded
+ *  strings are cached (up to several thousands of codes) and remain valid until the library
+ *  is finalized. If the cache is full, L"Unknown" is returned for codes not in it.
  */
 LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateGeneralIntegerValueToString(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value);
 
@@ -177,6 +259,73 @@ LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateGeneralIntegerValueToString(ELibTransl
  */
 LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateBitMaskValueToString(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value);
 
+/** Converts an array of system enumeration values to their string representations.
+ *
+ *  @param Type Type of the system enumeration values.
+ *  @param Description Determines whether the routine will return string representations
+ *  of the values (FALSE value), or descriptions of their meaning (TRUE value).
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the strings. Must have room for Count elements.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the enumeration type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to L"unknown".
+ *
+ *  @remark
+ *  Each returned string is the same as the one returned by
+ *  @link(LibTranslateEnumerationValueToString) for the corresponding value and
+ *  must not be freed. Translating many values by one call avoids per-call overhead.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateEnumerationValuesToStrings(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings);
+
+/** Converts an array of system constant values to their string representations.
+ *
+ *  @param Type Type of the constants.
+ *  @param Description If set to FALSE the routine returns string representations of the
+ *  constants. If set to TRUE, it returns their descriptions.
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the strings. Must have room for Count elements.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the constant type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to L"unknown".
+ *
+ *  @remark
+ *  Each returned string is the same as the one returned by
+ *  @link(LibTranslateGeneralIntegerValueToString) for the corresponding value and
+ *  must not be freed. The lookups of several values are interleaved, so translating
+ *  large arrays (such as NTSTATUS values or IOCTL codes of all records in a snapshot)
+ *  is considerably faster than calling LibTranslateGeneralIntegerValueToString for
+ *  each of them.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateGeneralIntegerValuesToStrings(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings);
+
+/** Converts a given bit mask value to a string containing either names for the
+ *  nonzero bits, or human-readable descriptions for them, and stores the string
+ *  in a caller-supplied buffer.
+ *
+ *  @param Type Type of bit mask to convert.
+ *  @param Description Determines whether the routine should produce names of the nonzero
+ *  bits (FALSE value) or their human-readable descriptions (TRUE value).
+ *  @param Value A bit mask value to convert.
+ *  @param Buffer Buffer to receive the null-terminated string.
+ *  @param BufferLength Length of the buffer, in characters.
+ *  @param RequiredLength Address of variable that receives length of the string, in characters,
+ *  including the terminating null character.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the buffer is too small, ERROR_INSUFFICIENT_BUFFER is
+ *  returned, the content of the buffer is undefined and RequiredLength receives the length needed.
+ *  ERROR_INVALID_PARAMETER indicates the bit mask type is not supported.
+ *
+ *  @remark
+ *  The resulting string is the same as the one returned by @link(LibTranslateBitMaskValueToString),
+ *  however, the routine allocates no memory, so there is nothing to free.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateBitMaskValueToBuffer(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+
 /** Frees a string returned by the @link(LibTranslateBitMaskValueToString) function.
  *
  *  @param Value Address of a string to free.
@@ -289,6 +438,177 @@ LIBTRANSLATEAPI DWORD WINAPI LibTranslateNTSTATUSCodeToWindowsError(NTSTATUS Sta
 
 LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateIRPFLagsToString(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description);
 
+/** Converts flags of a given IRP to a string and stores it in a caller-supplied buffer.
+ *
+ *  @param MajorFunction Major function of the IRP.
+ *  @param MinorFunction Minor function of the IRP.
+ *  @param IRPFlags The flags.
+ *  @param Description Determines whether the routine should produce names of the flags
+ *  (FALSE value) or their human-readable descriptions (TRUE value).
+ *  @param Buffer Buffer to receive the null-terminated string.
+ *  @param BufferLength Length of the buffer, in characters.
+ *  @param RequiredLength Address of variable that receives length of the string, in characters,
+ *  including the terminating null character.
+ *
+ *  @return
+ *  Returns the same values as @link(LibTranslateBitMaskValueToBuffer).
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateIRPFlagsToBuffer(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+
+/** Retrieves statistics of the hash table keyed by a given type of system
+ *  constants.
+ *
+ *  @param Type Type of the constants. Only ltivtNTSTATUS and ltivtWindowsError
+ *  are supported, they are keys of hash tables mapping NTSTATUS values and Windows
+ *  error codes to each other. Other constants are translated through sorted arrays.
+ *  @param Statistics Address of a structure that receives the statistics.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the library does not use a hash table
+ *  for the given constant type, ERROR_NOT_SUPPORTED is returned.
+ *
+ *  @remark
+ *  The statistics (chain length histogram, maximum chain length, load factor) are
+ *  meant for diagnostics of hash function quality and table sizing.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateHashTableStatistics(ELibTranslateIntegerValueType Type, PLIBTRANSLATE_HASH_TABLE_STATISTICS Statistics);
+
+
+
+/** Selects where descriptions of NTSTATUS values and Windows error codes come from.
+ *
+ *  @param Source The new source of the descriptions.
+ *  @param Blob Address of a description blob (see @link(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER)).
+ *  Used only if Source is set to ltdsBlob. The library makes its own copy of the blob.
+ *  @param BlobSize Size of the blob, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. ERROR_INVALID_DATA is returned if the blob
+ *  is malformed.
+ *
+ *  @remark
+ *  Descriptions are looked up when requested for the first time and are remembered
+ *  until the library is finalized or the source changes. The routine invalidates
+ *  strings returned as descriptions of NTSTATUS values and Windows error codes before,
+ *  so it must not be called concurrently with other routines of the library.
+ *
+ *  A blob source does not depend on system message tables, which makes the output
+ *  identical across systems and language settings.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateSetDescriptionSource(ELibTranslateDescriptionSource Source, PVOID Blob, ULONG BlobSize);
+
+
+/** Converts a given system enumeration value to UTF-8 form of its string representation.
+ *
+ *  @param Type Type of the system enumeration value.
+ *  @param Description Determines whether the routine will return a string representation
+ *  of the value (FALSE value), or a description of its meaning (TRUE value).
+ *  @param Value Value to convert.
+ *
+ *  @return
+ *  Returns UTF-8 form of the string returned by @link(LibTranslateEnumerationValueToString).
+ *  NULL is returned if there is not enough memory to convert the strings.
+ *
+ *  @remark
+ *  The UTF-8 strings are produced from the same tables as the UTF-16 ones when first
+ *  needed, and remain valid until the library is finalized. They must not be freed.
+ */
+LIBTRANSLATEAPI PCHAR WINAPI LibTranslateEnumerationValueToStringUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value);
+
+/** Converts an array of system enumeration values to UTF-8 forms of their string
+ *  representations.
+ *
+ *  @param Type Type of the system enumeration values.
+ *  @param Description Determines whether the routine will return string representations
+ *  of the values (FALSE value), or descriptions of their meaning (TRUE value).
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the strings. Must have room for Count elements.
+ *  @param Lengths Array that receives lengths of the strings, in bytes, not including
+ *  the terminating null characters. Optional.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the enumeration type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to "Unknown".
+ *  ERROR_NOT_ENOUGH_MEMORY indicates the strings could not be converted.
+ *
+ *  @remark
+ *  The lengths allow the caller to copy the strings to its output buffers directly.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateEnumerationValuesToStringsUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths);
+
+/** Converts a given system constant value to UTF-8 form of its string representation
+ *  or description.
+ *
+ *  @param Type Type of the constant to convert.
+ *  @param Description If set to FALSE the routine returns string representation of
+ *  the constant. If set to TRUE, it returns its description.
+ *  @param Value Value to translate.
+ *
+ *  @return
+ *  Returns UTF-8 form of the string returned by @link(LibTranslateGeneralIntegerValueToString).
+ *  NULL is returned if there is not enough memory to convert the string.
+ *
+ *  @remark
+ *  The returned string must not be freed. Descriptions of NTSTATUS values and Windows
+ *  error codes are invalidated by @link(LibTranslateSetDescriptionSource).
+ */
+LIBTRANSLATEAPI PCHAR WINAPI LibTranslateGeneralIntegerValueToStringUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value);
+
+/** Converts an array of system constant values to UTF-8 forms of their string
+ *  representations or descriptions.
+ *
+ *  @param Type Type of the constants.
+ *  @param Description If set to FALSE the routine returns string representations of the
+ *  constants. If set to TRUE, it returns their descriptions.
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the strings. Must have room for Count elements.
+ *  @param Lengths Array that receives lengths of the strings, in bytes, not including
+ *  the terminating null characters. Optional.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the constant type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to "Unknown".
+ *  If some strings could not be converted due to insufficient memory, they are set
+ *  to NULL and ERROR_NOT_ENOUGH_MEMORY is returned.
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateGeneralIntegerValuesToStringsUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths);
+
+/** Converts a given bit mask value to UTF-8 string containing either names for the
+ *  nonzero bits, or human-readable descriptions for them, and stores the string
+ *  in a caller-supplied buffer.
+ *
+ *  @param Type Type of bit mask to convert.
+ *  @param Description Determines whether the routine should produce names of the nonzero
+ *  bits (FALSE value) or their human-readable descriptions (TRUE value).
+ *  @param Value A bit mask value to convert.
+ *  @param Buffer Buffer to receive the null-terminated string.
+ *  @param BufferLength Size of the buffer, in bytes.
+ *  @param RequiredLength Address of variable that receives size of the string, in bytes,
+ *  including the terminating null character.
+ *
+ *  @return
+ *  Returns the same values as @link(LibTranslateBitMaskValueToBuffer).
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateBitMaskValueToBufferUTF8(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+
+/** Converts flags of a given IRP to UTF-8 string and stores it in a caller-supplied buffer.
+ *
+ *  @param MajorFunction Major function of the IRP.
+ *  @param MinorFunction Minor function of the IRP.
+ *  @param IRPFlags The flags.
+ *  @param Description Determines whether the routine should produce names of the flags
+ *  (FALSE value) or their human-readable descriptions (TRUE value).
+ *  @param Buffer Buffer to receive the null-terminated string.
+ *  @param BufferLength Size of the buffer, in bytes.
+ *  @param RequiredLength Address of variable that receives size of the string, in bytes,
+ *  including the terminating null character.
+ *
+ *  @return
+ *  Returns the same values as @link(LibTranslateBitMaskValueToBuffer).
+ */
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateIRPFlagsToBufferUTF8(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
 
 
 /** Initializes the library. The routine must be called before any other routine
@@ -19,11 +19,37 @@
  * - size
  * - name of function that allocated it
  * - line of code that allocated it
+ *
+ * How much work is done beyond filling the header and the footer depends on the
+ * allocator mode (@link(EDriverAllocatorMode)) that can be changed at runtime.
+ * Counters of allocation sites are updated by interlocked operations only. Live
+ * blocks are linked into one of DEBUG_ALLOCATOR_SHARD_COUNT lists per memory
+ * pool, selected by the block address, so allocations and deallocations on
+ * different processors rarely compete for the same lock.
  */
 
 #include <ntifs.h>
 #include "preprocessor.h"
 #include "allocator.h"
+#include "hash_table.h"
+
+
+
+
+/************************************************************************/
+/*                      TYPE DEFINITIONS                                */
+/************************************************************************/
+
+/** One list of live blocks together with its lock. Blocks allocated from
+    nonpaged pool are protected by the spin lock, the paged ones by the resource. */
+typedef struct DECLSPEC_CACHEALIGN _DEBUG_ALLOCATOR_SHARD {
+   /** Live blocks. */
+   LIST_ENTRY Blocks;
+   /** Protects lists of nonpaged memory blocks. */
+   KSPIN_LOCK SpinLock;
+   /** Protects lists of paged memory blocks. */
+   ERESOURCE Resource;
+} DEBUG_ALLOCATOR_SHARD, *PDEBUG_ALLOCATOR_SHARD;
 
 
 /************************************************************************/
@@ -36,12 +62,20 @@ volatile LONG __security_cookie = __LINE__;
 
 static const ULONG _poolTag = (ULONG)'MPRI';
 
-/** Synchronizes access to list of paged memory blocks. */
-static ERESOURCE _pagedListLock;
-/** synchronizes access to list of nonpaged memory blocks. */
-static KSPIN_LOCK _nonPagedListLock;
-/** Lists of memory blocks. One list for one memory pool. */
-static LIST_ENTRY _poolLists [2];
+/** Lists of live blocks. One set of lists for one memory pool. */
+static DEBUG_ALLOCATOR_SHARD _shards[2][DEBUG_ALLOCATOR_SHARD_COUNT];
+/** Number of resources of paged pool shards initialized so far. */
+static ULONG _pagedShardsInitialized = 0;
+/** Table of allocation sites. */
+static PDEBUG_ALLOCATOR_SITE volatile _siteBuckets[DEBUG_ALLOCATOR_SITE_BUCKETS];
+/** Number of allocation sites in the table. */
+static volatile LONG _siteCount = 0;
+/** Current mode of the allocator, one of @link(EDriverAllocatorMode) values. */
+#ifdef _DEBUG
+static volatile LONG _mode = edamTracking;
+#else
+static volatile LONG _mode = edamHeaderOnly;
+#endif
 
 
 /************************************************************************/
@@ -59,6 +93,7 @@ static LIST_ENTRY _poolLists [2];
  */
 #define BlockHeaderInitialize(Header, PoolType, NumberOfBytes, Function, Line) \
    InitializeListHead(&Header->Entry);                \
+   Header->Site = NULL;                               \
    Header->PoolType = PoolType;                       \
    Header->NumberOfBytes = NumberOfBytes;             \
    Header->Function = Function;                       \
@@ -72,27 +107,44 @@ static LIST_ENTRY _poolLists [2];
  */
 #define BlockFooterInitialize(Footer) \
    Footer->Signature = BLOCK_FOOTER_SIGNATURE 
+
+/** Index of the shard set of given memory pool. */
+#define PoolIndex(PoolType)         ((PoolType) == PagedPool ? 1 : 0)
  
 /************************************************************************/
 /*                        HELPER ROUTIENS                               */
 /************************************************************************/
 
-/** Locks list of allocated blocks of given memory pool.
+/** Retrieves the list a given block is stored in while tracked.
  *
+ *  @param Header Header of the block.
+ *
+ *  @return
+ *  Returns the shard of the block.
+ */
+static PDEBUG_ALLOCATOR_SHARD _BlockShard(PDEBUG_BLOCK_HEADER Header)
+{
+   return &_shards[PoolIndex(Header->PoolType)][HashTablePointerHash(Header) & (DEBUG_ALLOCATOR_SHARD_COUNT - 1)];
+}
+
+
+/** Locks one list of allocated blocks of given memory pool.
+ *
+ *  @param Shard The list to lock.
  *  @param PoolType Type of memory pool.
  *  @param Irql Address of variable that, when locking list of nonpaged memory blocks,
  *  receives value of IRQL before the locking operation. The parameter is ignored when
  *  locking list of paged memory blocks.
  */
-static VOID _PoolListLock(POOL_TYPE PoolType, PKIRQL Irql)
+static VOID _PoolListLock(PDEBUG_ALLOCATOR_SHARD Shard, POOL_TYPE PoolType, PKIRQL Irql)
 {
    switch (PoolType) {
       case NonPagedPool:
-         KeAcquireSpinLock(&_nonPagedListLock, Irql);
+         KeAcquireSpinLock(&Shard->SpinLock, Irql);
          break;
       case PagedPool:
 		  KeEnterCriticalRegion();
-         ExAcquireResourceExclusiveLite(&_pagedListLock, TRUE);
+         ExAcquireResourceExclusiveLite(&Shard->Resource, TRUE);
          break;
       default:
          DEBUG_ERROR("Invalid memory pool type: %u", PoolType);
@@ -103,20 +155,21 @@ static VOID _PoolListLock(POOL_TYPE PoolType, PKIRQL Irql)
 }
 
 
-/** Unlocks list of allocated blocks of given pool type.
+/** Unlocks one list of allocated blocks of given pool type.
  *
+ *  @param Shard The list to unlock.
  *  @param PoolType Type of memory pool.
  *  @param Irql Value of IRQL which should be restored after the unlock operation is
  *  finished. The parameter is ignored when unlocking list of nonpaged memory blocks.
  */
-static VOID _PoolUnlock(POOL_TYPE PoolType, KIRQL Irql)
+static VOID _PoolUnlock(PDEBUG_ALLOCATOR_SHARD Shard, POOL_TYPE PoolType, KIRQL Irql)
 {
    switch (PoolType) {
       case NonPagedPool:
-         KeReleaseSpinLock(&_nonPagedListLock, Irql);
+         KeReleaseSpinLock(&Shard->SpinLock, Irql);
          break;
       case PagedPool:
-         ExReleaseResourceLite(&_pagedListLock);
+         ExReleaseResourceLite(&Shard->Resource);
 		 KeLeaveCriticalRegion();
          break;
       default:
@@ -128,6 +181,113 @@ static VOID _PoolUnlock(POOL_TYPE PoolType, KIRQL Irql)
 }
 
 
+/** Retrieves counters of an allocation site, creates them if the site allocates
+ *  for the first time.
+ *
+ *  @param Function Name of function performing the allocation.
+ *  @param Line Source line performing the allocation.
+ *
+ *  @return
+ *  Returns the site record. NULL is returned when the record cannot be allocated,
+ *  the allocation is not counted in such case.
+ *
+ *  @remark
+ *  New records are inserted at the head of their bucket by an interlocked
+ *  compare-exchange. If another record was inserted concurrently, the newly
+ *  inserted ones are searched again before the next attempt, so every site
+ *  gets exactly one record.
+ */
+static PDEBUG_ALLOCATOR_SITE _SiteGet(PCHAR Function, ULONG Line)
+{
+   PDEBUG_ALLOCATOR_SITE head = NULL;
+   PDEBUG_ALLOCATOR_SITE old = NULL;
+   PDEBUG_ALLOCATOR_SITE tmp = NULL;
+   PDEBUG_ALLOCATOR_SITE ret = NULL;
+   PDEBUG_ALLOCATOR_SITE volatile *bucket = NULL;
+
+   bucket = &_siteBuckets[(HashTablePointerHash(Function) ^ (Line * 0x9e3779b1)) & (DEBUG_ALLOCATOR_SITE_BUCKETS - 1)];
+   head = *bucket;
+   for (tmp = head; tmp != NULL; tmp = tmp->Next) {
+      if (tmp->Function == Function && tmp->Line == Line) {
+         ret = tmp;
+         break;
+      }
+   }
+
+   if (ret == NULL) {
+      ret = (PDEBUG_ALLOCATOR_SITE)ExAllocatePoolWithTag(NonPagedPool, sizeof(DEBUG_ALLOCATOR_SITE), _poolTag);
+      if (ret != NULL) {
+         memset(ret, 0, sizeof(DEBUG_ALLOCATOR_SITE));
+         ret->Function = Function;
+         ret->Line = Line;
+         do {
+            ret->Next = head;
+            old = (PDEBUG_ALLOCATOR_SITE)InterlockedCompareExchangePointer((PVOID volatile *)bucket, ret, head);
+            if (old == head) {
+               InterlockedIncrement(&_siteCount);
+               break;
+            }
+
+            for (tmp = old; tmp != head; tmp = tmp->Next) {
+               if (tmp->Function == Function && tmp->Line == Line)
+                  break;
+            }
+
+            if (tmp != head) {
+               ExFreePoolWithTag(ret, _poolTag);
+               ret = tmp;
+               break;
+            }
+
+            head = old;
+         } while (TRUE);
+      }
+   }
+
+   return ret;
+}
+
+
+/** Records an allocation to the counters of its site.
+ *
+ *  @param Site The site.
+ *  @param NumberOfBytes Size of the allocated block.
+ */
+static VOID _SiteAllocated(PDEBUG_ALLOCATOR_SITE Site, SIZE_T NumberOfBytes)
+{
+   LONG64 live = 0;
+   LONG64 peak = 0;
+   LONG64 old = 0;
+
+   InterlockedIncrement64(&Site->Allocations);
+   live = InterlockedAdd64(&Site->LiveBytes, (LONG64)NumberOfBytes);
+   peak = Site->PeakBytes;
+   while (live > peak) {
+      old = InterlockedCompareExchange64(&Site->PeakBytes, live, peak);
+      if (old == peak)
+         break;
+
+      peak = old;
+   }
+
+   return;
+}
+
+
+/** Records a deallocation to the counters of its site.
+ *
+ *  @param Site The site.
+ *  @param NumberOfBytes Size of the freed block.
+ */
+static VOID _SiteFreed(PDEBUG_ALLOCATOR_SITE Site, SIZE_T NumberOfBytes)
+{
+   InterlockedIncrement64(&Site->Frees);
+   InterlockedAdd64(&Site->LiveBytes, -(LONG64)NumberOfBytes);
+
+   return;
+}
+
+
 /** Checks whether given allocated block of memory is valid.
  *
  *  @param Header Header of the block to check.
@@ -156,25 +316,30 @@ static VOID _BlockValidityCheck(PDEBUG_BLOCK_HEADER Header)
 }
 
 
-/** Checks validity of all blocks in one list.
+/** Checks validity of all blocks in lists of one memory pool.
  *
- *  @param PoolType Type of memory pool which list of allocated blocks should be
+ *  @param PoolType Type of memory pool which lists of allocated blocks should be
  *  checked.
  */
 static VOID _PoolValidityCheck(POOL_TYPE PoolType)
 {
+   ULONG i = 0;
    KIRQL Irql;
+   PDEBUG_ALLOCATOR_SHARD shard = NULL;
    PDEBUG_BLOCK_HEADER header = NULL;
 //   DEBUG_ENTER_FUNCTION("PoolType=%u", PoolType);
 
-   _PoolListLock(PoolType, &Irql);
-   header = CONTAINING_RECORD(_poolLists[PoolType].Flink, DEBUG_BLOCK_HEADER, Entry);
-   while (&header->Entry != &_poolLists[PoolType]) {
-      _BlockValidityCheck(header);
-      header = CONTAINING_RECORD(header->Entry.Flink, DEBUG_BLOCK_HEADER, Entry);
-   }
+   for (i = 0; i < DEBUG_ALLOCATOR_SHARD_COUNT; ++i) {
+      shard = &_shards[PoolIndex(PoolType)][i];
+      _PoolListLock(shard, PoolType, &Irql);
+      header = CONTAINING_RECORD(shard->Blocks.Flink, DEBUG_BLOCK_HEADER, Entry);
+      while (&header->Entry != &shard->Blocks) {
+         _BlockValidityCheck(header);
+         header = CONTAINING_RECORD(header->Entry.Flink, DEBUG_BLOCK_HEADER, Entry);
+      }
 
-   _PoolUnlock(PoolType, Irql);
+      _PoolUnlock(shard, PoolType, Irql);
+   }
 
 //   DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -185,8 +350,8 @@ static VOID _PoolValidityCheck(POOL_TYPE PoolType)
  *  allocated memory blocks. 
  *
  *  @remark
- *  If called at IRQL >= DISPATCH_LEVEL, only the list of nonpaged memory
- *  blocks is checked. Otherwise, the paged one is also examined.
+ *  If called at IRQL >= DISPATCH_LEVEL, only the lists of nonpaged memory
+ *  blocks are checked. Otherwise, the paged ones are also examined.
  */
 static VOID _HeapValidityCheck(VOID)
 {
@@ -215,17 +380,22 @@ static VOID _HeapValidityCheck(VOID)
  */
 static VOID _PoolFindUnfreedMemory(POOL_TYPE PoolType)
 {
+   ULONG i = 0;
+   PLIST_ENTRY list = NULL;
    PDEBUG_BLOCK_HEADER header = NULL;
 //   DEBUG_ENTER_FUNCTION("PoolType=%u", PoolType);
 
-   header = CONTAINING_RECORD(_poolLists[PoolType].Flink, DEBUG_BLOCK_HEADER, Entry);
-   while (&header->Entry != &_poolLists[PoolType]) {
-      DEBUG_PRINT_LOCATION("A block of allocated memory has been found: 0x%p", header + 1);
-      DEBUG_PRINT_LOCATION("Pool type: %s", header->PoolType == NonPagedPool ? "nonpaged" : "paged");
-      DEBUG_PRINT_LOCATION("Size:      %u", header->NumberOfBytes);
-      DEBUG_PRINT_LOCATION("Allocated in function %s at line %u", header->Function, header->Line);
-      __debugbreak();
-      header = CONTAINING_RECORD(header->Entry.Flink, DEBUG_BLOCK_HEADER, Entry);
+   for (i = 0; i < DEBUG_ALLOCATOR_SHARD_COUNT; ++i) {
+      list = &_shards[PoolIndex(PoolType)][i].Blocks;
+      header = CONTAINING_RECORD(list->Flink, DEBUG_BLOCK_HEADER, Entry);
+      while (&header->Entry != list) {
+         DEBUG_PRINT_LOCATION("A block of allocated memory has been found: 0x%p", header + 1);
+         DEBUG_PRINT_LOCATION("Pool type: %s", header->PoolType == NonPagedPool ? "nonpaged" : "paged");
+         DEBUG_PRINT_LOCATION("Size:      %u", header->NumberOfBytes);
+         DEBUG_PRINT_LOCATION("Allocated in function %s at line %u", header->Function, header->Line);
+         __debugbreak();
+         header = CONTAINING_RECORD(header->Entry.Flink, DEBUG_BLOCK_HEADER, Entry);
+      }
    }
 
 //   DEBUG_EXIT_FUNCTION_VOID();
@@ -235,13 +405,26 @@ static VOID _PoolFindUnfreedMemory(POOL_TYPE PoolType)
 
 /** Finds allocated memory blocks that were not freed, hence they are part of a memory
  *  leak.
+ *
+ *  @remark
+ *  Only blocks allocated while the tracking was enabled can be found. Allocation
+ *  sites with bytes not freed are reported as well, they also cover blocks allocated
+ *  while only the counters were enabled.
  */
 static VOID _FindUnfreedMemory(VOID)
 {
+   ULONG i = 0;
+   PDEBUG_ALLOCATOR_SITE site = NULL;
 //   DEBUG_ENTER_FUNCTION_NO_ARGS();
 
    _PoolFindUnfreedMemory(NonPagedPool);
    _PoolFindUnfreedMemory(PagedPool);
+   for (i = 0; i < DEBUG_ALLOCATOR_SITE_BUCKETS; ++i) {
+      for (site = _siteBuckets[i]; site != NULL; site = site->Next) {
+         if (site->LiveBytes != 0)
+            DEBUG_PRINT_LOCATION("Function %s at line %u has not freed %I64d bytes (%I64d allocations, %I64d frees)", site->Function, site->Line, site->LiveBytes, site->Allocations, site->Frees);
+      }
+   }
 
 //   DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -255,15 +438,22 @@ static VOID _FindUnfreedMemory(VOID)
  */
 static VOID _PoolFree(POOL_TYPE PoolType)
 {
+   ULONG i = 0;
+   PLIST_ENTRY list = NULL;
    PDEBUG_BLOCK_HEADER old = NULL;
    PDEBUG_BLOCK_HEADER header = NULL;
    DEBUG_ENTER_FUNCTION("PoolType=%u", PoolType);
 
-   header = CONTAINING_RECORD(_poolLists[PoolType].Flink, DEBUG_BLOCK_HEADER, Entry);
-   while (&header->Entry != &_poolLists[PoolType]) {
-      old = header;
-      header = CONTAINING_RECORD(header->Entry.Flink, DEBUG_BLOCK_HEADER, Entry);
-      ExFreePool(old);
+   for (i = 0; i < DEBUG_ALLOCATOR_SHARD_COUNT; ++i) {
+      list = &_shards[PoolIndex(PoolType)][i].Blocks;
+      header = CONTAINING_RECORD(list->Flink, DEBUG_BLOCK_HEADER, Entry);
+      while (&header->Entry != list) {
+         old = header;
+         header = CONTAINING_RECORD(header->Entry.Flink, DEBUG_BLOCK_HEADER, Entry);
+         ExFreePool(old);
+      }
+
+      InitializeListHead(list);
    }
 
    DEBUG_EXIT_FUNCTION_VOID();
@@ -276,10 +466,25 @@ static VOID _PoolFree(POOL_TYPE PoolType)
  */
 static VOID _PoolsFree(VOID)
 {
+   ULONG i = 0;
+   PDEBUG_ALLOCATOR_SITE old = NULL;
+   PDEBUG_ALLOCATOR_SITE site = NULL;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
    _PoolFree(NonPagedPool);
    _PoolFree(PagedPool);
+   for (i = 0; i < DEBUG_ALLOCATOR_SITE_BUCKETS; ++i) {
+      site = _siteBuckets[i];
+      while (site != NULL) {
+         old = site;
+         site = site->Next;
+         ExFreePoolWithTag(old, _poolTag);
+      }
+
+      _siteBuckets[i] = NULL;
+   }
+
+   _siteCount = 0;
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -300,26 +505,44 @@ static VOID _PoolsFree(VOID)
  *  @return
  *  Returns address of newly allocated block of memory. If the allocation fails, 
  *  the function returns NULL.
+ *
+ *  @remark
+ *  In the edamHeaderOnly mode, the routine only fills the header and the footer
+ *  of the block.
  */
 PVOID DebugAllocatorAlloc(POOL_TYPE PoolType, SIZE_T NumberOfBytes, PCHAR Function, ULONG Line)
 {
    KIRQL Irql;
    PVOID ret = NULL;
+   EDriverAllocatorMode mode = (EDriverAllocatorMode)_mode;
+   PDEBUG_ALLOCATOR_SHARD shard = NULL;
    PDEBUG_BLOCK_HEADER header = NULL;
    PDEBUG_BLOCK_FOOTER footer = NULL;
    SIZE_T wholeSize = sizeof(DEBUG_BLOCK_HEADER) + NumberOfBytes + sizeof(DEBUG_BLOCK_FOOTER);
 //   DEBUG_ENTER_FUNCTION("PoolType=%u; NumberOfBytes=%u; Function=%s; Line=%u", PoolType, NumberOfBytes, Function, Line);
 
-   _HeapValidityCheck();
+   if (mode >= edamValidation)
+      _HeapValidityCheck();
+
    ret = ExAllocatePoolWithTag(PoolType, wholeSize, _poolTag);
    if (ret != NULL) {
       header = (PDEBUG_BLOCK_HEADER)ret;
       footer = (PDEBUG_BLOCK_FOOTER)((PUCHAR)ret + sizeof(DEBUG_BLOCK_HEADER) + NumberOfBytes);
       BlockHeaderInitialize(header, PoolType, NumberOfBytes, Function, Line);
       BlockFooterInitialize(footer);
-      _PoolListLock(PoolType, &Irql);
-      InsertTailList(&_poolLists[PoolType], &header->Entry);
-      _PoolUnlock(PoolType, Irql);
+      if (mode >= edamCounters) {
+         header->Site = _SiteGet(Function, Line);
+         if (header->Site != NULL)
+            _SiteAllocated(header->Site, NumberOfBytes);
+
+         if (mode >= edamTracking) {
+            shard = _BlockShard(header);
+            _PoolListLock(shard, PoolType, &Irql);
+            InsertTailList(&shard->Blocks, &header->Entry);
+            _PoolUnlock(shard, PoolType, Irql);
+         }
+      }
+
       ret = (PVOID)((PUCHAR)ret + sizeof(DEBUG_BLOCK_HEADER));
    }
 
@@ -331,18 +554,34 @@ PVOID DebugAllocatorAlloc(POOL_TYPE PoolType, SIZE_T NumberOfBytes, PCHAR Functi
 /** Frees a block of memory.
  *
  *  @param Address of the block, returned by DebugAllocatorAlloc routine.
+ *
+ *  @remark
+ *  The counters and the lists are updated according to the mode the block was
+ *  allocated in, not according to the current one.
  */
 VOID DebugAllocatorFree(PVOID Address)
 {
    KIRQL Irql;
+   PDEBUG_ALLOCATOR_SHARD shard = NULL;
    PDEBUG_BLOCK_HEADER header = (PDEBUG_BLOCK_HEADER)((PUCHAR)Address - sizeof(DEBUG_BLOCK_HEADER));
 //   DEBUG_ENTER_FUNCTION("Address=0x%p", Address);
 
    _BlockValidityCheck(header);
-   _HeapValidityCheck();
-   _PoolListLock(header->PoolType, &Irql);
-   RemoveEntryList(&header->Entry);
-   _PoolUnlock(header->PoolType, Irql);
+   if (_mode >= edamValidation)
+      _HeapValidityCheck();
+
+   if (header->Site != NULL)
+      _SiteFreed(header->Site, header->NumberOfBytes);
+
+   // Only the block itself links its entry into a list, so an entry
+   // pointing to itself cannot change under our hands.
+   if (header->Entry.Flink != &header->Entry) {
+      shard = _BlockShard(header);
+      _PoolListLock(shard, header->PoolType, &Irql);
+      RemoveEntryList(&header->Entry);
+      _PoolUnlock(shard, header->PoolType, Irql);
+   }
+
    ExFreePoolWithTag(header, _poolTag);
 
 //   DEBUG_EXIT_FUNCTION_VOID();
@@ -350,6 +589,92 @@ VOID DebugAllocatorFree(PVOID Address)
 }
 
 
+/** Retrieves the current mode of the allocator.
+ *
+ *  @return
+ *  Returns the mode.
+ */
+EDriverAllocatorMode DebugAllocatorGetMode(VOID)
+{
+   return (EDriverAllocatorMode)_mode;
+}
+
+
+/** Changes the amount of work the allocator does on every allocation and
+ *  deallocation.
+ *
+ *  @param Mode The new mode.
+ *
+ *  @return
+ *  Returns STATUS_SUCCESS, or STATUS_INVALID_PARAMETER if the mode is not known.
+ *
+ *  @remark
+ *  The new mode affects only blocks allocated after the change. Blocks already
+ *  allocated keep being counted and tracked (or not) until they are freed.
+ */
+NTSTATUS DebugAllocatorSetMode(EDriverAllocatorMode Mode)
+{
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+   DEBUG_ENTER_FUNCTION("Mode=%u", Mode);
+
+   status = STATUS_INVALID_PARAMETER;
+   if (Mode >= edamHeaderOnly && Mode < edamMax) {
+      InterlockedExchange(&_mode, Mode);
+      status = STATUS_SUCCESS;
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%x", status);
+   return status;
+}
+
+
+/** Retrieves counters of the allocation sites.
+ *
+ *  @param Sites Array receiving the counters. Can be NULL if MaxCount is zero.
+ *  @param MaxCount Number of elements of the Sites array.
+ *  @param SiteCount Receives number of all allocation sites known to the allocator.
+ *  It may be greater than MaxCount, only MaxCount sites are returned in such case.
+ *
+ *  @remark
+ *  The site records are never removed, so the routine needs no locking. The
+ *  counters are read while other processors may update them, the values of one
+ *  site need not be consistent with each other.
+ */
+VOID DebugAllocatorQuerySites(PDRIVER_ALLOCATOR_SITE_STATISTICS Sites, ULONG MaxCount, PULONG SiteCount)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG count = 0;
+   PDEBUG_ALLOCATOR_SITE site = NULL;
+   PDRIVER_ALLOCATOR_SITE_STATISTICS stats = Sites;
+   DEBUG_ENTER_FUNCTION("Sites=0x%p; MaxCount=%u; SiteCount=0x%p", Sites, MaxCount, SiteCount);
+
+   for (i = 0; i < DEBUG_ALLOCATOR_SITE_BUCKETS; ++i) {
+      for (site = _siteBuckets[i]; site != NULL; site = site->Next) {
+         if (count < MaxCount) {
+            for (j = 0; j < DRIVER_ALLOCATOR_FUNCTION_NAME_MAX - 1 && site->Function[j] != '\0'; ++j)
+               stats->Function[j] = site->Function[j];
+
+            stats->Function[j] = '\0';
+            stats->Line = site->Line;
+            stats->Allocations = site->Allocations;
+            stats->Frees = site->Frees;
+            stats->LiveBytes = site->LiveBytes;
+            stats->PeakBytes = site->PeakBytes;
+            ++stats;
+         }
+
+         ++count;
+      }
+   }
+
+   *SiteCount = count;
+
+   DEBUG_EXIT_FUNCTION("*SiteCount=%u", *SiteCount);
+   return;
+}
+
+
 /************************************************************************/
 /*                     INITIALIZATION AND FINALIZACTION                 */
 /************************************************************************/
@@ -358,13 +683,15 @@ VOID DebugAllocatorFree(PVOID Address)
 /** Initializes the allocator.
  *
  *  @return
- *  Always returns STATUS_SUCCESS.
+ *  Returns STATUS_SUCCESS on success, or an error status if a resource of
+ *  the paged pool lists cannot be initialized.
  */
 NTSTATUS DebugAllocatorModuleInit(VOID)
 {
 #if _MSC_VER < 1700
 	ULONG seed = 0xbadf00d;
 #endif 
+   ULONG i = 0;
    NTSTATUS status = STATUS_UNSUCCESSFUL;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
@@ -373,11 +700,24 @@ NTSTATUS DebugAllocatorModuleInit(VOID)
    // an unresolved external error on 32-bit platforms.
    __security_cookie = RtlRandom(&seed);
 #endif 
-   status = ExInitializeResourceLite(&_pagedListLock);
-   if (NT_SUCCESS(status)) {
-	   KeInitializeSpinLock(&_nonPagedListLock);
-	   InitializeListHead(&_poolLists[0]);
-	   InitializeListHead(&_poolLists[1]);
+   status = STATUS_SUCCESS;
+   for (i = 0; i < DEBUG_ALLOCATOR_SHARD_COUNT; ++i) {
+      KeInitializeSpinLock(&_shards[PoolIndex(NonPagedPool)][i].SpinLock);
+      InitializeListHead(&_shards[PoolIndex(NonPagedPool)][i].Blocks);
+      InitializeListHead(&_shards[PoolIndex(PagedPool)][i].Blocks);
+   }
+
+   for (_pagedShardsInitialized = 0; _pagedShardsInitialized < DEBUG_ALLOCATOR_SHARD_COUNT; ++_pagedShardsInitialized) {
+      status = ExInitializeResourceLite(&_shards[PoolIndex(PagedPool)][_pagedShardsInitialized].Resource);
+      if (!NT_SUCCESS(status))
+         break;
+   }
+
+   if (!NT_SUCCESS(status)) {
+      for (i = 0; i < _pagedShardsInitialized; ++i)
+         ExDeleteResourceLite(&_shards[PoolIndex(PagedPool)][i].Resource);
+
+      _pagedShardsInitialized = 0;
    }
 
    DEBUG_EXIT_FUNCTION("0x%x", status);
@@ -391,12 +731,16 @@ NTSTATUS DebugAllocatorModuleInit(VOID)
  */
 VOID DebugAllocatorModuleFinit(VOID)
 {
+   ULONG i = 0;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
    _HeapValidityCheck();
    _FindUnfreedMemory();
    _PoolsFree();
-   ExDeleteResourceLite(&_pagedListLock);
+   for (i = 0; i < _pagedShardsInitialized; ++i)
+      ExDeleteResourceLite(&_shards[PoolIndex(PagedPool)][i].Resource);
+
+   _pagedShardsInitialized = 0;
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -10,6 +10,7 @@
 #define __PNPMON_ALLOCATOR_H__
 
 #include <ntifs.h>
+#include "general-types.h"
 
 
 /** Magic signature of block header, used to detect overrides. */
@@ -18,10 +19,39 @@
 #define BLOCK_FOOTER_SIGNATURE         0xf00defdf
 
 
+/** Number of lists of live blocks kept for each memory pool. Must be a power of two. */
+#define DEBUG_ALLOCATOR_SHARD_COUNT    64
+/** Number of buckets of the table of allocation sites. Must be a power of two. */
+#define DEBUG_ALLOCATOR_SITE_BUCKETS   256
+
+
+/** Counters of one place in the code that allocates memory. The records are
+    never removed until the driver unloads, so they can be searched without locking. */
+typedef struct _DEBUG_ALLOCATOR_SITE {
+   /** Next site in the same bucket. */
+   struct _DEBUG_ALLOCATOR_SITE *Next;
+   /** Name of the function performing the allocations. */
+   PCHAR Function;
+   /** Source line performing the allocations. */
+   ULONG Line;
+   /** Number of blocks allocated. */
+   volatile LONG64 Allocations;
+   /** Number of blocks freed. */
+   volatile LONG64 Frees;
+   /** Bytes in blocks not freed yet. */
+   volatile LONG64 LiveBytes;
+   /** Highest value reached by LiveBytes. */
+   volatile LONG64 PeakBytes;
+} DEBUG_ALLOCATOR_SITE, *PDEBUG_ALLOCATOR_SITE;
+
 /** Structure of the header of memory block allocated by the allocator. */
 typedef struct {
-   /** Used to store the block within list of allocated blocks. */
+   /** Used to store the block within list of allocated blocks. Points to itself
+       if the block was allocated while the tracking was disabled. */
    LIST_ENTRY Entry;
+   /** Counters of the allocation site, NULL if the block was allocated while the
+       counters were disabled. */
+   PDEBUG_ALLOCATOR_SITE Site;
    /** Name of function that allocated the block. */
    PCHAR Function;
    /** Line of code where the allocation occurred. */
@@ -43,11 +73,13 @@ typedef struct {
 
 PVOID DebugAllocatorAlloc(POOL_TYPE PoolType, SIZE_T NumberOfBytes, PCHAR Function, ULONG Line);
 VOID DebugAllocatorFree(PVOID Address);
+EDriverAllocatorMode DebugAllocatorGetMode(VOID);
+NTSTATUS DebugAllocatorSetMode(EDriverAllocatorMode Mode);
+VOID DebugAllocatorQuerySites(PDRIVER_ALLOCATOR_SITE_STATISTICS Sites, ULONG MaxCount, PULONG SiteCount);
 
-#ifdef _DEBUG
-// #define MEMORY_LEAK_DETECTION
-#endif
-
+/* All allocations go through the allocator, the amount of work it does is
+   selected at runtime by DebugAllocatorSetMode. Undefine to use the pool
+   directly. */
 #define MEMORY_LEAK_DETECTION
 #ifdef MEMORY_LEAK_DETECTION
 
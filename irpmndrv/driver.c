@@ -22,6 +22,9 @@
 
 static ERESOURCE _createCloseLock;
 static volatile LONG _openHandles = 0;
+/** Its address is stored in FsContext of file objects opened for overlapped
+    record retrieval (see IRPMNDRV_RECORDS_FILE_NAME). */
+static UCHAR _recordsFileMarker;
 
 /************************************************************************/
 /*                            HELPER FUNCTIONS                          */
@@ -29,6 +32,7 @@ static volatile LONG _openHandles = 0;
 
 NTSTATUS DriverCreateCleanup(PDEVICE_OBJECT DeviceObject, PIRP Irp)
 {
+	UNICODE_STRING uRecordsFileName;
 	PIO_STACK_LOCATION irpStack = NULL;
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
 	DEBUG_ENTER_FUNCTION("DeviceObject=0x%p; Irp=0x%p", DeviceObject, Irp);
@@ -38,9 +42,15 @@ NTSTATUS DriverCreateCleanup(PDEVICE_OBJECT DeviceObject, PIRP Irp)
 	KeEnterCriticalRegion();
 	ExAcquireResourceExclusiveLite(&_createCloseLock, TRUE);
 	irpStack = IoGetCurrentIrpStackLocation(Irp);
-	if (irpStack->MajorFunction == IRP_MJ_CLEANUP) {
-		UMRequestQueueDisconnect();
-		UMDeleteHandlesForProcess(PsGetCurrentProcess());
+	if (irpStack->MajorFunction == IRP_MJ_CREATE) {
+		RtlInitUnicodeString(&uRecordsFileName, IRPMNDRV_RECORDS_FILE_NAME);
+		if (RtlEqualUnicodeString(&irpStack->FileObject->FileName, &uRecordsFileName, TRUE))
+			irpStack->FileObject->FsContext = &_recordsFileMarker;
+	} else if (irpStack->MajorFunction == IRP_MJ_CLEANUP) {
+		if (irpStack->FileObject->FsContext != &_recordsFileMarker) {
+			UMRequestQueueDisconnect();
+			UMDeleteHandlesForProcess(PsGetCurrentProcess());
+		} else RequestQueueCancelPending(irpStack->FileObject);
 	}
 
 	ExReleaseResourceLite(&_createCloseLock);
@@ -96,6 +106,11 @@ static NTSTATUS _HandleCDORequest(ULONG ControlCode, PVOID InputBuffer, ULONG In
 			if (NT_SUCCESS(status))
 				IoStatus->Information = OutputBufferLength;
 			break;
+		case IOCTL_IRPMNDRV_GET_OBJECT_CHANGES:
+			status = UMGetObjectChanges((PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT)InputBuffer, InputBufferLength, (PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT)OutputBuffer, OutputBufferLength, &OutputBufferLength);
+			if (NT_SUCCESS(status))
+				IoStatus->Information = OutputBufferLength;
+			break;
 		case IOCTL_IRPMNDRV_HOOK_DRIVER_SET_INFO:
 			status = UMHookedDriverSetInfo((PIOCTL_IRPMNDRV_HOOK_DRIVER_SET_INFO_INPUT)InputBuffer, InputBufferLength);
 			break;
@@ -144,6 +159,29 @@ static NTSTATUS _HandleCDORequest(ULONG ControlCode, PVOID InputBuffer, ULONG In
 		case IOCTL_IRPMNDRV_DRIVER_WATCH_ENUM:
 			status = PWDDriverNameEnumerate((PIOCTL_IRPMNDRV_DRIVER_WATCH_ENUM_OUTPUT)OutputBuffer, OutputBufferLength, &IoStatus->Information, ExGetPreviousMode());
 			break;
+		case IOCTL_IRPMNDRV_HOOK_BATCH:
+			status = UMHookBatch((PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT)InputBuffer, InputBufferLength, (PIOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT)OutputBuffer, OutputBufferLength, &OutputBufferLength);
+			if (NT_SUCCESS(status))
+				IoStatus->Information = OutputBufferLength;
+			break;
+		case IOCTL_IRPMNDRV_UNHOOK_BATCH:
+			status = UMUnhookBatch((PIOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT)InputBuffer, InputBufferLength, (PIOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT)OutputBuffer, OutputBufferLength, &OutputBufferLength);
+			if (NT_SUCCESS(status))
+				IoStatus->Information = OutputBufferLength;
+			break;
+		case IOCTL_IRPMNDRV_HASH_TABLE_STATS:
+			status = UMHashTableStatistics((PIOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT)OutputBuffer, OutputBufferLength, &OutputBufferLength);
+			if (NT_SUCCESS(status))
+				IoStatus->Information = OutputBufferLength;
+			break;
+		case IOCTL_IRPMNDRV_ALLOCATOR_STATS:
+			status = UMAllocatorStatistics((PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT)OutputBuffer, OutputBufferLength, &OutputBufferLength);
+			if (NT_SUCCESS(status))
+				IoStatus->Information = OutputBufferLength;
+			break;
+		case IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE:
+			status = UMAllocatorSetMode((PIOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT)InputBuffer, InputBufferLength);
+			break;
 		default:
 			status = STATUS_INVALID_DEVICE_REQUEST;
 			break;
@@ -173,8 +211,10 @@ NTSTATUS DriverDeviceControl(PDEVICE_OBJECT DeviceObject, PIRP Irp)
 	outputBufferLength = irpSp->Parameters.DeviceIoControl.OutputBufferLength;
 	inputBuffer = irpSp->Parameters.DeviceIoControl.Type3InputBuffer;
 	outputBuffer = Irp->UserBuffer;
-	status = _HandleCDORequest(controlCode, inputBuffer, inputBufferLength, outputBuffer, outputBufferLength, &Irp->IoStatus);	
-	IoCompleteRequest(Irp, IO_NO_INCREMENT);
+	if (controlCode != IOCTL_IRPMNDRV_GET_RECORD_PENDING) {
+		status = _HandleCDORequest(controlCode, inputBuffer, inputBufferLength, outputBuffer, outputBufferLength, &Irp->IoStatus);	
+		IoCompleteRequest(Irp, IO_NO_INCREMENT);
+	} else status = RequestQueuePend(Irp);
 
 	DEBUG_EXIT_FUNCTION("0x%x", status);
 	return status;
@@ -190,8 +230,10 @@ BOOLEAN DriverFastIoDeviceControl(PFILE_OBJECT FileObject, BOOLEAN Wait, PVOID I
 	UNREFERENCED_PARAMETER(DeviceObject);
 	UNREFERENCED_PARAMETER(Wait);
 	
-	_HandleCDORequest(ControlCode, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, IoStatusBlock);
-	ret = TRUE;
+	// Overlapped record requests may need to wait, they are always sent as IRPs.
+	ret = (ControlCode != IOCTL_IRPMNDRV_GET_RECORD_PENDING);
+	if (ret)
+		_HandleCDORequest(ControlCode, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, IoStatusBlock);
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
@@ -12,7 +12,7 @@
 
 static ULONG32 _HashFunction(PVOID Key)
 {
-	return PtrToUlong(Key);
+	return HashTablePointerHash(Key);
 }
 
 static BOOLEAN _CompareFunction(PHASH_ITEM ObjectInTable, PVOID Key)
@@ -53,6 +53,28 @@
  * When iterating through a general hash table, the order of retrieved items
  * does not respect the order of their insertion or any other meaningful one.
  * The items are retrieved in the order they are physically stored in the table.
+ *
+ * Number of buckets is adjusted automatically according to the load factor
+ * (number of items divided by number of buckets). When an insertion makes the
+ * table too full, a new bucket array twice as large is allocated, and when
+ * a deletion makes it too empty, the bucket array is halved (but never below
+ * the size given at creation time). Items are not moved at once. The old
+ * bucket array is kept and every insert or delete operation moves items of
+ * a few old buckets to the new array (incremental rehashing), so no single
+ * operation pays for the whole rehash. Lookups search both arrays until
+ * the rehashing finishes.
+ *
+ * Locks are striped, their number is fixed at creation time and does not depend
+ * on number of buckets (see @link(HashTableCreateEx)); the number of buckets is
+ * always a multiple of it. Bucket I is protected by lock I % (number of locks),
+ * so every item is guarded by the same lock regardless the bucket array it
+ * currently resides in. Only swapping the bucket arrays at the start and
+ * the end of rehashing needs to acquire all the locks. Tables without
+ * synchronization use just one (virtual) lock.
+ *
+ * Read-mostly tables accessed at DISPATCH_LEVEL may use shared spin locks
+ * (@link(httDispatchLevelShared)), so concurrent lookups do not serialize
+ * on a bucket lock.
  */
 
 #include <ntifs.h>
@@ -88,6 +110,7 @@
          DEBUG_IRQL_LESS_OR_EQUAL(APC_LEVEL);                      \
          break;                                                    \
       case httDispatchLevel:                                       \
+      case httDispatchLevelShared:                                 \
          DEBUG_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);                 \
          break;                                                    \
       case httNoSynchronization:                                   \
@@ -111,7 +134,8 @@
 /** Locks a given table bucket for shared access.
  *
  *  @param Table Table which bucket is about to be locked.
- *  @param Index A zero-based index of the bucket to lock.
+ *  @param Index A zero-based index of the lock to acquire (bucket index modulo
+ *  number of locks).
  *  @param Irql Address of variable. If the table is not a dispatch IRQL
  *  one, this parameter is ignored. Otherwise, the variable is filled with
  *  the current IRQL value just before the locking in shared mode is performed.
@@ -125,7 +149,7 @@
 static VOID HashTableLockShared(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql)
 {
    HASH_TABLE_IRQL_VALIDATE(Table);
-   ASSERT(Index < Table->Size);
+   ASSERT(Index < Table->LockCount);
 
    switch (Table->Type) {
       case httPassiveLevel:
@@ -135,6 +159,9 @@ static VOID HashTableLockShared(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql)
       case httDispatchLevel:
          KeAcquireSpinLock(&Table->DispatchLocks[Index], Irql);
          break;
+      case httDispatchLevelShared:
+         *Irql = ExAcquireSpinLockShared(&Table->SharedDispatchLocks[Index]);
+         break;
       case httNoSynchronization:
          break;
       default:
@@ -148,7 +175,8 @@ static VOID HashTableLockShared(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql)
 /** Locks a given table bucket for exclusive access.
  *
  *  @param Table Table which bucket is about to be locked.
- *  @param Index A zero-based index of the bucket to lock.
+ *  @param Index A zero-based index of the lock to acquire (bucket index modulo
+ *  number of locks).
  *  @param Irql Address of variable. If the table is not a dispatch IRQL
  *  one, this parameter is ignored. Otherwise, the variable is filled with
  *  the current IRQL value just before the locking in exclusive mode is performed.
@@ -162,7 +190,7 @@ static VOID HashTableLockShared(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql)
 static VOID HashTableLockExclusive(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql)
 {
    HASH_TABLE_IRQL_VALIDATE(Table);
-   ASSERT(Index < Table->Size);
+   ASSERT(Index < Table->LockCount);
 
    switch (Table->Type) {
       case httPassiveLevel:
@@ -173,6 +201,10 @@ static VOID HashTableLockExclusive(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql
          KeAcquireSpinLock(&Table->DispatchLocks[Index], Irql);
          Table->DispatchLockExclusive[Index] = TRUE;
          break;
+      case httDispatchLevelShared:
+         *Irql = ExAcquireSpinLockExclusive(&Table->SharedDispatchLocks[Index]);
+         Table->DispatchLockExclusive[Index] = TRUE;
+         break;
       case httNoSynchronization:
          break;
       default:
@@ -186,7 +218,7 @@ static VOID HashTableLockExclusive(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql
 /** Unlocks a given bucket of a general hash table.
  *
  *  @param Table A hash table the bucket of which is to be unlocked.
- *  @param Index A zero-based index of the bucked to unlock.
+ *  @param Index A zero-based index of the lock to release.
  *  @param Irql A value of IRQL the caller had been running before the table
  *  was locked. The parameter is ignored for passive IRQL tables and tables access
  *  to whom is not synchronized.
@@ -200,7 +232,7 @@ static VOID HashTableLockExclusive(PHASH_TABLE Table, ULONG32 Index, PKIRQL Irql
 static VOID HashTableUnlock(PHASH_TABLE Table, ULONG32 Index, KIRQL Irql)
 {
    HASH_TABLE_IRQL_VALIDATE(Table);
-   ASSERT(Index < Table->Size);
+   ASSERT(Index < Table->LockCount);
 
    switch (Table->Type) {
       case httPassiveLevel:
@@ -215,6 +247,14 @@ static VOID HashTableUnlock(PHASH_TABLE Table, ULONG32 Index, KIRQL Irql)
             KeReleaseSpinLock(&Table->DispatchLocks[Index], Irql);
          }
          break;
+      case httDispatchLevelShared:
+         if (Table->DispatchLockExclusive[Index]) {
+            Table->DispatchLockExclusive[Index] = FALSE;
+            ExReleaseSpinLockExclusive(&Table->SharedDispatchLocks[Index], Irql);
+         } else {
+            ExReleaseSpinLockShared(&Table->SharedDispatchLocks[Index], Irql);
+         }
+         break;
       case httNoSynchronization:
          break;
       default:
@@ -245,9 +285,9 @@ static NTSTATUS _HashTableSynchronizationAlloc(PHASH_TABLE Table)
 
    switch (Table->Type) {
       case httPassiveLevel:
-         Table->Locks = (PERESOURCE)HeapMemoryAlloc(NonPagedPool, Table->Size * sizeof(ERESOURCE));
+         Table->Locks = (PERESOURCE)HeapMemoryAlloc(NonPagedPool, Table->LockCount * sizeof(ERESOURCE));
          if (Table->Locks != NULL) {
-            for (i = 0; i < (LONG)Table->Size; ++i) {
+            for (i = 0; i < (LONG)Table->LockCount; ++i) {
                status = ExInitializeResourceLite(&Table->Locks[i]);
                if (!NT_SUCCESS(status)) {
                   for (j = i - 1; j >= 0; --j) {
@@ -256,20 +296,20 @@ static NTSTATUS _HashTableSynchronizationAlloc(PHASH_TABLE Table)
 
                   break;
                }
+            }
 
-               if (!NT_SUCCESS(status)) {
-                  HeapMemoryFree(Table->Locks);
-                  Table->Locks = NULL;
-               }
+            if (!NT_SUCCESS(status)) {
+               HeapMemoryFree(Table->Locks);
+               Table->Locks = NULL;
             }
          } else status = STATUS_INSUFFICIENT_RESOURCES;
          break;
       case httDispatchLevel:
-         Table->DispatchLockExclusive = (PBOOLEAN)HeapMemoryAlloc(NonPagedPool, Table->Size * sizeof(BOOLEAN));
+         Table->DispatchLockExclusive = (PBOOLEAN)HeapMemoryAlloc(NonPagedPool, Table->LockCount * sizeof(BOOLEAN));
          if (Table->DispatchLockExclusive != NULL) {
-            Table->DispatchLocks = (PKSPIN_LOCK)HeapMemoryAlloc(NonPagedPool, Table->Size * sizeof(KSPIN_LOCK));
+            Table->DispatchLocks = (PKSPIN_LOCK)HeapMemoryAlloc(NonPagedPool, Table->LockCount * sizeof(KSPIN_LOCK));
             if (Table->DispatchLocks != NULL) {
-               for (i = 0; i < (LONG)Table->Size; ++i) {
+               for (i = 0; i < (LONG)Table->LockCount; ++i) {
                   Table->DispatchLockExclusive[i] = FALSE;
                   KeInitializeSpinLock(&Table->DispatchLocks[i]);
                }
@@ -287,6 +327,29 @@ static NTSTATUS _HashTableSynchronizationAlloc(PHASH_TABLE Table)
             status = STATUS_INSUFFICIENT_RESOURCES;
          }
          break;
+      case httDispatchLevelShared:
+         Table->DispatchLockExclusive = (PBOOLEAN)HeapMemoryAlloc(NonPagedPool, Table->LockCount * sizeof(BOOLEAN));
+         if (Table->DispatchLockExclusive != NULL) {
+            Table->SharedDispatchLocks = (PEX_SPIN_LOCK)HeapMemoryAlloc(NonPagedPool, Table->LockCount * sizeof(EX_SPIN_LOCK));
+            if (Table->SharedDispatchLocks != NULL) {
+               for (i = 0; i < (LONG)Table->LockCount; ++i) {
+                  Table->DispatchLockExclusive[i] = FALSE;
+                  Table->SharedDispatchLocks[i] = 0;
+               }
+
+               status = STATUS_SUCCESS;
+            } else {
+               status = STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            if (!NT_SUCCESS(status)) {
+               HeapMemoryFree(Table->DispatchLockExclusive);
+               Table->DispatchLockExclusive = NULL;
+            }
+         } else {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+         }
+         break;
       case httNoSynchronization:
          status = STATUS_SUCCESS;
          break;
@@ -312,7 +375,7 @@ static VOID _HashTableSynchronizationFree(PHASH_TABLE Table)
 
    switch (Table->Type) {
       case httPassiveLevel:
-         for (i = (LONG)Table->Size - 1; i >= 0; --i) {
+         for (i = (LONG)Table->LockCount - 1; i >= 0; --i) {
             ExDeleteResourceLite(&Table->Locks[i]);
          }
 
@@ -325,6 +388,12 @@ static VOID _HashTableSynchronizationFree(PHASH_TABLE Table)
          HeapMemoryFree(Table->DispatchLockExclusive);
          Table->DispatchLockExclusive = NULL;
          break;
+      case httDispatchLevelShared:
+         HeapMemoryFree(Table->SharedDispatchLocks);
+         Table->SharedDispatchLocks = NULL;
+         HeapMemoryFree(Table->DispatchLockExclusive);
+         Table->DispatchLockExclusive = NULL;
+         break;
       case httNoSynchronization:
          break;
       default:
@@ -336,20 +405,340 @@ static VOID _HashTableSynchronizationFree(PHASH_TABLE Table)
    return;
 }
 
+/** Acquires all locks of a given hash table for exclusive access.
+ *
+ *  @param Table The table to lock.
+ *  @param Irql Address of variable that receives the IRQL value the caller
+ *  had been running at before the locks were acquired. Used only by dispatch
+ *  IRQL tables.
+ *
+ *  @remark
+ *  The locks are always acquired in ascending order of their indices. The caller
+ *  must not hold any lock of the table.
+ *
+ *  The routine is used only when the bucket arrays of the table are swapped.
+ */
+static VOID _HashTableLockAll(PHASH_TABLE Table, PKIRQL Irql)
+{
+   ULONG32 i = 0;
+   HASH_TABLE_IRQL_VALIDATE(Table);
+
+   switch (Table->Type) {
+      case httPassiveLevel:
+         KeEnterCriticalRegion();
+         for (i = 0; i < Table->LockCount; ++i)
+            ExAcquireResourceExclusiveLite(&Table->Locks[i], TRUE);
+         break;
+      case httDispatchLevel:
+         KeRaiseIrql(DISPATCH_LEVEL, Irql);
+         for (i = 0; i < Table->LockCount; ++i)
+            KeAcquireSpinLockAtDpcLevel(&Table->DispatchLocks[i]);
+         break;
+      case httDispatchLevelShared:
+         KeRaiseIrql(DISPATCH_LEVEL, Irql);
+         for (i = 0; i < Table->LockCount; ++i)
+            ExAcquireSpinLockExclusiveAtDpcLevel(&Table->SharedDispatchLocks[i]);
+         break;
+      case httNoSynchronization:
+         break;
+      default:
+         DEBUG_ERROR("Invalid hash table type: %u", Table->Type);
+         break;
+   }
+
+   return;
+}
+
+/** Releases all locks of a given hash table acquired by @link(_HashTableLockAll).
+ *
+ *  @param Table The table to unlock.
+ *  @param Irql IRQL value returned by the _HashTableLockAll call.
+ */
+static VOID _HashTableUnlockAll(PHASH_TABLE Table, KIRQL Irql)
+{
+   LONG i = 0;
+   HASH_TABLE_IRQL_VALIDATE(Table);
+
+   switch (Table->Type) {
+      case httPassiveLevel:
+         for (i = (LONG)Table->LockCount - 1; i >= 0; --i)
+            ExReleaseResourceLite(&Table->Locks[i]);
+
+         KeLeaveCriticalRegion();
+         break;
+      case httDispatchLevel:
+         for (i = (LONG)Table->LockCount - 1; i >= 0; --i)
+            KeReleaseSpinLockFromDpcLevel(&Table->DispatchLocks[i]);
+
+         KeLowerIrql(Irql);
+         break;
+      case httDispatchLevelShared:
+         for (i = (LONG)Table->LockCount - 1; i >= 0; --i)
+            ExReleaseSpinLockExclusiveFromDpcLevel(&Table->SharedDispatchLocks[i]);
+
+         KeLowerIrql(Irql);
+         break;
+      case httNoSynchronization:
+         break;
+      default:
+         DEBUG_ERROR("Invalid hash table type: %u", Table->Type);
+         break;
+   }
+
+   return;
+}
+
+/** Translates a bucket index to address of the bucket.
+ *
+ *  @param Table The hash table.
+ *  @param Index Index of the bucket. Indices lower than the table size refer
+ *  to the current bucket array, the higher ones (up to Size + OldSize) refer to
+ *  the old bucket array used during incremental rehashing.
+ *
+ *  @return
+ *  Returns address of the bucket.
+ *
+ *  @remark
+ *  Both table size and the old size are multiples of the number of locks, hence
+ *  a bucket with index I is always protected by the lock I % LockCount. The caller
+ *  must hold that lock.
+ */
+static PHASH_ITEM *_HashTableBucketByIndex(PHASH_TABLE Table, ULONG Index)
+{
+   ASSERT(Index < Table->Size + Table->OldSize);
+
+   return (Index < Table->Size) ? &Table->Buckets[Index] : &Table->OldBuckets[Index - Table->Size];
+}
+
+/** Searches a bucket for an item stored under a given key.
+ *
+ *  @param Table The hash table.
+ *  @param Bucket Address of the bucket.
+ *  @param HashValue Hash of the key.
+ *  @param Key The key.
+ *  @param Remove If set to TRUE, the item found is unlinked from the bucket.
+ *
+ *  @return
+ *  Returns address of the item found, or NULL if no item corresponds to the key.
+ *
+ *  @remark
+ *  The compare function is invoked only on items whose hash value matches the one
+ *  of the key.
+ */
+static PHASH_ITEM _HashTableBucketFind(PHASH_TABLE Table, PHASH_ITEM *Bucket, ULONG32 HashValue, PVOID Key, BOOLEAN Remove)
+{
+   PHASH_ITEM akt = NULL;
+   PHASH_ITEM prev = NULL;
+
+   akt = *Bucket;
+   while (akt != NULL) {
+      if (akt->HashValue == HashValue && Table->CompareFunction(akt, Key)) {
+         if (Remove) {
+            if (prev != NULL)
+               prev->Next = akt->Next;
+            else *Bucket = akt->Next;
+         }
+
+         break;
+      }
+
+      prev = akt;
+      akt = akt->Next;
+   }
+
+   return akt;
+}
+
+/** Searches a hash table for an item stored under a given key.
+ *
+ *  @param Table The hash table.
+ *  @param HashValue Hash of the key.
+ *  @param Key The key.
+ *  @param Remove If set to TRUE, the item found is removed from the table.
+ *
+ *  @return
+ *  Returns address of the item found, or NULL if no item corresponds to the key.
+ *
+ *  @remark
+ *  If the table is being rehashed, both bucket arrays are searched. The caller
+ *  must hold the lock protecting the key (in exclusive mode if Remove is TRUE).
+ */
+static PHASH_ITEM _HashTableFind(PHASH_TABLE Table, ULONG32 HashValue, PVOID Key, BOOLEAN Remove)
+{
+   PHASH_ITEM ret = NULL;
+
+   ret = _HashTableBucketFind(Table, &Table->Buckets[HashValue % Table->Size], HashValue, Key, Remove);
+   if (ret == NULL && Table->OldBuckets != NULL)
+      ret = _HashTableBucketFind(Table, &Table->OldBuckets[HashValue % Table->OldSize], HashValue, Key, Remove);
+
+   return ret;
+}
+
+/** Moves items from old buckets protected by a given lock into the current
+ *  bucket array.
+ *
+ *  @param Table The hash table being rehashed.
+ *  @param LockIndex Index of the lock whose old buckets should be moved. The caller
+ *  must hold the lock in exclusive mode.
+ *  @param Count Maximum number of old buckets to move.
+ *
+ *  @return
+ *  Returns TRUE if the call moved the last old bucket of the whole table. In such
+ *  a case, the caller must call @link(_HashTableMigrationFinish) after releasing
+ *  the lock. Otherwise, FALSE is returned.
+ *
+ *  @remark
+ *  If the table is not being rehashed, the routine does nothing.
+ */
+static BOOLEAN _HashTableMigrate(PHASH_TABLE Table, ULONG32 LockIndex, ULONG32 Count)
+{
+   ULONG32 index = 0;
+   PHASH_ITEM item = NULL;
+   PHASH_ITEM next = NULL;
+   PHASH_ITEM *bucket = NULL;
+   BOOLEAN ret = FALSE;
+
+   if (Table->OldBuckets != NULL) {
+      index = Table->MigrateCursors[LockIndex];
+      if (index < Table->OldSize) {
+         while (Count > 0 && index < Table->OldSize) {
+            item = Table->OldBuckets[index];
+            while (item != NULL) {
+               next = item->Next;
+               bucket = &Table->Buckets[item->HashValue % Table->Size];
+               item->Next = *bucket;
+               *bucket = item;
+               item = next;
+            }
+
+            Table->OldBuckets[index] = NULL;
+            index += Table->LockCount;
+            --Count;
+         }
+
+         Table->MigrateCursors[LockIndex] = index;
+         if (index >= Table->OldSize)
+            ret = (InterlockedDecrement(&Table->LocksToMigrate) == 0);
+      }
+   }
+
+   return ret;
+}
+
+/** Releases the old bucket array when all its items were moved to the current one.
+ *
+ *  @param Table The hash table.
+ */
+static VOID _HashTableMigrationFinish(PHASH_TABLE Table)
+{
+   KIRQL irql;
+   PHASH_ITEM *oldBuckets = NULL;
+
+   _HashTableLockAll(Table, &irql);
+   if (Table->OldBuckets != NULL && Table->LocksToMigrate == 0) {
+      oldBuckets = Table->OldBuckets;
+      Table->OldBuckets = NULL;
+      Table->OldSize = 0;
+   }
+
+   _HashTableUnlockAll(Table, irql);
+   if (oldBuckets != NULL)
+      HeapMemoryFree(oldBuckets);
+
+   return;
+}
+
+/** Performs the table maintenance after an insert or delete operation.
+ *
+ *  @param Table The hash table.
+ *  @param MigrationFinished Set to TRUE if the operation moved the last old bucket.
+ *
+ *  @remark
+ *  If the table is being rehashed, the routine moves a few old buckets protected by
+ *  another lock than the one used by the operation. This makes the rehashing finish
+ *  even if the operations touch only a small part of the table.
+ *
+ *  If the table is not being rehashed and its load factor is out of bounds, the routine
+ *  allocates a new bucket array and starts the rehashing. When the allocation fails,
+ *  the table just keeps its current size.
+ *
+ *  The caller must not hold any lock of the table.
+ */
+static VOID _HashTableMaintain(PHASH_TABLE Table, BOOLEAN MigrationFinished)
+{
+   KIRQL irql;
+   ULONG32 i = 0;
+   ULONG32 lockIndex = 0;
+   ULONG32 oldSize = 0;
+   ULONG32 newSize = 0;
+   ULONG numberOfItems = 0;
+   PHASH_ITEM *newBuckets = NULL;
+
+   if (!MigrationFinished && Table->OldBuckets != NULL) {
+      lockIndex = (ULONG32)InterlockedIncrement(&Table->MigrateHelper) % Table->LockCount;
+      HashTableLockExclusive(Table, lockIndex, &irql);
+      MigrationFinished = _HashTableMigrate(Table, lockIndex, HASH_TABLE_MIGRATE_STEP);
+      HashTableUnlock(Table, lockIndex, irql);
+   }
+
+   if (MigrationFinished)
+      _HashTableMigrationFinish(Table);
+
+   if (Table->OldBuckets == NULL) {
+      oldSize = Table->Size;
+      numberOfItems = Table->NumberOfItems;
+      if (numberOfItems > oldSize*HASH_TABLE_GROW_LOAD_FACTOR && oldSize <= HASH_TABLE_MAX_SIZE / 2)
+         newSize = oldSize * 2;
+      else if (numberOfItems < oldSize / HASH_TABLE_SHRINK_LOAD_DIVISOR && oldSize / 2 >= Table->MinSize)
+         newSize = oldSize / 2;
+
+      if (newSize != 0) {
+         newBuckets = (PHASH_ITEM *)HeapMemoryAlloc(NonPagedPool, newSize*sizeof(PHASH_ITEM));
+         if (newBuckets != NULL) {
+            RtlZeroMemory(newBuckets, newSize*sizeof(PHASH_ITEM));
+            _HashTableLockAll(Table, &irql);
+            if (Table->OldBuckets == NULL && Table->Size == oldSize) {
+               Table->OldBuckets = Table->Buckets;
+               Table->OldSize = Table->Size;
+               Table->Buckets = newBuckets;
+               Table->Size = newSize;
+               for (i = 0; i < Table->LockCount; ++i)
+                  Table->MigrateCursors[i] = i;
+
+               Table->LocksToMigrate = (LONG)Table->LockCount;
+               newBuckets = NULL;
+            }
+
+            _HashTableUnlockAll(Table, irql);
+            if (newBuckets != NULL)
+               HeapMemoryFree(newBuckets);
+         }
+      }
+   }
+
+   return;
+}
+
 /************************************************************************/
 /*                   PUBLIC FUNCTIONS                                   */
 /************************************************************************/
 
-/** Creates a new general hash table.
+/** Creates a new general hash table with a given number of locks.
  *
  *  @param Type Type of the table. This argument can have the following values.
  *    @value httPassiveLevel A passive IRQL table, accessible at IRQL below DISPATCH_LEVEL
- *    and synchronized via an executive resource.
+ *    and synchronized via executive resources.
  *    @value httDispatchLevel A dispatch IRQL table, accessible at IRQL <= DISPATCH_LEVEL
- *    and synchronized via a reader-writer spin lock.
+ *    and synchronized via spin locks.
+ *    @value httDispatchLevelShared A dispatch IRQL table, accessible at IRQL <= DISPATCH_LEVEL
+ *    and synchronized via reader-writer spin locks. Lookups do not block each other.
  *    @value httNoSynchronization A table accessible at any IRQL and with no synchronization
  *    employed.
- *  @param Size Number of buckets of the new table.
+ *  @param Size Initial number of buckets of the new table. The value is rounded up
+ *  to a multiple of the number of locks. The table never shrinks below this size.
+ *  @param LockCount Number of locks (lock stripes) protecting the buckets. Zero means
+ *  @link(HASH_TABLE_DEFAULT_LOCK_COUNT) (or Size, if lower). The value is ignored
+ *  for tables with no synchronization.
  *  @param HashFunction Address of a hash function for the new table.
  *  @param CompareFunction Address of a compare function for the new table.
  *  @param FreeFunction Address of a free function for the new table. If this
@@ -361,8 +750,8 @@ static VOID _HashTableSynchronizationFree(PHASH_TABLE Table)
  *  The routine can return the following NTSTATUS values:
  *   @value STATUS_SUCCESS The table was successfully created.
  *   @value STATUS_INVALID_PARAMETER_X No hash function or compare function
- *   specified, or number of bucket is zero, or the type of the table is
- *   unknown.
+ *   specified, or number of bucket is zero or too large, or the type of the table is
+ *   unknown, or there are more locks than buckets.
  *   @value STATUS_INSUFFICIENT_RESOURCES There is not enough free memory
  *   to create the table.
  *   @value Other Some other error occurred.
@@ -370,28 +759,59 @@ static VOID _HashTableSynchronizationFree(PHASH_TABLE Table)
  *  @remark
  *  The routine can be called at IRQL <= DISPATCH_LEVEL.
  */
-NTSTATUS HashTableCreate(EHashTableType Type, ULONG32 Size, IN HASH_FUNCTION HashFunction, COMPARE_FUNCTION CompareFunction, FREE_ITEM_FUNCTION FreeFunction, PHASH_TABLE *Table)
+NTSTATUS HashTableCreateEx(EHashTableType Type, ULONG32 Size, ULONG32 LockCount, IN HASH_FUNCTION HashFunction, COMPARE_FUNCTION CompareFunction, FREE_ITEM_FUNCTION FreeFunction, PHASH_TABLE *Table)
 {
    PHASH_TABLE tmpTable = NULL;
    NTSTATUS status = STATUS_UNSUCCESSFUL;
-   SIZE_T tableLength = sizeof(HASH_TABLE) + Size * sizeof(PHASH_ITEM);
-   DEBUG_ENTER_FUNCTION("Type=%u; Size=%u; HashFunction=0x%p; CompareFunction=0x%p; FreeFunction=0x%p; Table=0x%p", Type, Size, HashFunction, CompareFunction, FreeFunction, Table);
+   SIZE_T bucketsLength = 0;
+   DEBUG_ENTER_FUNCTION("Type=%u; Size=%u; LockCount=%u; HashFunction=0x%p; CompareFunction=0x%p; FreeFunction=0x%p; Table=0x%p", Type, Size, LockCount, HashFunction, CompareFunction, FreeFunction, Table);
    DEBUG_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
 
-   if ((Type == httPassiveLevel || Type == httDispatchLevel || Type == httNoSynchronization) && 
-       Size > 0 && HashFunction != NULL && CompareFunction != NULL) {
-      tmpTable = (PHASH_TABLE)HeapMemoryAlloc(NonPagedPool, tableLength);
+   if (Type == httNoSynchronization)
+      LockCount = 1;
+   else if (LockCount == 0)
+      LockCount = (Size < HASH_TABLE_DEFAULT_LOCK_COUNT) ? Size : HASH_TABLE_DEFAULT_LOCK_COUNT;
+
+   if (LockCount > 0 && Size >= LockCount && Size <= HASH_TABLE_MAX_SIZE)
+      Size = ((Size + LockCount - 1) / LockCount)*LockCount;
+
+   if ((Type == httPassiveLevel || Type == httDispatchLevel || Type == httDispatchLevelShared || Type == httNoSynchronization) && 
+       Size > 0 && Size <= HASH_TABLE_MAX_SIZE && LockCount > 0 && LockCount <= Size &&
+       HashFunction != NULL && CompareFunction != NULL) {
+      bucketsLength = Size * sizeof(PHASH_ITEM);
+      tmpTable = (PHASH_TABLE)HeapMemoryAlloc(NonPagedPool, sizeof(HASH_TABLE));
       if (tmpTable != NULL) {
-         RtlZeroMemory(tmpTable, tableLength);
+         RtlZeroMemory(tmpTable, sizeof(HASH_TABLE));
          tmpTable->Type = Type;
          tmpTable->Size = Size;
+         tmpTable->MinSize = Size;
+         tmpTable->LockCount = LockCount;
          tmpTable->HashFunction = HashFunction;
          tmpTable->CompareFunction = CompareFunction;
          tmpTable->FreeFunction = FreeFunction;
          tmpTable->NumberOfItems = 0;
-         status = _HashTableSynchronizationAlloc(tmpTable);
-         if (NT_SUCCESS(status)) {
-            *Table = tmpTable;
+         tmpTable->Buckets = (PHASH_ITEM *)HeapMemoryAlloc(NonPagedPool, bucketsLength);
+         if (tmpTable->Buckets != NULL) {
+            RtlZeroMemory(tmpTable->Buckets, bucketsLength);
+            tmpTable->MigrateCursors = (PULONG32)HeapMemoryAlloc(NonPagedPool, tmpTable->LockCount*sizeof(ULONG32));
+            if (tmpTable->MigrateCursors != NULL) {
+               status = _HashTableSynchronizationAlloc(tmpTable);
+               if (NT_SUCCESS(status)) {
+                  *Table = tmpTable;
+               }
+
+               if (!NT_SUCCESS(status)) {
+                  HeapMemoryFree(tmpTable->MigrateCursors);
+               }
+            } else {
+               status = STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            if (!NT_SUCCESS(status)) {
+               HeapMemoryFree(tmpTable->Buckets);
+            }
+         } else {
+            status = STATUS_INSUFFICIENT_RESOURCES;
          }
 
          if (!NT_SUCCESS(status)) {
@@ -404,14 +824,16 @@ NTSTATUS HashTableCreate(EHashTableType Type, ULONG32 Size, IN HASH_FUNCTION Has
       // Set the right error status according to what caused it.
       status = STATUS_INVALID_PARAMETER;
       if (Type != httPassiveLevel && Type != httDispatchLevel &&
-          Type != httNoSynchronization) {
+          Type != httDispatchLevelShared && Type != httNoSynchronization) {
          status = STATUS_INVALID_PARAMETER_1;
-      } else if (Size == 0) {
+      } else if (Size == 0 || Size > HASH_TABLE_MAX_SIZE) {
          status = STATUS_INVALID_PARAMETER_2;
-      } else if (HashFunction == NULL) {
+      } else if (LockCount > Size) {
          status = STATUS_INVALID_PARAMETER_3;
-      } else if (CompareFunction == NULL) {
+      } else if (HashFunction == NULL) {
          status = STATUS_INVALID_PARAMETER_4;
+      } else if (CompareFunction == NULL) {
+         status = STATUS_INVALID_PARAMETER_5;
       }
    }
 
@@ -419,6 +841,35 @@ NTSTATUS HashTableCreate(EHashTableType Type, ULONG32 Size, IN HASH_FUNCTION Has
    return status;
 }
 
+/** Creates a new general hash table.
+ *
+ *  @param Type Type of the table. See @link(HashTableCreateEx) for details.
+ *  @param Size Initial number of buckets of the new table.
+ *  @param HashFunction Address of a hash function for the new table.
+ *  @param CompareFunction Address of a compare function for the new table.
+ *  @param FreeFunction Address of a free function for the new table. If this
+ *  parameter is NULL, the new table will have no free function.
+ *  @param Table Address of variable that receives the newly created
+ *  general hash table.
+ *
+ *  @return
+ *  Returns NTSTATUS value indicating success or failure of the operation.
+ *
+ *  @remark
+ *  The table uses the default number of locks. The routine can be called at
+ *  IRQL <= DISPATCH_LEVEL.
+ */
+NTSTATUS HashTableCreate(EHashTableType Type, ULONG32 Size, IN HASH_FUNCTION HashFunction, COMPARE_FUNCTION CompareFunction, FREE_ITEM_FUNCTION FreeFunction, PHASH_TABLE *Table)
+{
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+   DEBUG_ENTER_FUNCTION("Type=%u; Size=%u; HashFunction=0x%p; CompareFunction=0x%p; FreeFunction=0x%p; Table=0x%p", Type, Size, HashFunction, CompareFunction, FreeFunction, Table);
+
+   status = HashTableCreateEx(Type, Size, 0, HashFunction, CompareFunction, FreeFunction, Table);
+
+   DEBUG_EXIT_FUNCTION("0x%x, *Table=0x%p", status, *Table);
+   return status;
+}
+
 /** Destroys a given general hash table.
  *
  *  @param Table A hash table to destroy.
@@ -429,15 +880,15 @@ NTSTATUS HashTableCreate(EHashTableType Type, ULONG32 Size, IN HASH_FUNCTION Has
  */
 VOID HashTableDestroy(PHASH_TABLE Table)
 {
-   LONG i = 0;
+   ULONG i = 0;
    PHASH_ITEM Tmp = NULL;
    PHASH_ITEM Bucket = NULL;
    DEBUG_ENTER_FUNCTION("Table=%p", Table);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
    _HashTableSynchronizationFree(Table);
-   for (i = 0; i < (LONG)Table->Size; i++) {
-      Bucket = Table->Buckets[i];
+   for (i = 0; i < Table->Size + Table->OldSize; i++) {
+      Bucket = *_HashTableBucketByIndex(Table, i);
       if (Bucket != NULL) {
          do {
             Tmp = Bucket;
@@ -449,6 +900,11 @@ VOID HashTableDestroy(PHASH_TABLE Table)
       }
    }
 
+   if (Table->OldBuckets != NULL)
+      HeapMemoryFree(Table->OldBuckets);
+
+   HeapMemoryFree(Table->MigrateCursors);
+   HeapMemoryFree(Table->Buckets);
    HeapMemoryFree(Table);
 
    DEBUG_EXIT_FUNCTION_VOID();
@@ -466,6 +922,8 @@ VOID HashTableDestroy(PHASH_TABLE Table)
  *  @remark
  *  The routine uses the given HASH_ITEM structure to link the data into itself.
  *
+ *  The insertion may start or continue rehashing of the table.
+ *
  *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
  *  the caller runs at valid IRQL.
  */
@@ -473,14 +931,21 @@ VOID HashTableInsert(PHASH_TABLE Table, PHASH_ITEM Object, PVOID Key)
 {
    KIRQL Irql;
    ULONG32 Index = 0;
+   PHASH_ITEM *bucket = NULL;
+   BOOLEAN migrationFinished = FALSE;
    DEBUG_ENTER_FUNCTION("Tabulka=0x%p; Object=0x%p; Key=0x%p", Table, Object, Key);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   Index = Table->HashFunction(Key) % Table->Size;
+   Object->HashValue = Table->HashFunction(Key);
+   Index = Object->HashValue % Table->LockCount;
    HashTableLockExclusive(Table, Index, &Irql);
-   Object->Next = InterlockedExchangePointer(&Table->Buckets[Index], Object);
+   migrationFinished = _HashTableMigrate(Table, Index, HASH_TABLE_MIGRATE_STEP);
+   bucket = &Table->Buckets[Object->HashValue % Table->Size];
+   Object->Next = *bucket;
+   *bucket = Object;
    HashTableUnlock(Table, Index, Irql);
-   Table->NumberOfItems++;
+   InterlockedIncrement((volatile LONG *)&Table->NumberOfItems);
+   _HashTableMaintain(Table, migrationFinished);
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -497,6 +962,8 @@ VOID HashTableInsert(PHASH_TABLE Table, PHASH_ITEM Object, PVOID Key)
  *  by the given key, it returns its address. Otherwsie, NULL is returned.
  *
  *  @remark
+ *  The deletion may start or continue rehashing of the table.
+ *
  *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
  *  the caller runs at valid IRQL.
  */
@@ -504,73 +971,67 @@ PHASH_ITEM HashTableDelete(PHASH_TABLE Table, PVOID Key)
 {
    KIRQL Irql;
    ULONG32 Index = 0;
+   ULONG32 hashValue = 0;
    PHASH_ITEM Akt = NULL;
-   PHASH_ITEM Prev = NULL;
-   BOOLEAN Ret = FALSE;
+   BOOLEAN migrationFinished = FALSE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Key=0x%p", Table, Key);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   Index = Table->HashFunction(Key) % Table->Size;
+   hashValue = Table->HashFunction(Key);
+   Index = hashValue % Table->LockCount;
    HashTableLockExclusive(Table, Index, &Irql);
-   Akt = Table->Buckets[Index];
-   Prev = NULL;
-   while (Akt != NULL) {
-      Ret = Table->CompareFunction(Akt, Key);
-      if (Ret) {
-         if (Prev != NULL) {
-            Prev->Next = Akt->Next;
-         } else {
-            Table->Buckets[Index] = Akt->Next;
-         }
-
-         Table->NumberOfItems--;
-
-         break;
-      }
-
-      Prev = Akt;
-      Akt = Akt->Next;
-   }
-
+   migrationFinished = _HashTableMigrate(Table, Index, HASH_TABLE_MIGRATE_STEP);
+   Akt = _HashTableFind(Table, hashValue, Key, TRUE);
    HashTableUnlock(Table, Index, Irql);
+   if (Akt != NULL)
+      InterlockedDecrement((volatile LONG *)&Table->NumberOfItems);
+
+   _HashTableMaintain(Table, migrationFinished);
 
    DEBUG_EXIT_FUNCTION("0x%p", Akt);
    return Akt;
 }
 
-/** Retrieves a table item according to a given key.
+/** Retrieves a table item according to a given key and performs an action
+ *  with it before the table is unlocked.
  *
  *  @param Table The table where the search should be done.
  *  @param Key the key value to be used.
+ *  @param Callback Address of a routine invoked for the item found, before the
+ *  lock protecting its bucket is released. Typically, the callback references
+ *  the data containing the item, so they cannot be freed by a concurrent
+ *  delete operation. Can be NULL.
+ *  @param Context User-defined value passed to the callback.
  *
  *  @return
  *  If an item under the given key exists, the routine returns it. Otherwise,
- *  NULL is returned.
+ *  NULL is returned and the callback is not invoked.
  *
  *  @remark
+ *  The routine never modifies the table, it only searches both bucket arrays
+ *  when the table is being rehashed. The bucket of the item is locked for shared
+ *  access during execution of the callback, so lookups in dispatch IRQL tables
+ *  with shared locking do not block each other even when they reference the
+ *  item found.
+ *
  *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
  *  the caller runs at valid IRQL.
  */
-PHASH_ITEM HashTableGet(PHASH_TABLE Table, PVOID Key)
+PHASH_ITEM HashTableGetEx(PHASH_TABLE Table, PVOID Key, HASH_ITEM_CALLBACK Callback, PVOID Context)
 {
    KIRQL Irql;
-   BOOLEAN Ret = FALSE;
    ULONG32 Index = 0;
+   ULONG32 hashValue = 0;
    PHASH_ITEM Akt = NULL;
-   DEBUG_ENTER_FUNCTION("Table=0x%p; Key=0x%p", Table, Key);
+   DEBUG_ENTER_FUNCTION("Table=0x%p; Key=0x%p; Callback=0x%p; Context=0x%p", Table, Key, Callback, Context);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   Index = Table->HashFunction(Key) % Table->Size;
+   hashValue = Table->HashFunction(Key);
+   Index = hashValue % Table->LockCount;
    HashTableLockShared(Table, Index, &Irql);
-   Akt = Table->Buckets[Index];
-   while (Akt != NULL) {
-      Ret = Table->CompareFunction(Akt, Key);
-      if (Ret) {
-         break;
-      }
-
-      Akt = Akt->Next;
-   }
+   Akt = _HashTableFind(Table, hashValue, Key, FALSE);
+   if (Akt != NULL && Callback != NULL)
+      Callback(Akt, Context);
 
    HashTableUnlock(Table, Index, Irql);
 
@@ -578,6 +1039,33 @@ PHASH_ITEM HashTableGet(PHASH_TABLE Table, PVOID Key)
    return Akt;
 }
 
+/** Retrieves a table item according to a given key.
+ *
+ *  @param Table The table where the search should be done.
+ *  @param Key the key value to be used.
+ *
+ *  @return
+ *  If an item under the given key exists, the routine returns it. Otherwise,
+ *  NULL is returned.
+ *
+ *  @remark
+ *  The table is unlocked when the routine returns. If the item can be deleted
+ *  concurrently, use @link(HashTableGetEx) to reference it first.
+ *
+ *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
+ *  the caller runs at valid IRQL.
+ */
+PHASH_ITEM HashTableGet(PHASH_TABLE Table, PVOID Key)
+{
+   PHASH_ITEM ret = NULL;
+   DEBUG_ENTER_FUNCTION("Table=0x%p; Key=0x%p", Table, Key);
+
+   ret = HashTableGetEx(Table, Key, NULL, NULL);
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
 /** Performs an action with every item stored in a given hash table.
  *
  *  @param Table The table on which the action should be performed.
@@ -601,18 +1089,21 @@ VOID HashTablePerform(PHASH_TABLE Table, HASH_ITEM_CALLBACK Callback, PVOID Cont
 {
    KIRQL Irql;
    ULONG i = 0;
+   ULONG j = 0;
    PHASH_ITEM tmp = NULL;
    PHASH_ITEM old = NULL;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Callback=0x%p; Context=0x%p", Table, Callback, Context);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockExclusive(Table, i, &Irql);
-      tmp = Table->Buckets[i];
-      while (tmp != NULL) {
-         old = tmp;
-         tmp = tmp->Next;
-         Callback(old, Context);
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         tmp = *_HashTableBucketByIndex(Table, j);
+         while (tmp != NULL) {
+            old = tmp;
+            tmp = tmp->Next;
+            Callback(old, Context);
+         }
       }
 
       HashTableUnlock(Table, i, Irql);
@@ -647,19 +1138,22 @@ VOID HashTablePerformWithFeedback(PHASH_TABLE Table, HASH_ITEM_CALLBACK_WITH_FEE
 
    KIRQL Irql;
    ULONG i = 0;
+   ULONG j = 0;
    PHASH_ITEM tmp = NULL;
    PHASH_ITEM old = NULL;
    BOOLEAN cancelled = FALSE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Callback=0x%p; Context=0x%p", Table, Callback, Context);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockExclusive(Table, i, &Irql);
-      tmp = Table->Buckets[i];
-      while (!cancelled && tmp != NULL) {
-         old = tmp;
-         tmp = tmp->Next;
-         cancelled = !Callback(old, Context);
+      for (j = i; !cancelled && j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         tmp = *_HashTableBucketByIndex(Table, j);
+         while (!cancelled && tmp != NULL) {
+            old = tmp;
+            tmp = tmp->Next;
+            cancelled = !Callback(old, Context);
+         }
       }
 
       HashTableUnlock(Table, i, Irql);
@@ -679,6 +1173,9 @@ VOID HashTablePerformWithFeedback(PHASH_TABLE Table, HASH_ITEM_CALLBACK_WITH_FEE
  *  nothing is further done with it.
  *
  *  @remark
+ *  If the table is being rehashed, the rehashing is finished. The table
+ *  keeps its current number of buckets.
+ *
  *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
  *  the caller runs at valid IRQL.
  */
@@ -686,27 +1183,40 @@ VOID HashTableClear(PHASH_TABLE Table, BOOLEAN CallFreeFunction)
 {
    KIRQL Irql;
    ULONG i = 0;
+   ULONG j = 0;
    PHASH_ITEM old = NULL;
    PHASH_ITEM akt = NULL;
+   PHASH_ITEM *bucket = NULL;
+   BOOLEAN migrationFinished = FALSE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; CallFreeFunction=%u", Table, CallFreeFunction);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockExclusive(Table, i, &Irql);
-      if (CallFreeFunction && Table->FreeFunction != NULL) {
-         akt = Table->Buckets[i];
-         while (akt != NULL) {
-            old = akt;
-            akt = akt->Next;
-            Table->FreeFunction(old);
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         bucket = _HashTableBucketByIndex(Table, j);
+         if (CallFreeFunction && Table->FreeFunction != NULL) {
+            akt = *bucket;
+            while (akt != NULL) {
+               old = akt;
+               akt = akt->Next;
+               Table->FreeFunction(old);
+            }
          }
+
+         *bucket = NULL;
       }
 
-      Table->Buckets[i] = NULL;
+      // Old buckets of this lock are empty now, just mark them as moved
+      if (_HashTableMigrate(Table, i, MAXULONG))
+         migrationFinished = TRUE;
+
       HashTableUnlock(Table, i, Irql);
    }
 
    Table->NumberOfItems = 0;
+   if (migrationFinished)
+      _HashTableMigrationFinish(Table);
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -735,6 +1245,97 @@ ULONG HashTableGetItemCount(PHASH_TABLE Table)
    return ret;
 }
 
+/** Computes statistics describing distribution of items stored in a given
+ *  general hash table.
+ *
+ *  @param Table The table in question.
+ *  @param Statistics Address of a structure that receives the statistics.
+ *
+ *  @remark
+ *  The table is traversed lock by lock, each lock is held in shared mode while
+ *  the buckets it protects are examined. If the table is being rehashed, buckets
+ *  of both bucket arrays are counted.
+ *
+ *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
+ *  the caller runs at valid IRQL.
+ */
+VOID HashTableGetStatistics(PHASH_TABLE Table, PHASH_TABLE_STATISTICS Statistics)
+{
+   KIRQL Irql;
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG chainLength = 0;
+   PHASH_ITEM tmp = NULL;
+   DEBUG_ENTER_FUNCTION("Table=0x%p; Statistics=0x%p", Table, Statistics);
+   HASH_TABLE_IRQL_VALIDATE(Table);
+
+   memset(Statistics, 0, sizeof(HASH_TABLE_STATISTICS));
+   for (i = 0; i < Table->LockCount; ++i) {
+      HashTableLockShared(Table, i, &Irql);
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         chainLength = 0;
+         tmp = *_HashTableBucketByIndex(Table, j);
+         while (tmp != NULL) {
+            ++chainLength;
+            tmp = tmp->Next;
+         }
+
+         if (chainLength > 0)
+            ++Statistics->UsedBuckets;
+
+         if (chainLength > Statistics->MaxChainLength)
+            Statistics->MaxChainLength = chainLength;
+
+         ++Statistics->ChainLengthHistogram[min(chainLength, HASH_TABLE_STATISTICS_HISTOGRAM_SIZE - 1)];
+         Statistics->NumberOfItems += chainLength;
+      }
+
+      if (i == 0) {
+         Statistics->NumberOfBuckets = Table->Size;
+         Statistics->NumberOfOldBuckets = Table->OldSize;
+      }
+
+      HashTableUnlock(Table, i, Irql);
+   }
+
+   Statistics->NumberOfLocks = Table->LockCount;
+   if (Statistics->NumberOfBuckets + Statistics->NumberOfOldBuckets > 0)
+      Statistics->LoadFactor = (ULONG)(((ULONG64)Statistics->NumberOfItems * 100) / (Statistics->NumberOfBuckets + Statistics->NumberOfOldBuckets));
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/************************************************************************/
+/*                         HASH FUNCTIONS                               */
+/************************************************************************/
+
+/** Hash function suitable for tables keyed by addresses or integer values.
+ *
+ *  @param Key The key to hash. Integer keys are expected to be cast to PVOID.
+ *
+ *  @return
+ *  Returns the hash value.
+ *
+ *  @remark
+ *  Addresses of pool allocations are aligned and differ mostly in their middle
+ *  bits, so the key value cannot be used directly. The key is mixed by the
+ *  finalizer of the MurmurHash3 algorithm, every key bit affects all bits of the
+ *  result.
+ */
+ULONG32 HashTablePointerHash(PVOID Key)
+{
+   ULONG64 k = (ULONG64)(ULONG_PTR)Key;
+
+   k ^= (k >> 33);
+   k *= 0xff51afd7ed558ccdULL;
+   k ^= (k >> 33);
+   k *= 0xc4ceb9fe1a85ec53ULL;
+   k ^= (k >> 33);
+
+   return (ULONG32)k;
+}
+
 /************************************************************************/
 /*                         ITERATOR FUNCTIONS                           */
 /************************************************************************/
@@ -754,6 +1355,11 @@ ULONG HashTableGetItemCount(PHASH_TABLE Table)
  *  In such a case, the table is not locked and the current IRQL is left unchanged.
  *
  *  @remark
+ *  The iterator goes through the table lock by lock. All buckets protected by
+ *  one lock (in both bucket arrays when the table is being rehashed) are
+ *  visited while the lock is held, so rehashing cannot move items behind
+ *  the iterator's back.
+ *
  *  The @link(HASH_TABLE_IRQL_VALIDATE) macro is used to check whether
  *  the caller runs at valid IRQL.
  */
@@ -761,17 +1367,26 @@ BOOLEAN HashTableGetFirst(PHASH_TABLE Table, PHASH_TABLE_ITERATOR Iterator)
 {
    KIRQL irql;
    ULONG i = 0;
+   ULONG j = 0;
+   PHASH_ITEM item = NULL;
    BOOLEAN ret = FALSE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Iterator=0x%p", Table, Iterator);
    HASH_TABLE_IRQL_VALIDATE(Table);
 
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockShared(Table, i, &irql);
-      ret = Table->Buckets[i] != NULL;
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         item = *_HashTableBucketByIndex(Table, j);
+         if (item != NULL)
+            break;
+      }
+
+      ret = (item != NULL);
       if (ret) {
          Iterator->PointsToEnd = FALSE;
          Iterator->CurrentIndex = i;
-         Iterator->CurrentItem = Table->Buckets[i];
+         Iterator->BucketIndex = j;
+         Iterator->CurrentItem = item;
          Iterator->Irql = irql;
          Iterator->Table = Table;
          break;
@@ -809,26 +1424,36 @@ BOOLEAN HashTableGetFirst(PHASH_TABLE Table, PHASH_TABLE_ITERATOR Iterator)
 BOOLEAN HashTableGetNext(PHASH_TABLE_ITERATOR Iterator)
 {
    ULONG i = 0;
+   ULONG j = 0;
+   PHASH_ITEM item = NULL;
    PHASH_TABLE table = NULL;
    BOOLEAN ret = FALSE;
    DEBUG_ENTER_FUNCTION("Iterator=0x%p", Iterator);
 
    table = Iterator->Table;
-   for (i = Iterator->CurrentIndex; i < table->Size; ++i) {
-      if (i != Iterator->CurrentIndex) {
+   i = Iterator->CurrentIndex;
+   j = Iterator->BucketIndex;
+   item = Iterator->CurrentItem->Next;
+   while (item == NULL) {
+      j += table->LockCount;
+      if (j >= table->Size + table->OldSize) {
+         HashTableUnlock(table, i, Iterator->Irql);
+         ++i;
+         if (i == table->LockCount)
+            break;
+
          HashTableLockShared(table, i, &Iterator->Irql);
-         Iterator->CurrentItem = table->Buckets[i];
-         Iterator->CurrentIndex = i;
-      } else {
-         Iterator->CurrentItem = Iterator->CurrentItem->Next;
+         j = i;
       }
 
-      ret = (Iterator->CurrentItem != NULL);
-      if (ret) {
-         break;
-      }
+      item = *_HashTableBucketByIndex(table, j);
+   }
 
-      HashTableUnlock(table, i, Iterator->Irql);
+   ret = (item != NULL);
+   if (ret) {
+      Iterator->CurrentIndex = i;
+      Iterator->BucketIndex = j;
+      Iterator->CurrentItem = item;
    }
 
    Iterator->PointsToEnd = !ret;
@@ -9,6 +9,7 @@
 #define __HASH_TABLE_H_
 
 #include <ntifs.h>
+#include "general-types.h"
 
 
 /** Links hash table items stored in one bucket together. TThese structures
@@ -19,6 +20,10 @@
 typedef struct _HASH_ITEM {
    /** Address of the next item in the bucket. */
    struct _HASH_ITEM *Next;
+   /** Value returned by the hash function for the key of the item. Allows
+       to move the item to another bucket when the table is resized, and
+       to skip compare function calls for most of the non-matching items. */
+   ULONG32 HashValue;
 } HASH_ITEM, *PHASH_ITEM;
 
 
@@ -85,15 +90,17 @@ typedef BOOLEAN (*COMPARE_FUNCTION) (PHASH_ITEM ObjectInTable, PVOID Key);
 typedef VOID (*FREE_ITEM_FUNCTION) (PHASH_ITEM Object);
 
 /** Prototype of the action callback that is invoked for every item stored inside the
- *  table when a @link(HashTablePerform) is called.
+ *  table when a @link(HashTablePerform) is called, or for the item found by
+ *  @link(HashTableGetEx).
  *
  *  @param Object Address of the item.
  *  @param Context User-defined variable supplied as an argument to the
- *  HashTablePerform call.
+ *  HashTablePerform or HashTableGetEx call.
  *
  *  @remark
  *  The bucket to which the item passed to the callback routine as the first
- *  parameter, is locked for exclusive access.
+ *  parameter, is locked for exclusive access (HashTablePerform) or for shared
+ *  access (HashTableGetEx).
  *
  *  The IRQL at which the callback is invoked follows these conditions:
  *  * If the table is a passive IRQL table or no-synchronization table,
@@ -138,13 +145,41 @@ typedef enum {
    httDispatchLevel,
    /** A no-synchronization table. Access to the table is not synchronized, no
       limitations to IRQL and memory pool for table items are placed. */
-   httNoSynchronization
+   httNoSynchronization,
+   /** A dispatch IRQL table synchronized via executive reader-writer spin locks
+       (EX_SPIN_LOCK). Lookups acquire the locks in shared mode and do not block
+       each other. Suitable for read-mostly tables. Table items must be allocated
+       from nonpaged pool. */
+   httDispatchLevelShared,
 } EHashTableType, *PEHashTableType;
 
+/** Maximum ratio of number of items to number of buckets. When exceeded,
+    number of buckets is doubled. */
+#define HASH_TABLE_GROW_LOAD_FACTOR            2
+/** When number of items multiplied by this value drops below the number of
+    buckets, the number of buckets is halved (but never goes below the size
+    specified at creation time). */
+#define HASH_TABLE_SHRINK_LOAD_DIVISOR         8
+/** Maximum number of buckets a table can grow to. */
+#define HASH_TABLE_MAX_SIZE                    0x4000000
+/** Default number of locks (lock stripes) of synchronized tables. */
+#define HASH_TABLE_DEFAULT_LOCK_COUNT          16
+/** Number of old buckets moved to the new bucket array by a single insert
+    or delete operation during incremental rehashing. */
+#define HASH_TABLE_MIGRATE_STEP                2
+
 /** Represents a general hash table. */
 typedef struct _HASH_TABLE {
    /** Number of buckets (slots). */
    ULONG32 Size;
+   /** Number of buckets the table was created with. The table never
+       shrinks below this value. */
+   ULONG32 MinSize;
+   /** Number of bucket locks (lock stripes), independent of number of buckets.
+       Bucket with index I is protected by lock with index I % LockCount, in both
+       bucket arrays. Since number of buckets is always a multiple of LockCount,
+       an item is protected by the same lock before and after resize. */
+   ULONG32 LockCount;
    /** type of the table. */
    EHashTableType Type;
    /** Address of the hash function. */
@@ -156,23 +191,43 @@ typedef struct _HASH_TABLE {
    /** Array of executive resources used to synchronize access to individual
        buckets. For passive IRQL tables only. */
    PERESOURCE Locks;
-   /** Array of reader-writer spin locks used to synchronize access to individual
-       buckets. For dispatch IRQL tables only. */
+   /** Array of spin locks used to synchronize access to individual
+       buckets. For dispatch IRQL tables with exclusive locking only. */
    PKSPIN_LOCK DispatchLocks;
-   /** Array of boolean variables that indicate which buckets are
-       locked exclusively. Used by dispatch IRQL tables only. */
+   /** Array of reader-writer spin locks used by dispatch IRQL tables with
+       shared locking only. */
+   PEX_SPIN_LOCK SharedDispatchLocks;
+   /** Array of boolean variables that indicate which locks are
+       held exclusively. Used by dispatch IRQL tables only. */
    PBOOLEAN DispatchLockExclusive;
    /** Number of entries stored in the hash table. */
    volatile ULONG NumberOfItems;
    /** The buckets. */
-   PHASH_ITEM Buckets[1];
+   PHASH_ITEM *Buckets;
+   /** Bucket array the items are being moved from during incremental
+       rehashing. NULL if no rehashing is in progress. */
+   PHASH_ITEM *OldBuckets;
+   /** Number of buckets in the OldBuckets array. */
+   ULONG32 OldSize;
+   /** For every lock, index of the next old bucket (protected by that lock)
+       to be moved into the new bucket array. */
+   PULONG32 MigrateCursors;
+   /** Number of locks whose old buckets have not been fully moved yet. */
+   volatile LONG LocksToMigrate;
+   /** Used to select the lock whose old buckets are moved by an operation
+       on another part of the table. */
+   volatile LONG MigrateHelper;
 } HASH_TABLE, *PHASH_TABLE;
 
 /** Represents a general hash table iterator. The iterator can represent
     one table item. */
 typedef struct {
-   /** Bucket index of the item represented by the iterator. */
+   /** Index of the lock protecting the item represented by the iterator. */
    ULONG CurrentIndex;
+   /** Bucket index of the item represented by the iterator. Indices equal to
+       or greater than the table size refer to the old bucket array of a table
+       being rehashed. */
+   ULONG BucketIndex;
    /** Pointer to the item associated with the iterator. */
    PHASH_ITEM CurrentItem;
    /** Value of IRQL the caller was running at before this iterator
@@ -187,14 +242,19 @@ typedef struct {
 
 
 NTSTATUS HashTableCreate(EHashTableType Type, IN ULONG32 Size, IN HASH_FUNCTION HashFunction, IN COMPARE_FUNCTION CompareFunction, IN FREE_ITEM_FUNCTION FreeFunction, OUT PHASH_TABLE *Table);
+NTSTATUS HashTableCreateEx(EHashTableType Type, IN ULONG32 Size, IN ULONG32 LockCount, IN HASH_FUNCTION HashFunction, IN COMPARE_FUNCTION CompareFunction, IN FREE_ITEM_FUNCTION FreeFunction, OUT PHASH_TABLE *Table);
 VOID HashTableDestroy(IN PHASH_TABLE Table);
 VOID HashTableInsert(IN PHASH_TABLE Table, IN PHASH_ITEM Object, IN PVOID Key);
 PHASH_ITEM HashTableDelete(IN PHASH_TABLE Table, IN PVOID Key);
 PHASH_ITEM HashTableGet(IN PHASH_TABLE Table, IN PVOID Key);
+PHASH_ITEM HashTableGetEx(IN PHASH_TABLE Table, IN PVOID Key, IN HASH_ITEM_CALLBACK Callback, IN PVOID Context);
 VOID HashTablePerform(PHASH_TABLE Table, HASH_ITEM_CALLBACK Callback, PVOID Context);
 VOID HashTablePerformWithFeedback(PHASH_TABLE Table, HASH_ITEM_CALLBACK_WITH_FEEDBACK *Callback, PVOID Context);
 VOID HashTableClear(PHASH_TABLE Table, BOOLEAN CallFreeFunction);
 ULONG HashTableGetItemCount(PHASH_TABLE Table);
+VOID HashTableGetStatistics(PHASH_TABLE Table, PHASH_TABLE_STATISTICS Statistics);
+
+ULONG32 HashTablePointerHash(PVOID Key);
 
 BOOLEAN HashTableGetFirst(PHASH_TABLE HashTable, PHASH_TABLE_ITERATOR Iterator);
 BOOLEAN HashTableGetNext(PHASH_TABLE_ITERATOR Iterator);
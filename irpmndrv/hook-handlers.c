@@ -55,12 +55,7 @@ static BOOLEAN _CatchRequest(PDRIVER_HOOK_RECORD DriverHookRecord, PDEVICE_HOOK_
 			if (DeviceObject != NULL) {
 				status = DriverHookRecordAddDevice(DriverHookRecord, DeviceObject, NULL, NULL, TRUE, &deviceRecord);
 				if (NT_SUCCESS(status)) {
-					PREQUEST_HEADER rq = NULL;
-
-					status = RequestXXXDetectedCreate(ertDeviceDetected, DeviceObject->DriverObject, DeviceObject, &rq);
-					if (NT_SUCCESS(status))
-						RequestQueueInsert(rq);
-
+					RequestXXXDetectedQueue(ertDeviceDetected, DeviceObject->DriverObject, DeviceObject);
 					DeviceHookRecordDereference(deviceRecord);
 				}
 
@@ -1322,14 +1317,8 @@ NTSTATUS HookHandlerAddDeviceDispatch(PDRIVER_OBJECT DriverObject, PDEVICE_OBJEC
 
 		detectedDevice = PhysicalDeviceObject;
 		while (detectedDevice != NULL) {
-			PREQUEST_HEADER rq = NULL;
-
-			if (NT_SUCCESS(RequestXXXDetectedCreate(ertDriverDetected, detectedDevice->DriverObject, NULL, &rq)))
-				RequestQueueInsert(rq);
-
-			if (NT_SUCCESS(RequestXXXDetectedCreate(ertDeviceDetected, detectedDevice->DriverObject, detectedDevice, &rq)))
-				RequestQueueInsert(rq);
-
+			RequestXXXDetectedQueue(ertDriverDetected, detectedDevice->DriverObject, NULL);
+			RequestXXXDetectedQueue(ertDeviceDetected, detectedDevice->DriverObject, detectedDevice);
 			detectedDevice = detectedDevice->AttachedDevice;
 		}
 
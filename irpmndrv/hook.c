@@ -16,12 +16,12 @@
 /************************************************************************/
 
 static PHASH_TABLE _driverTable = NULL;
+/** Serializes modifications and enumerations of the driver table. Lookups
+    do not need it, the table synchronizes them itself. */
 static KSPIN_LOCK _driverTableLock;
 
 static PHASH_TABLE _driverValidationTable = NULL;
-static KSPIN_LOCK _driverValidationTableLock;
 static PHASH_TABLE _deviceValidationTable = NULL;
-static KSPIN_LOCK _deviceValidationTableLock;
 
 /************************************************************************/
 /*                       FORWARD DECLARATIONS                           */
@@ -36,7 +36,7 @@ static VOID _UnhookDriverObject(PDRIVER_HOOK_RECORD HookRecord);
 
 static ULONG32 _HashFunction(PVOID Key)
 {
-	return (ULONG32)((ULONG_PTR)Key / 4);
+	return HashTablePointerHash(Key);
 }
 
 static BOOLEAN _DriverCompareFunction(PHASH_ITEM HashItem, PVOID Key)
@@ -67,6 +67,42 @@ static BOOLEAN _DeviceValidationCompareFunction(PHASH_ITEM HashItem, PVOID Key)
 	return (Key == r);
 }
 
+static VOID _DriverReferenceCallback(PHASH_ITEM HashItem, PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Context);
+
+	DriverHookRecordReference(CONTAINING_RECORD(HashItem, DRIVER_HOOK_RECORD, HashItem));
+
+	return;
+}
+
+static VOID _DeviceReferenceCallback(PHASH_ITEM HashItem, PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Context);
+
+	DeviceHookRecordReference(CONTAINING_RECORD(HashItem, DEVICE_HOOK_RECORD, HashItem));
+
+	return;
+}
+
+static VOID _DriverValidationReferenceCallback(PHASH_ITEM HashItem, PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Context);
+
+	DriverHookRecordReference(CONTAINING_RECORD(HashItem, DRIVER_HOOK_RECORD, ValidationHashItem));
+
+	return;
+}
+
+static VOID _DeviceValidationReferenceCallback(PHASH_ITEM HashItem, PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Context);
+
+	DeviceHookRecordReference(CONTAINING_RECORD(HashItem, DEVICE_HOOK_RECORD, ValidationHashItem));
+
+	return;
+}
+
 static VOID _DriverFreeFunction(PHASH_ITEM HashItem)
 {
 	PDRIVER_HOOK_RECORD r = CONTAINING_RECORD(HashItem, DRIVER_HOOK_RECORD, HashItem);
@@ -101,13 +137,10 @@ static VOID _DeviceFreeFunction(PHASH_ITEM HashItem)
 
 static VOID _MakeDriverHookRecordValid(PDRIVER_HOOK_RECORD DriverRecord)
 {
-	KIRQL irql;
 	DEBUG_ENTER_FUNCTION("DriverRecord=0x%p", DriverRecord);
 
-	KeAcquireSpinLock(&_driverValidationTableLock, &irql);
 	ASSERT(HashTableGet(_driverValidationTable, DriverRecord) == NULL);
 	HashTableInsert(_driverValidationTable, &DriverRecord->ValidationHashItem, DriverRecord);
-	KeReleaseSpinLock(&_driverValidationTableLock, irql);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -115,13 +148,10 @@ static VOID _MakeDriverHookRecordValid(PDRIVER_HOOK_RECORD DriverRecord)
 
 static VOID _InvalidateDriverHookRecord(PDRIVER_HOOK_RECORD DriverRecord)
 {
-	KIRQL irql;
 	DEBUG_ENTER_FUNCTION("DriverRecord=0x%p", DriverRecord);
 
-	KeAcquireSpinLock(&_driverValidationTableLock, &irql);
 	ASSERT(HashTableGet(_driverValidationTable, DriverRecord) != NULL);
 	HashTableDelete(_driverValidationTable, DriverRecord);
-	KeReleaseSpinLock(&_driverValidationTableLock, irql);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -129,12 +159,9 @@ static VOID _InvalidateDriverHookRecord(PDRIVER_HOOK_RECORD DriverRecord)
 
 static VOID _MakeDeviceHookRecordValid(PDEVICE_HOOK_RECORD DeviceRecord)
 {
-	KIRQL irql;
 	DEBUG_ENTER_FUNCTION("DeviceRecord=0x%p", DeviceRecord);
 
-	KeAcquireSpinLock(&_deviceValidationTableLock, &irql);
 	HashTableInsert(_deviceValidationTable, &DeviceRecord->ValidationHashItem, DeviceRecord);
-	KeReleaseSpinLock(&_deviceValidationTableLock, irql);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -142,12 +169,9 @@ static VOID _MakeDeviceHookRecordValid(PDEVICE_HOOK_RECORD DeviceRecord)
 
 static VOID _InvalidateDeviceHookRecord(PDEVICE_HOOK_RECORD DeviceRecord)
 {
-	KIRQL irql;
 	DEBUG_ENTER_FUNCTION("DeviceRecord=0x%p", DeviceRecord);
 
-	KeAcquireSpinLock(&_deviceValidationTableLock, &irql);
 	HashTableDelete(_deviceValidationTable, DeviceRecord);
-	KeReleaseSpinLock(&_deviceValidationTableLock, irql);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -337,7 +361,7 @@ static NTSTATUS _DriverHookRecordCreate(PDRIVER_OBJECT DriverObject, PDRIVER_MON
 			memcpy(tmpRecord->IRPSettings, MonitorSettings->IRPSettings, sizeof(tmpRecord->IRPSettings));
 			memcpy(tmpRecord->FastIoSettings, MonitorSettings->FastIoSettings, sizeof(tmpRecord->FastIoSettings));
 			KeInitializeSpinLock(&tmpRecord->SelectedDevicesLock);
-			status = HashTableCreate(httNoSynchronization, 37, _HashFunction, _DeviceCompareFunction, _DeviceFreeFunction, &tmpRecord->SelectedDevices);
+			status = HashTableCreateEx(httDispatchLevelShared, 37, 4, _HashFunction, _DeviceCompareFunction, _DeviceFreeFunction, &tmpRecord->SelectedDevices);
 			if (NT_SUCCESS(status))
 				*Record = tmpRecord;
 		
@@ -596,21 +620,159 @@ NTSTATUS UnhookDriverObject(PDRIVER_HOOK_RECORD DriverRecord)
 	return status;
 }
 
-PDRIVER_HOOK_RECORD DriverHookRecordGet(PDRIVER_OBJECT DriverObject)
+/** Hooks multiple drivers at once.
+ *
+ *  @param Count Number of elements in the DriverObjects, MonitorSettings, DriverRecords and
+ *  Statuses arrays.
+ *  @param DriverObjects Drivers to hook. NULL entries are skipped (their status is left untouched).
+ *  @param MonitorSettings Monitoring settings for the individual drivers.
+ *  @param DriverRecords Receives referenced hook records for drivers that were hooked successfully.
+ *  @param Statuses Receives per-driver result of the operation.
+ *
+ *  @return
+ *  Returns STATUS_SUCCESS if at least the batch itself could be processed. Results for
+ *  individual drivers are reported through the Statuses array.
+ *
+ *  @remark
+ *  The hook records (and records of the existing devices) are prepared outside of any lock,
+ *  all the records are then inserted into the driver table during a single acquisition
+ *  of its lock. The routine must be called at PASSIVE_LEVEL.
+ */
+NTSTATUS HookDriverObjects(ULONG Count, PDRIVER_OBJECT *DriverObjects, PDRIVER_MONITOR_SETTINGS MonitorSettings, PDRIVER_HOOK_RECORD *DriverRecords, NTSTATUS *Statuses)
 {
 	KIRQL irql;
-	PHASH_ITEM h = NULL;
-	PDRIVER_HOOK_RECORD ret = NULL;
-	DEBUG_ENTER_FUNCTION("DriverObject=0x%p", DriverObject);
+	ULONG i = 0;
+	PDRIVER_HOOK_RECORD *records = NULL;
+	PDEVICE_HOOK_RECORD **existingDevices = NULL;
+	PULONG existingDeviceCounts = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("Count=%u; DriverObjects=0x%p; MonitorSettings=0x%p; DriverRecords=0x%p; Statuses=0x%p", Count, DriverObjects, MonitorSettings, DriverRecords, Statuses);
+
+	records = (PDRIVER_HOOK_RECORD *)HeapMemoryAllocPaged(Count*(sizeof(PDRIVER_HOOK_RECORD) + sizeof(PDEVICE_HOOK_RECORD *) + sizeof(ULONG)));
+	if (records != NULL) {
+		memset(records, 0, Count*(sizeof(PDRIVER_HOOK_RECORD) + sizeof(PDEVICE_HOOK_RECORD *) + sizeof(ULONG)));
+		existingDevices = (PDEVICE_HOOK_RECORD **)(records + Count);
+		existingDeviceCounts = (PULONG)(existingDevices + Count);
+		for (i = 0; i < Count; ++i) {
+			DriverRecords[i] = NULL;
+			if (DriverObjects[i] == NULL)
+				continue;
+
+			Statuses[i] = _DriverHookRecordCreate(DriverObjects[i], MonitorSettings + i, FALSE, records + i);
+			if (NT_SUCCESS(Statuses[i])) {
+				Statuses[i] = _CreateRecordsForExistingDevices(records[i], existingDevices + i, existingDeviceCounts + i);
+				if (!NT_SUCCESS(Statuses[i])) {
+					DriverHookRecordDereference(records[i]);
+					records[i] = NULL;
+				}
+			}
+		}
+
+		KeAcquireSpinLock(&_driverTableLock, &irql);
+		for (i = 0; i < Count; ++i) {
+			PDRIVER_HOOK_RECORD record = records[i];
+
+			if (record == NULL)
+				continue;
+
+			if (HashTableGet(_driverTable, record->DriverObject) == NULL) {
+				KIRQL irql2;
+				ULONG j = 0;
+
+				DriverHookRecordReference(record);
+				HashTableInsert(_driverTable, &record->HashItem, record->DriverObject);
+				KeAcquireSpinLock(&record->SelectedDevicesLock, &irql2);
+				for (j = 0; j < existingDeviceCounts[i]; ++j) {
+					PDEVICE_HOOK_RECORD deviceRecord = existingDevices[i][j];
+
+					DeviceHookRecordReference(deviceRecord);
+					HashTableInsert(record->SelectedDevices, &deviceRecord->HashItem, deviceRecord->DeviceObject);
+				}
+
+				KeReleaseSpinLock(&record->SelectedDevicesLock, irql2);
+				DriverHookRecordReference(record);
+				DriverRecords[i] = record;
+			} else Statuses[i] = STATUS_ALREADY_REGISTERED;
+		}
+
+		KeReleaseSpinLock(&_driverTableLock, irql);
+		for (i = 0; i < Count; ++i) {
+			if (records[i] == NULL)
+				continue;
+
+			if (DriverRecords[i] != NULL)
+				_MakeDriverHookRecordValid(records[i]);
+
+			_FreeDeviceHookRecordArray(existingDevices[i], existingDeviceCounts[i]);
+			DriverHookRecordDereference(records[i]);
+		}
+
+		HeapMemoryFree(records);
+		status = STATUS_SUCCESS;
+	} else status = STATUS_INSUFFICIENT_RESOURCES;
+
+	DEBUG_EXIT_FUNCTION("0x%x", status);
+	return status;
+}
+
+/** Unhooks multiple drivers at once.
+ *
+ *  @param Count Number of elements in the DriverRecords and Statuses arrays.
+ *  @param DriverRecords Hook records of the drivers to unhook. NULL entries are skipped.
+ *  @param Statuses Receives per-driver result of the operation.
+ *
+ *  @remark
+ *  All the records are removed from the driver table during a single acquisition of its
+ *  lock. Drivers that are being monitored have their hooks removed as well.
+ */
+VOID UnhookDriverObjects(ULONG Count, PDRIVER_HOOK_RECORD *DriverRecords, NTSTATUS *Statuses)
+{
+	KIRQL irql;
+	ULONG i = 0;
+	DEBUG_ENTER_FUNCTION("Count=%u; DriverRecords=0x%p; Statuses=0x%p", Count, DriverRecords, Statuses);
 
 	KeAcquireSpinLock(&_driverTableLock, &irql);
-	h = HashTableGet(_driverTable, DriverObject);
-	if (h != NULL) {
-		ret = CONTAINING_RECORD(h, DRIVER_HOOK_RECORD, HashItem);
-		DriverHookRecordReference(ret);
+	for (i = 0; i < Count; ++i) {
+		if (DriverRecords[i] == NULL)
+			continue;
+
+		Statuses[i] = (HashTableDelete(_driverTable, DriverRecords[i]->DriverObject) != NULL) ?
+			STATUS_SUCCESS :
+			STATUS_NOT_FOUND;
 	}
 
 	KeReleaseSpinLock(&_driverTableLock, irql);
+	for (i = 0; i < Count; ++i) {
+		PDRIVER_HOOK_RECORD record = DriverRecords[i];
+
+		if (record == NULL || !NT_SUCCESS(Statuses[i]))
+			continue;
+
+		if (record->MonitoringEnabled) {
+			_UnhookDriverObject(record);
+			record->MonitoringEnabled = FALSE;
+		}
+
+		KeAcquireSpinLock(&record->SelectedDevicesLock, &irql);
+		HashTableClear(record->SelectedDevices, TRUE);
+		KeReleaseSpinLock(&record->SelectedDevicesLock, irql);
+		_InvalidateDriverHookRecord(record);
+		DriverHookRecordDereference(record);
+	}
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+PDRIVER_HOOK_RECORD DriverHookRecordGet(PDRIVER_OBJECT DriverObject)
+{
+	PHASH_ITEM h = NULL;
+	PDRIVER_HOOK_RECORD ret = NULL;
+	DEBUG_ENTER_FUNCTION("DriverObject=0x%p", DriverObject);
+
+	h = HashTableGetEx(_driverTable, DriverObject, _DriverReferenceCallback, NULL);
+	if (h != NULL)
+		ret = CONTAINING_RECORD(h, DRIVER_HOOK_RECORD, HashItem);
 
 	DEBUG_EXIT_FUNCTION("0x%p", ret);
 	return ret;
@@ -741,7 +903,6 @@ NTSTATUS DriverHookRecordAddDevice(PDRIVER_HOOK_RECORD DriverRecord, PDEVICE_OBJ
 
 NTSTATUS DriverHookRecordDeleteDevice(PDEVICE_HOOK_RECORD DeviceRecord)
 {
-	KIRQL irql;
 	PHASH_ITEM h = NULL;
 	PDRIVER_HOOK_RECORD driverRecord = NULL;
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
@@ -749,12 +910,9 @@ NTSTATUS DriverHookRecordDeleteDevice(PDEVICE_HOOK_RECORD DeviceRecord)
 	DEBUG_ENTER_FUNCTION("DeviceRecord=0x%p", DeviceRecord);
 
 	driverRecord = DeviceRecord->DriverRecord;
-	KeAcquireSpinLock(&driverRecord->SelectedDevicesLock, &irql);
-	h = HashTableGet(driverRecord->SelectedDevices, DeviceRecord->DeviceObject);
+	h = HashTableGetEx(driverRecord->SelectedDevices, DeviceRecord->DeviceObject, _DeviceReferenceCallback, NULL);
 	if (h != NULL) {
 		deviceRecord = CONTAINING_RECORD(h, DEVICE_HOOK_RECORD, HashItem);
-		DeviceHookRecordReference(deviceRecord);
-		KeReleaseSpinLock(&driverRecord->SelectedDevicesLock, irql);
 		if (deviceRecord->CreateReason == edrcrUserRequest) {
 			deviceRecord->CreateReason = edrcrDriverHooked;
 			deviceRecord->MonitoringEnabled = FALSE;
@@ -764,7 +922,6 @@ NTSTATUS DriverHookRecordDeleteDevice(PDEVICE_HOOK_RECORD DeviceRecord)
 		
 		DeviceHookRecordDereference(deviceRecord);
 	} else {
-		KeReleaseSpinLock(&driverRecord->SelectedDevicesLock, irql);
 		status = STATUS_NOT_FOUND;
 		ASSERT(FALSE);
 	}
@@ -776,19 +933,13 @@ NTSTATUS DriverHookRecordDeleteDevice(PDEVICE_HOOK_RECORD DeviceRecord)
 
 PDEVICE_HOOK_RECORD DriverHookRecordGetDevice(PDRIVER_HOOK_RECORD Record, PDEVICE_OBJECT DeviceObject)
 {
-	KIRQL irql;
 	PHASH_ITEM h = NULL;
 	PDEVICE_HOOK_RECORD ret = NULL;
 	DEBUG_ENTER_FUNCTION("Record=0x%p; DeviceObject=0x%p", Record, DeviceObject);
 
-	KeAcquireSpinLock(&Record->SelectedDevicesLock, &irql);
-	h = HashTableGet(Record->SelectedDevices, DeviceObject);
-	if (h != NULL) {
+	h = HashTableGetEx(Record->SelectedDevices, DeviceObject, _DeviceReferenceCallback, NULL);
+	if (h != NULL)
 		ret = CONTAINING_RECORD(h, DEVICE_HOOK_RECORD, HashItem);
-		DeviceHookRecordReference(ret);
-	}
-
-	KeReleaseSpinLock(&Record->SelectedDevicesLock, irql);
 
 	DEBUG_EXIT_FUNCTION("0x%p", ret);
 	return ret;
@@ -861,7 +1012,7 @@ NTSTATUS HookObjectsEnumerate(PVOID Buffer, ULONG BufferLength, PULONG ReturnLen
 				HashTableIteratorFinit(&itDevices);
 			}
 
-			KeReleaseSpinLock(&driverRecord->SelectedDevicesLock, irql);
+			KeReleaseSpinLock(&driverRecord->SelectedDevicesLock, irql2);
 		} while (HashTableGetNext(&itDrivers));
 
 		HashTableIteratorFinit(&itDrivers);
@@ -927,7 +1078,7 @@ NTSTATUS HookObjectsEnumerate(PVOID Buffer, ULONG BufferLength, PULONG ReturnLen
 					driverInfo = (PHOOKED_DRIVER_INFO)deviceInfo;
 				}
 
-				KeReleaseSpinLock(&driverRecord->SelectedDevicesLock, irql);
+				KeReleaseSpinLock(&driverRecord->SelectedDevicesLock, irql2);
 			} while (HashTableGetNext(&itDrivers));
 
 			HashTableIteratorFinit(&itDrivers);
@@ -943,16 +1094,10 @@ NTSTATUS HookObjectsEnumerate(PVOID Buffer, ULONG BufferLength, PULONG ReturnLen
 
 BOOLEAN DeviceHookRecordValid(PDEVICE_HOOK_RECORD DeviceRecord)
 {
-	KIRQL irql;
 	BOOLEAN ret = FALSE;
 	DEBUG_ENTER_FUNCTION("DeviceRecord=0x%p", DeviceRecord);
 
-	KeAcquireSpinLock(&_deviceValidationTableLock, &irql);
-	ret = HashTableGet(_deviceValidationTable, DeviceRecord) != NULL;
-	if (ret)
-		DeviceHookRecordReference(DeviceRecord);
-
-	KeReleaseSpinLock(&_deviceValidationTableLock, irql);
+	ret = HashTableGetEx(_deviceValidationTable, DeviceRecord, _DeviceValidationReferenceCallback, NULL) != NULL;
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
@@ -961,22 +1106,36 @@ BOOLEAN DeviceHookRecordValid(PDEVICE_HOOK_RECORD DeviceRecord)
 
 BOOLEAN DriverHookRecordValid(PDRIVER_HOOK_RECORD DriverRecord)
 {
-	KIRQL irql;
 	BOOLEAN ret = FALSE;
 	DEBUG_ENTER_FUNCTION("DriverRecord=0x%p", DriverRecord);
 
-	KeAcquireSpinLock(&_driverValidationTableLock, &irql);
-	ret = HashTableGet(_driverValidationTable, DriverRecord) != NULL;
-	if (ret)
-		DriverHookRecordReference(DriverRecord);
-
-	KeReleaseSpinLock(&_driverValidationTableLock, irql);
+	ret = HashTableGetEx(_driverValidationTable, DriverRecord, _DriverValidationReferenceCallback, NULL) != NULL;
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
 }
 
 
+/** Retrieves statistics of hash tables maintained by the hooking module.
+ *
+ *  @param DriverTable Receives statistics of the table mapping driver objects
+ *  to driver hook records.
+ *  @param DriverValidation Receives statistics of the driver hook record validation table.
+ *  @param DeviceValidation Receives statistics of the device hook record validation table.
+ */
+VOID HookGetHashTableStatistics(PHASH_TABLE_STATISTICS DriverTable, PHASH_TABLE_STATISTICS DriverValidation, PHASH_TABLE_STATISTICS DeviceValidation)
+{
+	DEBUG_ENTER_FUNCTION("DriverTable=0x%p; DriverValidation=0x%p; DeviceValidation=0x%p", DriverTable, DriverValidation, DeviceValidation);
+
+	HashTableGetStatistics(_driverTable, DriverTable);
+	HashTableGetStatistics(_driverValidationTable, DriverValidation);
+	HashTableGetStatistics(_deviceValidationTable, DeviceValidation);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
 
 /************************************************************************/
 /*                       INITIALIZATION AND FINALIZATION                */
@@ -992,14 +1151,12 @@ NTSTATUS HookModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context)
 	UNREFERENCED_PARAMETER(DriverObject);
 	UNREFERENCED_PARAMETER(Context);
 
-	KeInitializeSpinLock(&_driverValidationTableLock);
-	status = HashTableCreate(httNoSynchronization, 37, _HashFunction, _DriverValidationCompareFunction, NULL, &_driverValidationTable);
+	status = HashTableCreate(httDispatchLevelShared, 37, _HashFunction, _DriverValidationCompareFunction, NULL, &_driverValidationTable);
 	if (NT_SUCCESS(status)) {
-		KeInitializeSpinLock(&_deviceValidationTableLock);
-		status = HashTableCreate(httNoSynchronization, 37, _HashFunction, _DeviceValidationCompareFunction, NULL, &_deviceValidationTable);
+		status = HashTableCreate(httDispatchLevelShared, 37, _HashFunction, _DeviceValidationCompareFunction, NULL, &_deviceValidationTable);
 		if (NT_SUCCESS(status)) {
 			KeInitializeSpinLock(&_driverTableLock);
-			status = HashTableCreate(httNoSynchronization, 37, _HashFunction, _DriverCompareFunction, _DriverFreeFunction, &_driverTable);
+			status = HashTableCreate(httDispatchLevelShared, 37, _HashFunction, _DriverCompareFunction, _DriverFreeFunction, &_driverTable);
 			if (!NT_SUCCESS(status))
 				HashTableDestroy(_deviceValidationTable);
 		}
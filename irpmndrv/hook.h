@@ -97,7 +97,8 @@ typedef struct _DRIVER_HOOK_RECORD {
 	UCHAR FastIoSettings[FastIoMax];
 	/** Indicates whether the driver actively monitors incoming requests. */
 	BOOLEAN MonitoringEnabled;
-	/** Synchronizes access to the device table. */
+	/** Serializes modifications of the device table. Lookups do not need it, the table
+	    synchronizes them itself. */
 	KSPIN_LOCK SelectedDevicesLock;
 	/** Contains information about monitoring of individual devices. */
 	PHASH_TABLE SelectedDevices;
@@ -112,6 +113,8 @@ BOOLEAN DeviceHookRecordValid(PDEVICE_HOOK_RECORD DeviceRecord);
 
 NTSTATUS HookDriverObject(PDRIVER_OBJECT DriverObject, PDRIVER_MONITOR_SETTINGS MonitorSettings, PDRIVER_HOOK_RECORD *DriverRecord);
 NTSTATUS UnhookDriverObject(PDRIVER_HOOK_RECORD DriverRecord);
+NTSTATUS HookDriverObjects(ULONG Count, PDRIVER_OBJECT *DriverObjects, PDRIVER_MONITOR_SETTINGS MonitorSettings, PDRIVER_HOOK_RECORD *DriverRecords, NTSTATUS *Statuses);
+VOID UnhookDriverObjects(ULONG Count, PDRIVER_HOOK_RECORD *DriverRecords, NTSTATUS *Statuses);
 NTSTATUS DriverHookRecordSetInfo(PDRIVER_HOOK_RECORD Record, PDRIVER_MONITOR_SETTINGS DriverSettings);
 VOID DriverHookRecordGetInfo(PDRIVER_HOOK_RECORD Record, PDRIVER_MONITOR_SETTINGS DriverSettings, PBOOLEAN Enabled);
 NTSTATUS DriverHookRecordEnable(PDRIVER_HOOK_RECORD Record, BOOLEAN Enable);
@@ -124,6 +127,7 @@ NTSTATUS DeviceHookRecordSetInfo(PDEVICE_HOOK_RECORD Record, PUCHAR IRPSettings,
 VOID DeviceHookRecordGetInfo(PDEVICE_HOOK_RECORD Record, PUCHAR IRPSettings, PUCHAR FastIoSettings, PBOOLEAN MonitoringEnabled);
 
 NTSTATUS HookObjectsEnumerate(PVOID Buffer, ULONG BufferLength, PULONG ReturnLength);
+VOID HookGetHashTableStatistics(PHASH_TABLE_STATISTICS DriverTable, PHASH_TABLE_STATISTICS DriverValidation, PHASH_TABLE_STATISTICS DeviceValidation);
 
 NTSTATUS HookModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context);
 VOID HookModuleFinit(PDRIVER_OBJECT DriverObject, PVOID Context);
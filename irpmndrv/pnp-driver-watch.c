@@ -272,15 +272,8 @@ static NTSTATUS _CheckDriver(PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceO
 	}
 
 	if (NT_SUCCESS(status)) {
-		PREQUEST_HEADER rq = NULL;
-
-		status = RequestXXXDetectedCreate(ertDriverDetected, DriverObject, NULL, &rq);
-		if (NT_SUCCESS(status))
-			RequestQueueInsert(rq);
-
-		status = RequestXXXDetectedCreate(ertDeviceDetected, DriverObject, DeviceObject, &rq);
-		if (NT_SUCCESS(status))
-			RequestQueueInsert(rq);
+		RequestXXXDetectedQueue(ertDriverDetected, DriverObject, NULL);
+		RequestXXXDetectedQueue(ertDeviceDetected, DriverObject, DeviceObject);
 	}
 
 	DEBUG_EXIT_FUNCTION("0x%x", status)
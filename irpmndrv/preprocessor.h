@@ -63,7 +63,7 @@
  */
 #define DEBUG_ERROR(format,...) \
    DbgPrintEx(DPFLTR_DEFAULT_ID, DPFLTR_ERROR_LEVEL, AT_LINE " ERROR: " format "\n", __VA_ARGS__); \
- //  __debugbreak() \
+ //  __debugbreak()
 
 
 #define DEBUG_IRQL_LESS_OR_EQUAL(aIrql) \
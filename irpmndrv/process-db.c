@@ -45,7 +45,6 @@ typedef struct _SYSTEM_PROCESS_INFORMATION {
 /************************************************************************/
 
 static PHASH_TABLE _pdbTable = NULL;
-static ERESOURCE _pdbLock;
 
 
 /************************************************************************/
@@ -140,7 +139,7 @@ static NTSTATUS _GetProcessNameById(HANDLE ProcessId, PUNICODE_STRING Name)
 
 static ULONG32 _HashFunction(PVOID Key)
 {
-	return (ULONG32)((ULONG_PTR)Key >> 2);
+	return HashTablePointerHash(Key);
 }
 
 static BOOLEAN _CompareFunction(PHASH_ITEM Item, PVOID Key)
@@ -283,11 +282,7 @@ VOID _ProcessNotifyEx(HANDLE ParentId, HANDLE ProcessId, PPS_CREATE_NOTIFY_INFO
 			status = RequestProcessCreatedCreated(rec->ProcessId, rec->ParentId, rec->CreatorId, &rec->ImageName, &rec->CommandLine, &rc);
 			if (NT_SUCCESS(status)) {
 				PDBRecordReference(rec);
-				KeEnterCriticalRegion();
-				ExAcquireResourceExclusiveLite(&_pdbLock, TRUE);
 				HashTableInsert(_pdbTable, &rec->Item, ProcessId);
-				ExReleaseResourceLite(&_pdbLock);
-				KeLeaveCriticalRegion();
 				RequestQueueInsert(&rc->Header);
 			}
 
@@ -296,11 +291,7 @@ VOID _ProcessNotifyEx(HANDLE ParentId, HANDLE ProcessId, PPS_CREATE_NOTIFY_INFO
 
 		CreateInfo->CreationStatus = status;
 	} else {
-		KeEnterCriticalRegion();
-		ExAcquireResourceExclusiveLite(&_pdbLock, TRUE);
 		h = HashTableDelete(_pdbTable, ProcessId);
-		ExReleaseResourceLite(&_pdbLock);
-		KeLeaveCriticalRegion();
 		if (h != NULL) {
 			rec = CONTAINING_RECORD(h, PROCESSDB_RECORD, Item);
 			RequestHeaderInit(&rec->ExitRequest->Header, NULL, NULL, ertProcessExitted);
@@ -337,6 +328,17 @@ VOID PDBRecordDereference(PPROCESSDB_RECORD Record)
 }
 
 
+VOID PDBGetHashTableStatistics(PHASH_TABLE_STATISTICS Statistics)
+{
+	DEBUG_ENTER_FUNCTION("Statistics=0x%p", Statistics);
+
+	HashTableGetStatistics(_pdbTable, Statistics);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
 NTSTATUS PDBEnumerateToQueue(VOID)
 {
 	SIZE_T index = 0;
@@ -349,20 +351,20 @@ NTSTATUS PDBEnumerateToQueue(VOID)
 	DEBUG_ENTER_FUNCTION_NO_ARGS();
 
 	status = STATUS_SUCCESS;
-	KeEnterCriticalRegion();
-	ExAcquireResourceSharedLite(&_pdbLock, TRUE);
+	// The table may change during the enumeration. At most count records are
+	// taken, processes created meanwhile are reported by their own notifications.
 	count = HashTableGetItemCount(_pdbTable);
 	records = (PPROCESSDB_RECORD *)HeapMemoryAllocPaged(count*sizeof(PPROCESSDB_RECORD));
 	if (records != NULL) {
 		requests = (PREQUEST_PROCESS_CREATED *)HeapMemoryAllocNonPaged(count*sizeof(PREQUEST_PROCESS_CREATED));
 		if (requests != NULL) {
-			if (HashTableGetFirst(_pdbTable, &it)) {
+			if (count > 0 && HashTableGetFirst(_pdbTable, &it)) {
 				do {
 					record = CONTAINING_RECORD(HashTableIteratorGetData(&it), PROCESSDB_RECORD, Item);
 					PDBRecordReference(record);
 					records[index] = record;
 					++index;
-				} while (HashTableGetNext(&it));
+				} while (index < count && HashTableGetNext(&it));
 
 				HashTableIteratorFinit(&it);
 			}
@@ -372,8 +374,6 @@ NTSTATUS PDBEnumerateToQueue(VOID)
 			HeapMemoryFree(records);
 	} else status = STATUS_INSUFFICIENT_RESOURCES;
 
-	ExReleaseResourceLite(&_pdbLock);
-	KeLeaveCriticalRegion();
 	if (NT_SUCCESS(status)) {
 		count = index;
 		for (SIZE_T i = 0; i < count; ++i) {
@@ -420,47 +420,41 @@ NTSTATUS ProcessDBModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context)
 	UNREFERENCED_PARAMETER(DriverObject);
 	UNREFERENCED_PARAMETER(Context);
 
-	status = ExInitializeResourceLite(&_pdbLock);
+	status = HashTableCreate(httPassiveLevel, 413, _HashFunction, _CompareFunction, _FreeFunction, &_pdbTable);
 	if (NT_SUCCESS(status)) {
-		status = HashTableCreate(httNoSynchronization, 413, _HashFunction, _CompareFunction, _FreeFunction, &_pdbTable);
+		status = _EnumProcesses(&spi);
 		if (NT_SUCCESS(status)) {
-			status = _EnumProcesses(&spi);
+			tmp = spi;
+			status = _PDBRecordCreateByEnum(tmp, &rec);
 			if (NT_SUCCESS(status)) {
-				tmp = spi;
-				status = _PDBRecordCreateByEnum(tmp, &rec);
-				if (NT_SUCCESS(status)) {
-					PDBRecordReference(rec);
-					HashTableInsert(_pdbTable, &rec->Item, rec->ProcessId);
-					PDBRecordDereference(rec);
-					if (tmp->NextEntryOffset > 0) {
-						do {
-							tmp = (PSYSTEM_PROCESS_INFORMATION)((PUCHAR)tmp + tmp->NextEntryOffset);
-							status = _PDBRecordCreateByEnum(tmp, &rec);
-							if (NT_SUCCESS(status)) {
-								PDBRecordReference(rec);
-								HashTableInsert(_pdbTable, &rec->Item, rec->ProcessId);
-								PDBRecordDereference(rec);
-							}
-						} while (NT_SUCCESS(status) && tmp->NextEntryOffset > 0);
-					}
+				PDBRecordReference(rec);
+				HashTableInsert(_pdbTable, &rec->Item, rec->ProcessId);
+				PDBRecordDereference(rec);
+				if (tmp->NextEntryOffset > 0) {
+					do {
+						tmp = (PSYSTEM_PROCESS_INFORMATION)((PUCHAR)tmp + tmp->NextEntryOffset);
+						status = _PDBRecordCreateByEnum(tmp, &rec);
+						if (NT_SUCCESS(status)) {
+							PDBRecordReference(rec);
+							HashTableInsert(_pdbTable, &rec->Item, rec->ProcessId);
+							PDBRecordDereference(rec);
+						}
+					} while (NT_SUCCESS(status) && tmp->NextEntryOffset > 0);
+				}
 
-					if (NT_SUCCESS(status)) {
-						status = PsSetCreateProcessNotifyRoutineEx(_ProcessNotifyEx, FALSE);
-						if (!NT_SUCCESS(status)) {
+				if (NT_SUCCESS(status)) {
+					status = PsSetCreateProcessNotifyRoutineEx(_ProcessNotifyEx, FALSE);
+					if (!NT_SUCCESS(status)) {
 
-						}
 					}
 				}
-
-				_FreeProcessEnumeration(spi);
 			}
-		
-			if (!NT_SUCCESS(status))
-				HashTableDestroy(_pdbTable);
-		}
 
+			_FreeProcessEnumeration(spi);
+		}
+	
 		if (!NT_SUCCESS(status))
-			ExDeleteResourceLite(&_pdbLock);
+			HashTableDestroy(_pdbTable);
 	}
 
 	DEBUG_EXIT_FUNCTION("0x%x", status);
@@ -477,7 +471,6 @@ VOID ProcessDBModuleFinit(PDRIVER_OBJECT DriverObject, PVOID Context)
 
 	PsSetCreateProcessNotifyRoutineEx(_ProcessNotifyEx, TRUE);
 	HashTableDestroy(_pdbTable);
-	ExDeleteResourceLite(&_pdbLock);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -30,6 +30,7 @@ typedef struct _PROCESSDB_RECORD {
 VOID PDBRecordReference(PPROCESSDB_RECORD Record);
 VOID PDBRecordDereference(PPROCESSDB_RECORD Record);
 NTSTATUS PDBEnumerateToQueue(VOID);
+VOID PDBGetHashTableStatistics(PHASH_TABLE_STATISTICS Statistics);
 
 NTSTATUS ProcessDBModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context);
 VOID ProcessDBModuleFinit(PDRIVER_OBJECT DriverObject, PVOID Context);
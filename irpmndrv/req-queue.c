@@ -3,6 +3,7 @@
 #include "preprocessor.h"
 #include "allocator.h"
 #include "utils.h"
+#include "ioctls.h"
 #include "req-queue.h"
 
 
@@ -18,6 +19,53 @@ static volatile LONG _connected = FALSE;
 static IO_REMOVE_LOCK _removeLock;
 static ERESOURCE _connectLock;
 static volatile LONG _lastRequestId = 0;
+static LIST_ENTRY _detectedListHead;
+static KSPIN_LOCK _detectedListLock;
+static KSEMAPHORE _detectedListSemaphore;
+static volatile LONG _detectedTerminate = FALSE;
+static PETHREAD _detectedWorkerThread = NULL;
+/** Signaled when the worker thread replaces a placeholder in the record queue. */
+static KEVENT _placeholderEvent;
+/** Overlapped IOCTL_IRPMNDRV_GET_RECORD_PENDING requests waiting for records. */
+static IO_CSQ _pendingIrpQueue;
+static LIST_ENTRY _pendingIrpList;
+static KSPIN_LOCK _pendingIrpLock;
+
+/** Number of driver and device detected records remembered for
+    IOCTL_IRPMNDRV_GET_OBJECT_CHANGES. */
+#define OBJECT_CHANGE_LOG_SIZE				512
+
+/** Copies of the recent driver and device detected records. The record of the
+    change with generation G is stored at index G % OBJECT_CHANGE_LOG_SIZE, NULL
+    means the copy could not be allocated. */
+static PREQUEST_HEADER _objectChangeLog[OBJECT_CHANGE_LOG_SIZE];
+/** Generation of the last change, zero if there were no changes. */
+static volatile LONG _objectGeneration = 0;
+static ERESOURCE _objectChangeLock;
+
+/************************************************************************/
+/*                          TYPE DEFINITIONS                            */
+/************************************************************************/
+
+/** Represents a driver or device object seen by a hook handler that has not yet
+    been reported to the user mode. The expensive part of the work (name query
+    and record construction) is done by the detected object worker thread. */
+typedef struct _DETECTED_OBJECT_TOKEN {
+	/** Links the token to the list of pending tokens. */
+	LIST_ENTRY Entry;
+	/** Type of the request to create (ertDriverDetected or ertDeviceDetected). */
+	ERequesttype Type;
+	/** Referenced driver object. */
+	PDRIVER_OBJECT DriverObject;
+	/** Referenced device object, NULL for driver detected tokens. */
+	PDEVICE_OBJECT DeviceObject;
+	/** Placeholder of the record in the record queue, of the erpUndefined type.
+	    Its ID, time, process, thread and IRQL describe the moment the object
+	    was seen and are copied to the record. */
+	REQUEST_HEADER Header;
+	/** The placeholder is in the record queue. */
+	BOOLEAN Queued;
+} DETECTED_OBJECT_TOKEN, *PDETECTED_OBJECT_TOKEN;
 
 /************************************************************************/
 /*                             HELPER FUNCTIONS                         */
@@ -84,6 +132,419 @@ static VOID _RequestQueueClear(VOID)
 }
 
 
+/** Remembers a driver or device detected record as a new object change.
+ *
+ *  @param Header The record. The routine stores its copy.
+ *
+ *  @remark
+ *  The generation advances even if the copy cannot be allocated, so the readers
+ *  of the changes find the gap and resort to a full snapshot.
+ */
+static VOID _ObjectChangeRecord(PREQUEST_HEADER Header)
+{
+	ULONG size = 0;
+	ULONG index = 0;
+	PREQUEST_HEADER copy = NULL;
+	DEBUG_ENTER_FUNCTION("Header=0x%p", Header);
+	DEBUG_IRQL_LESS_OR_EQUAL(PASSIVE_LEVEL);
+
+	size = _GetRequestSize(Header);
+	copy = (PREQUEST_HEADER)HeapMemoryAllocPaged(size);
+	if (copy != NULL) {
+		memcpy(copy, Header, size);
+		InitializeListHead(&copy->Entry);
+	}
+
+	KeEnterCriticalRegion();
+	ExAcquireResourceExclusiveLite(&_objectChangeLock, TRUE);
+	index = (ULONG)(_objectGeneration + 1) % OBJECT_CHANGE_LOG_SIZE;
+	if (_objectChangeLog[index] != NULL)
+		HeapMemoryFree(_objectChangeLog[index]);
+
+	_objectChangeLog[index] = copy;
+	InterlockedIncrement(&_objectGeneration);
+	ExReleaseResourceLite(&_objectChangeLock);
+	KeLeaveCriticalRegion();
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+/************************************************************************/
+/*                     PENDING RECORD REQUESTS                          */
+/************************************************************************/
+
+
+static VOID _PendingIrpInsert(PIO_CSQ Csq, PIRP Irp)
+{
+	UNREFERENCED_PARAMETER(Csq);
+
+	InsertTailList(&_pendingIrpList, &Irp->Tail.Overlay.ListEntry);
+
+	return;
+}
+
+
+static VOID _PendingIrpRemove(PIO_CSQ Csq, PIRP Irp)
+{
+	UNREFERENCED_PARAMETER(Csq);
+
+	RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+
+	return;
+}
+
+
+/** Finds the next pending request, optionally only the one issued for a
+ *  given file object.
+ *
+ *  @param Csq The queue.
+ *  @param Irp The request to continue from, NULL to start from the list head.
+ *  @param PeekContext A FILE_OBJECT the request must have been issued for, or NULL.
+ *
+ *  @return
+ *  Returns the request found, or NULL.
+ */
+static PIRP _PendingIrpPeekNext(PIO_CSQ Csq, PIRP Irp, PVOID PeekContext)
+{
+	PIRP ret = NULL;
+	PLIST_ENTRY entry = NULL;
+	PIO_STACK_LOCATION irpSp = NULL;
+
+	UNREFERENCED_PARAMETER(Csq);
+
+	entry = (Irp != NULL) ? Irp->Tail.Overlay.ListEntry.Flink : _pendingIrpList.Flink;
+	while (entry != &_pendingIrpList) {
+		ret = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+		irpSp = IoGetCurrentIrpStackLocation(ret);
+		if (PeekContext == NULL || irpSp->FileObject == (PFILE_OBJECT)PeekContext)
+			break;
+
+		ret = NULL;
+		entry = entry->Flink;
+	}
+
+	return ret;
+}
+
+
+static VOID _PendingIrpAcquireLock(PIO_CSQ Csq, PKIRQL Irql)
+{
+	UNREFERENCED_PARAMETER(Csq);
+
+	KeAcquireSpinLock(&_pendingIrpLock, Irql);
+
+	return;
+}
+
+
+static VOID _PendingIrpReleaseLock(PIO_CSQ Csq, KIRQL Irql)
+{
+	UNREFERENCED_PARAMETER(Csq);
+
+	KeReleaseSpinLock(&_pendingIrpLock, Irql);
+
+	return;
+}
+
+
+static VOID _PendingIrpCompleteCanceled(PIO_CSQ Csq, PIRP Irp)
+{
+	UNREFERENCED_PARAMETER(Csq);
+
+	Irp->IoStatus.Status = STATUS_CANCELLED;
+	Irp->IoStatus.Information = 0;
+	IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+	return;
+}
+
+
+/** Retrieves the record at the head of the queue, if it can be returned.
+ *
+ *  @return
+ *  Returns the record, or NULL if the queue is empty or starts with a placeholder
+ *  of a detected object. The placeholder holds back the records behind it until
+ *  the worker thread replaces it, so the records stay in order.
+ *
+ *  @remark
+ *  The caller must hold the record queue lock.
+ */
+static PREQUEST_HEADER _RecordQueueHead(VOID)
+{
+	PREQUEST_HEADER ret = NULL;
+
+	if (!IsListEmpty(&_requestListHead)) {
+		ret = CONTAINING_RECORD(_requestListHead.Flink, REQUEST_HEADER, Entry);
+		if (ret->Type == erpUndefined)
+			ret = NULL;
+	}
+
+	return ret;
+}
+
+
+/** Fills a pending request with records waiting in the queue and completes it.
+ *
+ *  @param Irp The request.
+ *  @param Consumed List receiving the records copied to the request. The caller
+ *  frees them after releasing the record queue lock.
+ *  @param Watch Address of a record the caller is interested in. Set to NULL if
+ *  the record is copied to the request. Can be NULL.
+ *
+ *  @remark
+ *  The caller must hold the record queue lock and a record must be available
+ *  (see @link(_RecordQueueHead)). Records are copied until the output buffer is
+ *  full or no more records are available.
+ *  A record is removed from the queue only when it fits into the buffer, so the
+ *  records always leave the queue in order.
+ */
+static VOID _PendingIrpFill(PIRP Irp, PLIST_ENTRY Consumed, PREQUEST_HEADER *Watch)
+{
+	ULONG reqSize = 0;
+	ULONG entrySize = 0;
+	ULONG offset = 0;
+	ULONG returned = 0;
+	ULONG length = 0;
+	PUCHAR buffer = NULL;
+	PREQUEST_HEADER h = NULL;
+	PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY entry = NULL;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	length = IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength;
+	buffer = (PUCHAR)MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+	if (buffer != NULL) {
+		while (offset < length) {
+			h = _RecordQueueHead();
+			if (h == NULL)
+				break;
+
+			reqSize = _GetRequestSize(h);
+			entrySize = sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + reqSize;
+			if (offset + entrySize > length) {
+				if (offset == 0) {
+					status = STATUS_BUFFER_TOO_SMALL;
+					returned = entrySize;
+				}
+
+				break;
+			}
+
+			RemoveHeadList(&_requestListHead);
+			InsertTailList(Consumed, &h->Entry);
+			InterlockedDecrement(&_requestCount);
+			if (Watch != NULL && *Watch == h)
+				*Watch = NULL;
+
+			entry = (PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY)(buffer + offset);
+			entry->Size = reqSize;
+			entry->Reserved = 0;
+			memcpy(entry + 1, h, reqSize);
+			returned = offset + entrySize;
+			offset = (ULONG)((returned + IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1) & ~(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1));
+		}
+	} else status = STATUS_INSUFFICIENT_RESOURCES;
+
+	Irp->IoStatus.Status = status;
+	Irp->IoStatus.Information = returned;
+	IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+	return;
+}
+
+
+/** Completes pending record requests while there are records to return.
+ *
+ *  @param Consumed List receiving the records copied to the requests.
+ *  @param Watch Passed to @link(_PendingIrpFill).
+ *
+ *  @remark
+ *  The caller must hold the record queue lock. The requests are filled and
+ *  completed one by one under the lock, so each of them carries records newer
+ *  than the requests completed before. Both the routine inserting records and
+ *  the one pending requests call this routine after their insertion, so a record
+ *  and a request cannot miss each other.
+ */
+static VOID _PendingIrpsDispatch(PLIST_ENTRY Consumed, PREQUEST_HEADER *Watch)
+{
+	PIRP irp = NULL;
+
+	while (_RecordQueueHead() != NULL) {
+		irp = IoCsqRemoveNextIrp(&_pendingIrpQueue, NULL);
+		if (irp == NULL)
+			break;
+
+		_PendingIrpFill(irp, Consumed, Watch);
+	}
+
+	return;
+}
+
+
+static VOID _RecordsFree(PLIST_ENTRY ListHead)
+{
+	while (!IsListEmpty(ListHead))
+		HeapMemoryFree(CONTAINING_RECORD(RemoveHeadList(ListHead), REQUEST_HEADER, Entry));
+
+	return;
+}
+
+
+/** Completes all pending record requests, optionally only those issued for
+ *  a given file object.
+ *
+ *  @param FileObject The file object, NULL means all requests.
+ *  @param Status Completion status of the requests.
+ */
+static VOID _PendingIrpsFlush(PFILE_OBJECT FileObject, NTSTATUS Status)
+{
+	PIRP irp = NULL;
+
+	do {
+		irp = IoCsqRemoveNextIrp(&_pendingIrpQueue, FileObject);
+		if (irp != NULL) {
+			irp->IoStatus.Status = Status;
+			irp->IoStatus.Information = 0;
+			IoCompleteRequest(irp, IO_NO_INCREMENT);
+		}
+	} while (irp != NULL);
+
+	return;
+}
+
+
+/************************************************************************/
+/*                        DETECTED OBJECTS                              */
+/************************************************************************/
+
+
+/** Inserts placeholder of a detected object record to the record queue.
+ *
+ *  @param Header The placeholder.
+ *
+ *  @return
+ *  Returns TRUE if the placeholder has been inserted, FALSE if no process is
+ *  connected to the queue.
+ */
+static BOOLEAN _PlaceholderInsert(PREQUEST_HEADER Header)
+{
+	KIRQL irql;
+	BOOLEAN ret = FALSE;
+
+	if (_connected && NT_SUCCESS(IoAcquireRemoveLock(&_removeLock, NULL))) {
+		KeAcquireSpinLock(&_requestListLock, &irql);
+		InsertTailList(&_requestListHead, &Header->Entry);
+		KeReleaseSpinLock(&_requestListLock, irql);
+		IoReleaseRemoveLock(&_removeLock, NULL);
+		ret = TRUE;
+	}
+
+	return ret;
+}
+
+
+/** Replaces placeholder of a token with the record created for it.
+ *
+ *  @param Token The token, its placeholder must be in the record queue.
+ *  @param Record The record, takes the position of the placeholder. NULL just
+ *  removes the placeholder.
+ *
+ *  @remark
+ *  The records held back by the placeholder become available to pending
+ *  requests and to IOCTL_IRPMNDRV_GET_RECORD.
+ */
+static VOID _PlaceholderResolve(PDETECTED_OBJECT_TOKEN Token, PREQUEST_HEADER Record)
+{
+	KIRQL irql;
+	LIST_ENTRY consumed;
+	BOOLEAN connected = FALSE;
+	PREQUEST_HEADER watch = Record;
+
+	InitializeListHead(&consumed);
+	connected = NT_SUCCESS(IoAcquireRemoveLock(&_removeLock, NULL));
+	KeAcquireSpinLock(&_requestListLock, &irql);
+	if (Record != NULL) {
+		InsertHeadList(&Token->Header.Entry, &Record->Entry);
+		InterlockedIncrement(&_requestCount);
+	}
+
+	RemoveEntryList(&Token->Header.Entry);
+	Token->Queued = FALSE;
+	if (connected) {
+		_PendingIrpsDispatch(&consumed, &watch);
+		if (watch != NULL && _requestListSemaphore != NULL)
+			KeReleaseSemaphore(_requestListSemaphore, IO_NO_INCREMENT, 1, FALSE);
+	}
+
+	KeReleaseSpinLock(&_requestListLock, irql);
+	if (connected)
+		IoReleaseRemoveLock(&_removeLock, NULL);
+
+	_RecordsFree(&consumed);
+	KeSetEvent(&_placeholderEvent, IO_NO_INCREMENT, FALSE);
+
+	return;
+}
+
+
+static VOID _DetectedObjectTokenFree(PDETECTED_OBJECT_TOKEN Token)
+{
+	if (Token->Queued)
+		_PlaceholderResolve(Token, NULL);
+
+	if (Token->DeviceObject != NULL)
+		ObDereferenceObject(Token->DeviceObject);
+
+	ObDereferenceObject(Token->DriverObject);
+	HeapMemoryFree(Token);
+
+	return;
+}
+
+
+static VOID _DetectedObjectTokenProcess(PDETECTED_OBJECT_TOKEN Token)
+{
+	PREQUEST_HEADER rq = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("Token=0x%p", Token);
+
+	status = RequestXXXDetectedCreate(Token->Type, Token->DriverObject, Token->DeviceObject, &Token->Header, &rq);
+	if (NT_SUCCESS(status))
+		_ObjectChangeRecord(rq);
+	else rq = NULL;
+
+	if (Token->Queued)
+		_PlaceholderResolve(Token, rq);
+	else if (rq != NULL)
+		RequestQueueInsert(rq);
+
+	_DetectedObjectTokenFree(Token);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+static VOID _DetectedObjectWorker(PVOID Context)
+{
+	PLIST_ENTRY l = NULL;
+	DEBUG_ENTER_FUNCTION("Context=0x%p", Context);
+
+	UNREFERENCED_PARAMETER(Context);
+
+	do {
+		KeWaitForSingleObject(&_detectedListSemaphore, Executive, KernelMode, FALSE, NULL);
+		l = ExInterlockedRemoveHeadList(&_detectedListHead, &_detectedListLock);
+		if (l != NULL)
+			_DetectedObjectTokenProcess(CONTAINING_RECORD(l, DETECTED_OBJECT_TOKEN, Entry));
+	} while (!_detectedTerminate || l != NULL);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+
 /************************************************************************/
 /*                            PUBLIC ROUTINES                           */
 /************************************************************************/
@@ -132,6 +593,7 @@ VOID RequestQueueDisconnect(VOID)
 	ExAcquireResourceExclusiveLite(&_connectLock, TRUE);
 	if (_connected) {		
 		IoReleaseRemoveLockAndWait(&_removeLock, NULL);
+		_PendingIrpsFlush(NULL, STATUS_CONNECTION_DISCONNECTED);
 		if (_requestListSemaphore != NULL) {
 			ObDereferenceObject(_requestListSemaphore);
 			_requestListSemaphore = NULL;
@@ -148,8 +610,21 @@ VOID RequestQueueDisconnect(VOID)
 }
 
 
+/** Inserts a record to the queue.
+ *
+ *  @param Header The record. The queue takes ownership of it.
+ *
+ *  @remark
+ *  If requests are pending, they take the record right away. The semaphore
+ *  is released only for a record that stays in the queue, so its count matches
+ *  the number of records IOCTL_IRPMNDRV_GET_RECORD can return, as long as the
+ *  process does not also pend IOCTL_IRPMNDRV_GET_RECORD_PENDING requests.
+ */
 VOID RequestQueueInsert(PREQUEST_HEADER Header)
 {
+	KIRQL irql;
+	LIST_ENTRY consumed;
+	PREQUEST_HEADER watch = Header;
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
 	DEBUG_ENTER_FUNCTION("Header=0x%p", Header);
 	DEBUG_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
@@ -157,11 +632,16 @@ VOID RequestQueueInsert(PREQUEST_HEADER Header)
 	if (_connected) {
 		status = IoAcquireRemoveLock(&_removeLock, NULL);
 		if (NT_SUCCESS(status)) {
-			ExInterlockedInsertTailList(&_requestListHead, &Header->Entry, &_requestListLock);
+			InitializeListHead(&consumed);
+			KeAcquireSpinLock(&_requestListLock, &irql);
+			InsertTailList(&_requestListHead, &Header->Entry);
 			InterlockedIncrement(&_requestCount);
-			if (_requestListSemaphore != NULL)
+			_PendingIrpsDispatch(&consumed, &watch);
+			if (watch != NULL && _requestListSemaphore != NULL)
 				KeReleaseSemaphore(_requestListSemaphore, IO_NO_INCREMENT, 1, FALSE);
-			
+
+			KeReleaseSpinLock(&_requestListLock, irql);
+			_RecordsFree(&consumed);
 			IoReleaseRemoveLock(&_removeLock, NULL);
 		}
 	} else status = STATUS_CONNECTION_DISCONNECTED;
@@ -192,7 +672,18 @@ VOID RequestHeaderInit(PREQUEST_HEADER Header, PDRIVER_OBJECT DriverObject, PDEV
 }
 
 
-NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject, PREQUEST_HEADER *Header)
+/** Creates a driver or device detected request.
+ *
+ *  @param Type Type of the request, ertDriverDetected or ertDeviceDetected.
+ *  @param DriverObject The driver object the request is about.
+ *  @param DeviceObject The device object the request is about.
+ *  @param Template Optional header already initialized by RequestHeaderInit.
+ *  Its ID, time, process, thread and IRQL are copied to the new request, so
+ *  no new ID is allocated. If NULL, the header of the request is initialized
+ *  by RequestHeaderInit.
+ *  @param Header Receives the new request.
+ */
+NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject, const REQUEST_HEADER *Template, PREQUEST_HEADER *Header)
 {
 	SIZE_T requestSize = 0;
 	PREQUEST_HEADER tmpHeader = NULL;
@@ -200,7 +691,7 @@ NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject
 	PREQUEST_DEVICE_DETECTED der = NULL;
 	UNICODE_STRING uObjectName;
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
-	DEBUG_ENTER_FUNCTION("Type=%u; DriverObject=0x%p; DeviceObject=0x%p; Header=0x%p", DriverObject, DeviceObject, Type, Header);
+	DEBUG_ENTER_FUNCTION("Type=%u; DriverObject=0x%p; DeviceObject=0x%p; Template=0x%p; Header=0x%p", Type, DriverObject, DeviceObject, Template, Header);
 
 	status = (Type == ertDeviceDetected) ?
 		_GetObjectName(DeviceObject, &uObjectName) :
@@ -232,7 +723,14 @@ NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject
 		}
 
 		if (NT_SUCCESS(status)) {
-			RequestHeaderInit(tmpHeader, DriverObject, DeviceObject, Type);
+			if (Template != NULL) {
+				*tmpHeader = *Template;
+				InitializeListHead(&tmpHeader->Entry);
+				tmpHeader->Driver = DriverObject;
+				tmpHeader->Device = DeviceObject;
+				tmpHeader->Type = Type;
+			} else RequestHeaderInit(tmpHeader, DriverObject, DeviceObject, Type);
+
 			*Header = tmpHeader;
 		}
 
@@ -244,6 +742,51 @@ NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject
 }
 
 
+/** Schedules creation of a driver or device detected request.
+ *
+ *  @param Type Type of the request, ertDriverDetected or ertDeviceDetected.
+ *  @param DriverObject The driver object the request is about.
+ *  @param DeviceObject The device object the request is about. Ignored for
+ *  ertDriverDetected requests.
+ *
+ *  @remark
+ *  The routine only records the objects and returns immediately, the name
+ *  lookup and the request construction are done by a system worker thread.
+ *  The objects are recorded even when no process is connected to the queue,
+ *  since they also feed the object change log.
+ *
+ *  A placeholder takes the place of the request in the record queue right
+ *  away, so the request reaches the user mode before records inserted after
+ *  the call, such as IRPs sent to the detected device. ID, time, process and
+ *  thread information of the resulting request reflect the moment of the call.
+ *  The routine can be called at IRQL <= DISPATCH_LEVEL.
+ */
+VOID RequestXXXDetectedQueue(ERequesttype Type, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject)
+{
+	PDETECTED_OBJECT_TOKEN token = NULL;
+	DEBUG_ENTER_FUNCTION("Type=%u; DriverObject=0x%p; DeviceObject=0x%p", Type, DriverObject, DeviceObject);
+	DEBUG_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+
+	token = (PDETECTED_OBJECT_TOKEN)HeapMemoryAllocNonPaged(sizeof(DETECTED_OBJECT_TOKEN));
+	if (token != NULL) {
+		token->Type = Type;
+		token->DriverObject = DriverObject;
+		token->DeviceObject = (Type == ertDeviceDetected) ? DeviceObject : NULL;
+		RequestHeaderInit(&token->Header, token->DriverObject, token->DeviceObject, erpUndefined);
+		ObReferenceObject(token->DriverObject);
+		if (token->DeviceObject != NULL)
+			ObReferenceObject(token->DeviceObject);
+
+		token->Queued = _PlaceholderInsert(&token->Header);
+		ExInterlockedInsertTailList(&_detectedListHead, &token->Entry, &_detectedListLock);
+		KeReleaseSemaphore(&_detectedListSemaphore, IO_NO_INCREMENT, 1, FALSE);
+	}
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
 NTSTATUS RequestProcessCreatedCreated(HANDLE ProcessId, HANDLE ParentId, HANDLE CreatorId, PCUNICODE_STRING ImageName, PCUNICODE_STRING CommandLine, PREQUEST_PROCESS_CREATED *Request)
 {
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
@@ -295,6 +838,7 @@ NTSTATUS RequestProcessExittedCreate(HANDLE ProcessId, PREQUEST_PROCESS_EXITTED
 
 NTSTATUS RequestQueueGet(PREQUEST_HEADER Buffer, PULONG Length)
 {
+	KIRQL irql;
 	ULONG reqSize = 0;
 	PREQUEST_HEADER h = NULL;
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
@@ -304,22 +848,32 @@ NTSTATUS RequestQueueGet(PREQUEST_HEADER Buffer, PULONG Length)
 	if (_connected) {
 		status = IoAcquireRemoveLock(&_removeLock, NULL);
 		if (NT_SUCCESS(status)) {
-			PLIST_ENTRY l = NULL;
-			
-			l = ExInterlockedRemoveHeadList(&_requestListHead, &_requestListLock);
-			if (l != NULL) {
-				h = CONTAINING_RECORD(l, REQUEST_HEADER, Entry);
-				reqSize = _GetRequestSize(h);
-				if (reqSize <= *Length) {
-					InterlockedDecrement(&_requestCount);
-					memcpy(Buffer, h, reqSize);
-					HeapMemoryFree(h);
-					status = STATUS_SUCCESS;
-				} else {
-					ExInterlockedInsertHeadList(&_requestListHead, l, &_requestListLock);
-					status = STATUS_BUFFER_TOO_SMALL;
-				}
-			} else status = STATUS_NO_MORE_ENTRIES;
+			do {
+				KeClearEvent(&_placeholderEvent);
+				KeAcquireSpinLock(&_requestListLock, &irql);
+				h = _RecordQueueHead();
+				if (h != NULL) {
+					reqSize = _GetRequestSize(h);
+					if (reqSize <= *Length) {
+						RemoveHeadList(&_requestListHead);
+						InterlockedDecrement(&_requestCount);
+						status = STATUS_SUCCESS;
+					} else status = STATUS_BUFFER_TOO_SMALL;
+				} else if (!IsListEmpty(&_requestListHead))
+					status = STATUS_PENDING;
+				else status = STATUS_NO_MORE_ENTRIES;
+
+				KeReleaseSpinLock(&_requestListLock, irql);
+				// The semaphore counts the records behind the placeholder,
+				// wait until the worker thread replaces it
+				if (status == STATUS_PENDING)
+					KeWaitForSingleObject(&_placeholderEvent, Executive, KernelMode, FALSE, NULL);
+			} while (status == STATUS_PENDING);
+
+			if (status == STATUS_SUCCESS) {
+				memcpy(Buffer, h, reqSize);
+				HeapMemoryFree(h);
+			}
 
 			*Length = reqSize;
 			IoReleaseRemoveLock(&_removeLock, NULL);
@@ -330,6 +884,160 @@ NTSTATUS RequestQueueGet(PREQUEST_HEADER Buffer, PULONG Length)
 	return status;
 }
 
+
+/** Handles an IOCTL_IRPMNDRV_GET_RECORD_PENDING request.
+ *
+ *  @param Irp The request. Its output buffer is described by Irp->MdlAddress.
+ *
+ *  @return
+ *  Returns STATUS_PENDING if the request has been queued. Otherwise, the request
+ *  is completed by the routine and its completion status is returned.
+ *
+ *  @remark
+ *  The request is completed when records become available, possibly in context
+ *  of an arbitrary thread. Pending requests are completed with STATUS_CANCELLED
+ *  when cancelled or when their handle is closed, and with
+ *  STATUS_CONNECTION_DISCONNECTED when the queue gets disconnected.
+ */
+NTSTATUS RequestQueuePend(PIRP Irp)
+{
+	KIRQL irql;
+	ULONG length = 0;
+	LIST_ENTRY consumed;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("Irp=0x%p", Irp);
+	DEBUG_IRQL_LESS_OR_EQUAL(APC_LEVEL);
+
+	length = IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength;
+	if (Irp->MdlAddress != NULL && length >= sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_HEADER)) {
+		if (_connected) {
+			status = IoAcquireRemoveLock(&_removeLock, NULL);
+			if (NT_SUCCESS(status)) {
+				// The queue marks the request pending.
+				IoCsqInsertIrp(&_pendingIrpQueue, Irp, NULL);
+				status = STATUS_PENDING;
+				InitializeListHead(&consumed);
+				KeAcquireSpinLock(&_requestListLock, &irql);
+				_PendingIrpsDispatch(&consumed, NULL);
+				KeReleaseSpinLock(&_requestListLock, irql);
+				_RecordsFree(&consumed);
+				IoReleaseRemoveLock(&_removeLock, NULL);
+			}
+		} else status = STATUS_CONNECTION_DISCONNECTED;
+	} else status = STATUS_BUFFER_TOO_SMALL;
+
+	if (status != STATUS_PENDING) {
+		Irp->IoStatus.Status = status;
+		Irp->IoStatus.Information = 0;
+		IoCompleteRequest(Irp, IO_NO_INCREMENT);
+	}
+
+	DEBUG_EXIT_FUNCTION("0x%x", status);
+	return status;
+}
+
+
+/** Completes all pending IOCTL_IRPMNDRV_GET_RECORD_PENDING requests issued for
+ *  a given file object. Called when the last handle to the file object is closed.
+ *
+ *  @param FileObject The file object.
+ */
+VOID RequestQueueCancelPending(PFILE_OBJECT FileObject)
+{
+	DEBUG_ENTER_FUNCTION("FileObject=0x%p", FileObject);
+
+	_PendingIrpsFlush(FileObject, STATUS_CANCELLED);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+/** Retrieves generation of the last driver or device object change.
+ *
+ *  @return
+ *  Returns the generation. Zero means no changes have been recorded yet.
+ */
+ULONG RequestQueueObjectGeneration(VOID)
+{
+	return (ULONG)_objectGeneration;
+}
+
+
+/** Collects driver and device detected records of changes newer than a given
+ *  generation.
+ *
+ *  @param Generation The generation.
+ *  @param Changes Receives address of a paged memory block holding the
+ *  IOCTL_IRPMNDRV_GET_OBJECT_CHANGES output. The caller frees it by HeapMemoryFree.
+ *  @param Length Receives size of the block, in bytes.
+ *
+ *  @return
+ *  Returns STATUS_SUCCESS, STATUS_NOT_FOUND if some of the changes are no longer
+ *  remembered, or STATUS_INSUFFICIENT_RESOURCES.
+ */
+NTSTATUS RequestQueueObjectChangesGet(ULONG Generation, PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT *Changes, PULONG Length)
+{
+	ULONG g = 0;
+	ULONG offset = 0;
+	ULONG current = 0;
+	ULONG requiredLength = 0;
+	PREQUEST_HEADER h = NULL;
+	PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY entry = NULL;
+	PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT tmpChanges = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("Generation=%u; Changes=0x%p; Length=0x%p", Generation, Changes, Length);
+	DEBUG_IRQL_LESS_OR_EQUAL(PASSIVE_LEVEL);
+
+	*Changes = NULL;
+	*Length = 0;
+	KeEnterCriticalRegion();
+	ExAcquireResourceSharedLite(&_objectChangeLock, TRUE);
+	current = (ULONG)_objectGeneration;
+	status = (Generation <= current && current - Generation <= OBJECT_CHANGE_LOG_SIZE) ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+	if (NT_SUCCESS(status)) {
+		requiredLength = sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT);
+		for (g = Generation + 1; g <= current; ++g) {
+			h = _objectChangeLog[g % OBJECT_CHANGE_LOG_SIZE];
+			if (h == NULL) {
+				status = STATUS_NOT_FOUND;
+				break;
+			}
+
+			requiredLength = (ULONG)((requiredLength + IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1) & ~(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1));
+			requiredLength += sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + _GetRequestSize(h);
+		}
+
+		if (NT_SUCCESS(status)) {
+			tmpChanges = (PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT)HeapMemoryAllocPaged(requiredLength);
+			if (tmpChanges != NULL) {
+				tmpChanges->RequiredLength = requiredLength;
+				tmpChanges->Generation = current;
+				tmpChanges->Count = current - Generation;
+				tmpChanges->Reserved = 0;
+				offset = sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT);
+				for (g = Generation + 1; g <= current; ++g) {
+					h = _objectChangeLog[g % OBJECT_CHANGE_LOG_SIZE];
+					offset = (ULONG)((offset + IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1) & ~(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1));
+					entry = (PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY)((PUCHAR)tmpChanges + offset);
+					entry->Size = _GetRequestSize(h);
+					entry->Reserved = 0;
+					memcpy(entry + 1, h, entry->Size);
+					offset += sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + entry->Size;
+				}
+
+				*Changes = tmpChanges;
+				*Length = requiredLength;
+			} else status = STATUS_INSUFFICIENT_RESOURCES;
+		}
+	}
+
+	ExReleaseResourceLite(&_objectChangeLock);
+	KeLeaveCriticalRegion();
+
+	DEBUG_EXIT_FUNCTION("0x%x, *Changes=0x%p, *Length=%u", status, *Changes, *Length);
+	return status;
+}
+
 /************************************************************************/
 /*                     INITIALIZATION AND FINALIZATION                  */
 /************************************************************************/
@@ -345,7 +1053,41 @@ NTSTATUS RequestQueueModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context)
 	InitializeListHead(&_requestListHead);
 	KeInitializeSpinLock(&_requestListLock);
 	IoInitializeRemoveLock(&_removeLock, 0, 0, 0x7fffffff);
+	InitializeListHead(&_detectedListHead);
+	KeInitializeSpinLock(&_detectedListLock);
+	KeInitializeSemaphore(&_detectedListSemaphore, 0, MAXLONG);
+	KeInitializeEvent(&_placeholderEvent, NotificationEvent, FALSE);
+	_detectedTerminate = FALSE;
+	InitializeListHead(&_pendingIrpList);
+	KeInitializeSpinLock(&_pendingIrpLock);
+	IoCsqInitialize(&_pendingIrpQueue, _PendingIrpInsert, _PendingIrpRemove, _PendingIrpPeekNext, _PendingIrpAcquireLock, _PendingIrpReleaseLock, _PendingIrpCompleteCanceled);
+	_objectGeneration = 0;
+	memset(_objectChangeLog, 0, sizeof(_objectChangeLog));
 	status = ExInitializeResourceLite(&_connectLock);
+	if (NT_SUCCESS(status)) {
+		status = ExInitializeResourceLite(&_objectChangeLock);
+		if (NT_SUCCESS(status)) {
+			HANDLE hThread = NULL;
+
+			status = PsCreateSystemThread(&hThread, THREAD_ALL_ACCESS, NULL, NULL, NULL, _DetectedObjectWorker, NULL);
+			if (NT_SUCCESS(status)) {
+				status = ObReferenceObjectByHandle(hThread, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, (PVOID *)&_detectedWorkerThread, NULL);
+				if (!NT_SUCCESS(status)) {
+					InterlockedExchange(&_detectedTerminate, TRUE);
+					KeReleaseSemaphore(&_detectedListSemaphore, IO_NO_INCREMENT, 1, FALSE);
+					ZwWaitForSingleObject(hThread, FALSE, NULL);
+				}
+
+				ZwClose(hThread);
+			}
+
+			if (!NT_SUCCESS(status))
+				ExDeleteResourceLite(&_objectChangeLock);
+		}
+
+		if (!NT_SUCCESS(status))
+			ExDeleteResourceLite(&_connectLock);
+	}
 
 	DEBUG_EXIT_FUNCTION("0x%x", status);
 	return status;
@@ -353,12 +1095,29 @@ NTSTATUS RequestQueueModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context)
 
 VOID RequestQueueModuleFinit(PDRIVER_OBJECT DriverObject, PVOID Context)
 {
+	ULONG i = 0;
 	DEBUG_ENTER_FUNCTION("DriverObject=0x%p; Context=0x%p", DriverObject, Context);
 
 	UNREFERENCED_PARAMETER(DriverObject);
 	UNREFERENCED_PARAMETER(Context);
 
+	InterlockedExchange(&_detectedTerminate, TRUE);
+	KeReleaseSemaphore(&_detectedListSemaphore, IO_NO_INCREMENT, 1, FALSE);
+	KeWaitForSingleObject(_detectedWorkerThread, Executive, KernelMode, FALSE, NULL);
+	ObDereferenceObject(_detectedWorkerThread);
+	_detectedWorkerThread = NULL;
+	while (!IsListEmpty(&_detectedListHead))
+		_DetectedObjectTokenFree(CONTAINING_RECORD(RemoveHeadList(&_detectedListHead), DETECTED_OBJECT_TOKEN, Entry));
+
 	_RequestQueueClear();
+	for (i = 0; i < OBJECT_CHANGE_LOG_SIZE; ++i) {
+		if (_objectChangeLog[i] != NULL) {
+			HeapMemoryFree(_objectChangeLog[i]);
+			_objectChangeLog[i] = NULL;
+		}
+	}
+
+	ExDeleteResourceLite(&_objectChangeLock);
 	ExDeleteResourceLite(&_connectLock);
 
 	DEBUG_EXIT_FUNCTION_VOID();
@@ -4,14 +4,20 @@
 
 #include <ntifs.h>
 #include "kernel-shared.h"
+#include "ioctls.h"
 
 
 VOID RequestHeaderInit(PREQUEST_HEADER Header, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject, ERequesttype RequestType);
-NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject, PREQUEST_HEADER *Header);
+NTSTATUS RequestXXXDetectedCreate(ERequesttype Type, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject, const REQUEST_HEADER *Template, PREQUEST_HEADER *Header);
+VOID RequestXXXDetectedQueue(ERequesttype Type, PDRIVER_OBJECT DriverObject, PDEVICE_OBJECT DeviceObject);
 NTSTATUS RequestProcessCreatedCreated(HANDLE ProcessId, HANDLE ParentId, HANDLE CreatorId, PCUNICODE_STRING ImageName, PCUNICODE_STRING CommandLine, PREQUEST_PROCESS_CREATED *Request);
 NTSTATUS RequestProcessExittedCreate(HANDLE ProcessId, PREQUEST_PROCESS_EXITTED *Request);
 NTSTATUS RequestQueueGet(PREQUEST_HEADER Buffer, PULONG Length);
 VOID RequestQueueInsert(PREQUEST_HEADER Header);
+NTSTATUS RequestQueuePend(PIRP Irp);
+VOID RequestQueueCancelPending(PFILE_OBJECT FileObject);
+ULONG RequestQueueObjectGeneration(VOID);
+NTSTATUS RequestQueueObjectChangesGet(ULONG Generation, PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT *Changes, PULONG Length);
 
 NTSTATUS RequestQueueConnect(HANDLE hSemaphore);
 VOID RequestQueueDisconnect(VOID);
@@ -10,6 +10,7 @@
 #include "hook.h"
 #include "req-queue.h"
 #include "pnp-driver-watch.h"
+#include "process-db.h"
 #include "um-services.h"
 
 
@@ -98,6 +99,81 @@ static VOID NTAPI _DeviceHandleDeleted(PCHANDLE_TABLE HandleTable, PVOID Object,
 }
 
 
+static NTSTATUS _HookDevice(PUNICODE_STRING DeviceName, PVOID DeviceAddress, PUCHAR IRPSettings, PUCHAR FastIoSettings, PHANDLE DeviceHandle, PVOID *ObjectId)
+{
+	PDEVICE_OBJECT targetDevice = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("DeviceName=\"%wZ\"; DeviceAddress=0x%p; IRPSettings=0x%p; FastIoSettings=0x%p; DeviceHandle=0x%p; ObjectId=0x%p", DeviceName, DeviceAddress, IRPSettings, FastIoSettings, DeviceHandle, ObjectId);
+
+	status = (DeviceName != NULL) ?
+		_GetDeviceAddress(DeviceName, TRUE, TRUE, &targetDevice) :
+		VerifyDeviceByAddress(DeviceAddress, TRUE, TRUE, &targetDevice);
+
+	if (NT_SUCCESS(status)) {
+		PDRIVER_HOOK_RECORD driverRecord = DriverHookRecordGet(targetDevice->DriverObject);
+
+		if (driverRecord != NULL) {
+			PDEVICE_HOOK_RECORD deviceRecord = NULL;
+
+			status = DriverHookRecordAddDevice(driverRecord, targetDevice, IRPSettings, FastIoSettings, TRUE, &deviceRecord);
+			if (NT_SUCCESS(status)) {
+				status = HandleTableHandleCreate(_deviceHandleTable, deviceRecord, DeviceHandle);
+				if (NT_SUCCESS(status))
+					*ObjectId = deviceRecord;
+
+				if (!NT_SUCCESS(status))
+					DriverHookRecordDeleteDevice(deviceRecord);
+
+				DeviceHookRecordDereference(deviceRecord);
+			}
+
+			DriverHookRecordDereference(driverRecord);
+		} else status = STATUS_NOT_FOUND;
+
+		ObDereferenceObject(targetDevice);
+	}
+
+	DEBUG_EXIT_FUNCTION("0x%x", status);
+	return status;
+}
+
+
+static NTSTATUS _UnhookDevice(HANDLE DeviceHandle)
+{
+	PDEVICE_HOOK_RECORD deviceRecord = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("DeviceHandle=0x%p", DeviceHandle);
+
+	status = HandleTablehandleTranslate(_deviceHandleTable, DeviceHandle, &deviceRecord);
+	if (NT_SUCCESS(status)) {
+		status = DriverHookRecordDeleteDevice(deviceRecord);
+		DeviceHookRecordDereference(deviceRecord);
+		if (NT_SUCCESS(status))
+			HandleTableHandleClose(_deviceHandleTable, DeviceHandle);
+	}
+
+	DEBUG_EXIT_FUNCTION("0x%x", status);
+	return status;
+}
+
+
+static NTSTATUS _GetBatchString(PUCHAR Buffer, ULONG BufferLength, ULONG Offset, ULONG Length, PUNICODE_STRING String)
+{
+	NTSTATUS status = STATUS_INVALID_PARAMETER;
+
+	if (Length > 0 && Length <= MAXUSHORT - sizeof(WCHAR) && (Length % sizeof(WCHAR)) == 0 &&
+		Offset < BufferLength && BufferLength - Offset >= Length + sizeof(WCHAR) &&
+		*(PWCHAR)(Buffer + Offset + Length) == L'\0') {
+		String->Length = (USHORT)Length;
+		String->MaximumLength = String->Length + sizeof(WCHAR);
+		String->Buffer = (PWCHAR)(Buffer + Offset);
+		status = STATUS_SUCCESS;
+	}
+
+	return status;
+}
+
+
 /************************************************************************/
 /*                    PUBLIC FUNCTIONS                                  */
 /************************************************************************/
@@ -281,48 +357,23 @@ NTSTATUS UMHookAddDevice(PIOCTL_IRPMNDRV_HOOK_ADD_DEVICE_INPUT InputBUffer, ULON
 		}
 
 		if (NT_SUCCESS(status)) {
-			PDEVICE_OBJECT targetDevice = NULL;
-
-			if (input.HookByName) {
-				UNICODE_STRING uDeviceName;
+			UNICODE_STRING uDeviceName;
 
+			if (input.HookByName)
 				RtlInitUnicodeString(&uDeviceName, deviceName);
-				status = _GetDeviceAddress(&uDeviceName, TRUE, TRUE, &targetDevice);
-			} else status = VerifyDeviceByAddress(input.DeviceAddress, TRUE, TRUE, &targetDevice);
 
+			status = _HookDevice((input.HookByName) ? &uDeviceName : NULL, input.DeviceAddress, input.IRPSettings, input.FastIoSettings, &output.DeviceHandle, &output.ObjectId);
 			if (NT_SUCCESS(status)) {
-				PDRIVER_HOOK_RECORD driverRecord = DriverHookRecordGet(targetDevice->DriverObject);
-
-				if (driverRecord != NULL) {
-					PDEVICE_HOOK_RECORD deviceRecord = NULL;
-
-					status = DriverHookRecordAddDevice(driverRecord, targetDevice, input.IRPSettings, input.FastIoSettings, TRUE, &deviceRecord);
-					if (NT_SUCCESS(status)) {
-						status = HandleTableHandleCreate(_deviceHandleTable, deviceRecord, &output.DeviceHandle);
-						if (NT_SUCCESS(status)) {
-							output.ObjectId = deviceRecord;
-							if (ExGetPreviousMode() == UserMode) {
-								__try {
-									*OutputBuffer = output;
-								} __except (EXCEPTION_EXECUTE_HANDLER) {
-									status = GetExceptionCode();
-								}
-							} else *OutputBuffer = output;
-						
-							if (!NT_SUCCESS(status))
-								HandleTableHandleClose(_deviceHandleTable, output.DeviceHandle);
-						}
-
-						if (!NT_SUCCESS(status))
-							DriverHookRecordDeleteDevice(deviceRecord);
-
-						DeviceHookRecordDereference(deviceRecord);
+				if (ExGetPreviousMode() == UserMode) {
+					__try {
+						*OutputBuffer = output;
+					} __except (EXCEPTION_EXECUTE_HANDLER) {
+						status = GetExceptionCode();
 					}
+				} else *OutputBuffer = output;
 
-					DriverHookRecordDereference(driverRecord);
-				} else status = STATUS_NOT_FOUND;
-
-				ObDereferenceObject(targetDevice);
+				if (!NT_SUCCESS(status))
+					_UnhookDevice(output.DeviceHandle);
 			}
 
 			if (ExGetPreviousMode() == UserMode) {
@@ -362,17 +413,8 @@ NTSTATUS UMHookDeleteDevice(PIOCTL_IRPMNDRV_HOOK_REMOVE_DEVICE_INPUT InputBuffer
 			status = STATUS_SUCCESS;
 		}
 
-		if (NT_SUCCESS(status)) {
-			PDEVICE_HOOK_RECORD deviceRecord = NULL;
-
-			status = HandleTablehandleTranslate(_deviceHandleTable, input.DeviceHandle, &deviceRecord);
-			if (NT_SUCCESS(status)) {
-				status = DriverHookRecordDeleteDevice(deviceRecord);
-				DeviceHookRecordDereference(deviceRecord);
-				if (NT_SUCCESS(status))
-					HandleTableHandleClose(_deviceHandleTable, input.DeviceHandle);
-			}
-		}
+		if (NT_SUCCESS(status))
+			status = _UnhookDevice(input.DeviceHandle);
 	} else status = STATUS_INFO_LENGTH_MISMATCH;
 
 	DEBUG_EXIT_FUNCTION("0x%x", status);
@@ -424,10 +466,14 @@ NTSTATUS UMEnumDriversDevices(PVOID OutputBuffer, ULONG OutputBufferLength, PULO
 	PDRIVER_OBJECT *fsDir = NULL;
 	SIZE_T fsDirCount = 0;
 	UNICODE_STRING uDirName;
+	IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT header;
 	NTSTATUS status = STATUS_UNSUCCESSFUL;
 	DEBUG_ENTER_FUNCTION("OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", OutputBuffer, OutputBufferLength, ReturnLength);
 
 	*ReturnLength = 0;
+	// Changes recorded during the enumeration have higher generations, so the
+	// caller asks for them later even if the snapshot already contains them.
+	header.Generation = RequestQueueObjectGeneration();
 	RtlInitUnicodeString(&uDirName, L"\\Driver");
 	status = _GetDriversInDirectory(&uDirName, &driverDir, &driverDirCount);
 	if (NT_SUCCESS(status)) {
@@ -441,8 +487,7 @@ NTSTATUS UMEnumDriversDevices(PVOID OutputBuffer, ULONG OutputBufferLength, PULO
 
 			driverInfoArray = (PUM_DRIVER_INFO)HeapMemoryAllocNonPaged(sizeof(UM_DRIVER_INFO)*driversCount);
 			if (driverInfoArray != NULL) {
-				// ULONG DriverCount
-				ULONG requiredLength = sizeof(ULONG);
+				ULONG requiredLength = sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT);
 
 				tmp = driverInfoArray;
 				for (i = 0; i < driversCount; ++i) {
@@ -549,8 +594,10 @@ NTSTATUS UMEnumDriversDevices(PVOID OutputBuffer, ULONG OutputBufferLength, PULO
 							PUCHAR tmpKernelBuffer = kernelBuffer;
 
 							tmp = driverInfoArray;
-							memcpy(tmpKernelBuffer, &driversCount, sizeof(driversCount));
-							tmpKernelBuffer += sizeof(driversCount);
+							header.RequiredLength = requiredLength;
+							header.DriverCount = driversCount;
+							memcpy(tmpKernelBuffer, &header, sizeof(header));
+							tmpKernelBuffer += sizeof(header);
 							for (i = 0; i < driversCount; ++i) {
 								ULONG j = 0;
 								ULONG nameLen = tmp->DriverName.Length;
@@ -588,7 +635,21 @@ NTSTATUS UMEnumDriversDevices(PVOID OutputBuffer, ULONG OutputBufferLength, PULO
 
 							*ReturnLength = requiredLength;
 						}
-					} else status = STATUS_BUFFER_TOO_SMALL;
+					} else {
+						// Tell the caller how large buffer to allocate, so the
+						// enumeration does not have to be repeated more than once.
+						status = STATUS_BUFFER_TOO_SMALL;
+						if (OutputBufferLength >= sizeof(ULONG)) {
+							if (ExGetPreviousMode() == UserMode) {
+								__try {
+									ProbeForWrite(OutputBuffer, sizeof(ULONG), 1);
+									*(PULONG)OutputBuffer = requiredLength;
+								} __except (EXCEPTION_EXECUTE_HANDLER) {
+									status = GetExceptionCode();
+								}
+							} else *(PULONG)OutputBuffer = requiredLength;
+						}
+					}
 
 					tmp = driverInfoArray;
 					for (i = 0; i < driversCount; ++i) {
@@ -625,6 +686,59 @@ NTSTATUS UMEnumDriversDevices(PVOID OutputBuffer, ULONG OutputBufferLength, PULO
 	return status;
 }
 
+NTSTATUS UMGetObjectChanges(PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT InputBuffer, ULONG InputBufferLength, PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	ULONG changesLength = 0;
+	ULONG dataLength = 0;
+	PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT changes = NULL;
+	IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT input = {0};
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("InputBuffer=0x%p; InputBufferLength=%u; OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, ReturnLength);
+
+	*ReturnLength = 0;
+	if (InputBufferLength == sizeof(input) && OutputBufferLength >= sizeof(ULONG)) {
+		if (ExGetPreviousMode() == UserMode) {
+			__try {
+				ProbeForRead(InputBuffer, InputBufferLength, 1);
+				input = *InputBuffer;
+				status = STATUS_SUCCESS;
+			} __except (EXCEPTION_EXECUTE_HANDLER) {
+				status = GetExceptionCode();
+			}
+		} else {
+			input = *InputBuffer;
+			status = STATUS_SUCCESS;
+		}
+
+		if (NT_SUCCESS(status))
+			status = RequestQueueObjectChangesGet(input.Generation, &changes, &changesLength);
+
+		if (NT_SUCCESS(status)) {
+			// Only the required length is copied when the changes do not fit.
+			dataLength = (OutputBufferLength >= changesLength) ? changesLength : sizeof(ULONG);
+			if (ExGetPreviousMode() == UserMode) {
+				__try {
+					ProbeForWrite(OutputBuffer, dataLength, 1);
+					memcpy(OutputBuffer, changes, dataLength);
+				} __except (EXCEPTION_EXECUTE_HANDLER) {
+					status = GetExceptionCode();
+				}
+			} else memcpy(OutputBuffer, changes, dataLength);
+
+			if (NT_SUCCESS(status)) {
+				if (dataLength < changesLength)
+					status = STATUS_BUFFER_TOO_SMALL;
+				else *ReturnLength = dataLength;
+			}
+
+			HeapMemoryFree(changes);
+		}
+	} else status = STATUS_INVALID_PARAMETER;
+
+	DEBUG_EXIT_FUNCTION("0x%x, *ReturnLength=%u", status, *ReturnLength);
+	return status;
+}
+
 NTSTATUS UMRequestQueueConnect(PIOCTL_IRPMNDRV_CONNECT_INPUT InputBuffer, ULONG InputBufferLength)
 {
 	IOCTL_IRPMNDRV_CONNECT_INPUT input = {0};
@@ -1280,6 +1394,391 @@ NTSTATUS UMDriverNamehUnregister(PIOCTL_IRPMNDRV_DRIVER_WATCH_UNREGISTER_INPUT I
 }
 
 
+NTSTATUS UMHookBatch(PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT InputBuffer, ULONG InputBufferLength, PIOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	ULONG i = 0;
+	ULONG resultCount = 0;
+	ULONG64 headerLength = 0;
+	PUCHAR input = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT header = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY driverEntry = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY deviceEntry = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_RESULT results = NULL;
+	PDRIVER_OBJECT *driverObjects = NULL;
+	PDRIVER_MONITOR_SETTINGS driverSettings = NULL;
+	PDRIVER_HOOK_RECORD *driverRecords = NULL;
+	NTSTATUS *driverStatuses = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("InputBuffer=0x%p; InputBufferLength=%u; OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, ReturnLength);
+
+	*ReturnLength = 0;
+	if (InputBufferLength >= sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_INPUT)) {
+		input = (PUCHAR)HeapMemoryAllocPaged(InputBufferLength);
+		if (input != NULL) {
+			if (ExGetPreviousMode() == UserMode) {
+				__try {
+					ProbeForRead(InputBuffer, InputBufferLength, 1);
+					memcpy(input, InputBuffer, InputBufferLength);
+					ProbeForWrite(OutputBuffer, OutputBufferLength, 1);
+					status = STATUS_SUCCESS;
+				} __except (EXCEPTION_EXECUTE_HANDLER) {
+					status = GetExceptionCode();
+				}
+			} else {
+				memcpy(input, InputBuffer, InputBufferLength);
+				status = STATUS_SUCCESS;
+			}
+
+			if (NT_SUCCESS(status)) {
+				header = (PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT)input;
+				headerLength = sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_INPUT) +
+					(ULONG64)header->DriverCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY) +
+					(ULONG64)header->DeviceCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY);
+				resultCount = header->DriverCount + header->DeviceCount;
+				if (headerLength > InputBufferLength || resultCount < header->DriverCount || resultCount == 0)
+					status = STATUS_INVALID_PARAMETER;
+				else if ((ULONG64)resultCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT) > OutputBufferLength)
+					status = STATUS_BUFFER_TOO_SMALL;
+			}
+
+			if (NT_SUCCESS(status)) {
+				driverEntry = (PIOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY)(header + 1);
+				deviceEntry = (PIOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY)(driverEntry + header->DriverCount);
+				results = (PIOCTL_IRPMNDRV_HOOK_BATCH_RESULT)HeapMemoryAllocPaged(resultCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT));
+				if (results != NULL) {
+					memset(results, 0, resultCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT));
+					if (header->DriverCount > 0) {
+						driverObjects = (PDRIVER_OBJECT *)HeapMemoryAllocPaged(header->DriverCount*(sizeof(PDRIVER_OBJECT) + sizeof(DRIVER_MONITOR_SETTINGS) + sizeof(PDRIVER_HOOK_RECORD) + sizeof(NTSTATUS)));
+						if (driverObjects != NULL) {
+							driverSettings = (PDRIVER_MONITOR_SETTINGS)(driverObjects + header->DriverCount);
+							driverRecords = (PDRIVER_HOOK_RECORD *)(driverSettings + header->DriverCount);
+							driverStatuses = (NTSTATUS *)(driverRecords + header->DriverCount);
+							for (i = 0; i < header->DriverCount; ++i) {
+								UNICODE_STRING uDriverName;
+
+								driverObjects[i] = NULL;
+								driverRecords[i] = NULL;
+								driverSettings[i] = driverEntry[i].MonitorSettings;
+								driverStatuses[i] = _GetBatchString(input, InputBufferLength, driverEntry[i].DriverNameOffset, driverEntry[i].DriverNameLength, &uDriverName);
+								if (NT_SUCCESS(driverStatuses[i]))
+									driverStatuses[i] = GetDriverObjectByName(&uDriverName, driverObjects + i);
+							}
+
+							status = HookDriverObjects(header->DriverCount, driverObjects, driverSettings, driverRecords, driverStatuses);
+							if (NT_SUCCESS(status)) {
+								for (i = 0; i < header->DriverCount; ++i) {
+									if (driverRecords[i] != NULL) {
+										driverStatuses[i] = HandleTableHandleCreate(_driverHandleTable, driverRecords[i], &results[i].Handle);
+										if (NT_SUCCESS(driverStatuses[i]))
+											results[i].ObjectId = driverRecords[i];
+										else UnhookDriverObject(driverRecords[i]);
+									}
+
+									results[i].Status = driverStatuses[i];
+								}
+							}
+
+							for (i = 0; i < header->DriverCount; ++i) {
+								if (driverRecords[i] != NULL)
+									DriverHookRecordDereference(driverRecords[i]);
+
+								if (driverObjects[i] != NULL)
+									ObDereferenceObject(driverObjects[i]);
+							}
+
+							HeapMemoryFree(driverObjects);
+						} else status = STATUS_INSUFFICIENT_RESOURCES;
+					} else status = STATUS_SUCCESS;
+
+					if (NT_SUCCESS(status)) {
+						if (header->Flags & HOOK_BATCH_FLAG_ACTIVATE) {
+							for (i = 0; i < header->DriverCount; ++i) {
+								PDRIVER_HOOK_RECORD driverRecord = NULL;
+
+								if (!NT_SUCCESS(results[i].Status))
+									continue;
+
+								results[i].Status = HandleTablehandleTranslate(_driverHandleTable, results[i].Handle, (PVOID *)&driverRecord);
+								if (NT_SUCCESS(results[i].Status)) {
+									results[i].Status = DriverHookRecordEnable(driverRecord, TRUE);
+									if (!NT_SUCCESS(results[i].Status)) {
+										UnhookDriverObject(driverRecord);
+										HandleTableHandleClose(_driverHandleTable, results[i].Handle);
+										results[i].Handle = NULL;
+										results[i].ObjectId = NULL;
+									}
+
+									DriverHookRecordDereference(driverRecord);
+								}
+							}
+						}
+
+						// A driver that failed to activate is unhooked, so hooking
+						// its devices fails with STATUS_NOT_FOUND.
+						for (i = 0; i < header->DeviceCount; ++i) {
+							UNICODE_STRING uDeviceName;
+							PUCHAR irpSettings = (deviceEntry[i].UseIRPSettings) ? deviceEntry[i].IRPSettings : NULL;
+							PUCHAR fastIoSettings = (deviceEntry[i].UseFastIoSettings) ? deviceEntry[i].FastIoSettings : NULL;
+							PIOCTL_IRPMNDRV_HOOK_BATCH_RESULT result = results + header->DriverCount + i;
+
+							if (deviceEntry[i].DeviceNameLength > 0) {
+								result->Status = _GetBatchString(input, InputBufferLength, deviceEntry[i].DeviceNameOffset, deviceEntry[i].DeviceNameLength, &uDeviceName);
+								if (NT_SUCCESS(result->Status))
+									result->Status = _HookDevice(&uDeviceName, NULL, irpSettings, fastIoSettings, &result->Handle, &result->ObjectId);
+							} else result->Status = _HookDevice(NULL, deviceEntry[i].DeviceAddress, irpSettings, fastIoSettings, &result->Handle, &result->ObjectId);
+						}
+
+						if (ExGetPreviousMode() == UserMode) {
+							__try {
+								memcpy(OutputBuffer->Results, results, resultCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT));
+							} __except (EXCEPTION_EXECUTE_HANDLER) {
+								status = GetExceptionCode();
+							}
+						} else memcpy(OutputBuffer->Results, results, resultCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT));
+
+						if (NT_SUCCESS(status))
+							*ReturnLength = resultCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT);
+
+						if (!NT_SUCCESS(status)) {
+							for (i = header->DriverCount; i < resultCount; ++i) {
+								if (NT_SUCCESS(results[i].Status))
+									_UnhookDevice(results[i].Handle);
+							}
+
+							for (i = 0; i < header->DriverCount; ++i) {
+								PDRIVER_HOOK_RECORD driverRecord = NULL;
+
+								if (NT_SUCCESS(results[i].Status) &&
+									NT_SUCCESS(HandleTablehandleTranslate(_driverHandleTable, results[i].Handle, (PVOID *)&driverRecord))) {
+									UnhookDriverObject(driverRecord);
+									DriverHookRecordDereference(driverRecord);
+									HandleTableHandleClose(_driverHandleTable, results[i].Handle);
+								}
+							}
+						}
+					}
+
+					HeapMemoryFree(results);
+				} else status = STATUS_INSUFFICIENT_RESOURCES;
+			}
+
+			HeapMemoryFree(input);
+		} else status = STATUS_INSUFFICIENT_RESOURCES;
+	} else status = STATUS_BUFFER_TOO_SMALL;
+
+	DEBUG_EXIT_FUNCTION("0x%x, *ReturnLength=%u", status, *ReturnLength);
+	return status;
+}
+
+
+NTSTATUS UMUnhookBatch(PIOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT InputBuffer, ULONG InputBufferLength, PIOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	ULONG i = 0;
+	ULONG count = 0;
+	PHANDLE handles = NULL;
+	PDRIVER_HOOK_RECORD *driverRecords = NULL;
+	NTSTATUS *statuses = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("InputBuffer=0x%p; InputBufferLength=%u; OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, ReturnLength);
+
+	*ReturnLength = 0;
+	if (InputBufferLength >= FIELD_OFFSET(IOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT, HookHandles)) {
+		if (ExGetPreviousMode() == UserMode) {
+			__try {
+				ProbeForRead(InputBuffer, InputBufferLength, 1);
+				count = InputBuffer->Count;
+				ProbeForWrite(OutputBuffer, OutputBufferLength, 1);
+				status = STATUS_SUCCESS;
+			} __except (EXCEPTION_EXECUTE_HANDLER) {
+				status = GetExceptionCode();
+			}
+		} else {
+			count = InputBuffer->Count;
+			status = STATUS_SUCCESS;
+		}
+
+		if (NT_SUCCESS(status)) {
+			if (count == 0 || FIELD_OFFSET(IOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT, HookHandles) + (ULONG64)count*sizeof(HANDLE) > InputBufferLength)
+				status = STATUS_INVALID_PARAMETER;
+			else if ((ULONG64)count*sizeof(NTSTATUS) > OutputBufferLength)
+				status = STATUS_BUFFER_TOO_SMALL;
+		}
+
+		if (NT_SUCCESS(status)) {
+			handles = (PHANDLE)HeapMemoryAllocPaged(count*(sizeof(HANDLE) + sizeof(PDRIVER_HOOK_RECORD) + sizeof(NTSTATUS)));
+			if (handles != NULL) {
+				driverRecords = (PDRIVER_HOOK_RECORD *)(handles + count);
+				statuses = (NTSTATUS *)(driverRecords + count);
+				if (ExGetPreviousMode() == UserMode) {
+					__try {
+						memcpy(handles, InputBuffer->HookHandles, count*sizeof(HANDLE));
+					} __except (EXCEPTION_EXECUTE_HANDLER) {
+						status = GetExceptionCode();
+					}
+				} else memcpy(handles, InputBuffer->HookHandles, count*sizeof(HANDLE));
+
+				if (NT_SUCCESS(status)) {
+					for (i = 0; i < count; ++i) {
+						driverRecords[i] = NULL;
+						statuses[i] = HandleTablehandleTranslate(_driverHandleTable, handles[i], (PVOID *)(driverRecords + i));
+						if (!NT_SUCCESS(statuses[i]))
+							driverRecords[i] = NULL;
+					}
+
+					UnhookDriverObjects(count, driverRecords, statuses);
+					for (i = 0; i < count; ++i) {
+						if (driverRecords[i] != NULL) {
+							DriverHookRecordDereference(driverRecords[i]);
+							if (NT_SUCCESS(statuses[i]))
+								HandleTableHandleClose(_driverHandleTable, handles[i]);
+						}
+					}
+
+					if (ExGetPreviousMode() == UserMode) {
+						__try {
+							memcpy(OutputBuffer->Statuses, statuses, count*sizeof(NTSTATUS));
+						} __except (EXCEPTION_EXECUTE_HANDLER) {
+							status = GetExceptionCode();
+						}
+					} else memcpy(OutputBuffer->Statuses, statuses, count*sizeof(NTSTATUS));
+
+					if (NT_SUCCESS(status))
+						*ReturnLength = count*sizeof(NTSTATUS);
+				}
+
+				HeapMemoryFree(handles);
+			} else status = STATUS_INSUFFICIENT_RESOURCES;
+		}
+	} else status = STATUS_BUFFER_TOO_SMALL;
+
+	DEBUG_EXIT_FUNCTION("0x%x, *ReturnLength=%u", status, *ReturnLength);
+	return status;
+}
+
+
+
+NTSTATUS UMHashTableStatistics(PIOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	PIOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT stats = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", OutputBuffer, OutputBufferLength, ReturnLength);
+
+	*ReturnLength = 0;
+	if (OutputBufferLength >= sizeof(IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT)) {
+		stats = (PIOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT)HeapMemoryAllocNonPaged(sizeof(IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT));
+		if (stats != NULL) {
+			HookGetHashTableStatistics(&stats->Tables[edhtDriverHooks], &stats->Tables[edhtDriverValidation], &stats->Tables[edhtDeviceValidation]);
+			PDBGetHashTableStatistics(&stats->Tables[edhtProcessDatabase]);
+			if (ExGetPreviousMode() == UserMode) {
+				__try {
+					ProbeForWrite(OutputBuffer, sizeof(IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT), 1);
+					memcpy(OutputBuffer, stats, sizeof(IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT));
+					status = STATUS_SUCCESS;
+				} __except (EXCEPTION_EXECUTE_HANDLER) {
+					status = GetExceptionCode();
+				}
+			} else {
+				memcpy(OutputBuffer, stats, sizeof(IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT));
+				status = STATUS_SUCCESS;
+			}
+
+			if (NT_SUCCESS(status))
+				*ReturnLength = sizeof(IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT);
+
+			HeapMemoryFree(stats);
+		} else status = STATUS_INSUFFICIENT_RESOURCES;
+	} else status = STATUS_BUFFER_TOO_SMALL;
+
+	DEBUG_EXIT_FUNCTION("0x%x, *ReturnLength=%u", status, *ReturnLength);
+	return status;
+}
+
+
+NTSTATUS UMAllocatorStatistics(PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	ULONG maxCount = 0;
+	ULONG siteCount = 0;
+	ULONG returnedCount = 0;
+	ULONG dataLength = 0;
+	PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT stats = NULL;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	DEBUG_ENTER_FUNCTION("OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", OutputBuffer, OutputBufferLength, ReturnLength);
+
+	*ReturnLength = 0;
+	if (OutputBufferLength >= FIELD_OFFSET(IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, Sites)) {
+		// Do not let the caller decide how much kernel memory gets allocated.
+		maxCount = (OutputBufferLength - FIELD_OFFSET(IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, Sites)) / sizeof(DRIVER_ALLOCATOR_SITE_STATISTICS);
+		DebugAllocatorQuerySites(NULL, 0, &siteCount);
+		if (maxCount > siteCount)
+			maxCount = siteCount;
+
+		stats = (PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT)HeapMemoryAllocPaged(FIELD_OFFSET(IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, Sites) + maxCount*sizeof(DRIVER_ALLOCATOR_SITE_STATISTICS));
+		if (stats != NULL) {
+			stats->Mode = DebugAllocatorGetMode();
+			DebugAllocatorQuerySites(stats->Sites, maxCount, &stats->SiteCount);
+			returnedCount = (stats->SiteCount < maxCount) ? stats->SiteCount : maxCount;
+			dataLength = FIELD_OFFSET(IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, Sites) + returnedCount*sizeof(DRIVER_ALLOCATOR_SITE_STATISTICS);
+			// The header is copied even if not all sites fit, so the caller
+			// learns how large buffer it needs.
+			if (stats->SiteCount > returnedCount)
+				dataLength = FIELD_OFFSET(IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, Sites);
+
+			if (ExGetPreviousMode() == UserMode) {
+				__try {
+					ProbeForWrite(OutputBuffer, dataLength, 1);
+					memcpy(OutputBuffer, stats, dataLength);
+					status = STATUS_SUCCESS;
+				} __except (EXCEPTION_EXECUTE_HANDLER) {
+					status = GetExceptionCode();
+				}
+			} else {
+				memcpy(OutputBuffer, stats, dataLength);
+				status = STATUS_SUCCESS;
+			}
+
+			if (NT_SUCCESS(status)) {
+				if (stats->SiteCount > returnedCount)
+					status = STATUS_BUFFER_TOO_SMALL;
+				else *ReturnLength = dataLength;
+			}
+
+			HeapMemoryFree(stats);
+		} else status = STATUS_INSUFFICIENT_RESOURCES;
+	} else status = STATUS_BUFFER_TOO_SMALL;
+
+	DEBUG_EXIT_FUNCTION("0x%x, *ReturnLength=%u", status, *ReturnLength);
+	return status;
+}
+
+
+NTSTATUS UMAllocatorSetMode(PIOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT InputBuffer, ULONG InputBufferLength)
+{
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT input = {0};
+	DEBUG_ENTER_FUNCTION("InputBuffer=0x%p; InputBufferLength=%u", InputBuffer, InputBufferLength);
+
+	if (InputBufferLength >= sizeof(IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT)) {
+		if (ExGetPreviousMode() == UserMode) {
+			__try {
+				ProbeForRead(InputBuffer, sizeof(IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT), 1);
+				input = *InputBuffer;
+				status = STATUS_SUCCESS;
+			} __except (EXCEPTION_EXECUTE_HANDLER) {
+				status = GetExceptionCode();
+			}
+		} else {
+			input = *InputBuffer;
+			status = STATUS_SUCCESS;
+		}
+
+		if (NT_SUCCESS(status))
+			status = DebugAllocatorSetMode(input.Mode);
+	} else status = STATUS_BUFFER_TOO_SMALL;
+
+	DEBUG_EXIT_FUNCTION("0x%x", status);
+	return status;
+}
+
 
 /************************************************************************/
 /*                   INITIALIZATION AND FINALIZATION                    */
@@ -26,6 +26,7 @@ NTSTATUS UMHookAddDevice(PIOCTL_IRPMNDRV_HOOK_ADD_DEVICE_INPUT InputBUffer, ULON
 NTSTATUS UMHookDeleteDevice(PIOCTL_IRPMNDRV_HOOK_REMOVE_DEVICE_INPUT InputBuffer, ULONG InputBufferLength);
 NTSTATUS UMGetRequestRecord(PVOID Buffer, ULONG BufferLength, PULONG ReturnLength);
 NTSTATUS UMEnumDriversDevices(PVOID OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
+NTSTATUS UMGetObjectChanges(PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT InputBuffer, ULONG InputBufferLength, PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
 NTSTATUS UMRequestQueueConnect(PIOCTL_IRPMNDRV_CONNECT_INPUT InputBuffer, ULONG InputBufferLength);
 VOID UMRequestQueueDisconnect(VOID);
 
@@ -46,6 +47,13 @@ NTSTATUS UMClassWatchUnregister(PIOCTL_IRPMNDRV_CLASS_WATCH_UNREGISTER_INPUT Inp
 NTSTATUS UMDriverNameWatchRegister(PIOCTL_IRPMNDRV_DRIVER_WATCH_REGISTER_INPUT InputBuffer, ULONG InputBufferLength);
 NTSTATUS UMDriverNamehUnregister(PIOCTL_IRPMNDRV_DRIVER_WATCH_UNREGISTER_INPUT InputBuffer, ULONG InputBUfferLength);
 
+NTSTATUS UMHookBatch(PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT InputBuffer, ULONG InputBufferLength, PIOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
+NTSTATUS UMUnhookBatch(PIOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT InputBuffer, ULONG InputBufferLength, PIOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
+
+NTSTATUS UMHashTableStatistics(PIOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
+NTSTATUS UMAllocatorStatistics(PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
+NTSTATUS UMAllocatorSetMode(PIOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT InputBuffer, ULONG InputBufferLength);
+
 NTSTATUS UMServicesModuleInit(PDRIVER_OBJECT DriverObject, PVOID Context);
 VOID UMServicesModuleFinit(PDRIVER_OBJECT DriverObject, PVOID Context);
 
@@ -0,0 +1,1245 @@
+
+/**
+ * @file
+ *
+ * irpmon-analyze: offline analysis of capture files written by
+ * irpmonconsole --capture. Filters the records, prints the matching ones,
+ * top-N summaries and per-device latencies of IRPs paired with their
+ * completions.
+ *
+ * The blocks are decoded and analyzed on a pool of threads, each thread
+ * keeping its own statistics. IRPs are paired with completions within a
+ * block; the remaining completions are paired when the blocks are committed
+ * in the file order, which is also the order in which the listings of the
+ * blocks are written.
+ */
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <locale.h>
+#include <stdarg.h>
+#include <time.h>
+#include <wctype.h>
+#include <windows.h>
+#include "general-types.h"
+#include "libtranslate.h"
+#include "request-format.h"
+#include "capture-format.h"
+#include "capture-reader.h"
+
+
+
+/************************************************************************/
+/*                           MACRO DEFINITIONS                          */
+/************************************************************************/
+
+#define ANALYZE_TOP_DEFAULT					10
+
+/** Latencies below this value (in 100 nanosecond units) have their own bucket,
+    larger ones are split into this number of buckets per power of two. */
+#define LATENCY_SUBBUCKETS					16
+#define LATENCY_SUBBUCKET_BITS				4
+#define LATENCY_BUCKET_COUNT				((64 - LATENCY_SUBBUCKET_BITS + 1)*LATENCY_SUBBUCKETS)
+
+/** Number of 100 nanosecond units between January 1 1601 and January 1 1970. */
+#define FILETIME_UNIX_EPOCH					116444736000000000ULL
+
+
+/************************************************************************/
+/*                           TYPE DEFINITIONS                           */
+/************************************************************************/
+
+typedef struct _ANALYZE_FILTER {
+	/** Lowercase substrings of the driver and device names, empty if not
+	    filtered. */
+	std::wstring Driver;
+	std::wstring Device;
+	/** Process ID, or a lowercase substring of the image name. */
+	BOOLEAN ProcessIdFiltered;
+	ULONG ProcessId;
+	std::wstring ProcessName;
+	BOOLEAN MajorFiltered;
+	UCHAR Major;
+	BOOLEAN IOCTLFiltered;
+	ULONG IOCTL;
+	BOOLEAN StatusFiltered;
+	ULONG Status;
+} ANALYZE_FILTER, *PANALYZE_FILTER;
+
+/** Log-linear histogram of latencies, in 100 nanosecond units. Values are
+    kept with a relative error below 1/LATENCY_SUBBUCKETS. */
+typedef struct _LATENCY_HISTOGRAM {
+	ULONG64 Buckets[LATENCY_BUCKET_COUNT];
+	ULONG64 Count;
+	ULONG64 Sum;
+	ULONG64 Max;
+} LATENCY_HISTOGRAM, *PLATENCY_HISTOGRAM;
+
+/** An IRP waiting for its completion. */
+typedef struct _PENDING_IRP {
+	LONG64 Time;
+	ULONG64 Device;
+	/** Whether the IRP passed the filters other than the status one. The
+	    completion inherits the result. */
+	BOOLEAN Matched;
+	/** Cleared when the completion is found in the same block. */
+	BOOLEAN Pending;
+} PENDING_IRP, *PPENDING_IRP;
+
+/** Counts and latencies of the matching records. Every worker thread has
+    its own instance, they are merged when all blocks have been read. */
+typedef struct _ANALYZE_STATS {
+	ULONG64 RecordCount;
+	ULONG64 MatchCount;
+	LONG64 FirstTime;
+	LONG64 LastTime;
+	ULONG64 TypeCounts[CAPTURE_TYPE_COUNT];
+	std::map<ULONG64, ULONG64> Drivers;
+	std::map<ULONG64, ULONG64> Devices;
+	std::map<ULONG, ULONG64> Processes;
+	std::map<ULONG, ULONG64> Majors;
+	std::map<ULONG, ULONG64> IOCTLs;
+	std::map<ULONG, ULONG64> Statuses;
+	std::map<ULONG64, LATENCY_HISTOGRAM> Latencies;
+} ANALYZE_STATS, *PANALYZE_STATS;
+
+/** A name announced by a DriverDetected, DeviceDetected or ProcessCreated
+    record. */
+typedef struct _ANALYZE_NAME {
+	ERequesttype Type;
+	ULONG64 Key;
+	std::wstring Name;
+} ANALYZE_NAME, *PANALYZE_NAME;
+
+/** Printed records, each identified by its sequence number (position within
+    the block). */
+typedef struct _ANALYZE_LISTING {
+	std::string Text;
+	/** Sequence number of each record and the offset of the end of its text. */
+	std::vector<std::pair<ULONG, size_t>> Entries;
+} ANALYZE_LISTING, *PANALYZE_LISTING;
+
+/** An IRP completion whose IRP was not seen in the same block. It is resolved
+    when the preceding blocks have been committed. */
+typedef struct _ORPHAN_COMPLETION {
+	ULONG Sequence;
+	std::vector<UCHAR> Record;
+} ORPHAN_COMPLETION, *PORPHAN_COMPLETION;
+
+/** Result of processing one block, kept until the block is committed. */
+typedef struct _ANALYZE_BLOCK {
+	DWORD Status;
+	/** IRPs of the block by address, the last one for each address. */
+	std::unordered_map<ULONG64, PENDING_IRP> IRPs;
+	std::vector<ORPHAN_COMPLETION> Orphans;
+	ANALYZE_LISTING Listing;
+	std::vector<ANALYZE_NAME> Names;
+} ANALYZE_BLOCK, *PANALYZE_BLOCK;
+
+typedef struct _ANALYZE_CONTEXT {
+	const ANALYZE_FILTER *Filter;
+	BOOLEAN List;
+	/** Names from the snapshot, updated by the records. Read-only while
+	    the blocks are analyzed. */
+	std::map<ULONG64, std::wstring> DriverNames;
+	std::map<ULONG64, std::wstring> DeviceNames;
+	std::map<ULONG, std::wstring> ProcessNames;
+	/** Named drivers, devices and processes passing the name filters. */
+	std::unordered_set<ULONG64> MatchingDrivers;
+	std::unordered_set<ULONG64> MatchingDevices;
+	std::unordered_set<ULONG> MatchingProcesses;
+	/** Indices of the blocks being read. */
+	std::vector<ULONG> BlockIndices;
+	/** Results of the blocks being read, by position in BlockIndices. */
+	std::vector<ANALYZE_BLOCK> Blocks;
+	/** Statistics of the worker threads. */
+	std::vector<ANALYZE_STATS> Workers;
+	/** Buffers for the request details, one per worker thread and one for
+	    the commit callback. */
+	std::vector<REQUEST_FORMAT_BUFFER> WorkerFormats;
+	REQUEST_FORMAT_BUFFER CommitFormat;
+	/** IRPs still pending at the end of the committed blocks, and the
+	    statistics of the completions paired with them. */
+	std::unordered_map<ULONG64, PENDING_IRP> PendingIRPs;
+	ANALYZE_STATS CommitStats;
+	PCAPTURE_READER Reader;
+} ANALYZE_CONTEXT, *PANALYZE_CONTEXT;
+
+/** Passed to the record callback by a worker thread. */
+typedef struct _ANALYZE_BLOCK_CONTEXT {
+	PANALYZE_CONTEXT Analyze;
+	PANALYZE_STATS Stats;
+	PREQUEST_FORMAT_BUFFER Format;
+	PANALYZE_BLOCK Block;
+	ULONG Sequence;
+} ANALYZE_BLOCK_CONTEXT, *PANALYZE_BLOCK_CONTEXT;
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+static std::wstring _ToLower(const std::wstring & String)
+{
+	std::wstring ret(String);
+
+	for (auto & c : ret)
+		c = towlower(c);
+
+	return ret;
+}
+
+
+static BOOLEAN _Contains(const std::wstring & String, const std::wstring & LowerPattern)
+{
+	return (_ToLower(String).find(LowerPattern) != std::wstring::npos);
+}
+
+
+static std::wstring _AddressToString(ULONG64 Address)
+{
+	WCHAR buf[32];
+
+	swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"0x%I64x", Address);
+
+	return buf;
+}
+
+
+static std::wstring _NameGet(const std::map<ULONG64, std::wstring> & Names, ULONG64 Address)
+{
+	std::wstring ret;
+	auto it = Names.find(Address);
+
+	if (it != Names.end())
+		ret = it->second;
+	else ret = _AddressToString(Address);
+
+	return ret;
+}
+
+
+static ULONG _LatencyBucket(ULONG64 Value)
+{
+	ULONG exponent = 0;
+	ULONG ret = 0;
+
+	if (Value >= LATENCY_SUBBUCKETS) {
+		exponent = 63 - __builtin_clzll(Value);
+		ret = (exponent - LATENCY_SUBBUCKET_BITS + 1)*LATENCY_SUBBUCKETS + (ULONG)((Value >> (exponent - LATENCY_SUBBUCKET_BITS)) & (LATENCY_SUBBUCKETS - 1));
+	} else ret = (ULONG)Value;
+
+	return ret;
+}
+
+
+/** Returns the highest value falling into a bucket. */
+static ULONG64 _LatencyBucketValue(ULONG Bucket)
+{
+	ULONG64 ret = Bucket;
+
+	if (Bucket >= LATENCY_SUBBUCKETS) {
+		ULONG exponent = Bucket / LATENCY_SUBBUCKETS + LATENCY_SUBBUCKET_BITS - 1;
+		ULONG64 step = 1ULL << (exponent - LATENCY_SUBBUCKET_BITS);
+
+		ret = (LATENCY_SUBBUCKETS + Bucket % LATENCY_SUBBUCKETS)*step + step - 1;
+	}
+
+	return ret;
+}
+
+
+static VOID _LatencyAdd(PLATENCY_HISTOGRAM Histogram, ULONG64 Value)
+{
+	++Histogram->Buckets[_LatencyBucket(Value)];
+	++Histogram->Count;
+	Histogram->Sum += Value;
+	if (Histogram->Max < Value)
+		Histogram->Max = Value;
+
+	return;
+}
+
+
+static ULONG64 _LatencyPercentile(const LATENCY_HISTOGRAM *Histogram, double Percentile)
+{
+	ULONG64 rank = (ULONG64)(Percentile*Histogram->Count / 100.0 + 0.5);
+	ULONG64 sum = 0;
+	ULONG64 ret = Histogram->Max;
+
+	if (rank == 0)
+		rank = 1;
+
+	for (ULONG i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+		sum += Histogram->Buckets[i];
+		if (sum >= rank) {
+			ret = std::min(_LatencyBucketValue(i), Histogram->Max);
+			break;
+		}
+	}
+
+	return ret;
+}
+
+
+/** Retrieves the status reported by a record, if any. */
+static BOOLEAN _RecordStatus(const REQUEST_HEADER *Header, PULONG Status)
+{
+	BOOLEAN ret = TRUE;
+
+	if (Header->Type == ertIRPCompletion)
+		*Status = (ULONG)CONTAINING_RECORD(Header, REQUEST_IRP_COMPLETION, Header)->CompletionStatus;
+	else if (Header->Type == ertFastIo && Header->ResultType == rrtBOOLEAN && Header->Result.BOOLEANValue)
+		*Status = (ULONG)CONTAINING_RECORD(Header, REQUEST_FASTIO, Header)->IOSBStatus;
+	else if (Header->ResultType == rrtNTSTATUS)
+		*Status = (ULONG)Header->Result.NTSTATUSValue;
+	else ret = FALSE;
+
+	return ret;
+}
+
+
+/** Retrieves the major function and the I/O control code of a record, if any. */
+static VOID _RecordOperation(const REQUEST_HEADER *Header, PBOOLEAN MajorValid, PUCHAR Major, PBOOLEAN IOCTLValid, PULONG IOCTL)
+{
+	*MajorValid = FALSE;
+	*IOCTLValid = FALSE;
+	switch (Header->Type) {
+		case ertIRP: {
+			const REQUEST_IRP *r = CONTAINING_RECORD(Header, REQUEST_IRP, Header);
+
+			*MajorValid = TRUE;
+			*Major = r->MajorFunction;
+			*IOCTLValid = (r->MajorFunction == IRP_MJ_DEVICE_CONTROL || r->MajorFunction == IRP_MJ_INTERNAL_DEVICE_CONTROL);
+			*IOCTL = (ULONG)(ULONG_PTR)r->Arg3;
+		} break;
+		case ertStartIo: {
+			const REQUEST_STARTIO *s = CONTAINING_RECORD(Header, REQUEST_STARTIO, Header);
+
+			*MajorValid = TRUE;
+			*Major = s->MajorFunction;
+			*IOCTLValid = (s->MajorFunction == IRP_MJ_DEVICE_CONTROL || s->MajorFunction == IRP_MJ_INTERNAL_DEVICE_CONTROL);
+			*IOCTL = (ULONG)(ULONG_PTR)s->Arg3;
+		} break;
+		case ertFastIo: {
+			const REQUEST_FASTIO *f = CONTAINING_RECORD(Header, REQUEST_FASTIO, Header);
+
+			*IOCTLValid = (f->FastIoType == FastIoDeviceControl);
+			*IOCTL = (ULONG)(ULONG_PTR)f->Arg1;
+		} break;
+		default:
+			break;
+	}
+
+	return;
+}
+
+
+/** Checks a driver or a device against a name filter. Objects without a name
+ *  are matched by their address.
+ */
+static BOOLEAN _ObjectMatches(const std::map<ULONG64, std::wstring> & Names, const std::unordered_set<ULONG64> & Matching, ULONG64 Address, const std::wstring & Pattern)
+{
+	BOOLEAN ret = FALSE;
+
+	ret = (Matching.count(Address) > 0);
+	if (!ret && Names.count(Address) == 0)
+		ret = _Contains(_AddressToString(Address), Pattern);
+
+	return ret;
+}
+
+
+/** Evaluates all filters except the status one. */
+static BOOLEAN _RecordMatches(PANALYZE_CONTEXT Context, const REQUEST_HEADER *Header)
+{
+	const ANALYZE_FILTER *filter = Context->Filter;
+	BOOLEAN majorValid = FALSE;
+	BOOLEAN ioctlValid = FALSE;
+	UCHAR major = 0;
+	ULONG ioctl = 0;
+	BOOLEAN ret = TRUE;
+
+	if (ret && filter->Driver.size() > 0)
+		ret = _ObjectMatches(Context->DriverNames, Context->MatchingDrivers, (ULONG_PTR)Header->Driver, filter->Driver);
+
+	if (ret && filter->Device.size() > 0)
+		ret = _ObjectMatches(Context->DeviceNames, Context->MatchingDevices, (ULONG_PTR)Header->Device, filter->Device);
+
+	if (ret && filter->ProcessIdFiltered)
+		ret = ((ULONG)(ULONG_PTR)Header->ProcessId == filter->ProcessId);
+
+	if (ret && filter->ProcessName.size() > 0)
+		ret = (Context->MatchingProcesses.count((ULONG)(ULONG_PTR)Header->ProcessId) > 0);
+
+	if (ret && (filter->MajorFiltered || filter->IOCTLFiltered)) {
+		_RecordOperation(Header, &majorValid, &major, &ioctlValid, &ioctl);
+		if (filter->MajorFiltered)
+			ret = (majorValid && major == filter->Major);
+
+		if (ret && filter->IOCTLFiltered)
+			ret = (ioctlValid && ioctl == filter->IOCTL);
+	}
+
+	return ret;
+}
+
+
+/** Collects names of the objects and processes announced by a block. */
+static BOOLEAN _OnNameRecord(PREQUEST_HEADER Header, ULONG Size, PVOID Context)
+{
+	PANALYZE_BLOCK block = (PANALYZE_BLOCK)Context;
+	ANALYZE_NAME name;
+
+	name.Type = Header->Type;
+	switch (Header->Type) {
+		case ertDriverDetected: {
+			const REQUEST_DRIVER_DETECTED *r = CONTAINING_RECORD(Header, REQUEST_DRIVER_DETECTED, Header);
+
+			name.Key = (ULONG_PTR)Header->Driver;
+			name.Name = CaptureStringRead(r + 1, r->DriverNameLength);
+			block->Names.push_back(name);
+		} break;
+		case ertDeviceDetected: {
+			const REQUEST_DEVICE_DETECTED *r = CONTAINING_RECORD(Header, REQUEST_DEVICE_DETECTED, Header);
+
+			name.Key = (ULONG_PTR)Header->Device;
+			name.Name = CaptureStringRead(r + 1, r->DeviceNameLength);
+			block->Names.push_back(name);
+		} break;
+		case ertProcessCreated: {
+			const REQUEST_PROCESS_CREATED *r = CONTAINING_RECORD(Header, REQUEST_PROCESS_CREATED, Header);
+
+			name.Key = (ULONG)(ULONG_PTR)r->ProcessId;
+			name.Name = CaptureStringRead((const UCHAR *)r + r->ImageNameOffset, r->ImageNameLength);
+			block->Names.push_back(name);
+		} break;
+		default:
+			break;
+	}
+
+	return TRUE;
+}
+
+
+static VOID _OnNameBlock(ULONG Worker, ULONG Position, DWORD Status, const UCHAR *Data, ULONG Length, PVOID Context)
+{
+	PANALYZE_CONTEXT ctx = (PANALYZE_CONTEXT)Context;
+
+	if (Status == ERROR_SUCCESS)
+		CaptureReaderRecordsEnumerate(Data, Length, _OnNameRecord, &ctx->Blocks[Position]);
+
+	return;
+}
+
+
+/** Applies the names in the order of the blocks, so the last announcement
+ *  of an object wins. */
+static VOID _OnNameBlockCommit(ULONG Position, PVOID Context)
+{
+	PANALYZE_CONTEXT ctx = (PANALYZE_CONTEXT)Context;
+	PANALYZE_BLOCK block = &ctx->Blocks[Position];
+
+	for (auto & n : block->Names) {
+		switch (n.Type) {
+			case ertDriverDetected:
+				ctx->DriverNames[n.Key] = n.Name;
+				break;
+			case ertDeviceDetected:
+				ctx->DeviceNames[n.Key] = n.Name;
+				break;
+			case ertProcessCreated:
+				ctx->ProcessNames[(ULONG)n.Key] = n.Name;
+				break;
+			default:
+				break;
+		}
+	}
+
+	block->Names.clear();
+	block->Names.shrink_to_fit();
+
+	return;
+}
+
+
+/** Reads the names announced by the records. Only the blocks containing the
+ *  DriverDetected, DeviceDetected and ProcessCreated records (according to
+ *  their index entries) are decompressed.
+ */
+static VOID _NamesRead(PANALYZE_CONTEXT Context, ULONG ThreadCount)
+{
+	PCAPTURE_READER reader = Context->Reader;
+
+	Context->BlockIndices.clear();
+	for (ULONG i = 0; i < reader->Blocks.size(); ++i) {
+		const CAPTURE_BLOCK_INDEX *b = &reader->Blocks[i];
+
+		if (b->TypeCounts[ertDriverDetected] > 0 || b->TypeCounts[ertDeviceDetected] > 0 || b->TypeCounts[ertProcessCreated] > 0)
+			Context->BlockIndices.push_back(i);
+	}
+
+	Context->Blocks.clear();
+	Context->Blocks.resize(Context->BlockIndices.size());
+	CaptureReaderBlocksProcess(reader, Context->BlockIndices, ThreadCount, _OnNameBlock, _OnNameBlockCommit, Context);
+	Context->Blocks.clear();
+
+	return;
+}
+
+
+/** Finds the named objects and processes passing the name filters. */
+static VOID _NameFiltersPrepare(PANALYZE_CONTEXT Context)
+{
+	const ANALYZE_FILTER *filter = Context->Filter;
+
+	if (filter->Driver.size() > 0) {
+		for (auto & e : Context->DriverNames) {
+			if (_Contains(e.second, filter->Driver))
+				Context->MatchingDrivers.insert(e.first);
+		}
+	}
+
+	if (filter->Device.size() > 0) {
+		for (auto & e : Context->DeviceNames) {
+			if (_Contains(e.second, filter->Device))
+				Context->MatchingDevices.insert(e.first);
+		}
+	}
+
+	if (filter->ProcessName.size() > 0) {
+		for (auto & e : Context->ProcessNames) {
+			if (_Contains(e.second, filter->ProcessName))
+				Context->MatchingProcesses.insert(e.first);
+		}
+	}
+
+	return;
+}
+
+
+static VOID _Append(std::string & Buffer, const char *Format, ...)
+{
+	va_list args;
+	size_t offset = Buffer.size();
+	int len = 0;
+
+	va_start(args, Format);
+	Buffer.resize(offset + 128);
+	len = vsnprintf(&Buffer[offset], 128, Format, args);
+	va_end(args);
+	if (len >= 128) {
+		Buffer.resize(offset + len + 1);
+		va_start(args, Format);
+		vsnprintf(&Buffer[offset], len + 1, Format, args);
+		va_end(args);
+	}
+
+	Buffer.resize(offset + ((len > 0) ? len : 0));
+
+	return;
+}
+
+
+/** Appends the printed form of a record to a listing. The Format buffer
+    receives the request details before they are copied to the listing. */
+static VOID _RecordFormat(PANALYZE_CONTEXT Context, PREQUEST_HEADER Header, ULONG Sequence, PREQUEST_FORMAT_BUFFER Format, PANALYZE_LISTING Listing)
+{
+	std::string & t = Listing->Text;
+
+	switch (Header->Type) {
+		case ertIRP:
+			_Append(t, "IRP: ");
+			break;
+		case ertIRPCompletion:
+			_Append(t, "IRPCOMPLETE: ");
+			break;
+		case ertFastIo:
+			_Append(t, "FASTIO: ");
+			break;
+		case ertAddDevice:
+			_Append(t, "ADDDEVICE: ");
+			break;
+		case ertStartIo:
+			_Append(t, "STARTIO: ");
+			break;
+		case ertDriverUnload:
+			_Append(t, "UNLOAD: ");
+			break;
+		case ertDriverDetected:
+			_Append(t, "DRIVERDETECTED: ");
+			break;
+		case ertDeviceDetected:
+			_Append(t, "DEVICEDETECTED: ");
+			break;
+		case ertProcessCreated:
+			_Append(t, "PROCESSCREATED: ");
+			break;
+		case ertProcessExitted:
+			_Append(t, "PROCESSEXITTED: ");
+			break;
+		default:
+			_Append(t, "UNKNOWN (%u): ", Header->Type);
+			break;
+	}
+
+	_Append(t, "%ls: %ls\n", _NameGet(Context->DriverNames, (ULONG_PTR)Header->Driver).c_str(), _NameGet(Context->DeviceNames, (ULONG_PTR)Header->Device).c_str());
+	_Append(t, "  ID: %u\n", Header->Id);
+	_Append(t, "  Time: %lld\n", (long long)Header->Time.QuadPart);
+	_Append(t, "  Process ID: %u\n", (ULONG)(ULONG_PTR)Header->ProcessId);
+
+	Format->Length = 0;
+	if (RequestFormatDetails(Format, Header) == ERROR_SUCCESS)
+		t.append(Format->Data, Format->Length);
+
+	Listing->Entries.push_back(std::make_pair(Sequence, t.size()));
+
+	return;
+}
+
+
+/** Writes two listings of a block to the standard output, ordered by the
+ *  sequence numbers of their records. */
+static VOID _ListingMerge(const ANALYZE_LISTING *First, const ANALYZE_LISTING *Second)
+{
+	const ANALYZE_LISTING *listings[2] = { First, Second };
+	size_t indices[2] = { 0, 0 };
+
+	for (;;) {
+		const ANALYZE_LISTING *l = NULL;
+		size_t *index = NULL;
+		size_t start = 0;
+
+		for (ULONG i = 0; i < 2; ++i) {
+			if (indices[i] < listings[i]->Entries.size() &&
+				(l == NULL || listings[i]->Entries[indices[i]].first < l->Entries[*index].first)) {
+				l = listings[i];
+				index = indices + i;
+			}
+		}
+
+		if (l == NULL)
+			break;
+
+		start = (*index > 0) ? l->Entries[*index - 1].second : 0;
+		fwrite(l->Text.data() + start, 1, l->Entries[*index].second - start, stdout);
+		++*index;
+	}
+
+	return;
+}
+
+
+/** Updates statistics by a record that passed the filters other than the
+ *  status one.
+ *
+ *  @return
+ *  Returns TRUE if the record passes the status filter as well.
+ */
+static BOOLEAN _RecordAccount(PANALYZE_CONTEXT Context, PANALYZE_STATS Stats, const REQUEST_HEADER *Header, BOOLEAN LatencyValid, ULONG64 LatencyDevice, ULONG64 Latency)
+{
+	ULONG status = 0;
+	BOOLEAN statusValid = FALSE;
+	BOOLEAN majorValid = FALSE;
+	BOOLEAN ioctlValid = FALSE;
+	UCHAR major = 0;
+	ULONG ioctl = 0;
+	BOOLEAN ret = TRUE;
+
+	statusValid = _RecordStatus(Header, &status);
+	if (Context->Filter->StatusFiltered)
+		ret = (statusValid && status == Context->Filter->Status);
+
+	if (ret) {
+		if (Stats->MatchCount == 0 || Header->Time.QuadPart < Stats->FirstTime)
+			Stats->FirstTime = Header->Time.QuadPart;
+
+		if (Stats->MatchCount == 0 || Header->Time.QuadPart > Stats->LastTime)
+			Stats->LastTime = Header->Time.QuadPart;
+
+		++Stats->MatchCount;
+		++Stats->TypeCounts[((ULONG)Header->Type < CAPTURE_TYPE_COUNT) ? Header->Type : erpUndefined];
+		++Stats->Drivers[(ULONG_PTR)Header->Driver];
+		++Stats->Devices[(ULONG_PTR)Header->Device];
+		++Stats->Processes[(ULONG)(ULONG_PTR)Header->ProcessId];
+		_RecordOperation(Header, &majorValid, &major, &ioctlValid, &ioctl);
+		if (majorValid)
+			++Stats->Majors[major];
+
+		if (ioctlValid)
+			++Stats->IOCTLs[ioctl];
+
+		if (statusValid)
+			++Stats->Statuses[status];
+
+		if (LatencyValid)
+			_LatencyAdd(&Stats->Latencies[LatencyDevice], Latency);
+	}
+
+	return ret;
+}
+
+
+/** Processes a record on a worker thread. IRPs are paired with completions
+ *  within the block; completions whose IRP is not in the block are left for
+ *  the commit of the block.
+ */
+static BOOLEAN _OnRecord(PREQUEST_HEADER Header, ULONG Size, PVOID Context)
+{
+	PANALYZE_BLOCK_CONTEXT ctx = (PANALYZE_BLOCK_CONTEXT)Context;
+	PANALYZE_BLOCK block = ctx->Block;
+	ULONG sequence = ctx->Sequence++;
+	BOOLEAN matched = FALSE;
+	BOOLEAN latencyValid = FALSE;
+	ULONG64 latencyDevice = 0;
+	ULONG64 latency = 0;
+
+	++ctx->Stats->RecordCount;
+	switch (Header->Type) {
+		case ertIRP: {
+			PREQUEST_IRP r = CONTAINING_RECORD(Header, REQUEST_IRP, Header);
+			PENDING_IRP pending;
+
+			matched = _RecordMatches(ctx->Analyze, Header);
+			pending.Time = Header->Time.QuadPart;
+			pending.Device = (ULONG_PTR)Header->Device;
+			pending.Matched = matched;
+			pending.Pending = TRUE;
+			block->IRPs[(ULONG_PTR)r->IRPAddress] = pending;
+		} break;
+		case ertIRPCompletion: {
+			PREQUEST_IRP_COMPLETION c = CONTAINING_RECORD(Header, REQUEST_IRP_COMPLETION, Header);
+			auto it = block->IRPs.find((ULONG_PTR)c->IRPAddress);
+
+			if (it == block->IRPs.end()) {
+				ORPHAN_COMPLETION orphan;
+
+				orphan.Sequence = sequence;
+				orphan.Record.assign((const UCHAR *)Header, (const UCHAR *)Header + Size);
+				block->Orphans.push_back(std::move(orphan));
+				return TRUE;
+			}
+
+			if (it->second.Pending) {
+				it->second.Pending = FALSE;
+				matched = it->second.Matched;
+				latencyValid = (Header->Time.QuadPart >= it->second.Time);
+				latencyDevice = it->second.Device;
+				latency = Header->Time.QuadPart - it->second.Time;
+			} else matched = _RecordMatches(ctx->Analyze, Header);
+		} break;
+		default:
+			matched = _RecordMatches(ctx->Analyze, Header);
+			break;
+	}
+
+	if (matched)
+		matched = _RecordAccount(ctx->Analyze, ctx->Stats, Header, latencyValid, latencyDevice, latency);
+
+	if (matched && ctx->Analyze->List)
+		_RecordFormat(ctx->Analyze, Header, sequence, ctx->Format, &block->Listing);
+
+	return TRUE;
+}
+
+
+static VOID _OnBlock(ULONG Worker, ULONG Position, DWORD Status, const UCHAR *Data, ULONG Length, PVOID Context)
+{
+	ANALYZE_BLOCK_CONTEXT ctx;
+
+	ctx.Analyze = (PANALYZE_CONTEXT)Context;
+	ctx.Stats = &ctx.Analyze->Workers[Worker];
+	ctx.Format = &ctx.Analyze->WorkerFormats[Worker];
+	ctx.Block = &ctx.Analyze->Blocks[Position];
+	ctx.Sequence = 0;
+	if (Status == ERROR_SUCCESS)
+		Status = CaptureReaderRecordsEnumerate(Data, Length, _OnRecord, &ctx);
+
+	ctx.Block->Status = Status;
+
+	return;
+}
+
+
+/** Pairs the orphan completions of a block with the IRPs pending at the end
+ *  of the preceding blocks, passes the IRPs still pending to the following
+ *  blocks and writes the listing of the block.
+ */
+static VOID _OnBlockCommit(ULONG Position, PVOID Context)
+{
+	PANALYZE_CONTEXT ctx = (PANALYZE_CONTEXT)Context;
+	PANALYZE_BLOCK block = &ctx->Blocks[Position];
+	ANALYZE_LISTING orphanListing;
+
+	for (auto & o : block->Orphans) {
+		PREQUEST_HEADER h = (PREQUEST_HEADER)o.Record.data();
+		PREQUEST_IRP_COMPLETION c = CONTAINING_RECORD(h, REQUEST_IRP_COMPLETION, Header);
+		auto it = ctx->PendingIRPs.find((ULONG_PTR)c->IRPAddress);
+		BOOLEAN matched = FALSE;
+		BOOLEAN latencyValid = FALSE;
+		ULONG64 latencyDevice = 0;
+		ULONG64 latency = 0;
+
+		if (it != ctx->PendingIRPs.end()) {
+			matched = it->second.Matched;
+			latencyValid = (h->Time.QuadPart >= it->second.Time);
+			latencyDevice = it->second.Device;
+			latency = h->Time.QuadPart - it->second.Time;
+			ctx->PendingIRPs.erase(it);
+		} else matched = _RecordMatches(ctx, h);
+
+		if (matched)
+			matched = _RecordAccount(ctx, &ctx->CommitStats, h, latencyValid, latencyDevice, latency);
+
+		if (matched && ctx->List)
+			_RecordFormat(ctx, h, o.Sequence, &ctx->CommitFormat, &orphanListing);
+	}
+
+	for (auto & e : block->IRPs) {
+		if (e.second.Pending)
+			ctx->PendingIRPs[e.first] = e.second;
+		else ctx->PendingIRPs.erase(e.first);
+	}
+
+	if (ctx->List)
+		_ListingMerge(&block->Listing, &orphanListing);
+
+	if (block->Status != ERROR_SUCCESS) {
+		if (ctx->List)
+			fflush(stdout);
+
+		fprintf(stderr, "ERROR: Block %u at offset %llu is damaged: %u\n", ctx->BlockIndices[Position], (unsigned long long)ctx->Reader->Blocks[ctx->BlockIndices[Position]].Offset, block->Status);
+	}
+
+	*block = ANALYZE_BLOCK();
+
+	return;
+}
+
+
+template <typename TKey, typename TValue>
+static VOID _MapMerge(std::map<TKey, TValue> & Target, const std::map<TKey, TValue> & Source)
+{
+	for (auto & e : Source)
+		Target[e.first] += e.second;
+
+	return;
+}
+
+
+static VOID _StatsMerge(PANALYZE_STATS Target, const ANALYZE_STATS *Source)
+{
+	Target->RecordCount += Source->RecordCount;
+	if (Source->MatchCount > 0) {
+		if (Target->MatchCount == 0 || Source->FirstTime < Target->FirstTime)
+			Target->FirstTime = Source->FirstTime;
+
+		if (Target->MatchCount == 0 || Source->LastTime > Target->LastTime)
+			Target->LastTime = Source->LastTime;
+
+		Target->MatchCount += Source->MatchCount;
+	}
+
+	for (ULONG i = 0; i < CAPTURE_TYPE_COUNT; ++i)
+		Target->TypeCounts[i] += Source->TypeCounts[i];
+
+	_MapMerge(Target->Drivers, Source->Drivers);
+	_MapMerge(Target->Devices, Source->Devices);
+	_MapMerge(Target->Processes, Source->Processes);
+	_MapMerge(Target->Majors, Source->Majors);
+	_MapMerge(Target->IOCTLs, Source->IOCTLs);
+	_MapMerge(Target->Statuses, Source->Statuses);
+	for (auto & e : Source->Latencies) {
+		PLATENCY_HISTOGRAM h = &Target->Latencies[e.first];
+
+		for (ULONG i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+			h->Buckets[i] += e.second.Buckets[i];
+
+		h->Count += e.second.Count;
+		h->Sum += e.second.Sum;
+		if (h->Max < e.second.Max)
+			h->Max = e.second.Max;
+	}
+
+	return;
+}
+
+
+template <typename TKey>
+static std::vector<std::pair<TKey, ULONG64>> _TopN(const std::map<TKey, ULONG64> & Counts, ULONG Count)
+{
+	std::vector<std::pair<TKey, ULONG64>> ret(Counts.cbegin(), Counts.cend());
+
+	std::stable_sort(ret.begin(), ret.end(), [](const std::pair<TKey, ULONG64> & a, const std::pair<TKey, ULONG64> & b) { return a.second > b.second; });
+	if (ret.size() > Count)
+		ret.resize(Count);
+
+	return ret;
+}
+
+
+static std::wstring _TimeToString(LONG64 Time)
+{
+	WCHAR buf[64];
+	time_t seconds = 0;
+	struct tm t;
+	std::wstring ret;
+
+	if (Time >= (LONG64)FILETIME_UNIX_EPOCH) {
+		seconds = (time_t)((Time - FILETIME_UNIX_EPOCH) / 10000000);
+		gmtime_r(&seconds, &t);
+		swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%04u-%02u-%02u %02u:%02u:%02u.%07u UTC", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, (ULONG)((Time - FILETIME_UNIX_EPOCH) % 10000000));
+		ret = buf;
+	} else ret = std::to_wstring(Time);
+
+	return ret;
+}
+
+
+static VOID _SummaryPrint(PANALYZE_CONTEXT Context, PANALYZE_STATS Stats, ULONG Top)
+{
+	const wchar_t *typeNames[] = {
+		L"Undefined", L"IRP", L"IRP completion", L"AddDevice", L"Driver unload", L"Fast I/O",
+		L"StartIo", L"Driver detected", L"Device detected", L"Process created", L"Process exitted",
+	};
+
+	printf("Records:          %llu\n", (unsigned long long)Stats->RecordCount);
+	printf("Matching records: %llu\n", (unsigned long long)Stats->MatchCount);
+	if (Stats->MatchCount > 0) {
+		printf("First record:     %ls\n", _TimeToString(Stats->FirstTime).c_str());
+		printf("Last record:      %ls\n", _TimeToString(Stats->LastTime).c_str());
+	}
+
+	printf("\nRecord types\n");
+	for (ULONG i = 0; i < CAPTURE_TYPE_COUNT; ++i) {
+		if (Stats->TypeCounts[i] > 0)
+			printf("  %-20ls %llu\n", (i < sizeof(typeNames) / sizeof(typeNames[0])) ? typeNames[i] : L"Unknown", (unsigned long long)Stats->TypeCounts[i]);
+	}
+
+	printf("\nTop drivers\n");
+	for (auto & e : _TopN(Stats->Drivers, Top))
+		printf("  %12llu  %ls\n", (unsigned long long)e.second, _NameGet(Context->DriverNames, e.first).c_str());
+
+	printf("\nTop devices\n");
+	for (auto & e : _TopN(Stats->Devices, Top))
+		printf("  %12llu  %ls\n", (unsigned long long)e.second, _NameGet(Context->DeviceNames, e.first).c_str());
+
+	printf("\nTop processes\n");
+	for (auto & e : _TopN(Stats->Processes, Top)) {
+		auto it = Context->ProcessNames.find(e.first);
+
+		printf("  %12llu  %u", (unsigned long long)e.second, e.first);
+		if (it != Context->ProcessNames.end())
+			printf(" (%ls)", it->second.c_str());
+
+		printf("\n");
+	}
+
+	printf("\nTop major functions\n");
+	for (auto & e : _TopN(Stats->Majors, Top))
+		printf("  %12llu  %ls\n", (unsigned long long)e.second, LibTranslateGeneralIntegerValueToString(ltivtFileIRPMajorFunction, FALSE, e.first));
+
+	printf("\nTop IOCTLs\n");
+	for (auto & e : _TopN(Stats->IOCTLs, Top))
+		printf("  %12llu  %ls (0x%x)\n", (unsigned long long)e.second, LibTranslateGeneralIntegerValueToString(ltivtDeviceControl, FALSE, e.first), e.first);
+
+	printf("\nTop statuses\n");
+	for (auto & e : _TopN(Stats->Statuses, Top))
+		printf("  %12llu  %ls (0x%x)\n", (unsigned long long)e.second, LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, e.first), e.first);
+
+	std::map<ULONG64, ULONG64> latencyCounts;
+	for (auto & e : Stats->Latencies)
+		latencyCounts[e.first] = e.second.Count;
+
+	printf("\nIRP latency per device (microseconds)\n");
+	printf("  %12s %10s %10s %10s %10s %10s %10s  %s\n", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max", "Device");
+	for (auto & e : _TopN(latencyCounts, Top)) {
+		const LATENCY_HISTOGRAM *h = &Stats->Latencies[e.first];
+
+		printf("  %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f  %ls\n",
+			(unsigned long long)h->Count, h->Sum / 10.0 / h->Count,
+			_LatencyPercentile(h, 50) / 10.0, _LatencyPercentile(h, 90) / 10.0,
+			_LatencyPercentile(h, 99) / 10.0, _LatencyPercentile(h, 99.9) / 10.0,
+			h->Max / 10.0, _NameGet(Context->DeviceNames, e.first).c_str());
+	}
+
+	return;
+}
+
+
+/** Finds a major function by its number or name (with or without the IRP_MJ_
+ *  prefix). */
+static BOOLEAN _MajorParse(const char *String, PUCHAR Major)
+{
+	char *end = NULL;
+	ULONG value = 0;
+	std::wstring name;
+	BOOLEAN ret = FALSE;
+
+	value = strtoul(String, &end, 0);
+	ret = (*String != '\0' && *end == '\0' && value <= IRP_MJ_MAXIMUM_FUNCTION);
+	if (ret)
+		*Major = (UCHAR)value;
+
+	if (!ret) {
+		for (const char *s = String; *s != '\0'; ++s)
+			name.push_back(towupper((UCHAR)*s));
+
+		if (name.compare(0, 7, L"IRP_MJ_") != 0)
+			name = L"IRP_MJ_" + name;
+
+		for (ULONG i = 0; i <= IRP_MJ_MAXIMUM_FUNCTION; ++i) {
+			ret = (name == LibTranslateGeneralIntegerValueToString(ltivtFileIRPMajorFunction, FALSE, i));
+			if (ret) {
+				*Major = (UCHAR)i;
+				break;
+			}
+		}
+	}
+
+	return ret;
+}
+
+
+static BOOLEAN _NumberParse(const char *String, PULONG Value)
+{
+	char *end = NULL;
+	BOOLEAN ret = FALSE;
+
+	*Value = (ULONG)strtoul(String, &end, 0);
+	ret = (*String != '\0' && *end == '\0');
+
+	return ret;
+}
+
+
+static std::wstring _ArgumentToLower(const char *String)
+{
+	std::wstring ret;
+	size_t len = mbstowcs(NULL, String, 0);
+
+	if (len != (size_t)-1) {
+		ret.resize(len);
+		mbstowcs(&ret[0], String, len);
+	} else {
+		for (const char *s = String; *s != '\0'; ++s)
+			ret.push_back((UCHAR)*s);
+	}
+
+	return _ToLower(ret);
+}
+
+
+/** Options followed by a value. */
+static const char *_valueOptions[] = {
+	"--driver",
+	"--device",
+	"--process",
+	"--major",
+	"--ioctl",
+	"--status",
+	"--top",
+	"--threads",
+};
+
+
+static BOOLEAN _OptionTakesValue(const char *Option)
+{
+	BOOLEAN ret = FALSE;
+
+	for (size_t i = 0; i < sizeof(_valueOptions) / sizeof(_valueOptions[0]); ++i) {
+		ret = (strcmp(Option, _valueOptions[i]) == 0);
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+
+static VOID _Usage(VOID)
+{
+	printf("Usage: irpmon-analyze [options] <capture file>\n");
+	printf("Options:\n");
+	printf("  --driver <name>       records of drivers whose name contains the string\n");
+	printf("  --device <name>       records of devices whose name contains the string\n");
+	printf("  --process <pid|name>  records of a process given by ID or image name\n");
+	printf("  --major <major>       IRPs of a major function (number or IRP_MJ_XXX name)\n");
+	printf("  --ioctl <code>        device control requests with a control code\n");
+	printf("  --status <status>     records reporting a status, completions for IRPs\n");
+	printf("  --top <N>             length of the summaries (default %u)\n", ANALYZE_TOP_DEFAULT);
+	printf("  --threads <N>         number of decoding threads (default: one per CPU)\n");
+	printf("  --list                print the matching records\n");
+	printf("  --help, -h            print this help\n");
+	printf("IRP completions match the filters other than --status if their IRP does.\n");
+
+	return;
+}
+
+
+/************************************************************************/
+/*                               MAIN FUNCTIONS                         */
+/************************************************************************/
+
+int main(int argc, char *argv[])
+{
+	ANALYZE_FILTER filter;
+	ANALYZE_CONTEXT *context = NULL;
+	PCAPTURE_READER reader = NULL;
+	const char *fileName = NULL;
+	ULONG top = ANALYZE_TOP_DEFAULT;
+	ULONG threadCount = 0;
+	BOOLEAN list = FALSE;
+	BOOLEAN help = FALSE;
+	DWORD ret = ERROR_SUCCESS;
+
+	setlocale(LC_ALL, "");
+	filter.ProcessIdFiltered = FALSE;
+	filter.ProcessId = 0;
+	filter.MajorFiltered = FALSE;
+	filter.Major = 0;
+	filter.IOCTLFiltered = FALSE;
+	filter.IOCTL = 0;
+	filter.StatusFiltered = FALSE;
+	filter.Status = 0;
+	// Names of major functions are resolved by the translation library.
+	ret = LibTranslateInitialize();
+	if (ret != ERROR_SUCCESS) {
+		fprintf(stderr, "ERROR: Unable to initialize the translation library: %u\n", ret);
+		return ret;
+	}
+
+	for (int i = 1; ret == ERROR_SUCCESS && i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--list") == 0) {
+			list = TRUE;
+			continue;
+		}
+
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+			help = TRUE;
+			break;
+		}
+
+		if (strncmp(arg, "--", 2) != 0) {
+			if (fileName == NULL) {
+				fileName = arg;
+				continue;
+			}
+
+			ret = ERROR_INVALID_PARAMETER;
+			break;
+		}
+
+		if (!_OptionTakesValue(arg)) {
+			fprintf(stderr, "ERROR: Unknown option %s\n", arg);
+			ret = ERROR_INVALID_PARAMETER;
+			break;
+		}
+
+		if (value == NULL) {
+			fprintf(stderr, "ERROR: Missing value of %s\n", arg);
+			ret = ERROR_INVALID_PARAMETER;
+			break;
+		}
+
+		++i;
+		if (strcmp(arg, "--driver") == 0)
+			filter.Driver = _ArgumentToLower(value);
+		else if (strcmp(arg, "--device") == 0)
+			filter.Device = _ArgumentToLower(value);
+		else if (strcmp(arg, "--process") == 0) {
+			filter.ProcessIdFiltered = _NumberParse(value, &filter.ProcessId);
+			if (!filter.ProcessIdFiltered)
+				filter.ProcessName = _ArgumentToLower(value);
+		} else if (strcmp(arg, "--major") == 0) {
+			filter.MajorFiltered = TRUE;
+			if (!_MajorParse(value, &filter.Major))
+				ret = ERROR_INVALID_PARAMETER;
+		} else if (strcmp(arg, "--ioctl") == 0) {
+			filter.IOCTLFiltered = TRUE;
+			if (!_NumberParse(value, &filter.IOCTL))
+				ret = ERROR_INVALID_PARAMETER;
+		} else if (strcmp(arg, "--status") == 0) {
+			filter.StatusFiltered = TRUE;
+			if (!_NumberParse(value, &filter.Status))
+				ret = ERROR_INVALID_PARAMETER;
+		} else if (strcmp(arg, "--top") == 0) {
+			if (!_NumberParse(value, &top))
+				ret = ERROR_INVALID_PARAMETER;
+		} else if (strcmp(arg, "--threads") == 0) {
+			if (!_NumberParse(value, &threadCount))
+				ret = ERROR_INVALID_PARAMETER;
+		}
+
+		if (ret != ERROR_SUCCESS)
+			fprintf(stderr, "ERROR: Invalid value of %s: %s\n", arg, value);
+	}
+
+	if (ret == ERROR_SUCCESS && fileName == NULL && !help)
+		ret = ERROR_INVALID_PARAMETER;
+
+	if (ret == ERROR_SUCCESS && !help) {
+		ret = CaptureReaderOpen(fileName, &reader);
+		if (ret == ERROR_SUCCESS) {
+			ANALYZE_STATS stats;
+
+			if (threadCount == 0)
+				threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+
+			context = new ANALYZE_CONTEXT();
+			context->Filter = &filter;
+			context->List = list;
+			context->Reader = reader;
+			context->Workers.resize(threadCount);
+			context->WorkerFormats.resize(threadCount);
+			for (auto & f : context->WorkerFormats)
+				RequestFormatBufferInit(&f);
+
+			RequestFormatBufferInit(&context->CommitFormat);
+			for (auto & d : reader->Drivers) {
+				context->DriverNames[d.DriverObject] = d.Name;
+				for (auto & v : d.Devices)
+					context->DeviceNames[v.DeviceObject] = v.Name;
+			}
+
+			printf("Capture:          %s\n", fileName);
+			printf("Started:          %ls\n", _TimeToString(reader->Header->StartTime).c_str());
+			printf("Blocks:           %u%s\n", (ULONG)reader->Blocks.size(), (reader->Complete) ? "" : " (the capture was not closed)");
+			printf("\n");
+			_NamesRead(context, threadCount);
+			_NameFiltersPrepare(context);
+			context->BlockIndices.resize(reader->Blocks.size());
+			for (ULONG i = 0; i < reader->Blocks.size(); ++i)
+				context->BlockIndices[i] = i;
+
+			context->Blocks.resize(reader->Blocks.size());
+			CaptureReaderBlocksProcess(reader, context->BlockIndices, threadCount, _OnBlock, _OnBlockCommit, context);
+			if (list)
+				fflush(stdout);
+
+			stats = context->CommitStats;
+			for (auto & w : context->Workers)
+				_StatsMerge(&stats, &w);
+
+			_SummaryPrint(context, &stats, top);
+			for (auto & f : context->WorkerFormats)
+				RequestFormatBufferFree(&f);
+
+			RequestFormatBufferFree(&context->CommitFormat);
+			delete context;
+			CaptureReaderClose(reader);
+		} else fprintf(stderr, "ERROR: Unable to open the capture \"%s\": %u\n", fileName, ret);
+	} else _Usage();
+
+	LibTranslateFinalize();
+
+	return ret;
+}
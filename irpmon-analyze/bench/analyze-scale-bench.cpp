@@ -0,0 +1,386 @@
+/**
+ * @file
+ *
+ * Measures how the analysis of a capture scales with the number of decoding
+ * threads. A synthetic capture is written to a temporary file (LZ4 blocks
+ * with IRPs of several drivers, devices and processes, completions following
+ * their IRPs with a delay, so some of them land in the next block), and
+ * irpmon-analyze is run on it with --threads 1, 2, 4, 8 and 16. Every run
+ * must print the same summary as the single-threaded one.
+ *
+ * Usage: analyze-scale-bench [record count] [path of irpmon-analyze]
+ *
+ * The speedups are bounded by the number of CPUs available, which is printed
+ * with the results; thread counts above it only measure the overhead of the
+ * additional workers.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "general-types.h"
+#include "capture-format.h"
+#include "lz4-block.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+#define BENCH_DRIVERS            16
+#define BENCH_DEVICES            4
+#define BENCH_PROCESSES          50
+#define BENCH_BLOCK_LENGTH       (1024*1024)
+/** Number of IRPs waiting for their completions. */
+#define BENCH_PENDING            64
+#define BENCH_RUNS               3
+
+typedef struct _BENCH_CAPTURE {
+   int File;
+   ULONG64 Offset;
+   std::vector<UCHAR> Block;
+   std::vector<UCHAR> Compressed;
+   CAPTURE_BLOCK_INDEX Index;
+   std::vector<CAPTURE_BLOCK_INDEX> Blocks;
+   ULONG64 Length;
+} BENCH_CAPTURE, *PBENCH_CAPTURE;
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static VOID _Write(PBENCH_CAPTURE Capture, const void *Data, ULONG Length)
+{
+   if (write(Capture->File, Data, Length) != (ssize_t)Length) {
+      perror("write");
+      exit(1);
+   }
+
+   Capture->Offset += Length;
+
+   return;
+}
+
+
+static VOID _BlockFlush(PBENCH_CAPTURE Capture)
+{
+   ULONG compressedLength = 0;
+   CAPTURE_BLOCK_HEADER header;
+
+   if (Capture->Index.RecordCount == 0)
+      return;
+
+   Capture->Compressed.resize(CaptureAlign(LZ4BlockCompressBound(Capture->Index.Length)));
+   memset(&header, 0, sizeof(header));
+   header.Signature = CAPTURE_BLOCK_SIGNATURE;
+   header.Index = Capture->Index;
+   header.Index.Offset = Capture->Offset;
+   header.Index.Compression = ccLZ4;
+   if (LZ4BlockCompress(Capture->Block.data(), Capture->Index.Length, Capture->Compressed.data(), (ULONG)Capture->Compressed.size(), &compressedLength) != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot compress a block\n");
+      exit(1);
+   }
+
+   header.Index.CompressedLength = compressedLength;
+   memset(Capture->Compressed.data() + compressedLength, 0, CaptureAlign(compressedLength) - compressedLength);
+   _Write(Capture, &header, sizeof(header));
+   _Write(Capture, Capture->Compressed.data(), (ULONG)CaptureAlign(compressedLength));
+   Capture->Blocks.push_back(header.Index);
+   Capture->Length += Capture->Index.Length;
+   memset(&Capture->Index, 0, sizeof(Capture->Index));
+   Capture->Block.clear();
+
+   return;
+}
+
+
+static VOID _RecordAppend(PBENCH_CAPTURE Capture, PREQUEST_HEADER Header, ULONG Size)
+{
+   ULONG entryLength = (ULONG)CaptureAlign(sizeof(CAPTURE_RECORD_ENTRY) + Size);
+   CAPTURE_RECORD_ENTRY entry;
+
+   if (Capture->Index.Length + entryLength > BENCH_BLOCK_LENGTH)
+      _BlockFlush(Capture);
+
+   if (Capture->Index.RecordCount == 0) {
+      Capture->Index.FirstId = Header->Id;
+      Capture->Index.FirstTime = Header->Time.QuadPart;
+   }
+
+   Capture->Index.LastId = Header->Id;
+   Capture->Index.LastTime = Header->Time.QuadPart;
+   ++Capture->Index.RecordCount;
+   ++Capture->Index.TypeCounts[Header->Type];
+   Capture->Block.resize(Capture->Index.Length + entryLength);
+   entry.Size = Size;
+   entry.Reserved = 0;
+   memcpy(&Capture->Block[Capture->Index.Length], &entry, sizeof(entry));
+   memcpy(&Capture->Block[Capture->Index.Length + sizeof(entry)], Header, Size);
+   Capture->Index.Length += entryLength;
+
+   return;
+}
+
+
+/** Appends a snapshot entry followed by its name, stored as UTF-16. */
+static VOID _SnapshotAppend(std::vector<UCHAR> & Header, const void *Entry, ULONG EntryLength, const char *Name)
+{
+   size_t offset = Header.size();
+   size_t nameLength = strlen(Name);
+
+   Header.resize(offset + CaptureAlign(EntryLength + nameLength*sizeof(USHORT)));
+   memcpy(&Header[offset], Entry, EntryLength);
+   for (size_t i = 0; i < nameLength; ++i) {
+      Header[offset + EntryLength + 2*i] = (UCHAR)Name[i];
+      Header[offset + EntryLength + 2*i + 1] = 0;
+   }
+
+   return;
+}
+
+
+static VOID _HeaderWrite(PBENCH_CAPTURE Capture)
+{
+   char name[64];
+   std::vector<UCHAR> header;
+   PCAPTURE_FILE_HEADER fileHeader = NULL;
+
+   header.resize(sizeof(CAPTURE_FILE_HEADER));
+   for (ULONG i = 0; i < BENCH_DRIVERS; ++i) {
+      CAPTURE_SNAPSHOT_DRIVER driver;
+
+      snprintf(name, sizeof(name), "\\Driver\\Bench%u", i);
+      driver.DriverObject = 0x10000 + i*0x1000;
+      driver.DeviceCount = BENCH_DEVICES;
+      driver.NameLength = (ULONG)(strlen(name)*sizeof(USHORT));
+      _SnapshotAppend(header, &driver, sizeof(driver), name);
+      for (ULONG j = 0; j < BENCH_DEVICES; ++j) {
+         CAPTURE_SNAPSHOT_DEVICE device;
+
+         snprintf(name, sizeof(name), "\\Device\\Bench%u_%u", i, j);
+         device.DeviceObject = driver.DriverObject + (j + 1)*0x100;
+         device.AttachedDevice = 0;
+         device.NameLength = (ULONG)(strlen(name)*sizeof(USHORT));
+         device.Reserved = 0;
+         _SnapshotAppend(header, &device, sizeof(device), name);
+      }
+   }
+
+   fileHeader = (PCAPTURE_FILE_HEADER)header.data();
+   fileHeader->Signature = CAPTURE_FILE_SIGNATURE;
+   fileHeader->Version = CAPTURE_FILE_VERSION;
+   fileHeader->HeaderLength = (ULONG)header.size();
+   fileHeader->PointerSize = sizeof(PVOID);
+   fileHeader->StartTime = 132000000000000000ULL;
+   fileHeader->MaxBlockLength = BENCH_BLOCK_LENGTH;
+   fileHeader->DriverCount = BENCH_DRIVERS;
+   _Write(Capture, header.data(), (ULONG)header.size());
+
+   return;
+}
+
+
+/** Writes a capture of a given number of records, half of them IRPs and half
+ *  their completions.
+ *
+ *  @return
+ *  Returns the length of the decompressed block data, in bytes.
+ */
+static ULONG64 _CaptureWrite(const char *FileName, ULONG RecordCount)
+{
+   ULONG id = 0;
+   ULONG seed = 1;
+   LONG64 time = 132000000000000000LL;
+   REQUEST_IRP irp;
+   REQUEST_IRP_COMPLETION completion;
+   REQUEST_IRP pending[BENCH_PENDING];
+   CAPTURE_FILE_TRAILER trailer;
+   BENCH_CAPTURE capture;
+   static const UCHAR majors[] = {0x3, 0x4, 0xe, 0x0, 0x2, 0x1b};
+
+   capture.File = open(FileName, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (capture.File == -1) {
+      perror(FileName);
+      exit(1);
+   }
+
+   capture.Offset = 0;
+   capture.Length = 0;
+   memset(&capture.Index, 0, sizeof(capture.Index));
+   _HeaderWrite(&capture);
+   memset(pending, 0, sizeof(pending));
+   while (id < RecordCount) {
+      ULONG driver = 0;
+      ULONG slot = 0;
+
+      seed = seed*1103515245 + 12345;
+      driver = (seed >> 8) % BENCH_DRIVERS;
+      slot = (seed >> 4) % BENCH_PENDING;
+      time += (seed >> 20) % 50;
+      // Complete the IRP occupying the slot.
+      if (pending[slot].IRPAddress != NULL) {
+         memset(&completion, 0, sizeof(completion));
+         completion.Header = pending[slot].Header;
+         completion.Header.Type = ertIRPCompletion;
+         completion.Header.Id = id++;
+         completion.Header.Time.QuadPart = time;
+         completion.IRPAddress = pending[slot].IRPAddress;
+         completion.CompletionStatus = ((seed >> 12) % 16 == 0) ? (NTSTATUS)0xc0000034 : 0;
+         completion.CompletionInformation = (seed >> 16) % 4096;
+         _RecordAppend(&capture, &completion.Header, sizeof(completion));
+      }
+
+      memset(&irp, 0, sizeof(irp));
+      irp.Header.Type = ertIRP;
+      irp.Header.Id = id++;
+      irp.Header.Time.QuadPart = time;
+      irp.Header.Driver = (PVOID)(ULONG_PTR)(0x10000 + driver*0x1000);
+      irp.Header.Device = (PVOID)(ULONG_PTR)(0x10000 + driver*0x1000 + ((seed >> 14) % BENCH_DEVICES + 1)*0x100);
+      irp.Header.ProcessId = (HANDLE)(ULONG_PTR)(4*((seed >> 10) % BENCH_PROCESSES + 1));
+      irp.Header.ThreadId = (HANDLE)(ULONG_PTR)(0x1000 + (seed >> 18) % 256);
+      irp.Header.ResultType = rrtNTSTATUS;
+      irp.Header.Result.NTSTATUSValue = STATUS_PENDING;
+      irp.MajorFunction = majors[(seed >> 22) % sizeof(majors)];
+      irp.IRPAddress = (PVOID)(ULONG_PTR)(0xffff000000000000ULL + (ULONG64)id*0x100);
+      irp.FileObject = (PVOID)(ULONG_PTR)(0xfffe000000000000ULL + (seed >> 6) % 1024*0x100);
+      if (irp.MajorFunction == 0xe)
+         irp.Arg3 = (PVOID)(ULONG_PTR)(0x220000 + ((seed >> 24) % 8)*4);
+
+      _RecordAppend(&capture, &irp.Header, sizeof(irp));
+      pending[slot] = irp;
+   }
+
+   _BlockFlush(&capture);
+   trailer.IndexOffset = capture.Offset;
+   trailer.BlockCount = (ULONG)capture.Blocks.size();
+   trailer.Signature = CAPTURE_TRAILER_SIGNATURE;
+   _Write(&capture, capture.Blocks.data(), (ULONG)(capture.Blocks.size()*sizeof(CAPTURE_BLOCK_INDEX)));
+   _Write(&capture, &trailer, sizeof(trailer));
+   close(capture.File);
+
+   return capture.Length;
+}
+
+
+/** Runs irpmon-analyze and collects its standard output. */
+static double _AnalyzeRun(const char *Analyzer, const char *FileName, ULONG ThreadCount, std::string & Output)
+{
+   int fds[2];
+   int status = 0;
+   char buffer[4096];
+   char threads[16];
+   ssize_t len = 0;
+   pid_t pid = 0;
+   double start = 0;
+
+   if (pipe(fds) != 0) {
+      perror("pipe");
+      exit(1);
+   }
+
+   snprintf(threads, sizeof(threads), "%u", ThreadCount);
+   start = _Now();
+   pid = fork();
+   if (pid == 0) {
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      execl(Analyzer, Analyzer, "--threads", threads, FileName, (char *)NULL);
+      perror(Analyzer);
+      _exit(127);
+   }
+
+   close(fds[1]);
+   Output.clear();
+   while ((len = read(fds[0], buffer, sizeof(buffer))) > 0)
+      Output.append(buffer, len);
+
+   close(fds[0]);
+   waitpid(pid, &status, 0);
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s --threads %u failed\n", Analyzer, ThreadCount);
+      exit(1);
+   }
+
+   return _Now() - start;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   int fd = -1;
+   ULONG recordCount = 2000000;
+   ULONG64 length = 0;
+   double baseTime = 0;
+   const char *analyzer = "./irpmon-analyze";
+   char fileName[] = "/tmp/analyze-scale-bench-XXXXXX";
+   std::string expected;
+   std::string output;
+   static const ULONG threadCounts[] = {1, 2, 4, 8, 16};
+
+   if (argc > 1)
+      recordCount = strtoul(argv[1], NULL, 0);
+
+   if (argc > 2)
+      analyzer = argv[2];
+
+   fd = mkstemp(fileName);
+   if (fd == -1) {
+      perror("mkstemp");
+      return 1;
+   }
+
+   close(fd);
+   length = _CaptureWrite(fileName, recordCount);
+   printf("%u records, %.1f MB of block data, %ld CPUs online\n", recordCount, length / 1e6, sysconf(_SC_NPROCESSORS_ONLN));
+   printf("%8s %10s %10s %12s %8s\n", "threads", "seconds", "MB/s", "Mrecords/s", "speedup");
+   for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+      double best = 0;
+
+      for (ULONG j = 0; j < BENCH_RUNS; ++j) {
+         double t = _AnalyzeRun(analyzer, fileName, threadCounts[i], output);
+
+         if (j == 0 || t < best)
+            best = t;
+
+         if (i == 0 && j == 0)
+            expected = output;
+         else if (output != expected) {
+            fprintf(stderr, "--threads %u: the summary differs from the single-threaded one\n", threadCounts[i]);
+            unlink(fileName);
+            return 1;
+         }
+      }
+
+      if (i == 0)
+         baseTime = best;
+
+      printf("%8u %10.3f %10.1f %12.2f %7.2fx\n", threadCounts[i], best, length / 1e6 / best, recordCount / 1e6 / best, baseTime / best);
+   }
+
+   unlink(fileName);
+
+   return 0;
+}
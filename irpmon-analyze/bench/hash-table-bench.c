@@ -0,0 +1,366 @@
+/**
+ * @file
+ *
+ * Measures the general hash table of the driver (irpmndrv/hash_table.c) in
+ * user mode, under the mixed load of the hook tables: many lookups that
+ * reference the record found, and occasional deletes and inserts (unhooking
+ * and hooking). The following synchronization schemes are compared:
+ *
+ *  * a table with no synchronization guarded by one outer lock, as the hook
+ *    and process tables used to be;
+ *  * a striped dispatch IRQL table with exclusive spin locks;
+ *  * a striped dispatch IRQL table with reader-writer spin locks, the lookups
+ *    reference the record through HashTableGetEx;
+ *  * a striped passive IRQL table.
+ *
+ * The memory taken by the locks is reported for the bucket counts used by the
+ * driver, computed from sizes of the structures on x64 Windows.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "ntifs.h"
+#include "allocator.h"
+#include "hash_table.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+typedef enum _EBenchLocking {
+   eblOuterSpinLock,
+   eblOuterResource,
+   eblStriped,
+} EBenchLocking;
+
+typedef struct _BENCH_ITEM {
+   HASH_ITEM HashItem;
+   ULONG_PTR Key;
+   volatile LONG ReferenceCount;
+   volatile LONG Moving;
+} BENCH_ITEM, *PBENCH_ITEM;
+
+typedef struct _BENCH_CONFIG {
+   const char *Name;
+   EHashTableType Type;
+   ULONG32 LockCount;
+   EBenchLocking Locking;
+} BENCH_CONFIG, *PBENCH_CONFIG;
+
+typedef struct _BENCH_THREAD_CONTEXT {
+   const BENCH_CONFIG *Config;
+   PHASH_TABLE Table;
+   PBENCH_ITEM Items;
+   ULONG KeyCount;
+   ULONG WritePercent;
+   ULONG Seed;
+   ULONG64 Operations;
+   ULONG64 Misses;
+} BENCH_THREAD_CONTEXT, *PBENCH_THREAD_CONTEXT;
+
+static KSPIN_LOCK _outerSpinLock;
+static ERESOURCE _outerResource;
+static volatile BOOLEAN _stop = FALSE;
+
+/* Sizes of the synchronization structures on x64 Windows. */
+#define X64_ERESOURCE_SIZE             104
+#define X64_KSPIN_LOCK_SIZE            8
+#define X64_EX_SPIN_LOCK_SIZE          4
+
+static const BENCH_CONFIG _configs[] = {
+   {"outer spin lock", httNoSynchronization, 1, eblOuterSpinLock},
+   {"dispatch, 16 stripes", httDispatchLevel, 16, eblStriped},
+   {"dispatch-shared, 16", httDispatchLevelShared, 16, eblStriped},
+   {"outer resource", httNoSynchronization, 1, eblOuterResource},
+   {"passive, 16 stripes", httPassiveLevel, 16, eblStriped},
+};
+
+
+/************************************************************************/
+/*                     TABLE CALLBACKS                                  */
+/************************************************************************/
+
+
+static BOOLEAN _BenchCompare(PHASH_ITEM ObjectInTable, PVOID Key)
+{
+   return (CONTAINING_RECORD(ObjectInTable, BENCH_ITEM, HashItem)->Key == (ULONG_PTR)Key);
+}
+
+
+static VOID _BenchReference(PHASH_ITEM Object, PVOID Context)
+{
+   InterlockedIncrement(&CONTAINING_RECORD(Object, BENCH_ITEM, HashItem)->ReferenceCount);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static ULONG _Random(PULONG Seed)
+{
+   *Seed = *Seed * 1103515245 + 12345;
+
+   return (*Seed >> 8);
+}
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static VOID _OuterLock(const BENCH_CONFIG *Config, BOOLEAN Exclusive, PKIRQL Irql)
+{
+   switch (Config->Locking) {
+      case eblOuterSpinLock:
+         KeAcquireSpinLock(&_outerSpinLock, Irql);
+         break;
+      case eblOuterResource:
+         KeEnterCriticalRegion();
+         if (Exclusive)
+            ExAcquireResourceExclusiveLite(&_outerResource, TRUE);
+         else ExAcquireResourceSharedLite(&_outerResource, TRUE);
+         break;
+      case eblStriped:
+         break;
+   }
+
+   return;
+}
+
+
+static VOID _OuterUnlock(const BENCH_CONFIG *Config, KIRQL Irql)
+{
+   switch (Config->Locking) {
+      case eblOuterSpinLock:
+         KeReleaseSpinLock(&_outerSpinLock, Irql);
+         break;
+      case eblOuterResource:
+         ExReleaseResourceLite(&_outerResource);
+         KeLeaveCriticalRegion();
+         break;
+      case eblStriped:
+         break;
+   }
+
+   return;
+}
+
+
+/** Looks up a record and references it, the way DriverHookRecordGet does. */
+static PBENCH_ITEM _Lookup(PBENCH_THREAD_CONTEXT Context, ULONG Key)
+{
+   KIRQL irql = PASSIVE_LEVEL;
+   PHASH_ITEM h = NULL;
+   PBENCH_ITEM ret = NULL;
+
+   if (Context->Config->Locking == eblStriped) {
+      h = HashTableGetEx(Context->Table, (PVOID)(ULONG_PTR)Key, _BenchReference, NULL);
+      if (h != NULL)
+         ret = CONTAINING_RECORD(h, BENCH_ITEM, HashItem);
+   } else {
+      _OuterLock(Context->Config, FALSE, &irql);
+      h = HashTableGet(Context->Table, (PVOID)(ULONG_PTR)Key);
+      if (h != NULL) {
+         ret = CONTAINING_RECORD(h, BENCH_ITEM, HashItem);
+         InterlockedIncrement(&ret->ReferenceCount);
+      }
+
+      _OuterUnlock(Context->Config, irql);
+   }
+
+   return ret;
+}
+
+
+/** Removes a record and inserts it back, as unhooking and hooking a driver do. */
+static VOID _Rehook(PBENCH_THREAD_CONTEXT Context, ULONG Key)
+{
+   KIRQL irql = PASSIVE_LEVEL;
+   PBENCH_ITEM item = &Context->Items[Key];
+
+   // Only one thread may move a given record.
+   if (InterlockedCompareExchange(&item->Moving, 1, 0) != 0)
+      return;
+
+   _OuterLock(Context->Config, TRUE, &irql);
+   HashTableDelete(Context->Table, (PVOID)(ULONG_PTR)Key);
+   _OuterUnlock(Context->Config, irql);
+   _OuterLock(Context->Config, TRUE, &irql);
+   HashTableInsert(Context->Table, &item->HashItem, (PVOID)(ULONG_PTR)Key);
+   _OuterUnlock(Context->Config, irql);
+   InterlockedExchange(&item->Moving, 0);
+
+   return;
+}
+
+
+static void *_BenchThreadRoutine(void *Parameter)
+{
+   ULONG key = 0;
+   PBENCH_ITEM item = NULL;
+   PBENCH_THREAD_CONTEXT ctx = (PBENCH_THREAD_CONTEXT)Parameter;
+
+   while (!_stop) {
+      key = _Random(&ctx->Seed) % ctx->KeyCount;
+      if (_Random(&ctx->Seed) % 100 < ctx->WritePercent) {
+         _Rehook(ctx, key);
+      } else {
+         item = _Lookup(ctx, key);
+         if (item != NULL)
+            InterlockedDecrement(&item->ReferenceCount);
+         else ++ctx->Misses;
+      }
+
+      ++ctx->Operations;
+   }
+
+   return NULL;
+}
+
+
+static double _RunMixed(const BENCH_CONFIG *Config, ULONG ThreadCount, ULONG KeyCount, ULONG WritePercent, double Seconds)
+{
+   ULONG i = 0;
+   double start = 0;
+   double elapsed = 0;
+   ULONG64 operations = 0;
+   PHASH_TABLE table = NULL;
+   PBENCH_ITEM items = NULL;
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+   pthread_t threads[16];
+   BENCH_THREAD_CONTEXT contexts[16];
+
+   items = (PBENCH_ITEM)calloc(KeyCount, sizeof(BENCH_ITEM));
+   status = HashTableCreateEx(Config->Type, 37, Config->LockCount, HashTablePointerHash, _BenchCompare, NULL, &table);
+   if (items == NULL || !NT_SUCCESS(status)) {
+      fprintf(stderr, "cannot create the table: 0x%x\n", status);
+      exit(1);
+   }
+
+   for (i = 0; i < KeyCount; ++i) {
+      items[i].Key = i;
+      items[i].ReferenceCount = 1;
+      HashTableInsert(table, &items[i].HashItem, (PVOID)(ULONG_PTR)i);
+   }
+
+   _stop = FALSE;
+   for (i = 0; i < ThreadCount; ++i) {
+      memset(&contexts[i], 0, sizeof(contexts[i]));
+      contexts[i].Config = Config;
+      contexts[i].Table = table;
+      contexts[i].Items = items;
+      contexts[i].KeyCount = KeyCount;
+      contexts[i].WritePercent = WritePercent;
+      contexts[i].Seed = 0x1234567 + i * 7919;
+   }
+
+   start = _Now();
+   for (i = 0; i < ThreadCount; ++i)
+      pthread_create(&threads[i], NULL, _BenchThreadRoutine, &contexts[i]);
+
+   while (_Now() - start < Seconds)
+      usleep(10000);
+
+   _stop = TRUE;
+   for (i = 0; i < ThreadCount; ++i) {
+      pthread_join(threads[i], NULL);
+      operations += contexts[i].Operations;
+   }
+
+   elapsed = _Now() - start;
+   HashTableDestroy(table);
+   free(items);
+
+   return operations / elapsed;
+}
+
+
+/** Lock memory of a table with a given number of buckets: one lock per bucket
+    (the layout before the locks were striped) and the striped layout. */
+static VOID _PrintMemory(const char *Name, EHashTableType Type, ULONG32 Buckets)
+{
+   ULONG32 stripes = 0;
+   ULONG perBucket = 0;
+   ULONG striped = 0;
+
+   stripes = (Buckets < HASH_TABLE_DEFAULT_LOCK_COUNT) ? Buckets : HASH_TABLE_DEFAULT_LOCK_COUNT;
+   switch (Type) {
+      case httPassiveLevel:
+         perBucket = Buckets * X64_ERESOURCE_SIZE;
+         striped = stripes * X64_ERESOURCE_SIZE;
+         break;
+      case httDispatchLevel:
+         perBucket = Buckets * (X64_KSPIN_LOCK_SIZE + sizeof(BOOLEAN));
+         striped = stripes * (X64_KSPIN_LOCK_SIZE + sizeof(BOOLEAN));
+         break;
+      case httDispatchLevelShared:
+         perBucket = Buckets * (X64_KSPIN_LOCK_SIZE + sizeof(BOOLEAN));
+         striped = stripes * (X64_EX_SPIN_LOCK_SIZE + sizeof(BOOLEAN));
+         break;
+      default:
+         break;
+   }
+
+   printf("  %-38s %5u buckets  %6u B per bucket  %5u B striped  (%u locks)\n", Name, Buckets, perBucket, striped, stripes);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   ULONG t = 0;
+   ULONG w = 0;
+   double seconds = 0.3;
+   static const ULONG threadCounts[] = {1, 2, 4, 8};
+   static const ULONG writePercents[] = {1, 10};
+
+   if (argc > 1)
+      seconds = atof(argv[1]);
+
+   KeInitializeSpinLock(&_outerSpinLock);
+   ExInitializeResourceLite(&_outerResource);
+   printf("Lock memory (x64 Windows structure sizes):\n");
+   _PrintMemory("process database (passive)", httPassiveLevel, 413);
+   _PrintMemory("driver hook tables (dispatch)", httDispatchLevel, 37);
+   _PrintMemory("driver hook tables (dispatch-shared)", httDispatchLevelShared, 37);
+   printf("\nMixed load, 256 records, %.1f s per run, %ld processors online\n", seconds, sysconf(_SC_NPROCESSORS_ONLN));
+   for (w = 0; w < sizeof(writePercents) / sizeof(writePercents[0]); ++w) {
+      printf("  %u %% deletes + inserts, Mops/s by thread count:\n", writePercents[w]);
+      printf("  %-24s", "");
+      for (t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t)
+         printf(" %8u", threadCounts[t]);
+
+      printf("\n");
+      for (i = 0; i < sizeof(_configs) / sizeof(_configs[0]); ++i) {
+         printf("  %-24s", _configs[i].Name);
+         for (t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+            printf(" %8.2f", _RunMixed(&_configs[i], threadCounts[t], 256, writePercents[w], seconds) / 1e6);
+            fflush(stdout);
+         }
+
+         printf("\n");
+      }
+   }
+
+   ExDeleteResourceLite(&_outerResource);
+
+   return 0;
+}
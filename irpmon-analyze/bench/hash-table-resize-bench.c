@@ -0,0 +1,147 @@
+/**
+ * @file
+ *
+ * Measures the cost of the incremental rehashing of the general hash table of
+ * the driver (irpmndrv/hash_table.c). A table starting at 37 buckets grows
+ * to hold up to 1M items and shrinks back, and is compared with a table created
+ * with enough buckets for all the items. The longest single insert shows that
+ * no operation pays for a whole rehash.
+ */
+
+#include <time.h>
+#include "ntifs.h"
+#include "allocator.h"
+#include "hash_table.h"
+
+
+/************************************************************************/
+/*                     TYPES                                            */
+/************************************************************************/
+
+typedef struct _BENCH_ITEM {
+   HASH_ITEM HashItem;
+   ULONG_PTR Key;
+} BENCH_ITEM, *PBENCH_ITEM;
+
+typedef struct _BENCH_RESULT {
+   double InsertNs;
+   double MaxInsertUs;
+   double GetNs;
+   double DeleteNs;
+   double MaxDeleteUs;
+   ULONG32 Buckets;
+} BENCH_RESULT, *PBENCH_RESULT;
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static BOOLEAN _BenchCompare(PHASH_ITEM ObjectInTable, PVOID Key)
+{
+   return (CONTAINING_RECORD(ObjectInTable, BENCH_ITEM, HashItem)->Key == (ULONG_PTR)Key);
+}
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static VOID _Run(ULONG32 InitialSize, PBENCH_ITEM Items, ULONG Count, PBENCH_RESULT Result)
+{
+   ULONG i = 0;
+   double start = 0;
+   double opStart = 0;
+   double opTime = 0;
+   ULONG found = 0;
+   PHASH_TABLE table = NULL;
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+   memset(Result, 0, sizeof(BENCH_RESULT));
+   status = HashTableCreate(httDispatchLevelShared, InitialSize, HashTablePointerHash, _BenchCompare, NULL, &table);
+   if (!NT_SUCCESS(status)) {
+      fprintf(stderr, "cannot create the table: 0x%x\n", status);
+      exit(1);
+   }
+
+   start = _Now();
+   for (i = 0; i < Count; ++i) {
+      opStart = _Now();
+      HashTableInsert(table, &Items[i].HashItem, (PVOID)Items[i].Key);
+      opTime = _Now() - opStart;
+      if (opTime > Result->MaxInsertUs)
+         Result->MaxInsertUs = opTime;
+   }
+
+   Result->InsertNs = (_Now() - start) * 1e9 / Count;
+   Result->MaxInsertUs *= 1e6;
+   Result->Buckets = table->Size;
+   start = _Now();
+   for (i = 0; i < Count; ++i)
+      found += (HashTableGet(table, (PVOID)Items[(i * 7919) % Count].Key) != NULL);
+
+   Result->GetNs = (_Now() - start) * 1e9 / Count;
+   if (found != Count)
+      fprintf(stderr, "%u of %u items found\n", found, Count);
+
+   start = _Now();
+   for (i = 0; i < Count; ++i) {
+      opStart = _Now();
+      HashTableDelete(table, (PVOID)Items[i].Key);
+      opTime = _Now() - opStart;
+      if (opTime > Result->MaxDeleteUs)
+         Result->MaxDeleteUs = opTime;
+   }
+
+   Result->DeleteNs = (_Now() - start) * 1e9 / Count;
+   Result->MaxDeleteUs *= 1e6;
+   HashTableDestroy(table);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG count = 0;
+   PBENCH_ITEM items = NULL;
+   BENCH_RESULT growing;
+   BENCH_RESULT presized;
+   static const ULONG counts[] = {1000, 10000, 100000, 1000000};
+
+   printf("dispatch-shared table, keys are addresses of the items\n");
+   printf("%8s  %-9s %8s %10s %13s %8s %10s %13s\n", "items", "table", "buckets", "insert ns", "max insert us", "get ns", "delete ns", "max delete us");
+   for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+      count = counts[i];
+      items = (PBENCH_ITEM)calloc(count, sizeof(BENCH_ITEM));
+      if (items == NULL) {
+         fprintf(stderr, "out of memory\n");
+         return 1;
+      }
+
+      for (j = 0; j < count; ++j)
+         items[j].Key = (ULONG_PTR)&items[j];
+
+      _Run(37, items, count, &growing);
+      _Run(count / HASH_TABLE_GROW_LOAD_FACTOR, items, count, &presized);
+      printf("%8u  %-9s %8u %10.1f %13.1f %8.1f %10.1f %13.1f\n", count, "growing", growing.Buckets, growing.InsertNs, growing.MaxInsertUs, growing.GetNs, growing.DeleteNs, growing.MaxDeleteUs);
+      printf("%8u  %-9s %8u %10.1f %13.1f %8.1f %10.1f %13.1f\n", count, "presized", presized.Buckets, presized.InsertNs, presized.MaxInsertUs, presized.GetNs, presized.DeleteNs, presized.MaxDeleteUs);
+      free(items);
+   }
+
+   return 0;
+}
@@ -0,0 +1,987 @@
+/**
+ * @file
+ *
+ * Compares formatting of request records by request-format.cpp, which writes
+ * UTF-8 text of a whole batch into one reusable buffer, with the previous
+ * formatting that built a vector of wide string pairs for every record
+ * (GetRequestDetails) and printed every line by a separate printf call. The
+ * previous formatting is reproduced here. Both write to /dev/null.
+ *
+ * Two sets of records are formatted:
+ *   - random: every field is random, so the bit masks, status values and
+ *     control codes almost never repeat and no string cache helps,
+ *   - typical: a few drivers and devices with names, the common major
+ *     functions, flags and status values, as a monitoring session sees them.
+ *
+ * Before the timing, the text produced by both formatters is compared and
+ * must be byte-identical.
+ *
+ * Usage: request-format-bench [record count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "general-types.h"
+#include "libtranslate.h"
+#include "request-format.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+#define BENCH_RECORDS            200000
+#define BENCH_RUNS               3
+#define BENCH_DRIVERS            4
+#define BENCH_DEVICES            2
+
+typedef union _BENCH_RECORD {
+   REQUEST_HEADER Header;
+   REQUEST_IRP Irp;
+   REQUEST_IRP_COMPLETION Completion;
+   REQUEST_FASTIO FastIo;
+   REQUEST_STARTIO StartIo;
+} BENCH_RECORD, *PBENCH_RECORD;
+
+typedef enum _EBenchWorkload {
+   ebwRandom,
+   ebwTypical,
+   ebwMax,
+} EBenchWorkload;
+
+static const char *_workloadNames[ebwMax] = {
+   "random",
+   "typical",
+};
+
+/** Names of the drivers (devices) of the typical records; driver I owns devices
+    I*BENCH_DEVICES to (I + 1)*BENCH_DEVICES - 1. The last device has no name. */
+static const wchar_t *_driverNames[BENCH_DRIVERS] = {
+   L"\\Driver\\Disk",
+   L"\\FileSystem\\Ntfs",
+   L"\\Driver\\Tcpip",
+   L"\\Driver\\kbdclass",
+};
+
+static const wchar_t *_deviceNames[BENCH_DRIVERS*BENCH_DEVICES] = {
+   L"\\Device\\Harddisk0\\DR0",
+   L"\\Device\\Harddisk1\\DR1",
+   L"\\Device\\HarddiskVolume2",
+   L"\\Device\\HarddiskVolume3",
+   L"\\Device\\Tcp",
+   L"\\Device\\Udp",
+   L"\\Device\\KeyboardClass0",
+   L"",
+};
+
+static ULONG64 _seed = 1;
+
+
+/************************************************************************/
+/*                     PREVIOUS FORMATTER                               */
+/************************************************************************/
+
+static std::wstring Ptr2Hex(PVOID Value)
+{
+   WCHAR buf[19];
+
+   swprintf(buf, 19, L"0x%p", Value);
+
+   return buf;
+}
+
+static std::wstring UInt642Hex(ULONG64 Value)
+{
+   WCHAR buf[19];
+
+   swprintf(buf, 19, L"0x%I64x", Value);
+
+   return buf;
+}
+
+static std::wstring BitMask2String(ELibTranslateBitMaskType Type, ULONG Value)
+{
+   WCHAR buf[256];
+   ULONG required = 0;
+   std::wstring res;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = LibTranslateBitMaskValueToBuffer(Type, FALSE, Value, buf, sizeof(buf) / sizeof(buf[0]), &required);
+   if (err == ERROR_INSUFFICIENT_BUFFER) {
+      std::vector<WCHAR> tmp(required);
+
+      err = LibTranslateBitMaskValueToBuffer(Type, FALSE, Value, tmp.data(), required, &required);
+      if (err == ERROR_SUCCESS)
+         res = tmp.data();
+   } else if (err == ERROR_SUCCESS)
+      res = buf;
+
+   return res;
+}
+
+static std::wstring IRPFlags2String(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags)
+{
+   WCHAR buf[256];
+   ULONG required = 0;
+   std::wstring res;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = LibTranslateIRPFlagsToBuffer(MajorFunction, MinorFunction, IRPFlags, FALSE, buf, sizeof(buf) / sizeof(buf[0]), &required);
+   if (err == ERROR_INSUFFICIENT_BUFFER) {
+      std::vector<WCHAR> tmp(required);
+
+      err = LibTranslateIRPFlagsToBuffer(MajorFunction, MinorFunction, IRPFlags, FALSE, tmp.data(), required, &required);
+      if (err == ERROR_SUCCESS)
+         res = tmp.data();
+   } else if (err == ERROR_SUCCESS)
+      res = buf;
+
+   return res;
+}
+
+static std::wstring _FastIoTypeToString(EFastIoOperationType Type)
+{
+   std::wstring res;
+   const wchar_t *_fastIoTypes[] = {
+      L"FastIoCheckIfPossible",
+      L"FastIoRead",
+      L"FastIoWrite",
+      L"FastIoQueryBasicInfo",
+      L"FastIoQueryStandardInfo",
+      L"FastIoLock",
+      L"FastIoUnlockSingle",
+      L"FastIoUnlockAll",
+      L"FastIoUnlockAllByKey",
+      L"FastIoDeviceControl",
+      L"AcquireFileForNtCreateSection",
+      L"ReleaseFileForNtCreateSection",
+      L"FastIoDetachDevice",
+      L"FastIoQueryNetworkOpenInfo",
+      L"AcquireForModWrite",
+      L"MdlRead",
+      L"MdlReadComplete",
+      L"PrepareMdlWrite",
+      L"MdlWriteComplete",
+      L"FastIoReadCompressed",
+      L"FastIoWriteCompressed",
+      L"MdlReadCompleteCompressed",
+      L"MdlWriteCompleteCompressed",
+      L"FastIoQueryOpen",
+      L"ReleaseForModWrite",
+      L"AcquireForCcFlush",
+      L"ReleaseForCcFlush"};
+
+   if ((ULONG)Type < FastIoMax)
+      res = _fastIoTypes[Type];
+   else res = L"<nknown> (" + std::to_wstring(Type) + L")";
+
+   return res;
+}
+
+static std::wstring _AccessModeToString(ULONG AccessMode)
+{
+   std::wstring res;
+   const wchar_t *modes [] = {L"KernelMode", L"UserMode"};
+
+   if (AccessMode < sizeof(modes) / sizeof(modes[0]))
+      res = modes[AccessMode];
+   else res = L"<unknown> (" + std::to_wstring(AccessMode) + L")";
+
+   return res;
+}
+
+static void _ParseIRPParameters(UCHAR MajorFunction, UCHAR MinorFunction, PVOID Arg1, PVOID Arg2, PVOID Arg3, PVOID Arg4, std::wstring & minor, std::vector<std::pair<std::wstring, std::wstring>> & args)
+{
+   PWCHAR wMinor = NULL;
+   minor = std::to_wstring(MinorFunction);
+
+   switch (MajorFunction) {
+      case IRP_MJ_CREATE:
+         args.push_back(std::make_pair(L"Security context", Ptr2Hex(Arg1)));
+         args.push_back(std::make_pair(L"Options", Ptr2Hex(Arg2)));
+         args.push_back(std::make_pair(L"File attributes", Ptr2Hex(Arg3)));
+         args.push_back(std::make_pair(L"EA length", std::to_wstring((ULONG)(ULONG_PTR)Arg4)));
+         break;
+      case IRP_MJ_READ:
+      case IRP_MJ_WRITE: {
+         minor = BitMask2String(((MajorFunction == IRP_MJ_READ) ? ltbtIRPReadMinorFunction : ltbtIRPWriteMinorFunction), MinorFunction);
+         args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+         args.push_back(std::make_pair(L"Key", std::to_wstring((ULONG)(ULONG_PTR)Arg2)));
+         std::wstring byteOffsetStr;
+         if (sizeof(PVOID) == 8)
+            byteOffsetStr = UInt642Hex((ULONG64)(ULONG_PTR)Arg3 + ((ULONG64)(ULONG_PTR)Arg4 << 32));
+         else byteOffsetStr = UInt642Hex((ULONG64)(ULONG_PTR)Arg3);
+
+         args.push_back(std::make_pair(L"Byte offset", byteOffsetStr));
+      } break;
+      case IRP_MJ_QUERY_INFORMATION:
+         args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+         args.push_back(std::make_pair(L"File information class", LibTranslateEnumerationValueToString(ltetFileInformationClass, FALSE, (ULONG)(ULONG_PTR)Arg2)));
+         break;
+      case IRP_MJ_SET_INFORMATION:
+         args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+         args.push_back(std::make_pair(L"File information class", LibTranslateEnumerationValueToString(ltetFileInformationClass, FALSE, (ULONG)(ULONG_PTR)Arg2)));
+         break;
+      case IRP_MJ_QUERY_VOLUME_INFORMATION:
+         args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+         args.push_back(std::make_pair(L"Volume information class", LibTranslateEnumerationValueToString(ltetFileVolumeInformationClass, FALSE, (ULONG)(ULONG_PTR)Arg2)));
+         break;
+      case IRP_MJ_DIRECTORY_CONTROL:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPDirectoryMinorFunction, FALSE, MinorFunction);
+         minor = std::wstring(wMinor);
+         break;
+      case IRP_MJ_FILE_SYSTEM_CONTROL:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPFileSystemMinorFunction, FALSE, MinorFunction);
+         minor = std::wstring(wMinor);
+         if (MinorFunction == 1 || MinorFunction == 2) {
+            args.push_back(std::make_pair(L"Device object", Ptr2Hex(Arg2)));
+         } else if (MinorFunction == 0 || MinorFunction == 4) {
+            args.push_back(std::make_pair(L"Output buffer length", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+            args.push_back(std::make_pair(L"Input buffer length", std::to_wstring((ULONG)(ULONG_PTR)Arg2)));
+            args.push_back(std::make_pair(L"FSCTL", UInt642Hex((ULONG)(ULONG_PTR)Arg3)));
+            args.push_back(std::make_pair(L"Type3InputBuffer", Ptr2Hex(Arg4)));
+         }
+
+         break;
+      case IRP_MJ_PNP:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPPnPMinorFunction, FALSE, MinorFunction);
+         minor = std::wstring(wMinor);
+         switch (MinorFunction) {
+            case 0x7:
+               args.push_back(std::make_pair(L"Device relation type", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+               break;
+            case 0x0C:
+               args.push_back(std::make_pair(L"Device text type", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+               break;
+            case 0x12:
+               args.push_back(std::make_pair(L"Lock", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+               break;
+            case 0x13:
+               args.push_back(std::make_pair(L"Device ID type", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+               break;
+         }
+         break;
+      case IRP_MJ_POWER:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPPowerMinorFunction, FALSE, MinorFunction);
+         minor = wMinor;
+         break;
+      case IRP_MJ_SYSTEM_CONTROL:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPSystemMinorFunction, FALSE, MinorFunction);
+         minor = std::wstring(wMinor);
+         break;
+      case IRP_MJ_LOCK_CONTROL:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPLockMinorFunction, FALSE, MinorFunction);
+         minor = std::wstring(wMinor);
+         break;
+      case IRP_MJ_FLUSH_BUFFERS:
+         wMinor = LibTranslateEnumerationValueToString(ltetIRPFlushMinorFunction, FALSE, MinorFunction);
+         minor = std::wstring(wMinor);
+         break;
+      case IRP_MJ_DEVICE_CONTROL:
+      case IRP_MJ_INTERNAL_DEVICE_CONTROL:
+         args.push_back(std::make_pair(L"Output buffer length", std::to_wstring((ULONG)(ULONG_PTR)Arg1)));
+         args.push_back(std::make_pair(L"Input buffer length", std::to_wstring((ULONG)(ULONG_PTR)Arg2)));
+         args.push_back(std::make_pair(L"IOCTL", LibTranslateGeneralIntegerValueToString(ltivtDeviceControl, FALSE, (ULONG)(ULONG_PTR)Arg3)));
+         args.push_back(std::make_pair(L"Type3InputBuffer", Ptr2Hex(Arg4)));
+         break;
+   }
+
+   return;
+}
+
+
+static std::wstring _OldRequestResult(PREQUEST_HEADER h)
+{
+   std::wstring res;
+
+   switch (h->ResultType) {
+      case rrtNTSTATUS:
+         res = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, h->Result.NTSTATUSValue);
+         break;
+      case rrtBOOLEAN:
+         res = (h->Result.BOOLEANValue) ? L"TRUE" : L"FALSE";
+         break;
+      default:
+         res = L"None";
+         break;
+   }
+
+   return res;
+}
+
+static std::vector<std::pair<std::wstring, std::wstring>> _OldRequestDetails(PREQUEST_HEADER h)
+{
+   std::vector<std::pair<std::wstring, std::wstring>> res;
+
+   switch (h->Type) {
+      case ertIRP: {
+         PREQUEST_IRP r = CONTAINING_RECORD(h, REQUEST_IRP, Header);
+         std::wstring major = LibTranslateGeneralIntegerValueToString(ltivtFileIRPMajorFunction, FALSE, r->MajorFunction);
+         std::wstring minor;
+         std::vector<std::pair<std::wstring, std::wstring>> args;
+
+         std::wstring flagsStr = IRPFlags2String(r->MajorFunction, r->MinorFunction, r->IrpFlags & (~0x60000));
+
+         _ParseIRPParameters(r->MajorFunction, r->MinorFunction, r->Arg1, r->Arg2, r->Arg3, r->Arg4, minor, args);
+         res.push_back(std::make_pair(L"IRP address", Ptr2Hex(r->IRPAddress)));
+         res.push_back(std::make_pair(L"File object", Ptr2Hex(r->FileObject)));
+         res.push_back(std::make_pair(L"Major function", major));
+         res.push_back(std::make_pair(L"Minor function", minor));
+         res.push_back(std::make_pair(L"Flags", flagsStr));
+         res.push_back(std::make_pair(L"Access mode", _AccessModeToString(r->PreviousMode)));
+         res.push_back(std::make_pair(L"Requestor mode", _AccessModeToString(r->RequestorMode)));
+         for (auto it = args.cbegin(); it != args.cend(); ++it)
+            res.push_back(*it);
+
+      } break;
+      case ertIRPCompletion: {
+         PREQUEST_IRP_COMPLETION r = CONTAINING_RECORD(h, REQUEST_IRP_COMPLETION, Header);
+
+         res.push_back(std::make_pair(L"IRP address", Ptr2Hex(r->IRPAddress)));
+         res.push_back(std::make_pair(L"Completion information", Ptr2Hex((PVOID)r->CompletionInformation)));
+         res.push_back(std::make_pair(L"Completion status", LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, (ULONG)r->CompletionStatus)));
+      } break;
+      case ertFastIo: {
+         PREQUEST_FASTIO f = CONTAINING_RECORD(h, REQUEST_FASTIO, Header);
+         bool iosbValid = false;
+         std::vector<std::pair<std::wstring, std::wstring>> args;
+
+         switch (f->FastIoType) {
+            case FastIoCheckIfPossible: {
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg3)));
+               args.push_back(std::make_pair(L"Operation", ((ULONG)(ULONG_PTR)f->Arg4 != 0) ? L"Read" : L"Write"));
+               args.push_back(std::make_pair(L"Wait", ((ULONG)(ULONG_PTR)f->Arg5) ? L"Yes" : L"No"));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg6)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoRead:  // the same as the FastIoWrite case
+            case FastIoWrite: {
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg3)));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg4)));
+               args.push_back(std::make_pair(L"Wait", ((ULONG)(ULONG_PTR)f->Arg5) ? L"Yes" : L"No"));
+               args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg6)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoQueryBasicInfo: {
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+               if (iosbValid && f->IOSBStatus >= 0) {
+                  ULONG64 creationTime = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+                  LONG64 lastAccessTime = (ULONG64)(ULONG_PTR)f->Arg3 + ((ULONG64)(ULONG_PTR)f->Arg4 << 32);
+                  ULONG64 lastWriteTime = (ULONG64)(ULONG_PTR)f->Arg5 + ((ULONG64)(ULONG_PTR)f->Arg6 << 32);
+
+                  args.push_back(std::make_pair(L"Creation time", std::to_wstring(creationTime)));
+                  args.push_back(std::make_pair(L"Last access time", std::to_wstring(lastAccessTime)));
+                  args.push_back(std::make_pair(L"Last write time", std::to_wstring(lastWriteTime)));
+                  args.push_back(std::make_pair(L"File attributes", BitMask2String(ltbtFileAttributes, (ULONG)(ULONG_PTR)f->Arg7)));
+               } else {
+                  args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg1)));
+                  args.push_back(std::make_pair(L"Wait", ((ULONG)(ULONG_PTR)f->Arg2) ? L"Yes" : L"No"));
+               }
+            } break;
+            case FastIoQueryStandardInfo: {
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+               if (iosbValid && f->IOSBStatus >= 0) {
+                  ULONG64 allocationSize = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+                  LONG64 endOfFile = (ULONG64)(ULONG_PTR)f->Arg3 + ((ULONG64)(ULONG_PTR)f->Arg4 << 32);
+
+                  args.push_back(std::make_pair(L"Allocation size", std::to_wstring(allocationSize)));
+                  args.push_back(std::make_pair(L"End of file", std::to_wstring(endOfFile)));
+                  args.push_back(std::make_pair(L"Number of links", std::to_wstring((ULONG)(ULONG_PTR)f->Arg5)));
+                  args.push_back(std::make_pair(L"Directory", ((ULONG)(ULONG_PTR)f->Arg6) ? L"Yes" : L"No"));
+                  args.push_back(std::make_pair(L"DeletePending", ((ULONG)(ULONG_PTR)f->Arg7) ? L"Yes" : L"No"));
+               } else {
+                  args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg1)));
+                  args.push_back(std::make_pair(L"Wait", ((ULONG)(ULONG_PTR)f->Arg2) ? L"Yes" : L"No"));
+               }
+            } break;
+            case FastIoLock: {
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+               ULONG64 regionLength = (ULONG64)(ULONG_PTR)f->Arg3 + ((ULONG64)(ULONG_PTR)f->Arg4 << 32);
+               ULONG flags = (ULONG)(ULONG_PTR)f->Arg5;
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"Length", std::to_wstring(regionLength)));
+               args.push_back(std::make_pair(L"Fail immediately", (flags & 2) ? L"Yes" : L"No"));
+               args.push_back(std::make_pair(L"Exclusive", (flags & 1) ? L"Yes" : L"No"));
+               args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg6)));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg7)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoUnlockSingle: {
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+               ULONG64 regionLength = (ULONG64)(ULONG_PTR)f->Arg3 + ((ULONG64)(ULONG_PTR)f->Arg4 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"Length", std::to_wstring(regionLength)));
+               args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg5)));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg6)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoUnlockAll: {
+               args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg1)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoUnlockAllByKey: {
+               args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg1)));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg2)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoDeviceControl: {
+               args.push_back(std::make_pair(L"IOCTL", LibTranslateGeneralIntegerValueToString(ltivtDeviceControl, FALSE, (ULONG)(ULONG_PTR)f->Arg1)));
+               args.push_back(std::make_pair(L"Input buffer length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg2)));
+               args.push_back(std::make_pair(L"Output buffer length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg3)));
+               args.push_back(std::make_pair(L"Wait", ((ULONG)(ULONG_PTR)f->Arg5) ? L"Yes" : L"No"));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoDetachDevice: {
+               args.push_back(std::make_pair(L"Source device", Ptr2Hex(f->Arg1)));
+               args.push_back(std::make_pair(L"Target device", Ptr2Hex(f->Arg2)));
+            } break;
+            case FastIoQueryNetworkOpenInfo: {
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+               if (iosbValid && f->IOSBStatus >= 0) {
+                  ULONG64 creationTime = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+                  LONG64 lastAccessTime = (ULONG64)(ULONG_PTR)f->Arg3 + ((ULONG64)(ULONG_PTR)f->Arg4 << 32);
+                  ULONG64 lastWriteTime = (ULONG64)(ULONG_PTR)f->Arg5 + ((ULONG64)(ULONG_PTR)f->Arg6 << 32);
+
+                  args.push_back(std::make_pair(L"Creation time", std::to_wstring(creationTime)));
+                  args.push_back(std::make_pair(L"Last access time", std::to_wstring(lastAccessTime)));
+                  args.push_back(std::make_pair(L"Last write time", std::to_wstring(lastWriteTime)));
+                  args.push_back(std::make_pair(L"File attributes", BitMask2String(ltbtFileAttributes, (ULONG)(ULONG_PTR)f->Arg7)));
+               } else {
+                  args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg1)));
+                  args.push_back(std::make_pair(L"Wait", ((ULONG)(ULONG_PTR)f->Arg2) ? L"Yes" : L"No"));
+               }
+            } break;
+            case AcquireForModWrite: {
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               if (f->Header.Result.NTSTATUSValue >= 0)
+                  args.push_back(std::make_pair(L"Lock", Ptr2Hex(f->Arg3)));
+            } break;
+            case PrepareMdlWrite:
+            case MdlRead: {  // the same as the PrepareMdlWrite case
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg3)));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg4)));
+               args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg5)));
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case MdlReadComplete:
+            case MdlReadCompleteCompressed: { // the same as the MdlReadComplete case
+               args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg1)));
+            } break;
+            case MdlWriteComplete:
+            case MdlWriteCompleteCompressed: { // the same as the MdlWriteComplete case
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg3)));
+            } break;
+            case FastIoWriteCompressed:
+            case FastIoReadCompressed: { // The same as the FastIoWriteCompressed case
+               ULONG64 fileOffset = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+
+               args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
+               args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg3)));
+               args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)(ULONG_PTR)f->Arg4)));
+               args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg5)));
+               args.push_back(std::make_pair(L"Compressed info length", std::to_wstring((ULONG)(ULONG_PTR)f->Arg6)));
+               if (f->IOSBStatus >= 0)
+                  args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg7)));
+
+               iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
+            } break;
+            case FastIoQueryOpen: {
+               if (f->Header.Result.BOOLEANValue) {
+                  ULONG64 creationTime = (ULONG64)(ULONG_PTR)f->Arg1 + ((ULONG64)(ULONG_PTR)f->Arg2 << 32);
+                  LONG64 lastAccessTime = (ULONG64)(ULONG_PTR)f->Arg3 + ((ULONG64)(ULONG_PTR)f->Arg4 << 32);
+                  ULONG64 lastWriteTime = (ULONG64)(ULONG_PTR)f->Arg5 + ((ULONG64)(ULONG_PTR)f->Arg6 << 32);
+
+                  args.push_back(std::make_pair(L"Creation time", std::to_wstring(creationTime)));
+                  args.push_back(std::make_pair(L"Last access time", std::to_wstring(lastAccessTime)));
+                  args.push_back(std::make_pair(L"Last write time", std::to_wstring(lastWriteTime)));
+                  args.push_back(std::make_pair(L"File attributes", BitMask2String(ltbtFileAttributes, (ULONG)(ULONG_PTR)f->Arg7)));
+               } else {
+                  args.push_back(std::make_pair(L"IRP address", Ptr2Hex(f->Arg1)));
+                  args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg2)));
+               }
+            } break;
+            case ReleaseForModWrite: {
+               args.push_back(std::make_pair(L"Lock", Ptr2Hex(f->Arg1)));
+            } break;
+            case AcquireForCcFlush:
+            case ReleaseForCcFlush: // the same as the AcquireForCcFlush case
+            case AcquireFileForNtCreateSection: // the same as the AcquireForCcFlush case
+            case ReleaseFileForNtCreateSection: // the same as the AcquireForCcFlush case
+               break;
+            default:
+               break;
+         }
+
+         res.push_back(std::make_pair(L"Type", _FastIoTypeToString(f->FastIoType)));
+         res.push_back(std::make_pair(L"File object", Ptr2Hex(f->FileObject)));
+         res.push_back(std::make_pair(L"Access mode", _AccessModeToString(f->PreviousMode)));
+         for (auto it = args.cbegin(); it != args.cend(); ++it)
+            res.push_back(*it);
+
+         if (iosbValid) {
+            res.push_back(std::make_pair(L"IOSB Status", LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, f->IOSBStatus)));
+            res.push_back(std::make_pair(L"IOSB Information", std::to_wstring(f->IOSBInformation)));
+         }
+      } break;
+      case ertStartIo: {
+         PREQUEST_STARTIO s = CONTAINING_RECORD(h, REQUEST_STARTIO, Header);
+         std::wstring major = LibTranslateGeneralIntegerValueToString(ltivtFileIRPMajorFunction, FALSE, s->MajorFunction);
+         std::wstring minor;
+         std::vector<std::pair<std::wstring, std::wstring>> args;
+
+         std::wstring flagsStr = IRPFlags2String(s->MajorFunction, s->MinorFunction, s->IrpFlags & (~0x60000));
+
+         _ParseIRPParameters(s->MajorFunction, s->MinorFunction, s->Arg1, s->Arg2, s->Arg3, s->Arg4, minor, args);
+         res.push_back(std::make_pair(L"IRP address", Ptr2Hex(s->IRPAddress)));
+         res.push_back(std::make_pair(L"File object", Ptr2Hex(s->FileObject)));
+         res.push_back(std::make_pair(L"Major function", major));
+         res.push_back(std::make_pair(L"Minor function", minor));
+         res.push_back(std::make_pair(L"Flags", flagsStr));
+         for (auto it = args.cbegin(); it != args.cend(); ++it)
+            res.push_back(*it);
+
+         res.push_back(std::make_pair(L"IOSB status", LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, (ULONG)s->Status)));
+         res.push_back(std::make_pair(L"IOSB information", Ptr2Hex((PVOID)s->Information)));
+      } break;
+      case ertAddDevice: {
+      } break;
+      case ertDriverUnload: {
+      } break;
+      default:
+         break;
+   }
+
+   return res;
+}
+
+/** Prints a request the way PrintRequest of irpmonconsole did, with %ls in place
+    of the %S of the Microsoft C runtime. */
+static void _OldRequestPrint(FILE *Stream, PREQUEST_HEADER Header, const wchar_t *DriverName, const wchar_t *DeviceName)
+{
+   switch (Header->Type) {
+      case ertIRP:
+         fprintf(Stream, "IRP: ");
+         break;
+      case ertIRPCompletion:
+         fprintf(Stream, "IRPCOMPLETE: ");
+         break;
+      case ertFastIo:
+         fprintf(Stream, "FASTIO: ");
+         break;
+      case ertAddDevice:
+         fprintf(Stream, "ADDDEVICE: ");
+         break;
+      case ertStartIo:
+         fprintf(Stream, "STARTIO: ");
+         break;
+      case ertDriverUnload:
+         fprintf(Stream, "UNLOAD: ");
+         break;
+      default:
+         fprintf(Stream, "UNKNOWN (%u): ", Header->Type);
+         break;
+   }
+
+   // The names were returned by value by the name cache.
+   std::wstring driverName = DriverName;
+   std::wstring deviceName = DeviceName;
+   if (driverName != L"")
+      fprintf(Stream, "%ls: ", driverName.data());
+   else fprintf(Stream, "(0x%0*llX): ", (int)sizeof(PVOID)*2, (unsigned long long)(ULONG_PTR)Header->Driver);
+
+   if (deviceName != L"")
+      fprintf(Stream, "%ls\n", deviceName.data());
+   else fprintf(Stream, "(0x%0*llX)\n", (int)sizeof(PVOID)*2, (unsigned long long)(ULONG_PTR)Header->Device);
+
+   std::vector<std::pair<std::wstring, std::wstring>> info = _OldRequestDetails(Header);
+   std::wstring res = _OldRequestResult(Header);
+   for (auto it = info.cbegin(); it != info.cend(); ++it)
+      fprintf(Stream, "  %ls: %ls\n", it->first.data(), it->second.data());
+
+   fprintf(Stream, "  Result: %ls\n", res.data());
+   fprintf(Stream, "\n");
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static ULONG64 _Random(void)
+{
+   _seed ^= _seed << 13;
+   _seed ^= _seed >> 7;
+   _seed ^= _seed << 17;
+
+   return _seed;
+}
+
+
+/** Returns a small number, a 32-bit one or a full pointer-sized one. */
+static PVOID _RandomArgument(void)
+{
+   PVOID ret = NULL;
+
+   switch (_Random() % 4) {
+      case 0:
+         ret = (PVOID)(ULONG_PTR)(_Random() % 5);
+         break;
+      case 1:
+         ret = (PVOID)(ULONG_PTR)(ULONG)_Random();
+         break;
+      default:
+         ret = (PVOID)(ULONG_PTR)_Random();
+         break;
+   }
+
+   return ret;
+}
+
+
+static void _RecordRandom(PBENCH_RECORD Record)
+{
+   ULONG i = 0;
+   PVOID *args = NULL;
+   PREQUEST_HEADER h = &Record->Header;
+
+   memset(Record, 0, sizeof(BENCH_RECORD));
+   h->Type = (ERequesttype)(_Random() % 8);
+   if (h->Type == 7)
+      h->Type = (ERequesttype)42;
+
+   h->Driver = _RandomArgument();
+   h->Device = _RandomArgument();
+   h->ResultType = (ERequestResultType)(_Random() % 3);
+   switch (_Random() % 4) {
+      case 0:
+         h->Result.NTSTATUSValue = (NTSTATUS)_Random();
+         break;
+      case 1:
+         h->Result.NTSTATUSValue = (NTSTATUS)0xC0000022;
+         break;
+      default:
+         h->Result.NTSTATUSValue = 0;
+         break;
+   }
+
+   if (_Random() % 3 == 0)
+      h->Result.BOOLEANValue = (BOOLEAN)(_Random() % 2);
+
+   switch (h->Type) {
+      case ertIRP:
+         Record->Irp.MajorFunction = (UCHAR)(_Random() % 0x1e);
+         Record->Irp.MinorFunction = (UCHAR)(_Random() % 0x1a);
+         Record->Irp.PreviousMode = (UCHAR)(_Random() % 3);
+         Record->Irp.RequestorMode = (UCHAR)(_Random() % 3);
+         Record->Irp.IRPAddress = _RandomArgument();
+         Record->Irp.IrpFlags = (ULONG)_Random();
+         Record->Irp.FileObject = _RandomArgument();
+         Record->Irp.Arg1 = _RandomArgument();
+         Record->Irp.Arg2 = _RandomArgument();
+         Record->Irp.Arg3 = _RandomArgument();
+         Record->Irp.Arg4 = _RandomArgument();
+         break;
+      case ertStartIo:
+         Record->StartIo.MajorFunction = (UCHAR)(_Random() % 0x1e);
+         Record->StartIo.MinorFunction = (UCHAR)(_Random() % 0x1a);
+         Record->StartIo.IRPAddress = _RandomArgument();
+         Record->StartIo.IrpFlags = (ULONG)_Random();
+         Record->StartIo.FileObject = _RandomArgument();
+         Record->StartIo.Arg1 = _RandomArgument();
+         Record->StartIo.Arg2 = _RandomArgument();
+         Record->StartIo.Arg3 = _RandomArgument();
+         Record->StartIo.Arg4 = _RandomArgument();
+         Record->StartIo.Information = (ULONG_PTR)_RandomArgument();
+         Record->StartIo.Status = (_Random() % 2) ? 0 : (NTSTATUS)_Random();
+         break;
+      case ertIRPCompletion:
+         Record->Completion.IRPAddress = _RandomArgument();
+         Record->Completion.CompletionStatus = (_Random() % 2) ? 0 : (NTSTATUS)_Random();
+         Record->Completion.CompletionInformation = (ULONG_PTR)_RandomArgument();
+         break;
+      case ertFastIo:
+         // Includes types out of the range of EFastIoOperationType.
+         Record->FastIo.FastIoType = (EFastIoOperationType)((int)(_Random() % 30) - 1);
+         Record->FastIo.PreviousMode = (UCHAR)(_Random() % 3);
+         args = &Record->FastIo.Arg1;
+         for (i = 0; i < 9; ++i)
+            args[i] = _RandomArgument();
+
+         Record->FastIo.FileObject = _RandomArgument();
+         Record->FastIo.IOSBStatus = (_Random() % 2) ? 0 : (NTSTATUS)_Random();
+         Record->FastIo.IOSBInformation = (ULONG_PTR)_RandomArgument();
+         break;
+      default:
+         break;
+   }
+
+   return;
+}
+
+
+static void _RecordTypical(PBENCH_RECORD Record)
+{
+   ULONG driver = 0;
+   ULONG device = 0;
+   PREQUEST_HEADER h = &Record->Header;
+   static const UCHAR majorFunctions[] = {IRP_MJ_CREATE, IRP_MJ_CLOSE, IRP_MJ_READ, IRP_MJ_WRITE, IRP_MJ_READ, IRP_MJ_WRITE, IRP_MJ_DEVICE_CONTROL, IRP_MJ_CLEANUP, IRP_MJ_QUERY_INFORMATION};
+   static const ULONG irpFlags[] = {0x0, 0x884, 0x43, 0xa00, 0x60900};
+   static const NTSTATUS statuses[] = {0, 0, 0, STATUS_PENDING, (NTSTATUS)0xC0000022, (NTSTATUS)0x80000005};
+   static const ULONG ioctls[] = {0x2d1400, 0x70000, 0x560000, 0x12003};
+   static const EFastIoOperationType fastIoTypes[] = {FastIoRead, FastIoWrite, FastIoQueryBasicInfo, FastIoCheckIfPossible};
+
+   memset(Record, 0, sizeof(BENCH_RECORD));
+   driver = (ULONG)(_Random() % BENCH_DRIVERS);
+   device = driver*BENCH_DEVICES + (ULONG)(_Random() % BENCH_DEVICES);
+   h->Driver = (PVOID)(ULONG_PTR)(0xffffe00010000000 + driver*0x1000);
+   h->Device = (PVOID)(ULONG_PTR)(0xffffe00020000000 + device*0x1000);
+   h->ResultType = rrtNTSTATUS;
+   h->Result.NTSTATUSValue = statuses[_Random() % (sizeof(statuses) / sizeof(statuses[0]))];
+   switch (_Random() % 50) {
+      case 0:
+         h->Type = ertStartIo;
+         Record->StartIo.MajorFunction = IRP_MJ_READ;
+         Record->StartIo.IRPAddress = (PVOID)(ULONG_PTR)(0xffffe00030000000 + (_Random() % 64)*0x100);
+         Record->StartIo.IrpFlags = 0x43;
+         Record->StartIo.Arg1 = (PVOID)(ULONG_PTR)4096;
+         Record->StartIo.Arg3 = (PVOID)(ULONG_PTR)((_Random() % 1000)*4096);
+         Record->StartIo.Status = 0;
+         Record->StartIo.Information = 4096;
+         break;
+      case 1: case 2: case 3: case 4:
+         h->Type = ertFastIo;
+         h->ResultType = rrtBOOLEAN;
+         h->Result.BOOLEANValue = TRUE;
+         Record->FastIo.FastIoType = fastIoTypes[_Random() % (sizeof(fastIoTypes) / sizeof(fastIoTypes[0]))];
+         Record->FastIo.PreviousMode = 1;
+         Record->FastIo.Arg1 = (PVOID)(ULONG_PTR)((_Random() % 1000)*512);
+         Record->FastIo.Arg3 = (PVOID)(ULONG_PTR)512;
+         Record->FastIo.Arg7 = (PVOID)(ULONG_PTR)0x20;
+         Record->FastIo.FileObject = (PVOID)(ULONG_PTR)(0xffffe00040000000 + (_Random() % 32)*0x100);
+         Record->FastIo.IOSBInformation = 512;
+         break;
+      default:
+         if (_Random() % 2 == 0) {
+            h->Type = ertIRP;
+            Record->Irp.MajorFunction = majorFunctions[_Random() % (sizeof(majorFunctions) / sizeof(majorFunctions[0]))];
+            Record->Irp.PreviousMode = (UCHAR)(_Random() % 2);
+            Record->Irp.RequestorMode = Record->Irp.PreviousMode;
+            Record->Irp.IRPAddress = (PVOID)(ULONG_PTR)(0xffffe00030000000 + (_Random() % 64)*0x100);
+            Record->Irp.IrpFlags = irpFlags[_Random() % (sizeof(irpFlags) / sizeof(irpFlags[0]))];
+            Record->Irp.FileObject = (PVOID)(ULONG_PTR)(0xffffe00040000000 + (_Random() % 32)*0x100);
+            Record->Irp.Arg1 = (PVOID)(ULONG_PTR)4096;
+            Record->Irp.Arg2 = (PVOID)(ULONG_PTR)(_Random() % 2);
+            Record->Irp.Arg3 = (PVOID)(ULONG_PTR)((_Random() % 1000)*4096);
+            if (Record->Irp.MajorFunction == IRP_MJ_DEVICE_CONTROL)
+               Record->Irp.Arg3 = (PVOID)(ULONG_PTR)ioctls[_Random() % (sizeof(ioctls) / sizeof(ioctls[0]))];
+            else if (Record->Irp.MajorFunction == IRP_MJ_QUERY_INFORMATION)
+               Record->Irp.Arg2 = (PVOID)(ULONG_PTR)(_Random() % 20);
+         } else {
+            h->Type = ertIRPCompletion;
+            Record->Completion.IRPAddress = (PVOID)(ULONG_PTR)(0xffffe00030000000 + (_Random() % 64)*0x100);
+            Record->Completion.CompletionStatus = h->Result.NTSTATUSValue;
+            Record->Completion.CompletionInformation = (h->Result.NTSTATUSValue == 0) ? 4096 : 0;
+         }
+         break;
+   }
+
+   return;
+}
+
+
+/** Finds names of the driver and device of a typical record; other records have none. */
+static void _NamesGet(PREQUEST_HEADER Header, PULONG Driver, PULONG Device)
+{
+   *Driver = BENCH_DRIVERS;
+   *Device = BENCH_DRIVERS*BENCH_DEVICES;
+   if ((ULONG_PTR)Header->Driver - 0xffffe00010000000 < BENCH_DRIVERS*0x1000 && (ULONG_PTR)Header->Device - 0xffffe00020000000 < BENCH_DRIVERS*BENCH_DEVICES*0x1000) {
+      *Driver = (ULONG)(((ULONG_PTR)Header->Driver - 0xffffe00010000000) / 0x1000);
+      *Device = (ULONG)(((ULONG_PTR)Header->Device - 0xffffe00020000000) / 0x1000);
+   }
+
+   return;
+}
+
+
+static void _OldPrint(FILE *Stream, const std::vector<BENCH_RECORD> & Records)
+{
+   ULONG driver = 0;
+   ULONG device = 0;
+
+   for (auto it = Records.cbegin(); it != Records.cend(); ++it) {
+      _NamesGet((PREQUEST_HEADER)&it->Header, &driver, &device);
+      _OldRequestPrint(Stream, (PREQUEST_HEADER)&it->Header, (driver < BENCH_DRIVERS) ? _driverNames[driver] : L"", (device < BENCH_DRIVERS*BENCH_DEVICES) ? _deviceNames[device] : L"");
+   }
+
+   fflush(Stream);
+
+   return;
+}
+
+
+static void _NewPrint(FILE *Stream, const std::vector<BENCH_RECORD> & Records, const std::vector<std::string> & DriverNames, const std::vector<std::string> & DeviceNames, PREQUEST_FORMAT_BUFFER Buffer)
+{
+   ULONG driver = 0;
+   ULONG device = 0;
+
+   Buffer->Length = 0;
+   for (auto it = Records.cbegin(); it != Records.cend(); ++it) {
+      _NamesGet((PREQUEST_HEADER)&it->Header, &driver, &device);
+      if (RequestFormatHeader(Buffer, &it->Header, (driver < BENCH_DRIVERS) ? DriverNames[driver].c_str() : NULL, (device < BENCH_DRIVERS*BENCH_DEVICES) ? DeviceNames[device].c_str() : NULL) != ERROR_SUCCESS ||
+         RequestFormatDetails(Buffer, &it->Header) != ERROR_SUCCESS) {
+         fprintf(stderr, "out of memory\n");
+         exit(1);
+      }
+
+      if (Buffer->Length >= REQUEST_FORMAT_FLUSH_LENGTH) {
+         fwrite(Buffer->Data, 1, Buffer->Length, Stream);
+         Buffer->Length = 0;
+      }
+   }
+
+   fwrite(Buffer->Data, 1, Buffer->Length, Stream);
+   Buffer->Length = 0;
+   fflush(Stream);
+
+   return;
+}
+
+
+static std::string _Utf8(const wchar_t *String)
+{
+   char buffer[128];
+
+   WideCharToMultiByte(CP_UTF8, 0, String, -1, buffer, sizeof(buffer), NULL, NULL);
+
+   return buffer;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG count = BENCH_RECORDS;
+   double start = 0;
+   double oldTime = 0;
+   double newTime = 0;
+   char *oldText = NULL;
+   char *newText = NULL;
+   size_t oldLength = 0;
+   size_t newLength = 0;
+   FILE *stream = NULL;
+   FILE *devNull = NULL;
+   REQUEST_FORMAT_BUFFER buffer;
+   std::vector<BENCH_RECORD> records;
+   std::vector<std::string> driverNames;
+   std::vector<std::string> deviceNames;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   if (argc > 1)
+      count = (ULONG)atol(argv[1]);
+
+   err = LibTranslateInitialize();
+   if (err != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot initialize libtranslate: %u\n", err);
+      return 1;
+   }
+
+   devNull = fopen("/dev/null", "w");
+   if (devNull == NULL) {
+      perror("/dev/null");
+      return 1;
+   }
+
+   for (i = 0; i < BENCH_DRIVERS; ++i)
+      driverNames.push_back(_Utf8(_driverNames[i]));
+
+   for (i = 0; i < BENCH_DRIVERS*BENCH_DEVICES; ++i)
+      deviceNames.push_back(_Utf8(_deviceNames[i]));
+
+   RequestFormatBufferInit(&buffer);
+   records.resize(count);
+   printf("%8s %8s %10s %12s %12s %8s\n", "records", "workload", "bytes", "old rec/s", "new rec/s", "speedup");
+   for (i = 0; i < ebwMax; ++i) {
+      for (auto it = records.begin(); it != records.end(); ++it) {
+         if (i == ebwTypical)
+            _RecordTypical(&*it);
+         else _RecordRandom(&*it);
+      }
+
+      stream = open_memstream(&oldText, &oldLength);
+      _OldPrint(stream, records);
+      fclose(stream);
+      stream = open_memstream(&newText, &newLength);
+      _NewPrint(stream, records, driverNames, deviceNames, &buffer);
+      fclose(stream);
+      if (oldLength != newLength || memcmp(oldText, newText, oldLength) != 0) {
+         for (j = 0; j < oldLength && j < newLength && oldText[j] == newText[j]; ++j)
+            ;
+
+         fprintf(stderr, "%s: the texts differ at byte %u\n", _workloadNames[i], j);
+         return 1;
+      }
+
+      free(oldText);
+      free(newText);
+      oldTime = 0;
+      newTime = 0;
+      for (j = 0; j < BENCH_RUNS; ++j) {
+         start = _Now();
+         _OldPrint(devNull, records);
+         if (oldTime == 0 || _Now() - start < oldTime)
+            oldTime = _Now() - start;
+
+         start = _Now();
+         _NewPrint(devNull, records, driverNames, deviceNames, &buffer);
+         if (newTime == 0 || _Now() - start < newTime)
+            newTime = _Now() - start;
+      }
+
+      printf("%8u %8s %10zu %12.0f %12.0f %7.1fx\n", count, _workloadNames[i], oldLength, count / oldTime, count / newTime, oldTime / newTime);
+   }
+
+   RequestFormatBufferFree(&buffer);
+   fclose(devNull);
+   LibTranslateFinalize();
+
+   return 0;
+}
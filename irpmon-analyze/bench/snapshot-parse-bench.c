@@ -0,0 +1,269 @@
+/**
+ * @file
+ *
+ * Compares decoding of the driver and device snapshot (output of
+ * IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO) by the codec of irpmondll, which
+ * places the whole result into one memory block, with the previous decoding
+ * that allocated every driver and device structure separately. The previous
+ * decoding is reproduced here. Each snapshot is decoded, walked (every name is
+ * read) and freed; the snapshots are built by the codec routines the mock
+ * driver uses.
+ */
+
+#include <time.h>
+#include <windows.h>
+#include "general-types.h"
+#include "kernel-shared.h"
+#include "ioctls.h"
+#include "irpmondll-types.h"
+#include "codec.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+/** Maximum number of devices of a driver; driver I owns I % (BENCH_MAX_DEVICES + 1) devices. */
+#define BENCH_MAX_DEVICES        4
+
+typedef enum _EBenchDecode {
+   ebdSeparate,
+   ebdBlock,
+   ebdMax,
+} EBenchDecode;
+
+static const char *_decodeNames[ebdMax] = {
+   "separate",
+   "block",
+};
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT _SnapshotBuild(ULONG DriverCount)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG offset = 0;
+   ULONG length = 0;
+   WCHAR name[64];
+   PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT ret = NULL;
+   DWORD err = ERROR_SUCCESS;
+
+   // The first pass computes the length, the second one fills the buffer.
+   do {
+      if (length > 0) {
+         ret = (PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, length);
+         if (ret == NULL) {
+            fprintf(stderr, "cannot allocate the snapshot\n");
+            exit(1);
+         }
+      }
+
+      err = ERROR_SUCCESS;
+      offset = sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT);
+      for (i = 0; i < DriverCount; ++i) {
+         swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Driver\\BenchDriver%u", i);
+         if (CodecSnapshotAppendDriver(ret, length, &offset, (PVOID)(ULONG_PTR)(0x10000 + i*0x100), i % (BENCH_MAX_DEVICES + 1), name, (ULONG)(wcslen(name)*sizeof(WCHAR))) != ERROR_SUCCESS)
+            err = ERROR_INSUFFICIENT_BUFFER;
+
+         for (j = 0; j < i % (BENCH_MAX_DEVICES + 1); ++j) {
+            // Some devices have no name.
+            name[0] = L'\0';
+            if (j % 3 != 2)
+               swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Device\\BenchDevice%u_%u", i, j);
+
+            if (CodecSnapshotAppendDevice(ret, length, &offset, (PVOID)(ULONG_PTR)(0x10000 + i*0x100 + j*0x10 + 8), NULL, name, (ULONG)(wcslen(name)*sizeof(WCHAR))) != ERROR_SUCCESS)
+               err = ERROR_INSUFFICIENT_BUFFER;
+         }
+      }
+
+      length = offset;
+   } while (err != ERROR_SUCCESS);
+
+   ret->RequiredLength = length;
+   ret->DriverCount = DriverCount;
+
+   return ret;
+}
+
+
+/** Decodes a snapshot the way DriverComSnapshotRetrieve did before the codec. */
+static PIRPMON_DRIVER_INFO *_SeparateDecode(PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG deviceCount = 0;
+   ULONG nameLen = 0;
+   PVOID object = NULL;
+   PIRPMON_DRIVER_INFO driver = NULL;
+   PIRPMON_DEVICE_INFO device = NULL;
+   PUCHAR tmpBuffer = (PUCHAR)(Snapshot + 1);
+   PIRPMON_DRIVER_INFO *ret = NULL;
+
+   ret = (PIRPMON_DRIVER_INFO *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Snapshot->DriverCount*sizeof(PIRPMON_DRIVER_INFO));
+   for (i = 0; i < Snapshot->DriverCount; ++i) {
+      object = *(PVOID *)tmpBuffer;
+      tmpBuffer += sizeof(PVOID);
+      deviceCount = *(PULONG)tmpBuffer;
+      tmpBuffer += sizeof(ULONG);
+      nameLen = *(PULONG)tmpBuffer;
+      tmpBuffer += sizeof(ULONG);
+      driver = (PIRPMON_DRIVER_INFO)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(IRPMON_DRIVER_INFO) + nameLen + sizeof(WCHAR) + deviceCount*sizeof(PIRPMON_DEVICE_INFO));
+      driver->DriverObject = object;
+      driver->DeviceCount = deviceCount;
+      driver->DriverName = (PWCHAR)(driver + 1);
+      memcpy(driver->DriverName, tmpBuffer, nameLen);
+      driver->DriverName[nameLen / sizeof(WCHAR)] = L'\0';
+      driver->Devices = (PIRPMON_DEVICE_INFO *)((PUCHAR)driver->DriverName + nameLen + sizeof(WCHAR));
+      tmpBuffer += nameLen;
+      for (j = 0; j < deviceCount; ++j) {
+         nameLen = *(PULONG)(tmpBuffer + 2*sizeof(PVOID));
+         device = (PIRPMON_DEVICE_INFO)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(IRPMON_DEVICE_INFO) + nameLen + sizeof(WCHAR));
+         device->DeviceObject = *(PVOID *)tmpBuffer;
+         tmpBuffer += sizeof(PVOID);
+         device->AttachedDevice = *(PVOID *)tmpBuffer;
+         tmpBuffer += sizeof(PVOID) + sizeof(ULONG);
+         device->Name = (PWCHAR)(device + 1);
+         memcpy(device->Name, tmpBuffer, nameLen);
+         device->Name[nameLen / sizeof(WCHAR)] = L'\0';
+         tmpBuffer += nameLen;
+         driver->Devices[j] = device;
+      }
+
+      ret[i] = driver;
+   }
+
+   return ret;
+}
+
+
+static VOID _SeparateFree(PIRPMON_DRIVER_INFO *Drivers, ULONG Count)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+
+   for (i = 0; i < Count; ++i) {
+      for (j = 0; j < Drivers[i]->DeviceCount; ++j)
+         HeapFree(GetProcessHeap(), 0, Drivers[i]->Devices[j]);
+
+      HeapFree(GetProcessHeap(), 0, Drivers[i]);
+   }
+
+   HeapFree(GetProcessHeap(), 0, Drivers);
+
+   return;
+}
+
+
+static PIRPMON_DRIVER_INFO *_BlockDecode(PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot)
+{
+   ULONG deviceCount = 0;
+   SIZE_T blockSize = 0;
+   PVOID block = NULL;
+
+   if (CodecSnapshotMeasure(Snapshot, &deviceCount, &blockSize) != ERROR_SUCCESS) {
+      fprintf(stderr, "invalid snapshot\n");
+      exit(1);
+   }
+
+   block = HeapAlloc(GetProcessHeap(), 0, blockSize);
+
+   return CodecSnapshotDecode(Snapshot, deviceCount, block);
+}
+
+
+static SIZE_T _Walk(PIRPMON_DRIVER_INFO *Drivers, ULONG Count)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   SIZE_T ret = 0;
+
+   for (i = 0; i < Count; ++i) {
+      ret += wcslen(Drivers[i]->DriverName) + (ULONG_PTR)Drivers[i]->DriverObject;
+      for (j = 0; j < Drivers[i]->DeviceCount; ++j)
+         ret += wcslen(Drivers[i]->Devices[j]->Name) + (ULONG_PTR)Drivers[i]->Devices[j]->DeviceObject;
+   }
+
+   return ret;
+}
+
+
+/** Returns time of one decode, walk and free, in microseconds. */
+static double _Run(EBenchDecode Decode, PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot, SIZE_T Expected, double Seconds)
+{
+   ULONG i = 0;
+   ULONG64 count = 0;
+   double start = 0;
+   double elapsed = 0;
+   PIRPMON_DRIVER_INFO *drivers = NULL;
+
+   start = _Now();
+   do {
+      for (i = 0; i < 16; ++i) {
+         drivers = (Decode == ebdBlock) ? _BlockDecode(Snapshot) : _SeparateDecode(Snapshot);
+         if (_Walk(drivers, Snapshot->DriverCount) != Expected) {
+            fprintf(stderr, "%s: wrong decoded snapshot\n", _decodeNames[Decode]);
+            exit(1);
+         }
+
+         if (Decode == ebdBlock)
+            HeapFree(GetProcessHeap(), 0, drivers);
+         else _SeparateFree(drivers, Snapshot->DriverCount);
+      }
+
+      count += 16;
+      elapsed = _Now() - start;
+   } while (elapsed < Seconds);
+
+   return elapsed / count * 1e6;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   SIZE_T expected = 0;
+   double seconds = 0.5;
+   double times[ebdMax];
+   PIRPMON_DRIVER_INFO *drivers = NULL;
+   PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT snapshot = NULL;
+   static const ULONG driverCounts[] = {100, 400, 2000};
+
+   if (argc > 1)
+      seconds = atof(argv[1]);
+
+   printf("%8s %8s %10s %12s %12s %8s\n", "drivers", "devices", "bytes", "separate us", "block us", "speedup");
+   for (i = 0; i < sizeof(driverCounts) / sizeof(driverCounts[0]); ++i) {
+      snapshot = _SnapshotBuild(driverCounts[i]);
+      drivers = _SeparateDecode(snapshot);
+      expected = _Walk(drivers, snapshot->DriverCount);
+      _SeparateFree(drivers, snapshot->DriverCount);
+      for (j = 0; j < ebdMax; ++j)
+         times[j] = _Run((EBenchDecode)j, snapshot, expected, seconds);
+
+      printf("%8u %8u %10u %12.1f %12.1f %7.1fx\n", driverCounts[i], driverCounts[i] / (BENCH_MAX_DEVICES + 1) * (BENCH_MAX_DEVICES*(BENCH_MAX_DEVICES + 1) / 2), snapshot->RequiredLength, times[ebdSeparate], times[ebdBlock], times[ebdSeparate] / times[ebdBlock]);
+      HeapFree(GetProcessHeap(), 0, snapshot);
+   }
+
+   return 0;
+}
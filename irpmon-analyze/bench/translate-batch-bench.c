@@ -0,0 +1,240 @@
+/**
+ * @file
+ *
+ * Compares the batch translation routines of the translation library with
+ * translating the same values one by one. 4096 NTSTATUS values and 4096 IOCTL
+ * codes, all present in the tables and in random order (as in a snapshot), go
+ * through LibTranslateGeneralIntegerValuesToStrings and through
+ * LibTranslateGeneralIntegerValueToString, and directly through
+ * GVTableGetBatch and GVTableGet. NTSTATUS and IOCTL codes are not
+ * enumerations, so LibTranslateEnumerationValuesToStrings is measured with
+ * PnP minor function codes.
+ */
+
+#include <time.h>
+#include <windows.h>
+#include "libtranslate.h"
+#include "translates.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+#define BENCH_VALUE_COUNT        4096
+/** Number of the PnP minor function codes, values beyond are unknown. */
+#define BENCH_PNP_MINOR_COUNT    0x1b
+
+typedef enum _EBenchRoutine {
+   ebrLibrary,
+   ebrTable,
+   ebrEnumeration,
+   ebrMax,
+} EBenchRoutine;
+
+typedef struct _BENCH_CASE {
+   const char *Name;
+   EBenchRoutine Routine;
+   ELibTranslateIntegerValueType Type;
+   ULONG Values[BENCH_VALUE_COUNT];
+} BENCH_CASE, *PBENCH_CASE;
+
+static BENCH_CASE _cases[] = {
+   {"NTSTATUS, API", ebrLibrary, ltivtNTSTATUS},
+   {"IOCTL, API", ebrLibrary, ltivtDeviceControl},
+   {"NTSTATUS, GV table", ebrTable, ltivtNTSTATUS},
+   {"IOCTL, GV table", ebrTable, ltivtDeviceControl},
+   {"PnP minor, API", ebrEnumeration},
+};
+
+static PWCHAR _strings[BENCH_VALUE_COUNT];
+static PGENERAL_VALUE_RECORD _records[BENCH_VALUE_COUNT];
+static ULONG _seed = 1;
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static ULONG _Random(VOID)
+{
+   _seed = _seed * 1103515245 + 12345;
+
+   return (_seed >> 8);
+}
+
+
+/** Fills the case with random values known to its table. */
+static VOID _CaseInit(PBENCH_CASE Case)
+{
+   ULONG i = 0;
+   PGENERAL_VALUE_TABLE table = NULL;
+
+   if (Case->Routine != ebrEnumeration) {
+      table = IntegerValueTable(Case->Type);
+      if (table == NULL || table->Count == 0) {
+         fprintf(stderr, "%s: no General Value Table\n", Case->Name);
+         exit(1);
+      }
+
+      for (i = 0; i < BENCH_VALUE_COUNT; ++i)
+         Case->Values[i] = table->Keys[_Random() % table->Count];
+   } else {
+      for (i = 0; i < BENCH_VALUE_COUNT; ++i)
+         Case->Values[i] = _Random() % BENCH_PNP_MINOR_COUNT;
+   }
+
+   return;
+}
+
+
+/** Translates all values of the case once.
+
+    @return Returns a value depending on the results, so the translations are
+    not optimized away. */
+static ULONG_PTR _Translate(PBENCH_CASE Case, BOOLEAN Batch)
+{
+   ULONG i = 0;
+   ULONG_PTR ret = 0;
+   PGENERAL_VALUE_TABLE table = NULL;
+
+   switch (Case->Routine) {
+      case ebrLibrary:
+         if (Batch)
+            LibTranslateGeneralIntegerValuesToStrings(Case->Type, FALSE, Case->Values, BENCH_VALUE_COUNT, _strings);
+         else {
+            for (i = 0; i < BENCH_VALUE_COUNT; ++i)
+               _strings[i] = LibTranslateGeneralIntegerValueToString(Case->Type, FALSE, Case->Values[i]);
+         }
+
+         for (i = 0; i < BENCH_VALUE_COUNT; i += 64)
+            ret += (ULONG_PTR)_strings[i];
+         break;
+      case ebrTable:
+         table = IntegerValueTable(Case->Type);
+         if (Batch)
+            GVTableGetBatch(table, Case->Values, BENCH_VALUE_COUNT, _records);
+         else {
+            for (i = 0; i < BENCH_VALUE_COUNT; ++i)
+               _records[i] = GVTableGet(table, Case->Values[i]);
+         }
+
+         for (i = 0; i < BENCH_VALUE_COUNT; i += 64)
+            ret += (ULONG_PTR)_records[i];
+         break;
+      case ebrEnumeration:
+         if (Batch)
+            LibTranslateEnumerationValuesToStrings(ltetIRPPnPMinorFunction, FALSE, Case->Values, BENCH_VALUE_COUNT, _strings);
+         else {
+            for (i = 0; i < BENCH_VALUE_COUNT; ++i)
+               _strings[i] = LibTranslateEnumerationValueToString(ltetIRPPnPMinorFunction, FALSE, Case->Values[i]);
+         }
+
+         for (i = 0; i < BENCH_VALUE_COUNT; i += 64)
+            ret += (ULONG_PTR)_strings[i];
+         break;
+      default:
+         break;
+   }
+
+   return ret;
+}
+
+
+/** Checks that the batch and the per-value translations agree. */
+static VOID _CaseVerify(PBENCH_CASE Case)
+{
+   ULONG i = 0;
+   PWCHAR strings[BENCH_VALUE_COUNT];
+   PGENERAL_VALUE_RECORD records[BENCH_VALUE_COUNT];
+
+   _Translate(Case, TRUE);
+   memcpy(strings, _strings, sizeof(strings));
+   memcpy(records, _records, sizeof(records));
+   _Translate(Case, FALSE);
+   for (i = 0; i < BENCH_VALUE_COUNT; ++i) {
+      if ((Case->Routine == ebrTable) ? records[i] != _records[i] : strings[i] != _strings[i]) {
+         fprintf(stderr, "%s: value 0x%x translated differently\n", Case->Name, Case->Values[i]);
+         exit(1);
+      }
+   }
+
+   return;
+}
+
+
+/** Translates the values repeatedly for the given time.
+
+    @return Returns millions of translated values per second in the fastest
+    pass; the fastest pass is the least disturbed by other processes. */
+static double _Run(PBENCH_CASE Case, BOOLEAN Batch, double Seconds)
+{
+   double start = 0;
+   double passStart = 0;
+   double pass = 0;
+   double best = 0;
+   ULONG_PTR sum = 0;
+
+   start = _Now();
+   do {
+      passStart = _Now();
+      sum += _Translate(Case, Batch);
+      pass = _Now() - passStart;
+      if (best == 0 || pass < best)
+         best = pass;
+   } while (_Now() - start < Seconds);
+
+   // Keep the translations from being optimized away.
+   if (sum == 1)
+      printf("\n");
+
+   return BENCH_VALUE_COUNT / best / 1e6;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   double seconds = 0.5;
+   double single = 0;
+   double batch = 0;
+
+   if (argc > 1)
+      seconds = atof(argv[1]);
+
+   if (LibTranslateInitialize() != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot initialize the translation library\n");
+      return 1;
+   }
+
+   printf("%u values per call, Mvalues/s in the fastest pass\n", BENCH_VALUE_COUNT);
+   printf("%-20s %10s %10s %8s\n", "", "per value", "batch", "speedup");
+   for (i = 0; i < sizeof(_cases) / sizeof(_cases[0]); ++i) {
+      _CaseInit(_cases + i);
+      _CaseVerify(_cases + i);
+      single = _Run(_cases + i, FALSE, seconds);
+      batch = _Run(_cases + i, TRUE, seconds);
+      printf("%-20s %10.1f %10.1f %7.2fx\n", _cases[i].Name, single, batch, batch / single);
+      fflush(stdout);
+   }
+
+   LibTranslateFinalize();
+
+   return 0;
+}
@@ -0,0 +1,420 @@
+/**
+ * @file
+ *
+ * Measures how lookups in the tables of the translation library scale with
+ * the number of threads. Two P2P tables hold the same mapping (shaped like
+ * the NTSTATUS to Windows error one); one of them is frozen by
+ * @link(P2PHashTableFreeze), the other one keeps its per-stripe locks.
+ *
+ * The General Value arrays of translates-arrays.h are looked up both in the
+ * sorted General Value Tables (gv-table.c) and in the hash tables the library
+ * used before them. The old tables are reproduced here: every array element
+ * is linked into a general hash table of the original bucket count, keyed by
+ * its value. The time needed to build all the tables at startup is measured
+ * for both.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include <windows.h>
+#include "libtranslate.h"
+#include "libtranslate-hash-table.h"
+#include "p2p-hash-table.h"
+#include "gv-table.h"
+// Only the General Value arrays of the file are used.
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include "translates-arrays.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+#define BENCH_KEY_COUNT          2048
+#define BENCH_MAX_THREADS        16
+#define BENCH_STARTUP_RUNS       20
+
+typedef enum _EBenchLookup {
+   eblP2PLocked,
+   eblP2PFrozen,
+   eblGVHash,
+   eblGVSorted,
+   eblMax,
+} EBenchLookup;
+
+typedef struct _BENCH_THREAD_CONTEXT {
+   EBenchLookup Lookup;
+   PHASH_TABLE Table;
+   ULONG Seed;
+   ULONG64 Operations;
+} BENCH_THREAD_CONTEXT, *PBENCH_THREAD_CONTEXT;
+
+/** An array element linked into the old General Value hash table. The
+    HASH_ITEM used to be a member of GENERAL_VALUE itself. */
+typedef struct _BENCH_GV_HASH_ITEM {
+   HASH_ITEM HashItem;
+   PGENERAL_VALUE Value;
+} BENCH_GV_HASH_ITEM, *PBENCH_GV_HASH_ITEM;
+
+typedef struct _BENCH_GV_ARRAY {
+   PGENERAL_VALUE Items;
+   ULONG Count;
+   /** Bucket count of the old hash table. */
+   ULONG HashSize;
+   PBENCH_GV_HASH_ITEM HashItems;
+   /** Unsorted copy of the array, sorted by GVTablesPrepare. */
+   PGENERAL_VALUE Copy;
+   GENERAL_VALUE_TABLE Table;
+} BENCH_GV_ARRAY, *PBENCH_GV_ARRAY;
+
+#define BENCH_GV_ARRAY_INIT(aArray, aHashSize)    {aArray, sizeof(aArray) / sizeof(aArray[0]), aHashSize}
+
+/** The arrays in the order of the library, with the bucket counts of the
+    old hash tables. The device type table did not exist then; it gets the
+    count of the other small tables. */
+static BENCH_GV_ARRAY _gvArrays[] = {
+   BENCH_GV_ARRAY_INIT(_winEventHooks, 233),
+   BENCH_GV_ARRAY_INIT(_ntstatus, 233),
+   BENCH_GV_ARRAY_INIT(_windowsError, 233),
+   BENCH_GV_ARRAY_INIT(_windowsMessages, 233),
+   BENCH_GV_ARRAY_INIT(_sctpPort, 7),
+   BENCH_GV_ARRAY_INIT(_dccpPort, 11),
+   BENCH_GV_ARRAY_INIT(_tcpPort, 797),
+   BENCH_GV_ARRAY_INIT(_udpPort, 797),
+   BENCH_GV_ARRAY_INIT(_irpMajorFunction, 31),
+   BENCH_GV_ARRAY_INIT(_volumeDeviceType, 31),
+   BENCH_GV_ARRAY_INIT(_WindowsHook, 31),
+   BENCH_GV_ARRAY_INIT(_ioControlCodes, 31),
+   BENCH_GV_ARRAY_INIT(_deviceType, 31),
+};
+
+#define BENCH_GV_ARRAY_COUNT     (sizeof(_gvArrays) / sizeof(_gvArrays[0]))
+/** The NTSTATUS array, used for the General Value lookups. */
+#define BENCH_GV_LOOKUP_ARRAY    1
+
+static const char *_lookupNames[eblMax] = {
+   "P2P locked",
+   "P2P frozen",
+   "GV hash (old)",
+   "GV sorted",
+};
+
+static ULONG_PTR _keys[BENCH_KEY_COUNT];
+/** NTSTATUS values present in the General Value tables. */
+static ULONG _gvKeys[BENCH_KEY_COUNT];
+static volatile LONG _stop = 0;
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static ULONG32 _GVHashFunction(PVOID Key)
+{
+   return HashTablePointerHash(Key);
+}
+
+
+static BOOLEAN _GVCompareFunction(PHASH_ITEM ObjectInTable, PVOID Key)
+{
+   PBENCH_GV_HASH_ITEM item = CONTAINING_RECORD(ObjectInTable, BENCH_GV_HASH_ITEM, HashItem);
+
+   return ((ULONG32)(ULONG_PTR)Key == item->Value->Value);
+}
+
+
+static VOID _GVFreeFunction(PHASH_ITEM Object)
+{
+   return;
+}
+
+
+/** Builds the old hash table of an array, the way the library did at
+    startup. */
+static PHASH_TABLE _GVHashTableCreate(PBENCH_GV_ARRAY Array)
+{
+   ULONG i = 0;
+   PHASH_TABLE ret = NULL;
+
+   if (HashTableCreate(Array->HashSize, _GVHashFunction, _GVCompareFunction, _GVFreeFunction, &ret) != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot create the General Value hash table\n");
+      exit(1);
+   }
+
+   for (i = 0; i < Array->Count; ++i)
+      HashTableInsert(ret, &Array->HashItems[i].HashItem, (PVOID)(ULONG_PTR)Array->Items[i].Value);
+
+   return ret;
+}
+
+
+/** Prepares the sorted tables from unsorted copies of the arrays. Only one
+    group of tables may be prepared at a time. */
+static VOID _GVTablesPrepare(VOID)
+{
+   ULONG i = 0;
+   PGENERAL_VALUE_TABLE tables[BENCH_GV_ARRAY_COUNT];
+
+   for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i) {
+      memset(&_gvArrays[i].Table, 0, sizeof(_gvArrays[i].Table));
+      _gvArrays[i].Table.Items = _gvArrays[i].Copy;
+      _gvArrays[i].Table.Count = _gvArrays[i].Count;
+      tables[i] = &_gvArrays[i].Table;
+   }
+
+   if (GVTablesPrepare(tables, BENCH_GV_ARRAY_COUNT) != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot prepare the General Value tables\n");
+      exit(1);
+   }
+
+   return;
+}
+
+
+static VOID _GVTablesFinit(VOID)
+{
+   ULONG i = 0;
+   PGENERAL_VALUE_TABLE tables[BENCH_GV_ARRAY_COUNT];
+
+   for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i)
+      tables[i] = &_gvArrays[i].Table;
+
+   GVTablesFinit(tables, BENCH_GV_ARRAY_COUNT);
+
+   return;
+}
+
+
+/** Measures building of all the General Value tables at startup, best of
+    BENCH_STARTUP_RUNS runs.
+
+    @return Returns the time in microseconds. */
+static double _StartupRun(BOOLEAN Sorted)
+{
+   ULONG i = 0;
+   ULONG run = 0;
+   double start = 0;
+   double elapsed = 0;
+   double ret = 0;
+   PHASH_TABLE tables[BENCH_GV_ARRAY_COUNT];
+
+   for (run = 0; run < BENCH_STARTUP_RUNS; ++run) {
+      if (Sorted) {
+         // The copies are sorted in place, restore the source order.
+         for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i)
+            memcpy(_gvArrays[i].Copy, _gvArrays[i].Items, _gvArrays[i].Count * sizeof(GENERAL_VALUE));
+
+         start = _Now();
+         _GVTablesPrepare();
+         elapsed = _Now() - start;
+         _GVTablesFinit();
+      } else {
+         start = _Now();
+         for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i)
+            tables[i] = _GVHashTableCreate(_gvArrays + i);
+
+         elapsed = _Now() - start;
+         for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i)
+            HashTableDestroy(tables[i]);
+      }
+
+      if (run == 0 || elapsed < ret)
+         ret = elapsed;
+   }
+
+   return ret * 1e6;
+}
+
+
+static PVOID _BenchThread(PVOID Context)
+{
+   ULONG i = 0;
+   ULONG index = 0;
+   ULONG_PTR value = 0;
+   ULONG_PTR sum = 0;
+   PHASH_ITEM item = NULL;
+   PGENERAL_VALUE_RECORD record = NULL;
+   PBENCH_THREAD_CONTEXT ctx = (PBENCH_THREAD_CONTEXT)Context;
+
+   index = ctx->Seed;
+   while (!__atomic_load_n(&_stop, __ATOMIC_RELAXED)) {
+      for (i = 0; i < 1024; ++i) {
+         index = (index * 1103515245 + 12345) % BENCH_KEY_COUNT;
+         switch (ctx->Lookup) {
+            case eblP2PLocked:
+            case eblP2PFrozen:
+               P2PHashTableGet(ctx->Table, _keys[index], &value);
+               sum += value;
+               break;
+            case eblGVHash:
+               item = HashTableGet(ctx->Table, (PVOID)(ULONG_PTR)_gvKeys[index]);
+               if (item != NULL)
+                  sum += (ULONG_PTR)CONTAINING_RECORD(item, BENCH_GV_HASH_ITEM, HashItem)->Value->Name;
+               break;
+            case eblGVSorted:
+               record = GVTableGet(&_gvArrays[BENCH_GV_LOOKUP_ARRAY].Table, _gvKeys[index]);
+               if (record != NULL)
+                  sum += record->NameOffset;
+               break;
+            default:
+               break;
+         }
+      }
+
+      ctx->Operations += 1024;
+   }
+
+   // Keep the lookups from being optimized away.
+   if (sum == 1)
+      printf("\n");
+
+   return NULL;
+}
+
+
+static double _Run(EBenchLookup Lookup, PHASH_TABLE Table, ULONG ThreadCount, double Seconds)
+{
+   ULONG i = 0;
+   double start = 0;
+   ULONG64 operations = 0;
+   pthread_t threads[BENCH_MAX_THREADS];
+   BENCH_THREAD_CONTEXT contexts[BENCH_MAX_THREADS];
+
+   _stop = 0;
+   for (i = 0; i < ThreadCount; ++i) {
+      contexts[i].Lookup = Lookup;
+      contexts[i].Table = Table;
+      contexts[i].Seed = i * 7919;
+      contexts[i].Operations = 0;
+   }
+
+   start = _Now();
+   for (i = 0; i < ThreadCount; ++i)
+      pthread_create(threads + i, NULL, _BenchThread, contexts + i);
+
+   while (_Now() - start < Seconds)
+      usleep(10000);
+
+   __atomic_store_n(&_stop, 1, __ATOMIC_RELAXED);
+   for (i = 0; i < ThreadCount; ++i) {
+      pthread_join(threads[i], NULL);
+      operations += contexts[i].Operations;
+   }
+
+   return operations / (_Now() - start) / 1e6;
+}
+
+
+static PHASH_TABLE _TableCreate(BOOLEAN Freeze)
+{
+   ULONG i = 0;
+   PHASH_TABLE ret = NULL;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = P2PHashTableCreate(37, &ret);
+   for (i = 0; err == ERROR_SUCCESS && i < BENCH_KEY_COUNT; ++i)
+      err = P2PHashTableInsert(ret, _keys[i], i);
+
+   if (err == ERROR_SUCCESS && Freeze)
+      err = P2PHashTableFreeze(ret);
+
+   if (err != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot create the table: %u\n", err);
+      exit(1);
+   }
+
+   return ret;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG itemCount = 0;
+   double seconds = 1;
+   double hashStartup = 0;
+   double sortedStartup = 0;
+   PHASH_TABLE tables[eblMax];
+   PBENCH_GV_ARRAY lookupArray = _gvArrays + BENCH_GV_LOOKUP_ARRAY;
+   static const ULONG threadCounts[] = {1, 2, 4, 8, 16};
+
+   if (argc > 1)
+      seconds = atof(argv[1]);
+
+   for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i) {
+      _gvArrays[i].HashItems = (PBENCH_GV_HASH_ITEM)calloc(_gvArrays[i].Count, sizeof(BENCH_GV_HASH_ITEM));
+      _gvArrays[i].Copy = (PGENERAL_VALUE)calloc(_gvArrays[i].Count, sizeof(GENERAL_VALUE));
+      if (_gvArrays[i].HashItems == NULL || _gvArrays[i].Copy == NULL) {
+         fprintf(stderr, "out of memory\n");
+         return 1;
+      }
+
+      for (j = 0; j < _gvArrays[i].Count; ++j)
+         _gvArrays[i].HashItems[j].Value = _gvArrays[i].Items + j;
+
+      itemCount += _gvArrays[i].Count;
+   }
+
+   for (i = 0; i < BENCH_KEY_COUNT; ++i) {
+      _keys[i] = 0xC0000000 + i;
+      _gvKeys[i] = lookupArray->Items[(i * 7) % lookupArray->Count].Value;
+   }
+
+   hashStartup = _StartupRun(FALSE);
+   sortedStartup = _StartupRun(TRUE);
+   printf("Startup, %u tables, %u values, best of %u runs\n", (ULONG)BENCH_GV_ARRAY_COUNT, itemCount, BENCH_STARTUP_RUNS);
+   printf("%-14s %8.1f us\n", _lookupNames[eblGVHash], hashStartup);
+   printf("%-14s %8.1f us\n\n", _lookupNames[eblGVSorted], sortedStartup);
+
+   tables[eblP2PLocked] = _TableCreate(FALSE);
+   tables[eblP2PFrozen] = _TableCreate(TRUE);
+   tables[eblGVHash] = _GVHashTableCreate(lookupArray);
+   tables[eblGVSorted] = NULL;
+   for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i)
+      memcpy(_gvArrays[i].Copy, _gvArrays[i].Items, _gvArrays[i].Count * sizeof(GENERAL_VALUE));
+
+   _GVTablesPrepare();
+   printf("%u keys (GV: %u NTSTATUS values), %ld CPUs, Mlookups/s (all threads together)\n", BENCH_KEY_COUNT, lookupArray->Count, sysconf(_SC_NPROCESSORS_ONLN));
+   printf("%-14s", "threads");
+   for (i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i)
+      printf(" %8u", threadCounts[i]);
+
+   printf("\n");
+   for (j = 0; j < eblMax; ++j) {
+      printf("%-14s", _lookupNames[j]);
+      for (i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+         printf(" %8.1f", _Run((EBenchLookup)j, tables[j], threadCounts[i], seconds));
+         fflush(stdout);
+      }
+
+      printf("\n");
+   }
+
+   _GVTablesFinit();
+   HashTableDestroy(tables[eblGVHash]);
+   P2PHashTableDestroy(tables[eblP2PFrozen]);
+   P2PHashTableDestroy(tables[eblP2PLocked]);
+   for (i = 0; i < BENCH_GV_ARRAY_COUNT; ++i) {
+      free(_gvArrays[i].Copy);
+      free(_gvArrays[i].HashItems);
+   }
+
+   return 0;
+}
@@ -0,0 +1,559 @@
+
+/**
+ * @file
+ *
+ * Reads capture files written by irpmonconsole --capture (see capture-format.h).
+ * The file is mapped into memory as a whole; blocks stored without compression
+ * are accessed in place.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <string>
+#include <thread>
+#include <vector>
+#include <windows.h>
+#include "general-types.h"
+#include "capture-format.h"
+#include "lz4-block.h"
+#include "capture-reader.h"
+
+
+
+/************************************************************************/
+/*                           MACRO DEFINITIONS                          */
+/************************************************************************/
+
+/** Upper bound of decompressed block length accepted from the file. */
+#define CAPTURE_BLOCK_LENGTH_MAX			(256*1024*1024)
+
+/** Number of blocks per worker thread that may be processed ahead of the
+    oldest block not committed yet. */
+#define CAPTURE_BLOCK_WINDOW				4
+
+
+/************************************************************************/
+/*                           TYPE DEFINITIONS                           */
+/************************************************************************/
+
+/** State shared by the worker threads of CaptureReaderBlocksProcess. */
+typedef struct _CAPTURE_BLOCK_POOL {
+	PCAPTURE_READER Reader;
+	const std::vector<ULONG> *Blocks;
+	CAPTURE_BLOCK_CALLBACK *Callback;
+	CAPTURE_BLOCK_COMMIT_CALLBACK *Commit;
+	PVOID Context;
+	/** Position of the next block to be taken by a worker. */
+	std::atomic<ULONG> Next;
+	/** Maximum distance between a block being processed and the next block
+	    to commit. Bounds the memory held by processed blocks. */
+	ULONG Window;
+	std::mutex Lock;
+	std::condition_variable Committed;
+	/** Blocks processed by the callback. */
+	std::vector<BOOLEAN> Done;
+	/** Position of the next block to commit. */
+	ULONG NextCommit;
+	/** Set while a worker commits blocks. */
+	BOOLEAN Committing;
+} CAPTURE_BLOCK_POOL, *PCAPTURE_BLOCK_POOL;
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+static DWORD _ErrnoToError(int Error)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	switch (Error) {
+		case ENOENT:
+			ret = ERROR_FILE_NOT_FOUND;
+			break;
+		case ENOMEM:
+			ret = ERROR_NOT_ENOUGH_MEMORY;
+			break;
+		case EACCES:
+		case EPERM:
+			ret = ERROR_ACCESS_DENIED;
+			break;
+	}
+
+	return ret;
+}
+
+
+/** Checks that a record is large enough for its type, including the names
+ *  stored after the structure. */
+static BOOLEAN _RecordValid(const REQUEST_HEADER *Header, ULONG Size)
+{
+	BOOLEAN ret = FALSE;
+
+	switch (Header->Type) {
+		case ertIRP:
+			ret = (Size >= sizeof(REQUEST_IRP));
+			break;
+		case ertIRPCompletion:
+			ret = (Size >= sizeof(REQUEST_IRP_COMPLETION));
+			break;
+		case ertFastIo:
+			ret = (Size >= sizeof(REQUEST_FASTIO));
+			break;
+		case ertStartIo:
+			ret = (Size >= sizeof(REQUEST_STARTIO));
+			break;
+		case ertDriverDetected: {
+			const REQUEST_DRIVER_DETECTED *r = CONTAINING_RECORD(Header, REQUEST_DRIVER_DETECTED, Header);
+
+			ret = (Size >= sizeof(REQUEST_DRIVER_DETECTED) && r->DriverNameLength <= Size - sizeof(REQUEST_DRIVER_DETECTED));
+		} break;
+		case ertDeviceDetected: {
+			const REQUEST_DEVICE_DETECTED *r = CONTAINING_RECORD(Header, REQUEST_DEVICE_DETECTED, Header);
+
+			ret = (Size >= sizeof(REQUEST_DEVICE_DETECTED) && r->DeviceNameLength <= Size - sizeof(REQUEST_DEVICE_DETECTED));
+		} break;
+		case ertProcessCreated: {
+			const REQUEST_PROCESS_CREATED *r = CONTAINING_RECORD(Header, REQUEST_PROCESS_CREATED, Header);
+
+			ret = (Size >= sizeof(REQUEST_PROCESS_CREATED) &&
+				r->ImageNameOffset <= Size && r->ImageNameLength <= Size - r->ImageNameOffset &&
+				r->CommandLineOffset <= Size && r->CommandLineLength <= Size - r->CommandLineOffset);
+		} break;
+		case ertProcessExitted:
+			ret = (Size >= sizeof(REQUEST_PROCESS_EXITTED));
+			break;
+		default:
+			ret = (Size >= sizeof(REQUEST_HEADER));
+			break;
+	}
+
+	return ret;
+}
+
+
+static DWORD _SnapshotRead(PCAPTURE_READER Reader)
+{
+	ULONG64 offset = sizeof(CAPTURE_FILE_HEADER);
+	ULONG64 end = Reader->Header->HeaderLength;
+	DWORD ret = ERROR_SUCCESS;
+
+	for (ULONG i = 0; i < Reader->Header->DriverCount; ++i) {
+		const CAPTURE_SNAPSHOT_DRIVER *d = (const CAPTURE_SNAPSHOT_DRIVER *)(Reader->View + offset);
+		CAPTURE_READER_DRIVER driver;
+
+		if (end - offset < sizeof(CAPTURE_SNAPSHOT_DRIVER) ||
+			end - offset - sizeof(CAPTURE_SNAPSHOT_DRIVER) < CaptureAlign(d->NameLength)) {
+			ret = ERROR_INVALID_DATA;
+			break;
+		}
+
+		driver.DriverObject = d->DriverObject;
+		driver.Name = CaptureStringRead(d + 1, d->NameLength);
+		offset += sizeof(CAPTURE_SNAPSHOT_DRIVER) + CaptureAlign(d->NameLength);
+		for (ULONG j = 0; j < d->DeviceCount; ++j) {
+			const CAPTURE_SNAPSHOT_DEVICE *v = (const CAPTURE_SNAPSHOT_DEVICE *)(Reader->View + offset);
+			CAPTURE_READER_DEVICE device;
+
+			if (end - offset < sizeof(CAPTURE_SNAPSHOT_DEVICE) ||
+				end - offset - sizeof(CAPTURE_SNAPSHOT_DEVICE) < CaptureAlign(v->NameLength)) {
+				ret = ERROR_INVALID_DATA;
+				break;
+			}
+
+			device.DeviceObject = v->DeviceObject;
+			device.AttachedDevice = v->AttachedDevice;
+			device.Name = CaptureStringRead(v + 1, v->NameLength);
+			driver.Devices.push_back(device);
+			offset += sizeof(CAPTURE_SNAPSHOT_DEVICE) + CaptureAlign(v->NameLength);
+		}
+
+		if (ret != ERROR_SUCCESS)
+			break;
+
+		Reader->Drivers.push_back(driver);
+	}
+
+	return ret;
+}
+
+
+static BOOLEAN _BlockIndexValid(const CAPTURE_READER *Reader, const CAPTURE_BLOCK_INDEX *Index, ULONG64 End)
+{
+	BOOLEAN ret = FALSE;
+
+	ret = (Index->Offset >= Reader->Header->HeaderLength &&
+		Index->Offset % CAPTURE_ALIGNMENT == 0 &&
+		Index->Offset <= End &&
+		End - Index->Offset >= sizeof(CAPTURE_BLOCK_HEADER) &&
+		End - Index->Offset - sizeof(CAPTURE_BLOCK_HEADER) >= Index->CompressedLength &&
+		Index->Length <= CAPTURE_BLOCK_LENGTH_MAX &&
+		(Index->Compression == ccLZ4 || (Index->Compression == ccNone && Index->CompressedLength == Index->Length)));
+
+	return ret;
+}
+
+
+/** Reads the index at the end of the file. */
+static BOOLEAN _IndexRead(PCAPTURE_READER Reader)
+{
+	const CAPTURE_FILE_TRAILER *trailer = NULL;
+	const CAPTURE_BLOCK_INDEX *index = NULL;
+	ULONG64 indexEnd = 0;
+	BOOLEAN ret = FALSE;
+
+	ret = (Reader->Length - Reader->Header->HeaderLength >= sizeof(CAPTURE_FILE_TRAILER));
+	if (ret) {
+		trailer = (const CAPTURE_FILE_TRAILER *)(Reader->View + Reader->Length - sizeof(CAPTURE_FILE_TRAILER));
+		indexEnd = Reader->Length - sizeof(CAPTURE_FILE_TRAILER);
+		ret = (trailer->Signature == CAPTURE_TRAILER_SIGNATURE &&
+			trailer->IndexOffset >= Reader->Header->HeaderLength &&
+			trailer->IndexOffset % CAPTURE_ALIGNMENT == 0 &&
+			trailer->IndexOffset <= indexEnd &&
+			(indexEnd - trailer->IndexOffset) / sizeof(CAPTURE_BLOCK_INDEX) == trailer->BlockCount);
+	}
+
+	if (ret) {
+		index = (const CAPTURE_BLOCK_INDEX *)(Reader->View + trailer->IndexOffset);
+		for (ULONG i = 0; i < trailer->BlockCount; ++i) {
+			ret = _BlockIndexValid(Reader, index + i, trailer->IndexOffset);
+			if (!ret)
+				break;
+		}
+	}
+
+	if (ret)
+		Reader->Blocks.assign(index, index + trailer->BlockCount);
+
+	return ret;
+}
+
+
+/** Finds the blocks of a capture that was not closed properly. */
+static VOID _BlocksWalk(PCAPTURE_READER Reader)
+{
+	ULONG64 offset = Reader->Header->HeaderLength;
+
+	while (Reader->Length - offset >= sizeof(CAPTURE_BLOCK_HEADER)) {
+		const CAPTURE_BLOCK_HEADER *block = (const CAPTURE_BLOCK_HEADER *)(Reader->View + offset);
+
+		if (block->Signature != CAPTURE_BLOCK_SIGNATURE ||
+			block->Index.Offset != offset ||
+			!_BlockIndexValid(Reader, &block->Index, Reader->Length))
+			break;
+
+		Reader->Blocks.push_back(block->Index);
+		offset += sizeof(CAPTURE_BLOCK_HEADER) + CaptureAlign(block->Index.CompressedLength);
+		if (offset > Reader->Length)
+			break;
+	}
+
+	return;
+}
+
+
+/** Marks a block as processed and commits all blocks that are ready. The
+ *  worker finding the next block to commit commits it and the ready blocks
+ *  following it, the other workers continue with decompression.
+ */
+static VOID _BlockCommit(PCAPTURE_BLOCK_POOL Pool, ULONG Position)
+{
+	std::unique_lock<std::mutex> lock(Pool->Lock);
+
+	Pool->Done[Position] = TRUE;
+	if (!Pool->Committing) {
+		Pool->Committing = TRUE;
+		while (Pool->NextCommit < Pool->Done.size() && Pool->Done[Pool->NextCommit]) {
+			ULONG position = Pool->NextCommit;
+
+			lock.unlock();
+			Pool->Commit(position, Pool->Context);
+			lock.lock();
+			++Pool->NextCommit;
+			Pool->Committed.notify_all();
+		}
+
+		Pool->Committing = FALSE;
+	}
+
+	return;
+}
+
+
+static VOID _BlockWorker(PCAPTURE_BLOCK_POOL Pool, ULONG Worker)
+{
+	std::vector<UCHAR> buffer;
+	ULONG count = (ULONG)Pool->Blocks->size();
+
+	for (;;) {
+		const UCHAR *data = NULL;
+		ULONG length = 0;
+		ULONG position = Pool->Next.fetch_add(1);
+		DWORD ret = ERROR_GEN_FAILURE;
+
+		if (position >= count)
+			break;
+
+		if (Pool->Commit != NULL) {
+			std::unique_lock<std::mutex> lock(Pool->Lock);
+
+			Pool->Committed.wait(lock, [Pool, position] { return position - Pool->NextCommit < Pool->Window; });
+		}
+
+		ret = CaptureReaderBlockDecode(Pool->Reader, (*Pool->Blocks)[position], buffer, &data, &length);
+		Pool->Callback(Worker, position, ret, data, length, Pool->Context);
+		if (Pool->Commit != NULL)
+			_BlockCommit(Pool, position);
+	}
+
+	return;
+}
+
+
+/************************************************************************/
+/*                           PUBLIC FUNCTIONS                           */
+/************************************************************************/
+
+/** Converts a UTF-16 string stored in a capture file.
+ *
+ *  @param Buffer The string, not necessarily aligned.
+ *  @param Length Length of the string, in bytes.
+ */
+std::wstring CaptureStringRead(const void *Buffer, ULONG Length)
+{
+	const UCHAR *b = (const UCHAR *)Buffer;
+	ULONG count = Length / sizeof(USHORT);
+	std::wstring ret;
+
+	ret.reserve(count);
+	for (ULONG i = 0; i < count; ++i) {
+		ULONG c = b[2*i] | ((ULONG)b[2*i + 1] << 8);
+
+		if (sizeof(wchar_t) == 4 && c >= 0xd800 && c < 0xdc00 && i + 1 < count) {
+			ULONG low = b[2*i + 2] | ((ULONG)b[2*i + 3] << 8);
+
+			if (low >= 0xdc00 && low < 0xe000) {
+				c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+				++i;
+			}
+		}
+
+		ret.push_back((wchar_t)c);
+	}
+
+	return ret;
+}
+
+
+/** Decompresses data of one block.
+ *
+ *  @param Reader The capture.
+ *  @param Index Index of the block within Reader->Blocks.
+ *  @param Buffer Receives the decompressed data, reused between calls.
+ *  @param Data Receives address of the block data. Points either to the Buffer,
+ *  or to the mapped file if the block is not compressed.
+ *  @param Length Receives length of the block data, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INVALID_DATA if the block is damaged.
+ */
+DWORD CaptureReaderBlockDecode(PCAPTURE_READER Reader, ULONG Index, std::vector<UCHAR> & Buffer, const UCHAR **Data, PULONG Length)
+{
+	const CAPTURE_BLOCK_INDEX *block = &Reader->Blocks[Index];
+	const UCHAR *compressed = Reader->View + block->Offset + sizeof(CAPTURE_BLOCK_HEADER);
+	ULONG length = 0;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	switch (block->Compression) {
+		case ccNone:
+			*Data = compressed;
+			*Length = block->Length;
+			ret = ERROR_SUCCESS;
+			break;
+		case ccLZ4:
+			if (Buffer.size() < block->Length)
+				Buffer.resize(block->Length);
+
+			ret = LZ4BlockDecompress(compressed, block->CompressedLength, Buffer.data(), block->Length, &length);
+			if (ret == ERROR_SUCCESS && length != block->Length)
+				ret = ERROR_INVALID_DATA;
+
+			if (ret == ERROR_SUCCESS) {
+				*Data = Buffer.data();
+				*Length = length;
+			}
+			break;
+		default:
+			ret = ERROR_NOT_SUPPORTED;
+			break;
+	}
+
+	return ret;
+}
+
+
+/** Invokes a callback for every record of decompressed block data.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INVALID_DATA if a record is damaged. The
+ *  records preceding it have been passed to the callback.
+ */
+DWORD CaptureReaderRecordsEnumerate(const UCHAR *Data, ULONG Length, CAPTURE_RECORD_CALLBACK *Callback, PVOID Context)
+{
+	ULONG offset = 0;
+	DWORD ret = ERROR_SUCCESS;
+
+	while (ret == ERROR_SUCCESS && offset < Length) {
+		const CAPTURE_RECORD_ENTRY *entry = (const CAPTURE_RECORD_ENTRY *)(Data + offset);
+		PREQUEST_HEADER header = (PREQUEST_HEADER)(entry + 1);
+
+		if (Length - offset < sizeof(CAPTURE_RECORD_ENTRY) ||
+			entry->Size < sizeof(REQUEST_HEADER) ||
+			Length - offset - sizeof(CAPTURE_RECORD_ENTRY) < entry->Size ||
+			!_RecordValid(header, entry->Size)) {
+			ret = ERROR_INVALID_DATA;
+			break;
+		}
+
+		if (!Callback(header, entry->Size, Context))
+			break;
+
+		offset += (ULONG)CaptureAlign(sizeof(CAPTURE_RECORD_ENTRY) + entry->Size);
+	}
+
+	return ret;
+}
+
+
+/** Decompresses blocks on a pool of worker threads.
+ *
+ *  @param Reader The capture.
+ *  @param Blocks Indices of the blocks to process (within Reader->Blocks).
+ *  @param ThreadCount Number of worker threads, including the calling one.
+ *  @param Callback Invoked for each block as soon as it is decompressed.
+ *  @param Commit Optional routine invoked for the processed blocks in the
+ *  order of the Blocks list. Workers do not get ahead of the oldest
+ *  uncommitted block by more than CAPTURE_BLOCK_WINDOW blocks per thread.
+ *  @param Context Passed to the callbacks.
+ *
+ *  @remark
+ *  Workers take the blocks in the order of the list, so the blocks to commit
+ *  are usually finished first. The routine returns when all blocks have been
+ *  processed and committed. If a thread cannot be created, the work is
+ *  shared by the threads created so far.
+ */
+VOID CaptureReaderBlocksProcess(PCAPTURE_READER Reader, const std::vector<ULONG> & Blocks, ULONG ThreadCount, CAPTURE_BLOCK_CALLBACK *Callback, CAPTURE_BLOCK_COMMIT_CALLBACK *Commit, PVOID Context)
+{
+	CAPTURE_BLOCK_POOL pool;
+	std::vector<std::thread> threads;
+
+	if (ThreadCount == 0)
+		ThreadCount = 1;
+
+	pool.Reader = Reader;
+	pool.Blocks = &Blocks;
+	pool.Callback = Callback;
+	pool.Commit = Commit;
+	pool.Context = Context;
+	pool.Next = 0;
+	pool.Window = ThreadCount*CAPTURE_BLOCK_WINDOW;
+	pool.Done.assign(Blocks.size(), FALSE);
+	pool.NextCommit = 0;
+	pool.Committing = FALSE;
+	for (ULONG i = 1; i < ThreadCount; ++i) {
+		try {
+			threads.emplace_back(_BlockWorker, &pool, i);
+		} catch (const std::system_error &) {
+			break;
+		}
+	}
+
+	_BlockWorker(&pool, 0);
+	for (auto & t : threads)
+		t.join();
+
+	return;
+}
+
+
+/** Maps a capture file into memory and reads its header, snapshot and the
+ *  list of blocks.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, ERROR_INVALID_DATA if the file is not a capture,
+ *  or ERROR_NOT_SUPPORTED if it comes from a platform with different pointer
+ *  size.
+ */
+DWORD CaptureReaderOpen(const char *FileName, PCAPTURE_READER *Reader)
+{
+	struct stat st;
+	PCAPTURE_READER tmpReader = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	tmpReader = new CAPTURE_READER();
+	tmpReader->File = open(FileName, O_RDONLY);
+	if (tmpReader->File != -1) {
+		if (fstat(tmpReader->File, &st) == 0) {
+			tmpReader->Length = st.st_size;
+			ret = (tmpReader->Length >= sizeof(CAPTURE_FILE_HEADER)) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+			if (ret == ERROR_SUCCESS) {
+				PVOID view = mmap(NULL, tmpReader->Length, PROT_READ, MAP_PRIVATE, tmpReader->File, 0);
+
+				if (view != MAP_FAILED) {
+					madvise(view, tmpReader->Length, MADV_SEQUENTIAL);
+					tmpReader->View = (const UCHAR *)view;
+					tmpReader->Header = (const CAPTURE_FILE_HEADER *)view;
+				} else ret = _ErrnoToError(errno);
+			}
+		} else ret = _ErrnoToError(errno);
+	} else ret = _ErrnoToError(errno);
+
+	if (ret == ERROR_SUCCESS) {
+		const CAPTURE_FILE_HEADER *header = tmpReader->Header;
+
+		if (header->Signature != CAPTURE_FILE_SIGNATURE ||
+			header->HeaderLength < sizeof(CAPTURE_FILE_HEADER) ||
+			header->HeaderLength % CAPTURE_ALIGNMENT != 0 ||
+			header->HeaderLength > tmpReader->Length)
+			ret = ERROR_INVALID_DATA;
+		else if (header->Version != CAPTURE_FILE_VERSION || header->PointerSize != sizeof(PVOID))
+			ret = ERROR_NOT_SUPPORTED;
+	}
+
+	if (ret == ERROR_SUCCESS)
+		ret = _SnapshotRead(tmpReader);
+
+	if (ret == ERROR_SUCCESS) {
+		tmpReader->Complete = _IndexRead(tmpReader);
+		if (!tmpReader->Complete)
+			_BlocksWalk(tmpReader);
+
+		*Reader = tmpReader;
+	}
+
+	if (ret != ERROR_SUCCESS)
+		CaptureReaderClose(tmpReader);
+
+	return ret;
+}
+
+
+VOID CaptureReaderClose(PCAPTURE_READER Reader)
+{
+	if (Reader->View != NULL)
+		munmap((PVOID)Reader->View, Reader->Length);
+
+	if (Reader->File != -1)
+		close(Reader->File);
+
+	delete Reader;
+
+	return;
+}
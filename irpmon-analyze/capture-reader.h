@@ -0,0 +1,72 @@
+
+#ifndef __IRPMON_CAPTURE_READER_H__
+#define __IRPMON_CAPTURE_READER_H__
+
+
+
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "general-types.h"
+#include "capture-format.h"
+
+
+typedef struct _CAPTURE_READER_DEVICE {
+	ULONG64 DeviceObject;
+	ULONG64 AttachedDevice;
+	std::wstring Name;
+} CAPTURE_READER_DEVICE, *PCAPTURE_READER_DEVICE;
+
+typedef struct _CAPTURE_READER_DRIVER {
+	ULONG64 DriverObject;
+	std::wstring Name;
+	std::vector<CAPTURE_READER_DEVICE> Devices;
+} CAPTURE_READER_DRIVER, *PCAPTURE_READER_DRIVER;
+
+/** Represents a capture file mapped into memory. */
+typedef struct _CAPTURE_READER {
+	int File;
+	const UCHAR *View;
+	ULONG64 Length;
+	const CAPTURE_FILE_HEADER *Header;
+	/** Drivers and devices present when the capture started. */
+	std::vector<CAPTURE_READER_DRIVER> Drivers;
+	/** Blocks in the order they were written. */
+	std::vector<CAPTURE_BLOCK_INDEX> Blocks;
+	/** Set if the file ends with the index; otherwise, the blocks were found by
+	    walking their headers and an incomplete last block was ignored. */
+	BOOLEAN Complete;
+} CAPTURE_READER, *PCAPTURE_READER;
+
+/** Invoked for each record of a block.
+ *
+ *  @return
+ *  Return FALSE to stop the enumeration.
+ */
+typedef BOOLEAN (CAPTURE_RECORD_CALLBACK)(PREQUEST_HEADER Header, ULONG Size, PVOID Context);
+
+/** Invoked on a worker thread for each block given to CaptureReaderBlocksProcess.
+ *
+ *  @param Worker Index of the worker thread, lower than the thread count.
+ *  @param Position Position of the block in the list of blocks to process.
+ *  @param Status Result of the decompression. Data and Length are valid only
+ *  if it is ERROR_SUCCESS.
+ */
+typedef VOID (CAPTURE_BLOCK_CALLBACK)(ULONG Worker, ULONG Position, DWORD Status, const UCHAR *Data, ULONG Length, PVOID Context);
+
+/** Invoked for each processed block in the order of the list. The calls are
+ *  serialized, but may be made from any worker thread.
+ */
+typedef VOID (CAPTURE_BLOCK_COMMIT_CALLBACK)(ULONG Position, PVOID Context);
+
+
+std::wstring CaptureStringRead(const void *Buffer, ULONG Length);
+DWORD CaptureReaderBlockDecode(PCAPTURE_READER Reader, ULONG Index, std::vector<UCHAR> & Buffer, const UCHAR **Data, PULONG Length);
+DWORD CaptureReaderRecordsEnumerate(const UCHAR *Data, ULONG Length, CAPTURE_RECORD_CALLBACK *Callback, PVOID Context);
+VOID CaptureReaderBlocksProcess(PCAPTURE_READER Reader, const std::vector<ULONG> & Blocks, ULONG ThreadCount, CAPTURE_BLOCK_CALLBACK *Callback, CAPTURE_BLOCK_COMMIT_CALLBACK *Commit, PVOID Context);
+DWORD CaptureReaderOpen(const char *FileName, PCAPTURE_READER *Reader);
+VOID CaptureReaderClose(PCAPTURE_READER Reader);
+
+
+
+#endif
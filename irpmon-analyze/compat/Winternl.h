@@ -0,0 +1,10 @@
+
+#ifndef __IRPMON_COMPAT_WINTERNL_H__
+#define __IRPMON_COMPAT_WINTERNL_H__
+
+/* Declarations of this header used by the tree are provided by windows.h. */
+#include <windows.h>
+
+
+
+#endif
@@ -0,0 +1,800 @@
+
+/**
+ * @file
+ *
+ * POSIX implementation of the Windows routines declared by compat/windows.h.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <windows.h>
+
+// The C library routines replaced by compat/windows.h are called directly here.
+#undef swprintf
+#undef vswprintf
+#undef sprintf_s
+
+
+
+/************************************************************************/
+/*                           GLOBAL VARIABLES                           */
+/************************************************************************/
+
+static __thread DWORD _lastError = ERROR_SUCCESS;
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+/** Converts a format string of the Microsoft C runtime to the one of the C
+ *  library.
+ *
+ *  @param Format The format string.
+ *  @param Wide Indicates whether the format belongs to a wide-character routine.
+ *  In that case, %s refers to a wide string and %S to a narrow one.
+ *  @param Output Receives the converted format.
+ *  @param OutputCount Size of the output buffer, in characters.
+ *
+ *  @return
+ *  Returns TRUE if the converted format fits into the buffer.
+ */
+static BOOLEAN _FormatConvert(const wchar_t *Format, BOOLEAN Wide, wchar_t *Output, size_t OutputCount)
+{
+	const wchar_t *end = Output + OutputCount - 1;
+	BOOLEAN ret = TRUE;
+
+	while (ret && *Format != L'\0') {
+		wchar_t length[3] = L"";
+		BOOLEAN lengthGiven = FALSE;
+
+		if (*Format != L'%') {
+			ret = (Output < end);
+			if (ret)
+				*Output++ = *Format++;
+
+			continue;
+		}
+
+		ret = (Output < end);
+		if (ret)
+			*Output++ = *Format++;
+
+		while (ret && *Format != L'\0' && wcschr(L"-+ #0123456789.*", *Format) != NULL) {
+			ret = (Output < end);
+			if (ret)
+				*Output++ = *Format++;
+		}
+
+		if (wcsncmp(Format, L"I64", 3) == 0) {
+			wcscpy(length, L"ll");
+			Format += 3;
+		} else if (wcsncmp(Format, L"I32", 3) == 0) {
+			Format += 3;
+		} else if (*Format == L'I') {
+			wcscpy(length, L"z");
+			++Format;
+		} else if (wcsncmp(Format, L"ll", 2) == 0) {
+			wcscpy(length, L"ll");
+			Format += 2;
+		} else if (*Format == L'h' || *Format == L'l' || *Format == L'w' || *Format == L'z') {
+			length[0] = (*Format == L'w') ? L'l' : *Format;
+			length[1] = L'\0';
+			lengthGiven = TRUE;
+			++Format;
+		}
+
+		switch (*Format) {
+			case L's':
+			case L'c':
+				if (!lengthGiven && Wide)
+					wcscpy(length, L"l");
+				else if (length[0] == L'h')
+					length[0] = L'\0';
+				break;
+			case L'S':
+			case L'C':
+				wcscpy(length, (Wide) ? L"" : L"l");
+				break;
+			case L'p':
+				wcscpy(length, L"l");
+				break;
+		}
+
+		if (*Format == L'p') {
+			int width = (int)(sizeof(PVOID)*2);
+
+			ret = (end - Output >= 3 + (ptrdiff_t)wcslen(length));
+			if (ret) {
+				*Output++ = L'0';
+				*Output++ = L'0' + width / 10;
+				*Output++ = L'0' + width % 10;
+			}
+		}
+
+		for (size_t i = 0; ret && length[i] != L'\0'; ++i) {
+			ret = (Output < end);
+			if (ret)
+				*Output++ = length[i];
+		}
+
+		if (ret && *Format != L'\0') {
+			ret = (Output < end);
+			if (ret) {
+				switch (*Format) {
+					case L'S': *Output++ = L's'; break;
+					case L'C': *Output++ = L'c'; break;
+					case L'p': *Output++ = L'X'; break;
+					default: *Output++ = *Format; break;
+				}
+
+				++Format;
+			}
+		}
+	}
+
+	*Output = L'\0';
+
+	return ret;
+}
+
+
+/************************************************************************/
+/*                        ERRORS AND DEBUGGING                          */
+/************************************************************************/
+
+DWORD GetLastError(VOID)
+{
+	return _lastError;
+}
+
+
+VOID SetLastError(DWORD ErrorCode)
+{
+	_lastError = ErrorCode;
+
+	return;
+}
+
+
+VOID OutputDebugStringA(LPCSTR String)
+{
+	fputs(String, stderr);
+
+	return;
+}
+
+
+DWORD GetCurrentProcessId(VOID)
+{
+	return (DWORD)getpid();
+}
+
+
+DWORD GetCurrentThreadId(VOID)
+{
+	return (DWORD)syscall(SYS_gettid);
+}
+
+
+/** There are no system message tables. */
+DWORD FormatMessageW(DWORD Flags, LPCVOID Source, DWORD MessageId, DWORD LanguageId, LPWSTR Buffer, DWORD Size, va_list *Arguments)
+{
+	SetLastError(ERROR_MR_MID_NOT_FOUND);
+
+	return 0;
+}
+
+
+/** There are no Windows modules. */
+HMODULE GetModuleHandleW(LPCWSTR ModuleName)
+{
+	SetLastError(ERROR_FILE_NOT_FOUND);
+
+	return NULL;
+}
+
+
+PVOID GetProcAddress(HMODULE Module, LPCSTR ProcName)
+{
+	SetLastError(ERROR_NOT_FOUND);
+
+	return NULL;
+}
+
+
+/************************************************************************/
+/*                               MEMORY                                 */
+/************************************************************************/
+
+PVOID HeapAlloc(HANDLE Heap, DWORD Flags, SIZE_T Bytes)
+{
+	PVOID ret = NULL;
+
+	if (Bytes == 0)
+		Bytes = 1;
+
+	if (Flags & HEAP_ZERO_MEMORY)
+		ret = calloc(1, Bytes);
+	else ret = malloc(Bytes);
+
+	return ret;
+}
+
+
+PVOID HeapReAlloc(HANDLE Heap, DWORD Flags, PVOID Memory, SIZE_T Bytes)
+{
+	return realloc(Memory, (Bytes > 0) ? Bytes : 1);
+}
+
+
+BOOL HeapFree(HANDLE Heap, DWORD Flags, PVOID Memory)
+{
+	free(Memory);
+
+	return TRUE;
+}
+
+
+BOOL HeapValidate(HANDLE Heap, DWORD Flags, LPCVOID Memory)
+{
+	return TRUE;
+}
+
+
+PVOID LocalFree(PVOID Memory)
+{
+	free(Memory);
+
+	return NULL;
+}
+
+
+/************************************************************************/
+/*                           SYNCHRONIZATION                            */
+/************************************************************************/
+
+VOID InitializeCriticalSection(PCRITICAL_SECTION CriticalSection)
+{
+	pthread_mutexattr_t attributes;
+
+	pthread_mutexattr_init(&attributes);
+	pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&CriticalSection->Mutex, &attributes);
+	pthread_mutexattr_destroy(&attributes);
+
+	return;
+}
+
+
+BOOL InitializeCriticalSectionAndSpinCount(PCRITICAL_SECTION CriticalSection, DWORD SpinCount)
+{
+	InitializeCriticalSection(CriticalSection);
+
+	return TRUE;
+}
+
+
+VOID EnterCriticalSection(PCRITICAL_SECTION CriticalSection)
+{
+	pthread_mutex_lock(&CriticalSection->Mutex);
+
+	return;
+}
+
+
+VOID LeaveCriticalSection(PCRITICAL_SECTION CriticalSection)
+{
+	pthread_mutex_unlock(&CriticalSection->Mutex);
+
+	return;
+}
+
+
+VOID DeleteCriticalSection(PCRITICAL_SECTION CriticalSection)
+{
+	pthread_mutex_destroy(&CriticalSection->Mutex);
+
+	return;
+}
+
+
+VOID InitializeSRWLock(PSRWLOCK Lock)
+{
+	pthread_rwlock_init(&Lock->Lock, NULL);
+
+	return;
+}
+
+
+VOID AcquireSRWLockShared(PSRWLOCK Lock)
+{
+	pthread_rwlock_rdlock(&Lock->Lock);
+
+	return;
+}
+
+
+VOID ReleaseSRWLockShared(PSRWLOCK Lock)
+{
+	pthread_rwlock_unlock(&Lock->Lock);
+
+	return;
+}
+
+
+VOID AcquireSRWLockExclusive(PSRWLOCK Lock)
+{
+	pthread_rwlock_wrlock(&Lock->Lock);
+
+	return;
+}
+
+
+VOID ReleaseSRWLockExclusive(PSRWLOCK Lock)
+{
+	pthread_rwlock_unlock(&Lock->Lock);
+
+	return;
+}
+
+
+VOID InitOnceInitialize(PINIT_ONCE InitOnce)
+{
+	pthread_mutex_init(&InitOnce->Mutex, NULL);
+	InitOnce->Done = FALSE;
+	InitOnce->Context = NULL;
+
+	return;
+}
+
+
+/** Unlike pthread_once, passes a parameter to the initialization routine. A failed
+ *  initialization is attempted again by the next call, as on Windows. */
+BOOL InitOnceExecuteOnce(PINIT_ONCE InitOnce, PINIT_ONCE_FN InitFn, PVOID Parameter, LPVOID *Context)
+{
+	BOOL ret = TRUE;
+
+	if (!__atomic_load_n(&InitOnce->Done, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&InitOnce->Mutex);
+		if (!InitOnce->Done) {
+			ret = InitFn(InitOnce, Parameter, &InitOnce->Context);
+			if (ret)
+				__atomic_store_n(&InitOnce->Done, TRUE, __ATOMIC_RELEASE);
+		}
+
+		pthread_mutex_unlock(&InitOnce->Mutex);
+	}
+
+	if (ret && Context != NULL)
+		*Context = InitOnce->Context;
+
+	return ret;
+}
+
+
+typedef enum _ECompatObjectType {
+	cotEvent,
+	cotSemaphore,
+	cotThread,
+} ECompatObjectType;
+
+/** State of a kernel object, its address is the handle. */
+typedef struct _COMPAT_OBJECT {
+	ECompatObjectType Type;
+	/** One reference for the handle, one for a running thread. */
+	volatile LONG ReferenceCount;
+	/** Events and threads. A thread is signaled when it terminates. */
+	BOOL Signaled;
+	BOOL ManualReset;
+	/** Semaphores. */
+	LONG Count;
+	LONG MaximumCount;
+	/** Threads. */
+	pthread_t Thread;
+	LPTHREAD_START_ROUTINE StartAddress;
+	PVOID Parameter;
+} COMPAT_OBJECT, *PCOMPAT_OBJECT;
+
+/** All the objects share one lock and one condition, so a thread can wait
+    for several objects at once. */
+static pthread_mutex_t _objectLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _objectCondition;
+static pthread_once_t _objectConditionInit = PTHREAD_ONCE_INIT;
+
+
+static VOID _ObjectConditionInit(VOID)
+{
+	pthread_condattr_t attributes;
+
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&_objectCondition, &attributes);
+	pthread_condattr_destroy(&attributes);
+
+	return;
+}
+
+
+static PCOMPAT_OBJECT _ObjectCreate(ECompatObjectType Type)
+{
+	PCOMPAT_OBJECT ret = NULL;
+
+	pthread_once(&_objectConditionInit, _ObjectConditionInit);
+	ret = (PCOMPAT_OBJECT)calloc(1, sizeof(COMPAT_OBJECT));
+	if (ret != NULL) {
+		ret->Type = Type;
+		ret->ReferenceCount = 1;
+	} else _lastError = ERROR_NOT_ENOUGH_MEMORY;
+
+	return ret;
+}
+
+
+static VOID _ObjectDereference(PCOMPAT_OBJECT Object)
+{
+	if (InterlockedDecrement(&Object->ReferenceCount) == 0)
+		free(Object);
+
+	return;
+}
+
+
+/** Must be called with the object lock held. */
+static BOOL _ObjectSignaled(PCOMPAT_OBJECT Object)
+{
+	return (Object->Type == cotSemaphore) ? (Object->Count > 0) : Object->Signaled;
+}
+
+
+/** Performs the side effect of a satisfied wait. Must be called with the
+ *  object lock held.
+ */
+static VOID _ObjectAcquire(PCOMPAT_OBJECT Object)
+{
+	switch (Object->Type) {
+		case cotEvent:
+			if (!Object->ManualReset)
+				Object->Signaled = FALSE;
+			break;
+		case cotSemaphore:
+			--Object->Count;
+			break;
+		default:
+			break;
+	}
+
+	return;
+}
+
+
+static PVOID _ThreadRoutine(PVOID Parameter)
+{
+	PCOMPAT_OBJECT thread = (PCOMPAT_OBJECT)Parameter;
+
+	thread->StartAddress(thread->Parameter);
+	pthread_mutex_lock(&_objectLock);
+	thread->Signaled = TRUE;
+	pthread_cond_broadcast(&_objectCondition);
+	pthread_mutex_unlock(&_objectLock);
+	_ObjectDereference(thread);
+
+	return NULL;
+}
+
+
+HANDLE CreateEventW(PVOID EventAttributes, BOOL ManualReset, BOOL InitialState, LPCWSTR Name)
+{
+	PCOMPAT_OBJECT ret = NULL;
+
+	ret = _ObjectCreate(cotEvent);
+	if (ret != NULL) {
+		ret->ManualReset = ManualReset;
+		ret->Signaled = InitialState;
+	}
+
+	return (HANDLE)ret;
+}
+
+
+BOOL SetEvent(HANDLE Event)
+{
+	PCOMPAT_OBJECT e = (PCOMPAT_OBJECT)Event;
+
+	pthread_mutex_lock(&_objectLock);
+	e->Signaled = TRUE;
+	pthread_cond_broadcast(&_objectCondition);
+	pthread_mutex_unlock(&_objectLock);
+
+	return TRUE;
+}
+
+
+BOOL ResetEvent(HANDLE Event)
+{
+	PCOMPAT_OBJECT e = (PCOMPAT_OBJECT)Event;
+
+	pthread_mutex_lock(&_objectLock);
+	e->Signaled = FALSE;
+	pthread_mutex_unlock(&_objectLock);
+
+	return TRUE;
+}
+
+
+HANDLE CreateSemaphoreW(PVOID SemaphoreAttributes, LONG InitialCount, LONG MaximumCount, LPCWSTR Name)
+{
+	PCOMPAT_OBJECT ret = NULL;
+
+	if (MaximumCount > 0 && InitialCount >= 0 && InitialCount <= MaximumCount) {
+		ret = _ObjectCreate(cotSemaphore);
+		if (ret != NULL) {
+			ret->Count = InitialCount;
+			ret->MaximumCount = MaximumCount;
+		}
+	} else _lastError = ERROR_INVALID_PARAMETER;
+
+	return (HANDLE)ret;
+}
+
+
+BOOL ReleaseSemaphore(HANDLE Semaphore, LONG ReleaseCount, PLONG PreviousCount)
+{
+	PCOMPAT_OBJECT s = (PCOMPAT_OBJECT)Semaphore;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&_objectLock);
+	ret = (ReleaseCount > 0 && ReleaseCount <= s->MaximumCount - s->Count);
+	if (ret) {
+		if (PreviousCount != NULL)
+			*PreviousCount = s->Count;
+
+		s->Count += ReleaseCount;
+		pthread_cond_broadcast(&_objectCondition);
+	}
+
+	pthread_mutex_unlock(&_objectLock);
+	if (!ret)
+		_lastError = (ReleaseCount > 0) ? ERROR_TOO_MANY_POSTS : ERROR_INVALID_PARAMETER;
+
+	return ret;
+}
+
+
+/** The thread starts immediately, CreationFlags and the stack size are ignored. */
+HANDLE CreateThread(PVOID ThreadAttributes, SIZE_T StackSize, LPTHREAD_START_ROUTINE StartAddress, PVOID Parameter, DWORD CreationFlags, PDWORD ThreadId)
+{
+	PCOMPAT_OBJECT ret = NULL;
+
+	ret = _ObjectCreate(cotThread);
+	if (ret != NULL) {
+		ret->StartAddress = StartAddress;
+		ret->Parameter = Parameter;
+		ret->ReferenceCount = 2;
+		if (pthread_create(&ret->Thread, NULL, _ThreadRoutine, ret) == 0) {
+			pthread_detach(ret->Thread);
+			if (ThreadId != NULL)
+				*ThreadId = 0;
+		} else {
+			free(ret);
+			ret = NULL;
+			_lastError = ERROR_NOT_ENOUGH_MEMORY;
+		}
+	}
+
+	return (HANDLE)ret;
+}
+
+
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds)
+{
+	return WaitForMultipleObjects(1, &Handle, FALSE, Milliseconds);
+}
+
+
+DWORD WaitForMultipleObjects(DWORD Count, const HANDLE *Handles, BOOL WaitAll, DWORD Milliseconds)
+{
+	DWORD i = 0;
+	DWORD signaled = 0;
+	BOOL timedOut = FALSE;
+	struct timespec deadline;
+	PCOMPAT_OBJECT *objects = (PCOMPAT_OBJECT *)Handles;
+	DWORD ret = WAIT_TIMEOUT;
+
+	if (Count == 0 || Count > MAXIMUM_WAIT_OBJECTS) {
+		_lastError = ERROR_INVALID_PARAMETER;
+		return WAIT_FAILED;
+	}
+
+	if (Milliseconds != INFINITE) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += Milliseconds / 1000;
+		deadline.tv_nsec += (long)(Milliseconds % 1000)*1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			++deadline.tv_sec;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&_objectLock);
+	for (;;) {
+		signaled = 0;
+		for (i = 0; i < Count; ++i) {
+			if (_ObjectSignaled(objects[i])) {
+				++signaled;
+				if (!WaitAll)
+					break;
+			}
+		}
+
+		if (WaitAll ? signaled == Count : signaled > 0) {
+			if (WaitAll) {
+				for (i = 0; i < Count; ++i)
+					_ObjectAcquire(objects[i]);
+
+				ret = WAIT_OBJECT_0;
+			} else {
+				_ObjectAcquire(objects[i]);
+				ret = WAIT_OBJECT_0 + i;
+			}
+
+			break;
+		}
+
+		// The objects are checked once more after the timeout.
+		if (timedOut)
+			break;
+
+		if (Milliseconds == INFINITE)
+			pthread_cond_wait(&_objectCondition, &_objectLock);
+		else if (Milliseconds == 0 || pthread_cond_timedwait(&_objectCondition, &_objectLock, &deadline) != 0)
+			timedOut = TRUE;
+	}
+
+	pthread_mutex_unlock(&_objectLock);
+
+	return ret;
+}
+
+
+BOOL CloseHandle(HANDLE Handle)
+{
+	_ObjectDereference((PCOMPAT_OBJECT)Handle);
+
+	return TRUE;
+}
+
+
+/************************************************************************/
+/*                                 TIME                                 */
+/************************************************************************/
+
+ULONGLONG GetTickCount64(VOID)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ULONGLONG)ts.tv_sec*1000 + ts.tv_nsec / 1000000;
+}
+
+
+/** FILETIME counts 100 ns intervals since January 1, 1601. */
+VOID GetSystemTimeAsFileTime(PFILETIME SystemTimeAsFileTime)
+{
+	struct timespec ts;
+	ULONGLONG t = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	t = (ULONGLONG)ts.tv_sec*10000000 + ts.tv_nsec / 100 + 116444736000000000ULL;
+	SystemTimeAsFileTime->dwLowDateTime = (DWORD)t;
+	SystemTimeAsFileTime->dwHighDateTime = (DWORD)(t >> 32);
+
+	return;
+}
+
+
+/************************************************************************/
+/*                               STRINGS                                */
+/************************************************************************/
+
+int CompatVswprintf(wchar_t *Buffer, size_t Count, const wchar_t *Format, va_list Args)
+{
+	wchar_t format[512];
+	int ret = -1;
+
+	if (_FormatConvert(Format, TRUE, format, sizeof(format) / sizeof(format[0])))
+		ret = vswprintf(Buffer, Count, format, Args);
+
+	return ret;
+}
+
+
+int CompatSwprintf(wchar_t *Buffer, size_t Count, const wchar_t *Format, ...)
+{
+	va_list args;
+	int ret = -1;
+
+	va_start(args, Format);
+	ret = CompatVswprintf(Buffer, Count, Format, args);
+	va_end(args);
+
+	return ret;
+}
+
+
+int CompatSprintf_s(char *Buffer, size_t Count, const char *Format, ...)
+{
+	va_list args;
+	wchar_t wideFormat[512];
+	wchar_t convertedFormat[512];
+	char format[512];
+	int ret = -1;
+
+	if (mbstowcs(wideFormat, Format, sizeof(wideFormat) / sizeof(wideFormat[0])) < sizeof(wideFormat) / sizeof(wideFormat[0]) &&
+		_FormatConvert(wideFormat, FALSE, convertedFormat, sizeof(convertedFormat) / sizeof(convertedFormat[0])) &&
+		wcstombs(format, convertedFormat, sizeof(format)) < sizeof(format)) {
+		va_start(args, Format);
+		ret = vsnprintf(Buffer, Count, format, args);
+		va_end(args);
+	}
+
+	return ret;
+}
+
+
+/** Supports only the CP_UTF8 code page. */
+int WideCharToMultiByte(UINT CodePage, DWORD Flags, LPCWSTR WideCharStr, int WideCharCount, LPSTR MultiByteStr, int MultiByteCount, LPCSTR DefaultChar, PBOOL UsedDefaultChar)
+{
+	int ret = 0;
+	unsigned char encoded[4];
+	size_t encodedLength = 0;
+
+	if (WideCharCount < 0)
+		WideCharCount = (int)wcslen(WideCharStr) + 1;
+
+	for (int i = 0; i < WideCharCount; ++i) {
+		ULONG c = (ULONG)WideCharStr[i];
+
+		if (c < 0x80) {
+			encoded[0] = (unsigned char)c;
+			encodedLength = 1;
+		} else if (c < 0x800) {
+			encoded[0] = (unsigned char)(0xc0 | (c >> 6));
+			encoded[1] = (unsigned char)(0x80 | (c & 0x3f));
+			encodedLength = 2;
+		} else if (c < 0x10000) {
+			encoded[0] = (unsigned char)(0xe0 | (c >> 12));
+			encoded[1] = (unsigned char)(0x80 | ((c >> 6) & 0x3f));
+			encoded[2] = (unsigned char)(0x80 | (c & 0x3f));
+			encodedLength = 3;
+		} else {
+			encoded[0] = (unsigned char)(0xf0 | ((c >> 18) & 0x7));
+			encoded[1] = (unsigned char)(0x80 | ((c >> 12) & 0x3f));
+			encoded[2] = (unsigned char)(0x80 | ((c >> 6) & 0x3f));
+			encoded[3] = (unsigned char)(0x80 | (c & 0x3f));
+			encodedLength = 4;
+		}
+
+		if (MultiByteCount > 0) {
+			if (ret + (int)encodedLength > MultiByteCount) {
+				SetLastError(ERROR_INSUFFICIENT_BUFFER);
+				ret = 0;
+				break;
+			}
+
+			memcpy(MultiByteStr + ret, encoded, encodedLength);
+		}
+
+		ret += (int)encodedLength;
+	}
+
+	return ret;
+}
@@ -0,0 +1,438 @@
+
+/**
+ * @file
+ *
+ * Constants of the Windows headers referenced by the value tables of the
+ * translation library. Values correspond to _WIN32_WINNT 0x0601.
+ */
+
+#ifndef __IRPMON_COMPAT_WINCONSTANTS_H__
+#define __IRPMON_COMPAT_WINCONSTANTS_H__
+
+
+
+/************************************************************************/
+/*                            ACCESS RIGHTS                             */
+/************************************************************************/
+
+#define DELETE									0x00010000
+#define READ_CONTROL							0x00020000
+#define WRITE_DAC								0x00040000
+#define WRITE_OWNER								0x00080000
+#define SYNCHRONIZE								0x00100000
+#define STANDARD_RIGHTS_REQUIRED				0x000F0000
+#define STANDARD_RIGHTS_READ					READ_CONTROL
+#define STANDARD_RIGHTS_WRITE					READ_CONTROL
+#define STANDARD_RIGHTS_EXECUTE					READ_CONTROL
+#define STANDARD_RIGHTS_ALL						0x001F0000
+#define ACCESS_SYSTEM_SECURITY					0x01000000
+#define MAXIMUM_ALLOWED							0x02000000
+#define GENERIC_READ							0x80000000
+#define GENERIC_WRITE							0x40000000
+#define GENERIC_EXECUTE							0x20000000
+#define GENERIC_ALL								0x10000000
+
+#define OWNER_SECURITY_INFORMATION				0x00000001
+#define GROUP_SECURITY_INFORMATION				0x00000002
+#define DACL_SECURITY_INFORMATION				0x00000004
+#define SACL_SECURITY_INFORMATION				0x00000008
+#define LABEL_SECURITY_INFORMATION				0x00000010
+
+#define FILE_READ_DATA							0x0001
+#define FILE_WRITE_DATA							0x0002
+#define FILE_APPEND_DATA						0x0004
+#define FILE_READ_EA							0x0008
+#define FILE_WRITE_EA							0x0010
+#define FILE_EXECUTE							0x0020
+#define FILE_READ_ATTRIBUTES					0x0080
+#define FILE_WRITE_ATTRIBUTES					0x0100
+#define FILE_GENERIC_READ						(STANDARD_RIGHTS_READ | FILE_READ_DATA | FILE_READ_ATTRIBUTES | FILE_READ_EA | SYNCHRONIZE)
+#define FILE_GENERIC_WRITE						(STANDARD_RIGHTS_WRITE | FILE_WRITE_DATA | FILE_WRITE_ATTRIBUTES | FILE_WRITE_EA | FILE_APPEND_DATA | SYNCHRONIZE)
+#define FILE_GENERIC_EXECUTE					(STANDARD_RIGHTS_EXECUTE | FILE_READ_ATTRIBUTES | FILE_EXECUTE | SYNCHRONIZE)
+
+#define KEY_QUERY_VALUE							0x0001
+#define KEY_SET_VALUE							0x0002
+#define KEY_CREATE_SUB_KEY						0x0004
+#define KEY_ENUMERATE_SUB_KEYS					0x0008
+#define KEY_NOTIFY								0x0010
+#define KEY_CREATE_LINK							0x0020
+#define KEY_READ								((STANDARD_RIGHTS_READ | KEY_QUERY_VALUE | KEY_ENUMERATE_SUB_KEYS | KEY_NOTIFY) & ~SYNCHRONIZE)
+#define KEY_WRITE								((STANDARD_RIGHTS_WRITE | KEY_SET_VALUE | KEY_CREATE_SUB_KEY) & ~SYNCHRONIZE)
+#define KEY_ALL_ACCESS							((STANDARD_RIGHTS_ALL | KEY_QUERY_VALUE | KEY_SET_VALUE | KEY_CREATE_SUB_KEY | KEY_ENUMERATE_SUB_KEYS | KEY_NOTIFY | KEY_CREATE_LINK) & ~SYNCHRONIZE)
+
+#define PROCESS_TERMINATE						0x0001
+#define PROCESS_CREATE_THREAD					0x0002
+#define PROCESS_SET_SESSIONID					0x0004
+#define PROCESS_VM_OPERATION					0x0008
+#define PROCESS_VM_READ							0x0010
+#define PROCESS_VM_WRITE						0x0020
+#define PROCESS_DUP_HANDLE						0x0040
+#define PROCESS_CREATE_PROCESS					0x0080
+#define PROCESS_SET_QUOTA						0x0100
+#define PROCESS_SET_INFORMATION					0x0200
+#define PROCESS_QUERY_INFORMATION				0x0400
+#define PROCESS_SUSPEND_RESUME					0x0800
+#define PROCESS_QUERY_LIMITED_INFORMATION		0x1000
+#define PROCESS_ALL_ACCESS						(STANDARD_RIGHTS_REQUIRED | SYNCHRONIZE | 0xFFFF)
+
+#define THREAD_TERMINATE						0x0001
+#define THREAD_SUSPEND_RESUME					0x0002
+#define THREAD_GET_CONTEXT						0x0008
+#define THREAD_SET_CONTEXT						0x0010
+#define THREAD_SET_INFORMATION					0x0020
+#define THREAD_QUERY_INFORMATION				0x0040
+#define THREAD_SET_THREAD_TOKEN					0x0080
+#define THREAD_IMPERSONATE						0x0100
+#define THREAD_DIRECT_IMPERSONATION				0x0200
+#define THREAD_SET_LIMITED_INFORMATION			0x0400
+#define THREAD_QUERY_LIMITED_INFORMATION		0x0800
+#define THREAD_ALL_ACCESS						(STANDARD_RIGHTS_REQUIRED | SYNCHRONIZE | 0xFFFF)
+
+
+/************************************************************************/
+/*                        FILES, REGISTRY, MEMORY                       */
+/************************************************************************/
+
+#define FILE_SHARE_READ							0x00000001
+#define FILE_SHARE_WRITE						0x00000002
+#define FILE_SHARE_DELETE						0x00000004
+
+#define FILE_ATTRIBUTE_READONLY					0x00000001
+#define FILE_ATTRIBUTE_HIDDEN					0x00000002
+#define FILE_ATTRIBUTE_SYSTEM					0x00000004
+#define FILE_ATTRIBUTE_ARCHIVE					0x00000020
+#define FILE_ATTRIBUTE_NORMAL					0x00000080
+#define FILE_ATTRIBUTE_TEMPORARY				0x00000100
+
+#define FILE_NOTIFY_CHANGE_FILE_NAME			0x00000001
+#define FILE_NOTIFY_CHANGE_DIR_NAME				0x00000002
+#define FILE_NOTIFY_CHANGE_ATTRIBUTES			0x00000004
+#define FILE_NOTIFY_CHANGE_SIZE					0x00000008
+#define FILE_NOTIFY_CHANGE_LAST_WRITE			0x00000010
+#define FILE_NOTIFY_CHANGE_LAST_ACCESS			0x00000020
+#define FILE_NOTIFY_CHANGE_CREATION				0x00000040
+#define FILE_NOTIFY_CHANGE_SECURITY				0x00000100
+
+#define FILE_DEVICE_CD_ROM_FILE_SYSTEM			0x00000003
+#define FILE_DEVICE_DISK_FILE_SYSTEM			0x00000008
+#define FILE_DEVICE_NETWORK_FILE_SYSTEM			0x00000014
+
+#define REG_OPTION_VOLATILE						0x00000001
+#define REG_OPTION_CREATE_LINK					0x00000002
+#define REG_OPTION_BACKUP_RESTORE				0x00000004
+#define REG_OPTION_OPEN_LINK					0x00000008
+
+#define PAGE_READONLY							0x00000002
+#define PAGE_READWRITE							0x00000004
+#define PAGE_WRITECOPY							0x00000008
+#define PAGE_EXECUTE							0x00000010
+#define PAGE_NOCACHE							0x00000200
+
+
+/************************************************************************/
+/*                        WINDOWS HOOKS AND EVENTS                      */
+/************************************************************************/
+
+#define WH_MSGFILTER							(-1)
+#define WH_JOURNALRECORD						0
+#define WH_JOURNALPLAYBACK						1
+#define WH_KEYBOARD								2
+#define WH_GETMESSAGE							3
+#define WH_CALLWNDPROC							4
+#define WH_CBT									5
+#define WH_SYSMSGFILTER							6
+#define WH_MOUSE								7
+#define WH_DEBUG								9
+#define WH_SHELL								10
+#define WH_FOREGROUNDIDLE						11
+#define WH_CALLWNDPROCRET						12
+#define WH_KEYBOARD_LL							13
+#define WH_MOUSE_LL								14
+
+#define EVENT_MIN								0x00000001
+#define EVENT_MAX								0x7FFFFFFF
+#define EVENT_SYSTEM_SOUND						0x0001
+#define EVENT_SYSTEM_ALERT						0x0002
+#define EVENT_SYSTEM_FOREGROUND					0x0003
+#define EVENT_SYSTEM_MENUSTART					0x0004
+#define EVENT_SYSTEM_MENUEND					0x0005
+#define EVENT_SYSTEM_MENUPOPUPSTART				0x0006
+#define EVENT_SYSTEM_MENUPOPUPEND				0x0007
+#define EVENT_SYSTEM_CAPTURESTART				0x0008
+#define EVENT_SYSTEM_CAPTUREEND					0x0009
+#define EVENT_SYSTEM_MOVESIZESTART				0x000A
+#define EVENT_SYSTEM_MOVESIZEEND				0x000B
+#define EVENT_SYSTEM_CONTEXTHELPSTART			0x000C
+#define EVENT_SYSTEM_CONTEXTHELPEND				0x000D
+#define EVENT_SYSTEM_DRAGDROPSTART				0x000E
+#define EVENT_SYSTEM_DRAGDROPEND				0x000F
+#define EVENT_SYSTEM_DIALOGSTART				0x0010
+#define EVENT_SYSTEM_DIALOGEND					0x0011
+#define EVENT_SYSTEM_SCROLLINGSTART				0x0012
+#define EVENT_SYSTEM_SCROLLINGEND				0x0013
+#define EVENT_SYSTEM_SWITCHSTART				0x0014
+#define EVENT_SYSTEM_SWITCHEND					0x0015
+#define EVENT_SYSTEM_MINIMIZESTART				0x0016
+#define EVENT_SYSTEM_MINIMIZEEND				0x0017
+#define EVENT_SYSTEM_DESKTOPSWITCH				0x0020
+#define EVENT_SYSTEM_END						0x00FF
+#define EVENT_OEM_DEFINED_START					0x0101
+#define EVENT_OEM_DEFINED_END					0x01FF
+#define EVENT_UIA_EVENTID_START					0x4E00
+#define EVENT_UIA_EVENTID_END					0x4EFF
+#define EVENT_UIA_PROPID_START					0x7500
+#define EVENT_UIA_PROPID_END					0x75FF
+#define EVENT_OBJECT_CREATE						0x8000
+#define EVENT_OBJECT_DESTROY					0x8001
+#define EVENT_OBJECT_SHOW						0x8002
+#define EVENT_OBJECT_HIDE						0x8003
+#define EVENT_OBJECT_REORDER					0x8004
+#define EVENT_OBJECT_FOCUS						0x8005
+#define EVENT_OBJECT_SELECTION					0x8006
+#define EVENT_OBJECT_SELECTIONADD				0x8007
+#define EVENT_OBJECT_SELECTIONREMOVE			0x8008
+#define EVENT_OBJECT_SELECTIONWITHIN			0x8009
+#define EVENT_OBJECT_STATECHANGE				0x800A
+#define EVENT_OBJECT_LOCATIONCHANGE				0x800B
+#define EVENT_OBJECT_NAMECHANGE					0x800C
+#define EVENT_OBJECT_DESCRIPTIONCHANGE			0x800D
+#define EVENT_OBJECT_VALUECHANGE				0x800E
+#define EVENT_OBJECT_PARENTCHANGE				0x800F
+#define EVENT_OBJECT_HELPCHANGE					0x8010
+#define EVENT_OBJECT_DEFACTIONCHANGE			0x8011
+#define EVENT_OBJECT_ACCELERATORCHANGE			0x8012
+#define EVENT_OBJECT_INVOKED					0x8013
+#define EVENT_OBJECT_TEXTSELECTIONCHANGED		0x8014
+#define EVENT_OBJECT_CONTENTSCROLLED			0x8015
+#define EVENT_SYSTEM_ARRANGMENTPREVIEW			0x8016
+#define EVENT_OBJECT_END						0x80FF
+#define EVENT_AIA_START							0xA000
+#define EVENT_AIA_END							0xAFFF
+
+
+/************************************************************************/
+/*                           WINDOW MESSAGES                            */
+/************************************************************************/
+
+#define WM_NULL									0x0000
+#define WM_CREATE								0x0001
+#define WM_DESTROY								0x0002
+#define WM_MOVE									0x0003
+#define WM_SIZE									0x0005
+#define WM_ACTIVATE								0x0006
+#define WM_SETFOCUS								0x0007
+#define WM_KILLFOCUS							0x0008
+#define WM_ENABLE								0x000A
+#define WM_SETREDRAW							0x000B
+#define WM_SETTEXT								0x000C
+#define WM_GETTEXT								0x000D
+#define WM_GETTEXTLENGTH						0x000E
+#define WM_PAINT								0x000F
+#define WM_CLOSE								0x0010
+#define WM_QUERYENDSESSION						0x0011
+#define WM_QUIT									0x0012
+#define WM_QUERYOPEN							0x0013
+#define WM_ERASEBKGND							0x0014
+#define WM_SYSCOLORCHANGE						0x0015
+#define WM_ENDSESSION							0x0016
+#define WM_SHOWWINDOW							0x0018
+#define WM_WININICHANGE							0x001A
+#define WM_SETTINGCHANGE						WM_WININICHANGE
+#define WM_DEVMODECHANGE						0x001B
+#define WM_ACTIVATEAPP							0x001C
+#define WM_FONTCHANGE							0x001D
+#define WM_TIMECHANGE							0x001E
+#define WM_CANCELMODE							0x001F
+#define WM_SETCURSOR							0x0020
+#define WM_MOUSEACTIVATE						0x0021
+#define WM_CHILDACTIVATE						0x0022
+#define WM_QUEUESYNC							0x0023
+#define WM_GETMINMAXINFO						0x0024
+#define WM_PAINTICON							0x0026
+#define WM_ICONERASEBKGND						0x0027
+#define WM_NEXTDLGCTL							0x0028
+#define WM_SPOOLERSTATUS						0x002A
+#define WM_DRAWITEM								0x002B
+#define WM_MEASUREITEM							0x002C
+#define WM_DELETEITEM							0x002D
+#define WM_VKEYTOITEM							0x002E
+#define WM_CHARTOITEM							0x002F
+#define WM_SETFONT								0x0030
+#define WM_GETFONT								0x0031
+#define WM_SETHOTKEY							0x0032
+#define WM_GETHOTKEY							0x0033
+#define WM_QUERYDRAGICON						0x0037
+#define WM_COMPAREITEM							0x0039
+#define WM_GETOBJECT							0x003D
+#define WM_COMPACTING							0x0041
+#define WM_COMMNOTIFY							0x0044
+#define WM_WINDOWPOSCHANGING					0x0046
+#define WM_WINDOWPOSCHANGED						0x0047
+#define WM_POWER								0x0048
+#define WM_COPYDATA								0x004A
+#define WM_CANCELJOURNAL						0x004B
+#define WM_NOTIFY								0x004E
+#define WM_INPUTLANGCHANGEREQUEST				0x0050
+#define WM_INPUTLANGCHANGE						0x0051
+#define WM_TCARD								0x0052
+#define WM_HELP									0x0053
+#define WM_USERCHANGED							0x0054
+#define WM_NOTIFYFORMAT							0x0055
+#define WM_CONTEXTMENU							0x007B
+#define WM_STYLECHANGING						0x007C
+#define WM_STYLECHANGED							0x007D
+#define WM_DISPLAYCHANGE						0x007E
+#define WM_GETICON								0x007F
+#define WM_SETICON								0x0080
+#define WM_NCCREATE								0x0081
+#define WM_NCDESTROY							0x0082
+#define WM_NCCALCSIZE							0x0083
+#define WM_NCHITTEST							0x0084
+#define WM_NCPAINT								0x0085
+#define WM_NCACTIVATE							0x0086
+#define WM_GETDLGCODE							0x0087
+#define WM_SYNCPAINT							0x0088
+#define WM_NCMOUSEMOVE							0x00A0
+#define WM_NCLBUTTONDOWN						0x00A1
+#define WM_NCLBUTTONUP							0x00A2
+#define WM_NCLBUTTONDBLCLK						0x00A3
+#define WM_NCRBUTTONDOWN						0x00A4
+#define WM_NCRBUTTONUP							0x00A5
+#define WM_NCRBUTTONDBLCLK						0x00A6
+#define WM_NCMBUTTONDOWN						0x00A7
+#define WM_NCMBUTTONUP							0x00A8
+#define WM_NCMBUTTONDBLCLK						0x00A9
+#define WM_NCXBUTTONDOWN						0x00AB
+#define WM_NCXBUTTONUP							0x00AC
+#define WM_NCXBUTTONDBLCLK						0x00AD
+#define WM_INPUT								0x00FF
+#define WM_KEYFIRST								0x0100
+#define WM_KEYDOWN								0x0100
+#define WM_KEYUP								0x0101
+#define WM_CHAR									0x0102
+#define WM_DEADCHAR								0x0103
+#define WM_SYSKEYDOWN							0x0104
+#define WM_SYSKEYUP								0x0105
+#define WM_SYSCHAR								0x0106
+#define WM_SYSDEADCHAR							0x0107
+#define WM_UNICHAR								0x0109
+#define WM_KEYLAST								0x0109
+#define WM_IME_STARTCOMPOSITION					0x010D
+#define WM_IME_ENDCOMPOSITION					0x010E
+#define WM_IME_COMPOSITION						0x010F
+#define WM_IME_KEYLAST							0x010F
+#define WM_INITDIALOG							0x0110
+#define WM_COMMAND								0x0111
+#define WM_SYSCOMMAND							0x0112
+#define WM_TIMER								0x0113
+#define WM_HSCROLL								0x0114
+#define WM_VSCROLL								0x0115
+#define WM_INITMENU								0x0116
+#define WM_INITMENUPOPUP						0x0117
+#define WM_MENUSELECT							0x011F
+#define WM_MENUCHAR								0x0120
+#define WM_ENTERIDLE							0x0121
+#define WM_MENURBUTTONUP						0x0122
+#define WM_MENUDRAG								0x0123
+#define WM_MENUGETOBJECT						0x0124
+#define WM_UNINITMENUPOPUP						0x0125
+#define WM_MENUCOMMAND							0x0126
+#define WM_CHANGEUISTATE						0x0127
+#define WM_UPDATEUISTATE						0x0128
+#define WM_QUERYUISTATE							0x0129
+#define WM_CTLCOLORMSGBOX						0x0132
+#define WM_CTLCOLOREDIT							0x0133
+#define WM_CTLCOLORLISTBOX						0x0134
+#define WM_CTLCOLORBTN							0x0135
+#define WM_CTLCOLORDLG							0x0136
+#define WM_CTLCOLORSCROLLBAR					0x0137
+#define WM_CTLCOLORSTATIC						0x0138
+#define WM_MOUSEFIRST							0x0200
+#define WM_MOUSEMOVE							0x0200
+#define WM_LBUTTONDOWN							0x0201
+#define WM_LBUTTONUP							0x0202
+#define WM_LBUTTONDBLCLK						0x0203
+#define WM_RBUTTONDOWN							0x0204
+#define WM_RBUTTONUP							0x0205
+#define WM_RBUTTONDBLCLK						0x0206
+#define WM_MBUTTONDOWN							0x0207
+#define WM_MBUTTONUP							0x0208
+#define WM_MBUTTONDBLCLK						0x0209
+#define WM_MOUSEWHEEL							0x020A
+#define WM_XBUTTONDOWN							0x020B
+#define WM_XBUTTONUP							0x020C
+#define WM_XBUTTONDBLCLK						0x020D
+#define WM_MOUSELAST							0x020E
+#define WM_PARENTNOTIFY							0x0210
+#define WM_ENTERMENULOOP						0x0211
+#define WM_EXITMENULOOP							0x0212
+#define WM_NEXTMENU								0x0213
+#define WM_SIZING								0x0214
+#define WM_CAPTURECHANGED						0x0215
+#define WM_MOVING								0x0216
+#define WM_POWERBROADCAST						0x0218
+#define WM_DEVICECHANGE							0x0219
+#define WM_MDICREATE							0x0220
+#define WM_MDIDESTROY							0x0221
+#define WM_MDIACTIVATE							0x0222
+#define WM_MDIRESTORE							0x0223
+#define WM_MDINEXT								0x0224
+#define WM_MDIMAXIMIZE							0x0225
+#define WM_MDITILE								0x0226
+#define WM_MDICASCADE							0x0227
+#define WM_MDIICONARRANGE						0x0228
+#define WM_MDIGETACTIVE							0x0229
+#define WM_MDISETMENU							0x0230
+#define WM_ENTERSIZEMOVE						0x0231
+#define WM_EXITSIZEMOVE							0x0232
+#define WM_DROPFILES							0x0233
+#define WM_MDIREFRESHMENU						0x0234
+#define WM_IME_SETCONTEXT						0x0281
+#define WM_IME_NOTIFY							0x0282
+#define WM_IME_CONTROL							0x0283
+#define WM_IME_COMPOSITIONFULL					0x0284
+#define WM_IME_SELECT							0x0285
+#define WM_IME_CHAR								0x0286
+#define WM_IME_REQUEST							0x0288
+#define WM_IME_KEYDOWN							0x0290
+#define WM_IME_KEYUP							0x0291
+#define WM_NCMOUSEHOVER							0x02A0
+#define WM_MOUSEHOVER							0x02A1
+#define WM_NCMOUSELEAVE							0x02A2
+#define WM_MOUSELEAVE							0x02A3
+#define WM_WTSSESSION_CHANGE					0x02B1
+#define WM_TABLET_FIRST							0x02C0
+#define WM_TABLET_LAST							0x02DF
+#define WM_CUT									0x0300
+#define WM_COPY									0x0301
+#define WM_PASTE								0x0302
+#define WM_CLEAR								0x0303
+#define WM_UNDO									0x0304
+#define WM_RENDERFORMAT							0x0305
+#define WM_RENDERALLFORMATS						0x0306
+#define WM_DESTROYCLIPBOARD						0x0307
+#define WM_DRAWCLIPBOARD						0x0308
+#define WM_PAINTCLIPBOARD						0x0309
+#define WM_VSCROLLCLIPBOARD						0x030A
+#define WM_SIZECLIPBOARD						0x030B
+#define WM_ASKCBFORMATNAME						0x030C
+#define WM_CHANGECBCHAIN						0x030D
+#define WM_HSCROLLCLIPBOARD						0x030E
+#define WM_QUERYNEWPALETTE						0x030F
+#define WM_PALETTEISCHANGING					0x0310
+#define WM_PALETTECHANGED						0x0311
+#define WM_HOTKEY								0x0312
+#define WM_PRINT								0x0317
+#define WM_PRINTCLIENT							0x0318
+#define WM_APPCOMMAND							0x0319
+#define WM_THEMECHANGED							0x031A
+#define WM_HANDHELDFIRST						0x0358
+#define WM_HANDHELDLAST							0x035F
+#define WM_AFXFIRST								0x0360
+#define WM_AFXLAST								0x037F
+#define WM_PENWINFIRST							0x0380
+#define WM_PENWINLAST							0x038F
+
+
+
+#endif
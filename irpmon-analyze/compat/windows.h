@@ -0,0 +1,311 @@
+
+/**
+ * @file
+ *
+ * Subset of the Windows API used by the translation library and the request
+ * decoding code of irpmonconsole, implemented on top of POSIX. Only used
+ * when building irpmon-analyze outside Windows.
+ *
+ * The integer types keep their Windows sizes (LONG and ULONG are 32 bits
+ * wide), so the records stored in capture files by 64-bit Windows can be
+ * accessed directly. WCHAR is wchar_t of the platform; strings read from
+ * captures must be converted from UTF-16.
+ */
+
+#ifndef __IRPMON_COMPAT_WINDOWS_H__
+#define __IRPMON_COMPAT_WINDOWS_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <pthread.h>
+#ifdef __cplusplus
+// The C++ headers undefine the macros replacing the standard routines below,
+// they must be processed first.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#endif
+
+
+#ifdef __cplusplus
+#define EXTERN_C					extern "C"
+#else
+#define EXTERN_C					extern
+#endif
+
+#define __declspec(a)
+#define WINAPI
+#define NTAPI
+#define CALLBACK
+#define FORCEINLINE					static inline
+#define IN
+#define OUT
+#define OPTIONAL
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+
+#define VOID						void
+#define TRUE						1
+#define FALSE						0
+
+typedef void *PVOID, *LPVOID;
+typedef const void *LPCVOID;
+typedef char CHAR, *PCHAR, *PSTR, *LPSTR;
+typedef const char *LPCSTR, *PCSTR;
+typedef unsigned char UCHAR, *PUCHAR, BYTE, *PBYTE, BOOLEAN, *PBOOLEAN;
+typedef int16_t SHORT, *PSHORT;
+typedef uint16_t USHORT, *PUSHORT, WORD, *PWORD, UINT16, *PUINT16;
+typedef int INT, *PINT, BOOL, *PBOOL;
+typedef unsigned int UINT, *PUINT;
+typedef int32_t LONG, *PLONG, LONG32, INT32, NTSTATUS;
+typedef uint32_t ULONG, *PULONG, ULONG32, *PULONG32, UINT32, DWORD, *PDWORD, *LPDWORD;
+typedef int64_t LONG64, *PLONG64, LONGLONG, *PLONGLONG, INT64;
+typedef uint64_t ULONG64, *PULONG64, ULONGLONG, *PULONGLONG, UINT64, DWORD64;
+typedef intptr_t LONG_PTR, INT_PTR;
+typedef uintptr_t ULONG_PTR, *PULONG_PTR, UINT_PTR, DWORD_PTR;
+typedef size_t SIZE_T, *PSIZE_T;
+typedef void *HANDLE, **PHANDLE, *HMODULE, *HINSTANCE;
+typedef wchar_t WCHAR, *PWCHAR, *PWSTR, *LPWSTR;
+typedef const wchar_t *PCWSTR, *LPCWSTR;
+
+typedef union _LARGE_INTEGER {
+	struct {
+		ULONG LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _LIST_ENTRY {
+	struct _LIST_ENTRY *Flink;
+	struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _GUID {
+	ULONG Data1;
+	USHORT Data2;
+	USHORT Data3;
+	UCHAR Data4[8];
+} GUID, *PGUID;
+
+typedef struct _FILETIME {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME, *PFILETIME;
+
+#define FIELD_OFFSET(aType, aField)				offsetof(aType, aField)
+#define CONTAINING_RECORD(aAddress, aType, aField)	((aType *)((PUCHAR)(aAddress) - offsetof(aType, aField)))
+#define ZeroMemory(aDestination, aLength)		memset((aDestination), 0, (aLength))
+#define CopyMemory(aDestination, aSource, aLength)	memcpy((aDestination), (aSource), (aLength))
+#define __debugbreak()							__builtin_trap()
+#define MemoryBarrier()							__sync_synchronize()
+
+#ifndef __cplusplus
+#ifndef min
+#define min(a, b)								(((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)								(((a) > (b)) ? (a) : (b))
+#endif
+#endif
+
+#define ERROR_SUCCESS							0
+#define ERROR_INVALID_FUNCTION					1
+#define ERROR_FILE_NOT_FOUND					2
+#define ERROR_ACCESS_DENIED						5
+#define ERROR_NOT_ENOUGH_MEMORY					8
+#define ERROR_INVALID_DATA						13
+#define ERROR_GEN_FAILURE						31
+#define ERROR_HANDLE_EOF						38
+#define ERROR_NOT_SUPPORTED						50
+#define ERROR_INVALID_PARAMETER					87
+#define ERROR_INSUFFICIENT_BUFFER				122
+#define ERROR_BUSY								170
+#define ERROR_ALREADY_EXISTS					183
+#define ERROR_NO_MORE_ITEMS						259
+#define ERROR_TOO_MANY_POSTS					298
+#define ERROR_MR_MID_NOT_FOUND					317
+#define ERROR_OPERATION_ABORTED					995
+#define ERROR_NOT_FOUND							1168
+
+#define WM_USER									0x0400
+#define WM_APP									0x8000
+
+#define CP_UTF8									65001
+
+#define FORMAT_MESSAGE_ALLOCATE_BUFFER			0x00000100
+#define FORMAT_MESSAGE_IGNORE_INSERTS			0x00000200
+#define FORMAT_MESSAGE_FROM_SYSTEM				0x00001000
+#define FORMAT_MESSAGE_ARGUMENT_ARRAY			0x00002000
+
+#define MAXULONG								0xffffffff
+
+#define HEAP_ZERO_MEMORY						0x00000008
+
+#define STATUS_PENDING							((NTSTATUS)0x00000103)
+
+#define INFINITE								0xffffffff
+#define WAIT_OBJECT_0							0
+#define WAIT_TIMEOUT							258
+#define WAIT_FAILED								0xffffffff
+#define MAXIMUM_WAIT_OBJECTS					64
+
+#define CTL_CODE(aDeviceType, aFunction, aMethod, aAccess)		\
+	(((aDeviceType) << 16) | ((aAccess) << 14) | ((aFunction) << 2) | (aMethod))
+#define FILE_DEVICE_UNKNOWN						0x00000022
+#define METHOD_BUFFERED							0
+#define METHOD_IN_DIRECT						1
+#define METHOD_OUT_DIRECT						2
+#define METHOD_NEITHER							3
+#define FILE_ANY_ACCESS							0
+#define FILE_READ_ACCESS						1
+#define FILE_WRITE_ACCESS						2
+
+
+/************************************************************************/
+/*                        ERRORS AND DEBUGGING                          */
+/************************************************************************/
+
+EXTERN_C DWORD GetLastError(VOID);
+EXTERN_C VOID SetLastError(DWORD ErrorCode);
+EXTERN_C VOID OutputDebugStringA(LPCSTR String);
+EXTERN_C DWORD GetCurrentProcessId(VOID);
+EXTERN_C DWORD GetCurrentThreadId(VOID);
+EXTERN_C DWORD FormatMessageW(DWORD Flags, LPCVOID Source, DWORD MessageId, DWORD LanguageId, LPWSTR Buffer, DWORD Size, va_list *Arguments);
+EXTERN_C HMODULE GetModuleHandleW(LPCWSTR ModuleName);
+EXTERN_C PVOID GetProcAddress(HMODULE Module, LPCSTR ProcName);
+
+
+/************************************************************************/
+/*                               MEMORY                                 */
+/************************************************************************/
+
+#define GetProcessHeap()						((HANDLE)NULL)
+
+EXTERN_C PVOID HeapAlloc(HANDLE Heap, DWORD Flags, SIZE_T Bytes);
+EXTERN_C PVOID HeapReAlloc(HANDLE Heap, DWORD Flags, PVOID Memory, SIZE_T Bytes);
+EXTERN_C BOOL HeapFree(HANDLE Heap, DWORD Flags, PVOID Memory);
+EXTERN_C BOOL HeapValidate(HANDLE Heap, DWORD Flags, LPCVOID Memory);
+EXTERN_C PVOID LocalFree(PVOID Memory);
+
+
+/************************************************************************/
+/*                         INTERLOCKED OPERATIONS                       */
+/************************************************************************/
+
+#define InterlockedIncrement(aAddend)					__atomic_add_fetch((aAddend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(aAddend)					__atomic_sub_fetch((aAddend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedIncrement64(aAddend)					__atomic_add_fetch((aAddend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement64(aAddend)					__atomic_sub_fetch((aAddend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd(aAddend, aValue)			__atomic_fetch_add((aAddend), (aValue), __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd64(aAddend, aValue)		__atomic_fetch_add((aAddend), (aValue), __ATOMIC_SEQ_CST)
+#define InterlockedExchange(aTarget, aValue)			__atomic_exchange_n((aTarget), (aValue), __ATOMIC_SEQ_CST)
+#define InterlockedCompareExchange(aDestination, aExchange, aComparand)			\
+	__sync_val_compare_and_swap((aDestination), (aComparand), (aExchange))
+#define InterlockedCompareExchange64(aDestination, aExchange, aComparand)		\
+	__sync_val_compare_and_swap((aDestination), (aComparand), (aExchange))
+#define InterlockedCompareExchangePointer(aDestination, aExchange, aComparand)	\
+	__sync_val_compare_and_swap((aDestination), (aComparand), (aExchange))
+
+
+/************************************************************************/
+/*                           SYNCHRONIZATION                            */
+/************************************************************************/
+
+/** Recursive, as the critical sections of Windows are. */
+typedef struct _CRITICAL_SECTION {
+	pthread_mutex_t Mutex;
+} CRITICAL_SECTION, *PCRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+/** An all-zero SRW lock is a valid unlocked one, the same holds for the
+    read-write locks of glibc. */
+typedef struct _SRWLOCK {
+	pthread_rwlock_t Lock;
+} SRWLOCK, *PSRWLOCK;
+
+#define SRWLOCK_INIT							{ PTHREAD_RWLOCK_INITIALIZER }
+
+typedef struct _INIT_ONCE {
+	pthread_mutex_t Mutex;
+	volatile BOOL Done;
+	PVOID Context;
+} INIT_ONCE, *PINIT_ONCE;
+
+#define INIT_ONCE_STATIC_INIT					{ PTHREAD_MUTEX_INITIALIZER, FALSE, NULL }
+
+typedef BOOL (CALLBACK *PINIT_ONCE_FN)(PINIT_ONCE InitOnce, PVOID Parameter, PVOID *Context);
+
+EXTERN_C VOID InitializeCriticalSection(PCRITICAL_SECTION CriticalSection);
+EXTERN_C BOOL InitializeCriticalSectionAndSpinCount(PCRITICAL_SECTION CriticalSection, DWORD SpinCount);
+EXTERN_C VOID EnterCriticalSection(PCRITICAL_SECTION CriticalSection);
+EXTERN_C VOID LeaveCriticalSection(PCRITICAL_SECTION CriticalSection);
+EXTERN_C VOID DeleteCriticalSection(PCRITICAL_SECTION CriticalSection);
+EXTERN_C VOID InitializeSRWLock(PSRWLOCK Lock);
+EXTERN_C VOID AcquireSRWLockShared(PSRWLOCK Lock);
+EXTERN_C VOID ReleaseSRWLockShared(PSRWLOCK Lock);
+EXTERN_C VOID AcquireSRWLockExclusive(PSRWLOCK Lock);
+EXTERN_C VOID ReleaseSRWLockExclusive(PSRWLOCK Lock);
+EXTERN_C VOID InitOnceInitialize(PINIT_ONCE InitOnce);
+EXTERN_C BOOL InitOnceExecuteOnce(PINIT_ONCE InitOnce, PINIT_ONCE_FN InitFn, PVOID Parameter, LPVOID *Context);
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(PVOID Parameter);
+
+/** Events, semaphores and threads are the only kernel objects available; the
+    handles can be waited for, closed, and neither named nor shared with other
+    processes. */
+EXTERN_C HANDLE CreateEventW(PVOID EventAttributes, BOOL ManualReset, BOOL InitialState, LPCWSTR Name);
+EXTERN_C BOOL SetEvent(HANDLE Event);
+EXTERN_C BOOL ResetEvent(HANDLE Event);
+EXTERN_C HANDLE CreateSemaphoreW(PVOID SemaphoreAttributes, LONG InitialCount, LONG MaximumCount, LPCWSTR Name);
+EXTERN_C BOOL ReleaseSemaphore(HANDLE Semaphore, LONG ReleaseCount, PLONG PreviousCount);
+EXTERN_C HANDLE CreateThread(PVOID ThreadAttributes, SIZE_T StackSize, LPTHREAD_START_ROUTINE StartAddress, PVOID Parameter, DWORD CreationFlags, PDWORD ThreadId);
+EXTERN_C DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds);
+EXTERN_C DWORD WaitForMultipleObjects(DWORD Count, const HANDLE *Handles, BOOL WaitAll, DWORD Milliseconds);
+EXTERN_C BOOL CloseHandle(HANDLE Handle);
+
+
+/************************************************************************/
+/*                                 TIME                                 */
+/************************************************************************/
+
+EXTERN_C ULONGLONG GetTickCount64(VOID);
+EXTERN_C VOID GetSystemTimeAsFileTime(PFILETIME SystemTimeAsFileTime);
+
+
+/************************************************************************/
+/*                               STRINGS                                */
+/************************************************************************/
+
+/** Formatting routines accepting the format strings of the Microsoft C runtime:
+    %s and %S refer to strings of the same and of the other width, %I64 is the
+    64-bit size prefix and %p prints the zero-padded address without a prefix. */
+EXTERN_C int CompatSwprintf(wchar_t *Buffer, size_t Count, const wchar_t *Format, ...);
+EXTERN_C int CompatVswprintf(wchar_t *Buffer, size_t Count, const wchar_t *Format, va_list Args);
+EXTERN_C int CompatSprintf_s(char *Buffer, size_t Count, const char *Format, ...);
+EXTERN_C int WideCharToMultiByte(UINT CodePage, DWORD Flags, LPCWSTR WideCharStr, int WideCharCount, LPSTR MultiByteStr, int MultiByteCount, LPCSTR DefaultChar, PBOOL UsedDefaultChar);
+
+#define swprintf								CompatSwprintf
+#define vswprintf								CompatVswprintf
+#define sprintf_s								CompatSprintf_s
+#define _TRUNCATE								((size_t)-1)
+#define _vsnprintf_s(aBuffer, aSize, aCount, aFormat, aArgs)	vsnprintf((aBuffer), (aSize), (aFormat), (aArgs))
+#define wcsicmp									wcscasecmp
+#define _wcsicmp								wcscasecmp
+#define _stricmp								strcasecmp
+#define stricmp									strcasecmp
+
+
+#include "winconstants.h"
+
+
+
+#endif
@@ -0,0 +1,267 @@
+/**
+ * @file
+ *
+ * Tests the debug allocator of the translation library (libtranslate/allocator.c)
+ * built with USE_MEMORY_LEAK_DETECTION. The test is compiled and linked with
+ * the address sanitizer, so it also checks that the allocator touches neither
+ * freed nor foreign memory and that DebugAllocatorFinit releases all of its
+ * records and sites.
+ */
+
+#include <time.h>
+#include <windows.h>
+#include "allocator.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+#define TEST_BLOCK_COUNT         10000
+#define TEST_THREAD_COUNT        8
+#define TEST_THREAD_ROUNDS       20000
+
+typedef struct _SITE_STATISTICS {
+   ULONG Count;
+   LONG64 Allocations;
+   LONG64 Frees;
+   LONG64 LiveBytes;
+   PDEBUG_ALLOCATION_SITE Site;
+   PCSTR Function;
+   ULONG Line;
+} SITE_STATISTICS, *PSITE_STATISTICS;
+
+typedef struct _RECORD_STATISTICS {
+   ULONG Count;
+   SIZE_T Bytes;
+} RECORD_STATISTICS, *PRECORD_STATISTICS;
+
+static PVOID _blocks[TEST_BLOCK_COUNT];
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static double _Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static VOID _SiteCallback(PDEBUG_ALLOCATION_SITE Site, PVOID Context)
+{
+   PSITE_STATISTICS s = (PSITE_STATISTICS)Context;
+
+   ++s->Count;
+   s->Allocations += Site->Allocations;
+   s->Frees += Site->Frees;
+   s->LiveBytes += Site->LiveBytes;
+   if (s->Function != NULL && strcmp(Site->Function, s->Function) == 0 && Site->Line == s->Line)
+      s->Site = Site;
+
+   return;
+}
+
+
+static VOID _RecordCallback(PDEBUG_ALLOCATION_RECORD Record, PVOID Context)
+{
+   PRECORD_STATISTICS s = (PRECORD_STATISTICS)Context;
+
+   ++s->Count;
+   s->Bytes += Record->NumberOfBytes;
+
+   return;
+}
+
+
+static SITE_STATISTICS _Sites(PCSTR Function, ULONG Line)
+{
+   SITE_STATISTICS ret;
+
+   memset(&ret, 0, sizeof(ret));
+   ret.Function = Function;
+   ret.Line = Line;
+   DebugAllocatorEnumerateSites(_SiteCallback, &ret);
+
+   return ret;
+}
+
+
+static RECORD_STATISTICS _Records(VOID)
+{
+   RECORD_STATISTICS ret;
+
+   memset(&ret, 0, sizeof(ret));
+   DebugAllocatorCheck(_RecordCallback, &ret);
+
+   return ret;
+}
+
+
+/************************************************************************/
+/*                     TESTS                                            */
+/************************************************************************/
+
+
+static VOID _TestSingleThread(VOID)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG line = 0;
+   SIZE_T bytes = 0;
+   SITE_STATISTICS sites;
+   RECORD_STATISTICS records;
+   BOOLEAN zeroed = TRUE;
+
+   for (i = 0; i < TEST_BLOCK_COUNT; ++i) {
+      if (i % 2 == 0) {
+         line = __LINE__ + 1;
+         _blocks[i] = HeapMemoryAlloc(i % 97 + 1);
+      } else _blocks[i] = HeapMemoryAlloc(i % 89 + 1);
+
+      TEST_CHECK(_blocks[i] != NULL, "allocation %u failed", i);
+      if (_blocks[i] == NULL)
+         return;
+
+      for (j = 0; j < i % 97 + 1 && (i % 2 == 0); ++j)
+         zeroed &= (((PUCHAR)_blocks[i])[j] == 0);
+
+      memset(_blocks[i], 0xcc, (i % 2 == 0) ? i % 97 + 1 : i % 89 + 1);
+      bytes += (i % 2 == 0) ? i % 97 + 1 : i % 89 + 1;
+   }
+
+   TEST_CHECK(zeroed, "%s", "blocks are not zeroed");
+   records = _Records();
+   TEST_CHECK(records.Count == TEST_BLOCK_COUNT && records.Bytes == bytes, "%u records of %zu bytes, expected %u of %zu", records.Count, records.Bytes, TEST_BLOCK_COUNT, bytes);
+   sites = _Sites(__FUNCTION__, line);
+   TEST_CHECK(sites.Count == 2, "%u sites", sites.Count);
+   TEST_CHECK(sites.Allocations == TEST_BLOCK_COUNT && sites.Frees == 0 && sites.LiveBytes == (LONG64)bytes, "sites: %lld allocations, %lld frees, %lld bytes", (long long)sites.Allocations, (long long)sites.Frees, (long long)sites.LiveBytes);
+   TEST_CHECK(sites.Site != NULL && sites.Site->Allocations == TEST_BLOCK_COUNT / 2, "%s", "site of the even blocks not found");
+
+   // Free in an order unrelated to the one of the allocations.
+   for (i = 0; i < TEST_BLOCK_COUNT; ++i) {
+      j = (i * 7919) % TEST_BLOCK_COUNT;
+      HeapMemoryFree(_blocks[j]);
+      _blocks[j] = NULL;
+   }
+
+   records = _Records();
+   TEST_CHECK(records.Count == 0, "%u records left", records.Count);
+   sites = _Sites(__FUNCTION__, line);
+   TEST_CHECK(sites.Count == 2 && sites.Frees == TEST_BLOCK_COUNT && sites.LiveBytes == 0, "sites: %lld frees, %lld bytes", (long long)sites.Frees, (long long)sites.LiveBytes);
+   TEST_CHECK(sites.Site != NULL && sites.Site->PeakBytes > 0 && sites.Site->PeakBytes <= (LONG64)bytes, "peak %lld", (sites.Site != NULL) ? (long long)sites.Site->PeakBytes : 0);
+
+   // A block not allocated by the allocator is reported and left alone.
+   DebugHeapMemoryFree(&i);
+   TEST_CHECK(_Records().Count == 0, "%s", "foreign free changed the records");
+
+   return;
+}
+
+
+static PVOID _Thread(PVOID Context)
+{
+   ULONG i = 0;
+   ULONG index = 0;
+   PVOID blocks[64];
+
+   memset(blocks, 0, sizeof(blocks));
+   index = (ULONG)(ULONG_PTR)Context;
+   for (i = 0; i < TEST_THREAD_ROUNDS; ++i) {
+      index = (index * 1103515245 + 12345);
+      if (blocks[index % 64] != NULL)
+         HeapMemoryFree(blocks[index % 64]);
+
+      blocks[index % 64] = HeapMemoryAlloc(index % 256 + 1);
+   }
+
+   for (i = 0; i < 64; ++i) {
+      if (blocks[i] != NULL)
+         HeapMemoryFree(blocks[i]);
+   }
+
+   return NULL;
+}
+
+
+static VOID _TestThreads(VOID)
+{
+   ULONG i = 0;
+   pthread_t threads[TEST_THREAD_COUNT];
+   SITE_STATISTICS sites;
+
+   for (i = 0; i < TEST_THREAD_COUNT; ++i)
+      pthread_create(threads + i, NULL, _Thread, (PVOID)(ULONG_PTR)(i + 1));
+
+   for (i = 0; i < TEST_THREAD_COUNT; ++i)
+      pthread_join(threads[i], NULL);
+
+   sites = _Sites("_Thread", 0);
+   TEST_CHECK(_Records().Count == 0, "%s", "records left after the threads");
+   TEST_CHECK(sites.Allocations == sites.Frees && sites.LiveBytes == 0, "sites: %lld allocations, %lld frees, %lld bytes", (long long)sites.Allocations, (long long)sites.Frees, (long long)sites.LiveBytes);
+   TEST_CHECK(sites.Allocations == TEST_BLOCK_COUNT + TEST_THREAD_COUNT * TEST_THREAD_ROUNDS, "%lld allocations", (long long)sites.Allocations);
+
+   return;
+}
+
+
+/** Frees of a block must not depend on the number of live blocks. */
+static VOID _TestFreeTime(VOID)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   double start = 0;
+   PVOID p = NULL;
+   static const ULONG liveCounts[] = {0, 1000, TEST_BLOCK_COUNT};
+
+   for (i = 0; i < sizeof(liveCounts) / sizeof(liveCounts[0]); ++i) {
+      for (j = 0; j < liveCounts[i]; ++j)
+         _blocks[j] = HeapMemoryAlloc(16);
+
+      start = _Now();
+      for (j = 0; j < 100000; ++j) {
+         p = HeapMemoryAlloc(16);
+         HeapMemoryFree(p);
+      }
+
+      printf("%5u live blocks: %.0f ns per allocation and free\n", liveCounts[i], (_Now() - start) / 100000 * 1e9);
+      for (j = 0; j < liveCounts[i]; ++j)
+         HeapMemoryFree(_blocks[j]);
+   }
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = DebugAllocatorInit();
+   if (err != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot initialize the allocator: %u\n", err);
+      return 1;
+   }
+
+   _TestSingleThread();
+   _TestThreads();
+   _TestFreeTime();
+   DebugAllocatorFinit();
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("allocator OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file
+ *
+ * Tests the record consumer (irpmondll/consumer.c) on top of the mock driver.
+ * The test provides DriverComTransport itself: the transport passes record
+ * requests to the mock driver and can inject one record larger than any batch
+ * buffer. Batches must be delivered when they contain enough records or when
+ * their oldest record waits for too long. When the user holds all buffers,
+ * the consumer must stop fetching, so the queue limit of the driver drops
+ * records. A record not fitting into a buffer must make the buffer grow
+ * without losing records.
+ */
+
+#include <unistd.h>
+#include <windows.h>
+#include "general-types.h"
+#include "kernel-shared.h"
+#include "ioctls.h"
+#include "irpmondll-types.h"
+#include "codec.h"
+#include "transport.h"
+#include "driver-com.h"
+#include "mock-driver.h"
+#include "consumer.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+/** Size of the injected record, larger than the initial batch buffers. */
+#define TEST_LARGE_RECORD_SIZE   0x10000
+#define TEST_LARGE_RECORD_ID     0xffffffff
+/** Maximum number of batches held by the test. */
+#define TEST_MAX_HELD            64
+
+/** What the batch callback has seen. */
+typedef struct _TEST_DELIVERIES {
+   ULONG Batches;
+   ULONG Records;
+   ULONG MinCount;
+   ULONG MaxCount;
+   /** Time between the creation of the first record of a batch and its
+       delivery, in milliseconds. */
+   ULONG MinLatency;
+   ULONG MaxLatency;
+   /** ID of the next record of the mock driver. */
+   ULONG NextId;
+   /** Number of places where records are missing from the sequence. */
+   ULONG Gaps;
+   ULONG LargeRecords;
+   BOOLEAN LargeRecordIntact;
+   /** When set, the batches are kept instead of being released. */
+   BOOLEAN Hold;
+   ULONG HeldCount;
+   PIRPMON_RECORD_BATCH Held[TEST_MAX_HELD];
+} TEST_DELIVERIES, *PTEST_DELIVERIES;
+
+static TRANSPORT _mock;
+/** The transport used by the consumer. */
+static TRANSPORT _transport;
+static CRITICAL_SECTION _lock;
+static TEST_DELIVERIES _deliveries;
+static volatile LONG _largeRecordPending = 0;
+/** Number of record requests refused because of the large record. */
+static volatile LONG _insufficientBuffers = 0;
+static ULONG64 _largeRecord[TEST_LARGE_RECORD_SIZE / sizeof(ULONG64)];
+
+
+/************************************************************************/
+/*                     TRANSPORT                                        */
+/************************************************************************/
+
+
+static DWORD _TestRecordsWait(PVOID Records, PVOID Buffer, ULONG Length, DWORD Timeout, HANDLE StopEvent, PULONG ReturnLength)
+{
+   ULONG offset = 0;
+   DWORD ret = ERROR_GEN_FAILURE;
+
+   if (__atomic_load_n(&_largeRecordPending, __ATOMIC_ACQUIRE)) {
+      ret = CodecRecordAppend(Buffer, Length, &offset, (PREQUEST_HEADER)_largeRecord, TEST_LARGE_RECORD_SIZE);
+      *ReturnLength = offset;
+      if (ret == ERROR_SUCCESS)
+         __atomic_store_n(&_largeRecordPending, 0, __ATOMIC_RELEASE);
+      else if (ret == ERROR_INSUFFICIENT_BUFFER)
+         InterlockedIncrement(&_insufficientBuffers);
+
+      return ret;
+   }
+
+   return _mock.RecordsWait(Records, Buffer, Length, Timeout, StopEvent, ReturnLength);
+}
+
+
+PTRANSPORT DriverComTransport(VOID)
+{
+   return &_transport;
+}
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static VOID WINAPI _BatchCallback(PIRPMON_RECORD_BATCH Batch, PVOID Context)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG latency = 0;
+   FILETIME now;
+   ULONGLONG nowTime = 0;
+   BOOLEAN release = TRUE;
+   PREQUEST_HEADER header = NULL;
+
+   GetSystemTimeAsFileTime(&now);
+   nowTime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+   EnterCriticalSection(&_lock);
+   for (i = 0; i < Batch->Count; ++i) {
+      header = Batch->Records[i].Header;
+      if (header->Id == TEST_LARGE_RECORD_ID) {
+         ++_deliveries.LargeRecords;
+         _deliveries.LargeRecordIntact = (Batch->Records[i].Size == TEST_LARGE_RECORD_SIZE);
+         for (j = sizeof(REQUEST_HEADER); _deliveries.LargeRecordIntact && j < TEST_LARGE_RECORD_SIZE; ++j)
+            _deliveries.LargeRecordIntact = (((PUCHAR)header)[j] == (UCHAR)j);
+
+         continue;
+      }
+
+      if (header->Id != _deliveries.NextId)
+         ++_deliveries.Gaps;
+
+      _deliveries.NextId = header->Id + 1;
+   }
+
+   if (Batch->Count > 0 && Batch->Records[0].Header->Id != TEST_LARGE_RECORD_ID) {
+      latency = (ULONG)((nowTime - (ULONGLONG)Batch->Records[0].Header->Time.QuadPart) / 10000);
+      if (_deliveries.Batches == 0 || latency < _deliveries.MinLatency)
+         _deliveries.MinLatency = latency;
+
+      if (latency > _deliveries.MaxLatency)
+         _deliveries.MaxLatency = latency;
+   }
+
+   if (_deliveries.Batches == 0 || Batch->Count < _deliveries.MinCount)
+      _deliveries.MinCount = Batch->Count;
+
+   if (Batch->Count > _deliveries.MaxCount)
+      _deliveries.MaxCount = Batch->Count;
+
+   ++_deliveries.Batches;
+   _deliveries.Records += Batch->Count;
+   if (_deliveries.Hold && _deliveries.HeldCount < TEST_MAX_HELD) {
+      _deliveries.Held[_deliveries.HeldCount] = Batch;
+      ++_deliveries.HeldCount;
+      release = FALSE;
+   }
+
+   LeaveCriticalSection(&_lock);
+   if (release)
+      ConsumerBatchRelease(Batch);
+
+   return;
+}
+
+
+static TEST_DELIVERIES _DeliveriesGet(VOID)
+{
+   TEST_DELIVERIES ret;
+
+   EnterCriticalSection(&_lock);
+   ret = _deliveries;
+   LeaveCriticalSection(&_lock);
+
+   return ret;
+}
+
+
+/** Opens the mock driver, connects to it and starts the consumer. */
+static BOOLEAN _ConsumerStart(ULONG RecordsPerSecond, ULONG QueueLimit, ULONG BatchSize, ULONG MaxLatency)
+{
+   ULONG length = 0;
+   IRPMON_MOCK_SETTINGS settings = {RecordsPerSecond, QueueLimit, 2, 2};
+   DWORD err = ERROR_GEN_FAILURE;
+
+   memset(&_deliveries, 0, sizeof(_deliveries));
+   err = MockDriverOpen(&settings, &_mock);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot open the mock driver: %u", err);
+   if (err != ERROR_SUCCESS)
+      return FALSE;
+
+   _transport = _mock;
+   _transport.RecordsWait = _TestRecordsWait;
+   _mock.Ioctl(_mock.Context, IOCTL_IRPMNDRV_CONNECT, NULL, 0, NULL, 0, &length);
+   err = ConsumerStart(_BatchCallback, BatchSize, MaxLatency, NULL);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot start the consumer: %u", err);
+   if (err != ERROR_SUCCESS) {
+      _mock.Close(_mock.Context);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static VOID _ConsumerStop(VOID)
+{
+   ULONG length = 0;
+
+   ConsumerStop();
+   _mock.Ioctl(_mock.Context, IOCTL_IRPMNDRV_DISCONNECT, NULL, 0, NULL, 0, &length);
+   _mock.Close(_mock.Context);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     TESTS                                            */
+/************************************************************************/
+
+
+/** Records are always available, so every batch is delivered because it
+    reached the batch size. */
+static VOID _TestBatchSize(VOID)
+{
+   TEST_DELIVERIES d;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = ConsumerStart(_BatchCallback, 0, 10, NULL);
+   TEST_CHECK(err == ERROR_INVALID_PARAMETER, "zero batch size: %u", err);
+   err = ConsumerStart(_BatchCallback, 16, INFINITE, NULL);
+   TEST_CHECK(err == ERROR_INVALID_PARAMETER, "infinite latency: %u", err);
+   if (!_ConsumerStart(0, 0, 16, 1000))
+      return;
+
+   err = ConsumerStart(_BatchCallback, 16, 1000, NULL);
+   TEST_CHECK(err == ERROR_BUSY, "second consumer: %u", err);
+   usleep(100000);
+   d = _DeliveriesGet();
+   _ConsumerStop();
+   TEST_CHECK(d.Batches > 0 && d.MinCount >= 16, "batch size: %u batches, smallest %u records", d.Batches, d.MinCount);
+   TEST_CHECK(d.Gaps == 0, "batch size: %u gaps in %u records", d.Gaps, d.Records);
+
+   return;
+}
+
+
+/** 200 records per second never fill a batch of 1000 records, every batch
+    is delivered when its first record waited for 50 ms. */
+static VOID _TestMaxLatency(VOID)
+{
+   TEST_DELIVERIES d;
+
+   if (!_ConsumerStart(200, 0, 1000, 50))
+      return;
+
+   // Stopping delivers the last batch early, it is not counted.
+   usleep(600000);
+   d = _DeliveriesGet();
+   _ConsumerStop();
+   TEST_CHECK(d.Batches >= 5 && d.MaxCount < 1000, "max latency: %u batches, largest %u records", d.Batches, d.MaxCount);
+   TEST_CHECK(d.Records >= 2*d.Batches, "max latency: %u records in %u batches", d.Records, d.Batches);
+   TEST_CHECK(d.MinLatency >= 45 && d.MaxLatency <= 150, "max latency: latency between %u and %u ms", d.MinLatency, d.MaxLatency);
+   TEST_CHECK(d.Gaps == 0, "max latency: %u gaps in %u records", d.Gaps, d.Records);
+
+   return;
+}
+
+
+/** While the test holds all batches, the consumer must not fetch records, so
+    the driver queue fills up and the newer records are dropped. Releasing the
+    batches resumes the delivery after the dropped records. */
+static VOID _TestPoolExhaustion(VOID)
+{
+   ULONG i = 0;
+   ULONG heldCount = 0;
+   TEST_DELIVERIES d1;
+   TEST_DELIVERIES d2;
+   TEST_DELIVERIES d3;
+   IRPMON_MOCK_STATISTICS s1;
+   IRPMON_MOCK_STATISTICS s2;
+   PIRPMON_RECORD_BATCH held[TEST_MAX_HELD];
+
+   if (!_ConsumerStart(20000, 1000, 64, 10))
+      return;
+
+   EnterCriticalSection(&_lock);
+   _deliveries.Hold = TRUE;
+   LeaveCriticalSection(&_lock);
+   usleep(300000);
+   d1 = _DeliveriesGet();
+   MockDriverStatistics(_mock.Context, &s1);
+   usleep(200000);
+   d2 = _DeliveriesGet();
+   MockDriverStatistics(_mock.Context, &s2);
+   TEST_CHECK(d1.HeldCount > 0 && d1.HeldCount < TEST_MAX_HELD && d2.HeldCount == d1.HeldCount, "pool exhaustion: %u batches held, then %u", d1.HeldCount, d2.HeldCount);
+   TEST_CHECK(s2.Delivered == s1.Delivered, "pool exhaustion: records fetched while all buffers were held (%llu, then %llu)", (unsigned long long)s1.Delivered, (unsigned long long)s2.Delivered);
+   TEST_CHECK(s2.Pending == 1000 && s2.Dropped > s1.Dropped, "pool exhaustion: %llu pending, %llu dropped", (unsigned long long)s2.Pending, (unsigned long long)s2.Dropped);
+   TEST_CHECK(d2.Gaps == 0, "pool exhaustion: %u gaps before the stall", d2.Gaps);
+
+   EnterCriticalSection(&_lock);
+   _deliveries.Hold = FALSE;
+   heldCount = _deliveries.HeldCount;
+   memcpy(held, _deliveries.Held, heldCount*sizeof(PIRPMON_RECORD_BATCH));
+   _deliveries.HeldCount = 0;
+   LeaveCriticalSection(&_lock);
+   for (i = 0; i < heldCount; ++i)
+      ConsumerBatchRelease(held[i]);
+
+   usleep(100000);
+   d3 = _DeliveriesGet();
+   _ConsumerStop();
+   TEST_CHECK(d3.Batches > d2.Batches, "pool exhaustion: %u batches after the release", d3.Batches - d2.Batches);
+   TEST_CHECK(d3.Gaps > 0, "pool exhaustion: %s", "the dropped records were delivered");
+
+   return;
+}
+
+
+/** A record larger than the buffer makes the consumer deliver the records
+    it has, then grow the buffer and fetch the record. */
+static VOID _TestBufferRegrowth(VOID)
+{
+   ULONG i = 0;
+   TEST_DELIVERIES d;
+   PREQUEST_HEADER header = (PREQUEST_HEADER)_largeRecord;
+
+   for (i = sizeof(REQUEST_HEADER); i < TEST_LARGE_RECORD_SIZE; ++i)
+      ((PUCHAR)_largeRecord)[i] = (UCHAR)i;
+
+   memset(header, 0, sizeof(REQUEST_HEADER));
+   header->Type = ertIRP;
+   header->Id = TEST_LARGE_RECORD_ID;
+   _insufficientBuffers = 0;
+   if (!_ConsumerStart(10000, 0, 16, 10))
+      return;
+
+   usleep(50000);
+   __atomic_store_n(&_largeRecordPending, 1, __ATOMIC_RELEASE);
+   for (i = 0; i < 100 && _DeliveriesGet().LargeRecords == 0; ++i)
+      usleep(10000);
+
+   usleep(50000);
+   _ConsumerStop();
+   d = _DeliveriesGet();
+   TEST_CHECK(_insufficientBuffers > 0, "buffer regrowth: %s", "the record fitted into the initial buffer");
+   TEST_CHECK(d.LargeRecords == 1 && d.LargeRecordIntact, "buffer regrowth: %u large records delivered, intact %u", d.LargeRecords, d.LargeRecordIntact);
+   TEST_CHECK(d.Gaps == 0 && d.Records > d.LargeRecords, "buffer regrowth: %u gaps in %u records", d.Gaps, d.Records);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   InitializeCriticalSection(&_lock);
+   _TestBatchSize();
+   _TestMaxLatency();
+   _TestPoolExhaustion();
+   _TestBufferRegrowth();
+   DeleteCriticalSection(&_lock);
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("consumer OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
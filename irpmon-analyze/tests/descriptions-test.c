@@ -0,0 +1,398 @@
+/**
+ * @file
+ *
+ * Tests the description blob parser of the translation library
+ * (libtranslate/descriptions.c). Valid blobs must describe exactly the codes
+ * they contain, malformed blobs must be rejected without replacing the current
+ * source, and values with empty descriptions must be remembered as having
+ * none.
+ */
+
+#include <windows.h>
+#include "libtranslate.h"
+#include "descriptions.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+typedef struct _TEST_DESCRIPTION {
+   ULONG32 Code;
+   const wchar_t *Text;
+} TEST_DESCRIPTION, *PTEST_DESCRIPTION;
+
+static const TEST_DESCRIPTION _ntstatusDescriptions[] = {
+   {0x00000000, L"The operation completed successfully."},
+   {0xC0000001, L"Unsuccessful."},
+   {0xC000000D, L""},
+   {0xC0000022, L"Access denied."},
+};
+
+static const TEST_DESCRIPTION _windowsErrorDescriptions[] = {
+   {2, L"The system cannot find the file specified."},
+   {5, L"Access is denied."},
+   {87, L""},
+};
+
+#define TEST_COUNT(aArray)       (sizeof(aArray) / sizeof(aArray[0]))
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static VOID _BlobRecordsAppend(PUCHAR Blob, PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD Record, const TEST_DESCRIPTION *Descriptions, ULONG Count, PULONG StringOffset)
+{
+   ULONG i = 0;
+   SIZE_T len = 0;
+
+   for (i = 0; i < Count; ++i) {
+      len = (wcslen(Descriptions[i].Text) + 1) * sizeof(WCHAR);
+      Record[i].Code = Descriptions[i].Code;
+      Record[i].Offset = *StringOffset;
+      memcpy(Blob + *StringOffset, Descriptions[i].Text, len);
+      *StringOffset += (ULONG)len;
+   }
+
+   return;
+}
+
+
+static PUCHAR _BlobBuild(const TEST_DESCRIPTION *NTSTATUSDescriptions, ULONG NTSTATUSCount, const TEST_DESCRIPTION *WindowsErrorDescriptions, ULONG WindowsErrorCount, PULONG BlobSize)
+{
+   ULONG i = 0;
+   ULONG size = 0;
+   ULONG stringOffset = 0;
+   PUCHAR ret = NULL;
+   PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER header = NULL;
+   PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD records = NULL;
+
+   stringOffset = sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER) + (NTSTATUSCount + WindowsErrorCount) * sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_RECORD);
+   size = stringOffset;
+   for (i = 0; i < NTSTATUSCount; ++i)
+      size += (ULONG)((wcslen(NTSTATUSDescriptions[i].Text) + 1) * sizeof(WCHAR));
+
+   for (i = 0; i < WindowsErrorCount; ++i)
+      size += (ULONG)((wcslen(WindowsErrorDescriptions[i].Text) + 1) * sizeof(WCHAR));
+
+   // An empty blob still has to end with a null character.
+   if (NTSTATUSCount + WindowsErrorCount == 0)
+      size += sizeof(WCHAR);
+
+   ret = (PUCHAR)calloc(1, size);
+   if (ret == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+
+   header = (PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER)ret;
+   header->Signature = LIBTRANSLATE_DESCRIPTION_BLOB_SIGNATURE;
+   header->Version = LIBTRANSLATE_DESCRIPTION_BLOB_VERSION;
+   header->NTSTATUSCount = NTSTATUSCount;
+   header->WindowsErrorCount = WindowsErrorCount;
+   records = (PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD)(header + 1);
+   _BlobRecordsAppend(ret, records, NTSTATUSDescriptions, NTSTATUSCount, &stringOffset);
+   _BlobRecordsAppend(ret, records + NTSTATUSCount, WindowsErrorDescriptions, WindowsErrorCount, &stringOffset);
+   *BlobSize = size;
+
+   return ret;
+}
+
+
+static PUCHAR _BlobBuildDefault(PULONG BlobSize)
+{
+   return _BlobBuild(_ntstatusDescriptions, TEST_COUNT(_ntstatusDescriptions), _windowsErrorDescriptions, TEST_COUNT(_windowsErrorDescriptions), BlobSize);
+}
+
+
+static VOID _CheckDescription(ELibTranslateIntegerValueType Type, ULONG32 Code, const wchar_t *Expected)
+{
+   PWCHAR desc = NULL;
+
+   desc = DescriptionGet(Type, Code);
+   if (Expected == NULL) {
+      TEST_CHECK(desc == NULL, "type %u, code 0x%x: unexpected description \"%ls\"", Type, Code, desc);
+   } else {
+      TEST_CHECK(desc != NULL && wcscmp(desc, Expected) == 0, "type %u, code 0x%x: expected \"%ls\", got \"%ls\"", Type, Code, Expected, (desc != NULL) ? desc : L"(null)");
+   }
+
+   if (desc != NULL)
+      DescriptionFree(desc);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     TESTS                                            */
+/************************************************************************/
+
+
+static VOID _TestValidBlob(VOID)
+{
+   ULONG i = 0;
+   ULONG blobSize = 0;
+   PUCHAR blob = NULL;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   blob = _BlobBuildDefault(&blobSize);
+   err = DescriptionsSetSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_SUCCESS, "valid blob rejected: %u", err);
+   // The library keeps its own copy.
+   memset(blob, 0, blobSize);
+   free(blob);
+   for (i = 0; i < TEST_COUNT(_ntstatusDescriptions); ++i)
+      _CheckDescription(ltivtNTSTATUS, _ntstatusDescriptions[i].Code, (*_ntstatusDescriptions[i].Text != L'\0') ? _ntstatusDescriptions[i].Text : NULL);
+
+   for (i = 0; i < TEST_COUNT(_windowsErrorDescriptions); ++i)
+      _CheckDescription(ltivtWindowsError, _windowsErrorDescriptions[i].Code, (*_windowsErrorDescriptions[i].Text != L'\0') ? _windowsErrorDescriptions[i].Text : NULL);
+
+   // Codes between, below and above the records, and codes of the other group.
+   _CheckDescription(ltivtNTSTATUS, 0xC0000002, NULL);
+   _CheckDescription(ltivtNTSTATUS, 0xFFFFFFFF, NULL);
+   _CheckDescription(ltivtNTSTATUS, 2, NULL);
+   _CheckDescription(ltivtWindowsError, 0, NULL);
+   _CheckDescription(ltivtWindowsError, 3, NULL);
+   _CheckDescription(ltivtWindowsError, 1000, NULL);
+   _CheckDescription(ltivtWindowsError, 0xC0000001, NULL);
+   _CheckDescription(ltivtDeviceControl, 2, NULL);
+
+   blob = _BlobBuild(NULL, 0, NULL, 0, &blobSize);
+   err = DescriptionsSetSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_SUCCESS, "empty blob rejected: %u", err);
+   free(blob);
+   _CheckDescription(ltivtNTSTATUS, 0, NULL);
+   _CheckDescription(ltivtWindowsError, 2, NULL);
+
+   blob = _BlobBuild(_ntstatusDescriptions + 1, 1, NULL, 0, &blobSize);
+   err = DescriptionsSetSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_SUCCESS, "single record blob rejected: %u", err);
+   free(blob);
+   _CheckDescription(ltivtNTSTATUS, 0xC0000001, _ntstatusDescriptions[1].Text);
+   _CheckDescription(ltivtNTSTATUS, 0xC0000000, NULL);
+   _CheckDescription(ltivtNTSTATUS, 0xC0000002, NULL);
+
+   err = DescriptionsSetSource(ltdsNone, NULL, 0);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot select the stub source: %u", err);
+   _CheckDescription(ltivtNTSTATUS, 0xC0000001, NULL);
+
+   return;
+}
+
+
+static VOID _TestMalformedBlob(const char *Name, VOID (*Corrupt)(PUCHAR Blob, PULONG BlobSize))
+{
+   ULONG blobSize = 0;
+   PUCHAR blob = NULL;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   // Select a known source first, it must survive the failed change.
+   blob = _BlobBuild(_ntstatusDescriptions + 3, 1, NULL, 0, &blobSize);
+   err = DescriptionsSetSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_SUCCESS, "%s: the initial blob rejected: %u", Name, err);
+   free(blob);
+
+   blob = _BlobBuildDefault(&blobSize);
+   Corrupt(blob, &blobSize);
+   err = DescriptionsSetSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_INVALID_DATA, "%s: expected ERROR_INVALID_DATA, got %u", Name, err);
+   free(blob);
+   _CheckDescription(ltivtNTSTATUS, 0xC0000022, _ntstatusDescriptions[3].Text);
+   _CheckDescription(ltivtNTSTATUS, 0xC0000001, NULL);
+
+   return;
+}
+
+
+static PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER _Header(PUCHAR Blob)
+{
+   return (PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER)Blob;
+}
+
+
+static PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD _Records(PUCHAR Blob)
+{
+   return (PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD)(_Header(Blob) + 1);
+}
+
+
+static VOID _CorruptSignature(PUCHAR Blob, PULONG BlobSize)
+{
+   _Header(Blob)->Signature ^= 1;
+
+   return;
+}
+
+
+static VOID _CorruptVersion(PUCHAR Blob, PULONG BlobSize)
+{
+   _Header(Blob)->Version++;
+
+   return;
+}
+
+
+static VOID _CorruptTooSmall(PUCHAR Blob, PULONG BlobSize)
+{
+   *BlobSize = sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER);
+
+   return;
+}
+
+
+static VOID _CorruptOddSize(PUCHAR Blob, PULONG BlobSize)
+{
+   --*BlobSize;
+
+   return;
+}
+
+
+static VOID _CorruptUnterminated(PUCHAR Blob, PULONG BlobSize)
+{
+   ((PWCHAR)(Blob + *BlobSize))[-1] = L'x';
+
+   return;
+}
+
+
+static VOID _CorruptTruncated(PUCHAR Blob, PULONG BlobSize)
+{
+   *BlobSize = sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER) + 2 * sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_RECORD);
+   ((PWCHAR)(Blob + *BlobSize))[-1] = L'\0';
+
+   return;
+}
+
+
+static VOID _CorruptCountOverflow(PUCHAR Blob, PULONG BlobSize)
+{
+   _Header(Blob)->NTSTATUSCount = 0xFFFFFFFF;
+   _Header(Blob)->WindowsErrorCount = 0xFFFFFFFF;
+
+   return;
+}
+
+
+static VOID _CorruptUnsorted(PUCHAR Blob, PULONG BlobSize)
+{
+   _Records(Blob)[1].Code = 0xC0000023;
+
+   return;
+}
+
+
+static VOID _CorruptDuplicate(PUCHAR Blob, PULONG BlobSize)
+{
+   _Records(Blob)[5].Code = 2;
+
+   return;
+}
+
+
+static VOID _CorruptOffsetOutside(PUCHAR Blob, PULONG BlobSize)
+{
+   _Records(Blob)[2].Offset = *BlobSize;
+
+   return;
+}
+
+
+static VOID _CorruptOffsetRecords(PUCHAR Blob, PULONG BlobSize)
+{
+   _Records(Blob)[4].Offset = sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER);
+
+   return;
+}
+
+
+static VOID _CorruptOffsetMisaligned(PUCHAR Blob, PULONG BlobSize)
+{
+   _Records(Blob)[0].Offset += 1;
+
+   return;
+}
+
+
+
+static VOID _TestCachedDescriptions(VOID)
+{
+   ULONG blobSize = 0;
+   PUCHAR blob = NULL;
+   PWCHAR first = NULL;
+   PWCHAR second = NULL;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   blob = _BlobBuildDefault(&blobSize);
+   err = LibTranslateSetDescriptionSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_SUCCESS, "valid blob rejected: %u", err);
+   free(blob);
+
+   first = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, TRUE, 0xC0000001);
+   TEST_CHECK(wcscmp(first, _ntstatusDescriptions[1].Text) == 0, "unexpected description \"%ls\"", first);
+   second = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, TRUE, 0xC0000001);
+   TEST_CHECK(first == second, "description of 0x%x looked up twice", 0xC0000001);
+
+   // Empty descriptions are remembered as missing ones.
+   first = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, TRUE, 0xC000000D);
+   TEST_CHECK(wcscmp(first, L"N / A") == 0, "unexpected description \"%ls\"", first);
+   second = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, TRUE, 0xC000000D);
+   TEST_CHECK(first == second, "description of 0x%x looked up twice", 0xC000000D);
+   first = LibTranslateGeneralIntegerValueToString(ltivtWindowsError, TRUE, 87);
+   TEST_CHECK(*first == L'\0', "unexpected description \"%ls\"", first);
+   second = LibTranslateGeneralIntegerValueToString(ltivtWindowsError, TRUE, 87);
+   TEST_CHECK(first == second, "description of %u looked up twice", 87);
+
+   // Changing the source forgets the remembered descriptions.
+   blob = _BlobBuild(_ntstatusDescriptions + 3, 1, NULL, 0, &blobSize);
+   err = LibTranslateSetDescriptionSource(ltdsBlob, blob, blobSize);
+   TEST_CHECK(err == ERROR_SUCCESS, "valid blob rejected: %u", err);
+   free(blob);
+   first = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, TRUE, 0xC0000001);
+   TEST_CHECK(wcscmp(first, L"N / A") == 0, "unexpected description \"%ls\"", first);
+   first = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, TRUE, 0xC0000022);
+   TEST_CHECK(wcscmp(first, _ntstatusDescriptions[3].Text) == 0, "unexpected description \"%ls\"", first);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = LibTranslateInitialize();
+   if (err != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot initialize the translation library: %u\n", err);
+      return 1;
+   }
+
+   _TestValidBlob();
+   _TestMalformedBlob("bad signature", _CorruptSignature);
+   _TestMalformedBlob("bad version", _CorruptVersion);
+   _TestMalformedBlob("too small", _CorruptTooSmall);
+   _TestMalformedBlob("odd size", _CorruptOddSize);
+   _TestMalformedBlob("not terminated", _CorruptUnterminated);
+   _TestMalformedBlob("records truncated", _CorruptTruncated);
+   _TestMalformedBlob("count overflow", _CorruptCountOverflow);
+   _TestMalformedBlob("unsorted", _CorruptUnsorted);
+   _TestMalformedBlob("duplicate", _CorruptDuplicate);
+   _TestMalformedBlob("offset outside", _CorruptOffsetOutside);
+   _TestMalformedBlob("offset into records", _CorruptOffsetRecords);
+   _TestMalformedBlob("offset misaligned", _CorruptOffsetMisaligned);
+   _TestCachedDescriptions();
+   LibTranslateFinalize();
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("descriptions OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
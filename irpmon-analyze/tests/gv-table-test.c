@@ -0,0 +1,182 @@
+/**
+ * @file
+ *
+ * Tests the General Value Tables of the translation library
+ * (libtranslate/gv-table.c) and their shared string pool. Lookups must return
+ * the strings of the original arrays, every distinct string must be stored
+ * in the pool only once, and the single and batch lookups must agree. The
+ * tables of translates-arrays.h are used as the large test case; the sizes
+ * of their string pool are printed.
+ */
+
+#include <windows.h>
+#include "libtranslate.h"
+#include "gv-table.h"
+// Only the General Value arrays of the file are used.
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include "translates-arrays.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+static GENERAL_VALUE _smallArray[] = {
+   {L"SECOND", 2, L"Shared description"},
+   {L"FIRST", 1, L"Shared description"},
+   {L"THIRD", 3, L""},
+   {L"SECOND_AGAIN", 2, L""},
+   {L"FIRST", 10, L"FIRST"},
+};
+
+static GENERAL_VALUE _emptyArray[1];
+
+
+/************************************************************************/
+/*                     TESTS                                            */
+/************************************************************************/
+
+
+static VOID _TestSmallTables(VOID)
+{
+   ULONG i = 0;
+   ULONG values[8];
+   PGENERAL_VALUE_RECORD records[8];
+   PGENERAL_VALUE_RECORD r = NULL;
+   GENERAL_VALUE_TABLE small = GENERAL_VALUE_TABLE_INIT(_smallArray);
+   GENERAL_VALUE_TABLE empty = {_emptyArray, 0, NULL, NULL, NULL};
+   PGENERAL_VALUE_TABLE tables[] = {&small, &empty};
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = GVTablesPrepare(tables, sizeof(tables) / sizeof(tables[0]));
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot prepare the tables: %u", err);
+   if (err != ERROR_SUCCESS)
+      return;
+
+   TEST_CHECK(small.Strings != NULL && small.Strings == empty.Strings, "%s", "the tables do not share the pool");
+   for (i = 1; i < small.Count; ++i)
+      TEST_CHECK(small.Keys[i - 1] <= small.Keys[i], "values %u and %u not sorted", i - 1, i);
+
+   r = GVTableGet(&small, 1);
+   TEST_CHECK(r != NULL && wcscmp(GVTableName(&small, r), L"FIRST") == 0 && wcscmp(GVTableDescription(&small, r), L"Shared description") == 0, "%s", "wrong record of 1");
+   // The last structure of equal values wins.
+   r = GVTableGet(&small, 2);
+   TEST_CHECK(r != NULL && wcscmp(GVTableName(&small, r), L"SECOND_AGAIN") == 0, "wrong record of 2: %ls", (r != NULL) ? GVTableName(&small, r) : L"(null)");
+   r = GVTableGet(&small, 3);
+   TEST_CHECK(r != NULL && *GVTableDescription(&small, r) == L'\0', "%s", "wrong record of 3");
+   TEST_CHECK(r != NULL && small.Items[GVTableIndex(&small, r)].Value == 3, "%s", "wrong index of 3");
+   TEST_CHECK(GVTableGet(&small, 0) == NULL && GVTableGet(&small, 4) == NULL && GVTableGet(&small, 11) == NULL, "%s", "lookup of a missing value succeeded");
+   TEST_CHECK(GVTableGet(&empty, 0) == NULL, "%s", "lookup in an empty table succeeded");
+
+   // Equal strings share their offsets, whether they are names or descriptions.
+   TEST_CHECK(GVTableGet(&small, 1)->NameOffset == GVTableGet(&small, 10)->NameOffset, "%s", "FIRST stored twice");
+   TEST_CHECK(GVTableGet(&small, 10)->DescriptionOffset == GVTableGet(&small, 10)->NameOffset, "%s", "FIRST stored twice");
+   TEST_CHECK(GVTableGet(&small, 1)->DescriptionOffset == small.Records[GVTableIndex(&small, GVTableGet(&small, 1)) + 1].DescriptionOffset, "%s", "the shared description stored twice");
+   TEST_CHECK(GVTableGet(&small, 3)->DescriptionOffset == GVTableGet(&small, 2)->DescriptionOffset, "%s", "the empty description stored twice");
+
+   for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+      values[i] = (i * 3) % 12;
+
+   GVTableGetBatch(&small, values, sizeof(values) / sizeof(values[0]), records);
+   for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+      TEST_CHECK(records[i] == GVTableGet(&small, values[i]), "batch lookup of %u differs", values[i]);
+
+   GVTableGetBatch(&empty, values, sizeof(values) / sizeof(values[0]), records);
+   for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+      TEST_CHECK(records[i] == NULL, "batch lookup of %u in an empty table succeeded", values[i]);
+
+   GVTablesFinit(tables, sizeof(tables) / sizeof(tables[0]));
+   TEST_CHECK(small.Keys == NULL && small.Records == NULL && small.Strings == NULL, "%s", "the table was not finalized");
+
+   return;
+}
+
+
+static VOID _TestLibraryTables(VOID)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG itemCount = 0;
+   SIZE_T stringLength = 0;
+   SIZE_T poolLength = 0;
+   ULONG32 offset = 0;
+   PGENERAL_VALUE item = NULL;
+   PGENERAL_VALUE_RECORD record = NULL;
+   PGENERAL_VALUE_TABLE table = NULL;
+   GENERAL_VALUE_TABLE tables[] = {
+      GENERAL_VALUE_TABLE_INIT(_winEventHooks),
+      GENERAL_VALUE_TABLE_INIT(_windowsError),
+      GENERAL_VALUE_TABLE_INIT(_ntstatus),
+      GENERAL_VALUE_TABLE_INIT(_windowsMessages),
+      GENERAL_VALUE_TABLE_INIT(_sctpPort),
+      GENERAL_VALUE_TABLE_INIT(_dccpPort),
+      GENERAL_VALUE_TABLE_INIT(_tcpPort),
+      GENERAL_VALUE_TABLE_INIT(_udpPort),
+      GENERAL_VALUE_TABLE_INIT(_irpMajorFunction),
+      GENERAL_VALUE_TABLE_INIT(_volumeDeviceType),
+      GENERAL_VALUE_TABLE_INIT(_WindowsHook),
+      GENERAL_VALUE_TABLE_INIT(_ioControlCodes),
+      GENERAL_VALUE_TABLE_INIT(_deviceType),
+   };
+   PGENERAL_VALUE_TABLE tablePointers[sizeof(tables) / sizeof(tables[0])];
+   DWORD err = ERROR_GEN_FAILURE;
+
+   for (i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i)
+      tablePointers[i] = tables + i;
+
+   err = GVTablesPrepare(tablePointers, sizeof(tables) / sizeof(tables[0]));
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot prepare the tables: %u", err);
+   if (err != ERROR_SUCCESS)
+      return;
+
+   for (i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+      table = tables + i;
+      for (j = 0; j < table->Count; ++j) {
+         item = table->Items + j;
+         record = table->Records + j;
+         TEST_CHECK(wcscmp(GVTableName(table, record), item->Name) == 0, "table %u, item %u: name \"%ls\", expected \"%ls\"", i, j, GVTableName(table, record), item->Name);
+         TEST_CHECK(wcscmp(GVTableDescription(table, record), item->Description) == 0, "table %u, item %u: wrong description", i, j);
+         TEST_CHECK(GVTableGet(table, item->Value) != NULL, "table %u: value 0x%x not found", i, item->Value);
+         stringLength += wcslen(item->Name) + wcslen(item->Description) + 2;
+         offset = (record->NameOffset > record->DescriptionOffset) ? record->NameOffset : record->DescriptionOffset;
+         if (offset + wcslen(table->Strings + offset) + 1 > poolLength)
+            poolLength = offset + wcslen(table->Strings + offset) + 1;
+      }
+
+      itemCount += table->Count;
+   }
+
+   // Every distinct string appears in the pool only once.
+   for (offset = 0; offset < poolLength; offset += (ULONG32)wcslen(tables[0].Strings + offset) + 1) {
+      for (j = offset + (ULONG32)wcslen(tables[0].Strings + offset) + 1; j < poolLength; j += (ULONG)wcslen(tables[0].Strings + j) + 1) {
+         if (wcscmp(tables[0].Strings + offset, tables[0].Strings + j) == 0) {
+            TEST_CHECK(FALSE, "\"%ls\" stored at %u and %u", tables[0].Strings + offset, offset, j);
+            break;
+         }
+      }
+   }
+
+   printf("%u items, %u strings of %zu characters pooled into %zu characters\n", itemCount, 2 * itemCount, stringLength, poolLength);
+   printf("items %zu bytes, keys and records %zu bytes\n", itemCount * sizeof(GENERAL_VALUE), itemCount * (sizeof(ULONG32) + sizeof(GENERAL_VALUE_RECORD)));
+   GVTablesFinit(tablePointers, sizeof(tables) / sizeof(tables[0]));
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   _TestSmallTables();
+   _TestLibraryTables();
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("gv-table OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+/**
+ * @file
+ *
+ * Tests the general hash table of the driver (irpmndrv/hash_table.c) in user
+ * mode, mainly while the table is being rehashed incrementally. Every time
+ * a rehash starts and when about half of the old buckets were moved, the test
+ * verifies that every item can be found, that iterators visit every item
+ * exactly once, and that items can be deleted and inserted again.
+ */
+
+#include "ntifs.h"
+#include "allocator.h"
+#include "hash_table.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+typedef struct _TEST_ITEM {
+   HASH_ITEM HashItem;
+   ULONG_PTR Key;
+} TEST_ITEM, *PTEST_ITEM;
+
+typedef enum _ETestRehashPhase {
+   etrpNone,
+   etrpStarted,
+   etrpHalfway,
+} ETestRehashPhase;
+
+typedef struct _TEST_STATE {
+   PHASH_TABLE Table;
+   ULONG KeyCount;
+   PTEST_ITEM Items;
+   PBOOLEAN Present;
+   PUCHAR Visits;
+   ULONG NumberOfPresent;
+   ETestRehashPhase Phase;
+   PHASH_ITEM *OldBuckets;
+   ULONG RehashChecks;
+} TEST_STATE, *PTEST_STATE;
+
+typedef struct _TEST_THREAD_CONTEXT {
+   PHASH_TABLE Table;
+   ULONG Index;
+   ULONG ThreadCount;
+   ULONG KeyCount;
+   PTEST_ITEM Items;
+   BOOLEAN Failed;
+} TEST_THREAD_CONTEXT, *PTEST_THREAD_CONTEXT;
+
+static volatile LONG _freeCount = 0;
+
+
+/************************************************************************/
+/*                     TABLE CALLBACKS                                  */
+/************************************************************************/
+
+
+static BOOLEAN _TestCompare(PHASH_ITEM ObjectInTable, PVOID Key)
+{
+   return (CONTAINING_RECORD(ObjectInTable, TEST_ITEM, HashItem)->Key == (ULONG_PTR)Key);
+}
+
+
+static VOID _TestCount(PHASH_ITEM Object, PVOID Context)
+{
+   ++*(PULONG)Context;
+
+   return;
+}
+
+
+static VOID _TestFree(PHASH_ITEM Object)
+{
+   InterlockedIncrement(&_freeCount);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static const char *_TypeName(EHashTableType Type)
+{
+   const char *ret = "unknown";
+
+   switch (Type) {
+      case httPassiveLevel: ret = "passive"; break;
+      case httDispatchLevel: ret = "dispatch"; break;
+      case httNoSynchronization: ret = "no-synchronization"; break;
+      case httDispatchLevelShared: ret = "dispatch-shared"; break;
+   }
+
+   return ret;
+}
+
+
+static ULONG _MigratedOldBuckets(PHASH_TABLE Table)
+{
+   ULONG i = 0;
+   ULONG ret = 0;
+
+   for (i = 0; i < Table->LockCount; ++i) {
+      if (Table->MigrateCursors[i] > i)
+         ret += (min(Table->MigrateCursors[i], Table->OldSize + i) - i) / Table->LockCount;
+   }
+
+   return ret;
+}
+
+
+static VOID _Insert(PTEST_STATE State, ULONG Key)
+{
+   HashTableInsert(State->Table, &State->Items[Key].HashItem, (PVOID)(ULONG_PTR)Key);
+   State->Present[Key] = TRUE;
+   ++State->NumberOfPresent;
+
+   return;
+}
+
+
+static VOID _Delete(PTEST_STATE State, ULONG Key)
+{
+   PHASH_ITEM item = NULL;
+
+   item = HashTableDelete(State->Table, (PVOID)(ULONG_PTR)Key);
+   TEST_CHECK(item == &State->Items[Key].HashItem, "delete of %u returned %p", Key, item);
+   State->Present[Key] = FALSE;
+   --State->NumberOfPresent;
+
+   return;
+}
+
+
+/** Verifies the whole table content against the expected one. */
+static VOID _CheckTable(PTEST_STATE State, const char *Where)
+{
+   ULONG i = 0;
+   ULONG visited = 0;
+   PHASH_ITEM item = NULL;
+   PTEST_ITEM testItem = NULL;
+   HASH_TABLE_ITERATOR it;
+   HASH_TABLE_STATISTICS stats;
+
+   for (i = 0; i < State->KeyCount; ++i) {
+      item = HashTableGet(State->Table, (PVOID)(ULONG_PTR)i);
+      if (State->Present[i]) {
+         TEST_CHECK(item == &State->Items[i].HashItem, "%s: key %u not found (got %p)", Where, i, item);
+      } else {
+         TEST_CHECK(item == NULL, "%s: deleted key %u found", Where, i);
+      }
+   }
+
+   memset(State->Visits, 0, State->KeyCount);
+   if (HashTableGetFirst(State->Table, &it)) {
+      do {
+         testItem = CONTAINING_RECORD(HashTableIteratorGetData(&it), TEST_ITEM, HashItem);
+         TEST_CHECK(testItem->Key < State->KeyCount && State->Present[testItem->Key], "%s: iterator returned an unknown item %p", Where, testItem);
+         if (testItem->Key < State->KeyCount)
+            ++State->Visits[testItem->Key];
+
+         ++visited;
+      } while (HashTableGetNext(&it));
+
+      HashTableIteratorFinit(&it);
+   }
+
+   TEST_CHECK(visited == State->NumberOfPresent, "%s: iterator visited %u items, %u expected", Where, visited, State->NumberOfPresent);
+   for (i = 0; i < State->KeyCount; ++i) {
+      TEST_CHECK(State->Visits[i] == (State->Present[i] ? 1 : 0), "%s: key %u visited %u times", Where, i, State->Visits[i]);
+   }
+
+   HashTableGetStatistics(State->Table, &stats);
+   TEST_CHECK(stats.NumberOfItems == State->NumberOfPresent, "%s: statistics report %u items, %u expected", Where, stats.NumberOfItems, State->NumberOfPresent);
+   TEST_CHECK(HashTableGetItemCount(State->Table) == State->NumberOfPresent, "%s: table counts %u items, %u expected", Where, HashTableGetItemCount(State->Table), State->NumberOfPresent);
+   TEST_CHECK(stats.NumberOfOldBuckets == State->Table->OldSize, "%s: statistics report %u old buckets, %u expected", Where, stats.NumberOfOldBuckets, State->Table->OldSize);
+   TEST_CHECK(stats.NumberOfLocks == State->Table->LockCount, "%s: statistics report %u locks, %u expected", Where, stats.NumberOfLocks, State->Table->LockCount);
+
+   return;
+}
+
+
+/** Deletes some of the items and inserts them again while the table is being rehashed.
+    Every operation moves a few old buckets, the lookups must keep working. */
+static VOID _CheckDeleteAndReinsert(PTEST_STATE State, const char *Where)
+{
+   ULONG i = 0;
+   ULONG calls = 0;
+   PHASH_ITEM item = NULL;
+
+   for (i = State->RehashChecks % 97; i < State->KeyCount; i += 97) {
+      if (State->Present[i]) {
+         _Delete(State, i);
+         item = HashTableGet(State->Table, (PVOID)(ULONG_PTR)i);
+         TEST_CHECK(item == NULL, "%s: key %u found after delete", Where, i);
+         calls = 0;
+         item = HashTableGetEx(State->Table, (PVOID)(ULONG_PTR)i, _TestCount, &calls);
+         TEST_CHECK(item == NULL && calls == 0, "%s: callback invoked for deleted key %u", Where, i);
+         item = HashTableDelete(State->Table, (PVOID)(ULONG_PTR)i);
+         TEST_CHECK(item == NULL, "%s: key %u deleted twice", Where, i);
+         _Insert(State, i);
+         item = HashTableGet(State->Table, (PVOID)(ULONG_PTR)i);
+         TEST_CHECK(item == &State->Items[i].HashItem, "%s: key %u not found after reinsert", Where, i);
+         item = HashTableGetEx(State->Table, (PVOID)(ULONG_PTR)i, _TestCount, &calls);
+         TEST_CHECK(item == &State->Items[i].HashItem && calls == 1, "%s: callback invoked %u times for key %u", Where, calls, i);
+      }
+   }
+
+   _CheckTable(State, Where);
+
+   return;
+}
+
+
+/** Called after every operation, runs the full checks at the start of a rehash
+    and when about half of the old buckets were moved. */
+static VOID _CheckRehash(PTEST_STATE State, const char *Operation)
+{
+   char where[128];
+   PHASH_TABLE table = State->Table;
+
+   if (table->OldBuckets == NULL) {
+      State->Phase = etrpNone;
+      State->OldBuckets = NULL;
+      return;
+   }
+
+   if (table->OldBuckets != State->OldBuckets) {
+      State->OldBuckets = table->OldBuckets;
+      State->Phase = etrpStarted;
+      snprintf(where, sizeof(where), "%s, rehash %u -> %u started", Operation, table->OldSize, table->Size);
+      ++State->RehashChecks;
+      _CheckTable(State, where);
+   }
+
+   if (State->Phase == etrpStarted && table->OldBuckets != NULL && _MigratedOldBuckets(table) * 2 >= table->OldSize) {
+      State->Phase = etrpHalfway;
+      snprintf(where, sizeof(where), "%s, rehash %u -> %u halfway", Operation, table->OldSize, table->Size);
+      ++State->RehashChecks;
+      _CheckDeleteAndReinsert(State, where);
+   }
+
+   return;
+}
+
+
+static VOID _TestSingleThread(EHashTableType Type, ULONG32 LockCount, ULONG KeyCount)
+{
+   ULONG i = 0;
+   ULONG maxSize = 0;
+   ULONG failures = _failures;
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+   TEST_STATE state;
+
+   memset(&state, 0, sizeof(state));
+   state.KeyCount = KeyCount;
+   state.Items = (PTEST_ITEM)calloc(KeyCount, sizeof(TEST_ITEM));
+   state.Present = (PBOOLEAN)calloc(KeyCount, sizeof(BOOLEAN));
+   state.Visits = (PUCHAR)calloc(KeyCount, sizeof(UCHAR));
+   if (state.Items == NULL || state.Present == NULL || state.Visits == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+
+   for (i = 0; i < KeyCount; ++i)
+      state.Items[i].Key = i;
+
+   _freeCount = 0;
+   status = HashTableCreateEx(Type, 16, LockCount, HashTablePointerHash, _TestCompare, _TestFree, &state.Table);
+   TEST_CHECK(NT_SUCCESS(status), "HashTableCreateEx: 0x%x", status);
+   if (!NT_SUCCESS(status))
+      return;
+
+   for (i = 0; i < KeyCount; ++i) {
+      _Insert(&state, i);
+      _CheckRehash(&state, "insert");
+      if (state.Table->Size > maxSize)
+         maxSize = state.Table->Size;
+   }
+
+   _CheckTable(&state, "after inserts");
+   TEST_CHECK(maxSize >= KeyCount / HASH_TABLE_GROW_LOAD_FACTOR, "table did not grow (%u buckets for %u items)", maxSize, KeyCount);
+
+   // Delete from both ends towards the middle, so the table shrinks.
+   for (i = 0; i < KeyCount - KeyCount / 64; ++i) {
+      _Delete(&state, (i % 2 == 0) ? i / 2 : KeyCount - 1 - i / 2);
+      _CheckRehash(&state, "delete");
+   }
+
+   _CheckTable(&state, "after deletes");
+   TEST_CHECK(state.Table->Size < maxSize, "table did not shrink (%u buckets)", state.Table->Size);
+
+   HashTableDestroy(state.Table);
+   TEST_CHECK((ULONG)_freeCount == state.NumberOfPresent, "destroy freed %u items, %u expected", _freeCount, state.NumberOfPresent);
+
+   printf("%-20s locks=%-3u keys=%-8u rehash checks=%-3u %s\n", _TypeName(Type), LockCount, KeyCount, state.RehashChecks, (failures == _failures) ? "OK" : "FAILED");
+   free(state.Visits);
+   free(state.Present);
+   free(state.Items);
+
+   return;
+}
+
+
+/** Every thread inserts, looks up and deletes its own keys, so the results of
+    its lookups do not depend on the other threads. The tables are rehashed
+    many times while the threads run. */
+static void *_TestThreadRoutine(void *Context)
+{
+   ULONG i = 0;
+   ULONG round = 0;
+   PHASH_ITEM item = NULL;
+   PTEST_THREAD_CONTEXT ctx = (PTEST_THREAD_CONTEXT)Context;
+
+   for (round = 0; round < 4; ++round) {
+      for (i = ctx->Index; i < ctx->KeyCount; i += ctx->ThreadCount) {
+         HashTableInsert(ctx->Table, &ctx->Items[i].HashItem, (PVOID)(ULONG_PTR)i);
+         item = HashTableGet(ctx->Table, (PVOID)(ULONG_PTR)i);
+         ctx->Failed |= (item != &ctx->Items[i].HashItem);
+      }
+
+      for (i = ctx->Index; i < ctx->KeyCount; i += ctx->ThreadCount) {
+         item = HashTableGet(ctx->Table, (PVOID)(ULONG_PTR)i);
+         ctx->Failed |= (item != &ctx->Items[i].HashItem);
+      }
+
+      for (i = ctx->Index; i < ctx->KeyCount; i += ctx->ThreadCount) {
+         item = HashTableDelete(ctx->Table, (PVOID)(ULONG_PTR)i);
+         ctx->Failed |= (item != &ctx->Items[i].HashItem);
+         item = HashTableGet(ctx->Table, (PVOID)(ULONG_PTR)i);
+         ctx->Failed |= (item != NULL);
+      }
+   }
+
+   return NULL;
+}
+
+
+static VOID _TestThreads(EHashTableType Type, ULONG32 LockCount, ULONG ThreadCount, ULONG KeyCount)
+{
+   ULONG i = 0;
+   PTEST_ITEM items = NULL;
+   PHASH_TABLE table = NULL;
+   ULONG failures = _failures;
+   NTSTATUS status = STATUS_UNSUCCESSFUL;
+   pthread_t threads[16];
+   TEST_THREAD_CONTEXT contexts[16];
+
+   items = (PTEST_ITEM)calloc(KeyCount, sizeof(TEST_ITEM));
+   if (items == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+
+   for (i = 0; i < KeyCount; ++i)
+      items[i].Key = i;
+
+   status = HashTableCreateEx(Type, 16, LockCount, HashTablePointerHash, _TestCompare, _TestFree, &table);
+   TEST_CHECK(NT_SUCCESS(status), "HashTableCreateEx: 0x%x", status);
+   if (!NT_SUCCESS(status))
+      return;
+
+   for (i = 0; i < ThreadCount; ++i) {
+      contexts[i].Table = table;
+      contexts[i].Index = i;
+      contexts[i].ThreadCount = ThreadCount;
+      contexts[i].KeyCount = KeyCount;
+      contexts[i].Items = items;
+      contexts[i].Failed = FALSE;
+      pthread_create(&threads[i], NULL, _TestThreadRoutine, &contexts[i]);
+   }
+
+   for (i = 0; i < ThreadCount; ++i) {
+      pthread_join(threads[i], NULL);
+      TEST_CHECK(!contexts[i].Failed, "thread %u saw a wrong lookup result", i);
+   }
+
+   TEST_CHECK(HashTableGetItemCount(table) == 0, "%u items left in the table", HashTableGetItemCount(table));
+   HashTableDestroy(table);
+   printf("%-20s locks=%-3u keys=%-8u threads=%u %s\n", _TypeName(Type), LockCount, KeyCount, ThreadCount, (failures == _failures) ? "OK" : "FAILED");
+   free(items);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   ULONG i = 0;
+   ULONG keyCount = 0;
+   static const ULONG keyCounts[] = {1000, 10000, 100000};
+
+   for (i = 0; i < sizeof(keyCounts) / sizeof(keyCounts[0]); ++i) {
+      keyCount = keyCounts[i];
+      _TestSingleThread(httNoSynchronization, 1, keyCount);
+      _TestSingleThread(httPassiveLevel, 4, keyCount);
+      _TestSingleThread(httDispatchLevel, 16, keyCount);
+      _TestSingleThread(httDispatchLevelShared, 4, keyCount);
+   }
+
+   _TestThreads(httPassiveLevel, 16, 4, 50000);
+   _TestThreads(httDispatchLevel, 16, 4, 50000);
+   _TestThreads(httDispatchLevelShared, 16, 4, 50000);
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+
+   return (_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+/**
+ * @file
+ *
+ * User mode implementation of the kernel routines declared in ntifs.h.
+ */
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "ntifs.h"
+#include "allocator.h"
+
+
+/************************************************************************/
+/*                     GLOBAL VARIABLES                                 */
+/************************************************************************/
+
+
+static __thread KIRQL _currentIrql = PASSIVE_LEVEL;
+
+#define EX_SPIN_LOCK_EXCLUSIVE         ((LONG)0x80000000)
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static void _Spin(void)
+{
+   sched_yield();
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     PUBLIC FUNCTIONS                                 */
+/************************************************************************/
+
+
+VOID KernelAssertionFailed(const char *Expression, const char *File, int Line)
+{
+   fprintf(stderr, "%s:%d: assertion failed: %s\n", File, Line, Expression);
+   abort();
+}
+
+
+ULONG DbgPrintEx(ULONG ComponentId, ULONG Level, PCSTR Format, ...)
+{
+   va_list args;
+
+   if (Level <= DPFLTR_WARNING_LEVEL) {
+      va_start(args, Format);
+      vfprintf(stderr, Format, args);
+      va_end(args);
+   }
+
+   return 0;
+}
+
+
+ULONG DbgPrint(PCSTR Format, ...)
+{
+   va_list args;
+
+   va_start(args, Format);
+   vfprintf(stderr, Format, args);
+   va_end(args);
+
+   return 0;
+}
+
+
+VOID KeBugCheck(ULONG BugCheckCode)
+{
+   fprintf(stderr, "bugcheck 0x%x\n", BugCheckCode);
+   abort();
+}
+
+
+KIRQL KeGetCurrentIrql(VOID)
+{
+   return _currentIrql;
+}
+
+
+VOID KeRaiseIrql(KIRQL NewIrql, PKIRQL OldIrql)
+{
+   ASSERT(NewIrql >= _currentIrql);
+   *OldIrql = _currentIrql;
+   _currentIrql = NewIrql;
+
+   return;
+}
+
+
+VOID KeLowerIrql(KIRQL NewIrql)
+{
+   ASSERT(NewIrql <= _currentIrql);
+   _currentIrql = NewIrql;
+
+   return;
+}
+
+
+HANDLE PsGetCurrentProcessId(VOID)
+{
+   return (HANDLE)(ULONG_PTR)getpid();
+}
+
+
+HANDLE PsGetCurrentThreadId(VOID)
+{
+   return (HANDLE)(ULONG_PTR)syscall(SYS_gettid);
+}
+
+
+VOID KeInitializeSpinLock(PKSPIN_LOCK SpinLock)
+{
+   *SpinLock = 0;
+
+   return;
+}
+
+
+VOID KeAcquireSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock)
+{
+   ASSERT(_currentIrql >= DISPATCH_LEVEL);
+   while (__atomic_exchange_n(SpinLock, 1, __ATOMIC_ACQUIRE) != 0) {
+      while (__atomic_load_n(SpinLock, __ATOMIC_RELAXED) != 0)
+         _Spin();
+   }
+
+   return;
+}
+
+
+VOID KeReleaseSpinLockFromDpcLevel(PKSPIN_LOCK SpinLock)
+{
+   ASSERT(*SpinLock != 0);
+   __atomic_store_n(SpinLock, 0, __ATOMIC_RELEASE);
+
+   return;
+}
+
+
+VOID KeAcquireSpinLock(PKSPIN_LOCK SpinLock, PKIRQL OldIrql)
+{
+   KeRaiseIrql(DISPATCH_LEVEL, OldIrql);
+   KeAcquireSpinLockAtDpcLevel(SpinLock);
+
+   return;
+}
+
+
+VOID KeReleaseSpinLock(PKSPIN_LOCK SpinLock, KIRQL NewIrql)
+{
+   KeReleaseSpinLockFromDpcLevel(SpinLock);
+   KeLowerIrql(NewIrql);
+
+   return;
+}
+
+
+VOID ExAcquireSpinLockSharedAtDpcLevel(PEX_SPIN_LOCK SpinLock)
+{
+   LONG value = 0;
+
+   ASSERT(_currentIrql >= DISPATCH_LEVEL);
+   for (;;) {
+      value = __atomic_load_n(SpinLock, __ATOMIC_RELAXED);
+      if ((value & EX_SPIN_LOCK_EXCLUSIVE) == 0 &&
+          __atomic_compare_exchange_n(SpinLock, &value, value + 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+         break;
+
+      _Spin();
+   }
+
+   return;
+}
+
+
+VOID ExReleaseSpinLockSharedFromDpcLevel(PEX_SPIN_LOCK SpinLock)
+{
+   ASSERT((*SpinLock & ~EX_SPIN_LOCK_EXCLUSIVE) != 0);
+   __atomic_sub_fetch(SpinLock, 1, __ATOMIC_RELEASE);
+
+   return;
+}
+
+
+VOID ExAcquireSpinLockExclusiveAtDpcLevel(PEX_SPIN_LOCK SpinLock)
+{
+   LONG value = 0;
+
+   ASSERT(_currentIrql >= DISPATCH_LEVEL);
+   // Like the real lock, block new readers first, then wait for the current ones.
+   for (;;) {
+      value = __atomic_load_n(SpinLock, __ATOMIC_RELAXED);
+      if ((value & EX_SPIN_LOCK_EXCLUSIVE) == 0 &&
+          __atomic_compare_exchange_n(SpinLock, &value, value | EX_SPIN_LOCK_EXCLUSIVE, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+         break;
+
+      _Spin();
+   }
+
+   while (__atomic_load_n(SpinLock, __ATOMIC_ACQUIRE) != EX_SPIN_LOCK_EXCLUSIVE)
+      _Spin();
+
+   return;
+}
+
+
+VOID ExReleaseSpinLockExclusiveFromDpcLevel(PEX_SPIN_LOCK SpinLock)
+{
+   ASSERT(*SpinLock == EX_SPIN_LOCK_EXCLUSIVE);
+   __atomic_store_n(SpinLock, 0, __ATOMIC_RELEASE);
+
+   return;
+}
+
+
+KIRQL ExAcquireSpinLockShared(PEX_SPIN_LOCK SpinLock)
+{
+   KIRQL ret = PASSIVE_LEVEL;
+
+   KeRaiseIrql(DISPATCH_LEVEL, &ret);
+   ExAcquireSpinLockSharedAtDpcLevel(SpinLock);
+
+   return ret;
+}
+
+
+VOID ExReleaseSpinLockShared(PEX_SPIN_LOCK SpinLock, KIRQL OldIrql)
+{
+   ExReleaseSpinLockSharedFromDpcLevel(SpinLock);
+   KeLowerIrql(OldIrql);
+
+   return;
+}
+
+
+KIRQL ExAcquireSpinLockExclusive(PEX_SPIN_LOCK SpinLock)
+{
+   KIRQL ret = PASSIVE_LEVEL;
+
+   KeRaiseIrql(DISPATCH_LEVEL, &ret);
+   ExAcquireSpinLockExclusiveAtDpcLevel(SpinLock);
+
+   return ret;
+}
+
+
+VOID ExReleaseSpinLockExclusive(PEX_SPIN_LOCK SpinLock, KIRQL OldIrql)
+{
+   ExReleaseSpinLockExclusiveFromDpcLevel(SpinLock);
+   KeLowerIrql(OldIrql);
+
+   return;
+}
+
+
+VOID KeEnterCriticalRegion(VOID)
+{
+   return;
+}
+
+
+VOID KeLeaveCriticalRegion(VOID)
+{
+   return;
+}
+
+
+NTSTATUS ExInitializeResourceLite(PERESOURCE Resource)
+{
+   return (pthread_rwlock_init(&Resource->Lock, NULL) == 0) ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+}
+
+
+NTSTATUS ExDeleteResourceLite(PERESOURCE Resource)
+{
+   pthread_rwlock_destroy(&Resource->Lock);
+
+   return STATUS_SUCCESS;
+}
+
+
+BOOLEAN ExAcquireResourceSharedLite(PERESOURCE Resource, BOOLEAN Wait)
+{
+   ASSERT(_currentIrql < DISPATCH_LEVEL);
+   if (!Wait)
+      return (pthread_rwlock_tryrdlock(&Resource->Lock) == 0);
+
+   pthread_rwlock_rdlock(&Resource->Lock);
+
+   return TRUE;
+}
+
+
+BOOLEAN ExAcquireResourceExclusiveLite(PERESOURCE Resource, BOOLEAN Wait)
+{
+   ASSERT(_currentIrql < DISPATCH_LEVEL);
+   if (!Wait)
+      return (pthread_rwlock_trywrlock(&Resource->Lock) == 0);
+
+   pthread_rwlock_wrlock(&Resource->Lock);
+
+   return TRUE;
+}
+
+
+VOID ExReleaseResourceLite(PERESOURCE Resource)
+{
+   pthread_rwlock_unlock(&Resource->Lock);
+
+   return;
+}
+
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+   return malloc(NumberOfBytes);
+}
+
+
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag)
+{
+   free(P);
+
+   return;
+}
+
+
+PVOID DebugAllocatorAlloc(POOL_TYPE PoolType, SIZE_T NumberOfBytes, PCHAR Function, ULONG Line)
+{
+   return malloc(NumberOfBytes);
+}
+
+
+VOID DebugAllocatorFree(PVOID Address)
+{
+   free(Address);
+
+   return;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file
+ *
+ * Subset of the kernel API used by the driver modules that are tested in
+ * user mode (the general hash table), implemented on top of POSIX threads.
+ * Only used by the tests and benchmarks of irpmon-analyze.
+ *
+ * The locks are real: spin locks spin (yielding the processor, since user
+ * mode threads may be preempted while holding them), reader-writer spin
+ * locks admit concurrent readers and executive resources are POSIX
+ * reader-writer locks. IRQL is tracked per thread, so the IRQL checks of
+ * the driver code keep working. Pool allocations go to the C heap.
+ */
+
+#ifndef __IRPMON_TESTS_NTIFS_H__
+#define __IRPMON_TESTS_NTIFS_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <pthread.h>
+
+
+typedef void VOID, *PVOID;
+typedef char CHAR, *PCHAR;
+typedef const char *PCSTR;
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN, *PBOOLEAN, KIRQL, *PKIRQL;
+typedef short SHORT;
+typedef unsigned short USHORT, *PUSHORT;
+typedef int LONG, *PLONG, NTSTATUS, INT, BOOL;
+typedef unsigned int ULONG, *PULONG, ULONG32, *PULONG32, DWORD, UINT32, ACCESS_MASK;
+typedef int64_t LONGLONG, LONG64, *PLONG64;
+typedef uint64_t ULONGLONG, ULONG64, *PULONG64;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR, SIZE_T, *PSIZE_T, *PULONG_PTR;
+typedef wchar_t WCHAR, *PWCHAR, *PWSTR, *PWCH;
+typedef void *HANDLE, **PHANDLE;
+
+typedef union _LARGE_INTEGER {
+   struct {
+      ULONG LowPart;
+      LONG HighPart;
+   };
+   LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _LIST_ENTRY {
+   struct _LIST_ENTRY *Flink;
+   struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _UNICODE_STRING {
+   USHORT Length;
+   USHORT MaximumLength;
+   PWCH Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef struct _GUID {
+   ULONG Data1;
+   USHORT Data2;
+   USHORT Data3;
+   UCHAR Data4[8];
+} GUID, *PGUID;
+
+typedef enum _POOL_TYPE {
+   NonPagedPool,
+   PagedPool,
+} POOL_TYPE;
+
+typedef ULONG_PTR KSPIN_LOCK, *PKSPIN_LOCK;
+typedef LONG EX_SPIN_LOCK, *PEX_SPIN_LOCK;
+
+typedef struct _ERESOURCE {
+   pthread_rwlock_t Lock;
+} ERESOURCE, *PERESOURCE;
+
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+typedef struct _DEVICE_OBJECT *PDEVICE_OBJECT;
+
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define NTAPI
+#define FORCEINLINE static inline
+#define DECLSPEC_CACHEALIGN __attribute__((aligned(64)))
+
+#define TRUE                             1
+#define FALSE                            0
+#define MAXULONG                         0xffffffffU
+#define MAXLONG                          0x7fffffff
+
+#define PASSIVE_LEVEL                    0
+#define APC_LEVEL                        1
+#define DISPATCH_LEVEL                   2
+#define HIGH_LEVEL                       31
+
+#define STATUS_SUCCESS                   ((NTSTATUS)0x00000000L)
+#define STATUS_UNSUCCESSFUL              ((NTSTATUS)0xC0000001L)
+#define STATUS_INVALID_PARAMETER         ((NTSTATUS)0xC000000DL)
+#define STATUS_INSUFFICIENT_RESOURCES    ((NTSTATUS)0xC000009AL)
+#define STATUS_INVALID_PARAMETER_1       ((NTSTATUS)0xC00000EFL)
+#define STATUS_INVALID_PARAMETER_2       ((NTSTATUS)0xC00000F0L)
+#define STATUS_INVALID_PARAMETER_3       ((NTSTATUS)0xC00000F1L)
+#define STATUS_INVALID_PARAMETER_4       ((NTSTATUS)0xC00000F2L)
+#define STATUS_INVALID_PARAMETER_5       ((NTSTATUS)0xC00000F3L)
+#define NT_SUCCESS(Status)               ((NTSTATUS)(Status) >= 0)
+
+#define DPFLTR_DEFAULT_ID                0
+#define DPFLTR_ERROR_LEVEL               0
+#define DPFLTR_WARNING_LEVEL             1
+#define DPFLTR_TRACE_LEVEL               2
+#define DPFLTR_INFO_LEVEL                3
+
+#define CONTAINING_RECORD(Address, Type, Field) ((Type *)((PUCHAR)(Address) - offsetof(Type, Field)))
+#define FIELD_OFFSET(Type, Field)        ((LONG)offsetof(Type, Field))
+#define UNREFERENCED_PARAMETER(P)        ((void)(P))
+#define ASSERT(Expression)               ((Expression) ? (void)0 : KernelAssertionFailed(#Expression, __FILE__, __LINE__))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+
+#ifndef min
+#define min(a, b)                        (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)                        (((a) > (b)) ? (a) : (b))
+#endif
+
+// The driver concatenates __FUNCTION__ with string literals (see preprocessor.h),
+// which only MSVC allows. The file name stands in for it.
+#define __FUNCTION__                     __FILE__
+
+#define InterlockedIncrement(Addend)                   __atomic_add_fetch((Addend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(Addend)                   __atomic_sub_fetch((Addend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd(Addend, Value)          __atomic_fetch_add((Addend), (Value), __ATOMIC_SEQ_CST)
+#define InterlockedIncrement64(Addend)                 __atomic_add_fetch((Addend), 1, __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd64(Addend, Value)        __atomic_fetch_add((Addend), (Value), __ATOMIC_SEQ_CST)
+#define InterlockedExchange(Target, Value)             __atomic_exchange_n((Target), (Value), __ATOMIC_SEQ_CST)
+#define InterlockedCompareExchange(Destination, Exchange, Comparand) __sync_val_compare_and_swap((Destination), (Comparand), (Exchange))
+#define InterlockedCompareExchangePointer(Destination, Exchange, Comparand) __sync_val_compare_and_swap((Destination), (Comparand), (Exchange))
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+VOID KernelAssertionFailed(const char *Expression, const char *File, int Line);
+
+ULONG DbgPrintEx(ULONG ComponentId, ULONG Level, PCSTR Format, ...);
+ULONG DbgPrint(PCSTR Format, ...);
+VOID KeBugCheck(ULONG BugCheckCode);
+
+KIRQL KeGetCurrentIrql(VOID);
+VOID KeRaiseIrql(KIRQL NewIrql, PKIRQL OldIrql);
+VOID KeLowerIrql(KIRQL NewIrql);
+HANDLE PsGetCurrentProcessId(VOID);
+HANDLE PsGetCurrentThreadId(VOID);
+
+VOID KeInitializeSpinLock(PKSPIN_LOCK SpinLock);
+VOID KeAcquireSpinLock(PKSPIN_LOCK SpinLock, PKIRQL OldIrql);
+VOID KeReleaseSpinLock(PKSPIN_LOCK SpinLock, KIRQL NewIrql);
+VOID KeAcquireSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock);
+VOID KeReleaseSpinLockFromDpcLevel(PKSPIN_LOCK SpinLock);
+
+KIRQL ExAcquireSpinLockShared(PEX_SPIN_LOCK SpinLock);
+VOID ExReleaseSpinLockShared(PEX_SPIN_LOCK SpinLock, KIRQL OldIrql);
+KIRQL ExAcquireSpinLockExclusive(PEX_SPIN_LOCK SpinLock);
+VOID ExReleaseSpinLockExclusive(PEX_SPIN_LOCK SpinLock, KIRQL OldIrql);
+VOID ExAcquireSpinLockSharedAtDpcLevel(PEX_SPIN_LOCK SpinLock);
+VOID ExReleaseSpinLockSharedFromDpcLevel(PEX_SPIN_LOCK SpinLock);
+VOID ExAcquireSpinLockExclusiveAtDpcLevel(PEX_SPIN_LOCK SpinLock);
+VOID ExReleaseSpinLockExclusiveFromDpcLevel(PEX_SPIN_LOCK SpinLock);
+
+VOID KeEnterCriticalRegion(VOID);
+VOID KeLeaveCriticalRegion(VOID);
+NTSTATUS ExInitializeResourceLite(PERESOURCE Resource);
+NTSTATUS ExDeleteResourceLite(PERESOURCE Resource);
+BOOLEAN ExAcquireResourceSharedLite(PERESOURCE Resource, BOOLEAN Wait);
+BOOLEAN ExAcquireResourceExclusiveLite(PERESOURCE Resource, BOOLEAN Wait);
+VOID ExReleaseResourceLite(PERESOURCE Resource);
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
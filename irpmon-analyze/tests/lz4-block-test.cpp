@@ -0,0 +1,248 @@
+/**
+ * @file
+ *
+ * Tests the LZ4 block codec of the capture files (irpmonconsole/lz4-block.cpp).
+ * Everything the compressor produces must decompress to the original data,
+ * including data that do not compress (the capture then stores the block
+ * with ccNone), matches overlapping their own output and inputs too short
+ * to contain a match. Damaged or truncated streams must be rejected with
+ * ERROR_INVALID_DATA and must never write past the destination.
+ */
+
+#include <string.h>
+#include <vector>
+#include <windows.h>
+#include "lz4-block.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+/** Inputs of at most this length are stored as literals only (LZ4_MATCH_LIMIT
+    of the codec). */
+#define TEST_MATCH_LIMIT         12
+#define TEST_LENGTH              0x10000
+/** Bytes following the destination that must stay untouched. */
+#define TEST_GUARD               64
+#define TEST_GUARD_BYTE          0xa5
+
+typedef struct _TEST_STREAM {
+   const char *Name;
+   UCHAR Data[8];
+   ULONG Length;
+} TEST_STREAM, *PTEST_STREAM;
+
+/** Streams the decompressor must reject, decompressed into 64 bytes. */
+static const TEST_STREAM _malformedStreams[] = {
+   {"match offset zero", {0x10, 'a', 0x00, 0x00}, 4},
+   {"match before the output start", {0x10, 'a', 0x02, 0x00}, 4},
+   {"literals past the input end", {0x50, 'a', 'b'}, 3},
+   {"missing literal length", {0xf0}, 1},
+   {"truncated literal length", {0xf0, 0xff}, 2},
+   {"truncated match offset", {0x10, 'a', 0x01}, 3},
+   {"missing match length", {0x1f, 'a', 0x01, 0x00}, 4},
+   {"match past the output end", {0x1f, 'a', 0x01, 0x00, 0x40}, 5},
+};
+
+#define TEST_COUNT(aArray)       (sizeof(aArray) / sizeof(aArray[0]))
+
+static ULONG64 _seed = 1;
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static UCHAR _Random(VOID)
+{
+   _seed ^= _seed << 13;
+   _seed ^= _seed >> 7;
+   _seed ^= _seed << 17;
+
+   return (UCHAR)(_seed >> 24);
+}
+
+
+/** Compresses the data into a buffer of LZ4BlockCompressBound bytes and
+    checks that they decompress to the same data.
+
+    @return Returns length of the compressed data. */
+static ULONG _RoundTrip(const char *What, const UCHAR *Data, ULONG Length, std::vector<UCHAR> & Compressed)
+{
+   ULONG compressedLength = 0;
+   ULONG decompressedLength = 0;
+   std::vector<UCHAR> decompressed(Length + TEST_GUARD, TEST_GUARD_BYTE);
+   DWORD err = ERROR_GEN_FAILURE;
+
+   Compressed.assign(LZ4BlockCompressBound(Length) + TEST_GUARD, TEST_GUARD_BYTE);
+   err = LZ4BlockCompress(Data, Length, Compressed.data(), LZ4BlockCompressBound(Length), &compressedLength);
+   TEST_CHECK(err == ERROR_SUCCESS, "%s: compression of %u bytes failed: %u", What, Length, err);
+   if (err != ERROR_SUCCESS)
+      return 0;
+
+   TEST_CHECK(compressedLength <= LZ4BlockCompressBound(Length), "%s: %u bytes compressed into %u", What, Length, compressedLength);
+   TEST_CHECK(Compressed[LZ4BlockCompressBound(Length)] == TEST_GUARD_BYTE, "%s: compression wrote past the destination", What);
+   err = LZ4BlockDecompress(Compressed.data(), compressedLength, decompressed.data(), Length, &decompressedLength);
+   TEST_CHECK(err == ERROR_SUCCESS && decompressedLength == Length, "%s: decompression failed: %u, %u bytes, expected %u", What, err, decompressedLength, Length);
+   TEST_CHECK(Length == 0 || memcmp(decompressed.data(), Data, Length) == 0, "%s: decompressed data differ", What);
+   TEST_CHECK(decompressed[Length] == TEST_GUARD_BYTE, "%s: decompression wrote past the destination", What);
+   Compressed.resize(compressedLength);
+
+   return compressedLength;
+}
+
+
+/************************************************************************/
+/*                     TESTS                                            */
+/************************************************************************/
+
+
+/** Random data do not compress. The capture writer compresses a block into
+    a buffer of the block's length and stores it with ccNone if that fails. */
+static VOID _TestIncompressible(VOID)
+{
+   ULONG compressedLength = 0;
+   std::vector<UCHAR> data(TEST_LENGTH);
+   std::vector<UCHAR> compressed(TEST_LENGTH + TEST_GUARD, TEST_GUARD_BYTE);
+   DWORD err = ERROR_GEN_FAILURE;
+
+   for (auto & b : data)
+      b = _Random();
+
+   err = LZ4BlockCompress(data.data(), (ULONG)data.size(), compressed.data(), (ULONG)data.size(), &compressedLength);
+   TEST_CHECK(err == ERROR_INSUFFICIENT_BUFFER, "random data compressed into their own length: %u, %u bytes", err, compressedLength);
+   TEST_CHECK(compressed[data.size()] == TEST_GUARD_BYTE, "compression of random data wrote past the destination%s", "");
+   compressedLength = _RoundTrip("random data", data.data(), (ULONG)data.size(), compressed);
+   TEST_CHECK(compressedLength > data.size(), "random data compressed into %u bytes", compressedLength);
+
+   return;
+}
+
+
+/** Matches whose offset is shorter than their length copy bytes they have
+    just produced. */
+static VOID _TestOverlappingMatches(VOID)
+{
+   ULONG length = 0;
+   UCHAR output[64];
+   std::vector<UCHAR> data(TEST_LENGTH);
+   std::vector<UCHAR> compressed;
+   // 'x', then a match of offset 1 and length 15 + 1 + LZ4_MIN_MATCH.
+   static const UCHAR stream[] = {0x1f, 'x', 0x01, 0x00, 0x01};
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = LZ4BlockDecompress(stream, sizeof(stream), output, sizeof(output), &length);
+   TEST_CHECK(err == ERROR_SUCCESS && length == 21, "overlapping match: %u, %u bytes, expected 21", err, length);
+   for (ULONG i = 0; i < length; ++i)
+      TEST_CHECK(output[i] == 'x', "overlapping match: byte %u is 0x%x", i, output[i]);
+
+   for (ULONG period = 1; period <= 8; ++period) {
+      char what[32];
+
+      for (ULONG i = 0; i < data.size(); ++i)
+         data[i] = (UCHAR)('a' + i % period);
+
+      snprintf(what, sizeof(what), "period %u", period);
+      length = _RoundTrip(what, data.data(), (ULONG)data.size(), compressed);
+      TEST_CHECK(length < data.size() / 64, "%s: %u bytes compressed into %u", what, (ULONG)data.size(), length);
+   }
+
+   // Runs of different lengths separated by random bytes.
+   for (ULONG i = 0; i < data.size(); ) {
+      UCHAR b = _Random();
+      ULONG run = 1 + _Random() % 40;
+
+      while (run > 0 && i < data.size()) {
+         data[i++] = b;
+         --run;
+      }
+   }
+
+   _RoundTrip("runs", data.data(), (ULONG)data.size(), compressed);
+
+   return;
+}
+
+
+static VOID _TestShortInputs(VOID)
+{
+   UCHAR data[TEST_MATCH_LIMIT + 8];
+   std::vector<UCHAR> compressed;
+
+   memset(data, 'a', sizeof(data));
+   for (ULONG length = 0; length <= sizeof(data); ++length) {
+      char what[32];
+      ULONG compressedLength = 0;
+
+      snprintf(what, sizeof(what), "%u bytes", length);
+      compressedLength = _RoundTrip(what, data, length, compressed);
+      if (length <= TEST_MATCH_LIMIT)
+         TEST_CHECK(compressedLength == 1 + length, "%s: compressed into %u bytes, expected literals only", what, compressedLength);
+   }
+
+   return;
+}
+
+
+static VOID _TestMalformedStreams(VOID)
+{
+   ULONG length = 0;
+   UCHAR output[64 + TEST_GUARD];
+   std::vector<UCHAR> data(0x1000);
+   std::vector<UCHAR> compressed;
+   std::vector<UCHAR> decompressed(data.size() + TEST_GUARD);
+   DWORD err = ERROR_GEN_FAILURE;
+
+   for (ULONG i = 0; i < TEST_COUNT(_malformedStreams); ++i) {
+      const TEST_STREAM *s = _malformedStreams + i;
+
+      memset(output, TEST_GUARD_BYTE, sizeof(output));
+      err = LZ4BlockDecompress(s->Data, s->Length, output, 64, &length);
+      TEST_CHECK(err == ERROR_INVALID_DATA, "%s: %u, expected ERROR_INVALID_DATA", s->Name, err);
+      TEST_CHECK(output[64] == TEST_GUARD_BYTE, "%s: decompression wrote past the destination", s->Name);
+   }
+
+   // Text-like data, so the stream contains both literals and matches.
+   for (ULONG i = 0; i < data.size(); ++i)
+      data[i] = (UCHAR)((_Random() % 4 == 0) ? _Random() : "IRP_MJ_READ "[i % 12]);
+
+   _RoundTrip("truncation source", data.data(), (ULONG)data.size(), compressed);
+   err = LZ4BlockDecompress(compressed.data(), (ULONG)compressed.size(), decompressed.data(), (ULONG)data.size() - 1, &length);
+   TEST_CHECK(err == ERROR_INVALID_DATA, "destination one byte short: %u, expected ERROR_INVALID_DATA", err);
+
+   // A stream cut right after literals is a valid shorter stream, any other
+   // cut must be rejected. None may produce the whole data.
+   for (ULONG cut = 0; cut < compressed.size(); ++cut) {
+      memset(decompressed.data(), TEST_GUARD_BYTE, decompressed.size());
+      length = 0;
+      err = LZ4BlockDecompress(compressed.data(), cut, decompressed.data(), (ULONG)data.size(), &length);
+      TEST_CHECK(err == ERROR_INVALID_DATA || (err == ERROR_SUCCESS && length < data.size()), "stream cut at %u of %u bytes: %u, %u bytes", cut, (ULONG)compressed.size(), err, length);
+      TEST_CHECK(decompressed[data.size()] == TEST_GUARD_BYTE, "stream cut at %u: decompression wrote past the destination", cut);
+      if (err == ERROR_SUCCESS)
+         TEST_CHECK(memcmp(decompressed.data(), data.data(), length) == 0, "stream cut at %u: decompressed data differ", cut);
+   }
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   _TestIncompressible();
+   _TestOverlappingMatches();
+   _TestShortInputs();
+   _TestMalformedStreams();
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("lz4 block OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
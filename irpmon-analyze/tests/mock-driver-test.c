@@ -0,0 +1,458 @@
+/**
+ * @file
+ *
+ * Tests the record codec (irpmondll/codec.c) and the in-process mock driver
+ * (irpmondll/mock-driver.c) through its transport. The codec must decode what
+ * it encodes and reject truncated or inconsistent input; the mock driver must
+ * answer the requests the library sends the way the driver does, including
+ * the record sequence, the queue limit and the waits for records.
+ */
+
+#include <unistd.h>
+#include <windows.h>
+#include "general-types.h"
+#include "kernel-shared.h"
+#include "ioctls.h"
+#include "irpmondll-types.h"
+#include "codec.h"
+#include "transport.h"
+#include "mock-driver.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+#define TEST_BUFFER_SIZE         0x4000
+
+static ULONG64 _buffer[TEST_BUFFER_SIZE / sizeof(ULONG64)];
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static ULONG _HookedEntryAppend(PUCHAR Buffer, ULONG Offset, BOOLEAN Driver, PVOID Object, ULONG DeviceCount, PWCHAR Name)
+{
+   ULONG nameLen = (ULONG)(wcslen(Name) + 1)*sizeof(WCHAR);
+   PHOOKED_DRIVER_INFO driver = (PHOOKED_DRIVER_INFO)(Buffer + Offset);
+   PHOOKED_DEVICE_INFO device = (PHOOKED_DEVICE_INFO)(Buffer + Offset);
+
+   if (Driver) {
+      driver->EntrySize = CodecRecordAlign(FIELD_OFFSET(HOOKED_DRIVER_INFO, DriverName) + nameLen);
+      driver->ObjectId = (PUCHAR)Object + 1;
+      driver->DriverObject = Object;
+      driver->MonitoringEnabled = TRUE;
+      driver->NumberOfHookedDevices = DeviceCount;
+      driver->DriverNameLen = nameLen;
+      memcpy(driver->DriverName, Name, nameLen);
+      Offset += driver->EntrySize;
+   } else {
+      device->EntrySize = CodecRecordAlign(FIELD_OFFSET(HOOKED_DEVICE_INFO, DeviceName) + nameLen);
+      device->ObjectId = (PUCHAR)Object + 1;
+      device->DeviceObject = Object;
+      device->IRPSettings[3] = TRUE;
+      device->DeviceNameLen = nameLen;
+      memcpy(device->DeviceName, Name, nameLen);
+      Offset += device->EntrySize;
+   }
+
+   return Offset;
+}
+
+
+/************************************************************************/
+/*                     CODEC TESTS                                      */
+/************************************************************************/
+
+
+static VOID _TestCodecRecords(VOID)
+{
+   ULONG i = 0;
+   ULONG size = 0;
+   ULONG offset = 0;
+   ULONG length = 0;
+   PREQUEST_HEADER header = NULL;
+   union {
+      REQUEST_HEADER Header;
+      UCHAR Bytes[sizeof(REQUEST_IRP) + 64];
+   } record;
+   static const ULONG sizes[] = {sizeof(REQUEST_HEADER), sizeof(REQUEST_IRP), sizeof(REQUEST_IRP_COMPLETION), sizeof(REQUEST_HEADER) + 13, sizeof(REQUEST_HEADER) + 64};
+
+   for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+      memset(&record, 0x40 + i, sizeof(record));
+      record.Header.Id = i;
+      TEST_CHECK(CodecRecordAppend(_buffer, sizeof(_buffer), &offset, &record.Header, sizes[i]) == ERROR_SUCCESS, "cannot append record %u", i);
+      TEST_CHECK(offset % IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT == 0, "offset %u not aligned", offset);
+   }
+
+   length = offset;
+   offset = 0;
+   for (i = 0; CodecRecordNext(_buffer, length, &offset, &header, &size); ++i) {
+      TEST_CHECK(i < sizeof(sizes) / sizeof(sizes[0]) && size == sizes[i] && header->Id == i, "record %u: size %u, ID %u", i, size, header->Id);
+      TEST_CHECK(((ULONG_PTR)header % IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT) == 0, "record %u not aligned", i);
+      TEST_CHECK(((PUCHAR)header)[size - 1] == 0x40 + i, "record %u: wrong data", i);
+   }
+
+   TEST_CHECK(i == sizeof(sizes) / sizeof(sizes[0]) && offset == length, "%u records decoded, offset %u of %u", i, offset, length);
+
+   // A record cut by the end of the data is not returned.
+   offset = 0;
+   for (i = 0; CodecRecordNext(_buffer, length - 1, &offset, &header, &size); ++i)
+      ;
+
+   TEST_CHECK(i == sizeof(sizes) / sizeof(sizes[0]) - 1, "%u records decoded from truncated data", i);
+
+   // A record not fitting into the buffer is not stored, the offset reports the size required.
+   offset = 0;
+   TEST_CHECK(CodecRecordAppend(_buffer, sizeof(REQUEST_IRP), &offset, &record.Header, sizeof(REQUEST_IRP)) == ERROR_INSUFFICIENT_BUFFER, "%s", "oversized record appended");
+   TEST_CHECK(offset == CodecRecordAlign(sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_IRP)), "required size %u", offset);
+
+   return;
+}
+
+
+static VOID _TestCodecSnapshot(VOID)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG offset = 0;
+   ULONG length = 0;
+   ULONG deviceCount = 0;
+   SIZE_T blockSize = 0;
+   WCHAR name[64];
+   PVOID block = NULL;
+   PIRPMON_DRIVER_INFO *drivers = NULL;
+   PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT snapshot = (PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT)_buffer;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   memset(_buffer, 0, sizeof(_buffer));
+   offset = sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT);
+   for (i = 0; i < 4; ++i) {
+      swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Driver\\Test%u", i);
+      CodecSnapshotAppendDriver(_buffer, sizeof(_buffer), &offset, (PVOID)(ULONG_PTR)(0x1000*(i + 1)), i, name, (ULONG)(wcslen(name)*sizeof(WCHAR)));
+      for (j = 0; j < i; ++j) {
+         // The first device of each driver has no name.
+         name[0] = L'\0';
+         if (j > 0)
+            swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Device\\Test%u_%u", i, j);
+
+         CodecSnapshotAppendDevice(_buffer, sizeof(_buffer), &offset, (PVOID)(ULONG_PTR)(0x1000*(i + 1) + 0x10*(j + 1)), (j > 0) ? (PVOID)(ULONG_PTR)(0x1000*(i + 1) + 0x10*j) : NULL, name, (ULONG)(wcslen(name)*sizeof(WCHAR)));
+      }
+   }
+
+   length = offset;
+   snapshot->RequiredLength = length;
+   snapshot->DriverCount = 4;
+   err = CodecSnapshotMeasure(snapshot, &deviceCount, &blockSize);
+   TEST_CHECK(err == ERROR_SUCCESS && deviceCount == 6, "measure: %u, %u devices", err, deviceCount);
+   if (err == ERROR_SUCCESS) {
+      block = malloc(blockSize);
+      drivers = CodecSnapshotDecode(snapshot, deviceCount, block);
+      TEST_CHECK(drivers == block, "%s", "the driver array does not start the block");
+      for (i = 0; i < 4; ++i) {
+         swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Driver\\Test%u", i);
+         TEST_CHECK(drivers[i]->DriverObject == (PVOID)(ULONG_PTR)(0x1000*(i + 1)) && drivers[i]->DeviceCount == i && wcscmp(drivers[i]->DriverName, name) == 0, "driver %u: %ls", i, drivers[i]->DriverName);
+         for (j = 0; j < drivers[i]->DeviceCount; ++j) {
+            name[0] = L'\0';
+            if (j > 0)
+               swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Device\\Test%u_%u", i, j);
+
+            TEST_CHECK(wcscmp(drivers[i]->Devices[j]->Name, name) == 0, "device %u of driver %u: \"%ls\"", j, i, drivers[i]->Devices[j]->Name);
+            TEST_CHECK(drivers[i]->Devices[j]->DeviceObject == (PVOID)(ULONG_PTR)(0x1000*(i + 1) + 0x10*(j + 1)), "device %u of driver %u: wrong address", j, i);
+            TEST_CHECK((PUCHAR)drivers[i]->Devices[j] >= (PUCHAR)block && (PUCHAR)drivers[i]->Devices[j] < (PUCHAR)block + blockSize, "device %u of driver %u outside the block", j, i);
+         }
+
+         TEST_CHECK((PUCHAR)drivers[i]->DriverName >= (PUCHAR)block && (PUCHAR)drivers[i]->DriverName < (PUCHAR)block + blockSize, "name of driver %u outside the block", i);
+      }
+
+      free(block);
+   }
+
+   // Any truncation is detected, the last record has a nonempty name.
+   for (i = 0; i < length; ++i) {
+      snapshot->RequiredLength = i;
+      err = CodecSnapshotMeasure(snapshot, &deviceCount, &blockSize);
+      TEST_CHECK(err == ERROR_INVALID_DATA, "snapshot of %u bytes accepted", i);
+   }
+
+   // So is a name longer than the rest of the snapshot.
+   snapshot->RequiredLength = length;
+   *(PULONG)((PUCHAR)snapshot + sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT) + sizeof(PVOID) + sizeof(ULONG)) = length;
+   TEST_CHECK(CodecSnapshotMeasure(snapshot, &deviceCount, &blockSize) == ERROR_INVALID_DATA, "%s", "oversized name accepted");
+
+   return;
+}
+
+
+static VOID _TestCodecHookedObjects(VOID)
+{
+   ULONG offset = 0;
+   ULONG deviceCount = 0;
+   SIZE_T blockSize = 0;
+   PVOID block = NULL;
+   PHOOKED_DRIVER_UMINFO drivers = NULL;
+   PHOOKED_OBJECTS_INFO info = (PHOOKED_OBJECTS_INFO)_buffer;
+   PHOOKED_DRIVER_INFO second = NULL;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   memset(_buffer, 0, sizeof(_buffer));
+   info->NumberOfHookedDrivers = 2;
+   info->NumberOfHookedDevices = 2;
+   offset = sizeof(HOOKED_OBJECTS_INFO);
+   offset = _HookedEntryAppend((PUCHAR)_buffer, offset, TRUE, (PVOID)0x1000, 0, L"\\Driver\\Empty");
+   second = (PHOOKED_DRIVER_INFO)((PUCHAR)_buffer + offset);
+   offset = _HookedEntryAppend((PUCHAR)_buffer, offset, TRUE, (PVOID)0x2000, 2, L"\\Driver\\Disk");
+   offset = _HookedEntryAppend((PUCHAR)_buffer, offset, FALSE, (PVOID)0x2010, 0, L"\\Device\\Harddisk0\\DR0");
+   offset = _HookedEntryAppend((PUCHAR)_buffer, offset, FALSE, (PVOID)0x2020, 0, L"\\Device\\Harddisk1\\DR1");
+   err = CodecHookedObjectsMeasure(info, offset, &deviceCount, &blockSize);
+   TEST_CHECK(err == ERROR_SUCCESS && deviceCount == 2, "measure: %u, %u devices", err, deviceCount);
+   if (err == ERROR_SUCCESS) {
+      block = malloc(blockSize);
+      drivers = CodecHookedObjectsDecode(info, deviceCount, block);
+      TEST_CHECK(drivers[0].NumberOfHookedDevices == 0 && drivers[0].HookedDevices == NULL && wcscmp(drivers[0].DriverName, L"\\Driver\\Empty") == 0, "%s", "wrong first driver");
+      TEST_CHECK(drivers[0].DriverNameLen == wcslen(L"\\Driver\\Empty")*sizeof(WCHAR) && drivers[0].ObjectId == (PVOID)0x1001 && drivers[0].MonitoringEnabled, "%s", "wrong first driver");
+      TEST_CHECK(drivers[1].NumberOfHookedDevices == 2 && drivers[1].DriverObject == (PVOID)0x2000 && wcscmp(drivers[1].DriverName, L"\\Driver\\Disk") == 0, "%s", "wrong second driver");
+      TEST_CHECK(wcscmp(drivers[1].HookedDevices[1].DeviceName, L"\\Device\\Harddisk1\\DR1") == 0 && drivers[1].HookedDevices[1].DeviceObject == (PVOID)0x2020, "%s", "wrong second device");
+      TEST_CHECK(drivers[1].HookedDevices[0].IRPSettings[3] && !drivers[1].HookedDevices[0].IRPSettings[4], "%s", "wrong IRP settings");
+      free(block);
+   }
+
+   TEST_CHECK(CodecHookedObjectsMeasure(info, offset - 1, &deviceCount, &blockSize) == ERROR_INVALID_DATA, "%s", "truncated information accepted");
+   TEST_CHECK(CodecHookedObjectsMeasure(info, sizeof(HOOKED_OBJECTS_INFO) - 1, &deviceCount, &blockSize) == ERROR_INVALID_DATA, "%s", "truncated header accepted");
+   second->DriverNameLen = 0;
+   TEST_CHECK(CodecHookedObjectsMeasure(info, offset, &deviceCount, &blockSize) == ERROR_INVALID_DATA, "%s", "empty name accepted");
+   second->DriverNameLen = second->EntrySize;
+   TEST_CHECK(CodecHookedObjectsMeasure(info, offset, &deviceCount, &blockSize) == ERROR_INVALID_DATA, "%s", "name longer than its entry accepted");
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MOCK DRIVER TESTS                                */
+/************************************************************************/
+
+
+/** Checks records retrieved from the mock driver continue a given sequence.
+ *
+ *  @return
+ *  Returns the number of records.
+ */
+static ULONG _RecordsCheck(PVOID Buffer, ULONG Length, ULONG FirstId)
+{
+   ULONG size = 0;
+   ULONG offset = 0;
+   ULONG ret = 0;
+   PVOID irpAddress = NULL;
+   PREQUEST_HEADER header = NULL;
+
+   while (CodecRecordNext(Buffer, Length, &offset, &header, &size)) {
+      TEST_CHECK(header->Id == FirstId + ret, "record ID %u, expected %u", header->Id, FirstId + ret);
+      TEST_CHECK(header->Type == (((header->Id % 2) == 0) ? ertIRP : ertIRPCompletion), "record %u: type %u", header->Id, header->Type);
+      TEST_CHECK(size == ((header->Type == ertIRP) ? sizeof(REQUEST_IRP) : sizeof(REQUEST_IRP_COMPLETION)), "record %u: size %u", header->Id, size);
+      TEST_CHECK(header->Device != NULL && header->Driver != NULL, "record %u: no device", header->Id);
+      if (header->Type == ertIRP)
+         irpAddress = ((PREQUEST_IRP)header)->IRPAddress;
+      else if (irpAddress != NULL)
+         TEST_CHECK(((PREQUEST_IRP_COMPLETION)header)->IRPAddress == irpAddress, "completion %u of another IRP", header->Id);
+
+      ++ret;
+   }
+
+   TEST_CHECK(offset == Length, "%u bytes of %u decoded", offset, Length);
+
+   return ret;
+}
+
+
+static VOID _TestMockRequests(VOID)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG length = 0;
+   ULONG deviceCount = 0;
+   SIZE_T blockSize = 0;
+   WCHAR name[64];
+   PVOID block = NULL;
+   PIRPMON_DRIVER_INFO *drivers = NULL;
+   TRANSPORT transport;
+   IRPMON_MOCK_SETTINGS settings = {0, 0, 3, 2};
+   IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT changesInput;
+   PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT changes = (PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT)_buffer;
+   PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT snapshot = (PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT)_buffer;
+   PHOOKED_OBJECTS_INFO hooked = (PHOOKED_OBJECTS_INFO)_buffer;
+   PREQUEST_HEADER header = (PREQUEST_HEADER)_buffer;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = MockDriverOpen(&settings, &transport);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot open the mock driver: %u", err);
+   if (err != ERROR_SUCCESS)
+      return;
+
+   // The snapshot, first into a buffer too small for it.
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO, NULL, 0, _buffer, sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT), &length);
+   TEST_CHECK(err == ERROR_INSUFFICIENT_BUFFER && snapshot->RequiredLength > sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT), "small snapshot buffer: %u, %u bytes required", err, snapshot->RequiredLength);
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO, NULL, 0, _buffer, sizeof(_buffer), &length);
+   TEST_CHECK(err == ERROR_SUCCESS && length == snapshot->RequiredLength && snapshot->DriverCount == 3 && snapshot->Generation == 0, "snapshot: %u", err);
+   if (err == ERROR_SUCCESS && CodecSnapshotMeasure(snapshot, &deviceCount, &blockSize) == ERROR_SUCCESS) {
+      TEST_CHECK(deviceCount == 6, "%u devices", deviceCount);
+      block = malloc(blockSize);
+      drivers = CodecSnapshotDecode(snapshot, deviceCount, block);
+      for (i = 0; i < 3; ++i) {
+         swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Driver\\Mock%u", i);
+         TEST_CHECK(wcscmp(drivers[i]->DriverName, name) == 0 && drivers[i]->DeviceCount == 2, "driver %u: %ls", i, drivers[i]->DriverName);
+         for (j = 0; j < drivers[i]->DeviceCount; ++j) {
+            swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Device\\Mock%u_%u", i, j);
+            TEST_CHECK(wcscmp(drivers[i]->Devices[j]->Name, name) == 0 && drivers[i]->Devices[j]->AttachedDevice == NULL, "device %u of driver %u: %ls", j, i, drivers[i]->Devices[j]->Name);
+         }
+      }
+
+      free(block);
+   } else TEST_CHECK(FALSE, "%s", "invalid snapshot of the mock driver");
+
+   // The objects never change, and the changes of other generations are not known.
+   changesInput.Generation = 0;
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_OBJECT_CHANGES, &changesInput, sizeof(changesInput), _buffer, sizeof(_buffer), &length);
+   TEST_CHECK(err == ERROR_SUCCESS && changes->Count == 0 && changes->Generation == 0 && length == sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT), "object changes: %u", err);
+   changesInput.Generation = 3;
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_OBJECT_CHANGES, &changesInput, sizeof(changesInput), _buffer, sizeof(_buffer), &length);
+   TEST_CHECK(err == ERROR_NOT_FOUND, "object changes of an unknown generation: %u", err);
+
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMONDRV_HOOK_GET_INFO, NULL, 0, _buffer, sizeof(_buffer), &length);
+   TEST_CHECK(err == ERROR_SUCCESS && length == sizeof(HOOKED_OBJECTS_INFO) && hooked->NumberOfHookedDrivers == 0, "hooked objects: %u", err);
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_HOOK_DRIVER, NULL, 0, NULL, 0, &length);
+   TEST_CHECK(err == ERROR_NOT_SUPPORTED, "hooking: %u", err);
+
+   // Records are available only to a connected client.
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_RECORD, NULL, 0, _buffer, sizeof(_buffer), &length);
+   TEST_CHECK(err == ERROR_NO_MORE_ITEMS, "record before connection: %u", err);
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_DISCONNECT, NULL, 0, NULL, 0, &length);
+   TEST_CHECK(err == ERROR_INVALID_FUNCTION, "disconnection before connection: %u", err);
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_CONNECT, NULL, 0, NULL, 0, &length);
+   TEST_CHECK(err == ERROR_SUCCESS, "connection: %u", err);
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_CONNECT, NULL, 0, NULL, 0, &length);
+   TEST_CHECK(err == ERROR_ALREADY_EXISTS, "second connection: %u", err);
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_RECORD, NULL, 0, _buffer, sizeof(REQUEST_HEADER), &length);
+   TEST_CHECK(err == ERROR_INSUFFICIENT_BUFFER, "record into a small buffer: %u", err);
+   for (i = 0; i < 4; ++i) {
+      err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_GET_RECORD, NULL, 0, _buffer, sizeof(_buffer), &length);
+      TEST_CHECK(err == ERROR_SUCCESS && header->Id == i && length == ((i % 2 == 0) ? sizeof(REQUEST_IRP) : sizeof(REQUEST_IRP_COMPLETION)), "record %u: %u, ID %u", i, err, header->Id);
+   }
+
+   err = transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_DISCONNECT, NULL, 0, NULL, 0, &length);
+   TEST_CHECK(err == ERROR_SUCCESS, "disconnection: %u", err);
+   transport.Close(transport.Context);
+
+   return;
+}
+
+
+static VOID _TestMockRecords(VOID)
+{
+   ULONG length = 0;
+   ULONG count = 0;
+   ULONG firstId = 0;
+   PVOID records = NULL;
+   HANDLE stopEvent = NULL;
+   ULONGLONG start = 0;
+   TRANSPORT transport;
+   IRPMON_MOCK_STATISTICS statistics;
+   IRPMON_MOCK_SETTINGS settings = {0, 0, 2, 2};
+   DWORD err = ERROR_GEN_FAILURE;
+
+   stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+   // Unlimited rate, every wait fills the buffer.
+   err = MockDriverOpen(&settings, &transport);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot open the mock driver: %u", err);
+   if (err != ERROR_SUCCESS)
+      return;
+
+   transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_CONNECT, NULL, 0, NULL, 0, &length);
+   err = transport.RecordsOpen(transport.Context, &records);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot open a record channel: %u", err);
+   err = transport.RecordsWait(records, _buffer, sizeof(_buffer), INFINITE, stopEvent, &length);
+   count = _RecordsCheck(_buffer, length, 0);
+   TEST_CHECK(err == ERROR_SUCCESS && count > 0 && sizeof(_buffer) - length < sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_IRP), "unlimited rate: %u, %u records in %u bytes", err, count, length);
+   firstId = count;
+   err = transport.RecordsWait(records, _buffer, sizeof(_buffer), INFINITE, stopEvent, &length);
+   TEST_CHECK(err == ERROR_SUCCESS && _RecordsCheck(_buffer, length, firstId) == count, "second wait: %u", err);
+   err = transport.RecordsWait(records, _buffer, sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_HEADER), INFINITE, stopEvent, &length);
+   TEST_CHECK(err == ERROR_INSUFFICIENT_BUFFER && length >= sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_IRP), "small buffer: %u, %u bytes required", err, length);
+   MockDriverStatistics(transport.Context, &statistics);
+   TEST_CHECK(statistics.Delivered == 2*count && statistics.Dropped == 0 && statistics.Pending == 0, "%llu records delivered", (unsigned long long)statistics.Delivered);
+   transport.RecordsClose(records);
+   transport.Close(transport.Context);
+
+   // 1000 records per second with at most 50 waiting: the newer ones are dropped.
+   settings.RecordsPerSecond = 1000;
+   settings.QueueLimit = 50;
+   err = MockDriverOpen(&settings, &transport);
+   TEST_CHECK(err == ERROR_SUCCESS, "cannot open the mock driver: %u", err);
+   if (err != ERROR_SUCCESS)
+      return;
+
+   transport.RecordsOpen(transport.Context, &records);
+   // Nothing comes before the connection, the stop event ends the wait.
+   SetEvent(stopEvent);
+   err = transport.RecordsWait(records, _buffer, sizeof(_buffer), INFINITE, stopEvent, &length);
+   TEST_CHECK(err == ERROR_OPERATION_ABORTED && length == 0, "stopped wait: %u", err);
+   ResetEvent(stopEvent);
+   transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_CONNECT, NULL, 0, NULL, 0, &length);
+   usleep(200000);
+   MockDriverStatistics(transport.Context, &statistics);
+   TEST_CHECK(statistics.Generated >= 200 && statistics.Pending == 50 && statistics.Dropped == statistics.Generated - 50, "queue limit: %llu generated, %llu dropped, %llu pending", (unsigned long long)statistics.Generated, (unsigned long long)statistics.Dropped, (unsigned long long)statistics.Pending);
+   err = transport.RecordsWait(records, _buffer, sizeof(_buffer), 0, stopEvent, &length);
+   TEST_CHECK(err == ERROR_SUCCESS, "wait for the queued records: %u", err);
+   count = _RecordsCheck(_buffer, length, (ULONG)statistics.Dropped);
+   TEST_CHECK(count >= 50, "%u queued records", count);
+
+   // The records come at the configured rate.
+   start = GetTickCount64();
+   count = 0;
+   while (GetTickCount64() - start < 100) {
+      err = transport.RecordsWait(records, _buffer, sizeof(_buffer), 50, stopEvent, &length);
+      if (err == ERROR_SUCCESS)
+         count += length / CodecRecordAlign(sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_IRP_COMPLETION));
+   }
+
+   TEST_CHECK(count >= 50 && count <= 200, "%u records in 100 ms", count);
+   MockDriverStatistics(transport.Context, &statistics);
+   TEST_CHECK(statistics.Generated == statistics.Delivered + statistics.Dropped + statistics.Pending, "%s", "the counters do not add up");
+
+   // The queue is cleared by the disconnection.
+   transport.Ioctl(transport.Context, IOCTL_IRPMNDRV_DISCONNECT, NULL, 0, NULL, 0, &length);
+   MockDriverStatistics(transport.Context, &statistics);
+   TEST_CHECK(statistics.Pending == 0, "%llu records pending after disconnection", (unsigned long long)statistics.Pending);
+   start = GetTickCount64();
+   err = transport.RecordsWait(records, _buffer, sizeof(_buffer), 50, stopEvent, &length);
+   TEST_CHECK(err == ERROR_OPERATION_ABORTED && GetTickCount64() - start >= 50, "wait after disconnection: %u", err);
+
+   transport.RecordsClose(records);
+   transport.Close(transport.Context);
+   CloseHandle(stopEvent);
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   _TestCodecRecords();
+   _TestCodecSnapshot();
+   _TestCodecHookedObjects();
+   _TestMockRequests();
+   _TestMockRecords();
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("mock driver OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#ifndef __IRPMON_ANALYZE_TEST_H__
+#define __IRPMON_ANALYZE_TEST_H__
+
+/**
+ * @file
+ *
+ * Checks shared by the test programs. Every test program is a single source
+ * file that includes this header after its Windows (or kernel) headers and
+ * returns nonzero from main if _failures is not zero.
+ */
+
+#include <stdio.h>
+
+
+/** Number of checks that failed so far. */
+static ULONG _failures = 0;
+
+/** Reports a failed check with the source location and counts it. */
+#define TEST_CHECK(aCondition, aFormat, ...)                                         \
+   if (!(aCondition)) {                                                               \
+      fprintf(stderr, "%s:%d: " aFormat "\n", __FILE__, __LINE__, __VA_ARGS__);       \
+      ++_failures;                                                                    \
+   }
+
+
+
+#endif
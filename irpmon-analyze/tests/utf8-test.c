@@ -0,0 +1,318 @@
+/**
+ * @file
+ *
+ * Tests the UTF-8 string tables of the translation library
+ * (libtranslate/utf8.c). The arrays must hold the exact UTF-8 form of their
+ * source strings together with their lengths, be built only once even when
+ * first requested by several threads at once, and the UTF-8 variants of
+ * the translation routines must return the same strings as the UTF-16 ones.
+ */
+
+#include <windows.h>
+#include "libtranslate.h"
+#include "utf8.h"
+#include "test.h"
+
+
+/************************************************************************/
+/*                     TYPES AND GLOBAL VARIABLES                       */
+/************************************************************************/
+
+typedef struct _TEST_STRING {
+   PWCHAR Wide;
+   const char *Utf8;
+} TEST_STRING, *PTEST_STRING;
+
+static const TEST_STRING _strings[] = {
+   {L"STATUS_SUCCESS", "STATUS_SUCCESS"},
+   {L"", ""},
+   {L"caf\u00e9", "caf\xc3\xa9"},
+   {L"\u20ac 5", "\xe2\x82\xac 5"},
+   {L"\U0001F600", "\xf0\x9f\x98\x80"},
+   {L"\u00a9 \u2122 \u00ae", "\xc2\xa9 \xe2\x84\xa2 \xc2\xae"},
+};
+
+#define TEST_COUNT(aArray)       (sizeof(aArray) / sizeof(aArray[0]))
+#define TEST_THREAD_COUNT        8
+#define TEST_VALUE_COUNT         0x400
+
+static volatile LONG _sourceCalls = 0;
+static UTF8_ARRAY _sharedArray;
+
+
+/************************************************************************/
+/*                     HELPER FUNCTIONS                                 */
+/************************************************************************/
+
+
+static PWCHAR _StringSource(PVOID Context, ULONG Index)
+{
+   InterlockedIncrement(&_sourceCalls);
+
+   return _strings[Index].Wide;
+}
+
+
+static VOID _CheckUtf8(const char *What, ULONG Value, PWCHAR Wide, PCHAR Utf8, ULONG Length)
+{
+   char expected[4096];
+   ULONG required = 0;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = Utf8FromWide(Wide, expected, sizeof(expected), &required);
+   TEST_CHECK(err == ERROR_SUCCESS, "%s 0x%x: cannot convert \"%ls\": %u", What, Value, Wide, err);
+   TEST_CHECK(Utf8 != NULL && strcmp(Utf8, expected) == 0, "%s 0x%x: expected \"%s\", got \"%s\"", What, Value, expected, (Utf8 != NULL) ? Utf8 : "(null)");
+   TEST_CHECK(Length == required - 1, "%s 0x%x: length %u, expected %u", What, Value, Length, required - 1);
+
+   return;
+}
+
+
+static PVOID _ArrayThread(PVOID Context)
+{
+   return Utf8ArrayGet(&_sharedArray, TEST_COUNT(_strings), _StringSource, NULL);
+}
+
+
+/************************************************************************/
+/*                     TESTS                                            */
+/************************************************************************/
+
+
+static VOID _TestArray(VOID)
+{
+   ULONG i = 0;
+   UTF8_ARRAY array;
+   PUTF8_STRING strings = NULL;
+
+   memset(&array, 0, sizeof(array));
+   InitOnceInitialize(&array.InitOnce);
+   _sourceCalls = 0;
+   strings = Utf8ArrayGet(&array, TEST_COUNT(_strings), _StringSource, NULL);
+   TEST_CHECK(strings != NULL, "cannot build an array of %u strings", (ULONG)TEST_COUNT(_strings));
+   if (strings == NULL)
+      return;
+
+   for (i = 0; i < TEST_COUNT(_strings); ++i) {
+      TEST_CHECK(strcmp(strings[i].Buffer, _strings[i].Utf8) == 0, "string %u: expected \"%s\", got \"%s\"", i, _strings[i].Utf8, strings[i].Buffer);
+      TEST_CHECK(strings[i].Length == strlen(_strings[i].Utf8), "string %u: length %u, expected %u", i, strings[i].Length, (ULONG)strlen(_strings[i].Utf8));
+      // All strings live in the pool, one right after another.
+      TEST_CHECK(strings[i].Buffer >= array.Pool, "string %u lies outside the pool", i);
+      if (i > 0)
+         TEST_CHECK(strings[i].Buffer == strings[i - 1].Buffer + strings[i - 1].Length + 1, "string %u does not follow string %u", i, i - 1);
+   }
+
+   // One pass to measure the strings, one to convert them, nothing afterwards.
+   TEST_CHECK(_sourceCalls == 2 * TEST_COUNT(_strings), "the source was called %d times", _sourceCalls);
+   TEST_CHECK(Utf8ArrayGet(&array, TEST_COUNT(_strings), _StringSource, NULL) == strings, "%s", "the array was built again");
+   TEST_CHECK(_sourceCalls == 2 * TEST_COUNT(_strings), "the source was called %d times", _sourceCalls);
+   Utf8ArrayFree(&array);
+   TEST_CHECK(array.Strings == NULL && array.Pool == NULL, "%s", "the array was not cleared");
+
+   // A freed array is built again.
+   strings = Utf8ArrayGet(&array, TEST_COUNT(_strings), _StringSource, NULL);
+   TEST_CHECK(strings != NULL && strcmp(strings[2].Buffer, _strings[2].Utf8) == 0, "%s", "the array was not rebuilt");
+   TEST_CHECK(_sourceCalls == 4 * TEST_COUNT(_strings), "the source was called %d times", _sourceCalls);
+   Utf8ArrayFree(&array);
+
+   return;
+}
+
+
+static VOID _TestLazyArray(VOID)
+{
+   ULONG i = 0;
+   UTF8_ARRAY array;
+   PCHAR first = NULL;
+   PCHAR second = NULL;
+   PUTF8_STRING strings = NULL;
+
+   memset(&array, 0, sizeof(array));
+   InitOnceInitialize(&array.InitOnce);
+   strings = Utf8ArrayGet(&array, TEST_COUNT(_strings), NULL, NULL);
+   TEST_CHECK(strings != NULL && array.Pool == NULL, "%s", "cannot build a lazy array");
+   if (strings == NULL)
+      return;
+
+   for (i = 0; i < TEST_COUNT(_strings); ++i) {
+      TEST_CHECK(strings[i].Buffer == NULL, "string %u converted too early", i);
+      first = Utf8ArrayGetLazy(&array, i, _strings[i].Wide);
+      TEST_CHECK(first != NULL && strcmp(first, _strings[i].Utf8) == 0, "string %u: expected \"%s\", got \"%s\"", i, _strings[i].Utf8, (first != NULL) ? first : "(null)");
+      second = Utf8ArrayGetLazy(&array, i, _strings[i].Wide);
+      TEST_CHECK(first == second, "string %u converted twice", i);
+   }
+
+   Utf8ArrayFree(&array);
+
+   return;
+}
+
+
+static VOID _TestConcurrentBuild(VOID)
+{
+   ULONG i = 0;
+   PVOID results[TEST_THREAD_COUNT];
+   pthread_t threads[TEST_THREAD_COUNT];
+
+   InitOnceInitialize(&_sharedArray.InitOnce);
+   _sourceCalls = 0;
+   for (i = 0; i < TEST_THREAD_COUNT; ++i)
+      pthread_create(threads + i, NULL, _ArrayThread, NULL);
+
+   for (i = 0; i < TEST_THREAD_COUNT; ++i)
+      pthread_join(threads[i], results + i);
+
+   for (i = 0; i < TEST_THREAD_COUNT; ++i)
+      TEST_CHECK(results[i] != NULL && results[i] == results[0], "thread %u got a different array", i);
+
+   TEST_CHECK(_sourceCalls == 2 * TEST_COUNT(_strings), "the array was built more than once (%d source calls)", _sourceCalls);
+   Utf8ArrayFree(&_sharedArray);
+
+   return;
+}
+
+
+static VOID _TestBuffer(VOID)
+{
+   char buffer[8];
+   ULONG required = 0;
+   DWORD err = ERROR_GEN_FAILURE;
+
+   err = Utf8FromWide(L"\u20ac\u20ac", buffer, sizeof(buffer), &required);
+   TEST_CHECK(err == ERROR_SUCCESS && required == 7 && strcmp(buffer, "\xe2\x82\xac\xe2\x82\xac") == 0, "conversion failed: %u, %u", err, required);
+   err = Utf8FromWide(L"\u20ac\u20ac", buffer, 6, &required);
+   TEST_CHECK(err == ERROR_INSUFFICIENT_BUFFER && required == 7, "expected ERROR_INSUFFICIENT_BUFFER and 7, got %u and %u", err, required);
+
+   return;
+}
+
+
+static VOID _TestEnumerations(VOID)
+{
+   ULONG i = 0;
+   ULONG type = 0;
+   ULONG description = 0;
+   PWCHAR wide = NULL;
+   PCHAR utf8 = NULL;
+   static ULONG values[TEST_VALUE_COUNT];
+   static PCHAR strings[TEST_VALUE_COUNT];
+   static ULONG lengths[TEST_VALUE_COUNT];
+   DWORD err = ERROR_GEN_FAILURE;
+
+   for (i = 0; i < TEST_VALUE_COUNT; ++i)
+      values[i] = i;
+
+   for (type = 0; type <= ltetIRPSystemMinorFunction; ++type) {
+      for (description = 0; description < 2; ++description) {
+         err = LibTranslateEnumerationValuesToStringsUTF8((ELibTranslateEnumerationType)type, (BOOLEAN)description, values, TEST_VALUE_COUNT, strings, lengths);
+         TEST_CHECK(err == ERROR_SUCCESS, "enumeration %u: batch failed with %u", type, err);
+         for (i = 0; i < TEST_VALUE_COUNT; ++i) {
+            wide = LibTranslateEnumerationValueToString((ELibTranslateEnumerationType)type, (BOOLEAN)description, i);
+            utf8 = LibTranslateEnumerationValueToStringUTF8((ELibTranslateEnumerationType)type, (BOOLEAN)description, i);
+            _CheckUtf8("enumeration", i, wide, utf8, (utf8 != NULL) ? (ULONG)strlen(utf8) : 0);
+            _CheckUtf8("enumeration batch", i, wide, strings[i], lengths[i]);
+         }
+      }
+   }
+
+   return;
+}
+
+
+static VOID _TestIntegerValues(VOID)
+{
+   ULONG i = 0;
+   ULONG type = 0;
+   ULONG description = 0;
+   PWCHAR wide = NULL;
+   PCHAR utf8 = NULL;
+   static ULONG values[TEST_VALUE_COUNT];
+   static PCHAR strings[TEST_VALUE_COUNT];
+   static ULONG lengths[TEST_VALUE_COUNT];
+   DWORD err = ERROR_GEN_FAILURE;
+
+   for (type = 0; type <= ltivtDeviceControl; ++type) {
+      for (i = 0; i < TEST_VALUE_COUNT; ++i)
+         values[i] = (type == ltivtNTSTATUS) ? 0xC0000000 + i : i;
+
+      for (description = 0; description < 2; ++description) {
+         err = LibTranslateGeneralIntegerValuesToStringsUTF8((ELibTranslateIntegerValueType)type, (BOOLEAN)description, values, TEST_VALUE_COUNT, strings, lengths);
+         if (err == ERROR_INVALID_PARAMETER)
+            continue;
+
+         TEST_CHECK(err == ERROR_SUCCESS, "integer type %u: batch failed with %u", type, err);
+         for (i = 0; i < TEST_VALUE_COUNT; ++i) {
+            wide = LibTranslateGeneralIntegerValueToString((ELibTranslateIntegerValueType)type, (BOOLEAN)description, values[i]);
+            utf8 = LibTranslateGeneralIntegerValueToStringUTF8((ELibTranslateIntegerValueType)type, (BOOLEAN)description, values[i]);
+            _CheckUtf8("integer", values[i], wide, utf8, (utf8 != NULL) ? (ULONG)strlen(utf8) : 0);
+            _CheckUtf8("integer batch", values[i], wide, strings[i], lengths[i]);
+         }
+      }
+   }
+
+   return;
+}
+
+
+static VOID _TestBitMasks(VOID)
+{
+   ULONG i = 0;
+   ULONG type = 0;
+   ULONG description = 0;
+   ULONG value = 0;
+   ULONG wideLength = 0;
+   ULONG utf8Length = 0;
+   WCHAR wide[1024];
+   char utf8[2048];
+   DWORD err = ERROR_GEN_FAILURE;
+
+   for (type = 0; type <= ltbtIRPPagingReadWrite; ++type) {
+      for (description = 0; description < 2; ++description) {
+         for (i = 0; i < 64; ++i) {
+            // Single bits, all bits and a few scattered combinations.
+            value = (i < 32) ? (1U << i) : (i == 32) ? 0xFFFFFFFF : (0x9E3779B9U * i);
+            err = LibTranslateBitMaskValueToBuffer((ELibTranslateBitMaskType)type, (BOOLEAN)description, value, wide, TEST_COUNT(wide), &wideLength);
+            TEST_CHECK(err == ERROR_SUCCESS, "bit mask %u, value 0x%x: %u", type, value, err);
+            err = LibTranslateBitMaskValueToBufferUTF8((ELibTranslateBitMaskType)type, (BOOLEAN)description, value, utf8, sizeof(utf8), &utf8Length);
+            TEST_CHECK(err == ERROR_SUCCESS, "bit mask %u, value 0x%x: %u", type, value, err);
+            _CheckUtf8("bit mask", value, wide, utf8, utf8Length - 1);
+            // The UTF-8 string is not built from the UTF-16 one, so it reports its size on its own.
+            err = LibTranslateBitMaskValueToBufferUTF8((ELibTranslateBitMaskType)type, (BOOLEAN)description, value, utf8, utf8Length - 1, &wideLength);
+            TEST_CHECK(err == ERROR_INSUFFICIENT_BUFFER && wideLength == utf8Length, "bit mask %u, value 0x%x: %u, %u bytes required, expected %u", type, value, err, wideLength, utf8Length);
+         }
+      }
+   }
+
+   return;
+}
+
+
+/************************************************************************/
+/*                     MAIN                                             */
+/************************************************************************/
+
+
+int main(int argc, char *argv[])
+{
+   DWORD err = ERROR_GEN_FAILURE;
+
+   _TestArray();
+   _TestLazyArray();
+   _TestConcurrentBuild();
+   _TestBuffer();
+   err = LibTranslateInitialize();
+   if (err != ERROR_SUCCESS) {
+      fprintf(stderr, "cannot initialize the translation library: %u\n", err);
+      return 1;
+   }
+
+   _TestEnumerations();
+   _TestIntegerValues();
+   _TestBitMasks();
+   LibTranslateFinalize();
+   if (_failures > 0)
+      fprintf(stderr, "%u checks failed\n", _failures);
+   else printf("utf8 OK\n");
+
+   return (_failures == 0) ? 0 : 1;
+}
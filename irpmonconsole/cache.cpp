@@ -1,5 +1,6 @@
 
 #include <map>
+#include <set>
 #include <string>
 #include <windows.h>
 #include "debug.h"
@@ -13,15 +14,38 @@
 /*                           GLOBAL VARIABLES                           */
 /************************************************************************/
 
-static std::map<PVOID, std::wstring> _deviceNames;
-static std::map<PVOID, std::wstring> _driverNames;
-static CRITICAL_SECTION _cacheLock;
+static std::map<PVOID, const char *> _deviceNames;
+static std::map<PVOID, const char *> _driverNames;
+/** UTF-8 names referenced by the maps. The names are kept until the cache
+    is finalized, so the pointers returned to callers stay valid even after
+    a refresh. */
+static std::set<std::string> _names;
+/** Lookups share the lock, only an update of the maps takes it exclusively. */
+static SRWLOCK _cacheLock;
+/** Object change generation the maps are consistent with. */
+static ULONG _generation = 0;
 
 
 /************************************************************************/
 /*                           HELPER FUNCTIONS                           */
 /************************************************************************/
 
+static const char *_NameIntern(const wchar_t *Name, int Length)
+{
+	int len = 0;
+	std::string utf8;
+
+	len = WideCharToMultiByte(CP_UTF8, 0, Name, Length, NULL, 0, NULL, NULL);
+	if (len > 0) {
+		utf8.resize(len);
+		WideCharToMultiByte(CP_UTF8, 0, Name, Length, &utf8[0], len, NULL, NULL);
+		if (Length == -1)
+			utf8.resize(len - 1);
+	}
+
+	return _names.insert(utf8).first->c_str();
+}
+
 static DWORD _Refresh(VOID)
 {
 	ULONG driverCount = 0;
@@ -29,67 +53,131 @@ static DWORD _Refresh(VOID)
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION_NO_ARGS();
 
-	ret = IRPMonDllSnapshotRetrieve(&driverSnapshot, &driverCount);
+	ret = IRPMonDllSnapshotRetrieveEx(&driverSnapshot, &driverCount, &_generation);
 	if (ret == ERROR_SUCCESS) {
 		_driverNames.clear();
 		_deviceNames.clear();
 		for (ULONG i = 0; i < driverCount; ++i) {
 			PIRPMON_DRIVER_INFO dr = driverSnapshot[i];
 
-			_driverNames.insert(std::make_pair(dr->DriverObject, std::wstring(dr->DriverName)));
+			_driverNames.insert(std::make_pair(dr->DriverObject, _NameIntern(dr->DriverName, -1)));
 			for (ULONG j = 0; j < dr->DeviceCount; ++j) {
 				PIRPMON_DEVICE_INFO devr = dr->Devices[j];
 
-				_deviceNames.insert(std::make_pair(devr->DeviceObject, std::wstring(devr->Name)));
+				_deviceNames.insert(std::make_pair(devr->DeviceObject, _NameIntern(devr->Name, -1)));
 			}
 		}
 
 		IRPMonDllSnapshotFree(driverSnapshot, driverCount);
-		_deviceNames.insert(std::make_pair(nullptr, std::wstring(L"N/A")));
+		_deviceNames.insert(std::make_pair(nullptr, _NameIntern(L"N/A", -1)));
 	}
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
 }
 
+/** Adds objects detected since the last refresh or update to the maps. A new
+ *  name of an object replaces the old one, since the address may have been
+ *  reused. Falls back to the full refresh if the driver no longer remembers
+ *  all the changes.
+ */
+static DWORD _Update(VOID)
+{
+	PIRPMON_RECORD_BATCH changes = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+	ret = IRPMonDllObjectChangesGet(&_generation, &changes);
+	if (ret == ERROR_SUCCESS) {
+		for (ULONG i = 0; i < changes->Count; ++i) {
+			PREQUEST_HEADER h = changes->Records[i].Header;
+
+			switch (h->Type) {
+				case ertDriverDetected: {
+					PREQUEST_DRIVER_DETECTED r = CONTAINING_RECORD(h, REQUEST_DRIVER_DETECTED, Header);
+
+					_driverNames[h->Driver] = _NameIntern((wchar_t *)(r + 1), r->DriverNameLength / sizeof(wchar_t));
+				} break;
+				case ertDeviceDetected: {
+					PREQUEST_DEVICE_DETECTED r = CONTAINING_RECORD(h, REQUEST_DEVICE_DETECTED, Header);
+
+					_deviceNames[h->Device] = _NameIntern((wchar_t *)(r + 1), r->DeviceNameLength / sizeof(wchar_t));
+				} break;
+				default:
+					break;
+			}
+		}
+
+		IRPMonDllObjectChangesFree(changes);
+	} else if (ret == ERROR_NOT_FOUND)
+		ret = _Refresh();
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
 /************************************************************************/
 /*                           PUBLIC FUNCTIONS                           */
 /************************************************************************/
 
-std::wstring CacheDriverNameGet(PVOID DriverObject)
+/** Retrieves UTF-8 name of a driver object.
+ *
+ *  @return
+ *  Returns the name, or NULL if the object is not known. The string is valid
+ *  until the cache is finalized.
+ */
+const char *CacheDriverNameGet(PVOID DriverObject)
 {
-	std::wstring ret = L"";
+	const char *ret = NULL;
 
-	EnterCriticalSection(&_cacheLock);
+	AcquireSRWLockShared(&_cacheLock);
 	auto it = _driverNames.find(DriverObject);
 	if (it != _driverNames.cend())
 		ret = it->second;
-	else if (_Refresh() == ERROR_SUCCESS) {
+
+	ReleaseSRWLockShared(&_cacheLock);
+	if (ret == NULL) {
+		AcquireSRWLockExclusive(&_cacheLock);
 		it = _driverNames.find(DriverObject);
+		if (it == _driverNames.cend() && _Update() == ERROR_SUCCESS)
+			it = _driverNames.find(DriverObject);
+
 		if (it != _driverNames.cend())
 			ret = it->second;
-	}
 
-	LeaveCriticalSection(&_cacheLock);
+		ReleaseSRWLockExclusive(&_cacheLock);
+	}
 
 	return ret;
 }
 
-std::wstring CacheDeviceNameGet(PVOID DeviceObject)
+/** Retrieves UTF-8 name of a device object.
+ *
+ *  @return
+ *  Returns the name, or NULL if the object is not known. The string is valid
+ *  until the cache is finalized.
+ */
+const char *CacheDeviceNameGet(PVOID DeviceObject)
 {
-	std::wstring ret = L"";
+	const char *ret = NULL;
 
-	EnterCriticalSection(&_cacheLock);
+	AcquireSRWLockShared(&_cacheLock);
 	auto it = _deviceNames.find(DeviceObject);
 	if (it != _deviceNames.cend())
 		ret = it->second;
-	else if (_Refresh() == ERROR_SUCCESS) {
+
+	ReleaseSRWLockShared(&_cacheLock);
+	if (ret == NULL) {
+		AcquireSRWLockExclusive(&_cacheLock);
 		it = _deviceNames.find(DeviceObject);
+		if (it == _deviceNames.cend() && _Update() == ERROR_SUCCESS)
+			it = _deviceNames.find(DeviceObject);
+
 		if (it != _deviceNames.cend())
 			ret = it->second;
-	}
 
-	LeaveCriticalSection(&_cacheLock);
+		ReleaseSRWLockExclusive(&_cacheLock);
+	}
 
 	return ret;
 }
@@ -103,11 +191,8 @@ DWORD CacheInit(VOID)
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION_NO_ARGS();
 
-	if (InitializeCriticalSectionAndSpinCount(&_cacheLock, 0x1000)) {
-		ret = _Refresh();
-		if (ret != ERROR_SUCCESS)
-			DeleteCriticalSection(&_cacheLock);
-	} else ret = GetLastError();
+	InitializeSRWLock(&_cacheLock);
+	ret = _Refresh();
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
@@ -117,7 +202,7 @@ VOID CacheFinit(VOID)
 {
 	_driverNames.clear();
 	_deviceNames.clear();
-	DeleteCriticalSection(&_cacheLock);
+	_names.clear();
 
 	return;
 }
\ No newline at end of file
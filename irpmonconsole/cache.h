@@ -4,12 +4,11 @@
 
 
 
-#include <string>
 #include <windows.h>
 
 
-std::wstring CacheDeviceNameGet(PVOID DeviceObject);
-std::wstring CacheDriverNameGet(PVOID DriverObject);
+const char *CacheDeviceNameGet(PVOID DeviceObject);
+const char *CacheDriverNameGet(PVOID DriverObject);
 DWORD CacheInit(VOID);
 VOID CacheFinit(VOID);
 
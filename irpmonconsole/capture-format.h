@@ -0,0 +1,132 @@
+
+#ifndef __IRPMON_CAPTURE_FORMAT_H__
+#define __IRPMON_CAPTURE_FORMAT_H__
+
+#include <windows.h>
+
+
+/************************************************************************/
+/*                        CAPTURE FILE LAYOUT                           */
+/************************************************************************/
+
+/*
+ * A capture file consists of:
+ *
+ *   CAPTURE_FILE_HEADER
+ *   CAPTURE_SNAPSHOT_DRIVER, name, CAPTURE_SNAPSHOT_DEVICE, name, ... (DriverCount drivers)
+ *   CAPTURE_BLOCK_HEADER, block data                                  (repeated)
+ *   CAPTURE_BLOCK_INDEX array                                         (one per block)
+ *   CAPTURE_FILE_TRAILER
+ *
+ * Block data decompress to a sequence of CAPTURE_RECORD_ENTRY structures, each
+ * followed by one REQUEST_XXX record and aligned to CAPTURE_ALIGNMENT. The index
+ * and the trailer are written when the capture is closed; a file without them
+ * can still be read by walking the block headers.
+ *
+ * All structures are aligned to CAPTURE_ALIGNMENT, names are UTF-16 strings
+ * without the terminating null character, padded to CAPTURE_ALIGNMENT.
+ */
+
+#define CAPTURE_FILE_SIGNATURE				0x50414349		// "ICAP"
+#define CAPTURE_BLOCK_SIGNATURE				0x4b4c4249		// "IBLK"
+#define CAPTURE_TRAILER_SIGNATURE			0x58444e49		// "INDX"
+#define CAPTURE_FILE_VERSION				1
+
+#define CAPTURE_ALIGNMENT					sizeof(ULONG64)
+#define CaptureAlign(aValue)				(((aValue) + CAPTURE_ALIGNMENT - 1) & ~(CAPTURE_ALIGNMENT - 1))
+
+/** Number of record types counted by the block index. Records of other types
+    are counted in the erpUndefined slot. */
+#define CAPTURE_TYPE_COUNT					16
+
+typedef enum _ECaptureCompression {
+	ccNone,
+	/** The LZ4 block format. */
+	ccLZ4,
+} ECaptureCompression, *PECaptureCompression;
+
+typedef struct _CAPTURE_FILE_HEADER {
+	ULONG Signature;
+	ULONG Version;
+	/** Size of the header including the snapshot, in bytes. The first block
+	    starts at this offset. */
+	ULONG HeaderLength;
+	/** Size of a pointer in the records, in bytes (4 or 8). */
+	ULONG PointerSize;
+	/** Date and time the capture started (in 100 nanosecond units from
+	    January 1 1601). */
+	ULONG64 StartTime;
+	/** Maximum length of decompressed block data, in bytes. A block holding one
+	    record larger than this value may exceed it. */
+	ULONG MaxBlockLength;
+	/** Number of drivers in the snapshot. */
+	ULONG DriverCount;
+} CAPTURE_FILE_HEADER, *PCAPTURE_FILE_HEADER;
+
+typedef struct _CAPTURE_SNAPSHOT_DRIVER {
+	ULONG64 DriverObject;
+	/** Number of CAPTURE_SNAPSHOT_DEVICE structures following the name. */
+	ULONG DeviceCount;
+	/** Length of the name, in bytes. */
+	ULONG NameLength;
+	// WCHAR Name[]
+} CAPTURE_SNAPSHOT_DRIVER, *PCAPTURE_SNAPSHOT_DRIVER;
+
+typedef struct _CAPTURE_SNAPSHOT_DEVICE {
+	ULONG64 DeviceObject;
+	ULONG64 AttachedDevice;
+	/** Length of the name, in bytes. */
+	ULONG NameLength;
+	ULONG Reserved;
+	// WCHAR Name[]
+} CAPTURE_SNAPSHOT_DEVICE, *PCAPTURE_SNAPSHOT_DEVICE;
+
+/** Describes one block. Stored both in the block header and in the index at
+    the end of the file, so the records can be located and filtered without
+    decompressing the blocks. */
+typedef struct _CAPTURE_BLOCK_INDEX {
+	/** File offset of the CAPTURE_BLOCK_HEADER structure. */
+	ULONG64 Offset;
+	/** Length of the block data as stored in the file, in bytes. */
+	ULONG CompressedLength;
+	/** Length of the decompressed block data, in bytes. */
+	ULONG Length;
+	ULONG RecordCount;
+	/** Compression of the block data (ECaptureCompression). */
+	ULONG Compression;
+	/** ID (sequence number) of the first record. */
+	ULONG FirstId;
+	/** ID of the last record. */
+	ULONG LastId;
+	/** The lowest and the highest record time within the block. */
+	LONG64 FirstTime;
+	LONG64 LastTime;
+	/** Number of records of each type (ERequesttype). */
+	ULONG TypeCounts[CAPTURE_TYPE_COUNT];
+} CAPTURE_BLOCK_INDEX, *PCAPTURE_BLOCK_INDEX;
+
+typedef struct _CAPTURE_BLOCK_HEADER {
+	ULONG Signature;
+	ULONG Reserved;
+	CAPTURE_BLOCK_INDEX Index;
+	// Block data
+} CAPTURE_BLOCK_HEADER, *PCAPTURE_BLOCK_HEADER;
+
+typedef struct _CAPTURE_RECORD_ENTRY {
+	/** Size of the record following this structure, in bytes. */
+	ULONG Size;
+	ULONG Reserved;
+	// REQUEST_XXX
+} CAPTURE_RECORD_ENTRY, *PCAPTURE_RECORD_ENTRY;
+
+/** Occupies the last bytes of a completely written capture file. */
+typedef struct _CAPTURE_FILE_TRAILER {
+	/** File offset of the CAPTURE_BLOCK_INDEX array. */
+	ULONG64 IndexOffset;
+	ULONG BlockCount;
+	ULONG Signature;
+} CAPTURE_FILE_TRAILER, *PCAPTURE_FILE_TRAILER;
+
+
+
+#endif
@@ -0,0 +1,427 @@
+
+/**
+ * @file
+ *
+ * Writes records into a capture file (see capture-format.h).
+ *
+ * Records are appended to the active block buffer by the thread delivering
+ * them. A full buffer is handed to the writer thread that compresses it and
+ * writes it by a single call, while the other buffer is being filled. If the
+ * writer falls behind, the delivering thread waits and the records stay in
+ * the IRPMon Event Queue.
+ */
+
+#include <vector>
+#include <string.h>
+#include <windows.h>
+#include "debug.h"
+#include "irpmondll-types.h"
+#include "irpmondll.h"
+#include "lz4-block.h"
+#include "capture-format.h"
+#include "capture.h"
+
+
+
+/************************************************************************/
+/*                           TYPE DEFINITIONS                           */
+/************************************************************************/
+
+typedef struct _CAPTURE_BUFFER {
+	CAPTURE_BLOCK_INDEX Index;
+	PUCHAR Data;
+	ULONG Capacity;
+} CAPTURE_BUFFER, *PCAPTURE_BUFFER;
+
+
+/************************************************************************/
+/*                           GLOBAL VARIABLES                           */
+/************************************************************************/
+
+static HANDLE _captureFile = INVALID_HANDLE_VALUE;
+static ULONG64 _fileOffset = 0;
+static ULONG _maxBlockLength = 0;
+static CAPTURE_BUFFER _buffers[2];
+/** Buffer receiving new records. */
+static PCAPTURE_BUFFER _activeBuffer = NULL;
+/** Buffer handed to the writer thread. */
+static PCAPTURE_BUFFER _pendingBuffer = NULL;
+/** Signaled when the pending buffer is set or the writer should terminate. */
+static HANDLE _blockReadyEvent = NULL;
+/** Signaled when the writer has no pending buffer. */
+static HANDLE _writerIdleEvent = NULL;
+static HANDLE _writerThread = NULL;
+static volatile BOOLEAN _writerTerminate = FALSE;
+/** The first error the writer has encountered. */
+static DWORD _writerError = ERROR_SUCCESS;
+/** Block header followed by the compressed data, owned by the writer. */
+static PUCHAR _writeBuffer = NULL;
+static ULONG _writeBufferSize = 0;
+static std::vector<CAPTURE_BLOCK_INDEX> _blockIndex;
+static CAPTURE_STATISTICS _statistics;
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+static DWORD _FileWrite(const void *Buffer, ULONG Length)
+{
+	DWORD bytesWritten = 0;
+	const UCHAR *data = (const UCHAR *)Buffer;
+	DWORD ret = ERROR_SUCCESS;
+
+	while (ret == ERROR_SUCCESS && Length > 0) {
+		if (WriteFile(_captureFile, data, Length, &bytesWritten, NULL)) {
+			data += bytesWritten;
+			Length -= bytesWritten;
+			_fileOffset += bytesWritten;
+		} else ret = GetLastError();
+	}
+
+	return ret;
+}
+
+
+static DWORD _BufferReserve(PUCHAR *Buffer, PULONG Capacity, ULONG Length)
+{
+	PUCHAR tmp = NULL;
+	DWORD ret = ERROR_SUCCESS;
+
+	if (*Capacity < Length) {
+		if (*Buffer != NULL)
+			tmp = (PUCHAR)HeapReAlloc(GetProcessHeap(), 0, *Buffer, Length);
+		else tmp = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, Length);
+
+		if (tmp != NULL) {
+			*Buffer = tmp;
+			*Capacity = Length;
+		} else ret = ERROR_NOT_ENOUGH_MEMORY;
+	}
+
+	return ret;
+}
+
+
+/** Compresses a block and writes it to the file. Called by the writer thread. */
+static DWORD _BlockWrite(PCAPTURE_BUFFER Buffer)
+{
+	ULONG dataLength = 0;
+	ULONG paddedLength = 0;
+	PCAPTURE_BLOCK_HEADER header = NULL;
+	PUCHAR data = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Buffer=0x%p", Buffer);
+
+	ret = _BufferReserve(&_writeBuffer, &_writeBufferSize, sizeof(CAPTURE_BLOCK_HEADER) + (ULONG)CaptureAlign(LZ4BlockCompressBound(Buffer->Index.Length)));
+	if (ret == ERROR_SUCCESS) {
+		header = (PCAPTURE_BLOCK_HEADER)_writeBuffer;
+		data = (PUCHAR)(header + 1);
+		header->Signature = CAPTURE_BLOCK_SIGNATURE;
+		header->Reserved = 0;
+		header->Index = Buffer->Index;
+		header->Index.Offset = _fileOffset;
+		header->Index.Compression = ccLZ4;
+		ret = LZ4BlockCompress(Buffer->Data, Buffer->Index.Length, data, Buffer->Index.Length, &dataLength);
+		if (ret != ERROR_SUCCESS) {
+			header->Index.Compression = ccNone;
+			dataLength = Buffer->Index.Length;
+			memcpy(data, Buffer->Data, dataLength);
+			ret = ERROR_SUCCESS;
+		}
+
+		header->Index.CompressedLength = dataLength;
+		paddedLength = (ULONG)CaptureAlign(dataLength);
+		memset(data + dataLength, 0, paddedLength - dataLength);
+		ret = _FileWrite(header, sizeof(CAPTURE_BLOCK_HEADER) + paddedLength);
+		if (ret == ERROR_SUCCESS) {
+			_blockIndex.push_back(header->Index);
+			++_statistics.BlockCount;
+			_statistics.RecordCount += header->Index.RecordCount;
+			_statistics.Length += header->Index.Length;
+			_statistics.CompressedLength += dataLength;
+		}
+	}
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+static DWORD WINAPI _WriterThreadRoutine(PVOID Context)
+{
+	BOOLEAN terminate = FALSE;
+	DEBUG_ENTER_FUNCTION("Context=0x%p", Context);
+
+	do {
+		WaitForSingleObject(_blockReadyEvent, INFINITE);
+		terminate = _writerTerminate;
+		if (_pendingBuffer != NULL) {
+			if (_writerError == ERROR_SUCCESS)
+				_writerError = _BlockWrite(_pendingBuffer);
+
+			_pendingBuffer = NULL;
+			SetEvent(_writerIdleEvent);
+		}
+	} while (!terminate);
+
+	DEBUG_EXIT_FUNCTION("%u", _writerError);
+	return _writerError;
+}
+
+
+/** Hands the active buffer to the writer thread and makes the other buffer active.
+ *  Waits until the writer finishes the previous block.
+ *
+ *  @return
+ *  Returns the first error the writer has encountered.
+ */
+static DWORD _BlockSubmit(VOID)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+	WaitForSingleObject(_writerIdleEvent, INFINITE);
+	ret = _writerError;
+	_pendingBuffer = _activeBuffer;
+	SetEvent(_blockReadyEvent);
+	_activeBuffer = (_activeBuffer == &_buffers[0]) ? &_buffers[1] : &_buffers[0];
+	memset(&_activeBuffer->Index, 0, sizeof(_activeBuffer->Index));
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+/** Writes the file header followed by names of the drivers and devices
+ *  currently present in the system. */
+static DWORD _HeaderWrite(VOID)
+{
+	ULONG driverCount = 0;
+	PIRPMON_DRIVER_INFO *drivers = NULL;
+	std::vector<UCHAR> header;
+	PCAPTURE_FILE_HEADER fileHeader = NULL;
+	FILETIME startTime;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+	ret = IRPMonDllSnapshotRetrieve(&drivers, &driverCount);
+	if (ret == ERROR_SUCCESS) {
+		SIZE_T length = sizeof(CAPTURE_FILE_HEADER);
+
+		for (ULONG i = 0; i < driverCount; ++i) {
+			length += CaptureAlign(sizeof(CAPTURE_SNAPSHOT_DRIVER) + wcslen(drivers[i]->DriverName)*sizeof(WCHAR));
+			for (ULONG j = 0; j < drivers[i]->DeviceCount; ++j)
+				length += CaptureAlign(sizeof(CAPTURE_SNAPSHOT_DEVICE) + wcslen(drivers[i]->Devices[j]->Name)*sizeof(WCHAR));
+		}
+
+		header.resize(length);
+		fileHeader = (PCAPTURE_FILE_HEADER)&header[0];
+		GetSystemTimeAsFileTime(&startTime);
+		fileHeader->Signature = CAPTURE_FILE_SIGNATURE;
+		fileHeader->Version = CAPTURE_FILE_VERSION;
+		fileHeader->HeaderLength = (ULONG)length;
+		fileHeader->PointerSize = sizeof(PVOID);
+		fileHeader->StartTime = ((ULONG64)startTime.dwHighDateTime << 32) + startTime.dwLowDateTime;
+		fileHeader->MaxBlockLength = _maxBlockLength;
+		fileHeader->DriverCount = driverCount;
+		length = sizeof(CAPTURE_FILE_HEADER);
+		for (ULONG i = 0; i < driverCount; ++i) {
+			PIRPMON_DRIVER_INFO dr = drivers[i];
+			PCAPTURE_SNAPSHOT_DRIVER driverEntry = (PCAPTURE_SNAPSHOT_DRIVER)&header[length];
+
+			driverEntry->DriverObject = (ULONG_PTR)dr->DriverObject;
+			driverEntry->DeviceCount = dr->DeviceCount;
+			driverEntry->NameLength = (ULONG)wcslen(dr->DriverName)*sizeof(WCHAR);
+			memcpy(driverEntry + 1, dr->DriverName, driverEntry->NameLength);
+			length += CaptureAlign(sizeof(CAPTURE_SNAPSHOT_DRIVER) + driverEntry->NameLength);
+			for (ULONG j = 0; j < dr->DeviceCount; ++j) {
+				PIRPMON_DEVICE_INFO devr = dr->Devices[j];
+				PCAPTURE_SNAPSHOT_DEVICE deviceEntry = (PCAPTURE_SNAPSHOT_DEVICE)&header[length];
+
+				deviceEntry->DeviceObject = (ULONG_PTR)devr->DeviceObject;
+				deviceEntry->AttachedDevice = (ULONG_PTR)devr->AttachedDevice;
+				deviceEntry->NameLength = (ULONG)wcslen(devr->Name)*sizeof(WCHAR);
+				memcpy(deviceEntry + 1, devr->Name, deviceEntry->NameLength);
+				length += CaptureAlign(sizeof(CAPTURE_SNAPSHOT_DEVICE) + deviceEntry->NameLength);
+			}
+		}
+
+		IRPMonDllSnapshotFree(drivers, driverCount);
+		ret = _FileWrite(&header[0], (ULONG)header.size());
+	}
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+/************************************************************************/
+/*                           PUBLIC FUNCTIONS                           */
+/************************************************************************/
+
+/** Appends one record to the capture. Must be called from one thread at a time.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or an error that prevented writing of the capture.
+ */
+DWORD CaptureRecord(PREQUEST_HEADER Header, ULONG Size)
+{
+	ULONG entryLength = 0;
+	PCAPTURE_RECORD_ENTRY entry = NULL;
+	PCAPTURE_BLOCK_INDEX index = &_activeBuffer->Index;
+	ULONG type = Header->Type;
+	DWORD ret = ERROR_SUCCESS;
+
+	entryLength = (ULONG)CaptureAlign(sizeof(CAPTURE_RECORD_ENTRY) + Size);
+	if (index->RecordCount > 0 && index->Length + entryLength > _maxBlockLength) {
+		ret = _BlockSubmit();
+		index = &_activeBuffer->Index;
+	}
+
+	if (ret == ERROR_SUCCESS)
+		ret = _BufferReserve(&_activeBuffer->Data, &_activeBuffer->Capacity, index->Length + entryLength);
+
+	if (ret == ERROR_SUCCESS) {
+		entry = (PCAPTURE_RECORD_ENTRY)(_activeBuffer->Data + index->Length);
+		entry->Size = Size;
+		entry->Reserved = 0;
+		memcpy(entry + 1, Header, Size);
+		memset((PUCHAR)(entry + 1) + Size, 0, entryLength - sizeof(CAPTURE_RECORD_ENTRY) - Size);
+		if (index->RecordCount == 0) {
+			index->FirstId = Header->Id;
+			index->FirstTime = Header->Time.QuadPart;
+			index->LastTime = Header->Time.QuadPart;
+		}
+
+		if (index->FirstTime > Header->Time.QuadPart)
+			index->FirstTime = Header->Time.QuadPart;
+
+		if (index->LastTime < Header->Time.QuadPart)
+			index->LastTime = Header->Time.QuadPart;
+
+		index->LastId = Header->Id;
+		++index->TypeCounts[(type < CAPTURE_TYPE_COUNT) ? type : erpUndefined];
+		++index->RecordCount;
+		index->Length += entryLength;
+	}
+
+	return ret;
+}
+
+
+DWORD CaptureInit(PWCHAR FileName, ULONG MaxBlockLength)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("FileName=\"%S\"; MaxBlockLength=%u", FileName, MaxBlockLength);
+
+	_maxBlockLength = MaxBlockLength;
+	_fileOffset = 0;
+	_writerError = ERROR_SUCCESS;
+	_writerTerminate = FALSE;
+	_pendingBuffer = NULL;
+	_activeBuffer = &_buffers[0];
+	memset(_buffers, 0, sizeof(_buffers));
+	memset(&_statistics, 0, sizeof(_statistics));
+	_blockIndex.clear();
+	ret = _BufferReserve(&_buffers[0].Data, &_buffers[0].Capacity, MaxBlockLength);
+	if (ret == ERROR_SUCCESS)
+		ret = _BufferReserve(&_buffers[1].Data, &_buffers[1].Capacity, MaxBlockLength);
+
+	if (ret == ERROR_SUCCESS) {
+		_captureFile = CreateFileW(FileName, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (_captureFile != INVALID_HANDLE_VALUE) {
+			ret = _HeaderWrite();
+			if (ret == ERROR_SUCCESS) {
+				_blockReadyEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+				if (_blockReadyEvent != NULL) {
+					_writerIdleEvent = CreateEventW(NULL, FALSE, TRUE, NULL);
+					if (_writerIdleEvent != NULL) {
+						_writerThread = CreateThread(NULL, 0, _WriterThreadRoutine, NULL, 0, NULL);
+						if (_writerThread == NULL) {
+							ret = GetLastError();
+							CloseHandle(_writerIdleEvent);
+						}
+					} else ret = GetLastError();
+
+					if (ret != ERROR_SUCCESS)
+						CloseHandle(_blockReadyEvent);
+				} else ret = GetLastError();
+			}
+
+			if (ret != ERROR_SUCCESS) {
+				CloseHandle(_captureFile);
+				_captureFile = INVALID_HANDLE_VALUE;
+				DeleteFileW(FileName);
+			}
+		} else ret = GetLastError();
+	}
+
+	if (ret != ERROR_SUCCESS) {
+		for (size_t i = 0; i < sizeof(_buffers) / sizeof(_buffers[0]); ++i) {
+			if (_buffers[i].Data != NULL)
+				HeapFree(GetProcessHeap(), 0, _buffers[i].Data);
+		}
+
+		memset(_buffers, 0, sizeof(_buffers));
+	}
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+/** Writes the remaining records and the block index, and closes the capture file.
+ *
+ *  @param Statistics Receives the amount of data written. May be NULL.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or the first error encountered while writing the capture.
+ */
+DWORD CaptureFinit(PCAPTURE_STATISTICS Statistics)
+{
+	CAPTURE_FILE_TRAILER trailer;
+	DWORD ret = ERROR_SUCCESS;
+	DEBUG_ENTER_FUNCTION("Statistics=0x%p", Statistics);
+
+	if (_activeBuffer->Index.RecordCount > 0)
+		_BlockSubmit();
+
+	WaitForSingleObject(_writerIdleEvent, INFINITE);
+	_writerTerminate = TRUE;
+	SetEvent(_blockReadyEvent);
+	WaitForSingleObject(_writerThread, INFINITE);
+	CloseHandle(_writerThread);
+	CloseHandle(_writerIdleEvent);
+	CloseHandle(_blockReadyEvent);
+	ret = _writerError;
+	if (ret == ERROR_SUCCESS) {
+		trailer.IndexOffset = _fileOffset;
+		trailer.BlockCount = (ULONG)_blockIndex.size();
+		trailer.Signature = CAPTURE_TRAILER_SIGNATURE;
+		if (_blockIndex.size() > 0)
+			ret = _FileWrite(&_blockIndex[0], (ULONG)(_blockIndex.size()*sizeof(CAPTURE_BLOCK_INDEX)));
+
+		if (ret == ERROR_SUCCESS)
+			ret = _FileWrite(&trailer, sizeof(trailer));
+	}
+
+	CloseHandle(_captureFile);
+	_captureFile = INVALID_HANDLE_VALUE;
+	_blockIndex.clear();
+	if (_writeBuffer != NULL) {
+		HeapFree(GetProcessHeap(), 0, _writeBuffer);
+		_writeBuffer = NULL;
+		_writeBufferSize = 0;
+	}
+
+	for (size_t i = 0; i < sizeof(_buffers) / sizeof(_buffers[0]); ++i)
+		HeapFree(GetProcessHeap(), 0, _buffers[i].Data);
+
+	memset(_buffers, 0, sizeof(_buffers));
+	if (Statistics != NULL)
+		*Statistics = _statistics;
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
@@ -0,0 +1,29 @@
+
+#ifndef __IRPMON_CAPTURE_H__
+#define __IRPMON_CAPTURE_H__
+
+#include <windows.h>
+#include "general-types.h"
+
+
+/** Default maximum length of decompressed block data, in bytes. */
+#define CAPTURE_BLOCK_LENGTH_DEFAULT			(1024*1024)
+
+
+typedef struct _CAPTURE_STATISTICS {
+	ULONG64 RecordCount;
+	ULONG64 BlockCount;
+	/** Length of the decompressed block data, in bytes. */
+	ULONG64 Length;
+	/** Length of the block data written to the file, in bytes. */
+	ULONG64 CompressedLength;
+} CAPTURE_STATISTICS, *PCAPTURE_STATISTICS;
+
+
+DWORD CaptureRecord(PREQUEST_HEADER Header, ULONG Size);
+DWORD CaptureInit(PWCHAR FileName, ULONG MaxBlockLength);
+DWORD CaptureFinit(PCAPTURE_STATISTICS Statistics);
+
+
+
+#endif
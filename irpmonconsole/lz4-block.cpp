@@ -0,0 +1,246 @@
+
+/**
+ * @file
+ *
+ * Compression and decompression of the LZ4 block format. The code is
+ * self-contained so capture files can be read on any platform.
+ */
+
+#include <string.h>
+#include <windows.h>
+#include "lz4-block.h"
+
+
+
+/************************************************************************/
+/*                           MACRO DEFINITIONS                          */
+/************************************************************************/
+
+#define LZ4_MIN_MATCH				4
+/** The last literals of a block are never covered by a match. */
+#define LZ4_LAST_LITERALS			5
+/** A match must start at least this number of bytes before the end of the block. */
+#define LZ4_MATCH_LIMIT				12
+#define LZ4_MAX_OFFSET				0xffff
+#define LZ4_HASH_BITS				12
+
+#define _LZ4Read32(aPointer)		((ULONG)(aPointer)[0] | ((ULONG)(aPointer)[1] << 8) | ((ULONG)(aPointer)[2] << 16) | ((ULONG)(aPointer)[3] << 24))
+#define _LZ4Hash(aValue)			(((aValue)*2654435761U) >> (32 - LZ4_HASH_BITS))
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+static PUCHAR _WriteLength(PUCHAR Output, ULONG Length)
+{
+	while (Length >= 255) {
+		*Output++ = 255;
+		Length -= 255;
+	}
+
+	*Output++ = (UCHAR)Length;
+
+	return Output;
+}
+
+
+static BOOLEAN _ReadLength(const UCHAR **Input, const UCHAR *End, PULONG Length)
+{
+	UCHAR b = 255;
+	BOOLEAN ret = TRUE;
+
+	while (ret && b == 255) {
+		ret = (*Input < End);
+		if (ret) {
+			b = **Input;
+			++*Input;
+			*Length += b;
+		}
+	}
+
+	return ret;
+}
+
+
+/** Appends one sequence (literals and a match) to the output.
+ *
+ *  @return
+ *  Returns the new end of the output, or NULL if the sequence does not fit.
+ */
+static PUCHAR _WriteSequence(PUCHAR Output, const UCHAR *OutputEnd, const UCHAR *Literals, ULONG LiteralLength, ULONG Offset, ULONG MatchLength)
+{
+	PUCHAR token = Output;
+	PUCHAR ret = NULL;
+
+	if ((ULONG_PTR)(OutputEnd - Output) >= 1 + LiteralLength / 255 + 1 + LiteralLength + 2 + MatchLength / 255 + 1) {
+		ret = Output + 1;
+		if (LiteralLength >= 15) {
+			*token = 15 << 4;
+			ret = _WriteLength(ret, LiteralLength - 15);
+		} else *token = (UCHAR)(LiteralLength << 4);
+
+		memcpy(ret, Literals, LiteralLength);
+		ret += LiteralLength;
+		if (MatchLength > 0) {
+			*ret++ = (UCHAR)Offset;
+			*ret++ = (UCHAR)(Offset >> 8);
+			MatchLength -= LZ4_MIN_MATCH;
+			if (MatchLength >= 15) {
+				*token |= 15;
+				ret = _WriteLength(ret, MatchLength - 15);
+			} else *token |= (UCHAR)MatchLength;
+		}
+	}
+
+	return ret;
+}
+
+
+/************************************************************************/
+/*                           PUBLIC FUNCTIONS                           */
+/************************************************************************/
+
+/** Compresses a memory block into the LZ4 block format.
+ *
+ *  @param Source Data to compress.
+ *  @param Length Length of the data, in bytes.
+ *  @param Destination Receives the compressed data.
+ *  @param DestinationLength Size of the destination, in bytes. The compression
+ *  cannot fail if the size is at least LZ4BlockCompressBound(Length).
+ *  @param CompressedLength Receives length of the compressed data, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INSUFFICIENT_BUFFER if the compressed data do
+ *  not fit into the destination.
+ */
+DWORD LZ4BlockCompress(const void *Source, ULONG Length, void *Destination, ULONG DestinationLength, PULONG CompressedLength)
+{
+	ULONG table[1 << LZ4_HASH_BITS];
+	const UCHAR *src = (const UCHAR *)Source;
+	const UCHAR *ip = src;
+	const UCHAR *anchor = src;
+	const UCHAR *end = src + Length;
+	PUCHAR op = (PUCHAR)Destination;
+	const UCHAR *opEnd = op + DestinationLength;
+	DWORD ret = ERROR_SUCCESS;
+
+	memset(table, 0xff, sizeof(table));
+	if (Length > LZ4_MATCH_LIMIT) {
+		const UCHAR *matchStartLimit = end - LZ4_MATCH_LIMIT;
+		const UCHAR *matchEndLimit = end - LZ4_LAST_LITERALS;
+
+		while (op != NULL && ip < matchStartLimit) {
+			ULONG value = _LZ4Read32(ip);
+			ULONG hash = _LZ4Hash(value);
+			ULONG candidate = table[hash];
+
+			table[hash] = (ULONG)(ip - src);
+			if (candidate != 0xffffffff && (ULONG)(ip - src) - candidate <= LZ4_MAX_OFFSET && _LZ4Read32(src + candidate) == value) {
+				const UCHAR *ref = src + candidate;
+				ULONG matchLength = LZ4_MIN_MATCH;
+
+				while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+					--ip;
+					--ref;
+					++matchLength;
+				}
+
+				while (ip + matchLength < matchEndLimit && ip[matchLength] == ref[matchLength])
+					++matchLength;
+
+				op = _WriteSequence(op, opEnd, anchor, (ULONG)(ip - anchor), (ULONG)(ip - ref), matchLength);
+				ip += matchLength;
+				anchor = ip;
+			} else ip += 1 + ((ip - anchor) >> 6);
+		}
+	}
+
+	if (op != NULL)
+		op = _WriteSequence(op, opEnd, anchor, (ULONG)(end - anchor), 0, 0);
+
+	if (op != NULL)
+		*CompressedLength = (ULONG)(op - (PUCHAR)Destination);
+	else ret = ERROR_INSUFFICIENT_BUFFER;
+
+	return ret;
+}
+
+
+/** Decompresses data in the LZ4 block format.
+ *
+ *  @param Source The compressed data.
+ *  @param Length Length of the compressed data, in bytes.
+ *  @param Destination Receives the decompressed data.
+ *  @param DestinationLength Size of the destination, in bytes.
+ *  @param DecompressedLength Receives length of the decompressed data, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INVALID_DATA if the data are malformed or do
+ *  not fit into the destination.
+ */
+DWORD LZ4BlockDecompress(const void *Source, ULONG Length, void *Destination, ULONG DestinationLength, PULONG DecompressedLength)
+{
+	const UCHAR *ip = (const UCHAR *)Source;
+	const UCHAR *end = ip + Length;
+	PUCHAR op = (PUCHAR)Destination;
+	PUCHAR opEnd = op + DestinationLength;
+	DWORD ret = ERROR_SUCCESS;
+
+	while (ret == ERROR_SUCCESS && ip < end) {
+		UCHAR token = *ip++;
+		ULONG literalLength = token >> 4;
+		ULONG matchLength = token & 0xf;
+		ULONG offset = 0;
+
+		if (literalLength == 15 && !_ReadLength(&ip, end, &literalLength))
+			ret = ERROR_INVALID_DATA;
+
+		if (ret == ERROR_SUCCESS &&
+			((ULONG_PTR)(end - ip) < literalLength || (ULONG_PTR)(opEnd - op) < literalLength))
+			ret = ERROR_INVALID_DATA;
+
+		if (ret != ERROR_SUCCESS)
+			break;
+
+		memcpy(op, ip, literalLength);
+		ip += literalLength;
+		op += literalLength;
+		if (ip == end)
+			break;
+
+		if (end - ip < 2) {
+			ret = ERROR_INVALID_DATA;
+			break;
+		}
+
+		offset = ip[0] | ((ULONG)ip[1] << 8);
+		ip += 2;
+		if (matchLength == 15 && !_ReadLength(&ip, end, &matchLength))
+			ret = ERROR_INVALID_DATA;
+
+		matchLength += LZ4_MIN_MATCH;
+		if (ret == ERROR_SUCCESS &&
+			(offset == 0 || (ULONG_PTR)(op - (PUCHAR)Destination) < offset || (ULONG_PTR)(opEnd - op) < matchLength))
+			ret = ERROR_INVALID_DATA;
+
+		if (ret == ERROR_SUCCESS) {
+			const UCHAR *ref = op - offset;
+
+			if (offset >= matchLength) {
+				memcpy(op, ref, matchLength);
+				op += matchLength;
+			} else {
+				while (matchLength > 0) {
+					*op++ = *ref++;
+					--matchLength;
+				}
+			}
+		}
+	}
+
+	if (ret == ERROR_SUCCESS)
+		*DecompressedLength = (ULONG)(op - (PUCHAR)Destination);
+
+	return ret;
+}
@@ -0,0 +1,17 @@
+
+#ifndef __IRPMON_LZ4_BLOCK_H__
+#define __IRPMON_LZ4_BLOCK_H__
+
+#include <windows.h>
+
+
+/** Maximum size of data compressed from Length bytes. */
+#define LZ4BlockCompressBound(aLength)			((aLength) + (aLength) / 255 + 16)
+
+
+DWORD LZ4BlockCompress(const void *Source, ULONG Length, void *Destination, ULONG DestinationLength, PULONG CompressedLength);
+DWORD LZ4BlockDecompress(const void *Source, ULONG Length, void *Destination, ULONG DestinationLength, PULONG DecompressedLength);
+
+
+
+#endif
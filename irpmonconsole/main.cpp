@@ -10,14 +10,35 @@
 #include "irpmondll.h"
 #include "install.h"
 #include "cache.h"
+#include "capture.h"
+#include "monitor.h"
 #include "libtranslate.h"
 #include "main.h"
 
 
+/************************************************************************/
+/*                   GLOBAL VARIABLES                                   */
+/************************************************************************/
+
+/** Signaled when the monitoring should stop. */
+static HANDLE _stopEvent = NULL;
+
 /************************************************************************/
 /*                   HELPER FUNCTIONS                                   */
 /************************************************************************/
 
+static BOOL WINAPI _ConsoleCtrlHandler(DWORD CtrlType)
+{
+	BOOL ret = FALSE;
+
+	if (CtrlType == CTRL_C_EVENT || CtrlType == CTRL_BREAK_EVENT) {
+		SetEvent(_stopEvent);
+		ret = TRUE;
+	}
+
+	return ret;
+}
+
 static BOOLEAN StringToPointer(PWCHAR String, PVOID *Pointer)
 {
 	BOOLEAN ret = FALSE;
@@ -52,480 +73,6 @@ static BOOLEAN StringToPointer(PWCHAR String, PVOID *Pointer)
 	return ret;
 }
 
-/************************************************************************/
-/*                  PRINTING                                            */
-/************************************************************************/
-
-static std::wstring Ptr2Hex(PVOID Value)
-{
-	WCHAR buf[19];
-
-	swprintf(buf, 19, L"0x%p", Value);
-
-	return buf;
-}
-
-static std::wstring UInt642Hex(ULONG64 Value)
-{
-	WCHAR buf[19];
-
-	swprintf(buf, 19, L"0x%x", Value);
-
-	return buf;
-}
-
-static std::wstring _FastIoTypeToString(EFastIoOperationType Type)
-{
-	std::wstring res;
-	PWCHAR _fastIoTypes[] = {
-		L"FastIoCheckIfPossible",
-		L"FastIoRead",
-		L"FastIoWrite",
-		L"FastIoQueryBasicInfo",
-		L"FastIoQueryStandardInfo",
-		L"FastIoLock",
-		L"FastIoUnlockSingle",
-		L"FastIoUnlockAll",
-		L"FastIoUnlockAllByKey",
-		L"FastIoDeviceControl",
-		L"AcquireFileForNtCreateSection",
-		L"ReleaseFileForNtCreateSection",
-		L"FastIoDetachDevice",
-		L"FastIoQueryNetworkOpenInfo",
-		L"AcquireForModWrite",
-		L"MdlRead",
-		L"MdlReadComplete",
-		L"PrepareMdlWrite",
-		L"MdlWriteComplete",
-		L"FastIoReadCompressed",
-		L"FastIoWriteCompressed",
-		L"MdlReadCompleteCompressed",
-		L"MdlWriteCompleteCompressed",
-		L"FastIoQueryOpen",
-		L"ReleaseForModWrite",
-		L"AcquireForCcFlush",
-		L"ReleaseForCcFlush"};
-	
-	if ((ULONG)Type < FastIoMax)
-		res = _fastIoTypes[Type];
-	else res = L"<nknown> (" + std::to_wstring(Type) + L")";
-
-	return res;
-}
-
-static std::wstring _AccessModeToString(ULONG AccessMode)
-{
-	std::wstring res;
-	PWCHAR modes [] = {L"KernelMode", L"UserMode"};
-
-	if (AccessMode < sizeof(modes) / sizeof(PWCHAR))
-		res = modes[AccessMode];
-	else res = L"<unknown> (" + std::to_wstring(AccessMode) + L")";
-
-	return res;
-}
-
-std::wstring GetRequestResult(PREQUEST_HEADER h)
-{
-	std::wstring res;
-
-	switch (h->ResultType) {
-		case rrtNTSTATUS:
-			res = LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, h->Result.NTSTATUSValue);
-			break;
-		case rrtBOOLEAN:
-			res = (h->Result.BOOLEANValue) ? L"TRUE" : L"FALSE";
-			break;
-		default:
-			res = L"None";
-			break;
-	}
-
-	return res;
-}
-
-static void _ParseIRPParameters(UCHAR MajorFunction, UCHAR MinorFunction, PVOID Arg1, PVOID Arg2, PVOID Arg3, PVOID Arg4, std::wstring & minor, std::vector<std::pair<std::wstring, std::wstring>> & args)
-{
-	PWCHAR wMinor = NULL;
-	minor = std::to_wstring(MinorFunction);
-
-	switch (MajorFunction) {
-		case IRP_MJ_CREATE:
-			args.push_back(std::make_pair(L"Security context", Ptr2Hex(Arg1)));
-			args.push_back(std::make_pair(L"Options", Ptr2Hex(Arg2)));
-			args.push_back(std::make_pair(L"File attributes", Ptr2Hex(Arg3)));
-			args.push_back(std::make_pair(L"EA length", std::to_wstring((ULONG)Arg4)));
-			break;
-		case IRP_MJ_READ:
-		case IRP_MJ_WRITE: {
-			wMinor = LibTranslateBitMaskValueToString(((MajorFunction == IRP_MJ_READ) ? ltbtIRPReadMinorFunction : ltbtIRPWriteMinorFunction), FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			LibTranslateBitMaskValueStringFree(wMinor);
-			args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)Arg1)));
-			args.push_back(std::make_pair(L"Key", std::to_wstring((ULONG)Arg2)));
-			std::wstring byteOffsetStr;
-			if (sizeof(PVOID) == 8)
-				byteOffsetStr = UInt642Hex((ULONG64)Arg3 + ((ULONG64)Arg4 << 32));
-			else byteOffsetStr = UInt642Hex((ULONG64)Arg3);
-
-			args.push_back(std::make_pair(L"Byte offset", byteOffsetStr));
-		} break;
-		case IRP_MJ_QUERY_INFORMATION:
-			args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)Arg1)));
-			args.push_back(std::make_pair(L"File information class", LibTranslateEnumerationValueToString(ltetFileInformationClass, FALSE, (ULONG)Arg2)));
-			break;
-		case IRP_MJ_SET_INFORMATION:
-			args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)Arg1)));
-			args.push_back(std::make_pair(L"File information class", LibTranslateEnumerationValueToString(ltetFileInformationClass, FALSE, (ULONG)Arg2)));
-			break;
-		case IRP_MJ_QUERY_VOLUME_INFORMATION:
-			args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)Arg1)));
-			args.push_back(std::make_pair(L"Volume information class", LibTranslateEnumerationValueToString(ltetFileVolumeInformationClass, FALSE, (ULONG)Arg2)));
-			break;
-		case IRP_MJ_DIRECTORY_CONTROL:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPDirectoryMinorFunction, FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			break;
-		case IRP_MJ_FILE_SYSTEM_CONTROL:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPFileSystemMinorFunction, FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			if (MinorFunction == 1 || MinorFunction == 2) {
-				args.push_back(std::make_pair(L"Device object", Ptr2Hex(Arg2)));
-			} else if (MinorFunction == 0 || MinorFunction == 4) {
-				args.push_back(std::make_pair(L"Output buffer length", std::to_wstring((ULONG)Arg1)));
-				args.push_back(std::make_pair(L"Input buffer length", std::to_wstring((ULONG)Arg2)));
-				args.push_back(std::make_pair(L"FSCTL", UInt642Hex((ULONG)Arg3)));
-				args.push_back(std::make_pair(L"Type3InputBuffer", Ptr2Hex(Arg4)));
-			}
-
-			break;
-		case IRP_MJ_PNP:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPPnPMinorFunction, FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			switch (MinorFunction) {
-				case 0x7:
-					args.push_back(std::make_pair(L"Device relation type", std::to_wstring((ULONG)Arg1)));
-					break;
-				case 0x0C:
-					args.push_back(std::make_pair(L"Device text type", std::to_wstring((ULONG)Arg1)));
-					break;
-				case 0x12:
-					args.push_back(std::make_pair(L"Lock", std::to_wstring((ULONG)Arg1)));
-					break;
-				case 0x13:
-					args.push_back(std::make_pair(L"Device ID type", std::to_wstring((ULONG)Arg1)));
-					break;
-			}
-			break;
-		case IRP_MJ_POWER:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPPowerMinorFunction, FALSE, MinorFunction);
-			minor = wMinor;
-			break;
-		case IRP_MJ_SYSTEM_CONTROL:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPSystemMinorFunction, FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			break;
-		case IRP_MJ_LOCK_CONTROL:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPLockMinorFunction, FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			break;
-		case IRP_MJ_FLUSH_BUFFERS:
-			wMinor = LibTranslateEnumerationValueToString(ltetIRPFlushMinorFunction, FALSE, MinorFunction);
-			minor = std::wstring(wMinor);
-			break;
-		case IRP_MJ_DEVICE_CONTROL:
-		case IRP_MJ_INTERNAL_DEVICE_CONTROL:
-			args.push_back(std::make_pair(L"Output buffer length", std::to_wstring((ULONG)Arg1)));
-			args.push_back(std::make_pair(L"Input buffer length", std::to_wstring((ULONG)Arg2)));
-			args.push_back(std::make_pair(L"IOCTL", LibTranslateGeneralIntegerValueToString(ltivtDeviceControl, FALSE, (ULONG)Arg3)));
-			args.push_back(std::make_pair(L"Type3InputBuffer", Ptr2Hex(Arg4)));
-			break;
-	}
-
-	return;
-}
-
-std::vector<std::pair<std::wstring, std::wstring>> GetRequestDetails(PREQUEST_HEADER h)
-{
-	std::vector<std::pair<std::wstring, std::wstring>> res;
-
-	switch (h->Type) {
-		case ertIRP: {
-			PREQUEST_IRP r = CONTAINING_RECORD(h, REQUEST_IRP, Header);
-			std::wstring major = LibTranslateGeneralIntegerValueToString(ltivtFileIRPMajorFunction, FALSE, r->MajorFunction);
-			std::wstring minor;
-			std::vector<std::pair<std::wstring, std::wstring>> args;
-			
-			PWCHAR wFlagsStr = LibTranslateIRPFLagsToString(r->MajorFunction, r->MinorFunction, r->IrpFlags & (~0x60000), FALSE);
-			std::wstring flagsStr;
-			if (wFlagsStr != NULL) {
-				flagsStr = std::wstring(wFlagsStr);
-				LibTranslateBitMaskValueStringFree(wFlagsStr);
-			}
-
-			_ParseIRPParameters(r->MajorFunction, r->MinorFunction, r->Arg1, r->Arg2, r->Arg3, r->Arg4, minor, args);
-			res.push_back(std::make_pair(L"IRP address", Ptr2Hex(r->IRPAddress)));
-			res.push_back(std::make_pair(L"File object", Ptr2Hex(r->FileObject)));
-			res.push_back(std::make_pair(L"Major function", major));
-			res.push_back(std::make_pair(L"Minor function", minor));
-			res.push_back(std::make_pair(L"Flags", flagsStr));
-			res.push_back(std::make_pair(L"Access mode", _AccessModeToString(r->PreviousMode)));
-			res.push_back(std::make_pair(L"Requestor mode", _AccessModeToString(r->RequestorMode)));
-			for (auto it = args.cbegin(); it != args.cend(); ++it)
-				res.push_back(*it);
-
-		} break;
-		case ertIRPCompletion: {
-			PREQUEST_IRP_COMPLETION r = CONTAINING_RECORD(h, REQUEST_IRP_COMPLETION, Header);
-
-			res.push_back(std::make_pair(L"IRP address", Ptr2Hex(r->IRPAddress)));
-			res.push_back(std::make_pair(L"Completion information", Ptr2Hex((PVOID)r->CompletionInformation)));
-			res.push_back(std::make_pair(L"Completion status", LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, (ULONG)r->CompletionStatus)));
-		} break;
-		case ertFastIo: {
-			PREQUEST_FASTIO f = CONTAINING_RECORD(h, REQUEST_FASTIO, Header);
-			bool iosbValid = false;
-			std::vector<std::pair<std::wstring, std::wstring>> args;
-
-			switch (f->FastIoType) {
-				case FastIoCheckIfPossible: {
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)f->Arg3)));
-					args.push_back(std::make_pair(L"Operation", ((ULONG)f->Arg4 != 0) ? L"Read" : L"Write"));
-					args.push_back(std::make_pair(L"Wait", ((ULONG)f->Arg5) ? L"Yes" : L"No"));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg6)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoRead:  // the same as the FastIoWrite case
-				case FastIoWrite: {
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)f->Arg3)));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg4)));
-					args.push_back(std::make_pair(L"Wait", ((ULONG)f->Arg5) ? L"Yes" : L"No"));
-					args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg6)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoQueryBasicInfo: {
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-					if (iosbValid && f->IOSBStatus >= 0) {
-						ULONG64 creationTime = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-						LONG64 lastAccessTime = (ULONG64)f->Arg3 + ((ULONG64)f->Arg4 << 32);
-						ULONG64 lastWriteTime = (ULONG64)f->Arg5 + ((ULONG64)f->Arg6 << 32);
-						PWCHAR attrMask = LibTranslateBitMaskValueToString(ltbtFileAttributes, FALSE, (ULONG)f->Arg7);
-
-						args.push_back(std::make_pair(L"Creation time", std::to_wstring(creationTime)));
-						args.push_back(std::make_pair(L"Last access time", std::to_wstring(lastAccessTime)));
-						args.push_back(std::make_pair(L"Last write time", std::to_wstring(lastWriteTime)));
-						if (attrMask != NULL) {
-							args.push_back(std::make_pair(L"File attributes", attrMask));
-							LibTranslateBitMaskValueStringFree(attrMask);
-						} else args.push_back(std::make_pair(L"File attributes", Ptr2Hex(f->Arg7)));
-					} else {
-						args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg1)));
-						args.push_back(std::make_pair(L"Wait", ((ULONG)f->Arg2) ? L"Yes" : L"No"));
-					}
-				} break;
-				case FastIoQueryStandardInfo: {
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-					if (iosbValid && f->IOSBStatus >= 0) {
-						ULONG64 allocationSize = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-						LONG64 endOfFile = (ULONG64)f->Arg3 + ((ULONG64)f->Arg4 << 32);
-
-						args.push_back(std::make_pair(L"Allocation size", std::to_wstring(allocationSize)));
-						args.push_back(std::make_pair(L"End of file", std::to_wstring(endOfFile)));
-						args.push_back(std::make_pair(L"Number of links", std::to_wstring((ULONG)f->Arg5)));
-						args.push_back(std::make_pair(L"Directory", ((ULONG)f->Arg6) ? L"Yes" : L"No"));
-						args.push_back(std::make_pair(L"DeletePending", ((ULONG)f->Arg7) ? L"Yes" : L"No"));
-					} else {
-						args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg1)));
-						args.push_back(std::make_pair(L"Wait", ((ULONG)f->Arg2) ? L"Yes" : L"No"));
-					}
-				} break;
-				case FastIoLock: {
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-					ULONG64 regionLength = (ULONG64)f->Arg3 + ((ULONG64)f->Arg4 << 32);
-					ULONG flags = (ULONG)f->Arg5;
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"Length", std::to_wstring(regionLength)));
-					args.push_back(std::make_pair(L"Fail immediately", (flags & 2) ? L"Yes" : L"No"));
-					args.push_back(std::make_pair(L"Exclusive", (flags & 1) ? L"Yes" : L"No"));
-					args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg6)));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg7)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoUnlockSingle: {
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-					ULONG64 regionLength = (ULONG64)f->Arg3 + ((ULONG64)f->Arg4 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"Length", std::to_wstring(regionLength)));
-					args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg5)));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg6)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoUnlockAll: {
-					args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg1)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoUnlockAllByKey: {
-					args.push_back(std::make_pair(L"ProcessId", Ptr2Hex(f->Arg1)));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg2)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoDeviceControl: {
-					args.push_back(std::make_pair(L"IOCTL", LibTranslateGeneralIntegerValueToString(ltivtDeviceControl, FALSE, (ULONG)f->Arg1)));
-					args.push_back(std::make_pair(L"Input buffer length", std::to_wstring((ULONG)f->Arg2)));
-					args.push_back(std::make_pair(L"Output buffer length", std::to_wstring((ULONG)f->Arg3)));
-					args.push_back(std::make_pair(L"Wait", ((ULONG)f->Arg5) ? L"Yes" : L"No"));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoDetachDevice: {
-					args.push_back(std::make_pair(L"Source device", Ptr2Hex(f->Arg1)));
-					args.push_back(std::make_pair(L"Target device", Ptr2Hex(f->Arg2)));
-				} break;
-				case FastIoQueryNetworkOpenInfo: {
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-					if (iosbValid && f->IOSBStatus >= 0) {
-						ULONG64 creationTime = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-						LONG64 lastAccessTime = (ULONG64)f->Arg3 + ((ULONG64)f->Arg4 << 32);
-						ULONG64 lastWriteTime = (ULONG64)f->Arg5 + ((ULONG64)f->Arg6 << 32);
-						PWCHAR attrMask = LibTranslateBitMaskValueToString(ltbtFileAttributes, FALSE, (ULONG)f->Arg7);
-
-						args.push_back(std::make_pair(L"Creation time", std::to_wstring(creationTime)));
-						args.push_back(std::make_pair(L"Last access time", std::to_wstring(lastAccessTime)));
-						args.push_back(std::make_pair(L"Last write time", std::to_wstring(lastWriteTime)));
-						if (attrMask != NULL) {
-							args.push_back(std::make_pair(L"File attributes", attrMask));
-							LibTranslateBitMaskValueStringFree(attrMask);
-						} else args.push_back(std::make_pair(L"File attributes", Ptr2Hex(f->Arg7)));
-					} else {
-						args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg1)));
-						args.push_back(std::make_pair(L"Wait", ((ULONG)f->Arg2) ? L"Yes" : L"No"));
-					}
-				} break;
-				case AcquireForModWrite: {
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					if (f->Header.Result.NTSTATUSValue >= 0)
-						args.push_back(std::make_pair(L"Lock", Ptr2Hex(f->Arg3)));
-				} break;
-				case PrepareMdlWrite:
-				case MdlRead: {  // the same as the PrepareMdlWrite case
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)f->Arg3)));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg4)));
-					args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg5)));
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case MdlReadComplete: 
-				case MdlReadCompleteCompressed: { // the same as the MdlReadComplete case
-					args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg1)));
-				} break;
-				case MdlWriteComplete: 
-				case MdlWriteCompleteCompressed: { // the same as the MdlWriteComplete case
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg3)));
-				} break;
-				case FastIoWriteCompressed:
-				case FastIoReadCompressed: { // The same as the FastIoWriteCompressed case
-					ULONG64 fileOffset = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-
-					args.push_back(std::make_pair(L"File offset", std::to_wstring(fileOffset)));
-					args.push_back(std::make_pair(L"Length", std::to_wstring((ULONG)f->Arg3)));
-					args.push_back(std::make_pair(L"Lock key", std::to_wstring((ULONG)f->Arg4)));
-					args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg5)));
-					args.push_back(std::make_pair(L"Compressed info length", std::to_wstring((ULONG)f->Arg6)));
-					if (f->IOSBStatus >= 0) 
-						args.push_back(std::make_pair(L"MDL", Ptr2Hex(f->Arg7)));
-
-					iosbValid = (f->Header.Result.BOOLEANValue != FALSE);
-				} break;
-				case FastIoQueryOpen: {
-					if (f->Header.Result.BOOLEANValue) {
-						ULONG64 creationTime = (ULONG64)f->Arg1 + ((ULONG64)f->Arg2 << 32);
-						LONG64 lastAccessTime = (ULONG64)f->Arg3 + ((ULONG64)f->Arg4 << 32);
-						ULONG64 lastWriteTime = (ULONG64)f->Arg5 + ((ULONG64)f->Arg6 << 32);
-						PWCHAR attrMask = LibTranslateBitMaskValueToString(ltbtFileAttributes, FALSE, (ULONG)f->Arg7);
-
-						args.push_back(std::make_pair(L"Creation time", std::to_wstring(creationTime)));
-						args.push_back(std::make_pair(L"Last access time", std::to_wstring(lastAccessTime)));
-						args.push_back(std::make_pair(L"Last write time", std::to_wstring(lastWriteTime)));
-						if (attrMask != NULL) {
-							args.push_back(std::make_pair(L"File attributes", attrMask));
-							LibTranslateBitMaskValueStringFree(attrMask);
-						} else args.push_back(std::make_pair(L"File attributes", Ptr2Hex(f->Arg7)));
-					} else {
-						args.push_back(std::make_pair(L"IRP address", Ptr2Hex(f->Arg1)));
-						args.push_back(std::make_pair(L"Buffer", Ptr2Hex(f->Arg2)));
-					}
-				} break;
-				case ReleaseForModWrite: {
-					args.push_back(std::make_pair(L"Lock", Ptr2Hex(f->Arg1)));
-				} break;
-				case AcquireForCcFlush:
-				case ReleaseForCcFlush: // the same as the AcquireForCcFlush case
-				case AcquireFileForNtCreateSection: // the same as the AcquireForCcFlush case
-				case ReleaseFileForNtCreateSection: // the same as the AcquireForCcFlush case
-					break;
-				default:
-					break;
-			}
-
-			res.push_back(std::make_pair(L"Type", _FastIoTypeToString(f->FastIoType)));
-			res.push_back(std::make_pair(L"File object", Ptr2Hex(f->FileObject)));
-			res.push_back(std::make_pair(L"Access mode", _AccessModeToString(f->PreviousMode)));
-			for (auto it = args.cbegin(); it != args.cend(); ++it)
-				res.push_back(*it);
-
-			if (iosbValid) {
-				res.push_back(std::make_pair(L"IOSB Status", LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, f->IOSBStatus)));
-				res.push_back(std::make_pair(L"IOSB Information", std::to_wstring(f->IOSBInformation)));
-			}
-		} break;
-		case ertStartIo: {
-			PREQUEST_STARTIO s = CONTAINING_RECORD(h, REQUEST_STARTIO, Header);
-			std::wstring major = LibTranslateGeneralIntegerValueToString(ltivtFileIRPMajorFunction, FALSE, s->MajorFunction);
-			std::wstring minor;
-			std::vector<std::pair<std::wstring, std::wstring>> args;
-
-			PWCHAR wFlagsStr = LibTranslateIRPFLagsToString(s->MajorFunction, s->MinorFunction, s->IrpFlags & (~0x60000), FALSE);
-			std::wstring flagsStr;
-			if (wFlagsStr != NULL) {
-				flagsStr = std::wstring(wFlagsStr);
-				LibTranslateBitMaskValueStringFree(wFlagsStr);
-			}
-
-			_ParseIRPParameters(s->MajorFunction, s->MinorFunction, s->Arg1, s->Arg2, s->Arg3, s->Arg4, minor, args);
-			res.push_back(std::make_pair(L"IRP address", Ptr2Hex(s->IRPAddress)));
-			res.push_back(std::make_pair(L"File object", Ptr2Hex(s->FileObject)));
-			res.push_back(std::make_pair(L"Major function", major));
-			res.push_back(std::make_pair(L"Minor function", minor));
-			res.push_back(std::make_pair(L"Flags", flagsStr));
-			for (auto it = args.cbegin(); it != args.cend(); ++it)
-				res.push_back(*it);
-
-			res.push_back(std::make_pair(L"IOSB status", LibTranslateGeneralIntegerValueToString(ltivtNTSTATUS, FALSE, (ULONG)s->Status)));
-			res.push_back(std::make_pair(L"IOSB information", Ptr2Hex((PVOID)s->Information)));
-		} break;
-		case ertAddDevice: {
-		} break;
-		case ertDriverUnload: {
-		} break;
-	}
-
-	return res;
-}
-
 /************************************************************************/
 /*                  COMMANDS                                            */
 /************************************************************************/
@@ -599,82 +146,195 @@ VOID PrintHooks(PHOOKED_DRIVER_UMINFO HookedDrivers, ULONG Count)
 	return;
 }
 
+static VOID WINAPI OnCaptureBatch(PIRPMON_RECORD_BATCH Batch, PVOID Context)
+{
+	PDWORD captureError = (PDWORD)Context;
+	DWORD err = ERROR_SUCCESS;
+	DEBUG_ENTER_FUNCTION("Batch=0x%p; Context=0x%p", Batch, Context);
+
+	for (ULONG i = 0; i < Batch->Count; ++i) {
+		err = CaptureRecord(Batch->Records[i].Header, Batch->Records[i].Size);
+		if (err != ERROR_SUCCESS)
+			break;
+	}
+
+	if (err != ERROR_SUCCESS && *captureError == ERROR_SUCCESS) {
+		*captureError = err;
+		printf("ERROR: Failed to write the capture: %u\n", err);
+		SetEvent(_stopEvent);
+	}
+
+	IRPMonDllConsumerBatchRelease(Batch);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+static VOID PrintStageStatistics(const char *Name, const MONITOR_STAGE_STATISTICS *Stage, ULONG64 Duration)
+{
+	ULONG64 threadTime = Duration*Stage->ThreadCount;
+
+	if (threadTime == 0)
+		threadTime = 1;
+
+	printf("  %-8s %7u %6.1f%% %6.1f%%\n", Name, Stage->ThreadCount, Stage->BusyTime*100.0 / threadTime, Stage->WaitTime*100.0 / threadTime);
+
+	return;
+}
+
+static VOID PrintQueueStatistics(const char *Name, const MONITOR_QUEUE_STATISTICS *Queue)
+{
+	double average = 0;
+
+	if (Queue->PushCount > 0)
+		average = (double)Queue->DepthSum / Queue->PushCount;
+
+	printf("  %-8s %8u %9.1f %7u\n", Name, Queue->Capacity, average, Queue->MaxDepth);
+
+	return;
+}
+
+static VOID PrintMonitorStatistics(const MONITOR_STATISTICS *Statistics)
+{
+	printf("Monitored %I64u records in %I64u batches in %I64u ms\n", Statistics->RecordCount, Statistics->BatchCount, Statistics->Duration / 1000);
+	printf("  Stage    Threads   Busy  Waiting\n");
+	PrintStageStatistics("Fetch", &Statistics->Fetch, Statistics->Duration);
+	PrintStageStatistics("Format", &Statistics->Format, Statistics->Duration);
+	PrintStageStatistics("Write", &Statistics->Write, Statistics->Duration);
+	printf("  Queue    Capacity Avg depth Max depth\n");
+	PrintQueueStatistics("Format", &Statistics->FormatQueue);
+	PrintQueueStatistics("Write", &Statistics->WriteQueue);
+
+	return;
+}
+
+/** Hooks the drivers and devices collected from the command line so far.
+ *  If any of them fails, every object hooked by this command (including earlier
+ *  batches) is unhooked again. The entry lists are emptied in both cases.
+ */
+static DWORD HookPending(std::vector<IRPMON_HOOK_DRIVER_BATCH_ENTRY> & DriverEntries, std::vector<IRPMON_HOOK_DEVICE_BATCH_ENTRY> & DeviceEntries, std::vector<HANDLE> & HookedDrivers, std::vector<HANDLE> & HookedDevices)
+{
+	DWORD err = ERROR_SUCCESS;
+	DEBUG_ENTER_FUNCTION("DriverEntries=%u; DeviceEntries=%u", (ULONG)DriverEntries.size(), (ULONG)DeviceEntries.size());
+
+	if (DriverEntries.size() > 0 || DeviceEntries.size() > 0) {
+		PIRPMON_HOOK_DRIVER_BATCH_ENTRY drivers = (DriverEntries.size() > 0) ? &DriverEntries[0] : NULL;
+		PIRPMON_HOOK_DEVICE_BATCH_ENTRY devices = (DeviceEntries.size() > 0) ? &DeviceEntries[0] : NULL;
+
+		err = IRPMonDllHookBatch(drivers, (ULONG)DriverEntries.size(), devices, (ULONG)DeviceEntries.size(), TRUE);
+		if (err == ERROR_SUCCESS) {
+			for (auto it = DriverEntries.begin(); it != DriverEntries.end(); ++it) {
+				if (it->Result == ERROR_SUCCESS) {
+					HookedDrivers.push_back(it->DriverHandle);
+					printf("The driver %S has been hooked successfully\n", it->DriverName);
+				} else {
+					printf("ERROR: Unable to hook the %S driver: %u\n", it->DriverName, it->Result);
+					err = it->Result;
+				}
+			}
+
+			for (auto it = DeviceEntries.begin(); it != DeviceEntries.end(); ++it) {
+				if (it->Result == ERROR_SUCCESS) {
+					HookedDevices.push_back(it->DeviceHandle);
+					if (it->DeviceName != NULL)
+						printf("The device object \"%S\" has been hooked successfully\n", it->DeviceName);
+					else printf("The device object (0x%p) has been hooked successfully\n", it->DeviceAddress);
+				} else {
+					if (it->DeviceName != NULL)
+						printf("ERROR: Unable to hook device \"%S\": %u\n", it->DeviceName, it->Result);
+					else printf("ERROR: Unable to hook device (0x%p): %u\n", it->DeviceAddress, it->Result);
+
+					err = it->Result;
+				}
+			}
+
+			if (err != ERROR_SUCCESS) {
+				for (auto it = HookedDevices.begin(); it != HookedDevices.end(); ++it) {
+					DWORD err2 = IRPMonDllUnhookDevice(*it);
+					if (err2 != ERROR_SUCCESS)
+						printf("ERROR: Unable to unhook the device 0x%p: %u\n", *it, err2);
+				}
+
+				if (HookedDrivers.size() > 0) {
+					std::vector<DWORD> results(HookedDrivers.size());
+					DWORD err2 = IRPMonDllUnhookDriverBatch(&HookedDrivers[0], (ULONG)HookedDrivers.size(), &results[0]);
+
+					if (err2 == ERROR_SUCCESS) {
+						for (size_t j = 0; j < HookedDrivers.size(); ++j) {
+							if (results[j] != ERROR_SUCCESS)
+								printf("ERROR: Unable to unhook the driver 0x%p: %u\n", HookedDrivers[j], results[j]);
+						}
+					} else printf("ERROR: Unable to unhook the drivers: %u\n", err2);
+				}
+
+				HookedDevices.clear();
+				HookedDrivers.clear();
+			}
+		} else printf("ERROR: Unable to hook the drivers and devices: %u\n", err);
+	}
+
+	DriverEntries.clear();
+	DeviceEntries.clear();
+
+	DEBUG_EXIT_FUNCTION("%u", err);
+	return err;
+}
+
 VOID HookAndMonitor(int argc, PWCHAR *argv)
 {
+	std::vector<IRPMON_HOOK_DRIVER_BATCH_ENTRY> driverEntries;
+	std::vector<IRPMON_HOOK_DEVICE_BATCH_ENTRY> deviceEntries;
 	std::vector<HANDLE> hookedDrivers;
 	std::vector<HANDLE> hookedDevices;
 	int i = 0;
 	BOOLEAN performMonitoring = FALSE;
+	PWCHAR captureFileName = NULL;
+	ULONG threadCount = 0;
+	SYSTEM_INFO systemInfo;
 	DWORD err = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION("argc=%u; argv=0x%p", argc, argv);
 
+	GetSystemInfo(&systemInfo);
+	threadCount = systemInfo.dwNumberOfProcessors;
 	err = CacheInit();
 	if (err == ERROR_SUCCESS) {
 		while (err == ERROR_SUCCESS && i < argc) {
 			PWCHAR argument = argv[i];
 	
-			if (wcsicmp(argument, L"--hook-driver") == 0) {
-				HANDLE hookHandle = NULL;
-				PWCHAR driverName = NULL;
-				DRIVER_MONITOR_SETTINGS ms;
-
-				ms.MonitorAddDevice = TRUE;
-				ms.MonitorFastIo = TRUE;
-				ms.MonitorIRP = TRUE;
-				ms.MonitorIRPCompletion = TRUE;
-				ms.MonitorNewDevices = FALSE;
-				ms.MonitorStartIo = TRUE;
-				ms.MonitorUnload = TRUE;
-				++i;
-				driverName = argv[i];
-				err = IRPMonDllHookDriver(driverName, &ms, &hookHandle, NULL);
-				if (err == ERROR_SUCCESS) {
-					hookedDrivers.push_back(hookHandle);
-					printf("The driver %S has been hooked successfully\n", driverName);
-				} else printf("ERROR: Unable to hook the %S driver: %u\n", driverName, err);
-			} else if (wcsicmp(argument, L"--hook-driver-nd") == 0) {
-				HANDLE hookHandle = NULL;
-				PWCHAR driverName = NULL;
-				DRIVER_MONITOR_SETTINGS ms;
-
-				ms.MonitorAddDevice = TRUE;
-				ms.MonitorFastIo = TRUE;
-				ms.MonitorIRP = TRUE;
-				ms.MonitorIRPCompletion = TRUE;
-				ms.MonitorNewDevices = TRUE;
-				ms.MonitorStartIo = TRUE;
-				ms.MonitorUnload = TRUE;
+			if (wcsicmp(argument, L"--hook-driver") == 0 || wcsicmp(argument, L"--hook-driver-nd") == 0) {
+				IRPMON_HOOK_DRIVER_BATCH_ENTRY entry;
+
+				memset(&entry, 0, sizeof(entry));
+				entry.MonitorSettings.MonitorAddDevice = TRUE;
+				entry.MonitorSettings.MonitorFastIo = TRUE;
+				entry.MonitorSettings.MonitorIRP = TRUE;
+				entry.MonitorSettings.MonitorIRPCompletion = TRUE;
+				entry.MonitorSettings.MonitorNewDevices = (wcsicmp(argument, L"--hook-driver-nd") == 0);
+				entry.MonitorSettings.MonitorStartIo = TRUE;
+				entry.MonitorSettings.MonitorUnload = TRUE;
 				++i;
-				driverName = argv[i];
-				err = IRPMonDllHookDriver(driverName, &ms, &hookHandle, NULL);
-				if (err == ERROR_SUCCESS) {
-					hookedDrivers.push_back(hookHandle);
-					printf("The driver %S has been hooked successfully\n", driverName);
-				} else printf("ERROR: Unable to hook the %S driver: %u\n", driverName, err);
+				entry.DriverName = argv[i];
+				driverEntries.push_back(entry);
 			} else if (wcsicmp(argument, L"--hook-device-address") == 0) {
-				HANDLE hookHandle = NULL;
-				PVOID deviceAddress = NULL;
+				IRPMON_HOOK_DEVICE_BATCH_ENTRY entry;
 
+				memset(&entry, 0, sizeof(entry));
 				++i;
-				deviceAddress = (PVOID)wcstoul(argv[i], NULL, 0);
-				err = IRPMonDllHookDeviceByAddress(deviceAddress, &hookHandle, NULL);
-				if (err == ERROR_SUCCESS) {
-					hookedDevices.push_back(hookHandle);
-					printf("The device object (0x%p) has been hooked successfully\n", deviceAddress);
-				} else printf("ERROR: Unable to hook device (0x%p): %u\n", deviceAddress, err);
+				entry.DeviceAddress = (PVOID)wcstoul(argv[i], NULL, 0);
+				deviceEntries.push_back(entry);
 			} else if (wcsicmp(argument, L"--hook-device-name") == 0) {
-				HANDLE hookHandle = NULL;
-				PWCHAR deviceName = NULL;
+				IRPMON_HOOK_DEVICE_BATCH_ENTRY entry;
 
+				memset(&entry, 0, sizeof(entry));
 				++i;
-				deviceName = argv[i];
-				err = IRPMonDllHookDeviceByName(deviceName, &hookHandle, NULL);
-				if (err == ERROR_SUCCESS) {
-					hookedDevices.push_back(hookHandle);
-					printf("The device object \"%S\" has been hooked successfully\n", deviceName);
-				} else printf("ERROR: Unable to hook device \"%S\": %u\n", deviceName, err);
+				entry.DeviceName = argv[i];
+				deviceEntries.push_back(entry);
 			} else if (wcsicmp(argument, L"--unhook-driver") == 0) {
 				PVOID objectId = NULL;
+
+				err = HookPending(driverEntries, deviceEntries, hookedDrivers, hookedDevices);
+				if (err != ERROR_SUCCESS)
+					break;
 				
 				++i;
 				argument = argv[i];
@@ -700,6 +360,10 @@ VOID HookAndMonitor(int argc, PWCHAR *argv)
 			} else if (wcsicmp(argument, L"--unhook-device") == 0) {
 				PVOID objectId = NULL;
 
+				err = HookPending(driverEntries, deviceEntries, hookedDrivers, hookedDevices);
+				if (err != ERROR_SUCCESS)
+					break;
+
 				++i;
 				argument = argv[i];
 				if (StringToPointer(argument, &objectId)) {
@@ -722,160 +386,119 @@ VOID HookAndMonitor(int argc, PWCHAR *argv)
 					err = ERROR_INVALID_PARAMETER;
 				}
 			} else if (wcsicmp(argument, L"--enumerate-hooks") == 0) {
-				ULONG hookedDriversCount = 0;
-				PHOOKED_DRIVER_UMINFO hookedDrivers = NULL;
+				ULONG hookCount = 0;
+				PHOOKED_DRIVER_UMINFO hooks = NULL;
+
+				err = HookPending(driverEntries, deviceEntries, hookedDrivers, hookedDevices);
+				if (err != ERROR_SUCCESS)
+					break;
 
-				err = IRPMonDllDriverHooksEnumerate(&hookedDrivers, &hookedDriversCount);
+				err = IRPMonDllDriverHooksEnumerate(&hooks, &hookCount);
 				if (err == ERROR_SUCCESS) {
-					PrintHooks(hookedDrivers, hookedDriversCount);
-					IRPMonDllDriverHooksFree(hookedDrivers, hookedDriversCount);
+					PrintHooks(hooks, hookCount);
+					IRPMonDllDriverHooksFree(hooks, hookCount);
 				} else printf("ERROR: Failed to enumerate hooked drivers: %u\n", err);
 			} else if (wcsicmp(argument, L"--monitor") == 0) {
 				performMonitoring = TRUE;
+			} else if (wcsicmp(argument, L"--capture") == 0) {
+				++i;
+				captureFileName = argv[i];
+				performMonitoring = TRUE;
+			} else if (wcsicmp(argument, L"--threads") == 0) {
+				++i;
+				threadCount = (i < argc) ? wcstoul(argv[i], NULL, 0) : 0;
+				if (threadCount == 0 || threadCount > MONITOR_WORKERS_MAX) {
+					printf("ERROR: The number of threads must be between 1 and %u\n", MONITOR_WORKERS_MAX);
+					err = ERROR_INVALID_PARAMETER;
+				}
 			} else {
 				printf("ERROR: Unknown argument \"%S\"\n", argv[i]);
 				err = ERROR_INVALID_PARAMETER;
 			}
 
-			if (err != ERROR_SUCCESS) {
-				for (auto it = hookedDrivers.begin(); it != hookedDrivers.end(); ++it) {
-					DWORD err2 = IRPMonDllUnhookDriver(*it);
-					if (err2 != ERROR_SUCCESS)
-						printf("ERROR: Unable to unhook the driver 0x%p: %u\n", *it, err2);
-				}
-			}
-
 			++i;
 		}
 
-		if (err == ERROR_SUCCESS) {
-			for (auto it = hookedDrivers.begin(); it != hookedDrivers.end(); ++it) {
-				err = IRPMonDllDriverStartMonitoring(*it);
-				if (err != ERROR_SUCCESS) {
-					printf("ERROR: Unable to active the 0x%p driver: %u\n", *it, err);
-					for (auto it2 = hookedDrivers.begin(); it2 != it; ++it2) {
-						err = IRPMonDllDriverStopMonitoring(*it2);
-						if (err != ERROR_SUCCESS)
-							printf("WARNING: Unable to deactivate driver 0x%p: %u\n", *it2, err);
-					}
-
-					break;
-				}
-			}
-
-			if (err != ERROR_SUCCESS) {
-				for (auto it = hookedDrivers.begin(); it != hookedDrivers.end(); ++it) {
-					err = IRPMonDllUnhookDriver(*it);
-					if (err != ERROR_SUCCESS)
-						printf("ERROR: Unable to unhook the 0x%p driver\n", *it, err);
-				}
-			}
-		}
+		if (err == ERROR_SUCCESS)
+			err = HookPending(driverEntries, deviceEntries, hookedDrivers, hookedDevices);
 
 		if (err != ERROR_SUCCESS)
 			CacheFinit();
 	}
 
 	if (err == ERROR_SUCCESS) {
-		HANDLE hSemaphore = NULL;
-		HANDLE hEvent = NULL;
+		DWORD captureError = ERROR_SUCCESS;
+		CAPTURE_STATISTICS captureStatistics;
+		MONITOR_STATISTICS monitorStatistics;
 
 		if (performMonitoring) {
-			hSemaphore = CreateSemaphoreW(NULL, 0, 0x7FFFFFFF, NULL);
-			if (hSemaphore != NULL) {
-				hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-				if (hEvent != NULL) {
-					err = IRPMonDllConnect(hSemaphore);
+			_stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+			if (_stopEvent != NULL) {
+				SetConsoleCtrlHandler(_ConsoleCtrlHandler, TRUE);
+				if (captureFileName != NULL) {
+					err = CaptureInit(captureFileName, CAPTURE_BLOCK_LENGTH_DEFAULT);
+					if (err != ERROR_SUCCESS)
+						printf("ERROR: Failed to create the capture file \"%S\": %u\n", captureFileName, err);
+				}
+
+				if (err == ERROR_SUCCESS) {
+					err = IRPMonDllConnect(NULL);
 					if (err == ERROR_SUCCESS) {
-						DWORD waitRes = WAIT_FAILED;
-						HANDLE objectsToWait[] = {hSemaphore, hEvent};
-						ULONG numObjectsToWait = sizeof(objectsToWait) / sizeof(HANDLE);
-						BOOLEAN terminate = FALSE;
-						BOOLEAN disocnnected = FALSE;
-
-						while (!terminate) {
-							waitRes = WaitForMultipleObjects(numObjectsToWait, objectsToWait, FALSE, INFINITE);
-							switch (waitRes) {
-								REQUEST_FASTIO r;
-
-								case WAIT_OBJECT_0:
-									err = IRPMonDllGetRequest(&r.Header, sizeof(r));
-									if (err == ERROR_SUCCESS) {
-										switch (r.Header.Type) {
-											case ertIRP:
-												printf("IRP: ");
-												break;
-											case ertIRPCompletion:
-												printf("IRPCOMPLETE: ");
-												break;
-											case ertFastIo:
-												printf("FASTIO: ");
-												break;
-											case ertAddDevice:
-												printf("ADDDEVICE: ");
-												break;
-											case ertStartIo:
-												printf("STARTIO: ");
-												break;
-											case ertDriverUnload:
-												printf("UNLOAD: ");
-												break;
-											default:
-												printf("UNKNOWN (%u): ", r.Header.Type);
-												break;
-										}
-
-										std::wstring driverName = CacheDriverNameGet(r.Header.Driver);
-										std::wstring deviceName = CacheDeviceNameGet(r.Header.Device);
-										if (driverName != L"")
-											printf("%S: ", driverName.data());
-										else printf("(0x%p): ", r.Header.Driver);
-
-										if (deviceName != L"")
-											printf("%S\n", deviceName.data());
-										else printf("(0x%p)\n", r.Header.Device);
-
-										std::vector<std::pair<std::wstring, std::wstring>> info = GetRequestDetails(&r.Header);
-										std::wstring res = GetRequestResult(&r.Header);
-										for (auto it = info.cbegin(); it != info.cend(); ++it)
-											printf("  %S: %S\n", it->first.data(), it->second.data());
-
-										printf("  Result: %S\n", res.data());
-										printf("\n");
-										fflush(stdout);
-									} else printf("ERROR: failed to get request: %u\n", err);
-									break;
-								case WAIT_OBJECT_0 + 1:
-									if (!disocnnected) {
-										IRPMonDllDisconnect();
-										disocnnected = TRUE;
-									} else terminate = TRUE;
-									break;
-								case WAIT_TIMEOUT:
-									break;
-								default:
-									break;
+						UINT codePage = GetConsoleOutputCP();
+
+						if (captureFileName != NULL)
+							err = IRPMonDllStartConsumer(OnCaptureBatch, 1024, 100, &captureError);
+						else {
+							// The requests are printed in UTF-8
+							SetConsoleOutputCP(CP_UTF8);
+							err = MonitorInit(threadCount);
+							if (err == ERROR_SUCCESS) {
+								err = IRPMonDllStartConsumer(MonitorBatch, 64, 50, NULL);
+								if (err != ERROR_SUCCESS)
+									MonitorFinit(NULL);
 							}
 						}
+
+						if (err == ERROR_SUCCESS) {
+							WaitForSingleObject(_stopEvent, INFINITE);
+							IRPMonDllStopConsumer();
+							if (captureFileName == NULL) {
+								MonitorFinit(&monitorStatistics);
+								PrintMonitorStatistics(&monitorStatistics);
+							}
+						} else printf("ERROR: Failed to start the record consumer: %u\n", err);
+
+						if (captureFileName == NULL)
+							SetConsoleOutputCP(codePage);
+
+						IRPMonDllDisconnect();
 					}
 
-					CloseHandle(hEvent);
-				} else err = GetLastError();
+					if (captureFileName != NULL) {
+						captureError = CaptureFinit(&captureStatistics);
+						if (captureError == ERROR_SUCCESS)
+							printf("Captured %I64u records in %I64u blocks (%I64u bytes, %I64u compressed)\n", captureStatistics.RecordCount, captureStatistics.BlockCount, captureStatistics.Length, captureStatistics.CompressedLength);
+						else printf("ERROR: Failed to write the capture: %u\n", captureError);
+					}
+				}
 
-				CloseHandle(hSemaphore);
+				SetConsoleCtrlHandler(_ConsoleCtrlHandler, FALSE);
+				CloseHandle(_stopEvent);
+				_stopEvent = NULL;
 			} else err = GetLastError();
 		}
 
 		CacheFinit();
-		for (auto it = hookedDevices.begin(); it != hookedDevices.end(); ++it)
-			IRPMonDllCloseHookedDeviceHandle(*it);
+	}
 
-		hookedDevices.clear();
-		for (auto it = hookedDrivers.begin(); it != hookedDrivers.end(); ++it)
-			IRPMonDllCloseHookedDriverHandle(*it);
+	for (auto it = hookedDevices.begin(); it != hookedDevices.end(); ++it)
+		IRPMonDllCloseHookedDeviceHandle(*it);
 
-		hookedDrivers.clear();
-	}
+	hookedDevices.clear();
+	for (auto it = hookedDrivers.begin(); it != hookedDrivers.end(); ++it)
+		IRPMonDllCloseHookedDriverHandle(*it);
+
+	hookedDrivers.clear();
 
 	fflush(stdout);
 
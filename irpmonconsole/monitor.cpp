@@ -0,0 +1,567 @@
+
+/**
+ * @file
+ *
+ * Prints records delivered by the record consumer through a pipeline of
+ * three stages.
+ *
+ * The thread delivering the batches (the fetch stage) numbers each batch and
+ * queues it for formatting. Worker threads take the batches, format their
+ * records into text and return the record buffers to the consumer. The writer
+ * thread writes the text to the standard output in the order of the batch
+ * numbers, so the output does not depend on which worker finishes first.
+ *
+ * The stages are connected by bounded lock-free queues. A fixed number of
+ * batches circulate through the pipeline; when all of them are in use, the
+ * fetch stage waits and the records stay in the IRPMon Event Queue.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+#include "debug.h"
+#include "irpmondll-types.h"
+#include "irpmondll.h"
+#include "cache.h"
+#include "request-format.h"
+#include "monitor.h"
+
+
+
+/************************************************************************/
+/*                           TYPE DEFINITIONS                           */
+/************************************************************************/
+
+/** Number of batches in the pipeline per worker thread. */
+#define MONITOR_BATCHES_PER_WORKER				4
+
+/** A batch of records travelling through the pipeline. */
+typedef struct _MONITOR_BATCH {
+	/** Order in which the batch was delivered. */
+	ULONG64 Sequence;
+	/** Records delivered by the consumer, returned after formatting. */
+	PIRPMON_RECORD_BATCH Records;
+	REQUEST_FORMAT_BUFFER Text;
+	/** The first error encountered while formatting the records. */
+	DWORD Error;
+	/** ID of the request that could not be formatted. */
+	ULONG FailedId;
+} MONITOR_BATCH, *PMONITOR_BATCH;
+
+typedef struct _MONITOR_QUEUE_CELL {
+	/** Position of the insertion or removal the cell is ready for. */
+	volatile LONG Sequence;
+	PMONITOR_BATCH Batch;
+} MONITOR_QUEUE_CELL, *PMONITOR_QUEUE_CELL;
+
+/** Bounded queue of batches with any number of producers and consumers.
+ *
+ *  Each cell records the position it is ready for, so threads claim the
+ *  positions by a compare-and-swap and never wait for each other. The queue
+ *  is large enough to hold all the batches, so an insertion always finds a
+ *  free cell. A thread removing a batch from an empty queue sleeps on the
+ *  semaphore; the semaphore is touched only when a thread waits.
+ */
+typedef struct _MONITOR_QUEUE {
+	PMONITOR_QUEUE_CELL Cells;
+	ULONG Mask;
+	/** Position of the next insertion. */
+	volatile LONG Head;
+	UCHAR Padding1[64];
+	/** Position of the next removal. */
+	volatile LONG Tail;
+	UCHAR Padding2[64];
+	/** Number of batches available for removal, negative if threads wait
+	    for them. */
+	volatile LONG Available;
+	HANDLE Semaphore;
+	volatile LONG64 PushCount;
+	volatile LONG64 DepthSum;
+	volatile LONG MaxDepth;
+} MONITOR_QUEUE, *PMONITOR_QUEUE;
+
+/** Statistics of one thread, in performance counter ticks. */
+typedef struct _MONITOR_THREAD_STATISTICS {
+	ULONG64 BusyTime;
+	ULONG64 WaitTime;
+	UCHAR Padding[64];
+} MONITOR_THREAD_STATISTICS, *PMONITOR_THREAD_STATISTICS;
+
+
+/************************************************************************/
+/*                           GLOBAL VARIABLES                           */
+/************************************************************************/
+
+static ULONG _workerCount = 0;
+static HANDLE _workerThreads[MONITOR_WORKERS_MAX];
+static MONITOR_THREAD_STATISTICS _workerStatistics[MONITOR_WORKERS_MAX];
+static HANDLE _writerThread = NULL;
+static MONITOR_THREAD_STATISTICS _writerStatistics;
+static MONITOR_THREAD_STATISTICS _fetchStatistics;
+static ULONG _batchCount = 0;
+static PMONITOR_BATCH _batches = NULL;
+/** Free batches, taken by the fetch stage. */
+static MONITOR_QUEUE _freeQueue;
+/** Batches waiting to be formatted. */
+static MONITOR_QUEUE _formatQueue;
+/** Formatted batches, in any order. */
+static MONITOR_QUEUE _writeQueue;
+/** Formatted batches that arrived before their predecessors, indexed by
+    their sequence numbers modulo the number of batches. Owned by the writer. */
+static PMONITOR_BATCH *_reorderWindow = NULL;
+static ULONG64 _nextSequence = 0;
+static ULONG64 _nextWrite = 0;
+static ULONG64 _recordCount = 0;
+static ULONG64 _deliveredBatchCount = 0;
+static LARGE_INTEGER _startTime;
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+static ULONG64 _Now(VOID)
+{
+	LARGE_INTEGER ret;
+
+	QueryPerformanceCounter(&ret);
+
+	return ret.QuadPart;
+}
+
+
+static ULONG64 _TicksToMicroseconds(ULONG64 Ticks)
+{
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceFrequency(&frequency);
+
+	return (Ticks / frequency.QuadPart)*1000000 + (Ticks % frequency.QuadPart)*1000000 / frequency.QuadPart;
+}
+
+
+static DWORD _QueueInit(PMONITOR_QUEUE Queue, ULONG MinCapacity)
+{
+	ULONG capacity = 1;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	while (capacity < MinCapacity)
+		capacity *= 2;
+
+	memset(Queue, 0, sizeof(MONITOR_QUEUE));
+	Queue->Mask = capacity - 1;
+	Queue->Cells = (PMONITOR_QUEUE_CELL)HeapAlloc(GetProcessHeap(), 0, capacity*sizeof(MONITOR_QUEUE_CELL));
+	if (Queue->Cells != NULL) {
+		for (ULONG i = 0; i < capacity; ++i) {
+			Queue->Cells[i].Sequence = i;
+			Queue->Cells[i].Batch = NULL;
+		}
+
+		Queue->Semaphore = CreateSemaphoreW(NULL, 0, capacity, NULL);
+		if (Queue->Semaphore != NULL)
+			ret = ERROR_SUCCESS;
+		else ret = GetLastError();
+
+		if (ret != ERROR_SUCCESS)
+			HeapFree(GetProcessHeap(), 0, Queue->Cells);
+	} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	return ret;
+}
+
+
+static VOID _QueueFinit(PMONITOR_QUEUE Queue)
+{
+	CloseHandle(Queue->Semaphore);
+	HeapFree(GetProcessHeap(), 0, Queue->Cells);
+	memset(Queue, 0, sizeof(MONITOR_QUEUE));
+
+	return;
+}
+
+
+/** Inserts a batch to the queue. NULL asks the thread removing it to terminate. */
+static VOID _QueuePush(PMONITOR_QUEUE Queue, PMONITOR_BATCH Batch)
+{
+	LONG pos = 0;
+	LONG depth = 0;
+	LONG maxDepth = 0;
+	PMONITOR_QUEUE_CELL cell = NULL;
+
+	pos = Queue->Head;
+	for (;;) {
+		cell = Queue->Cells + (pos & Queue->Mask);
+		if (cell->Sequence == pos) {
+			if (InterlockedCompareExchange(&Queue->Head, pos + 1, pos) == pos)
+				break;
+		} else YieldProcessor();
+
+		pos = Queue->Head;
+	}
+
+	cell->Batch = Batch;
+	InterlockedExchange(&cell->Sequence, pos + 1);
+	if (InterlockedIncrement(&Queue->Available) <= 0)
+		ReleaseSemaphore(Queue->Semaphore, 1, NULL);
+
+	// The batch may already be gone
+	depth = pos + 1 - Queue->Tail;
+	if (depth < 1)
+		depth = 1;
+
+	InterlockedIncrement64(&Queue->PushCount);
+	InterlockedExchangeAdd64(&Queue->DepthSum, depth);
+	maxDepth = Queue->MaxDepth;
+	while (depth > maxDepth && InterlockedCompareExchange(&Queue->MaxDepth, depth, maxDepth) != maxDepth)
+		maxDepth = Queue->MaxDepth;
+
+	return;
+}
+
+
+/** Removes a batch from the queue, waiting until there is one. */
+static PMONITOR_BATCH _QueuePop(PMONITOR_QUEUE Queue)
+{
+	LONG pos = 0;
+	PMONITOR_QUEUE_CELL cell = NULL;
+	PMONITOR_BATCH ret = NULL;
+
+	if (InterlockedDecrement(&Queue->Available) < 0)
+		WaitForSingleObject(Queue->Semaphore, INFINITE);
+
+	pos = Queue->Tail;
+	for (;;) {
+		cell = Queue->Cells + (pos & Queue->Mask);
+		// A batch is available, but the thread inserting it to this cell
+		// may still be storing it
+		if (cell->Sequence == pos + 1) {
+			if (InterlockedCompareExchange(&Queue->Tail, pos + 1, pos) == pos)
+				break;
+		} else YieldProcessor();
+
+		pos = Queue->Tail;
+	}
+
+	ret = cell->Batch;
+	InterlockedExchange(&cell->Sequence, pos + Queue->Mask + 1);
+
+	return ret;
+}
+
+
+static VOID _QueueStatisticsGet(PMONITOR_QUEUE Queue, PMONITOR_QUEUE_STATISTICS Statistics)
+{
+	Statistics->Capacity = Queue->Mask + 1;
+	Statistics->PushCount = Queue->PushCount;
+	Statistics->DepthSum = Queue->DepthSum;
+	Statistics->MaxDepth = Queue->MaxDepth;
+
+	return;
+}
+
+
+static VOID _BatchFormat(PMONITOR_BATCH Batch)
+{
+	SIZE_T length = 0;
+	PREQUEST_HEADER header = NULL;
+	DWORD err = ERROR_GEN_FAILURE;
+
+	for (ULONG i = 0; i < Batch->Records->Count; ++i) {
+		header = Batch->Records->Records[i].Header;
+		length = Batch->Text.Length;
+		err = RequestFormatHeader(&Batch->Text, header, CacheDriverNameGet(header->Driver), CacheDeviceNameGet(header->Device));
+		if (err == ERROR_SUCCESS)
+			err = RequestFormatDetails(&Batch->Text, header);
+
+		if (err != ERROR_SUCCESS) {
+			Batch->Text.Length = length;
+			if (Batch->Error == ERROR_SUCCESS) {
+				Batch->Error = err;
+				Batch->FailedId = header->Id;
+			}
+		}
+	}
+
+	return;
+}
+
+
+static DWORD WINAPI _WorkerThreadRoutine(PVOID Context)
+{
+	ULONG64 start = 0;
+	ULONG64 now = 0;
+	PMONITOR_BATCH batch = NULL;
+	PMONITOR_THREAD_STATISTICS statistics = (PMONITOR_THREAD_STATISTICS)Context;
+	DEBUG_ENTER_FUNCTION("Context=0x%p", Context);
+
+	start = _Now();
+	for (;;) {
+		batch = _QueuePop(&_formatQueue);
+		now = _Now();
+		statistics->WaitTime += (now - start);
+		start = now;
+		if (batch == NULL)
+			break;
+
+		_BatchFormat(batch);
+		IRPMonDllConsumerBatchRelease(batch->Records);
+		batch->Records = NULL;
+		_QueuePush(&_writeQueue, batch);
+		now = _Now();
+		statistics->BusyTime += (now - start);
+		start = now;
+	}
+
+	DEBUG_EXIT_FUNCTION("%u", ERROR_SUCCESS);
+	return ERROR_SUCCESS;
+}
+
+
+static DWORD WINAPI _WriterThreadRoutine(PVOID Context)
+{
+	ULONG64 start = 0;
+	ULONG64 now = 0;
+	PMONITOR_BATCH batch = NULL;
+	DEBUG_ENTER_FUNCTION("Context=0x%p", Context);
+
+	start = _Now();
+	for (;;) {
+		batch = _QueuePop(&_writeQueue);
+		now = _Now();
+		_writerStatistics.WaitTime += (now - start);
+		start = now;
+		if (batch == NULL)
+			break;
+
+		_reorderWindow[batch->Sequence % _batchCount] = batch;
+		batch = _reorderWindow[_nextWrite % _batchCount];
+		if (batch != NULL) {
+			do {
+				_reorderWindow[_nextWrite % _batchCount] = NULL;
+				if (batch->Text.Length > 0)
+					fwrite(batch->Text.Data, 1, batch->Text.Length, stdout);
+
+				if (batch->Error != ERROR_SUCCESS)
+					printf("ERROR: Failed to format request %u: %u\n", batch->FailedId, batch->Error);
+
+				batch->Text.Length = 0;
+				batch->Error = ERROR_SUCCESS;
+				_QueuePush(&_freeQueue, batch);
+				++_nextWrite;
+				batch = _reorderWindow[_nextWrite % _batchCount];
+			} while (batch != NULL);
+
+			fflush(stdout);
+		}
+
+		now = _Now();
+		_writerStatistics.BusyTime += (now - start);
+		start = now;
+	}
+
+	DEBUG_EXIT_FUNCTION("%u", ERROR_SUCCESS);
+	return ERROR_SUCCESS;
+}
+
+
+/** Asks the threads to terminate after they process the queued batches,
+ *  and waits for them. */
+static VOID _ThreadsStop(VOID)
+{
+	for (ULONG i = 0; i < _workerCount; ++i)
+		_QueuePush(&_formatQueue, NULL);
+
+	for (ULONG i = 0; i < _workerCount; ++i) {
+		WaitForSingleObject(_workerThreads[i], INFINITE);
+		CloseHandle(_workerThreads[i]);
+		_workerThreads[i] = NULL;
+	}
+
+	if (_writerThread != NULL) {
+		_QueuePush(&_writeQueue, NULL);
+		WaitForSingleObject(_writerThread, INFINITE);
+		CloseHandle(_writerThread);
+		_writerThread = NULL;
+	}
+
+	_workerCount = 0;
+
+	return;
+}
+
+
+static VOID _BatchesFree(VOID)
+{
+	if (_batches != NULL) {
+		for (ULONG i = 0; i < _batchCount; ++i)
+			RequestFormatBufferFree(&_batches[i].Text);
+
+		HeapFree(GetProcessHeap(), 0, _batches);
+		_batches = NULL;
+	}
+
+	if (_reorderWindow != NULL) {
+		HeapFree(GetProcessHeap(), 0, _reorderWindow);
+		_reorderWindow = NULL;
+	}
+
+	_batchCount = 0;
+
+	return;
+}
+
+
+/************************************************************************/
+/*                           PUBLIC FUNCTIONS                           */
+/************************************************************************/
+
+/** The record consumer callback, the fetch stage of the pipeline. Waits if
+ *  all batches are in the pipeline.
+ */
+VOID WINAPI MonitorBatch(PIRPMON_RECORD_BATCH Batch, PVOID Context)
+{
+	ULONG64 start = 0;
+	ULONG64 taken = 0;
+	PMONITOR_BATCH batch = NULL;
+	DEBUG_ENTER_FUNCTION("Batch=0x%p; Context=0x%p", Batch, Context);
+
+	start = _Now();
+	batch = _QueuePop(&_freeQueue);
+	taken = _Now();
+	batch->Sequence = _nextSequence;
+	++_nextSequence;
+	batch->Records = Batch;
+	_recordCount += Batch->Count;
+	++_deliveredBatchCount;
+	_QueuePush(&_formatQueue, batch);
+	_fetchStatistics.WaitTime += (taken - start);
+	_fetchStatistics.BusyTime += (_Now() - taken);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+/** Starts the pipeline threads.
+ *
+ *  @param WorkerCount Number of threads formatting the records, up to
+ *  MONITOR_WORKERS_MAX.
+ */
+DWORD MonitorInit(ULONG WorkerCount)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("WorkerCount=%u", WorkerCount);
+
+	if (WorkerCount == 0)
+		WorkerCount = 1;
+	else if (WorkerCount > MONITOR_WORKERS_MAX)
+		WorkerCount = MONITOR_WORKERS_MAX;
+
+	_workerCount = 0;
+	_nextSequence = 0;
+	_nextWrite = 0;
+	_recordCount = 0;
+	_deliveredBatchCount = 0;
+	memset(_workerStatistics, 0, sizeof(_workerStatistics));
+	memset(&_writerStatistics, 0, sizeof(_writerStatistics));
+	memset(&_fetchStatistics, 0, sizeof(_fetchStatistics));
+	_batchCount = WorkerCount*MONITOR_BATCHES_PER_WORKER;
+	_batches = (PMONITOR_BATCH)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, _batchCount*sizeof(MONITOR_BATCH));
+	_reorderWindow = (PMONITOR_BATCH *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, _batchCount*sizeof(PMONITOR_BATCH));
+	if (_batches != NULL && _reorderWindow != NULL) {
+		// The queues also hold the termination requests
+		ret = _QueueInit(&_freeQueue, _batchCount);
+		if (ret == ERROR_SUCCESS) {
+			ret = _QueueInit(&_formatQueue, _batchCount + WorkerCount);
+			if (ret == ERROR_SUCCESS) {
+				ret = _QueueInit(&_writeQueue, _batchCount + 1);
+				if (ret == ERROR_SUCCESS) {
+					for (ULONG i = 0; i < _batchCount; ++i) {
+						RequestFormatBufferInit(&_batches[i].Text);
+						_QueuePush(&_freeQueue, _batches + i);
+					}
+
+					QueryPerformanceCounter(&_startTime);
+					_writerThread = CreateThread(NULL, 0, _WriterThreadRoutine, NULL, 0, NULL);
+					if (_writerThread == NULL)
+						ret = GetLastError();
+
+					while (ret == ERROR_SUCCESS && _workerCount < WorkerCount) {
+						_workerThreads[_workerCount] = CreateThread(NULL, 0, _WorkerThreadRoutine, _workerStatistics + _workerCount, 0, NULL);
+						if (_workerThreads[_workerCount] == NULL) {
+							ret = GetLastError();
+							break;
+						}
+
+						++_workerCount;
+					}
+
+					if (ret != ERROR_SUCCESS) {
+						_ThreadsStop();
+						_QueueFinit(&_writeQueue);
+					}
+				}
+
+				if (ret != ERROR_SUCCESS)
+					_QueueFinit(&_formatQueue);
+			}
+
+			if (ret != ERROR_SUCCESS)
+				_QueueFinit(&_freeQueue);
+		}
+	} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	if (ret != ERROR_SUCCESS)
+		_BatchesFree();
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+/** Writes the remaining batches and stops the pipeline threads. Must be
+ *  called after the record consumer is stopped.
+ *
+ *  @param Statistics Receives occupancy of the stages and depths of the
+ *  queues. May be NULL.
+ */
+VOID MonitorFinit(PMONITOR_STATISTICS Statistics)
+{
+	ULONG workerCount = _workerCount;
+	ULONG64 duration = 0;
+	DEBUG_ENTER_FUNCTION("Statistics=0x%p", Statistics);
+
+	_ThreadsStop();
+	duration = _Now() - _startTime.QuadPart;
+	if (Statistics != NULL) {
+		memset(Statistics, 0, sizeof(MONITOR_STATISTICS));
+		Statistics->RecordCount = _recordCount;
+		Statistics->BatchCount = _deliveredBatchCount;
+		Statistics->Duration = _TicksToMicroseconds(duration);
+		Statistics->Fetch.ThreadCount = 1;
+		Statistics->Fetch.BusyTime = _TicksToMicroseconds(_fetchStatistics.BusyTime);
+		Statistics->Fetch.WaitTime = _TicksToMicroseconds(_fetchStatistics.WaitTime);
+		Statistics->Format.ThreadCount = workerCount;
+		for (ULONG i = 0; i < workerCount; ++i) {
+			Statistics->Format.BusyTime += _TicksToMicroseconds(_workerStatistics[i].BusyTime);
+			Statistics->Format.WaitTime += _TicksToMicroseconds(_workerStatistics[i].WaitTime);
+		}
+
+		Statistics->Write.ThreadCount = 1;
+		Statistics->Write.BusyTime = _TicksToMicroseconds(_writerStatistics.BusyTime);
+		Statistics->Write.WaitTime = _TicksToMicroseconds(_writerStatistics.WaitTime);
+		_QueueStatisticsGet(&_formatQueue, &Statistics->FormatQueue);
+		_QueueStatisticsGet(&_writeQueue, &Statistics->WriteQueue);
+		// Do not count the termination requests
+		Statistics->FormatQueue.PushCount -= workerCount;
+		--Statistics->WriteQueue.PushCount;
+	}
+
+	_QueueFinit(&_writeQueue);
+	_QueueFinit(&_formatQueue);
+	_QueueFinit(&_freeQueue);
+	_BatchesFree();
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
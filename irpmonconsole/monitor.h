@@ -0,0 +1,57 @@
+
+#ifndef __IRPMON_MONITOR_H__
+#define __IRPMON_MONITOR_H__
+
+#include <windows.h>
+#include "irpmondll-types.h"
+
+
+/** Maximum number of threads formatting the records. */
+#define MONITOR_WORKERS_MAX						64
+
+
+typedef struct _MONITOR_STAGE_STATISTICS {
+	/** Number of threads of the stage. */
+	ULONG ThreadCount;
+	/** Time the threads spent working, in microseconds. */
+	ULONG64 BusyTime;
+	/** Time the threads spent waiting for the other stages, in microseconds. */
+	ULONG64 WaitTime;
+} MONITOR_STAGE_STATISTICS, *PMONITOR_STAGE_STATISTICS;
+
+typedef struct _MONITOR_QUEUE_STATISTICS {
+	ULONG Capacity;
+	/** Number of batches inserted into the queue. */
+	ULONG64 PushCount;
+	/** Sum of the queue depths seen by the insertions, including the inserted
+	    batch. */
+	ULONG64 DepthSum;
+	ULONG MaxDepth;
+} MONITOR_QUEUE_STATISTICS, *PMONITOR_QUEUE_STATISTICS;
+
+typedef struct _MONITOR_STATISTICS {
+	ULONG64 RecordCount;
+	ULONG64 BatchCount;
+	/** Time from the initialization to the finalization, in microseconds. */
+	ULONG64 Duration;
+	/** The thread delivering the batches, waiting when all batches are in
+	    the pipeline. */
+	MONITOR_STAGE_STATISTICS Fetch;
+	/** The threads formatting the records, waiting for batches to format. */
+	MONITOR_STAGE_STATISTICS Format;
+	/** The thread writing the text, waiting for the next batch in order. */
+	MONITOR_STAGE_STATISTICS Write;
+	/** Batches waiting to be formatted. */
+	MONITOR_QUEUE_STATISTICS FormatQueue;
+	/** Formatted batches waiting to be written. */
+	MONITOR_QUEUE_STATISTICS WriteQueue;
+} MONITOR_STATISTICS, *PMONITOR_STATISTICS;
+
+
+VOID WINAPI MonitorBatch(PIRPMON_RECORD_BATCH Batch, PVOID Context);
+DWORD MonitorInit(ULONG WorkerCount);
+VOID MonitorFinit(PMONITOR_STATISTICS Statistics);
+
+
+
+#endif
@@ -0,0 +1,1063 @@
+
+/**
+ * @file
+ *
+ * Conversion of request records to human-readable UTF-8 text. Shared by
+ * irpmonconsole and irpmon-analyze.
+ *
+ * The fields printed for each type of request are described by tables, so
+ * a record is formatted by walking a table and writing each value straight
+ * into a reusable buffer, without any temporary strings.
+ */
+
+#include <string.h>
+#include <windows.h>
+#include "general-types.h"
+#include "libtranslate.h"
+#include "request-format.h"
+
+
+
+/************************************************************************/
+/*                           TYPE DEFINITIONS                           */
+/************************************************************************/
+
+/** Determines how a field value is read and converted to text. */
+typedef enum _EREQUEST_FIELD_FORMAT {
+	/** PVOID printed as 0x%p. */
+	rffPointer,
+	/** Lower 32 bits of a PVOID printed in lowercase hexadecimal. */
+	rffHex,
+	/** Lower 32 bits of a PVOID printed in decimal. */
+	rffDecimal,
+	/** Two PVOIDs forming a 64-bit value (the lower part first), printed
+	    in decimal. */
+	rffDecimal64,
+	/** The same as rffDecimal64, printed as a signed number. */
+	rffSignedDecimal64,
+	/** IRP byte offset that spans two PVOIDs on 64-bit systems, printed
+	    in lowercase hexadecimal. */
+	rffByteOffset,
+	/** Yes if the lower 32 bits of a PVOID are nonzero. */
+	rffYesNo,
+	/** Yes if the lower 32 bits of a PVOID have the Parameter bits set. */
+	rffFlagYesNo,
+	/** Read if the lower 32 bits of a PVOID are nonzero, Write otherwise. */
+	rffReadWrite,
+	/** Lower 32 bits of a PVOID translated as an I/O control code. */
+	rffIOCTL,
+	/** Lower 32 bits of a PVOID translated as a value of the Parameter
+	    enumeration type. */
+	rffEnumeration,
+	/** Lower 32 bits of a PVOID translated as a Parameter bit mask. */
+	rffBitMask,
+	/** LONG translated as NTSTATUS. */
+	rffNTSTATUS,
+	/** ULONG_PTR printed in decimal. */
+	rffUIntPtrDecimal,
+	/** UCHAR access mode. */
+	rffAccessMode,
+	/** EFastIoOperationType value. */
+	rffFastIoType,
+	/** UCHAR IRP major function. */
+	rffMajorFunction,
+	/** UCHAR IRP minor function, following the major one. */
+	rffMinorFunction,
+	/** ULONG IRP flags; Parameter is offset of the major function. */
+	rffIRPFlags,
+} EREQUEST_FIELD_FORMAT, *PEREQUEST_FIELD_FORMAT;
+
+/** Describes one line of the formatted request. */
+typedef struct _REQUEST_FIELD {
+	const char *Name;
+	USHORT NameLength;
+	/** EREQUEST_FIELD_FORMAT value. */
+	UCHAR Format;
+	/** Offset of the value, relative to the base given to _FieldsFormat. */
+	USHORT Offset;
+	/** Meaning depends on the format. */
+	USHORT Parameter;
+} REQUEST_FIELD, *PREQUEST_FIELD;
+
+typedef struct _REQUEST_FIELD_TABLE {
+	const REQUEST_FIELD *Fields;
+	ULONG Count;
+} REQUEST_FIELD_TABLE, *PREQUEST_FIELD_TABLE;
+
+/** Arguments of an IRP major function and how to print its minor function. */
+typedef struct _IRP_MAJOR_FORMAT {
+	REQUEST_FIELD_TABLE Arguments;
+	/** rffDecimal, rffEnumeration or rffBitMask. */
+	UCHAR MinorFormat;
+	USHORT MinorParameter;
+} IRP_MAJOR_FORMAT, *PIRP_MAJOR_FORMAT;
+
+/** Arguments of a fast I/O operation. */
+typedef struct _FASTIO_FORMAT {
+	REQUEST_FIELD_TABLE Arguments;
+	/** The IOSB is valid if the operation returned TRUE. */
+	BOOLEAN IOSB;
+} FASTIO_FORMAT, *PFASTIO_FORMAT;
+
+
+#define FIELD(aName, aFormat, aOffset, aParameter)		{aName, sizeof(aName) - 1, aFormat, (USHORT)(aOffset), (USHORT)(aParameter)}
+/** Offset of a request argument (numbered from one) relative to Arg1. */
+#define ARG(aNumber)									(((aNumber) - 1)*sizeof(PVOID))
+#define TABLE(aFields)									{aFields, sizeof(aFields) / sizeof(aFields[0])}
+#define TABLE_EMPTY										{NULL, 0}
+
+
+/************************************************************************/
+/*                           GLOBAL VARIABLES                           */
+/************************************************************************/
+
+static const char _decimalPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char _hexLower[] = "0123456789abcdef";
+static const char _hexUpper[] = "0123456789ABCDEF";
+
+static const char *_fastIoTypes[] = {
+	"FastIoCheckIfPossible",
+	"FastIoRead",
+	"FastIoWrite",
+	"FastIoQueryBasicInfo",
+	"FastIoQueryStandardInfo",
+	"FastIoLock",
+	"FastIoUnlockSingle",
+	"FastIoUnlockAll",
+	"FastIoUnlockAllByKey",
+	"FastIoDeviceControl",
+	"AcquireFileForNtCreateSection",
+	"ReleaseFileForNtCreateSection",
+	"FastIoDetachDevice",
+	"FastIoQueryNetworkOpenInfo",
+	"AcquireForModWrite",
+	"MdlRead",
+	"MdlReadComplete",
+	"PrepareMdlWrite",
+	"MdlWriteComplete",
+	"FastIoReadCompressed",
+	"FastIoWriteCompressed",
+	"MdlReadCompleteCompressed",
+	"MdlWriteCompleteCompressed",
+	"FastIoQueryOpen",
+	"ReleaseForModWrite",
+	"AcquireForCcFlush",
+	"ReleaseForCcFlush",
+};
+
+static const char *_accessModes[] = {
+	"KernelMode",
+	"UserMode",
+};
+
+/*
+ * Request records
+ */
+
+static const REQUEST_FIELD _irpFields[] = {
+	FIELD("IRP address", rffPointer, FIELD_OFFSET(REQUEST_IRP, IRPAddress), 0),
+	FIELD("File object", rffPointer, FIELD_OFFSET(REQUEST_IRP, FileObject), 0),
+	FIELD("Major function", rffMajorFunction, FIELD_OFFSET(REQUEST_IRP, MajorFunction), 0),
+	FIELD("Minor function", rffMinorFunction, FIELD_OFFSET(REQUEST_IRP, MajorFunction), 0),
+	FIELD("Flags", rffIRPFlags, FIELD_OFFSET(REQUEST_IRP, IrpFlags), FIELD_OFFSET(REQUEST_IRP, MajorFunction)),
+	FIELD("Access mode", rffAccessMode, FIELD_OFFSET(REQUEST_IRP, PreviousMode), 0),
+	FIELD("Requestor mode", rffAccessMode, FIELD_OFFSET(REQUEST_IRP, RequestorMode), 0),
+};
+
+static const REQUEST_FIELD _startIoFields[] = {
+	FIELD("IRP address", rffPointer, FIELD_OFFSET(REQUEST_STARTIO, IRPAddress), 0),
+	FIELD("File object", rffPointer, FIELD_OFFSET(REQUEST_STARTIO, FileObject), 0),
+	FIELD("Major function", rffMajorFunction, FIELD_OFFSET(REQUEST_STARTIO, MajorFunction), 0),
+	FIELD("Minor function", rffMinorFunction, FIELD_OFFSET(REQUEST_STARTIO, MajorFunction), 0),
+	FIELD("Flags", rffIRPFlags, FIELD_OFFSET(REQUEST_STARTIO, IrpFlags), FIELD_OFFSET(REQUEST_STARTIO, MajorFunction)),
+};
+
+static const REQUEST_FIELD _startIoTrailerFields[] = {
+	FIELD("IOSB status", rffNTSTATUS, FIELD_OFFSET(REQUEST_STARTIO, Status), 0),
+	FIELD("IOSB information", rffPointer, FIELD_OFFSET(REQUEST_STARTIO, Information), 0),
+};
+
+static const REQUEST_FIELD _irpCompletionFields[] = {
+	FIELD("IRP address", rffPointer, FIELD_OFFSET(REQUEST_IRP_COMPLETION, IRPAddress), 0),
+	FIELD("Completion information", rffPointer, FIELD_OFFSET(REQUEST_IRP_COMPLETION, CompletionInformation), 0),
+	FIELD("Completion status", rffNTSTATUS, FIELD_OFFSET(REQUEST_IRP_COMPLETION, CompletionStatus), 0),
+};
+
+static const REQUEST_FIELD _fastIoFields[] = {
+	FIELD("Type", rffFastIoType, FIELD_OFFSET(REQUEST_FASTIO, FastIoType), 0),
+	FIELD("File object", rffPointer, FIELD_OFFSET(REQUEST_FASTIO, FileObject), 0),
+	FIELD("Access mode", rffAccessMode, FIELD_OFFSET(REQUEST_FASTIO, PreviousMode), 0),
+};
+
+static const REQUEST_FIELD _fastIoIOSBFields[] = {
+	FIELD("IOSB Status", rffNTSTATUS, FIELD_OFFSET(REQUEST_FASTIO, IOSBStatus), 0),
+	FIELD("IOSB Information", rffUIntPtrDecimal, FIELD_OFFSET(REQUEST_FASTIO, IOSBInformation), 0),
+};
+
+/*
+ * IRP arguments
+ */
+
+static const REQUEST_FIELD _irpCreateArgs[] = {
+	FIELD("Security context", rffPointer, ARG(1), 0),
+	FIELD("Options", rffPointer, ARG(2), 0),
+	FIELD("File attributes", rffPointer, ARG(3), 0),
+	FIELD("EA length", rffDecimal, ARG(4), 0),
+};
+
+static const REQUEST_FIELD _irpReadWriteArgs[] = {
+	FIELD("Length", rffDecimal, ARG(1), 0),
+	FIELD("Key", rffDecimal, ARG(2), 0),
+	FIELD("Byte offset", rffByteOffset, ARG(3), 0),
+};
+
+static const REQUEST_FIELD _irpInformationArgs[] = {
+	FIELD("Length", rffDecimal, ARG(1), 0),
+	FIELD("File information class", rffEnumeration, ARG(2), ltetFileInformationClass),
+};
+
+static const REQUEST_FIELD _irpVolumeInformationArgs[] = {
+	FIELD("Length", rffDecimal, ARG(1), 0),
+	FIELD("Volume information class", rffEnumeration, ARG(2), ltetFileVolumeInformationClass),
+};
+
+static const REQUEST_FIELD _irpDeviceControlArgs[] = {
+	FIELD("Output buffer length", rffDecimal, ARG(1), 0),
+	FIELD("Input buffer length", rffDecimal, ARG(2), 0),
+	FIELD("IOCTL", rffIOCTL, ARG(3), 0),
+	FIELD("Type3InputBuffer", rffPointer, ARG(4), 0),
+};
+
+/** IRP_MN_MOUNT_VOLUME and IRP_MN_VERIFY_VOLUME */
+static const REQUEST_FIELD _irpFsVolumeArgs[] = {
+	FIELD("Device object", rffPointer, ARG(2), 0),
+};
+
+/** IRP_MN_USER_FS_REQUEST and IRP_MN_KERNEL_CALL */
+static const REQUEST_FIELD _irpFsControlArgs[] = {
+	FIELD("Output buffer length", rffDecimal, ARG(1), 0),
+	FIELD("Input buffer length", rffDecimal, ARG(2), 0),
+	FIELD("FSCTL", rffHex, ARG(3), 0),
+	FIELD("Type3InputBuffer", rffPointer, ARG(4), 0),
+};
+
+static const REQUEST_FIELD _irpPnPRelationsArgs[] = {
+	FIELD("Device relation type", rffDecimal, ARG(1), 0),
+};
+
+static const REQUEST_FIELD _irpPnPTextArgs[] = {
+	FIELD("Device text type", rffDecimal, ARG(1), 0),
+};
+
+static const REQUEST_FIELD _irpPnPLockArgs[] = {
+	FIELD("Lock", rffDecimal, ARG(1), 0),
+};
+
+static const REQUEST_FIELD _irpPnPIdArgs[] = {
+	FIELD("Device ID type", rffDecimal, ARG(1), 0),
+};
+
+/** Indexed by the major function. The arguments of IRP_MJ_FILE_SYSTEM_CONTROL
+    and IRP_MJ_PNP depend on the minor function and are chosen in code. */
+static const IRP_MAJOR_FORMAT _irpMajorFormats[IRP_MJ_MAXIMUM_FUNCTION + 1] = {
+	{TABLE(_irpCreateArgs), rffDecimal, 0},                                        // IRP_MJ_CREATE
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_CREATE_NAMED_PIPE
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_CLOSE
+	{TABLE(_irpReadWriteArgs), rffBitMask, ltbtIRPReadMinorFunction},              // IRP_MJ_READ
+	{TABLE(_irpReadWriteArgs), rffBitMask, ltbtIRPWriteMinorFunction},             // IRP_MJ_WRITE
+	{TABLE(_irpInformationArgs), rffDecimal, 0},                                   // IRP_MJ_QUERY_INFORMATION
+	{TABLE(_irpInformationArgs), rffDecimal, 0},                                   // IRP_MJ_SET_INFORMATION
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_QUERY_EA
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_SET_EA
+	{TABLE_EMPTY, rffEnumeration, ltetIRPFlushMinorFunction},                      // IRP_MJ_FLUSH_BUFFERS
+	{TABLE(_irpVolumeInformationArgs), rffDecimal, 0},                             // IRP_MJ_QUERY_VOLUME_INFORMATION
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_SET_VOLUME_INFORMATION
+	{TABLE_EMPTY, rffEnumeration, ltetIRPDirectoryMinorFunction},                  // IRP_MJ_DIRECTORY_CONTROL
+	{TABLE_EMPTY, rffEnumeration, ltetIRPFileSystemMinorFunction},                 // IRP_MJ_FILE_SYSTEM_CONTROL
+	{TABLE(_irpDeviceControlArgs), rffDecimal, 0},                                 // IRP_MJ_DEVICE_CONTROL
+	{TABLE(_irpDeviceControlArgs), rffDecimal, 0},                                 // IRP_MJ_INTERNAL_DEVICE_CONTROL
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_SHUTDOWN
+	{TABLE_EMPTY, rffEnumeration, ltetIRPLockMinorFunction},                       // IRP_MJ_LOCK_CONTROL
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_CLEANUP
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_CREATE_MAILSLOT
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_QUERY_SECURITY
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_SET_SECURITY
+	{TABLE_EMPTY, rffEnumeration, ltetIRPPowerMinorFunction},                      // IRP_MJ_POWER
+	{TABLE_EMPTY, rffEnumeration, ltetIRPSystemMinorFunction},                     // IRP_MJ_SYSTEM_CONTROL
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_DEVICE_CHANGE
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_QUERY_QUOTA
+	{TABLE_EMPTY, rffDecimal, 0},                                                  // IRP_MJ_SET_QUOTA
+	{TABLE_EMPTY, rffEnumeration, ltetIRPPnPMinorFunction},                        // IRP_MJ_PNP
+};
+
+/*
+ * Fast I/O arguments
+ */
+
+static const REQUEST_FIELD _fastIoCheckIfPossibleArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Length", rffDecimal, ARG(3), 0),
+	FIELD("Operation", rffReadWrite, ARG(4), 0),
+	FIELD("Wait", rffYesNo, ARG(5), 0),
+	FIELD("Lock key", rffDecimal, ARG(6), 0),
+};
+
+static const REQUEST_FIELD _fastIoReadWriteArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Length", rffDecimal, ARG(3), 0),
+	FIELD("Lock key", rffDecimal, ARG(4), 0),
+	FIELD("Wait", rffYesNo, ARG(5), 0),
+	FIELD("Buffer", rffPointer, ARG(6), 0),
+};
+
+/** Query operations that did not succeed. */
+static const REQUEST_FIELD _fastIoQueryArgs[] = {
+	FIELD("Buffer", rffPointer, ARG(1), 0),
+	FIELD("Wait", rffYesNo, ARG(2), 0),
+};
+
+/** FastIoQueryBasicInfo, FastIoQueryNetworkOpenInfo and FastIoQueryOpen
+    that succeeded. */
+static const REQUEST_FIELD _fastIoBasicInfoArgs[] = {
+	FIELD("Creation time", rffDecimal64, ARG(1), 0),
+	FIELD("Last access time", rffSignedDecimal64, ARG(3), 0),
+	FIELD("Last write time", rffDecimal64, ARG(5), 0),
+	FIELD("File attributes", rffBitMask, ARG(7), ltbtFileAttributes),
+};
+
+static const REQUEST_FIELD _fastIoStandardInfoArgs[] = {
+	FIELD("Allocation size", rffDecimal64, ARG(1), 0),
+	FIELD("End of file", rffSignedDecimal64, ARG(3), 0),
+	FIELD("Number of links", rffDecimal, ARG(5), 0),
+	FIELD("Directory", rffYesNo, ARG(6), 0),
+	FIELD("DeletePending", rffYesNo, ARG(7), 0),
+};
+
+static const REQUEST_FIELD _fastIoLockArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Length", rffDecimal64, ARG(3), 0),
+	FIELD("Fail immediately", rffFlagYesNo, ARG(5), 2),
+	FIELD("Exclusive", rffFlagYesNo, ARG(5), 1),
+	FIELD("ProcessId", rffPointer, ARG(6), 0),
+	FIELD("Lock key", rffDecimal, ARG(7), 0),
+};
+
+static const REQUEST_FIELD _fastIoUnlockSingleArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Length", rffDecimal64, ARG(3), 0),
+	FIELD("ProcessId", rffPointer, ARG(5), 0),
+	FIELD("Lock key", rffDecimal, ARG(6), 0),
+};
+
+static const REQUEST_FIELD _fastIoUnlockAllArgs[] = {
+	FIELD("ProcessId", rffPointer, ARG(1), 0),
+};
+
+static const REQUEST_FIELD _fastIoUnlockAllByKeyArgs[] = {
+	FIELD("ProcessId", rffPointer, ARG(1), 0),
+	FIELD("Lock key", rffDecimal, ARG(2), 0),
+};
+
+static const REQUEST_FIELD _fastIoDeviceControlArgs[] = {
+	FIELD("IOCTL", rffIOCTL, ARG(1), 0),
+	FIELD("Input buffer length", rffDecimal, ARG(2), 0),
+	FIELD("Output buffer length", rffDecimal, ARG(3), 0),
+	FIELD("Wait", rffYesNo, ARG(5), 0),
+};
+
+static const REQUEST_FIELD _fastIoDetachDeviceArgs[] = {
+	FIELD("Source device", rffPointer, ARG(1), 0),
+	FIELD("Target device", rffPointer, ARG(2), 0),
+};
+
+/** The lock is present only if the operation succeeded. */
+static const REQUEST_FIELD _fastIoAcquireForModWriteArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Lock", rffPointer, ARG(3), 0),
+};
+
+static const REQUEST_FIELD _fastIoMdlReadArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Length", rffDecimal, ARG(3), 0),
+	FIELD("Lock key", rffDecimal, ARG(4), 0),
+	FIELD("MDL", rffPointer, ARG(5), 0),
+};
+
+static const REQUEST_FIELD _fastIoMdlReadCompleteArgs[] = {
+	FIELD("MDL", rffPointer, ARG(1), 0),
+};
+
+static const REQUEST_FIELD _fastIoMdlWriteCompleteArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("MDL", rffPointer, ARG(3), 0),
+};
+
+/** The MDL is present only if the IOSB status indicates success. */
+static const REQUEST_FIELD _fastIoCompressedArgs[] = {
+	FIELD("File offset", rffDecimal64, ARG(1), 0),
+	FIELD("Length", rffDecimal, ARG(3), 0),
+	FIELD("Lock key", rffDecimal, ARG(4), 0),
+	FIELD("Buffer", rffPointer, ARG(5), 0),
+	FIELD("Compressed info length", rffDecimal, ARG(6), 0),
+	FIELD("MDL", rffPointer, ARG(7), 0),
+};
+
+/** FastIoQueryOpen that returned FALSE. */
+static const REQUEST_FIELD _fastIoQueryOpenArgs[] = {
+	FIELD("IRP address", rffPointer, ARG(1), 0),
+	FIELD("Buffer", rffPointer, ARG(2), 0),
+};
+
+static const REQUEST_FIELD _fastIoReleaseForModWriteArgs[] = {
+	FIELD("Lock", rffPointer, ARG(1), 0),
+};
+
+/** Indexed by EFastIoOperationType. Operations whose arguments depend on
+    the result are adjusted in code. */
+static const FASTIO_FORMAT _fastIoFormats[FastIoMax] = {
+	{TABLE(_fastIoCheckIfPossibleArgs), TRUE},     // FastIoCheckIfPossible
+	{TABLE(_fastIoReadWriteArgs), TRUE},           // FastIoRead
+	{TABLE(_fastIoReadWriteArgs), TRUE},           // FastIoWrite
+	{TABLE(_fastIoBasicInfoArgs), TRUE},           // FastIoQueryBasicInfo
+	{TABLE(_fastIoStandardInfoArgs), TRUE},        // FastIoQueryStandardInfo
+	{TABLE(_fastIoLockArgs), TRUE},                // FastIoLock
+	{TABLE(_fastIoUnlockSingleArgs), TRUE},        // FastIoUnlockSingle
+	{TABLE(_fastIoUnlockAllArgs), TRUE},           // FastIoUnlockAll
+	{TABLE(_fastIoUnlockAllByKeyArgs), TRUE},      // FastIoUnlockAllByKey
+	{TABLE(_fastIoDeviceControlArgs), TRUE},       // FastIoDeviceControl
+	{TABLE_EMPTY, FALSE},                          // AcquireFileForNtCreateSection
+	{TABLE_EMPTY, FALSE},                          // ReleaseFileForNtCreateSection
+	{TABLE(_fastIoDetachDeviceArgs), FALSE},       // FastIoDetachDevice
+	{TABLE(_fastIoBasicInfoArgs), TRUE},           // FastIoQueryNetworkOpenInfo
+	{TABLE(_fastIoAcquireForModWriteArgs), FALSE}, // AcquireForModWrite
+	{TABLE(_fastIoMdlReadArgs), TRUE},             // MdlRead
+	{TABLE(_fastIoMdlReadCompleteArgs), FALSE},    // MdlReadComplete
+	{TABLE(_fastIoMdlReadArgs), TRUE},             // PrepareMdlWrite
+	{TABLE(_fastIoMdlWriteCompleteArgs), FALSE},   // MdlWriteComplete
+	{TABLE(_fastIoCompressedArgs), TRUE},          // FastIoReadCompressed
+	{TABLE(_fastIoCompressedArgs), TRUE},          // FastIoWriteCompressed
+	{TABLE(_fastIoMdlReadCompleteArgs), FALSE},    // MdlReadCompleteCompressed
+	{TABLE(_fastIoMdlWriteCompleteArgs), FALSE},   // MdlWriteCompleteCompressed
+	{TABLE(_fastIoBasicInfoArgs), FALSE},          // FastIoQueryOpen
+	{TABLE(_fastIoReleaseForModWriteArgs), FALSE}, // ReleaseForModWrite
+	{TABLE_EMPTY, FALSE},                          // AcquireForCcFlush
+	{TABLE_EMPTY, FALSE},                          // ReleaseForCcFlush
+};
+
+
+/************************************************************************/
+/*                           HELPER FUNCTIONS                           */
+/************************************************************************/
+
+/*
+ * Number conversion. The routines write the digits backwards, ending just
+ * before the End pointer, and return the first character.
+ */
+
+static char *_DecimalFormat(ULONG64 Value, char *End)
+{
+	char *ret = End;
+
+	while (Value >= 100) {
+		const char *pair = _decimalPairs + (Value % 100)*2;
+
+		Value /= 100;
+		*--ret = pair[1];
+		*--ret = pair[0];
+	}
+
+	if (Value >= 10) {
+		*--ret = _decimalPairs[Value*2 + 1];
+		*--ret = _decimalPairs[Value*2];
+	} else *--ret = (char)('0' + Value);
+
+	return ret;
+}
+
+static char *_SignedDecimalFormat(LONG64 Value, char *End)
+{
+	char *ret = NULL;
+
+	if (Value < 0) {
+		ret = _DecimalFormat(0 - (ULONG64)Value, End);
+		*--ret = '-';
+	} else ret = _DecimalFormat((ULONG64)Value, End);
+
+	return ret;
+}
+
+/** Formats a number surrounded by the given texts. */
+static char *_LabelledNumberFormat(const char *Prefix, LONG64 Value, const char *Suffix, char *End)
+{
+	char *ret = NULL;
+	SIZE_T length = 0;
+
+	length = strlen(Suffix);
+	ret = _SignedDecimalFormat(Value, End - length);
+	memcpy(End - length, Suffix, length);
+	length = strlen(Prefix);
+	ret -= length;
+	memcpy(ret, Prefix, length);
+
+	return ret;
+}
+
+/** Formats a number as 0x followed by at least Digits hexadecimal digits. */
+static char *_HexFormat(ULONG64 Value, ULONG Digits, const char *Alphabet, char *End)
+{
+	char *ret = End;
+
+	do {
+		*--ret = Alphabet[Value & 0xf];
+		Value >>= 4;
+		if (Digits > 0)
+			--Digits;
+	} while (Value != 0 || Digits > 0);
+
+	*--ret = 'x';
+	*--ret = '0';
+
+	return ret;
+}
+
+/** Formats a pointer the way the printf family does for "0x%p". */
+static char *_PointerFormat(ULONG_PTR Value, char *End)
+{
+	return _HexFormat(Value, sizeof(PVOID)*2, _hexUpper, End);
+}
+
+/*
+ * Buffer management
+ */
+
+static BOOLEAN _BufferReserve(PREQUEST_FORMAT_BUFFER Buffer, SIZE_T Length)
+{
+	SIZE_T capacity = 0;
+	PCHAR data = NULL;
+	BOOLEAN ret = TRUE;
+
+	if (Buffer->Capacity - Buffer->Length < Length) {
+		capacity = (Buffer->Capacity > 0) ? Buffer->Capacity : 4096;
+		while (capacity - Buffer->Length < Length)
+			capacity *= 2;
+
+		if (Buffer->Data != NULL)
+			data = (PCHAR)HeapReAlloc(GetProcessHeap(), 0, Buffer->Data, capacity);
+		else data = (PCHAR)HeapAlloc(GetProcessHeap(), 0, capacity);
+
+		ret = (data != NULL);
+		if (ret) {
+			Buffer->Data = data;
+			Buffer->Capacity = capacity;
+		}
+	}
+
+	return ret;
+}
+
+static BOOLEAN _BufferAppend(PREQUEST_FORMAT_BUFFER Buffer, const char *Text, SIZE_T Length)
+{
+	BOOLEAN ret = FALSE;
+
+	ret = _BufferReserve(Buffer, Length);
+	if (ret) {
+		memcpy(Buffer->Data + Buffer->Length, Text, Length);
+		Buffer->Length += Length;
+	}
+
+	return ret;
+}
+
+/** Appends a "  Name: Value" line. */
+static BOOLEAN _LineAppend(PREQUEST_FORMAT_BUFFER Buffer, const char *Name, SIZE_T NameLength, const char *Value, SIZE_T ValueLength)
+{
+	PCHAR pos = NULL;
+	BOOLEAN ret = FALSE;
+
+	ret = _BufferReserve(Buffer, NameLength + ValueLength + 5);
+	if (ret) {
+		pos = Buffer->Data + Buffer->Length;
+		*pos++ = ' ';
+		*pos++ = ' ';
+		memcpy(pos, Name, NameLength);
+		pos += NameLength;
+		*pos++ = ':';
+		*pos++ = ' ';
+		// The value may already be in place, see _BitMaskLineAppend
+		memmove(pos, Value, ValueLength);
+		pos += ValueLength;
+		*pos++ = '\n';
+		Buffer->Length = pos - Buffer->Data;
+	}
+
+	return ret;
+}
+
+/** Appends a line with a bit mask, or IRP flags if the Type is negative.
+ *  The text is translated right into the buffer.
+ */
+static BOOLEAN _BitMaskLineAppend(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_FIELD *Field, int Type, ULONG Value, UCHAR MajorFunction, UCHAR MinorFunction)
+{
+	ULONG required = 256;
+	SIZE_T prefixLength = 0;
+	DWORD err = ERROR_GEN_FAILURE;
+	BOOLEAN ret = FALSE;
+
+	prefixLength = Field->NameLength + 4;
+	do {
+		ret = _BufferReserve(Buffer, prefixLength + required + 1);
+		if (!ret)
+			break;
+
+		PCHAR text = Buffer->Data + Buffer->Length + prefixLength;
+		ULONG textLength = (ULONG)(Buffer->Capacity - Buffer->Length - prefixLength);
+
+		if (Type >= 0)
+			err = LibTranslateBitMaskValueToBufferUTF8((ELibTranslateBitMaskType)Type, FALSE, Value, text, textLength, &required);
+		else err = LibTranslateIRPFlagsToBufferUTF8(MajorFunction, MinorFunction, Value, FALSE, text, textLength, &required);
+	} while (err == ERROR_INSUFFICIENT_BUFFER);
+
+	if (ret) {
+		// The value ends with the terminator, replaced by the end of the line
+		required = (err == ERROR_SUCCESS && required > 0) ? required - 1 : 0;
+		ret = _LineAppend(Buffer, Field->Name, Field->NameLength, Buffer->Data + Buffer->Length + prefixLength, required);
+	}
+
+	return ret;
+}
+
+static BOOLEAN _StringLineAppend(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_FIELD *Field, const char *Value)
+{
+	if (Value == NULL)
+		Value = "";
+
+	return _LineAppend(Buffer, Field->Name, Field->NameLength, Value, strlen(Value));
+}
+
+static ULONG_PTR _PointerRead(const UCHAR *Base, USHORT Offset)
+{
+	return *(const ULONG_PTR *)(Base + Offset);
+}
+
+static ULONG64 _Pointer64Read(const UCHAR *Base, USHORT Offset)
+{
+	return (ULONG64)_PointerRead(Base, Offset) + ((ULONG64)_PointerRead(Base, Offset + sizeof(PVOID)) << 32);
+}
+
+static BOOLEAN _FieldFormat(PREQUEST_FORMAT_BUFFER Buffer, const UCHAR *Base, const REQUEST_FIELD *Field)
+{
+	char number[48];
+	char *end = number + sizeof(number);
+	char *start = end;
+	const char *value = NULL;
+	UCHAR majorFunction = 0;
+	UCHAR minorFunction = 0;
+	const IRP_MAJOR_FORMAT *majorFormat = NULL;
+	BOOLEAN appended = FALSE;
+	BOOLEAN ret = FALSE;
+
+	switch (Field->Format) {
+		case rffPointer:
+			start = _PointerFormat(_PointerRead(Base, Field->Offset), end);
+			break;
+		case rffHex:
+			start = _HexFormat((ULONG)_PointerRead(Base, Field->Offset), 0, _hexLower, end);
+			break;
+		case rffDecimal:
+			start = _DecimalFormat((ULONG)_PointerRead(Base, Field->Offset), end);
+			break;
+		case rffDecimal64:
+			start = _DecimalFormat(_Pointer64Read(Base, Field->Offset), end);
+			break;
+		case rffSignedDecimal64:
+			start = _SignedDecimalFormat((LONG64)_Pointer64Read(Base, Field->Offset), end);
+			break;
+		case rffByteOffset:
+			if (sizeof(PVOID) == 8)
+				start = _HexFormat(_Pointer64Read(Base, Field->Offset), 0, _hexLower, end);
+			else start = _HexFormat(_PointerRead(Base, Field->Offset), 0, _hexLower, end);
+			break;
+		case rffYesNo:
+			value = ((ULONG)_PointerRead(Base, Field->Offset) != 0) ? "Yes" : "No";
+			break;
+		case rffFlagYesNo:
+			value = (((ULONG)_PointerRead(Base, Field->Offset) & Field->Parameter) != 0) ? "Yes" : "No";
+			break;
+		case rffReadWrite:
+			value = ((ULONG)_PointerRead(Base, Field->Offset) != 0) ? "Read" : "Write";
+			break;
+		case rffIOCTL:
+			value = LibTranslateGeneralIntegerValueToStringUTF8(ltivtDeviceControl, FALSE, (ULONG)_PointerRead(Base, Field->Offset));
+			break;
+		case rffEnumeration:
+			value = LibTranslateEnumerationValueToStringUTF8((ELibTranslateEnumerationType)Field->Parameter, FALSE, (ULONG)_PointerRead(Base, Field->Offset));
+			break;
+		case rffBitMask:
+			ret = _BitMaskLineAppend(Buffer, Field, Field->Parameter, (ULONG)_PointerRead(Base, Field->Offset), 0, 0);
+			appended = TRUE;
+			break;
+		case rffNTSTATUS:
+			value = LibTranslateGeneralIntegerValueToStringUTF8(ltivtNTSTATUS, FALSE, *(const ULONG *)(Base + Field->Offset));
+			break;
+		case rffUIntPtrDecimal:
+			start = _DecimalFormat(_PointerRead(Base, Field->Offset), end);
+			break;
+		case rffAccessMode: {
+			UCHAR mode = Base[Field->Offset];
+
+			if (mode < sizeof(_accessModes) / sizeof(_accessModes[0]))
+				value = _accessModes[mode];
+			else start = _LabelledNumberFormat("<unknown> (", mode, ")", end);
+		} break;
+		case rffFastIoType: {
+			EFastIoOperationType type = *(const EFastIoOperationType *)(Base + Field->Offset);
+
+			if ((ULONG)type < FastIoMax)
+				value = _fastIoTypes[type];
+			else start = _LabelledNumberFormat("<nknown> (", (LONG)type, ")", end);
+		} break;
+		case rffMajorFunction:
+			value = LibTranslateGeneralIntegerValueToStringUTF8(ltivtFileIRPMajorFunction, FALSE, Base[Field->Offset]);
+			break;
+		case rffMinorFunction:
+			majorFunction = Base[Field->Offset];
+			minorFunction = Base[Field->Offset + 1];
+			if (majorFunction <= IRP_MJ_MAXIMUM_FUNCTION) {
+				majorFormat = _irpMajorFormats + majorFunction;
+				switch (majorFormat->MinorFormat) {
+					case rffEnumeration:
+						value = LibTranslateEnumerationValueToStringUTF8((ELibTranslateEnumerationType)majorFormat->MinorParameter, FALSE, minorFunction);
+						break;
+					case rffBitMask:
+						ret = _BitMaskLineAppend(Buffer, Field, majorFormat->MinorParameter, minorFunction, 0, 0);
+						appended = TRUE;
+						break;
+				}
+			}
+
+			if (!appended && value == NULL && (majorFormat == NULL || majorFormat->MinorFormat == rffDecimal))
+				start = _DecimalFormat(minorFunction, end);
+			break;
+		case rffIRPFlags:
+			majorFunction = Base[Field->Parameter];
+			minorFunction = Base[Field->Parameter + 1];
+			ret = _BitMaskLineAppend(Buffer, Field, -1, *(const ULONG *)(Base + Field->Offset) & (~0x60000), majorFunction, minorFunction);
+			appended = TRUE;
+			break;
+	}
+
+	if (!appended) {
+		if (value == NULL)
+			ret = _LineAppend(Buffer, Field->Name, Field->NameLength, start, end - start);
+		else ret = _StringLineAppend(Buffer, Field, value);
+	}
+
+	return ret;
+}
+
+static BOOLEAN _FieldsFormat(PREQUEST_FORMAT_BUFFER Buffer, const void *Base, const REQUEST_FIELD *Fields, ULONG Count)
+{
+	BOOLEAN ret = TRUE;
+
+	for (ULONG i = 0; i < Count; ++i) {
+		ret = _FieldFormat(Buffer, (const UCHAR *)Base, Fields + i);
+		if (!ret)
+			break;
+	}
+
+	return ret;
+}
+
+static REQUEST_FIELD_TABLE _IRPArgumentsGet(UCHAR MajorFunction, UCHAR MinorFunction)
+{
+	REQUEST_FIELD_TABLE ret = TABLE_EMPTY;
+
+	switch (MajorFunction) {
+		case IRP_MJ_FILE_SYSTEM_CONTROL:
+			if (MinorFunction == 1 || MinorFunction == 2) {
+				ret.Fields = _irpFsVolumeArgs;
+				ret.Count = sizeof(_irpFsVolumeArgs) / sizeof(_irpFsVolumeArgs[0]);
+			} else if (MinorFunction == 0 || MinorFunction == 4) {
+				ret.Fields = _irpFsControlArgs;
+				ret.Count = sizeof(_irpFsControlArgs) / sizeof(_irpFsControlArgs[0]);
+			}
+			break;
+		case IRP_MJ_PNP:
+			switch (MinorFunction) {
+				case 0x7:
+					ret.Fields = _irpPnPRelationsArgs;
+					break;
+				case 0x0C:
+					ret.Fields = _irpPnPTextArgs;
+					break;
+				case 0x12:
+					ret.Fields = _irpPnPLockArgs;
+					break;
+				case 0x13:
+					ret.Fields = _irpPnPIdArgs;
+					break;
+			}
+
+			if (ret.Fields != NULL)
+				ret.Count = 1;
+			break;
+		default:
+			if (MajorFunction <= IRP_MJ_MAXIMUM_FUNCTION)
+				ret = _irpMajorFormats[MajorFunction].Arguments;
+			break;
+	}
+
+	return ret;
+}
+
+static REQUEST_FIELD_TABLE _FastIoArgumentsGet(const REQUEST_FASTIO *Request, PBOOLEAN IOSB)
+{
+	BOOLEAN succeeded = FALSE;
+	const FASTIO_FORMAT *format = NULL;
+	REQUEST_FIELD_TABLE ret = TABLE_EMPTY;
+
+	*IOSB = FALSE;
+	if ((ULONG)Request->FastIoType < FastIoMax) {
+		format = _fastIoFormats + Request->FastIoType;
+		ret = format->Arguments;
+		*IOSB = (format->IOSB && Request->Header.Result.BOOLEANValue != FALSE);
+		succeeded = (*IOSB && Request->IOSBStatus >= 0);
+		switch (Request->FastIoType) {
+			case FastIoQueryBasicInfo:
+			case FastIoQueryStandardInfo:
+			case FastIoQueryNetworkOpenInfo:
+				if (!succeeded) {
+					ret.Fields = _fastIoQueryArgs;
+					ret.Count = sizeof(_fastIoQueryArgs) / sizeof(_fastIoQueryArgs[0]);
+				}
+				break;
+			case AcquireForModWrite:
+				if (Request->Header.Result.NTSTATUSValue < 0)
+					--ret.Count;
+				break;
+			case FastIoReadCompressed:
+			case FastIoWriteCompressed:
+				if (Request->IOSBStatus < 0)
+					--ret.Count;
+				break;
+			case FastIoQueryOpen:
+				if (!Request->Header.Result.BOOLEANValue) {
+					ret.Fields = _fastIoQueryOpenArgs;
+					ret.Count = sizeof(_fastIoQueryOpenArgs) / sizeof(_fastIoQueryOpenArgs[0]);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return ret;
+}
+
+static BOOLEAN _ResultFormat(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_HEADER *Header)
+{
+	const char *value = NULL;
+
+	switch (Header->ResultType) {
+		case rrtNTSTATUS:
+			value = LibTranslateGeneralIntegerValueToStringUTF8(ltivtNTSTATUS, FALSE, Header->Result.NTSTATUSValue);
+			break;
+		case rrtBOOLEAN:
+			value = (Header->Result.BOOLEANValue) ? "TRUE" : "FALSE";
+			break;
+		default:
+			value = "None";
+			break;
+	}
+
+	if (value == NULL)
+		value = "";
+
+	return _LineAppend(Buffer, "Result", sizeof("Result") - 1, value, strlen(value));
+}
+
+static BOOLEAN _NameAppend(PREQUEST_FORMAT_BUFFER Buffer, const char *Name, PVOID Address, const char *Separator)
+{
+	char number[24];
+	char *end = number + sizeof(number);
+	char *start = NULL;
+	BOOLEAN ret = FALSE;
+
+	if (Name != NULL && *Name != '\0')
+		ret = _BufferAppend(Buffer, Name, strlen(Name));
+	else {
+		*--end = ')';
+		start = _PointerFormat((ULONG_PTR)Address, end);
+		*--start = '(';
+		ret = _BufferAppend(Buffer, start, number + sizeof(number) - start);
+	}
+
+	if (ret)
+		ret = _BufferAppend(Buffer, Separator, strlen(Separator));
+
+	return ret;
+}
+
+
+/************************************************************************/
+/*                           PUBLIC FUNCTIONS                           */
+/************************************************************************/
+
+/** Appends the first line of a request, with its type and the names of the
+ *  driver and device it is associated with.
+ *
+ *  @param DriverName UTF-8 name of the driver. If NULL or empty, the address
+ *  of the driver object is used instead.
+ *  @param DeviceName UTF-8 name of the device. If NULL or empty, the address
+ *  of the device object is used instead.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_NOT_ENOUGH_MEMORY, in which case the
+ *  buffer is left unchanged.
+ */
+DWORD RequestFormatHeader(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_HEADER *Header, const char *DriverName, const char *DeviceName)
+{
+	char number[32];
+	char *end = number + sizeof(number);
+	char *start = NULL;
+	const char *type = NULL;
+	SIZE_T length = Buffer->Length;
+	BOOLEAN succeeded = FALSE;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	switch (Header->Type) {
+		case ertIRP:
+			type = "IRP: ";
+			break;
+		case ertIRPCompletion:
+			type = "IRPCOMPLETE: ";
+			break;
+		case ertFastIo:
+			type = "FASTIO: ";
+			break;
+		case ertAddDevice:
+			type = "ADDDEVICE: ";
+			break;
+		case ertStartIo:
+			type = "STARTIO: ";
+			break;
+		case ertDriverUnload:
+			type = "UNLOAD: ";
+			break;
+		default:
+			break;
+	}
+
+	if (type == NULL) {
+		start = _LabelledNumberFormat("UNKNOWN (", (ULONG)Header->Type, "): ", end);
+		succeeded = _BufferAppend(Buffer, start, end - start);
+	} else succeeded = _BufferAppend(Buffer, type, strlen(type));
+
+	if (succeeded)
+		succeeded = _NameAppend(Buffer, DriverName, Header->Driver, ": ");
+
+	if (succeeded)
+		succeeded = _NameAppend(Buffer, DeviceName, Header->Device, "\n");
+
+	ret = (succeeded) ? ERROR_SUCCESS : ERROR_NOT_ENOUGH_MEMORY;
+	if (ret != ERROR_SUCCESS)
+		Buffer->Length = length;
+
+	return ret;
+}
+
+/** Appends the fields of a request as "  Name: Value" lines, followed by its
+ *  result and an empty line.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_NOT_ENOUGH_MEMORY, in which case the
+ *  buffer is left unchanged.
+ */
+DWORD RequestFormatDetails(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_HEADER *Header)
+{
+	BOOLEAN iosb = FALSE;
+	REQUEST_FIELD_TABLE args = TABLE_EMPTY;
+	SIZE_T length = Buffer->Length;
+	BOOLEAN succeeded = TRUE;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	switch (Header->Type) {
+		case ertIRP: {
+			const REQUEST_IRP *r = CONTAINING_RECORD(Header, REQUEST_IRP, Header);
+
+			args = _IRPArgumentsGet(r->MajorFunction, r->MinorFunction);
+			succeeded = _FieldsFormat(Buffer, r, _irpFields, sizeof(_irpFields) / sizeof(_irpFields[0]));
+			if (succeeded)
+				succeeded = _FieldsFormat(Buffer, &r->Arg1, args.Fields, args.Count);
+		} break;
+		case ertIRPCompletion: {
+			const REQUEST_IRP_COMPLETION *r = CONTAINING_RECORD(Header, REQUEST_IRP_COMPLETION, Header);
+
+			succeeded = _FieldsFormat(Buffer, r, _irpCompletionFields, sizeof(_irpCompletionFields) / sizeof(_irpCompletionFields[0]));
+		} break;
+		case ertFastIo: {
+			const REQUEST_FASTIO *f = CONTAINING_RECORD(Header, REQUEST_FASTIO, Header);
+
+			args = _FastIoArgumentsGet(f, &iosb);
+			succeeded = _FieldsFormat(Buffer, f, _fastIoFields, sizeof(_fastIoFields) / sizeof(_fastIoFields[0]));
+			if (succeeded)
+				succeeded = _FieldsFormat(Buffer, &f->Arg1, args.Fields, args.Count);
+
+			if (succeeded && iosb)
+				succeeded = _FieldsFormat(Buffer, f, _fastIoIOSBFields, sizeof(_fastIoIOSBFields) / sizeof(_fastIoIOSBFields[0]));
+		} break;
+		case ertStartIo: {
+			const REQUEST_STARTIO *s = CONTAINING_RECORD(Header, REQUEST_STARTIO, Header);
+
+			args = _IRPArgumentsGet(s->MajorFunction, s->MinorFunction);
+			succeeded = _FieldsFormat(Buffer, s, _startIoFields, sizeof(_startIoFields) / sizeof(_startIoFields[0]));
+			if (succeeded)
+				succeeded = _FieldsFormat(Buffer, &s->Arg1, args.Fields, args.Count);
+
+			if (succeeded)
+				succeeded = _FieldsFormat(Buffer, s, _startIoTrailerFields, sizeof(_startIoTrailerFields) / sizeof(_startIoTrailerFields[0]));
+		} break;
+		default:
+			break;
+	}
+
+	if (succeeded)
+		succeeded = _ResultFormat(Buffer, Header);
+
+	if (succeeded)
+		succeeded = _BufferAppend(Buffer, "\n", 1);
+
+	ret = (succeeded) ? ERROR_SUCCESS : ERROR_NOT_ENOUGH_MEMORY;
+	if (ret != ERROR_SUCCESS)
+		Buffer->Length = length;
+
+	return ret;
+}
+
+VOID RequestFormatBufferInit(PREQUEST_FORMAT_BUFFER Buffer)
+{
+	memset(Buffer, 0, sizeof(REQUEST_FORMAT_BUFFER));
+
+	return;
+}
+
+VOID RequestFormatBufferFree(PREQUEST_FORMAT_BUFFER Buffer)
+{
+	if (Buffer->Data != NULL)
+		HeapFree(GetProcessHeap(), 0, Buffer->Data);
+
+	RequestFormatBufferInit(Buffer);
+
+	return;
+}
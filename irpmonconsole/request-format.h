@@ -0,0 +1,62 @@
+
+#ifndef __IRPMON_REQUEST_FORMAT_H__
+#define __IRPMON_REQUEST_FORMAT_H__
+
+
+
+#include <windows.h>
+#include "general-types.h"
+
+
+#define IRP_MJ_CREATE                   0x00
+#define IRP_MJ_CREATE_NAMED_PIPE        0x01
+#define IRP_MJ_CLOSE                    0x02
+#define IRP_MJ_READ                     0x03
+#define IRP_MJ_WRITE                    0x04
+#define IRP_MJ_QUERY_INFORMATION        0x05
+#define IRP_MJ_SET_INFORMATION          0x06
+#define IRP_MJ_QUERY_EA                 0x07
+#define IRP_MJ_SET_EA                   0x08
+#define IRP_MJ_FLUSH_BUFFERS            0x09
+#define IRP_MJ_QUERY_VOLUME_INFORMATION 0x0a
+#define IRP_MJ_SET_VOLUME_INFORMATION   0x0b
+#define IRP_MJ_DIRECTORY_CONTROL        0x0c
+#define IRP_MJ_FILE_SYSTEM_CONTROL      0x0d
+#define IRP_MJ_DEVICE_CONTROL           0x0e
+#define IRP_MJ_INTERNAL_DEVICE_CONTROL  0x0f
+#define IRP_MJ_SHUTDOWN                 0x10
+#define IRP_MJ_LOCK_CONTROL             0x11
+#define IRP_MJ_CLEANUP                  0x12
+#define IRP_MJ_CREATE_MAILSLOT          0x13
+#define IRP_MJ_QUERY_SECURITY           0x14
+#define IRP_MJ_SET_SECURITY             0x15
+#define IRP_MJ_POWER                    0x16
+#define IRP_MJ_SYSTEM_CONTROL           0x17
+#define IRP_MJ_DEVICE_CHANGE            0x18
+#define IRP_MJ_QUERY_QUOTA              0x19
+#define IRP_MJ_SET_QUOTA                0x1a
+#define IRP_MJ_PNP                      0x1b
+#define IRP_MJ_MAXIMUM_FUNCTION         0x1b
+
+/** Formatting the text beyond this length is a good time to write it out. */
+#define REQUEST_FORMAT_FLUSH_LENGTH			(64*1024)
+
+
+/** Receives UTF-8 text of formatted records. The buffer grows as needed and
+    is meant to be reused, so no memory is allocated once it is large enough. */
+typedef struct _REQUEST_FORMAT_BUFFER {
+	PCHAR Data;
+	/** Length of the text, in bytes. */
+	SIZE_T Length;
+	/** Size of the Data buffer, in bytes. */
+	SIZE_T Capacity;
+} REQUEST_FORMAT_BUFFER, *PREQUEST_FORMAT_BUFFER;
+
+
+DWORD RequestFormatHeader(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_HEADER *Header, const char *DriverName, const char *DeviceName);
+DWORD RequestFormatDetails(PREQUEST_FORMAT_BUFFER Buffer, const REQUEST_HEADER *Header);
+VOID RequestFormatBufferInit(PREQUEST_FORMAT_BUFFER Buffer);
+VOID RequestFormatBufferFree(PREQUEST_FORMAT_BUFFER Buffer);
+
+
+#endif
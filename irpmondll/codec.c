@@ -0,0 +1,480 @@
+
+/**
+ * @file
+ *
+ * Encodes and decodes data structures exchanged with the IRPMon driver: records
+ * returned by IOCTL_IRPMNDRV_GET_RECORD_PENDING, the driver and device snapshot
+ * (IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO) and the list of hooked objects
+ * (IOCTL_IRPMONDRV_HOOK_GET_INFO).
+ *
+ * The routines only work with memory supplied by their callers and call no
+ * operating system routines, so they can be shared by the driver communication,
+ * the mock driver and tools processing the records outside of Windows.
+ *
+ * Decoding is done in two steps. The measuring routine validates the input and
+ * computes size of the memory block required for the decoded form; the decoding
+ * routine then lays out all the structures and strings in that block, so the
+ * whole result is released by a single free.
+ */
+
+#include <windows.h>
+#include "general-types.h"
+#include "kernel-shared.h"
+#include "ioctls.h"
+#include "irpmondll-types.h"
+#include "codec.h"
+
+
+/************************************************************************/
+/*                          HELPER ROUTINES                             */
+/************************************************************************/
+
+/** Copies a string into a string pool and terminates it.
+ *
+ *  @param Pool Address of variable pointing to the free part of the pool. The
+ *  variable is moved past the copied string.
+ *  @param String The string.
+ *  @param Length Length of the string, in bytes.
+ *
+ *  @return
+ *  Returns address of the copy.
+ */
+static PWCHAR _PoolCopyString(PWCHAR *Pool, PWCHAR String, ULONG Length)
+{
+	PWCHAR ret = *Pool;
+
+	memcpy(ret, String, Length);
+	ret[Length / sizeof(WCHAR)] = L'\0';
+	*Pool = ret + Length / sizeof(WCHAR) + 1;
+
+	return ret;
+}
+
+
+/** Copies data to a buffer if they fit into it.
+ *
+ *  @param Buffer The buffer.
+ *  @param Length Size of the buffer, in bytes.
+ *  @param Offset Address of variable holding the position to copy the data to.
+ *  The variable is moved past the data even if they do not fit.
+ *  @param Data The data.
+ *  @param Size Size of the data, in bytes.
+ *
+ *  @return
+ *  Returns TRUE if the data have been copied.
+ */
+static BOOLEAN _BufferPut(PVOID Buffer, ULONG Length, PULONG Offset, const VOID *Data, ULONG Size)
+{
+	BOOLEAN ret = FALSE;
+
+	ret = (*Offset <= Length && Length - *Offset >= Size);
+	if (ret)
+		memcpy((PUCHAR)Buffer + *Offset, Data, Size);
+
+	*Offset += Size;
+
+	return ret;
+}
+
+
+/************************************************************************/
+/*                          RECORDS                                     */
+/************************************************************************/
+
+/** Retrieves the next record of IOCTL_IRPMNDRV_GET_RECORD_PENDING output.
+ *
+ *  @param Buffer The output.
+ *  @param Length Number of bytes of the output.
+ *  @param Offset Address of variable holding offset of the next record entry.
+ *  Start with zero. On success, the variable is moved to the following entry.
+ *  @param Header Receives address of the record.
+ *  @param Size Receives size of the record, in bytes.
+ *
+ *  @return
+ *  Returns TRUE if a record has been retrieved, FALSE if there are no more
+ *  complete records in the buffer.
+ */
+BOOLEAN CodecRecordNext(PVOID Buffer, ULONG Length, PULONG Offset, PREQUEST_HEADER *Header, PULONG Size)
+{
+	ULONG offset = *Offset;
+	PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY entry = NULL;
+	BOOLEAN ret = FALSE;
+
+	ret = (offset <= Length && Length - offset >= sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY));
+	if (ret) {
+		entry = (PIOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY)((PUCHAR)Buffer + offset);
+		offset += sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY);
+		ret = (entry->Size <= Length - offset);
+		if (ret) {
+			*Header = (PREQUEST_HEADER)(entry + 1);
+			*Size = entry->Size;
+			*Offset = CodecRecordAlign(offset + entry->Size);
+		}
+	}
+
+	return ret;
+}
+
+
+/** Stores a record in the format of IOCTL_IRPMNDRV_GET_RECORD_PENDING output.
+ *
+ *  @param Buffer The output buffer.
+ *  @param Length Size of the buffer, in bytes.
+ *  @param Offset Address of variable holding offset of the record entry, must be
+ *  aligned by @link(CodecRecordAlign). The variable is moved to the next aligned
+ *  offset even if the record does not fit.
+ *  @param Header The record.
+ *  @param Size Size of the record, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INSUFFICIENT_BUFFER if the record does not fit.
+ */
+DWORD CodecRecordAppend(PVOID Buffer, ULONG Length, PULONG Offset, PREQUEST_HEADER Header, ULONG Size)
+{
+	IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY entry;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	entry.Size = Size;
+	entry.Reserved = 0;
+	ret = (*Offset <= Length && Length - *Offset >= sizeof(entry) + Size) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER;
+	_BufferPut(Buffer, (ret == ERROR_SUCCESS) ? Length : 0, Offset, &entry, sizeof(entry));
+	_BufferPut(Buffer, (ret == ERROR_SUCCESS) ? Length : 0, Offset, Header, Size);
+	*Offset = CodecRecordAlign(*Offset);
+
+	return ret;
+}
+
+
+/************************************************************************/
+/*                  DRIVER AND DEVICE SNAPSHOT                          */
+/************************************************************************/
+
+/** Validates a driver and device snapshot and computes size of its decoded form.
+ *
+ *  @param Snapshot The snapshot returned by the driver. Its RequiredLength member
+ *  determines the number of valid bytes.
+ *  @param DeviceCount Receives the total number of devices.
+ *  @param BlockSize Receives size of the memory block required by @link(CodecSnapshotDecode).
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INVALID_DATA if the snapshot records exceed
+ *  its length.
+ */
+DWORD CodecSnapshotMeasure(PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot, PULONG DeviceCount, PSIZE_T BlockSize)
+{
+	ULONG i = 0;
+	ULONG j = 0;
+	ULONG deviceCount = 0;
+	ULONG totalDevices = 0;
+	ULONG nameLen = 0;
+	SIZE_T namesSize = 0;
+	PUCHAR tmpBuffer = (PUCHAR)(Snapshot + 1);
+	PUCHAR end = (PUCHAR)Snapshot + Snapshot->RequiredLength;
+	DWORD ret = ERROR_SUCCESS;
+
+	if (Snapshot->RequiredLength < sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT))
+		ret = ERROR_INVALID_DATA;
+
+	for (i = 0; ret == ERROR_SUCCESS && i < Snapshot->DriverCount; ++i) {
+		ret = ((ULONG_PTR)(end - tmpBuffer) >= sizeof(PVOID) + 2*sizeof(ULONG)) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+		if (ret != ERROR_SUCCESS)
+			break;
+
+		tmpBuffer += sizeof(PVOID);
+		deviceCount = *(PULONG)tmpBuffer;
+		tmpBuffer += sizeof(ULONG);
+		nameLen = *(PULONG)tmpBuffer;
+		tmpBuffer += sizeof(ULONG);
+		ret = ((ULONG_PTR)(end - tmpBuffer) >= nameLen) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+		if (ret != ERROR_SUCCESS)
+			break;
+
+		tmpBuffer += nameLen;
+		namesSize += nameLen + sizeof(WCHAR);
+		for (j = 0; j < deviceCount; ++j) {
+			ret = ((ULONG_PTR)(end - tmpBuffer) >= 2*sizeof(PVOID) + sizeof(ULONG)) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+			if (ret != ERROR_SUCCESS)
+				break;
+
+			tmpBuffer += 2*sizeof(PVOID);
+			nameLen = *(PULONG)tmpBuffer;
+			tmpBuffer += sizeof(ULONG);
+			ret = ((ULONG_PTR)(end - tmpBuffer) >= nameLen) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+			if (ret != ERROR_SUCCESS)
+				break;
+
+			tmpBuffer += nameLen;
+			namesSize += nameLen + sizeof(WCHAR);
+		}
+
+		totalDevices += deviceCount;
+	}
+
+	if (ret == ERROR_SUCCESS) {
+		*DeviceCount = totalDevices;
+		*BlockSize = Snapshot->DriverCount*(sizeof(PIRPMON_DRIVER_INFO) + sizeof(IRPMON_DRIVER_INFO)) +
+			totalDevices*(sizeof(PIRPMON_DEVICE_INFO) + sizeof(IRPMON_DEVICE_INFO)) +
+			namesSize;
+	}
+
+	return ret;
+}
+
+
+/** Decodes a driver and device snapshot.
+ *
+ *  @param Snapshot The snapshot, validated by @link(CodecSnapshotMeasure).
+ *  @param DeviceCount Total number of devices, as reported by @link(CodecSnapshotMeasure).
+ *  @param Block Memory block of the size reported by @link(CodecSnapshotMeasure).
+ *
+ *  @return
+ *  Returns the array of pointers to the driver structures, which starts at the
+ *  beginning of the block.
+ *
+ *  @remark
+ *  The block holds the array of driver pointers, the driver structures, the
+ *  device pointers referenced by the drivers, the device structures and the
+ *  string pool, in this order.
+ */
+PIRPMON_DRIVER_INFO *CodecSnapshotDecode(PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot, ULONG DeviceCount, PVOID Block)
+{
+	ULONG i = 0;
+	ULONG j = 0;
+	ULONG nameLen = 0;
+	PWCHAR names = NULL;
+	PIRPMON_DRIVER_INFO drivers = NULL;
+	PIRPMON_DEVICE_INFO devices = NULL;
+	PIRPMON_DEVICE_INFO *devicePointers = NULL;
+	PUCHAR tmpBuffer = (PUCHAR)(Snapshot + 1);
+	PIRPMON_DRIVER_INFO *ret = (PIRPMON_DRIVER_INFO *)Block;
+
+	drivers = (PIRPMON_DRIVER_INFO)(ret + Snapshot->DriverCount);
+	devicePointers = (PIRPMON_DEVICE_INFO *)(drivers + Snapshot->DriverCount);
+	devices = (PIRPMON_DEVICE_INFO)(devicePointers + DeviceCount);
+	names = (PWCHAR)(devices + DeviceCount);
+	for (i = 0; i < Snapshot->DriverCount; ++i) {
+		ret[i] = drivers;
+		drivers->DriverObject = *(PVOID *)tmpBuffer;
+		tmpBuffer += sizeof(PVOID);
+		drivers->DeviceCount = *(PULONG)tmpBuffer;
+		tmpBuffer += sizeof(ULONG);
+		nameLen = *(PULONG)tmpBuffer;
+		tmpBuffer += sizeof(ULONG);
+		drivers->DriverName = _PoolCopyString(&names, (PWCHAR)tmpBuffer, nameLen);
+		tmpBuffer += nameLen;
+		drivers->Devices = devicePointers;
+		for (j = 0; j < drivers->DeviceCount; ++j) {
+			*devicePointers = devices;
+			devices->DeviceObject = *(PVOID *)tmpBuffer;
+			tmpBuffer += sizeof(PVOID);
+			devices->AttachedDevice = *(PVOID *)tmpBuffer;
+			tmpBuffer += sizeof(PVOID);
+			nameLen = *(PULONG)tmpBuffer;
+			tmpBuffer += sizeof(ULONG);
+			devices->Name = _PoolCopyString(&names, (PWCHAR)tmpBuffer, nameLen);
+			tmpBuffer += nameLen;
+			++devicePointers;
+			++devices;
+		}
+
+		++drivers;
+	}
+
+	return ret;
+}
+
+
+/** Stores one driver record of a driver and device snapshot.
+ *
+ *  @param Buffer The snapshot buffer. It starts with the
+ *  IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT header, filled by the caller.
+ *  @param Length Size of the buffer, in bytes.
+ *  @param Offset Address of variable holding offset of the record. The first
+ *  record follows the header. The variable is moved past the record even if
+ *  the record does not fit, so the final value is the size of the snapshot.
+ *  @param DriverObject Address of the driver object.
+ *  @param DeviceCount Number of device records that follow.
+ *  @param Name Name of the driver.
+ *  @param NameLength Length of the name, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INSUFFICIENT_BUFFER if the record does not fit.
+ */
+DWORD CodecSnapshotAppendDriver(PVOID Buffer, ULONG Length, PULONG Offset, PVOID DriverObject, ULONG DeviceCount, PWCHAR Name, ULONG NameLength)
+{
+	DWORD ret = ERROR_SUCCESS;
+
+	if (!_BufferPut(Buffer, Length, Offset, &DriverObject, sizeof(DriverObject)))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	if (!_BufferPut(Buffer, Length, Offset, &DeviceCount, sizeof(DeviceCount)))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	if (!_BufferPut(Buffer, Length, Offset, &NameLength, sizeof(NameLength)))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	if (!_BufferPut(Buffer, Length, Offset, Name, NameLength))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	return ret;
+}
+
+
+/** Stores one device record of a driver and device snapshot.
+ *
+ *  @param Buffer The snapshot buffer.
+ *  @param Length Size of the buffer, in bytes.
+ *  @param Offset Address of variable holding offset of the record. The variable
+ *  is moved past the record even if the record does not fit.
+ *  @param DeviceObject Address of the device object.
+ *  @param AttachedDevice Address of the device attached to the device, or NULL.
+ *  @param Name Name of the device.
+ *  @param NameLength Length of the name, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INSUFFICIENT_BUFFER if the record does not fit.
+ */
+DWORD CodecSnapshotAppendDevice(PVOID Buffer, ULONG Length, PULONG Offset, PVOID DeviceObject, PVOID AttachedDevice, PWCHAR Name, ULONG NameLength)
+{
+	DWORD ret = ERROR_SUCCESS;
+
+	if (!_BufferPut(Buffer, Length, Offset, &DeviceObject, sizeof(DeviceObject)))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	if (!_BufferPut(Buffer, Length, Offset, &AttachedDevice, sizeof(AttachedDevice)))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	if (!_BufferPut(Buffer, Length, Offset, &NameLength, sizeof(NameLength)))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	if (!_BufferPut(Buffer, Length, Offset, Name, NameLength))
+		ret = ERROR_INSUFFICIENT_BUFFER;
+
+	return ret;
+}
+
+
+/************************************************************************/
+/*                  HOOKED DRIVERS AND DEVICES                          */
+/************************************************************************/
+
+/** Validates information about hooked drivers and devices and computes size
+ *  of its decoded form.
+ *
+ *  @param Info The information returned by the driver.
+ *  @param Length Number of valid bytes.
+ *  @param DeviceCount Receives the total number of devices.
+ *  @param BlockSize Receives size of the memory block required by
+ *  @link(CodecHookedObjectsDecode).
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, or ERROR_INVALID_DATA if the entries exceed the length.
+ */
+DWORD CodecHookedObjectsMeasure(PHOOKED_OBJECTS_INFO Info, ULONG Length, PULONG DeviceCount, PSIZE_T BlockSize)
+{
+	ULONG i = 0;
+	ULONG j = 0;
+	ULONG deviceCount = 0;
+	SIZE_T namesSize = 0;
+	PUCHAR end = (PUCHAR)Info + Length;
+	PHOOKED_DRIVER_INFO driverEntry = NULL;
+	PHOOKED_DEVICE_INFO deviceEntry = NULL;
+	DWORD ret = ERROR_SUCCESS;
+
+	if (Length < sizeof(HOOKED_OBJECTS_INFO))
+		ret = ERROR_INVALID_DATA;
+
+	driverEntry = (PHOOKED_DRIVER_INFO)(Info + 1);
+	for (i = 0; ret == ERROR_SUCCESS && i < Info->NumberOfHookedDrivers; ++i) {
+		ret = ((ULONG_PTR)(end - (PUCHAR)driverEntry) >= FIELD_OFFSET(HOOKED_DRIVER_INFO, DriverName) &&
+			driverEntry->DriverNameLen >= sizeof(WCHAR) &&
+			driverEntry->EntrySize >= FIELD_OFFSET(HOOKED_DRIVER_INFO, DriverName) + driverEntry->DriverNameLen &&
+			(ULONG_PTR)(end - (PUCHAR)driverEntry) >= driverEntry->EntrySize) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+		if (ret != ERROR_SUCCESS)
+			break;
+
+		namesSize += driverEntry->DriverNameLen;
+		deviceCount += driverEntry->NumberOfHookedDevices;
+		deviceEntry = (PHOOKED_DEVICE_INFO)((PUCHAR)driverEntry + driverEntry->EntrySize);
+		for (j = 0; j < driverEntry->NumberOfHookedDevices; ++j) {
+			ret = ((ULONG_PTR)(end - (PUCHAR)deviceEntry) >= FIELD_OFFSET(HOOKED_DEVICE_INFO, DeviceName) &&
+				deviceEntry->DeviceNameLen >= sizeof(WCHAR) &&
+				deviceEntry->EntrySize >= FIELD_OFFSET(HOOKED_DEVICE_INFO, DeviceName) + deviceEntry->DeviceNameLen &&
+				(ULONG_PTR)(end - (PUCHAR)deviceEntry) >= deviceEntry->EntrySize) ? ERROR_SUCCESS : ERROR_INVALID_DATA;
+			if (ret != ERROR_SUCCESS)
+				break;
+
+			namesSize += deviceEntry->DeviceNameLen;
+			deviceEntry = (PHOOKED_DEVICE_INFO)((PUCHAR)deviceEntry + deviceEntry->EntrySize);
+		}
+
+		driverEntry = (PHOOKED_DRIVER_INFO)deviceEntry;
+	}
+
+	if (ret == ERROR_SUCCESS) {
+		*DeviceCount = deviceCount;
+		*BlockSize = Info->NumberOfHookedDrivers*sizeof(HOOKED_DRIVER_UMINFO) +
+			deviceCount*sizeof(HOOKED_DEVICE_UMINFO) +
+			namesSize;
+	}
+
+	return ret;
+}
+
+
+/** Decodes information about hooked drivers and devices.
+ *
+ *  @param Info The information, validated by @link(CodecHookedObjectsMeasure).
+ *  @param DeviceCount Total number of devices, as reported by @link(CodecHookedObjectsMeasure).
+ *  @param Block Memory block of the size reported by @link(CodecHookedObjectsMeasure).
+ *
+ *  @return
+ *  Returns the array of driver structures, which starts at the beginning of the block.
+ *
+ *  @remark
+ *  The block holds the driver structures, the device structures (devices of
+ *  each driver form a contiguous part) and the string pool, in this order.
+ */
+PHOOKED_DRIVER_UMINFO CodecHookedObjectsDecode(PHOOKED_OBJECTS_INFO Info, ULONG DeviceCount, PVOID Block)
+{
+	ULONG i = 0;
+	ULONG j = 0;
+	PWCHAR names = NULL;
+	PHOOKED_DRIVER_UMINFO umDriverEntry = NULL;
+	PHOOKED_DEVICE_UMINFO umDeviceEntry = NULL;
+	PHOOKED_DRIVER_INFO driverEntry = NULL;
+	PHOOKED_DEVICE_INFO deviceEntry = NULL;
+	PHOOKED_DRIVER_UMINFO ret = (PHOOKED_DRIVER_UMINFO)Block;
+
+	umDriverEntry = ret;
+	umDeviceEntry = (PHOOKED_DEVICE_UMINFO)(ret + Info->NumberOfHookedDrivers);
+	names = (PWCHAR)(umDeviceEntry + DeviceCount);
+	driverEntry = (PHOOKED_DRIVER_INFO)(Info + 1);
+	for (i = 0; i < Info->NumberOfHookedDrivers; ++i) {
+		umDriverEntry->ObjectId = driverEntry->ObjectId;
+		umDriverEntry->DriverObject = driverEntry->DriverObject;
+		umDriverEntry->MonitoringEnabled = driverEntry->MonitoringEnabled;
+		umDriverEntry->MonitorSettings = driverEntry->MonitorSettings;
+		umDriverEntry->DriverNameLen = driverEntry->DriverNameLen - sizeof(WCHAR);
+		umDriverEntry->DriverName = _PoolCopyString(&names, driverEntry->DriverName, umDriverEntry->DriverNameLen);
+		umDriverEntry->NumberOfHookedDevices = driverEntry->NumberOfHookedDevices;
+		umDriverEntry->HookedDevices = (umDriverEntry->NumberOfHookedDevices > 0) ? umDeviceEntry : NULL;
+		deviceEntry = (PHOOKED_DEVICE_INFO)((PUCHAR)driverEntry + driverEntry->EntrySize);
+		for (j = 0; j < umDriverEntry->NumberOfHookedDevices; ++j) {
+			umDeviceEntry->ObjectId = deviceEntry->ObjectId;
+			umDeviceEntry->DeviceObject = deviceEntry->DeviceObject;
+			memcpy(umDeviceEntry->FastIoSettings, deviceEntry->FastIoSettings, sizeof(umDeviceEntry->FastIoSettings));
+			memcpy(umDeviceEntry->IRPSettings, deviceEntry->IRPSettings, sizeof(umDeviceEntry->IRPSettings));
+			umDeviceEntry->MonitoringEnabled = deviceEntry->MonitoringEnabled;
+			umDeviceEntry->DeviceNameLen = deviceEntry->DeviceNameLen - sizeof(WCHAR);
+			umDeviceEntry->DeviceName = _PoolCopyString(&names, deviceEntry->DeviceName, umDeviceEntry->DeviceNameLen);
+			++umDeviceEntry;
+			deviceEntry = (PHOOKED_DEVICE_INFO)((PUCHAR)deviceEntry + deviceEntry->EntrySize);
+		}
+
+		driverEntry = (PHOOKED_DRIVER_INFO)deviceEntry;
+		++umDriverEntry;
+	}
+
+	return ret;
+}
@@ -0,0 +1,31 @@
+
+#ifndef __IRPMONDLL_CODEC_H__
+#define __IRPMONDLL_CODEC_H__
+
+#include <windows.h>
+#include "general-types.h"
+#include "kernel-shared.h"
+#include "ioctls.h"
+#include "irpmondll-types.h"
+
+
+/** Rounds an offset within output of IOCTL_IRPMNDRV_GET_RECORD_PENDING up to
+    the alignment of the records. */
+#define CodecRecordAlign(aOffset)			\
+	((ULONG)(((aOffset) + IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1) & ~(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ALIGNMENT - 1)))
+
+
+BOOLEAN CodecRecordNext(PVOID Buffer, ULONG Length, PULONG Offset, PREQUEST_HEADER *Header, PULONG Size);
+DWORD CodecRecordAppend(PVOID Buffer, ULONG Length, PULONG Offset, PREQUEST_HEADER Header, ULONG Size);
+
+DWORD CodecSnapshotMeasure(PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot, PULONG DeviceCount, PSIZE_T BlockSize);
+PIRPMON_DRIVER_INFO *CodecSnapshotDecode(PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot, ULONG DeviceCount, PVOID Block);
+DWORD CodecSnapshotAppendDriver(PVOID Buffer, ULONG Length, PULONG Offset, PVOID DriverObject, ULONG DeviceCount, PWCHAR Name, ULONG NameLength);
+DWORD CodecSnapshotAppendDevice(PVOID Buffer, ULONG Length, PULONG Offset, PVOID DeviceObject, PVOID AttachedDevice, PWCHAR Name, ULONG NameLength);
+
+DWORD CodecHookedObjectsMeasure(PHOOKED_OBJECTS_INFO Info, ULONG Length, PULONG DeviceCount, PSIZE_T BlockSize);
+PHOOKED_DRIVER_UMINFO CodecHookedObjectsDecode(PHOOKED_OBJECTS_INFO Info, ULONG DeviceCount, PVOID Block);
+
+
+
+#endif
@@ -0,0 +1,476 @@
+
+/**
+ * @file
+ *
+ * Delivers records of the IRPMon Event Queue in batches.
+ *
+ * A dedicated thread keeps one record request pending in the driver.
+ * The request is issued directly into the free space of a batch buffer, so the
+ * driver copies the records to their final place and the consumer receives them
+ * without any further copying. The batch is delivered when it contains enough
+ * records, when its oldest record waits for too long, or when the buffer is full.
+ *
+ * The batch buffers come from a small pool. The consumer returns each buffer when
+ * it is done with the records; if all buffers are held by the consumer, the thread
+ * waits and the records stay queued in the driver.
+ */
+
+#include <windows.h>
+#include "debug.h"
+#include "ioctls.h"
+#include "kernel-shared.h"
+#include "general-types.h"
+#include "irpmondll-types.h"
+#include "codec.h"
+#include "transport.h"
+#include "driver-com.h"
+#include "consumer.h"
+
+
+/************************************************************************/
+/*               TYPE DEFINITIONS                                       */
+/************************************************************************/
+
+struct _CONSUMER;
+
+/** One buffer of the pool. */
+typedef struct _CONSUMER_BUFFER {
+	/** The batch passed to the consumer, must be the first member. */
+	IRPMON_RECORD_BATCH Batch;
+	/** Links free buffers together. */
+	struct _CONSUMER_BUFFER *Next;
+	/** The consumer the buffer belongs to. */
+	struct _CONSUMER *Owner;
+	/** Size of the data block, in bytes. */
+	ULONG Size;
+	/** Maximum number of records the data block can hold. */
+	ULONG Capacity;
+} CONSUMER_BUFFER, *PCONSUMER_BUFFER;
+
+/** Represents one running record consumer. */
+typedef struct _CONSUMER {
+	/** One reference for the running consumer, one for each buffer held by
+	    the thread or by the user. */
+	volatile LONG ReferenceCount;
+	/** Set when the consumer is being stopped. Buffers returned afterwards are freed. */
+	BOOLEAN Stopping;
+	/** Protects the list of free buffers. */
+	CRITICAL_SECTION Lock;
+	PCONSUMER_BUFFER FreeBuffers;
+	/** Counts the free buffers. */
+	HANDLE FreeSemaphore;
+	/** Signaled when the consumer should stop. */
+	HANDLE StopEvent;
+	/** The transport the records come from. */
+	PTRANSPORT Transport;
+	/** Channel of the transport used for the record retrieval. */
+	PVOID Records;
+	HANDLE Thread;
+	IRPMON_BATCH_CALLBACK *Callback;
+	PVOID Context;
+	ULONG BatchSize;
+	ULONG MaxLatency;
+} CONSUMER, *PCONSUMER;
+
+
+/************************************************************************/
+/*                           GLOBAL VARIABLES                           */
+/************************************************************************/
+
+/** Number of buffers of the pool. */
+#define CONSUMER_BUFFER_COUNT				4
+/** Time to wait before a failed record request is retried, in milliseconds. */
+#define CONSUMER_RETRY_INTERVAL				250
+
+/** The only consumer allowed to run. */
+static PCONSUMER _consumer = NULL;
+
+
+/************************************************************************/
+/*                          HELPER ROUTINES                             */
+/************************************************************************/
+
+static VOID _ConsumerFree(PCONSUMER Consumer)
+{
+	if (Consumer->Records != NULL)
+		Consumer->Transport->RecordsClose(Consumer->Records);
+
+	if (Consumer->StopEvent != NULL)
+		CloseHandle(Consumer->StopEvent);
+
+	if (Consumer->FreeSemaphore != NULL)
+		CloseHandle(Consumer->FreeSemaphore);
+
+	DeleteCriticalSection(&Consumer->Lock);
+	HeapFree(GetProcessHeap(), 0, Consumer);
+
+	return;
+}
+
+
+static VOID _ConsumerDereference(PCONSUMER Consumer)
+{
+	if (InterlockedDecrement(&Consumer->ReferenceCount) == 0)
+		_ConsumerFree(Consumer);
+
+	return;
+}
+
+
+static VOID _BufferFree(PCONSUMER_BUFFER Buffer)
+{
+	if (Buffer->Batch.Records != NULL)
+		HeapFree(GetProcessHeap(), 0, Buffer->Batch.Records);
+
+	if (Buffer->Batch.Data != NULL)
+		HeapFree(GetProcessHeap(), 0, Buffer->Batch.Data);
+
+	HeapFree(GetProcessHeap(), 0, Buffer);
+
+	return;
+}
+
+
+/** Allocates the data block of a buffer, together with the array describing
+ *  the records it can hold.
+ *
+ *  @param Buffer The buffer. Its previous data block, if any, is freed.
+ *  @param Size Size of the data block, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS or ERROR_NOT_ENOUGH_MEMORY. In the latter case,
+ *  the buffer is left intact.
+ */
+static DWORD _BufferSetSize(PCONSUMER_BUFFER Buffer, ULONG Size)
+{
+	ULONG capacity = 0;
+	PVOID data = NULL;
+	PIRPMON_BATCH_RECORD records = NULL;
+	DWORD ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	capacity = Size / CodecRecordAlign(sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_HEADER)) + 1;
+	data = HeapAlloc(GetProcessHeap(), 0, Size);
+	if (data != NULL) {
+		records = (PIRPMON_BATCH_RECORD)HeapAlloc(GetProcessHeap(), 0, capacity*sizeof(IRPMON_BATCH_RECORD));
+		if (records != NULL) {
+			if (Buffer->Batch.Records != NULL)
+				HeapFree(GetProcessHeap(), 0, Buffer->Batch.Records);
+
+			if (Buffer->Batch.Data != NULL)
+				HeapFree(GetProcessHeap(), 0, Buffer->Batch.Data);
+
+			Buffer->Batch.Records = records;
+			Buffer->Batch.Data = data;
+			Buffer->Size = Size;
+			Buffer->Capacity = capacity;
+			ret = ERROR_SUCCESS;
+		}
+
+		if (ret != ERROR_SUCCESS)
+			HeapFree(GetProcessHeap(), 0, data);
+	}
+
+	return ret;
+}
+
+
+/** Takes a buffer from the pool, waits for one if none is free.
+ *
+ *  @return
+ *  Returns the buffer, or NULL if the consumer is being stopped.
+ */
+static PCONSUMER_BUFFER _BufferGet(PCONSUMER Consumer)
+{
+	HANDLE objectsToWait[2];
+	PCONSUMER_BUFFER ret = NULL;
+
+	objectsToWait[0] = Consumer->StopEvent;
+	objectsToWait[1] = Consumer->FreeSemaphore;
+	if (WaitForMultipleObjects(sizeof(objectsToWait) / sizeof(HANDLE), objectsToWait, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+		EnterCriticalSection(&Consumer->Lock);
+		ret = Consumer->FreeBuffers;
+		Consumer->FreeBuffers = ret->Next;
+		LeaveCriticalSection(&Consumer->Lock);
+		ret->Next = NULL;
+		ret->Batch.Count = 0;
+		ret->Batch.Length = 0;
+	}
+
+	return ret;
+}
+
+
+/** Returns a buffer to the pool, or frees it if the consumer is being stopped. */
+static VOID _BufferPut(PCONSUMER_BUFFER Buffer)
+{
+	BOOLEAN freeBuffer = FALSE;
+	PCONSUMER consumer = Buffer->Owner;
+
+	EnterCriticalSection(&consumer->Lock);
+	freeBuffer = consumer->Stopping;
+	if (!freeBuffer) {
+		Buffer->Next = consumer->FreeBuffers;
+		consumer->FreeBuffers = Buffer;
+	}
+
+	LeaveCriticalSection(&consumer->Lock);
+	if (!freeBuffer)
+		ReleaseSemaphore(consumer->FreeSemaphore, 1, NULL);
+	else {
+		_BufferFree(Buffer);
+		_ConsumerDereference(consumer);
+	}
+
+	return;
+}
+
+
+/** Describes the records the driver has just stored into the free space
+ *  of a buffer.
+ *
+ *  @param Buffer The buffer.
+ *  @param Length Number of bytes returned by the driver.
+ */
+static VOID _BufferAppend(PCONSUMER_BUFFER Buffer, ULONG Length)
+{
+	ULONG offset = 0;
+	ULONG end = 0;
+	PIRPMON_BATCH_RECORD record = NULL;
+
+	offset = Buffer->Batch.Length;
+	end = offset + Length;
+	while (Buffer->Batch.Count < Buffer->Capacity) {
+		record = Buffer->Batch.Records + Buffer->Batch.Count;
+		if (!CodecRecordNext(Buffer->Batch.Data, end, &offset, &record->Header, &record->Size))
+			break;
+
+		++Buffer->Batch.Count;
+	}
+
+	Buffer->Batch.Length = CodecRecordAlign(end);
+
+	return;
+}
+
+
+/** Sends one record request into the free space of a buffer and waits
+ *  for its completion.
+ *
+ *  @param Consumer The consumer.
+ *  @param Buffer The buffer.
+ *  @param Timeout Time to wait for records, in milliseconds. The request is
+ *  cancelled if it does not complete in time.
+ *  @param Length Receives the number of bytes returned. If the routine returns
+ *  ERROR_INSUFFICIENT_BUFFER, the variable receives the size the buffer requires.
+ *
+ *  @return
+ *  Returns an error code. ERROR_OPERATION_ABORTED means the request was cancelled
+ *  because of the timeout or the consumer being stopped.
+ */
+static DWORD _RecordsRequest(PCONSUMER Consumer, PCONSUMER_BUFFER Buffer, DWORD Timeout, PULONG Length)
+{
+	return Consumer->Transport->RecordsWait(Consumer->Records, (PUCHAR)Buffer->Batch.Data + Buffer->Batch.Length, Buffer->Size - Buffer->Batch.Length, Timeout, Consumer->StopEvent, Length);
+}
+
+
+/** Fills batch buffers by records and delivers them to the consumer.
+ *
+ *  @param Parameter The consumer.
+ *
+ *  @return
+ *  Always returns 0.
+ */
+static DWORD WINAPI _ConsumerThreadRoutine(PVOID Parameter)
+{
+	ULONG length = 0;
+	DWORD timeout = 0;
+	ULONGLONG now = 0;
+	ULONGLONG deadline = 0;
+	BOOLEAN deliver = FALSE;
+	PCONSUMER_BUFFER buffer = NULL;
+	PCONSUMER consumer = (PCONSUMER)Parameter;
+	DWORD err = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Parameter=0x%p", Parameter);
+
+	do {
+		if (buffer == NULL) {
+			buffer = _BufferGet(consumer);
+			if (buffer == NULL)
+				break;
+		}
+
+		timeout = INFINITE;
+		if (buffer->Batch.Count > 0) {
+			now = GetTickCount64();
+			timeout = (now < deadline) ? (DWORD)(deadline - now) : 0;
+		}
+
+		deliver = FALSE;
+		err = _RecordsRequest(consumer, buffer, timeout, &length);
+		switch (err) {
+			case ERROR_SUCCESS:
+				if (buffer->Batch.Count == 0)
+					deadline = GetTickCount64() + consumer->MaxLatency;
+
+				_BufferAppend(buffer, length);
+				deliver = (buffer->Batch.Count >= consumer->BatchSize ||
+					buffer->Size - buffer->Batch.Length < sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_GENERAL) ||
+					GetTickCount64() >= deadline);
+				break;
+			case ERROR_INSUFFICIENT_BUFFER:
+				// Records already in the batch are delivered first, the next
+				// request then starts at the beginning of the buffer.
+				deliver = (buffer->Batch.Count > 0);
+				if (!deliver) {
+					if (length <= buffer->Size)
+						length = buffer->Size*2;
+
+					err = _BufferSetSize(buffer, CodecRecordAlign(length));
+					if (err != ERROR_SUCCESS)
+						WaitForSingleObject(consumer->StopEvent, CONSUMER_RETRY_INTERVAL);
+				}
+				break;
+			case ERROR_OPERATION_ABORTED:
+				deliver = (buffer->Batch.Count > 0);
+				break;
+			default:
+				DEBUG_PRINT_LOCATION("Record request failed with error %u", err);
+				deliver = (buffer->Batch.Count > 0);
+				WaitForSingleObject(consumer->StopEvent, CONSUMER_RETRY_INTERVAL);
+				break;
+		}
+
+		if (deliver) {
+			consumer->Callback(&buffer->Batch, consumer->Context);
+			buffer = NULL;
+		}
+	} while (WaitForSingleObject(consumer->StopEvent, 0) == WAIT_TIMEOUT);
+
+	if (buffer != NULL)
+		_BufferPut(buffer);
+
+	DEBUG_EXIT_FUNCTION("%u", 0);
+	return 0;
+}
+
+
+/************************************************************************/
+/*                          PUBLIC ROUTINES                             */
+/************************************************************************/
+
+DWORD ConsumerStart(IRPMON_BATCH_CALLBACK *Callback, ULONG BatchSize, ULONG MaxLatency, PVOID Context)
+{
+	ULONG i = 0;
+	PCONSUMER_BUFFER buffer = NULL;
+	PCONSUMER consumer = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Callback=0x%p; BatchSize=%u; MaxLatency=%u; Context=0x%p", Callback, BatchSize, MaxLatency, Context);
+
+	if (Callback != NULL && BatchSize > 0 && MaxLatency != INFINITE) {
+		if (_consumer == NULL) {
+			consumer = (PCONSUMER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONSUMER));
+			if (consumer != NULL) {
+				InitializeCriticalSection(&consumer->Lock);
+				consumer->ReferenceCount = 1;
+				consumer->Transport = DriverComTransport();
+				consumer->Callback = Callback;
+				consumer->Context = Context;
+				consumer->BatchSize = BatchSize;
+				consumer->MaxLatency = MaxLatency;
+				consumer->FreeSemaphore = CreateSemaphoreW(NULL, 0, CONSUMER_BUFFER_COUNT, NULL);
+				consumer->StopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+				if (consumer->FreeSemaphore != NULL && consumer->StopEvent != NULL) {
+					ret = consumer->Transport->RecordsOpen(consumer->Transport->Context, &consumer->Records);
+					if (ret == ERROR_SUCCESS) {
+						for (i = 0; i < CONSUMER_BUFFER_COUNT; ++i) {
+							buffer = (PCONSUMER_BUFFER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONSUMER_BUFFER));
+							if (buffer == NULL) {
+								ret = ERROR_NOT_ENOUGH_MEMORY;
+								break;
+							}
+
+							buffer->Owner = consumer;
+							ret = _BufferSetSize(buffer, BatchSize*CodecRecordAlign(sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_GENERAL)));
+							if (ret != ERROR_SUCCESS) {
+								_BufferFree(buffer);
+								break;
+							}
+
+							InterlockedIncrement(&consumer->ReferenceCount);
+							_BufferPut(buffer);
+						}
+
+						if (ret == ERROR_SUCCESS) {
+							consumer->Thread = CreateThread(NULL, 0, _ConsumerThreadRoutine, consumer, 0, NULL);
+							if (consumer->Thread != NULL)
+								_consumer = consumer;
+							else ret = GetLastError();
+						}
+					}
+				} else ret = GetLastError();
+
+				if (ret != ERROR_SUCCESS) {
+					consumer->Stopping = TRUE;
+					while (consumer->FreeBuffers != NULL) {
+						buffer = consumer->FreeBuffers;
+						consumer->FreeBuffers = buffer->Next;
+						_BufferFree(buffer);
+						_ConsumerDereference(consumer);
+					}
+
+					_ConsumerDereference(consumer);
+				}
+			} else ret = ERROR_NOT_ENOUGH_MEMORY;
+		} else ret = ERROR_BUSY;
+	} else ret = ERROR_INVALID_PARAMETER;
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+VOID ConsumerStop(VOID)
+{
+	PCONSUMER_BUFFER buffer = NULL;
+	PCONSUMER consumer = _consumer;
+	DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+	if (consumer != NULL) {
+		_consumer = NULL;
+		SetEvent(consumer->StopEvent);
+		WaitForSingleObject(consumer->Thread, INFINITE);
+		CloseHandle(consumer->Thread);
+		consumer->Thread = NULL;
+		consumer->Transport->RecordsClose(consumer->Records);
+		consumer->Records = NULL;
+		// Buffers still held by the user are freed when they are returned.
+		EnterCriticalSection(&consumer->Lock);
+		consumer->Stopping = TRUE;
+		buffer = consumer->FreeBuffers;
+		consumer->FreeBuffers = NULL;
+		LeaveCriticalSection(&consumer->Lock);
+		while (buffer != NULL) {
+			PCONSUMER_BUFFER tmp = buffer;
+
+			buffer = buffer->Next;
+			_BufferFree(tmp);
+			_ConsumerDereference(consumer);
+		}
+
+		_ConsumerDereference(consumer);
+	}
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+VOID ConsumerBatchRelease(PIRPMON_RECORD_BATCH Batch)
+{
+	DEBUG_ENTER_FUNCTION("Batch=0x%p", Batch);
+
+	_BufferPut(CONTAINING_RECORD(Batch, CONSUMER_BUFFER, Batch));
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
@@ -0,0 +1,15 @@
+
+#ifndef __IRPMONDLL_CONSUMER_H__
+#define __IRPMONDLL_CONSUMER_H__
+
+#include <windows.h>
+#include "irpmondll-types.h"
+
+
+DWORD ConsumerStart(IRPMON_BATCH_CALLBACK *Callback, ULONG BatchSize, ULONG MaxLatency, PVOID Context);
+VOID ConsumerStop(VOID);
+VOID ConsumerBatchRelease(PIRPMON_RECORD_BATCH Batch);
+
+
+
+#endif
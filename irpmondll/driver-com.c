@@ -6,6 +6,9 @@
 #include "kernel-shared.h"
 #include "general-types.h"
 #include "irpmondll-types.h"
+#include "codec.h"
+#include "transport.h"
+#include "mock-driver.h"
 #include "driver-com.h"
 
 
@@ -15,6 +18,25 @@
 
 typedef NTSTATUS (NTAPI RTLSTRINGFROMGUID)(GUID *Guid, PUNICODE_STRING GuidString);
 typedef VOID(WINAPI RTLFREEUNICODESTRING)(PUNICODE_STRING String);
+typedef ULONG (NTAPI RTLNTSTATUSTODOSERROR)(NTSTATUS Status);
+
+/** One buffer of the overlapped record retrieval. The buffer is always either
+    sent to the driver, or being processed by one of the fetch threads. */
+typedef struct _FETCH_BUFFER {
+	OVERLAPPED Overlapped;
+	/** Size of the Data buffer, in bytes. */
+	ULONG Size;
+	/** Receives the records. */
+	PUCHAR Data;
+} FETCH_BUFFER, *PFETCH_BUFFER;
+
+/** A channel for record retrieval opened on the driver device. */
+typedef struct _DEVICE_RECORDS {
+	/** Handle opened for the overlapped record retrieval. */
+	HANDLE Handle;
+	/** Signaled when the overlapped request completes. */
+	HANDLE IoEvent;
+} DEVICE_RECORDS, *PDEVICE_RECORDS;
 
 
 /************************************************************************/
@@ -22,12 +44,165 @@ typedef VOID(WINAPI RTLFREEUNICODESTRING)(PUNICODE_STRING String);
 /************************************************************************/
 
 
-static HANDLE _deviceHandle = INVALID_HANDLE_VALUE;
 static BOOLEAN _initialized = FALSE;
 static BOOLEAN _connected = FALSE;
 
 static RTLSTRINGFROMGUID *_RtlStringFromGuid = NULL;
 static RTLFREEUNICODESTRING *_RtlFreeUnicodeString = NULL;
+static RTLNTSTATUSTODOSERROR *_RtlNtStatusToDosError = NULL;
+
+/** Handle used for overlapped record retrieval, opened with FILE_FLAG_OVERLAPPED. */
+static HANDLE _recordsHandle = INVALID_HANDLE_VALUE;
+/** Completion port the overlapped record requests are reported to. */
+static HANDLE _fetchPort = NULL;
+static PFETCH_BUFFER _fetchBuffers = NULL;
+static ULONG _fetchBufferCount = 0;
+static PHANDLE _fetchThreads = NULL;
+static ULONG _fetchThreadCount = 0;
+/** Number of buffers sent to the driver and not yet processed, plus one while
+    the fetching runs. */
+static volatile LONG _fetchOutstanding = 0;
+/** Signaled when _fetchOutstanding drops to zero. */
+static HANDLE _fetchIdleEvent = NULL;
+static volatile LONG _fetchStopping = FALSE;
+static IRPMON_RECORD_CALLBACK *_fetchCallback = NULL;
+static PVOID _fetchContext = NULL;
+/** Size of the buffer for the first attempt to retrieve the driver and device
+    snapshot, derived from size of the last snapshot. */
+static volatile LONG _snapshotSizeHint = 512;
+
+
+/************************************************************************/
+/*                     DEVICE TRANSPORT                                 */
+/************************************************************************/
+
+
+static DWORD _DeviceIoctl(PVOID Context, DWORD Code, PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	DWORD length = 0;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	if (DeviceIoControl((HANDLE)Context, Code, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, &length, NULL))
+		ret = ERROR_SUCCESS;
+	else ret = GetLastError();
+
+	*ReturnLength = length;
+
+	return ret;
+}
+
+
+static VOID _DeviceRecordsClose(PVOID Records)
+{
+	PDEVICE_RECORDS records = (PDEVICE_RECORDS)Records;
+	DEBUG_ENTER_FUNCTION("Records=0x%p", Records);
+
+	if (records->Handle != INVALID_HANDLE_VALUE)
+		CloseHandle(records->Handle);
+
+	if (records->IoEvent != NULL)
+		CloseHandle(records->IoEvent);
+
+	HeapFree(GetProcessHeap(), 0, records);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+static DWORD _DeviceRecordsOpen(PVOID Context, PVOID *Records)
+{
+	PDEVICE_RECORDS records = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Context=0x%p; Records=0x%p", Context, Records);
+
+	UNREFERENCED_PARAMETER(Context);
+
+	records = (PDEVICE_RECORDS)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DEVICE_RECORDS));
+	if (records != NULL) {
+		records->Handle = INVALID_HANDLE_VALUE;
+		records->IoEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+		if (records->IoEvent != NULL) {
+			records->Handle = CreateFileW(IRPMNDRV_USER_DEVICE_NAME IRPMNDRV_RECORDS_FILE_NAME, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+			if (records->Handle != INVALID_HANDLE_VALUE) {
+				*Records = records;
+				ret = ERROR_SUCCESS;
+			} else ret = GetLastError();
+		} else ret = GetLastError();
+
+		if (ret != ERROR_SUCCESS)
+			_DeviceRecordsClose(records);
+	} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	DEBUG_EXIT_FUNCTION("%u, *Records=0x%p", ret, *Records);
+	return ret;
+}
+
+
+/** Sends one overlapped record request and waits for its completion. The
+ *  request is cancelled if it does not complete in time.
+ */
+static DWORD _DeviceRecordsWait(PVOID Records, PVOID Buffer, ULONG Length, DWORD Timeout, HANDLE StopEvent, PULONG ReturnLength)
+{
+	DWORD length = 0;
+	OVERLAPPED overlapped;
+	HANDLE objectsToWait[2];
+	PDEVICE_RECORDS records = (PDEVICE_RECORDS)Records;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.hEvent = records->IoEvent;
+	if (DeviceIoControl(records->Handle, IOCTL_IRPMNDRV_GET_RECORD_PENDING, NULL, 0, Buffer, Length, NULL, &overlapped))
+		ret = ERROR_SUCCESS;
+	else ret = GetLastError();
+
+	if (ret == ERROR_IO_PENDING) {
+		objectsToWait[0] = records->IoEvent;
+		objectsToWait[1] = StopEvent;
+		if (WaitForMultipleObjects(sizeof(objectsToWait) / sizeof(HANDLE), objectsToWait, FALSE, Timeout) != WAIT_OBJECT_0)
+			CancelIoEx(records->Handle, &overlapped);
+
+		// The request may complete with records even when it is being cancelled.
+		if (GetOverlappedResult(records->Handle, &overlapped, &length, TRUE))
+			ret = ERROR_SUCCESS;
+		else ret = GetLastError();
+	} else if (ret == ERROR_SUCCESS || ret == ERROR_INSUFFICIENT_BUFFER)
+		length = (DWORD)overlapped.InternalHigh;
+
+	*ReturnLength = length;
+
+	return ret;
+}
+
+
+static VOID _DeviceClose(PVOID Context)
+{
+	DEBUG_ENTER_FUNCTION("Context=0x%p", Context);
+
+	if ((HANDLE)Context != INVALID_HANDLE_VALUE)
+		CloseHandle((HANDLE)Context);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+/** The driver device, its context is the device handle. */
+static TRANSPORT _deviceTransport = {
+	_DeviceIoctl,
+	_DeviceRecordsOpen,
+	_DeviceRecordsWait,
+	_DeviceRecordsClose,
+	_DeviceClose,
+	INVALID_HANDLE_VALUE,
+};
+
+/** The mock driver, used instead of the device when the library is initialized
+    by @link(DriverComModuleInitMock). */
+static TRANSPORT _mockTransport;
+
+/** The transport all requests go through. */
+static PTRANSPORT _transport = &_deviceTransport;
 
 
 /************************************************************************/
@@ -37,13 +212,11 @@ static RTLFREEUNICODESTRING *_RtlFreeUnicodeString = NULL;
 
 static DWORD _SynchronousNoIOIOCTL(DWORD Code)
 {
-	DWORD dummy = 0;
+	ULONG dummy = 0;
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION("Code=0x%x", Code);
 
-	if (DeviceIoControl(_deviceHandle, Code, NULL, 0, NULL, 0, &dummy, NULL))
-		ret = ERROR_SUCCESS;
-	else ret = GetLastError();
+	ret = _transport->Ioctl(_transport->Context, Code, NULL, 0, NULL, 0, &dummy);
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
@@ -52,13 +225,11 @@ static DWORD _SynchronousNoIOIOCTL(DWORD Code)
 
 static DWORD _SynchronousWriteIOCTL(DWORD Code, PVOID InputBuffer, ULONG InputBufferLength)
 {
-	DWORD dummy = 0;
+	ULONG dummy = 0;
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION("Code=0x%x; InputBuffer=0x%p; InputBufferLength=%u", Code, InputBuffer, InputBufferLength);
 
-	if (DeviceIoControl(_deviceHandle, Code, InputBuffer, InputBufferLength, NULL, 0, &dummy, NULL))
-		ret = ERROR_SUCCESS;
-	else ret = GetLastError();
+	ret = _transport->Ioctl(_transport->Context, Code, InputBuffer, InputBufferLength, NULL, 0, &dummy);
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
@@ -67,13 +238,11 @@ static DWORD _SynchronousWriteIOCTL(DWORD Code, PVOID InputBuffer, ULONG InputBu
 
 static DWORD _SynchronousReadIOCTL(DWORD Code, PVOID OutputBuffer, ULONG OutputBufferLength)
 {
-	DWORD dummy = 0;
+	ULONG dummy = 0;
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION("Code=0x%x; OutputBuffer=0x%p; OutputBufferLength=%u", Code, OutputBuffer, OutputBufferLength);
 
-	if (DeviceIoControl(_deviceHandle, Code, NULL, 0, OutputBuffer, OutputBufferLength, &dummy, NULL))
-		ret = ERROR_SUCCESS;
-	else ret = GetLastError();
+	ret = _transport->Ioctl(_transport->Context, Code, NULL, 0, OutputBuffer, OutputBufferLength, &dummy);
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
@@ -82,80 +251,186 @@ static DWORD _SynchronousReadIOCTL(DWORD Code, PVOID OutputBuffer, ULONG OutputB
 
 static DWORD _SynchronousOtherIOCTL(DWORD Code, PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength)
 {
-	DWORD dummy = 0;
+	ULONG dummy = 0;
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION("Code=0x%x; InputBuffer=0x%p; InputBufferLength=%u; OutputBuffer=0x%p; OutputBufferLength=%u", Code, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength);
 
-	if (DeviceIoControl(_deviceHandle, Code, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, &dummy, NULL))
-		ret = ERROR_SUCCESS;
-	else ret = GetLastError();
+	ret = _transport->Ioctl(_transport->Context, Code, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, &dummy);
 
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
 }
 
 
-static PIRPMON_DRIVER_INFO _DriverInfoAlloc(PVOID DriverObject, PWCHAR Drivername, ULONG DriverNameLen, ULONG DeviceCount)
+static VOID _FetchBufferRelease(VOID)
 {
-	PIRPMON_DRIVER_INFO ret = NULL;
-	SIZE_T size = sizeof(IRPMON_DRIVER_INFO);
-	DEBUG_ENTER_FUNCTION("DriverObject=0x%p; DriverName=0x%p; DriverNameLen=%u; DeviceCount=%u", DriverObject, Drivername, DriverNameLen, DeviceCount);
+	if (InterlockedDecrement(&_fetchOutstanding) == 0)
+		SetEvent(_fetchIdleEvent);
 
-	size += DriverNameLen + sizeof(WCHAR) + DeviceCount*sizeof(PIRPMON_DEVICE_INFO);
-	ret = (PIRPMON_DRIVER_INFO)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
-	if (ret != NULL) {
-		ret->DriverObject = DriverObject;
-		ret->DeviceCount = DeviceCount;
-		ret->DriverName = (PWCHAR)(ret + 1);
-		memcpy(ret->DriverName, Drivername, DriverNameLen);
-		ret->DriverName[DriverNameLen / sizeof(WCHAR)] = L'\0';
-		ret->Devices = (PIRPMON_DEVICE_INFO *)((PUCHAR)ret->DriverName + DriverNameLen + sizeof(WCHAR));
-	}
+	return;
+}
+
+
+static DWORD _FetchBufferSubmit(PFETCH_BUFFER Buffer)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	memset(&Buffer->Overlapped, 0, sizeof(Buffer->Overlapped));
+	InterlockedIncrement(&_fetchOutstanding);
+	if (DeviceIoControl(_recordsHandle, IOCTL_IRPMNDRV_GET_RECORD_PENDING, NULL, 0, Buffer->Data, Buffer->Size, NULL, &Buffer->Overlapped))
+		ret = ERROR_SUCCESS;
+	else ret = GetLastError();
+
+	if (ret == ERROR_IO_PENDING)
+		ret = ERROR_SUCCESS;
+
+	// No completion is reported for requests failing immediately.
+	if (ret != ERROR_SUCCESS)
+		_FetchBufferRelease();
 
-	DEBUG_EXIT_FUNCTION("0x%p", ret);
 	return ret;
 }
 
 
-static VOID _DriverInfoFree(PIRPMON_DRIVER_INFO Info)
+static VOID _FetchBufferProcess(PFETCH_BUFFER Buffer, DWORD Length)
 {
-	DEBUG_ENTER_FUNCTION("Info=0x%p", Info);
+	ULONG offset = 0;
+	ULONG size = 0;
+	PREQUEST_HEADER header = NULL;
 
-	HeapFree(GetProcessHeap(), 0, Info);
+	while (CodecRecordNext(Buffer->Data, Length, &offset, &header, &size))
+		_fetchCallback(header, size, _fetchContext);
 
-	DEBUG_EXIT_FUNCTION_VOID();
 	return;
 }
 
 
-static PIRPMON_DEVICE_INFO _DeviceInfoAlloc(PVOID DeviceObject, PVOID AttachedDevice, PWCHAR DeviceName, ULONG DeviceNameLen)
+/** Grows a buffer the first record of which did not fit into it.
+ *
+ *  @param Buffer The buffer.
+ *  @param Size The size required, reported by the driver.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS or ERROR_NOT_ENOUGH_MEMORY.
+ */
+static DWORD _FetchBufferGrow(PFETCH_BUFFER Buffer, ULONG Size)
 {
-	PIRPMON_DEVICE_INFO ret = NULL;
-	SIZE_T size = sizeof(IRPMON_DEVICE_INFO);
-	DEBUG_ENTER_FUNCTION("DeviceObject=0x%p; AttachedDevice=0x%p; DeviceName=0x%p; DeviceNameLen=%u", DeviceObject, AttachedDevice, DeviceName, DeviceNameLen);
+	PUCHAR tmp = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
 
-	size += DeviceNameLen + sizeof(WCHAR);
-	ret = (PIRPMON_DEVICE_INFO)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
-	if (ret != NULL) {
-		ret->DeviceObject = DeviceObject;
-		ret->AttachedDevice = AttachedDevice;
-		ret->Name = (PWCHAR)(ret + 1);
-		memcpy(ret->Name, DeviceName, DeviceNameLen);
-		ret->Name[DeviceNameLen / sizeof(WCHAR)] = L'\0';
-	}
+	tmp = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, Size);
+	if (tmp != NULL) {
+		HeapFree(GetProcessHeap(), 0, Buffer->Data);
+		Buffer->Data = tmp;
+		Buffer->Size = Size;
+		ret = ERROR_SUCCESS;
+	} else ret = ERROR_NOT_ENOUGH_MEMORY;
 
-	DEBUG_EXIT_FUNCTION("0x%x", ret);
 	return ret;
 }
 
 
-static VOID _DeviceInfoFree(PIRPMON_DEVICE_INFO Info)
+/** Processes completed record requests and sends the buffers back to the driver.
+ *
+ *  @param Parameter Not used.
+ *
+ *  @return
+ *  Always returns 0.
+ *
+ *  @remark
+ *  The thread terminates when it dequeues a packet with no OVERLAPPED structure,
+ *  which is posted by @link(DriverComFetchStop).
+ */
+static DWORD WINAPI _FetchThreadRoutine(PVOID Parameter)
 {
-	DEBUG_ENTER_FUNCTION("Info=0x%p", Info);
+	BOOL succeeded = FALSE;
+	DWORD length = 0;
+	ULONG_PTR key = 0;
+	LPOVERLAPPED overlapped = NULL;
+	PFETCH_BUFFER buffer = NULL;
+	DWORD err = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Parameter=0x%p", Parameter);
 
-	HeapFree(GetProcessHeap(), 0, Info);
+	UNREFERENCED_PARAMETER(Parameter);
+
+	do {
+		succeeded = GetQueuedCompletionStatus(_fetchPort, &length, &key, &overlapped, INFINITE);
+		if (overlapped == NULL)
+			break;
+
+		buffer = CONTAINING_RECORD(overlapped, FETCH_BUFFER, Overlapped);
+		err = (succeeded) ? ERROR_SUCCESS : GetLastError();
+		switch (err) {
+			case ERROR_SUCCESS:
+				_FetchBufferProcess(buffer, length);
+				break;
+			case ERROR_INSUFFICIENT_BUFFER:
+				err = _FetchBufferGrow(buffer, length);
+				break;
+			default:
+				DEBUG_PRINT_LOCATION("Record request failed with error %u", err);
+				break;
+		}
+
+		if (err == ERROR_SUCCESS && !_fetchStopping)
+			_FetchBufferSubmit(buffer);
+
+		// Releases the request just completed, a resubmitted one holds its own reference.
+		_FetchBufferRelease();
+	} while (TRUE);
+
+	DEBUG_EXIT_FUNCTION("%u", 0);
+	return 0;
+}
+
+
+static VOID _FetchCleanup(VOID)
+{
+	ULONG i = 0;
+
+	if (_fetchThreads != NULL) {
+		for (i = 0; i < _fetchThreadCount; ++i)
+			PostQueuedCompletionStatus(_fetchPort, 0, 0, NULL);
+
+		for (i = 0; i < _fetchThreadCount; ++i) {
+			WaitForSingleObject(_fetchThreads[i], INFINITE);
+			CloseHandle(_fetchThreads[i]);
+		}
+
+		HeapFree(GetProcessHeap(), 0, _fetchThreads);
+		_fetchThreads = NULL;
+	}
+
+	_fetchThreadCount = 0;
+	if (_fetchPort != NULL) {
+		CloseHandle(_fetchPort);
+		_fetchPort = NULL;
+	}
+
+	if (_recordsHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(_recordsHandle);
+		_recordsHandle = INVALID_HANDLE_VALUE;
+	}
+
+	if (_fetchBuffers != NULL) {
+		for (i = 0; i < _fetchBufferCount; ++i) {
+			if (_fetchBuffers[i].Data != NULL)
+				HeapFree(GetProcessHeap(), 0, _fetchBuffers[i].Data);
+		}
+
+		HeapFree(GetProcessHeap(), 0, _fetchBuffers);
+		_fetchBuffers = NULL;
+	}
+
+	_fetchBufferCount = 0;
+	if (_fetchIdleEvent != NULL) {
+		CloseHandle(_fetchIdleEvent);
+		_fetchIdleEvent = NULL;
+	}
+
+	_fetchCallback = NULL;
+	_fetchContext = NULL;
 
-	DEBUG_EXIT_FUNCTION_VOID();
 	return;
 }
 
@@ -211,104 +486,54 @@ static DWORD _ObjectClose(EHandletype ObjectType, HANDLE Handle)
 /*                          PUBLIC ROUTINES                             */
 /************************************************************************/
 
-DWORD DriverComSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCount)
+DWORD DriverComSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCount, PULONG Generation)
 {
-	DWORD outputBufferLength = 512;
+	DWORD outputBufferLength = 0;
 	PVOID outputBuffer = NULL;
 	ULONG tmpInfoArrayCount = 0;
 	PIRPMON_DRIVER_INFO *tmpInfoArray = NULL;
 	DWORD ret = ERROR_GEN_FAILURE;
-	DEBUG_ENTER_FUNCTION("DriverInfo=0x%p; InfoCount=0x%p", DriverInfo, InfoCount);
+	DEBUG_ENTER_FUNCTION("DriverInfo=0x%p; InfoCount=0x%p; Generation=0x%p", DriverInfo, InfoCount, Generation);
 
+	// The driver reports the required size when the buffer is too small, so the
+	// snapshot usually takes one request, two if the hint is no longer enough.
+	outputBufferLength = (DWORD)_snapshotSizeHint;
 	do {
 		outputBuffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, outputBufferLength);
 		if (outputBuffer != NULL) {
 			ret = _SynchronousReadIOCTL(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO, outputBuffer, outputBufferLength);
 			if (ret != ERROR_SUCCESS) {
+				if (ret == ERROR_INSUFFICIENT_BUFFER) {
+					// Objects may appear before the next attempt, leave some space for them.
+					if (*(PULONG)outputBuffer > outputBufferLength)
+						outputBufferLength = *(PULONG)outputBuffer + *(PULONG)outputBuffer / 8;
+					else outputBufferLength *= 2;
+				}
+
 				HeapFree(GetProcessHeap(), 0, outputBuffer);
-				if (ret == ERROR_INSUFFICIENT_BUFFER)
-					outputBufferLength *= 2;
 			}
 		} else ret = GetLastError();
 	} while (ret == ERROR_INSUFFICIENT_BUFFER);
 
 	if (ret == ERROR_SUCCESS) {
-		PUCHAR tmpBuffer = (PUCHAR)outputBuffer;
-
-		tmpInfoArrayCount = *(PULONG)tmpBuffer;
-		tmpBuffer += sizeof(ULONG);
-		tmpInfoArray = (PIRPMON_DRIVER_INFO *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PIRPMON_DRIVER_INFO)*tmpInfoArrayCount);
-		if (tmpInfoArray != NULL) {
-			ULONG i = 0;
-
-			for (i = 0; i < tmpInfoArrayCount; ++i) {
-				PVOID driverObject = NULL;
-				ULONG deviceCount = 0;
-				ULONG driverNameLen = 0;
-				
-				driverObject = *(PVOID *)tmpBuffer;
-				tmpBuffer += sizeof(driverObject);
-				deviceCount = *(PULONG)tmpBuffer;
-				tmpBuffer += sizeof(deviceCount);
-				driverNameLen = *(PULONG)tmpBuffer;
-				tmpBuffer += sizeof(driverNameLen);
-				tmpInfoArray[i] = _DriverInfoAlloc(driverObject, (PWCHAR)tmpBuffer, driverNameLen, deviceCount);
-				if (tmpInfoArray[i] != NULL) {
-					ULONG j = 0;
-					PIRPMON_DRIVER_INFO driverInfo = tmpInfoArray[i];
-					
-					tmpBuffer += driverNameLen;
-					for (j = 0; j < deviceCount; ++j) {
-						PVOID deviceObject = NULL;
-						PVOID attachedDevice = NULL;
-						ULONG deviceNameLen = 0;
-						
-						deviceObject = *(PVOID *)tmpBuffer;
-						tmpBuffer += sizeof(deviceObject);
-						attachedDevice = *(PVOID *)tmpBuffer;
-						tmpBuffer += sizeof(attachedDevice);
-						deviceNameLen = *(PULONG)tmpBuffer;
-						tmpBuffer += sizeof(deviceNameLen);
-						driverInfo->Devices[j] = _DeviceInfoAlloc(deviceObject, attachedDevice, (PWCHAR)tmpBuffer, deviceNameLen);
-						if (driverInfo->Devices[j] == NULL) {
-							ULONG k = 0;
-
-							ret = ERROR_NOT_ENOUGH_MEMORY;
-							for (k = 0; k < j; ++k)
-								_DeviceInfoFree(driverInfo->Devices[k]);
-
-							break;
-						}
+		ULONG deviceCount = 0;
+		SIZE_T blockSize = 0;
+		PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT header = (PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT)outputBuffer;
 
-						tmpBuffer += deviceNameLen;
-					}
-				} else ret = ERROR_NOT_ENOUGH_MEMORY;
-			
-				if (ret != ERROR_SUCCESS) {
-					ULONG k = 0;
-
-					for (k = 0; k < i; ++k) {
-						ULONG l = 0;
-						PIRPMON_DRIVER_INFO driverInfo = tmpInfoArray[k];
-					
-						for (l = 0; l < driverInfo->DeviceCount; ++l)
-							_DeviceInfoFree(driverInfo->Devices[l]);
-
-						_DriverInfoFree(driverInfo);
-					}
+		InterlockedExchange(&_snapshotSizeHint, (LONG)(header->RequiredLength + header->RequiredLength / 8));
+		if (Generation != NULL)
+			*Generation = header->Generation;
 
-					break;
-				}
-			}
-		
-			if (ret == ERROR_SUCCESS) {
-				*DriverInfo = tmpInfoArray;
+		// The whole snapshot lives in a single block, see CodecSnapshotDecode.
+		tmpInfoArrayCount = header->DriverCount;
+		ret = CodecSnapshotMeasure(header, &deviceCount, &blockSize);
+		if (ret == ERROR_SUCCESS) {
+			tmpInfoArray = (PIRPMON_DRIVER_INFO *)HeapAlloc(GetProcessHeap(), 0, blockSize);
+			if (tmpInfoArray != NULL) {
+				*DriverInfo = CodecSnapshotDecode(header, deviceCount, tmpInfoArray);
 				*InfoCount = tmpInfoArrayCount;
-			}
-
-			if (ret != ERROR_SUCCESS)
-				HeapFree(GetProcessHeap(), 0, tmpInfoArray);
-		} else ret = GetLastError();
+			} else ret = ERROR_NOT_ENOUGH_MEMORY;
+		}
 
 		HeapFree(GetProcessHeap(), 0, outputBuffer);
 	}
@@ -319,20 +544,73 @@ DWORD DriverComSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCou
 
 VOID DriverComSnapshotFree(PIRPMON_DRIVER_INFO *DriverInfo, ULONG Count)
 {
-	ULONG i = 0;
 	DEBUG_ENTER_FUNCTION("DriverInfo=0x%p; Count=%u", DriverInfo, Count);
 
-	for (i = 0; i < Count; ++i) {
-		ULONG j = 0;
-		PIRPMON_DRIVER_INFO drvInfo = DriverInfo[i];
-	
-		for (j = 0; j < drvInfo->DeviceCount; ++j)
-			_DeviceInfoFree(drvInfo->Devices[j]);
+	UNREFERENCED_PARAMETER(Count);
+	HeapFree(GetProcessHeap(), 0, DriverInfo);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+DWORD DriverComObjectChangesGet(PULONG Generation, PIRPMON_RECORD_BATCH *Changes)
+{
+	ULONG i = 0;
+	ULONG offset = 0;
+	ULONG outputSize = 0;
+	PIRPMON_RECORD_BATCH tmpChanges = NULL;
+	IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT input;
+	PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT output = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Generation=0x%p; Changes=0x%p", Generation, Changes);
+
+	input.Generation = *Generation;
+	outputSize = 4096;
+	do {
+		output = (PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, outputSize);
+		if (output != NULL) {
+			ret = _SynchronousOtherIOCTL(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES, &input, sizeof(input), output, outputSize);
+			if (ret != ERROR_SUCCESS) {
+				if (ret == ERROR_INSUFFICIENT_BUFFER)
+					outputSize = (output->RequiredLength > outputSize) ? output->RequiredLength : outputSize * 2;
+
+				HeapFree(GetProcessHeap(), 0, output);
+			}
+		} else ret = ERROR_NOT_ENOUGH_MEMORY;
+	} while (ret == ERROR_INSUFFICIENT_BUFFER);
+
+	if (ret == ERROR_SUCCESS) {
+		// The batch, its record array and the records live in one block.
+		tmpChanges = (PIRPMON_RECORD_BATCH)HeapAlloc(GetProcessHeap(), 0, sizeof(IRPMON_RECORD_BATCH) + output->Count*sizeof(IRPMON_BATCH_RECORD) + output->RequiredLength);
+		if (tmpChanges != NULL) {
+			tmpChanges->Count = output->Count;
+			tmpChanges->Records = (PIRPMON_BATCH_RECORD)(tmpChanges + 1);
+			tmpChanges->Length = output->RequiredLength;
+			tmpChanges->Data = tmpChanges->Records + output->Count;
+			memcpy(tmpChanges->Data, output, output->RequiredLength);
+			offset = CodecRecordAlign(sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT));
+			for (i = 0; i < output->Count; ++i) {
+				if (!CodecRecordNext(tmpChanges->Data, tmpChanges->Length, &offset, &tmpChanges->Records[i].Header, &tmpChanges->Records[i].Size))
+					break;
+			}
+
+			tmpChanges->Count = i;
+			*Generation = output->Generation;
+			*Changes = tmpChanges;
+		} else ret = ERROR_NOT_ENOUGH_MEMORY;
 
-		_DriverInfoFree(drvInfo);
+		HeapFree(GetProcessHeap(), 0, output);
 	}
 
-	HeapFree(GetProcessHeap(), 0, DriverInfo);
+	DEBUG_EXIT_FUNCTION("%u, *Generation=%u, *Changes=0x%p", ret, *Generation, *Changes);
+	return ret;
+}
+
+VOID DriverComObjectChangesFree(PIRPMON_RECORD_BATCH Changes)
+{
+	DEBUG_ENTER_FUNCTION("Changes=0x%p", Changes);
+
+	HeapFree(GetProcessHeap(), 0, Changes);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -423,6 +701,210 @@ DWORD DriverComUnhookDriver(HANDLE HookHandle)
 	return ret;
 }
 
+
+DWORD DriverComHookBatch(PIRPMON_HOOK_DRIVER_BATCH_ENTRY Drivers, ULONG DriverCount, PIRPMON_HOOK_DEVICE_BATCH_ENTRY Devices, ULONG DeviceCount, BOOLEAN Activate)
+{
+	ULONG i = 0;
+	SIZE_T inputLength = 0;
+	SIZE_T outputOffset = 0;
+	SIZE_T nameOffset = 0;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT input = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY driverEntry = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY deviceEntry = NULL;
+	PIOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT output = NULL;
+	SIZE_T outputLength = (DriverCount + DeviceCount)*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT);
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Drivers=0x%p; DriverCount=%u; Devices=0x%p; DeviceCount=%u; Activate=%u", Drivers, DriverCount, Devices, DeviceCount, Activate);
+
+	nameOffset = sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_INPUT) + DriverCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY) + DeviceCount*sizeof(IOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY);
+	inputLength = nameOffset;
+	for (i = 0; i < DriverCount; ++i)
+		inputLength += (wcslen(Drivers[i].DriverName) + 1)*sizeof(WCHAR);
+
+	for (i = 0; i < DeviceCount; ++i) {
+		if (Devices[i].DeviceName != NULL)
+			inputLength += (wcslen(Devices[i].DeviceName) + 1)*sizeof(WCHAR);
+	}
+
+	// The names are WCHAR strings, the results contain pointers.
+	outputOffset = (inputLength + TYPE_ALIGNMENT(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT) - 1) & ~((SIZE_T)TYPE_ALIGNMENT(IOCTL_IRPMNDRV_HOOK_BATCH_RESULT) - 1);
+	input = (PIOCTL_IRPMNDRV_HOOK_BATCH_INPUT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, outputOffset + outputLength);
+	if (input != NULL) {
+		output = (PIOCTL_IRPMNDRV_HOOK_BATCH_OUTPUT)((PUCHAR)input + outputOffset);
+		input->Flags = (Activate) ? HOOK_BATCH_FLAG_ACTIVATE : 0;
+		input->DriverCount = DriverCount;
+		input->DeviceCount = DeviceCount;
+		driverEntry = (PIOCTL_IRPMNDRV_HOOK_BATCH_DRIVER_ENTRY)(input + 1);
+		for (i = 0; i < DriverCount; ++i) {
+			driverEntry->DriverNameOffset = (ULONG)nameOffset;
+			driverEntry->DriverNameLength = (ULONG)wcslen(Drivers[i].DriverName)*sizeof(WCHAR);
+			driverEntry->MonitorSettings = Drivers[i].MonitorSettings;
+			memcpy((PUCHAR)input + nameOffset, Drivers[i].DriverName, driverEntry->DriverNameLength);
+			nameOffset += driverEntry->DriverNameLength + sizeof(WCHAR);
+			++driverEntry;
+		}
+
+		deviceEntry = (PIOCTL_IRPMNDRV_HOOK_BATCH_DEVICE_ENTRY)driverEntry;
+		for (i = 0; i < DeviceCount; ++i) {
+			deviceEntry->DeviceAddress = Devices[i].DeviceAddress;
+			if (Devices[i].IRPSettings != NULL) {
+				deviceEntry->UseIRPSettings = TRUE;
+				memcpy(deviceEntry->IRPSettings, Devices[i].IRPSettings, sizeof(deviceEntry->IRPSettings));
+			}
+
+			if (Devices[i].FastIoSettings != NULL) {
+				deviceEntry->UseFastIoSettings = TRUE;
+				memcpy(deviceEntry->FastIoSettings, Devices[i].FastIoSettings, sizeof(deviceEntry->FastIoSettings));
+			}
+
+			if (Devices[i].DeviceName != NULL) {
+				deviceEntry->DeviceNameOffset = (ULONG)nameOffset;
+				deviceEntry->DeviceNameLength = (ULONG)wcslen(Devices[i].DeviceName)*sizeof(WCHAR);
+				memcpy((PUCHAR)input + nameOffset, Devices[i].DeviceName, deviceEntry->DeviceNameLength);
+				nameOffset += deviceEntry->DeviceNameLength + sizeof(WCHAR);
+			}
+
+			++deviceEntry;
+		}
+
+		ret = _SynchronousOtherIOCTL(IOCTL_IRPMNDRV_HOOK_BATCH, input, (ULONG)inputLength, output, (ULONG)outputLength);
+		if (ret == ERROR_SUCCESS) {
+			PIOCTL_IRPMNDRV_HOOK_BATCH_RESULT result = output->Results;
+
+			for (i = 0; i < DriverCount; ++i) {
+				Drivers[i].Result = _RtlNtStatusToDosError(result->Status);
+				Drivers[i].DriverHandle = result->Handle;
+				Drivers[i].ObjectId = result->ObjectId;
+				++result;
+			}
+
+			for (i = 0; i < DeviceCount; ++i) {
+				Devices[i].Result = _RtlNtStatusToDosError(result->Status);
+				Devices[i].DeviceHandle = result->Handle;
+				Devices[i].ObjectId = result->ObjectId;
+				++result;
+			}
+		}
+
+		HeapFree(GetProcessHeap(), 0, input);
+	} else ret = GetLastError();
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+DWORD DriverComUnhookDriverBatch(PHANDLE DriverHandles, ULONG Count, PDWORD Results)
+{
+	ULONG i = 0;
+	PIOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT input = NULL;
+	PIOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT output = NULL;
+	ULONG inputLength = FIELD_OFFSET(IOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT, HookHandles) + Count*sizeof(HANDLE);
+	ULONG outputOffset = (inputLength + (ULONG)TYPE_ALIGNMENT(IOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT) - 1) & ~((ULONG)TYPE_ALIGNMENT(IOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT) - 1);
+	ULONG outputLength = Count*sizeof(NTSTATUS);
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("DriverHandles=0x%p; Count=%u; Results=0x%p", DriverHandles, Count, Results);
+
+	input = (PIOCTL_IRPMNDRV_UNHOOK_BATCH_INPUT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, outputOffset + outputLength);
+	if (input != NULL) {
+		output = (PIOCTL_IRPMNDRV_UNHOOK_BATCH_OUTPUT)((PUCHAR)input + outputOffset);
+		input->Count = Count;
+		memcpy(input->HookHandles, DriverHandles, Count*sizeof(HANDLE));
+		ret = _SynchronousOtherIOCTL(IOCTL_IRPMNDRV_UNHOOK_BATCH, input, inputLength, output, outputLength);
+		if (ret == ERROR_SUCCESS && Results != NULL) {
+			for (i = 0; i < Count; ++i)
+				Results[i] = _RtlNtStatusToDosError(output->Statuses[i]);
+		}
+
+		HeapFree(GetProcessHeap(), 0, input);
+	} else ret = GetLastError();
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+DWORD DriverComHashTableStatistics(PHASH_TABLE_STATISTICS Statistics)
+{
+	IOCTL_IRPMNDRV_HASH_TABLE_STATS_OUTPUT output;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Statistics=0x%p", Statistics);
+
+	ret = _SynchronousReadIOCTL(IOCTL_IRPMNDRV_HASH_TABLE_STATS, &output, sizeof(output));
+	if (ret == ERROR_SUCCESS)
+		memcpy(Statistics, output.Tables, sizeof(output.Tables));
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+DWORD DriverComAllocatorStatistics(PEDriverAllocatorMode Mode, PDRIVER_ALLOCATOR_SITE_STATISTICS *Sites, PULONG Count)
+{
+	ULONG siteCount = 0;
+	ULONG outputSize = 0;
+	PDRIVER_ALLOCATOR_SITE_STATISTICS tmpSites = NULL;
+	PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT output = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Mode=0x%p; Sites=0x%p; Count=0x%p", Mode, Sites, Count);
+
+	// The driver reports the number of sites even if the buffer is too small. New
+	// sites may appear before the next attempt, so ask for a few more.
+	siteCount = 64;
+	do {
+		outputSize = FIELD_OFFSET(IOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT, Sites) + siteCount*sizeof(DRIVER_ALLOCATOR_SITE_STATISTICS);
+		output = (PIOCTL_IRPMNDRV_ALLOCATOR_STATS_OUTPUT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, outputSize);
+		if (output != NULL) {
+			ret = _SynchronousReadIOCTL(IOCTL_IRPMNDRV_ALLOCATOR_STATS, output, outputSize);
+			if (ret != ERROR_SUCCESS) {
+				siteCount = output->SiteCount + 16;
+				HeapFree(GetProcessHeap(), 0, output);
+			}
+		} else ret = ERROR_NOT_ENOUGH_MEMORY;
+	} while (ret == ERROR_INSUFFICIENT_BUFFER);
+
+	if (ret == ERROR_SUCCESS) {
+		if (output->SiteCount > 0) {
+			tmpSites = (PDRIVER_ALLOCATOR_SITE_STATISTICS)HeapAlloc(GetProcessHeap(), 0, output->SiteCount*sizeof(DRIVER_ALLOCATOR_SITE_STATISTICS));
+			if (tmpSites != NULL)
+				memcpy(tmpSites, output->Sites, output->SiteCount*sizeof(DRIVER_ALLOCATOR_SITE_STATISTICS));
+			else ret = ERROR_NOT_ENOUGH_MEMORY;
+		}
+
+		if (ret == ERROR_SUCCESS) {
+			*Mode = output->Mode;
+			*Sites = tmpSites;
+			*Count = output->SiteCount;
+		}
+
+		HeapFree(GetProcessHeap(), 0, output);
+	}
+
+	DEBUG_EXIT_FUNCTION("%u, *Mode=%u, *Sites=0x%p, *Count=%u", ret, *Mode, *Sites, *Count);
+	return ret;
+}
+
+VOID DriverComAllocatorStatisticsFree(PDRIVER_ALLOCATOR_SITE_STATISTICS Sites)
+{
+	DEBUG_ENTER_FUNCTION("Sites=0x%p", Sites);
+
+	if (Sites != NULL)
+		HeapFree(GetProcessHeap(), 0, Sites);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+DWORD DriverComAllocatorSetMode(EDriverAllocatorMode Mode)
+{
+	IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE_INPUT input;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Mode=%u", Mode);
+
+	input.Mode = Mode;
+	ret = _SynchronousWriteIOCTL(IOCTL_IRPMNDRV_ALLOCATOR_SET_MODE, &input, sizeof(input));
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
 DWORD DriverComConnect(HANDLE hSemaphore)
 {
 	DWORD ret = ERROR_GEN_FAILURE;
@@ -458,6 +940,101 @@ DWORD DriverComGetRequest(PREQUEST_HEADER Request, DWORD Size)
 	return ret;
 }
 
+DWORD DriverComFetchStart(ULONG PendingRequests, ULONG BufferSize, ULONG ThreadCount, IRPMON_RECORD_CALLBACK *Callback, PVOID Context)
+{
+	ULONG i = 0;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("PendingRequests=%u; BufferSize=%u; ThreadCount=%u; Callback=0x%p; Context=0x%p", PendingRequests, BufferSize, ThreadCount, Callback, Context);
+
+	if (PendingRequests > 0 && ThreadCount > 0 && Callback != NULL &&
+		BufferSize >= sizeof(IOCTL_IRPMNDRV_GET_RECORD_PENDING_ENTRY) + sizeof(REQUEST_GENERAL)) {
+		// The completion port needs a real file handle, the mock driver
+		// serves records only through the transport.
+		if (_transport != &_deviceTransport)
+			ret = ERROR_NOT_SUPPORTED;
+		else if (_recordsHandle == INVALID_HANDLE_VALUE) {
+			_fetchCallback = Callback;
+			_fetchContext = Context;
+			_fetchStopping = FALSE;
+			_fetchOutstanding = 1;
+			_fetchIdleEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+			if (_fetchIdleEvent != NULL) {
+				_recordsHandle = CreateFileW(IRPMNDRV_USER_DEVICE_NAME IRPMNDRV_RECORDS_FILE_NAME, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+				if (_recordsHandle != INVALID_HANDLE_VALUE) {
+					_fetchPort = CreateIoCompletionPort(_recordsHandle, NULL, 0, ThreadCount);
+					if (_fetchPort != NULL) {
+						ret = ERROR_SUCCESS;
+						_fetchBuffers = (PFETCH_BUFFER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, PendingRequests*sizeof(FETCH_BUFFER));
+						if (_fetchBuffers != NULL) {
+							_fetchBufferCount = PendingRequests;
+							for (i = 0; i < _fetchBufferCount; ++i) {
+								_fetchBuffers[i].Size = BufferSize;
+								_fetchBuffers[i].Data = (PUCHAR)HeapAlloc(GetProcessHeap(), 0, BufferSize);
+								if (_fetchBuffers[i].Data == NULL) {
+									ret = ERROR_NOT_ENOUGH_MEMORY;
+									break;
+								}
+							}
+						} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+						if (ret == ERROR_SUCCESS) {
+							_fetchThreads = (PHANDLE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ThreadCount*sizeof(HANDLE));
+							if (_fetchThreads != NULL) {
+								for (i = 0; i < ThreadCount; ++i) {
+									_fetchThreads[i] = CreateThread(NULL, 0, _FetchThreadRoutine, NULL, 0, NULL);
+									if (_fetchThreads[i] == NULL) {
+										ret = GetLastError();
+										break;
+									}
+
+									++_fetchThreadCount;
+								}
+							} else ret = ERROR_NOT_ENOUGH_MEMORY;
+						}
+
+						if (ret == ERROR_SUCCESS) {
+							for (i = 0; i < _fetchBufferCount; ++i) {
+								ret = _FetchBufferSubmit(_fetchBuffers + i);
+								if (ret != ERROR_SUCCESS)
+									break;
+							}
+
+							if (ret != ERROR_SUCCESS)
+								DriverComFetchStop();
+						}
+					} else ret = GetLastError();
+				} else ret = GetLastError();
+			} else ret = GetLastError();
+
+			if (ret != ERROR_SUCCESS && _fetchIdleEvent != NULL)
+				_FetchCleanup();
+		} else ret = ERROR_BUSY;
+	} else ret = ERROR_INVALID_PARAMETER;
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+VOID DriverComFetchStop(VOID)
+{
+	DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+	if (_recordsHandle != INVALID_HANDLE_VALUE) {
+		InterlockedExchange(&_fetchStopping, TRUE);
+		_FetchBufferRelease();
+		// A fetch thread might have resubmitted its buffer just before it noticed
+		// the stop request, so the cancellation is repeated until all buffers return.
+		do {
+			CancelIoEx(_recordsHandle, NULL);
+		} while (WaitForSingleObject(_fetchIdleEvent, 100) == WAIT_TIMEOUT);
+
+		_FetchCleanup();
+	}
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
 DWORD DriverComHookDeviceByName(PWCHAR DeviceName, PHANDLE HookHandle, PVOID *ObjectId)
 {
 	DWORD ret = ERROR_GEN_FAILURE;
@@ -579,103 +1156,21 @@ DWORD DriverComHookedObjectsEnumerate(PHOOKED_DRIVER_UMINFO *Info, PULONG Count)
 	} while (ret == ERROR_INSUFFICIENT_BUFFER);
 
 	if (ret == ERROR_SUCCESS) {
+		ULONG deviceCount = 0;
+		SIZE_T blockSize = 0;
 		PHOOKED_DRIVER_UMINFO tmpInfo = NULL;
 
 		if (hookedObjects->NumberOfHookedDrivers > 0) {
-			tmpInfo = (PHOOKED_DRIVER_UMINFO)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(HOOKED_DRIVER_UMINFO)*hookedObjects->NumberOfHookedDrivers);
-			if (tmpInfo != NULL) {
-				PHOOKED_DRIVER_INFO driverEntry = (PHOOKED_DRIVER_INFO)(hookedObjects + 1);
-				PHOOKED_DRIVER_UMINFO umDriverEntry = tmpInfo;
-
-				ret = ERROR_SUCCESS;
-				for (SIZE_T i = 0; i < hookedObjects->NumberOfHookedDrivers; ++i) {
-					umDriverEntry->ObjectId = driverEntry->ObjectId;
-					umDriverEntry->DriverObject = driverEntry->DriverObject;
-					umDriverEntry->MonitoringEnabled = driverEntry->MonitoringEnabled;
-					umDriverEntry->MonitorSettings = driverEntry->MonitorSettings;
-					umDriverEntry->DriverNameLen = driverEntry->DriverNameLen - sizeof(WCHAR);
-					umDriverEntry->DriverName = (PWCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, driverEntry->DriverNameLen);
-					if (umDriverEntry->DriverName != NULL) {
-						memcpy(umDriverEntry->DriverName, driverEntry->DriverName, driverEntry->DriverNameLen);
-						umDriverEntry->NumberOfHookedDevices = driverEntry->NumberOfHookedDevices;
-						umDriverEntry->HookedDevices = (umDriverEntry->NumberOfHookedDevices > 0) ?
-							(PHOOKED_DEVICE_UMINFO)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, umDriverEntry->NumberOfHookedDevices*sizeof(HOOKED_DEVICE_UMINFO)) :
-							NULL;
-
-						if (umDriverEntry->NumberOfHookedDevices == 0 || umDriverEntry->HookedDevices != NULL) {
-							PHOOKED_DEVICE_INFO deviceEntry = (PHOOKED_DEVICE_INFO)((PUCHAR)driverEntry + driverEntry->EntrySize);
-							PHOOKED_DEVICE_UMINFO umDeviceEntry = umDriverEntry->HookedDevices;
-
-							for (SIZE_T j = 0; j < umDriverEntry->NumberOfHookedDevices; ++j) {
-								umDeviceEntry->ObjectId = deviceEntry->ObjectId;
-								umDeviceEntry->DeviceObject = deviceEntry->DeviceObject;
-								memcpy(umDeviceEntry->FastIoSettings, deviceEntry->FastIoSettings, sizeof(umDeviceEntry->FastIoSettings));
-								memcpy(umDeviceEntry->IRPSettings, deviceEntry->IRPSettings, sizeof(umDeviceEntry->IRPSettings));
-								umDeviceEntry->MonitoringEnabled = deviceEntry->MonitoringEnabled;
-								umDeviceEntry->DeviceNameLen = deviceEntry->DeviceNameLen - sizeof(WCHAR);
-								umDeviceEntry->DeviceName = (PWCHAR)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, deviceEntry->DeviceNameLen);
-								if (umDeviceEntry->DeviceName != NULL)
-									memcpy(umDeviceEntry->DeviceName, deviceEntry->DeviceName, deviceEntry->DeviceNameLen);
-								else ret = GetLastError();
-
-								if (ret != ERROR_SUCCESS) {
-									--umDeviceEntry;
-									for (SIZE_T k = 0; k < j; ++k) {
-										HeapFree(GetProcessHeap(), 0, umDeviceEntry->DeviceName);
-										--umDeviceEntry;
-									}
-
-									break;
-								}
-
-								++umDeviceEntry;
-								deviceEntry = (PHOOKED_DEVICE_INFO)((PUCHAR)deviceEntry + deviceEntry->EntrySize);
-							}
-
-							driverEntry = (PHOOKED_DRIVER_INFO)deviceEntry;
-							if (ret != ERROR_SUCCESS) {
-								if (umDriverEntry->HookedDevices != NULL)
-									HeapFree(GetProcessHeap(), 0, umDriverEntry->HookedDevices);
-							}
-						} else ret = GetLastError();
-
-						if (ret != ERROR_SUCCESS)
-							HeapFree(GetProcessHeap(), 0, umDriverEntry->DriverName);
-					} else ret = GetLastError();
-
-					if (ret != ERROR_SUCCESS) {
-						--umDriverEntry;
-						for (SIZE_T j = 0; j < i; ++j) {
-							if (umDriverEntry->NumberOfHookedDevices > 0) {
-								ULONG k = 0;
-								PHOOKED_DEVICE_UMINFO umDeviceEntry = umDriverEntry->HookedDevices;
-
-								for (k = 0; k < umDriverEntry->NumberOfHookedDevices; ++k) {
-									HeapFree(GetProcessHeap(), 0, umDeviceEntry->DeviceName);
-									++umDeviceEntry;
-								}
-							
-								HeapFree(GetProcessHeap(), 0, umDriverEntry->HookedDevices);
-							}
-
-							HeapFree(GetProcessHeap(), 0, umDriverEntry->DriverName);
-							--umDriverEntry;
-						}
-
-						break;
-					}
-
-					++umDriverEntry;
-				}
-
-				if (ret == ERROR_SUCCESS) {
-					*Info = tmpInfo;
+			// The drivers, their devices and all the names are stored in a single
+			// block, so DriverComHookedObjectsFree needs just one HeapFree.
+			ret = CodecHookedObjectsMeasure(hookedObjects, hoLen, &deviceCount, &blockSize);
+			if (ret == ERROR_SUCCESS) {
+				tmpInfo = (PHOOKED_DRIVER_UMINFO)HeapAlloc(GetProcessHeap(), 0, blockSize);
+				if (tmpInfo != NULL) {
+					*Info = CodecHookedObjectsDecode(hookedObjects, deviceCount, tmpInfo);
 					*Count = hookedObjects->NumberOfHookedDrivers;
-				}
-
-				if (ret != ERROR_SUCCESS)
-					HeapFree(GetProcessHeap(), 0, tmpInfo);
-			} else ret = GetLastError();
+				} else ret = ERROR_NOT_ENOUGH_MEMORY;
+			}
 		} else {
 			*Info = NULL;
 			*Count = 0;
@@ -690,31 +1185,10 @@ DWORD DriverComHookedObjectsEnumerate(PHOOKED_DRIVER_UMINFO *Info, PULONG Count)
 
 VOID DriverComHookedObjectsFree(PHOOKED_DRIVER_UMINFO Info, ULONG Count)
 {
-	ULONG i = 0;
-	PHOOKED_DRIVER_UMINFO driverInfo = Info;
 	DEBUG_ENTER_FUNCTION("Info=0x%p; Count=%u", Info, Count);
 
-	if (Count > 0) {
-		for (i = 0; i < Count; ++i) {
-			if (driverInfo->NumberOfHookedDevices > 0) {
-				ULONG j = 0;
-				PHOOKED_DEVICE_UMINFO deviceInfo = driverInfo->HookedDevices;
-
-				for (i = 0; i < driverInfo->NumberOfHookedDevices; ++i) {
-					HeapFree(GetProcessHeap(), 0, deviceInfo->DeviceName);
-					++deviceInfo;
-				}
-
-				HeapFree(GetProcessHeap(), 0, driverInfo->HookedDevices);
-			}
-
-			HeapFree(GetProcessHeap(), 0, driverInfo->DriverName);
-
-			++driverInfo;
-		}
-
+	if (Count > 0)
 		HeapFree(GetProcessHeap(), 0, Info);
-	}
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -1047,16 +1521,41 @@ VOID DriverComDriverNameWatchEnumFree(PDRIVER_NAME_WATCH_RECORD Array, ULONG Cou
 	return;
 }
 
+/************************************************************************/
+/*                     TRANSPORT                                        */
+/************************************************************************/
+
+
+PTRANSPORT DriverComTransport(VOID)
+{
+	return _transport;
+}
+
+
+DWORD DriverComMockStatistics(PIRPMON_MOCK_STATISTICS Statistics)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Statistics=0x%p", Statistics);
+
+	if (_transport == &_mockTransport) {
+		MockDriverStatistics(_mockTransport.Context, Statistics);
+		ret = ERROR_SUCCESS;
+	} else ret = ERROR_NOT_SUPPORTED;
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
 /************************************************************************/
 /*                   INITIALIZATION AND FINALIZATION                    */
 /************************************************************************/
 
 
-DWORD DriverComModuleInit(VOID)
+static DWORD _NtdllRoutinesGet(VOID)
 {
 	HMODULE HNtdll = NULL;
 	DWORD ret = ERROR_GEN_FAILURE;
-	DEBUG_ENTER_FUNCTION_NO_ARGS();
 
 	HNtdll = GetModuleHandleW(L"ntdll.dll");
 	if (HNtdll != NULL) {
@@ -1064,17 +1563,56 @@ DWORD DriverComModuleInit(VOID)
 		if (_RtlStringFromGuid != NULL) {
 			_RtlFreeUnicodeString = (RTLFREEUNICODESTRING *)GetProcAddress(HNtdll, "RtlFreeUnicodeString");
 			if (_RtlFreeUnicodeString != NULL) {
-				_deviceHandle = CreateFileW(IRPMNDRV_USER_DEVICE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-				_initialized = (_deviceHandle != INVALID_HANDLE_VALUE);
-				if (_initialized)
+				_RtlNtStatusToDosError = (RTLNTSTATUSTODOSERROR *)GetProcAddress(HNtdll, "RtlNtStatusToDosError");
+				if (_RtlNtStatusToDosError != NULL)
 					ret = ERROR_SUCCESS;
-
-				if (!_initialized)
-					ret = GetLastError();
+				else ret = GetLastError();
 			} else ret = GetLastError();
 		} else ret = GetLastError();
 	} else ret = GetLastError();
 
+	return ret;
+}
+
+
+DWORD DriverComModuleInit(VOID)
+{
+	HANDLE deviceHandle = INVALID_HANDLE_VALUE;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+	ret = _NtdllRoutinesGet();
+	if (ret == ERROR_SUCCESS) {
+		deviceHandle = CreateFileW(IRPMNDRV_USER_DEVICE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		_initialized = (deviceHandle != INVALID_HANDLE_VALUE);
+		if (_initialized) {
+			_deviceTransport.Context = deviceHandle;
+			_transport = &_deviceTransport;
+			ret = ERROR_SUCCESS;
+		}
+
+		if (!_initialized)
+			ret = GetLastError();
+	}
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+DWORD DriverComModuleInitMock(PIRPMON_MOCK_SETTINGS Settings)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Settings=0x%p", Settings);
+
+	ret = _NtdllRoutinesGet();
+	if (ret == ERROR_SUCCESS) {
+		ret = MockDriverOpen(Settings, &_mockTransport);
+		_initialized = (ret == ERROR_SUCCESS);
+		if (_initialized)
+			_transport = &_mockTransport;
+	}
+
 	DEBUG_EXIT_FUNCTION("%u", ret);
 	return ret;
 }
@@ -1083,10 +1621,12 @@ VOID DriverComModuleFinit(VOID)
 {
 	DEBUG_ENTER_FUNCTION_NO_ARGS();
 
+	DriverComFetchStop();
 	_connected = FALSE;
 	_initialized = FALSE;
-	CloseHandle(_deviceHandle);
-	_deviceHandle = INVALID_HANDLE_VALUE;
+	_transport->Close(_transport->Context);
+	_deviceTransport.Context = INVALID_HANDLE_VALUE;
+	_transport = &_deviceTransport;
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -5,6 +5,8 @@
 #include <windows.h>
 #include "general-types.h"
 #include "kernel-shared.h"
+#include "irpmondll-types.h"
+#include "transport.h"
 
 
 DWORD DriverComHookDriver(PWCHAR DriverName, PDRIVER_MONITOR_SETTINGS MonitorSettings, PHANDLE HookHandle, PVOID *ObjectId);
@@ -12,10 +14,18 @@ DWORD DriverComHookedDriverSetInfo(HANDLE Driverhandle, PDRIVER_MONITOR_SETTINGS
 DWORD DriverComHookedDriverGetInfo(HANDLE Driverhandle, PDRIVER_MONITOR_SETTINGS Settings, PBOOLEAN MonitoringEnabled);
 DWORD DriverComHookedDriverActivate(HANDLE DriverHandle, BOOLEAN Activate);
 DWORD DriverComUnhookDriver(HANDLE HookHandle);
+DWORD DriverComHookBatch(PIRPMON_HOOK_DRIVER_BATCH_ENTRY Drivers, ULONG DriverCount, PIRPMON_HOOK_DEVICE_BATCH_ENTRY Devices, ULONG DeviceCount, BOOLEAN Activate);
+DWORD DriverComUnhookDriverBatch(PHANDLE DriverHandles, ULONG Count, PDWORD Results);
+DWORD DriverComHashTableStatistics(PHASH_TABLE_STATISTICS Statistics);
+DWORD DriverComAllocatorStatistics(PEDriverAllocatorMode Mode, PDRIVER_ALLOCATOR_SITE_STATISTICS *Sites, PULONG Count);
+VOID DriverComAllocatorStatisticsFree(PDRIVER_ALLOCATOR_SITE_STATISTICS Sites);
+DWORD DriverComAllocatorSetMode(EDriverAllocatorMode Mode);
 
 DWORD DriverComConnect(HANDLE hSemaphore);
 DWORD DriverComDisconnect(VOID);
 DWORD DriverComGetRequest(PREQUEST_HEADER Request, DWORD Size);
+DWORD DriverComFetchStart(ULONG PendingRequests, ULONG BufferSize, ULONG ThreadCount, IRPMON_RECORD_CALLBACK *Callback, PVOID Context);
+VOID DriverComFetchStop(VOID);
 
 DWORD DriverComHookDeviceByName(PWCHAR DeviceName, PHANDLE HookHandle, PVOID *ObjectId);
 DWORD DriverComHookDeviceByAddress(PVOID DeviceObject, PHANDLE HookHandle, PVOID *ObjectId);
@@ -23,8 +33,10 @@ DWORD DriverComDeviceGetInfo(HANDLE DeviceHandle, PUCHAR IRPSettings, PUCHAR Fas
 DWORD DriverComDeviceSetInfo(HANDLE DeviceHandle, PUCHAR IRPSettings, PUCHAR FastIoSettings, BOOLEAN MonitoringEnabled);
 DWORD DriverComUnhookDevice(HANDLE HookHandle);
 
-DWORD DriverComSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCount);
+DWORD DriverComSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCount, PULONG Generation);
 VOID DriverComSnapshotFree(PIRPMON_DRIVER_INFO *DriverInfo, ULONG Count);
+DWORD DriverComObjectChangesGet(PULONG Generation, PIRPMON_RECORD_BATCH *Changes);
+VOID DriverComObjectChangesFree(PIRPMON_RECORD_BATCH Changes);
 
 DWORD DriverComHookedObjectsEnumerate(PHOOKED_DRIVER_UMINFO *Info, PULONG Count);
 VOID DriverComHookedObjectsFree(PHOOKED_DRIVER_UMINFO Info, ULONG Count);
@@ -44,7 +56,11 @@ DWORD DriverComDriverNameWatchUnregister(PWCHAR DriverName);
 DWORD DriverComDriverNameWatchEnum(PDRIVER_NAME_WATCH_RECORD *Array, PULONG Count);
 VOID DriverComDriverNameWatchEnumFree(PDRIVER_NAME_WATCH_RECORD Array, ULONG Count);
 
+PTRANSPORT DriverComTransport(VOID);
+DWORD DriverComMockStatistics(PIRPMON_MOCK_STATISTICS Statistics);
+
 DWORD DriverComModuleInit(VOID);
+DWORD DriverComModuleInitMock(PIRPMON_MOCK_SETTINGS Settings);
 VOID DriverComModuleFinit(VOID);
 
 
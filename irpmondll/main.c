@@ -3,6 +3,7 @@
 #include "debug.h"
 #include "irpmondll-types.h"
 #include "driver-com.h"
+#include "consumer.h"
 #include "irpmondll.h"
 
 
@@ -27,6 +28,37 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllDisconnect(VOID)
 	return DriverComDisconnect();
 }
 
+IRPMONDLL_API DWORD WINAPI IRPMonDllFetchStart(ULONG PendingRequests, ULONG BufferSize, ULONG ThreadCount, IRPMON_RECORD_CALLBACK *Callback, PVOID Context)
+{
+	return DriverComFetchStart(PendingRequests, BufferSize, ThreadCount, Callback, Context);
+}
+
+IRPMONDLL_API VOID WINAPI IRPMonDllFetchStop(VOID)
+{
+	DriverComFetchStop();
+
+	return;
+}
+
+IRPMONDLL_API DWORD WINAPI IRPMonDllStartConsumer(IRPMON_BATCH_CALLBACK *Callback, ULONG BatchSize, ULONG MaxLatency, PVOID Context)
+{
+	return ConsumerStart(Callback, BatchSize, MaxLatency, Context);
+}
+
+IRPMONDLL_API VOID WINAPI IRPMonDllStopConsumer(VOID)
+{
+	ConsumerStop();
+
+	return;
+}
+
+IRPMONDLL_API VOID WINAPI IRPMonDllConsumerBatchRelease(PIRPMON_RECORD_BATCH Batch)
+{
+	ConsumerBatchRelease(Batch);
+
+	return;
+}
+
 
 IRPMONDLL_API DWORD WINAPI IRPMonDllHookDriver(PWCHAR DriverName, PDRIVER_MONITOR_SETTINGS MonitorSettings, PHANDLE DriverHandle, PVOID *ObjectId)
 {
@@ -39,9 +71,25 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllUnhookDriver(HANDLE HookHandle)
 }
 
 
+IRPMONDLL_API DWORD WINAPI IRPMonDllHookBatch(PIRPMON_HOOK_DRIVER_BATCH_ENTRY Drivers, ULONG DriverCount, PIRPMON_HOOK_DEVICE_BATCH_ENTRY Devices, ULONG DeviceCount, BOOLEAN Activate)
+{
+	return DriverComHookBatch(Drivers, DriverCount, Devices, DeviceCount, Activate);
+}
+
+IRPMONDLL_API DWORD WINAPI IRPMonDllUnhookDriverBatch(PHANDLE DriverHandles, ULONG Count, PDWORD Results)
+{
+	return DriverComUnhookDriverBatch(DriverHandles, Count, Results);
+}
+
+
 IRPMONDLL_API DWORD WINAPI IRPMonDllSnapshotRetrieve(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCount)
 {
-	return DriverComSnapshotRetrieve(DriverInfo, InfoCount);
+	return DriverComSnapshotRetrieve(DriverInfo, InfoCount, NULL);
+}
+
+IRPMONDLL_API DWORD WINAPI IRPMonDllSnapshotRetrieveEx(PIRPMON_DRIVER_INFO **DriverInfo, PULONG InfoCount, PULONG Generation)
+{
+	return DriverComSnapshotRetrieve(DriverInfo, InfoCount, Generation);
 }
 
 IRPMONDLL_API VOID WINAPI IRPMonDllSnapshotFree(PIRPMON_DRIVER_INFO *DriverInfo, ULONG Count)
@@ -51,6 +99,18 @@ IRPMONDLL_API VOID WINAPI IRPMonDllSnapshotFree(PIRPMON_DRIVER_INFO *DriverInfo,
 	return;
 }
 
+IRPMONDLL_API DWORD WINAPI IRPMonDllObjectChangesGet(PULONG Generation, PIRPMON_RECORD_BATCH *Changes)
+{
+	return DriverComObjectChangesGet(Generation, Changes);
+}
+
+IRPMONDLL_API VOID WINAPI IRPMonDllObjectChangesFree(PIRPMON_RECORD_BATCH Changes)
+{
+	DriverComObjectChangesFree(Changes);
+
+	return;
+}
+
 IRPMONDLL_API DWORD WINAPI IRPMonDllHookDeviceByName(PWCHAR DeviceName, PHANDLE HookHandle, PVOID *ObjectId)
 {
 	return DriverComHookDeviceByName(DeviceName, HookHandle, ObjectId);
@@ -196,6 +256,28 @@ IRPMONDLL_API VOID WINAPI IRPMonDllDriverNameWatchEnumFree(PDRIVER_NAME_WATCH_RE
 	return;
 }
 
+IRPMONDLL_API DWORD WINAPI IRPMonDllHashTableStatistics(PHASH_TABLE_STATISTICS Statistics)
+{
+	return DriverComHashTableStatistics(Statistics);
+}
+
+IRPMONDLL_API DWORD WINAPI IRPMonDllAllocatorStatistics(PEDriverAllocatorMode Mode, PDRIVER_ALLOCATOR_SITE_STATISTICS *Sites, PULONG Count)
+{
+	return DriverComAllocatorStatistics(Mode, Sites, Count);
+}
+
+IRPMONDLL_API VOID WINAPI IRPMonDllAllocatorStatisticsFree(PDRIVER_ALLOCATOR_SITE_STATISTICS Sites)
+{
+	DriverComAllocatorStatisticsFree(Sites);
+
+	return;
+}
+
+IRPMONDLL_API DWORD WINAPI IRPMonDllAllocatorSetMode(EDriverAllocatorMode Mode)
+{
+	return DriverComAllocatorSetMode(Mode);
+}
+
 
 /************************************************************************/
 /*                          INITIALIZATION AND FINALIZATION             */
@@ -212,10 +294,27 @@ IRPMONDLL_API DWORD WINAPI IRPMonDllInitialize(VOID)
 	return ret;
 }
 
+IRPMONDLL_API DWORD WINAPI IRPMonDllInitializeMock(PIRPMON_MOCK_SETTINGS Settings)
+{
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Settings=0x%p", Settings);
+
+	ret = DriverComModuleInitMock(Settings);
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+IRPMONDLL_API DWORD WINAPI IRPMonDllMockStatistics(PIRPMON_MOCK_STATISTICS Statistics)
+{
+	return DriverComMockStatistics(Statistics);
+}
+
 IRPMONDLL_API VOID WINAPI IRPMonDllFinalize(VOID)
 {
 	DEBUG_ENTER_FUNCTION_NO_ARGS();
 
+	ConsumerStop();
 	DriverComModuleFinit();
 
 	DEBUG_EXIT_FUNCTION_VOID();
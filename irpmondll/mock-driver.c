@@ -0,0 +1,557 @@
+
+/**
+ * @file
+ *
+ * An in-process replacement of the IRPMon driver. It speaks the same protocol as
+ * the driver, so the rest of the library, including the record consumer, runs
+ * unchanged on top of it, but it needs neither the driver nor administrator
+ * privileges. That makes it suitable for measuring and testing the consumer side.
+ *
+ * The driver reports a synthetic set of drivers and devices and, once a client
+ * connects, produces pairs of IRP and IRP completion records for these devices
+ * at the configured rate. The records are not stored; the queue is represented
+ * only by counters and the records are built when they are retrieved. Records
+ * exceeding the queue limit are dropped the same way the driver drops them when
+ * the client does not keep up.
+ */
+
+#include <windows.h>
+#include <stdio.h>
+#include "debug.h"
+#include "ioctls.h"
+#include "kernel-shared.h"
+#include "general-types.h"
+#include "irpmondll-types.h"
+#include "codec.h"
+#include "transport.h"
+#include "mock-driver.h"
+
+
+/************************************************************************/
+/*               TYPE DEFINITIONS                                       */
+/************************************************************************/
+
+/** One synthetic device, records are spread over all devices. */
+typedef struct _MOCK_DEVICE {
+	PVOID DriverObject;
+	PVOID DeviceObject;
+} MOCK_DEVICE, *PMOCK_DEVICE;
+
+typedef union _MOCK_RECORD {
+	REQUEST_HEADER Header;
+	REQUEST_IRP Irp;
+	REQUEST_IRP_COMPLETION Completion;
+} MOCK_RECORD, *PMOCK_RECORD;
+
+typedef struct _MOCK_DRIVER {
+	IRPMON_MOCK_SETTINGS Settings;
+	/** Protects the connection state and the counters. */
+	CRITICAL_SECTION Lock;
+	BOOLEAN Connected;
+	/** Tick count of the connection. */
+	ULONGLONG ConnectTime;
+	/** System time of the connection, the time of the records is derived from it. */
+	ULONGLONG ConnectSystemTime;
+	/** Value of the Generated counter at the connection. */
+	ULONGLONG ConnectGenerated;
+	ULONGLONG Generated;
+	ULONGLONG Delivered;
+	ULONGLONG Dropped;
+	ULONG DeviceCount;
+	PMOCK_DEVICE Devices;
+	/** Output of IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO, built when the driver is opened. */
+	PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT Snapshot;
+} MOCK_DRIVER, *PMOCK_DRIVER;
+
+/** A channel for record retrieval. */
+typedef struct _MOCK_RECORDS {
+	PMOCK_DRIVER Driver;
+} MOCK_RECORDS, *PMOCK_RECORDS;
+
+
+/************************************************************************/
+/*                           GLOBAL VARIABLES                           */
+/************************************************************************/
+
+/** Major functions of the synthetic IRPs. */
+static const UCHAR _mockMajorFunctions[] = {
+	0x03, // IRP_MJ_READ
+	0x04, // IRP_MJ_WRITE
+	0x0e, // IRP_MJ_DEVICE_CONTROL
+	0x0f, // IRP_MJ_INTERNAL_DEVICE_CONTROL
+};
+
+
+/************************************************************************/
+/*                          HELPER ROUTINES                             */
+/************************************************************************/
+
+#define _MockPending(aDriver)					\
+	((aDriver)->Generated - (aDriver)->Delivered - (aDriver)->Dropped)
+
+#define _MockDriverAddress(aDriverIndex)		\
+	((PVOID)(ULONG_PTR)(0x10000000 + (aDriverIndex)*0x10000))
+
+#define _MockDeviceAddress(aDriverIndex, aDeviceIndex)		\
+	((PVOID)(ULONG_PTR)(0x10000000 + (aDriverIndex)*0x10000 + ((aDeviceIndex) + 1)*0x100))
+
+
+/** Accounts records produced since the last call. Must be called with the
+ *  lock held.
+ */
+static VOID _MockUpdate(PMOCK_DRIVER Driver)
+{
+	ULONGLONG due = 0;
+	ULONGLONG pending = 0;
+
+	if (Driver->Connected && Driver->Settings.RecordsPerSecond > 0) {
+		due = Driver->ConnectGenerated + (GetTickCount64() - Driver->ConnectTime)*Driver->Settings.RecordsPerSecond / 1000;
+		if (due > Driver->Generated) {
+			Driver->Generated = due;
+			pending = _MockPending(Driver);
+			if (Driver->Settings.QueueLimit > 0 && pending > Driver->Settings.QueueLimit)
+				Driver->Dropped += pending - Driver->Settings.QueueLimit;
+		}
+	}
+
+	return;
+}
+
+
+/** Computes how long it takes until the next record is produced. Must be
+ *  called with the lock held.
+ *
+ *  @return
+ *  Returns the time in milliseconds, or INFINITE if no records are produced.
+ */
+static DWORD _MockNextRecordTime(PMOCK_DRIVER Driver)
+{
+	ULONGLONG elapsed = 0;
+	ULONGLONG nextTime = 0;
+	DWORD ret = INFINITE;
+
+	if (Driver->Connected && Driver->Settings.RecordsPerSecond > 0) {
+		nextTime = ((Driver->Generated - Driver->ConnectGenerated + 1)*1000 + Driver->Settings.RecordsPerSecond - 1) / Driver->Settings.RecordsPerSecond;
+		elapsed = GetTickCount64() - Driver->ConnectTime;
+		ret = (nextTime > elapsed) ? (DWORD)(nextTime - elapsed) : 0;
+	}
+
+	return ret;
+}
+
+
+/** Builds the record with a given sequence number. Records with even numbers
+ *  are IRPs, the following odd ones are their completions.
+ *
+ *  @param Driver The mock driver.
+ *  @param Sequence Sequence number of the record.
+ *  @param Record Receives the record.
+ *
+ *  @return
+ *  Returns size of the record, in bytes.
+ */
+static ULONG _MockRecordBuild(PMOCK_DRIVER Driver, ULONGLONG Sequence, PMOCK_RECORD Record)
+{
+	FILETIME now;
+	ULONGLONG irpIndex = Sequence / 2;
+	PMOCK_DEVICE device = NULL;
+	PVOID irpAddress = (PVOID)(ULONG_PTR)(0x100000 + (irpIndex % 0x10000)*0x100);
+	ULONG ret = 0;
+
+	memset(Record, 0, sizeof(MOCK_RECORD));
+	if (Driver->DeviceCount > 0) {
+		device = Driver->Devices + irpIndex % Driver->DeviceCount;
+		Record->Header.Driver = device->DriverObject;
+		Record->Header.Device = device->DeviceObject;
+	}
+
+	Record->Header.Id = (ULONG)Sequence;
+	if (Driver->Settings.RecordsPerSecond > 0)
+		Record->Header.Time.QuadPart = (LONGLONG)(Driver->ConnectSystemTime + (Sequence - Driver->ConnectGenerated)*10000000 / Driver->Settings.RecordsPerSecond);
+	else {
+		GetSystemTimeAsFileTime(&now);
+		Record->Header.Time.LowPart = now.dwLowDateTime;
+		Record->Header.Time.HighPart = now.dwHighDateTime;
+	}
+
+	Record->Header.ProcessId = (HANDLE)(ULONG_PTR)(4 + (irpIndex % 16)*4);
+	Record->Header.ThreadId = (HANDLE)(ULONG_PTR)(1000 + (irpIndex % 64)*4);
+	if ((Sequence % 2) == 0) {
+		Record->Header.Type = ertIRP;
+		RequestHeaderSetResult(Record->Header, NTSTATUS, STATUS_PENDING);
+		Record->Irp.MajorFunction = _mockMajorFunctions[irpIndex % (sizeof(_mockMajorFunctions) / sizeof(_mockMajorFunctions[0]))];
+		Record->Irp.PreviousMode = 1;
+		Record->Irp.RequestorMode = 1;
+		Record->Irp.IRPAddress = irpAddress;
+		Record->Irp.Arg1 = (PVOID)(ULONG_PTR)(512 << (irpIndex % 4));
+		ret = sizeof(REQUEST_IRP);
+	} else {
+		Record->Header.Type = ertIRPCompletion;
+		Record->Completion.IRPAddress = irpAddress;
+		Record->Completion.CompletionStatus = 0;
+		Record->Completion.CompletionInformation = 512 << (irpIndex % 4);
+		ret = sizeof(REQUEST_IRP_COMPLETION);
+	}
+
+	return ret;
+}
+
+
+/** Removes records from the queue and stores them into a buffer. Must be called
+ *  with the lock held.
+ *
+ *  @param Driver The mock driver.
+ *  @param Buffer Receives the records in the format of IOCTL_IRPMNDRV_GET_RECORD_PENDING.
+ *  @param Length Size of the buffer, in bytes.
+ *  @param ReturnLength Receives the number of bytes used. If the first record
+ *  does not fit, receives size of the buffer required.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS, ERROR_NO_MORE_ITEMS if the queue is empty, or
+ *  ERROR_INSUFFICIENT_BUFFER.
+ */
+static DWORD _MockRecordsGet(PMOCK_DRIVER Driver, PVOID Buffer, ULONG Length, PULONG ReturnLength)
+{
+	ULONG size = 0;
+	ULONG offset = 0;
+	ULONG lastOffset = 0;
+	MOCK_RECORD record;
+	DWORD ret = ERROR_NO_MORE_ITEMS;
+
+	while (Driver->Settings.RecordsPerSecond == 0 || _MockPending(Driver) > 0) {
+		// Records exceeding the limit are the newest ones, so the records
+		// retrieved continue the sequence after the dropped ones.
+		size = _MockRecordBuild(Driver, Driver->Delivered + Driver->Dropped, &record);
+		lastOffset = offset;
+		if (CodecRecordAppend(Buffer, Length, &offset, &record.Header, size) != ERROR_SUCCESS) {
+			if (lastOffset == 0)
+				ret = ERROR_INSUFFICIENT_BUFFER;
+			else offset = lastOffset;
+
+			break;
+		}
+
+		if (Driver->Settings.RecordsPerSecond == 0)
+			++Driver->Generated;
+
+		++Driver->Delivered;
+		ret = ERROR_SUCCESS;
+	}
+
+	*ReturnLength = offset;
+
+	return ret;
+}
+
+
+/** Builds the snapshot of the synthetic drivers and devices.
+ *
+ *  @remark
+ *  The snapshot is encoded twice, first into an empty buffer to determine its size.
+ */
+static DWORD _MockSnapshotCreate(PMOCK_DRIVER Driver)
+{
+	ULONG i = 0;
+	ULONG j = 0;
+	ULONG pass = 0;
+	ULONG offset = 0;
+	ULONG length = 0;
+	ULONG nameLen = 0;
+	WCHAR name[64];
+	PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT snapshot = NULL;
+	DWORD ret = ERROR_SUCCESS;
+
+	for (pass = 0; pass < 2; ++pass) {
+		offset = sizeof(IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT);
+		for (i = 0; i < Driver->Settings.DriverCount; ++i) {
+			nameLen = (ULONG)swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Driver\\Mock%u", i)*sizeof(WCHAR);
+			CodecSnapshotAppendDriver(snapshot, length, &offset, _MockDriverAddress(i), Driver->Settings.DevicesPerDriver, name, nameLen);
+			for (j = 0; j < Driver->Settings.DevicesPerDriver; ++j) {
+				nameLen = (ULONG)swprintf(name, sizeof(name) / sizeof(name[0]), L"\\Device\\Mock%u_%u", i, j)*sizeof(WCHAR);
+				CodecSnapshotAppendDevice(snapshot, length, &offset, _MockDeviceAddress(i, j), NULL, name, nameLen);
+			}
+		}
+
+		if (pass == 0) {
+			length = offset;
+			snapshot = (PIOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO_OUTPUT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, length);
+			if (snapshot == NULL) {
+				ret = ERROR_NOT_ENOUGH_MEMORY;
+				break;
+			}
+
+			snapshot->RequiredLength = length;
+			snapshot->Generation = 0;
+			snapshot->DriverCount = Driver->Settings.DriverCount;
+		}
+	}
+
+	if (ret == ERROR_SUCCESS)
+		Driver->Snapshot = snapshot;
+
+	return ret;
+}
+
+
+static VOID _MockFree(PMOCK_DRIVER Driver)
+{
+	if (Driver->Snapshot != NULL)
+		HeapFree(GetProcessHeap(), 0, Driver->Snapshot);
+
+	if (Driver->Devices != NULL)
+		HeapFree(GetProcessHeap(), 0, Driver->Devices);
+
+	DeleteCriticalSection(&Driver->Lock);
+	HeapFree(GetProcessHeap(), 0, Driver);
+
+	return;
+}
+
+
+/************************************************************************/
+/*                       TRANSPORT ROUTINES                             */
+/************************************************************************/
+
+static DWORD _MockIoctl(PVOID Context, DWORD Code, PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength)
+{
+	FILETIME now;
+	PMOCK_DRIVER driver = (PMOCK_DRIVER)Context;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Context=0x%p; Code=0x%x; InputBuffer=0x%p; InputBufferLength=%u; OutputBuffer=0x%p; OutputBufferLength=%u; ReturnLength=0x%p", Context, Code, InputBuffer, InputBufferLength, OutputBuffer, OutputBufferLength, ReturnLength);
+
+	*ReturnLength = 0;
+	EnterCriticalSection(&driver->Lock);
+	switch (Code) {
+		case IOCTL_IRPMNDRV_CONNECT:
+			ret = (!driver->Connected) ? ERROR_SUCCESS : ERROR_ALREADY_EXISTS;
+			if (ret == ERROR_SUCCESS) {
+				GetSystemTimeAsFileTime(&now);
+				driver->ConnectSystemTime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+				driver->ConnectTime = GetTickCount64();
+				driver->ConnectGenerated = driver->Generated;
+				driver->Connected = TRUE;
+			}
+			break;
+		case IOCTL_IRPMNDRV_DISCONNECT:
+			ret = (driver->Connected) ? ERROR_SUCCESS : ERROR_INVALID_FUNCTION;
+			if (ret == ERROR_SUCCESS) {
+				_MockUpdate(driver);
+				driver->Connected = FALSE;
+				// The driver clears its queue on disconnection.
+				driver->Dropped += _MockPending(driver);
+			}
+			break;
+		case IOCTL_IRPMNDRV_GET_RECORD:
+			_MockUpdate(driver);
+			ret = ERROR_NO_MORE_ITEMS;
+			if (driver->Connected) {
+				ULONG length = 0;
+				ULONG size = 0;
+				MOCK_RECORD record;
+
+				if (driver->Settings.RecordsPerSecond == 0 || _MockPending(driver) > 0) {
+					size = _MockRecordBuild(driver, driver->Delivered + driver->Dropped, &record);
+					ret = (OutputBufferLength >= size) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER;
+					if (ret == ERROR_SUCCESS) {
+						memcpy(OutputBuffer, &record, size);
+						length = size;
+						if (driver->Settings.RecordsPerSecond == 0)
+							++driver->Generated;
+
+						++driver->Delivered;
+					}
+				}
+
+				*ReturnLength = length;
+			}
+			break;
+		case IOCTL_IRPMNDRV_GET_DRIVER_DEVICE_INFO:
+			ret = (OutputBufferLength >= driver->Snapshot->RequiredLength) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER;
+			if (ret == ERROR_SUCCESS) {
+				memcpy(OutputBuffer, driver->Snapshot, driver->Snapshot->RequiredLength);
+				*ReturnLength = driver->Snapshot->RequiredLength;
+			} else if (OutputBufferLength >= sizeof(ULONG))
+				*(PULONG)OutputBuffer = driver->Snapshot->RequiredLength;
+			break;
+		case IOCTL_IRPMNDRV_GET_OBJECT_CHANGES: {
+			PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT output = (PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT)OutputBuffer;
+
+			// The set of synthetic objects never changes.
+			ret = (InputBufferLength >= sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT)) ? ERROR_SUCCESS : ERROR_INVALID_PARAMETER;
+			if (ret == ERROR_SUCCESS && ((PIOCTL_IRPMNDRV_GET_OBJECT_CHANGES_INPUT)InputBuffer)->Generation != driver->Snapshot->Generation)
+				ret = ERROR_NOT_FOUND;
+
+			if (ret == ERROR_SUCCESS && OutputBufferLength < sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT))
+				ret = ERROR_INSUFFICIENT_BUFFER;
+
+			if (ret == ERROR_SUCCESS) {
+				memset(output, 0, sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT));
+				output->RequiredLength = sizeof(IOCTL_IRPMNDRV_GET_OBJECT_CHANGES_OUTPUT);
+				output->Generation = driver->Snapshot->Generation;
+				*ReturnLength = output->RequiredLength;
+			}
+		} break;
+		case IOCTL_IRPMONDRV_HOOK_GET_INFO:
+			// Nothing can be hooked.
+			ret = (OutputBufferLength >= sizeof(HOOKED_OBJECTS_INFO)) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER;
+			if (ret == ERROR_SUCCESS) {
+				memset(OutputBuffer, 0, sizeof(HOOKED_OBJECTS_INFO));
+				*ReturnLength = sizeof(HOOKED_OBJECTS_INFO);
+			}
+			break;
+		default:
+			ret = ERROR_NOT_SUPPORTED;
+			break;
+	}
+
+	LeaveCriticalSection(&driver->Lock);
+
+	DEBUG_EXIT_FUNCTION("%u, *ReturnLength=%u", ret, *ReturnLength);
+	return ret;
+}
+
+
+static DWORD _MockRecordsOpen(PVOID Context, PVOID *Records)
+{
+	PMOCK_RECORDS tmpRecords = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Context=0x%p; Records=0x%p", Context, Records);
+
+	tmpRecords = (PMOCK_RECORDS)HeapAlloc(GetProcessHeap(), 0, sizeof(MOCK_RECORDS));
+	if (tmpRecords != NULL) {
+		tmpRecords->Driver = (PMOCK_DRIVER)Context;
+		*Records = tmpRecords;
+		ret = ERROR_SUCCESS;
+	} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	DEBUG_EXIT_FUNCTION("%u, *Records=0x%p", ret, *Records);
+	return ret;
+}
+
+
+static DWORD _MockRecordsWait(PVOID Records, PVOID Buffer, ULONG Length, DWORD Timeout, HANDLE StopEvent, PULONG ReturnLength)
+{
+	DWORD waitTime = 0;
+	ULONGLONG now = 0;
+	ULONGLONG deadline = 0;
+	PMOCK_DRIVER driver = ((PMOCK_RECORDS)Records)->Driver;
+	DWORD ret = ERROR_GEN_FAILURE;
+
+	deadline = (Timeout != INFINITE) ? GetTickCount64() + Timeout : 0;
+	do {
+		EnterCriticalSection(&driver->Lock);
+		_MockUpdate(driver);
+		ret = (driver->Connected) ? _MockRecordsGet(driver, Buffer, Length, ReturnLength) : ERROR_NO_MORE_ITEMS;
+		waitTime = _MockNextRecordTime(driver);
+		LeaveCriticalSection(&driver->Lock);
+		if (ret != ERROR_NO_MORE_ITEMS)
+			break;
+
+		ret = ERROR_OPERATION_ABORTED;
+		*ReturnLength = 0;
+		if (Timeout != INFINITE) {
+			now = GetTickCount64();
+			if (now >= deadline)
+				break;
+
+			if (waitTime == INFINITE || waitTime > deadline - now)
+				waitTime = (DWORD)(deadline - now);
+		}
+
+		// Connection is not signaled, check for it from time to time.
+		if (waitTime == INFINITE)
+			waitTime = 100;
+	} while (WaitForSingleObject(StopEvent, waitTime) == WAIT_TIMEOUT);
+
+	return ret;
+}
+
+
+static VOID _MockRecordsClose(PVOID Records)
+{
+	DEBUG_ENTER_FUNCTION("Records=0x%p", Records);
+
+	HeapFree(GetProcessHeap(), 0, Records);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+static VOID _MockClose(PVOID Context)
+{
+	DEBUG_ENTER_FUNCTION("Context=0x%p", Context);
+
+	_MockFree((PMOCK_DRIVER)Context);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
+
+
+/************************************************************************/
+/*                          PUBLIC ROUTINES                             */
+/************************************************************************/
+
+DWORD MockDriverOpen(PIRPMON_MOCK_SETTINGS Settings, PTRANSPORT Transport)
+{
+	ULONG i = 0;
+	ULONG j = 0;
+	PMOCK_DEVICE device = NULL;
+	PMOCK_DRIVER driver = NULL;
+	DWORD ret = ERROR_GEN_FAILURE;
+	DEBUG_ENTER_FUNCTION("Settings=0x%p; Transport=0x%p", Settings, Transport);
+
+	driver = (PMOCK_DRIVER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MOCK_DRIVER));
+	if (driver != NULL) {
+		InitializeCriticalSection(&driver->Lock);
+		driver->Settings = *Settings;
+		driver->DeviceCount = Settings->DriverCount*Settings->DevicesPerDriver;
+		driver->Devices = (PMOCK_DEVICE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, driver->DeviceCount*sizeof(MOCK_DEVICE));
+		if (driver->Devices != NULL) {
+			device = driver->Devices;
+			for (i = 0; i < Settings->DriverCount; ++i) {
+				for (j = 0; j < Settings->DevicesPerDriver; ++j) {
+					device->DriverObject = _MockDriverAddress(i);
+					device->DeviceObject = _MockDeviceAddress(i, j);
+					++device;
+				}
+			}
+
+			ret = _MockSnapshotCreate(driver);
+		} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+		if (ret == ERROR_SUCCESS) {
+			Transport->Ioctl = _MockIoctl;
+			Transport->RecordsOpen = _MockRecordsOpen;
+			Transport->RecordsWait = _MockRecordsWait;
+			Transport->RecordsClose = _MockRecordsClose;
+			Transport->Close = _MockClose;
+			Transport->Context = driver;
+		}
+
+		if (ret != ERROR_SUCCESS)
+			_MockFree(driver);
+	} else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	DEBUG_EXIT_FUNCTION("%u", ret);
+	return ret;
+}
+
+
+VOID MockDriverStatistics(PVOID Context, PIRPMON_MOCK_STATISTICS Statistics)
+{
+	PMOCK_DRIVER driver = (PMOCK_DRIVER)Context;
+	DEBUG_ENTER_FUNCTION("Context=0x%p; Statistics=0x%p", Context, Statistics);
+
+	EnterCriticalSection(&driver->Lock);
+	_MockUpdate(driver);
+	Statistics->Generated = driver->Generated;
+	Statistics->Delivered = driver->Delivered;
+	Statistics->Dropped = driver->Dropped;
+	Statistics->Pending = _MockPending(driver);
+	LeaveCriticalSection(&driver->Lock);
+
+	DEBUG_EXIT_FUNCTION_VOID();
+	return;
+}
@@ -0,0 +1,15 @@
+
+#ifndef __IRPMONDLL_MOCK_DRIVER_H__
+#define __IRPMONDLL_MOCK_DRIVER_H__
+
+#include <windows.h>
+#include "irpmondll-types.h"
+#include "transport.h"
+
+
+DWORD MockDriverOpen(PIRPMON_MOCK_SETTINGS Settings, PTRANSPORT Transport);
+VOID MockDriverStatistics(PVOID Context, PIRPMON_MOCK_STATISTICS Statistics);
+
+
+
+#endif
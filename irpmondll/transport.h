@@ -0,0 +1,61 @@
+
+#ifndef __IRPMONDLL_TRANSPORT_H__
+#define __IRPMONDLL_TRANSPORT_H__
+
+#include <windows.h>
+
+
+/** Sends a control request to the driver endpoint.
+ *
+ *  @param Context Context of the transport.
+ *  @param Code The IOCTL code.
+ *  @param InputBuffer Input data, may be NULL.
+ *  @param InputBufferLength Size of the input data, in bytes.
+ *  @param OutputBuffer Receives the output, may be NULL.
+ *  @param OutputBufferLength Size of the output buffer, in bytes.
+ *  @param ReturnLength Receives the number of bytes written to the output buffer.
+ *
+ *  @return
+ *  Returns a Win32 error code, as DeviceIoControl would.
+ */
+typedef DWORD (TRANSPORT_IOCTL)(PVOID Context, DWORD Code, PVOID InputBuffer, ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength, PULONG ReturnLength);
+
+/** Opens a channel for record retrieval (IOCTL_IRPMNDRV_GET_RECORD_PENDING).
+ *  Each consumer of the records uses its own channel.
+ */
+typedef DWORD (TRANSPORT_RECORDS_OPEN)(PVOID Context, PVOID *Records);
+
+/** Waits for records and stores them into a buffer.
+ *
+ *  @param Records The channel.
+ *  @param Buffer Receives the records, in the format of IOCTL_IRPMNDRV_GET_RECORD_PENDING.
+ *  @param Length Size of the buffer, in bytes.
+ *  @param Timeout Time to wait for records, in milliseconds.
+ *  @param StopEvent An event terminating the wait when signaled.
+ *  @param ReturnLength Receives the number of bytes returned. If the routine returns
+ *  ERROR_INSUFFICIENT_BUFFER, the variable receives the size the buffer requires.
+ *
+ *  @return
+ *  Returns an error code. ERROR_OPERATION_ABORTED means no records arrived within
+ *  the timeout, or the stop event was signaled.
+ */
+typedef DWORD (TRANSPORT_RECORDS_WAIT)(PVOID Records, PVOID Buffer, ULONG Length, DWORD Timeout, HANDLE StopEvent, PULONG ReturnLength);
+
+typedef VOID (TRANSPORT_RECORDS_CLOSE)(PVOID Records);
+
+typedef VOID (TRANSPORT_CLOSE)(PVOID Context);
+
+/** Connects the library to an endpoint speaking the IRPMon driver protocol:
+    either the driver itself, or the mock driver. */
+typedef struct _TRANSPORT {
+	TRANSPORT_IOCTL *Ioctl;
+	TRANSPORT_RECORDS_OPEN *RecordsOpen;
+	TRANSPORT_RECORDS_WAIT *RecordsWait;
+	TRANSPORT_RECORDS_CLOSE *RecordsClose;
+	TRANSPORT_CLOSE *Close;
+	PVOID Context;
+} TRANSPORT, *PTRANSPORT;
+
+
+
+#endif
@@ -10,25 +10,112 @@
 /*                               LOCAL VARIABLES                        */
 /************************************************************************/
 
-static LIST_ENTRY _allocationRecordsList;
-static CRITICAL_SECTION _allocationRecordsListLock;
+/** Allocation records hashed by the allocated addresses. */
+static PLIST_ENTRY _recordBuckets = NULL;
+/** Locks protecting buckets of the allocation record table. */
+static CRITICAL_SECTION _recordLocks[DEBUG_ALLOCATOR_LOCK_COUNT];
+/** Allocation sites hashed by function name and line. Sites are only inserted
+    (by an interlocked compare-exchange) and never removed before finalization,
+    so the lists can be traversed without any lock. */
+static PDEBUG_ALLOCATION_SITE volatile _siteBuckets[DEBUG_ALLOCATOR_SITE_BUCKETS];
 
 
 /************************************************************************/
 /*                                HELPER FUNCTIONS                      */
 /************************************************************************/
 
-static VOID _Lock(VOID)
+/** Computes index of the record table bucket for a given address. The low bits
+ *  are always zero for heap blocks, the multiplication spreads the remaining ones.
+ */
+static ULONG _AddressBucket(PVOID Address)
 {
-   EnterCriticalSection(&_allocationRecordsListLock);
+   ULONG64 k = ((ULONG64)(ULONG_PTR)Address >> 4);
+
+   return (ULONG)((k*0x9E3779B97F4A7C15ULL) >> 32) & (DEBUG_ALLOCATOR_RECORD_BUCKETS - 1);
+}
+
+static VOID _Lock(ULONG Bucket)
+{
+   EnterCriticalSection(&_recordLocks[Bucket % DEBUG_ALLOCATOR_LOCK_COUNT]);
 }
 
-static VOID _Unlock(VOID)
+static VOID _Unlock(ULONG Bucket)
 {
-   LeaveCriticalSection(&_allocationRecordsListLock);
+   LeaveCriticalSection(&_recordLocks[Bucket % DEBUG_ALLOCATOR_LOCK_COUNT]);
 }
 
-static PDEBUG_ALLOCATION_RECORD _RecordAlloc(PVOID Address, SIZE_T NumberOfBytes, PCHAR Function, ULONG Line)
+/** Retrieves counters of a given allocation site, creates them if the site
+ *  allocates for the first time.
+ *
+ *  @return
+ *  Returns address of the site, or NULL if there is not enough memory.
+ */
+static PDEBUG_ALLOCATION_SITE _SiteGet(PCSTR Function, ULONG Line)
+{
+   ULONG bucket = 0;
+   ULONG64 k = 0;
+   PDEBUG_ALLOCATION_SITE head = NULL;
+   PDEBUG_ALLOCATION_SITE newSite = NULL;
+   PDEBUG_ALLOCATION_SITE ret = NULL;
+   DEBUG_ENTER_FUNCTION("Function=%s; Line=%u", Function, Line);
+
+   k = ((ULONG64)(ULONG_PTR)Function) ^ ((ULONG64)Line << 32);
+   bucket = (ULONG)((k*0x9E3779B97F4A7C15ULL) >> 40) & (DEBUG_ALLOCATOR_SITE_BUCKETS - 1);
+   do {
+      head = _siteBuckets[bucket];
+      for (ret = head; ret != NULL; ret = ret->Next) {
+         if (ret->Function == Function && ret->Line == Line)
+            break;
+      }
+
+      if (ret == NULL) {
+         if (newSite == NULL) {
+            newSite = (PDEBUG_ALLOCATION_SITE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DEBUG_ALLOCATION_SITE));
+            if (newSite == NULL)
+               break;
+
+            newSite->Function = Function;
+            newSite->Line = Line;
+         }
+
+         newSite->Next = head;
+         if (InterlockedCompareExchangePointer((PVOID volatile *)&_siteBuckets[bucket], newSite, head) == head) {
+            ret = newSite;
+            newSite = NULL;
+         }
+      }
+   } while (ret == NULL);
+
+   if (newSite != NULL)
+      HeapFree(GetProcessHeap(), 0, newSite);
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Updates counters of an allocation site when a block allocated there is
+ *  allocated (positive NumberOfBytes), or freed (negative NumberOfBytes).
+ */
+static VOID _SiteUpdate(PDEBUG_ALLOCATION_SITE Site, LONG64 NumberOfBytes)
+{
+   LONG64 live = 0;
+   LONG64 peak = 0;
+
+   if (NumberOfBytes >= 0) {
+      InterlockedIncrement64(&Site->Allocations);
+      live = InterlockedExchangeAdd64(&Site->LiveBytes, NumberOfBytes) + NumberOfBytes;
+      do {
+         peak = Site->PeakBytes;
+      } while (live > peak && InterlockedCompareExchange64(&Site->PeakBytes, live, peak) != peak);
+   } else {
+      InterlockedIncrement64(&Site->Frees);
+      InterlockedExchangeAdd64(&Site->LiveBytes, NumberOfBytes);
+   }
+
+   return;
+}
+
+static PDEBUG_ALLOCATION_RECORD _RecordAlloc(PVOID Address, SIZE_T NumberOfBytes, PCSTR Function, ULONG Line)
 {
    PDEBUG_ALLOCATION_RECORD ret = NULL;
    DEBUG_ENTER_FUNCTION("Address=0x%p; NumberOfBytes=%u; Function=%s; Line=%u", Address, NumberOfBytes, Function, Line);
@@ -40,6 +127,11 @@ static PDEBUG_ALLOCATION_RECORD _RecordAlloc(PVOID Address, SIZE_T NumberOfBytes
       ret->Function = Function;
       ret->Line = Line;
       ret->NumberOfBytes = NumberOfBytes;
+      ret->Site = _SiteGet(Function, Line);
+      if (ret->Site == NULL) {
+         HeapFree(GetProcessHeap(), 0, ret);
+         ret = NULL;
+      }
    }
 
    DEBUG_EXIT_FUNCTION("0x%p", ret);
@@ -56,78 +148,50 @@ static VOID _RecordFree(PDEBUG_ALLOCATION_RECORD Record)
    return;
 }
 
-static VOID _RecordInsert(PDEBUG_ALLOCATION_RECORD Record)
-{
-   DEBUG_ENTER_FUNCTION("Record=0x%p", Record);
-
-   _InsertTailList(&_allocationRecordsList, &Record->Entry);
-
-   DEBUG_EXIT_FUNCTION_VOID();
-   return;
-}
-
 static VOID _RecordInsertLock(PDEBUG_ALLOCATION_RECORD Record)
 {
+   ULONG bucket = 0;
    DEBUG_ENTER_FUNCTION("Record=0x%p", Record);
 
-   _Lock();
-   _RecordInsert(Record);
-   _Unlock();
+   bucket = _AddressBucket(Record->Address);
+   _Lock(bucket);
+   _InsertTailList(&_recordBuckets[bucket], &Record->Entry);
+   _Unlock(bucket);
+   _SiteUpdate(Record->Site, (LONG64)Record->NumberOfBytes);
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
-static PDEBUG_ALLOCATION_RECORD _RecordFind(PVOID Address)
+/** Searches a bucket of the record table for the record of a given address.
+ *  The caller must hold the lock protecting the bucket.
+ */
+static PDEBUG_ALLOCATION_RECORD _RecordFind(ULONG Bucket, PVOID Address)
 {
+   PLIST_ENTRY head = &_recordBuckets[Bucket];
    PDEBUG_ALLOCATION_RECORD ret = NULL;
-   DEBUG_ENTER_FUNCTION("Address=0x%p", Address);
+   DEBUG_ENTER_FUNCTION("Bucket=%u; Address=0x%p", Bucket, Address);
 
-   ret = CONTAINING_RECORD(_allocationRecordsList.Flink, DEBUG_ALLOCATION_RECORD, Entry);
-   while (&_allocationRecordsList != &ret->Entry) {
+   ret = CONTAINING_RECORD(head->Flink, DEBUG_ALLOCATION_RECORD, Entry);
+   while (head != &ret->Entry) {
       if (ret->Address == Address)
          break;
 
       ret = CONTAINING_RECORD(ret->Entry.Flink, DEBUG_ALLOCATION_RECORD, Entry);
    }
 
-   if (&ret->Entry == &_allocationRecordsList)
+   if (&ret->Entry == head)
       ret = NULL;
 
    DEBUG_EXIT_FUNCTION("0x%p", ret);
    return ret;
 }
 
-static PDEBUG_ALLOCATION_RECORD _RecordFindLock(PVOID Address)
-{
-   PDEBUG_ALLOCATION_RECORD ret = NULL;
-   DEBUG_ENTER_FUNCTION("Address=0x%p", Address);
-
-   _Lock();
-   ret = _RecordFind(Address);
-   _Unlock();
-
-   DEBUG_EXIT_FUNCTION("0x%p", ret);
-   return ret;
-}
-
 static VOID _RecordRemove(PDEBUG_ALLOCATION_RECORD Record)
-{
-   DEBUG_ENTER_FUNCTION("Record=0x%p");
-
-   _RemoveEntryList(&Record->Entry);
-
-   DEBUG_EXIT_FUNCTION_VOID();
-   return;
-}
-
-static VOID _RecordRemoveLock(PDEBUG_ALLOCATION_RECORD Record)
 {
    DEBUG_ENTER_FUNCTION("Record=0x%p", Record);
 
-   _Lock();
-   _RecordRemove(Record);
-   _Unlock();
+   _RemoveEntryList(&Record->Entry);
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -145,26 +209,48 @@ static VOID _CheckCallback(PDEBUG_ALLOCATION_RECORD Record, PVOID Context)
    return;
 }
 
-static VOID _AllocatorCheck(ALLOCATOR_CHECK_CALLBACK *Callback, PVOID Context)
+/** Invokes a callback for every allocation record stored in the buckets protected
+ *  by a given lock. The caller must hold the lock.
+ */
+static VOID _AllocatorCheck(ULONG LockIndex, ALLOCATOR_CHECK_CALLBACK *Callback, PVOID Context)
 {
+   ULONG i = 0;
+   PLIST_ENTRY head = NULL;
    PDEBUG_ALLOCATION_RECORD tmp = NULL;
-   DEBUG_ENTER_FUNCTION("Callaback=0x%p; Context=0x%p", Callback, Context);
-
-   tmp = CONTAINING_RECORD(_allocationRecordsList.Flink, DEBUG_ALLOCATION_RECORD, Entry);
-   while (&tmp->Entry != &_allocationRecordsList) {
-      Callback(tmp, Context);
-      tmp = CONTAINING_RECORD(tmp->Entry.Flink, DEBUG_ALLOCATION_RECORD, Entry);
+   DEBUG_ENTER_FUNCTION("LockIndex=%u; Callaback=0x%p; Context=0x%p", LockIndex, Callback, Context);
+
+   for (i = LockIndex; i < DEBUG_ALLOCATOR_RECORD_BUCKETS; i += DEBUG_ALLOCATOR_LOCK_COUNT) {
+      head = &_recordBuckets[i];
+      tmp = CONTAINING_RECORD(head->Flink, DEBUG_ALLOCATION_RECORD, Entry);
+      while (&tmp->Entry != head) {
+         Callback(tmp, Context);
+         tmp = CONTAINING_RECORD(tmp->Entry.Flink, DEBUG_ALLOCATION_RECORD, Entry);
+      }
    }
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
+static VOID _LeakReportCallback(PDEBUG_ALLOCATION_SITE Site, PVOID Context)
+{
+   char msg[256];
+   PULONG leakingSites = (PULONG)Context;
+
+   if (Site->Allocations != Site->Frees) {
+      sprintf_s(msg, sizeof(msg), "LEAK: %s:%u: %I64d allocations, %I64d frees, %I64d bytes not freed (peak %I64d bytes)\n", Site->Function, Site->Line, Site->Allocations, Site->Frees, Site->LiveBytes, Site->PeakBytes);
+      OutputDebugStringA(msg);
+      ++(*leakingSites);
+   }
+
+   return;
+}
+
 /************************************************************************/
 /*                               PUBLIC ROUTINES                        */
 /************************************************************************/
 
-PVOID DebugHeapMemoryAlloc(SIZE_T NumberOfBytes, PCHAR Function, ULONG Line)
+PVOID DebugHeapMemoryAlloc(SIZE_T NumberOfBytes, PCSTR Function, ULONG Line)
 {
    PVOID ret = NULL;
    PDEBUG_ALLOCATION_RECORD record = NULL;
@@ -193,13 +279,19 @@ PVOID DebugHeapMemoryAlloc(SIZE_T NumberOfBytes, PCHAR Function, ULONG Line)
 
 VOID DebugHeapMemoryFree(PVOID Address)
 {
+   ULONG bucket = 0;
    PDEBUG_ALLOCATION_RECORD record = NULL;
    DEBUG_ENTER_FUNCTION("Address=0x%p", Address);
 
-   _Lock();
-   record = _RecordFind(Address);
-   if (record != NULL) {
+   bucket = _AddressBucket(Address);
+   _Lock(bucket);
+   record = _RecordFind(bucket, Address);
+   if (record != NULL)
       _RecordRemove(record);
+
+   _Unlock(bucket);
+   if (record != NULL) {
+      _SiteUpdate(record->Site, -(LONG64)record->NumberOfBytes);
       HeapFree(GetProcessHeap(), 0, Address);
       if (!HeapValidate(GetProcessHeap(), 0, NULL)) {
          DEBUG_PRINT_LOCATION("Last operation occurred at function %s at line %d", record->Function, record->Line);
@@ -211,22 +303,67 @@ VOID DebugHeapMemoryFree(PVOID Address)
       DEBUG_PRINT_LOCATION("ERROR: Allocation record for address 0x%p not found", Address);
    }
 
-   _Unlock();
-
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
 VOID DebugAllocatorCheck(ALLOCATOR_CHECK_CALLBACK *Callback, PVOID Context)
 {
+   ULONG i = 0;
    DEBUG_ENTER_FUNCTION("Callkback=0x%p; Context=0x%p", Callback, Context);
     
    if (Callback == NULL)
       Callback = _CheckCallback;
 
-   _Lock();
-   _AllocatorCheck(Callback, Context);
-   _Unlock();
+   if (_recordBuckets != NULL) {
+      for (i = 0; i < DEBUG_ALLOCATOR_LOCK_COUNT; ++i) {
+         _Lock(i);
+         _AllocatorCheck(i, Callback, Context);
+         _Unlock(i);
+      }
+   }
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/** Invokes a given callback for every allocation site known to the allocator.
+ *
+ *  @param Callback The callback.
+ *  @param Context Passed to the callback.
+ *
+ *  @remark
+ *  The counters of a site are updated by interlocked operations without stopping
+ *  other threads, so they may change while the callback is running.
+ */
+VOID DebugAllocatorEnumerateSites(ALLOCATOR_SITE_CALLBACK *Callback, PVOID Context)
+{
+   ULONG i = 0;
+   PDEBUG_ALLOCATION_SITE site = NULL;
+   DEBUG_ENTER_FUNCTION("Callback=0x%p; Context=0x%p", Callback, Context);
+
+   for (i = 0; i < DEBUG_ALLOCATOR_SITE_BUCKETS; ++i) {
+      for (site = _siteBuckets[i]; site != NULL; site = site->Next)
+         Callback(site, Context);
+   }
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/** Reports allocation sites whose blocks have not been freed, one line per site
+ *  with the number of allocations, frees and leaked bytes. The report is sent to
+ *  the debugger output.
+ */
+VOID DebugAllocatorLeakReport(VOID)
+{
+   char msg[64];
+   ULONG leakingSites = 0;
+   DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+   DebugAllocatorEnumerateSites(_LeakReportCallback, &leakingSites);
+   sprintf_s(msg, sizeof(msg), "LEAK: %u leaking allocation sites\n", leakingSites);
+   OutputDebugStringA(msg);
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -238,15 +375,42 @@ VOID DebugAllocatorCheck(ALLOCATOR_CHECK_CALLBACK *Callback, PVOID Context)
 
 DWORD DebugAllocatorInit(VOID)
 {
+#ifdef USE_MEMORY_LEAK_DETECTION
+   ULONG i = 0;
+   ULONG j = 0;
+#endif
    DWORD ret = ERROR_GEN_FAILURE;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
-   if (InitializeCriticalSectionAndSpinCount(&_allocationRecordsListLock, 0x1000)) {
-      _InitializeListHead(&_allocationRecordsList);
+#ifdef USE_MEMORY_LEAK_DETECTION
+   _recordBuckets = (PLIST_ENTRY)HeapAlloc(GetProcessHeap(), 0, DEBUG_ALLOCATOR_RECORD_BUCKETS*sizeof(LIST_ENTRY));
+   if (_recordBuckets != NULL) {
+      for (i = 0; i < DEBUG_ALLOCATOR_RECORD_BUCKETS; ++i)
+         _InitializeListHead(&_recordBuckets[i]);
+
       ret = ERROR_SUCCESS;
-   } else {
-      ret = GetLastError();
-   }
+      for (i = 0; i < DEBUG_ALLOCATOR_LOCK_COUNT; ++i) {
+         if (!InitializeCriticalSectionAndSpinCount(&_recordLocks[i], 0x1000)) {
+            ret = GetLastError();
+            for (j = 0; j < i; ++j)
+               DeleteCriticalSection(&_recordLocks[j]);
+
+            break;
+         }
+      }
+
+      if (ret == ERROR_SUCCESS)
+         memset((PVOID)_siteBuckets, 0, sizeof(_siteBuckets));
+
+      if (ret != ERROR_SUCCESS) {
+         HeapFree(GetProcessHeap(), 0, _recordBuckets);
+         _recordBuckets = NULL;
+      }
+   } else ret = ERROR_NOT_ENOUGH_MEMORY;
+#else
+   // The tracking tables are needed only by DebugHeapMemoryAlloc and DebugHeapMemoryFree.
+   ret = ERROR_SUCCESS;
+#endif
 
    DEBUG_EXIT_FUNCTION("%d", ret);
    return ret;
@@ -254,10 +418,31 @@ DWORD DebugAllocatorInit(VOID)
 
 VOID DebugAllocatorFinit(VOID)
 {
+   ULONG i = 0;
+   PDEBUG_ALLOCATION_SITE site = NULL;
+   PDEBUG_ALLOCATION_SITE next = NULL;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
-   DebugAllocatorCheck(NULL, NULL);
-   DeleteCriticalSection(&_allocationRecordsListLock);
+   if (_recordBuckets != NULL) {
+      DebugAllocatorLeakReport();
+      DebugAllocatorCheck(NULL, NULL);
+      for (i = 0; i < DEBUG_ALLOCATOR_LOCK_COUNT; ++i)
+         DeleteCriticalSection(&_recordLocks[i]);
+
+      for (i = 0; i < DEBUG_ALLOCATOR_SITE_BUCKETS; ++i) {
+         site = _siteBuckets[i];
+         while (site != NULL) {
+            next = site->Next;
+            HeapFree(GetProcessHeap(), 0, site);
+            site = next;
+         }
+
+         _siteBuckets[i] = NULL;
+      }
+
+      HeapFree(GetProcessHeap(), 0, _recordBuckets);
+      _recordBuckets = NULL;
+   }
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
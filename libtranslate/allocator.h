@@ -4,15 +4,40 @@
 
 #include <windows.h>
 
+/** Counters of allocations made at one place of the source code. */
+typedef struct _DEBUG_ALLOCATION_SITE {
+   struct _DEBUG_ALLOCATION_SITE *Next;
+   PCSTR Function;
+   ULONG Line;
+   /** Number of allocations made at the site. */
+   volatile LONG64 Allocations;
+   /** Number of allocations made at the site and freed since. */
+   volatile LONG64 Frees;
+   /** Number of bytes allocated at the site and not freed yet. */
+   volatile LONG64 LiveBytes;
+   /** Maximum value of the LiveBytes counter. */
+   volatile LONG64 PeakBytes;
+} DEBUG_ALLOCATION_SITE, *PDEBUG_ALLOCATION_SITE;
+
 typedef struct {
    LIST_ENTRY Entry;
    PVOID Address;
    SIZE_T NumberOfBytes;
-   PCHAR Function;
+   PCSTR Function;
    ULONG Line;
+   PDEBUG_ALLOCATION_SITE Site;
 } DEBUG_ALLOCATION_RECORD, *PDEBUG_ALLOCATION_RECORD;
 
 typedef VOID (ALLOCATOR_CHECK_CALLBACK)(PDEBUG_ALLOCATION_RECORD Record, PVOID Context);
+typedef VOID (ALLOCATOR_SITE_CALLBACK)(PDEBUG_ALLOCATION_SITE Site, PVOID Context);
+
+/** Number of buckets of the table of allocation records. Must be a power of two. */
+#define DEBUG_ALLOCATOR_RECORD_BUCKETS       0x10000
+/** Number of buckets of the table of allocation sites. Must be a power of two. */
+#define DEBUG_ALLOCATOR_SITE_BUCKETS         0x400
+/** Number of locks protecting the allocation record table; bucket I is protected
+    by lock I % DEBUG_ALLOCATOR_LOCK_COUNT. */
+#define DEBUG_ALLOCATOR_LOCK_COUNT           64
 
 /** When defined, a custom memory allocator able to detect memory leaks is 
     used rather than the standard Windows heap functions.
@@ -36,9 +61,11 @@ typedef VOID (ALLOCATOR_CHECK_CALLBACK)(PDEBUG_ALLOCATION_RECORD Record, PVOID C
 #endif
 
 
-PVOID DebugHeapMemoryAlloc(SIZE_T NumberOfBytes, PCHAR Function, ULONG Line);
+PVOID DebugHeapMemoryAlloc(SIZE_T NumberOfBytes, PCSTR Function, ULONG Line);
 VOID DebugHeapMemoryFree(PVOID Address);
 VOID DebugAllocatorCheck(ALLOCATOR_CHECK_CALLBACK *Callback, PVOID Context);
+VOID DebugAllocatorEnumerateSites(ALLOCATOR_SITE_CALLBACK *Callback, PVOID Context);
+VOID DebugAllocatorLeakReport(VOID);
 
 DWORD DebugAllocatorInit(VOID);
 VOID DebugAllocatorFinit(VOID);
@@ -0,0 +1,448 @@
+
+/**
+ * @file
+ *
+ * Provides human-readable descriptions of NTSTATUS values and Windows error codes.
+ *
+ * The descriptions come from one of the following sources (providers):
+ * * the system message tables, accessed through the FormatMessage routine,
+ * * a prebuilt description blob supplied by the library user,
+ * * a stub provider that has no descriptions at all.
+ *
+ * The module does not remember the descriptions it returns, caching them
+ * is up to the caller. Only the system provider depends on Windows; if the
+ * module is compiled elsewhere, the stub provider is the default one and
+ * the blob provider remains fully functional.
+ */
+
+#include <windows.h>
+#include "debug.h"
+#include "allocator.h"
+#include "libtranslate.h"
+#include "descriptions.h"
+
+
+/************************************************************************/
+/*                  GLOBAL VARIABLES                                    */
+/************************************************************************/
+
+/** The current source of descriptions. */
+#ifdef _WIN32
+static ELibTranslateDescriptionSource _descriptionSource = ltdsSystem;
+#else
+static ELibTranslateDescriptionSource _descriptionSource = ltdsNone;
+#endif
+/** Copy of the description blob, valid if the ltdsBlob source is selected. */
+static PUCHAR _blob = NULL;
+/** Size of the description blob, in bytes. */
+static ULONG _blobSize = 0;
+/** Records of the description blob describing NTSTATUS values. */
+static PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD _blobNTSTATUSRecords = NULL;
+/** Number of records describing NTSTATUS values. */
+static ULONG _blobNTSTATUSCount = 0;
+/** Records of the description blob describing Windows error codes. */
+static PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD _blobWindowsErrorRecords = NULL;
+/** Number of records describing Windows error codes. */
+static ULONG _blobWindowsErrorCount = 0;
+#ifdef _WIN32
+/** Address of the ntdll!RtlNtStatusToDosError routine. */
+static RTLNTSTATUSTODOSERROR *_RtlNtStatusToDosError = NULL;
+#endif
+
+
+/************************************************************************/
+/*                  HELPER FUNCTIONS                                    */
+/************************************************************************/
+
+#ifdef _WIN32
+
+/** Retrieves description of a given Windows error code from the system
+ *  message tables.
+ *
+ *  @param ErrorCode The error code.
+ *
+ *  @return
+ *  Returns the description allocated by the FormatMessage routine, or NULL
+ *  if the system has no description for the error code.
+ */
+static PWCHAR _SystemFormatMessage(ULONG ErrorCode)
+{
+   DWORD len = 0;
+   PWCHAR ret = NULL;
+   DWORD formatMessageFlags = FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS | FORMAT_MESSAGE_ARGUMENT_ARRAY | FORMAT_MESSAGE_ALLOCATE_BUFFER;
+   DEBUG_ENTER_FUNCTION("ErrorCode=%u", ErrorCode);
+
+   len = FormatMessageW(formatMessageFlags, NULL, ErrorCode, 0, (LPWSTR)&ret, 0, NULL);
+   if (len == 0) {
+      if (GetLastError() != ERROR_MR_MID_NOT_FOUND)
+         DEBUG_PRINT_LOCATION("Error %u has no description (GetLastError=%u)", ErrorCode, GetLastError());
+
+      ret = NULL;
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Retrieves description of a given NTSTATUS value or Windows error code from
+ *  the system message tables.
+ *
+ *  @param Type Determines whether the Code parameter is a NTSTATUS value, or a
+ *  Windows error code.
+ *  @param Code The value to describe.
+ *
+ *  @return
+ *  Returns the description, or NULL if none exists. The description must be
+ *  freed by @link(DescriptionFree).
+ *
+ *  @remark
+ *  NTSTATUS values are converted to Windows error codes via the RtlNtStatusToDosError
+ *  routine first. Values without associated Windows error code have no description.
+ */
+static PWCHAR _SystemDescriptionGet(ELibTranslateIntegerValueType Type, ULONG32 Code)
+{
+   DWORD errCode = 0;
+   PWCHAR ret = NULL;
+   DEBUG_ENTER_FUNCTION("Type=%u; Code=0x%x", Type, Code);
+
+   switch (Type) {
+      case ltivtWindowsError:
+         ret = _SystemFormatMessage(Code);
+         break;
+      case ltivtNTSTATUS:
+         errCode = _RtlNtStatusToDosError(Code);
+         // For some NTSTATUS values, the RtlNtStatusToDosError routine
+         // seems to return NTSTATUS value itself. Example of such value
+         // is 0xC000001d. However, keep in mind that STATUS_SUCCESS, which is
+         // a constant of zero, translates to ERROR_SUCCESS, which is also a
+         // zero constant, hence there must be an exception for such value
+         // (hope there is not more of them).
+         if (errCode == 0 || (errCode != ERROR_MR_MID_NOT_FOUND && errCode != Code))
+            ret = _SystemFormatMessage(errCode);
+         break;
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+#endif
+
+/** Looks up description of a given NTSTATUS value or Windows error code in
+ *  the description blob.
+ *
+ *  @param Type Determines whether the Code parameter is a NTSTATUS value, or a
+ *  Windows error code.
+ *  @param Code The value to describe.
+ *
+ *  @return
+ *  Returns address of the description inside the blob, or NULL if the blob does
+ *  not describe the value.
+ */
+static PWCHAR _BlobDescriptionGet(ELibTranslateIntegerValueType Type, ULONG32 Code)
+{
+   ULONG half = 0;
+   ULONG count = 0;
+   PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD base = NULL;
+   PWCHAR ret = NULL;
+   DEBUG_ENTER_FUNCTION("Type=%u; Code=0x%x", Type, Code);
+
+   switch (Type) {
+      case ltivtNTSTATUS:
+         base = _blobNTSTATUSRecords;
+         count = _blobNTSTATUSCount;
+         break;
+      case ltivtWindowsError:
+         base = _blobWindowsErrorRecords;
+         count = _blobWindowsErrorCount;
+         break;
+      default:
+         break;
+   }
+
+   if (count > 0) {
+      while (count > 1) {
+         half = count / 2;
+         base = (base[half].Code <= Code) ? base + half : base;
+         count -= half;
+      }
+
+      if (base->Code == Code)
+         ret = (PWCHAR)(_blob + base->Offset);
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Checks whether a given group of description blob records is valid.
+ *
+ *  @param Records The first record of the group.
+ *  @param Count Number of records in the group.
+ *  @param DataOffset Offset of the first byte following the records.
+ *  @param BlobSize Size of the blob.
+ *
+ *  @return
+ *  Returns TRUE if the records are sorted, contain no duplicate codes and point
+ *  to aligned offsets inside the string area of the blob.
+ */
+static BOOLEAN _BlobRecordsValid(PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD Records, ULONG Count, ULONG DataOffset, ULONG BlobSize)
+{
+   ULONG i = 0;
+   BOOLEAN ret = TRUE;
+   DEBUG_ENTER_FUNCTION("Records=0x%p; Count=%u; DataOffset=%u; BlobSize=%u", Records, Count, DataOffset, BlobSize);
+
+   for (i = 0; i < Count; ++i) {
+      ret = (Records[i].Offset >= DataOffset && Records[i].Offset < BlobSize && (Records[i].Offset % sizeof(WCHAR)) == 0);
+      if (ret && i > 0)
+         ret = (Records[i - 1].Code < Records[i].Code);
+
+      if (!ret)
+         break;
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Validates a given description blob and makes it the source of
+ *  descriptions.
+ *
+ *  @param Blob Address of the blob.
+ *  @param BlobSize Size of the blob, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, ERROR_INVALID_DATA if the blob is malformed.
+ *
+ *  @remark
+ *  Since the blob must end with a null character and every record must point inside
+ *  the blob, all descriptions are guaranteed to be null-terminated without checking
+ *  them individually.
+ */
+static DWORD _BlobLoad(PVOID Blob, ULONG BlobSize)
+{
+   ULONG64 dataOffset = 0;
+   PUCHAR blobCopy = NULL;
+   PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER header = (PLIBTRANSLATE_DESCRIPTION_BLOB_HEADER)Blob;
+   PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD records = NULL;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Blob=0x%p; BlobSize=%u", Blob, BlobSize);
+
+   ret = ERROR_INVALID_DATA;
+   if (Blob != NULL && BlobSize >= sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER) + sizeof(WCHAR) &&
+      (BlobSize % sizeof(WCHAR)) == 0 &&
+      header->Signature == LIBTRANSLATE_DESCRIPTION_BLOB_SIGNATURE &&
+      header->Version == LIBTRANSLATE_DESCRIPTION_BLOB_VERSION &&
+      ((PWCHAR)((PUCHAR)Blob + BlobSize))[-1] == L'\0') {
+      dataOffset = sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER) + ((ULONG64)header->NTSTATUSCount + header->WindowsErrorCount) * sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_RECORD);
+      if (dataOffset <= BlobSize) {
+         records = (PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD)(header + 1);
+         if (_BlobRecordsValid(records, header->NTSTATUSCount, (ULONG)dataOffset, BlobSize) &&
+            _BlobRecordsValid(records + header->NTSTATUSCount, header->WindowsErrorCount, (ULONG)dataOffset, BlobSize)) {
+            blobCopy = (PUCHAR)HeapMemoryAlloc(BlobSize);
+            if (blobCopy != NULL) {
+               memcpy(blobCopy, Blob, BlobSize);
+               _blob = blobCopy;
+               _blobSize = BlobSize;
+               _blobNTSTATUSRecords = (PLIBTRANSLATE_DESCRIPTION_BLOB_RECORD)(blobCopy + sizeof(LIBTRANSLATE_DESCRIPTION_BLOB_HEADER));
+               _blobNTSTATUSCount = header->NTSTATUSCount;
+               _blobWindowsErrorRecords = _blobNTSTATUSRecords + _blobNTSTATUSCount;
+               _blobWindowsErrorCount = header->WindowsErrorCount;
+               ret = ERROR_SUCCESS;
+            } else ret = ERROR_NOT_ENOUGH_MEMORY;
+         }
+      }
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Frees the description blob, if any.
+ */
+static VOID _BlobUnload(VOID)
+{
+   DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+   if (_blob != NULL) {
+      HeapMemoryFree(_blob);
+      _blob = NULL;
+      _blobSize = 0;
+      _blobNTSTATUSRecords = NULL;
+      _blobNTSTATUSCount = 0;
+      _blobWindowsErrorRecords = NULL;
+      _blobWindowsErrorCount = 0;
+   }
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+
+/************************************************************************/
+/*                  PUBLIC FUNCTIONS                                    */
+/************************************************************************/
+
+/** Retrieves description of a given NTSTATUS value or Windows error code from
+ *  the current description source.
+ *
+ *  @param Type Determines whether the Code parameter is a NTSTATUS value
+ *  (ltivtNTSTATUS), or a Windows error code (ltivtWindowsError).
+ *  @param Code The value to describe.
+ *
+ *  @return
+ *  Returns the description, or NULL if the source does not describe the value.
+ *  The description must be released by @link(DescriptionFree).
+ *
+ *  @remark
+ *  The routine may be called concurrently from multiple threads.
+ *
+ *  Empty descriptions (such as empty strings of the description blob) are reported
+ *  as NULL, so the callers can remember them as missing.
+ */
+PWCHAR DescriptionGet(ELibTranslateIntegerValueType Type, ULONG32 Code)
+{
+   PWCHAR ret = NULL;
+   DEBUG_ENTER_FUNCTION("Type=%u; Code=0x%x", Type, Code);
+
+   switch (_descriptionSource) {
+#ifdef _WIN32
+      case ltdsSystem:
+         ret = _SystemDescriptionGet(Type, Code);
+         break;
+#endif
+      case ltdsBlob:
+         ret = _BlobDescriptionGet(Type, Code);
+         break;
+      default:
+         break;
+   }
+
+   if (ret != NULL && *ret == L'\0') {
+      DescriptionFree(ret);
+      ret = NULL;
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Releases a description returned by @link(DescriptionGet).
+ *
+ *  @param Description The description to release.
+ *
+ *  @remark
+ *  Descriptions residing inside the description blob are not freed. The routine
+ *  must be called before the description source changes.
+ */
+VOID DescriptionFree(PWCHAR Description)
+{
+   DEBUG_ENTER_FUNCTION("Description=0x%p", Description);
+
+   if ((PUCHAR)Description < _blob || (PUCHAR)Description >= _blob + _blobSize)
+      LocalFree(Description);
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/** Changes the source of descriptions.
+ *
+ *  @param Source The new source.
+ *  @param Blob Address of the description blob, used only for the ltdsBlob source.
+ *  @param BlobSize Size of the description blob, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, ERROR_INVALID_DATA if the blob is malformed and
+ *  ERROR_NOT_SUPPORTED if the source is not available on the current platform. On
+ *  failure, the current source remains selected.
+ *
+ *  @remark
+ *  All descriptions returned by @link(DescriptionGet) must have been released
+ *  by the caller before calling this routine.
+ */
+DWORD DescriptionsSetSource(ELibTranslateDescriptionSource Source, PVOID Blob, ULONG BlobSize)
+{
+   PUCHAR oldBlob = _blob;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Source=%u; Blob=0x%p; BlobSize=%u", Source, Blob, BlobSize);
+
+   switch (Source) {
+#ifdef _WIN32
+      case ltdsSystem:
+#endif
+      case ltdsNone:
+         _BlobUnload();
+         _descriptionSource = Source;
+         ret = ERROR_SUCCESS;
+         break;
+      case ltdsBlob:
+         ret = _BlobLoad(Blob, BlobSize);
+         if (ret == ERROR_SUCCESS) {
+            if (oldBlob != NULL)
+               HeapMemoryFree(oldBlob);
+
+            _descriptionSource = Source;
+         }
+         break;
+      default:
+         ret = ERROR_NOT_SUPPORTED;
+         break;
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+
+/************************************************************************/
+/*                  INITIALIZATION AND FINALIZATION                     */
+/************************************************************************/
+
+/** Initializes the module.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. On Windows, the routine fails if the
+ *  RtlNtStatusToDosError routine cannot be found.
+ *
+ *  @remark
+ *  No descriptions are looked up during initialization.
+ */
+DWORD DescriptionsModuleInit(VOID)
+{
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+   ret = ERROR_SUCCESS;
+#ifdef _WIN32
+   // RtlNtStatusToDosErrror is a part of any SDK library. It is probably a part of
+   // ntdll.lib provided with WDK. So, it must be found manually.
+   // The GetModuleHandleW call always succeeds because ntdll.dll is always present.
+   _RtlNtStatusToDosError = (RTLNTSTATUSTODOSERROR *)GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlNtStatusToDosError");
+   if (_RtlNtStatusToDosError == NULL)
+      ret = GetLastError();
+
+   _descriptionSource = ltdsSystem;
+#else
+   _descriptionSource = ltdsNone;
+#endif
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Finalizes the module. All descriptions must be released before calling
+ *  this routine.
+ */
+VOID DescriptionsModuleFinit(VOID)
+{
+   DEBUG_ENTER_FUNCTION_NO_ARGS();
+
+   _BlobUnload();
+#ifdef _WIN32
+   _RtlNtStatusToDosError = NULL;
+#endif
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
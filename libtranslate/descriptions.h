@@ -0,0 +1,46 @@
+
+/**
+ * @file
+ *
+ * Header file of the module providing human-readable descriptions of NTSTATUS
+ * values and Windows error codes.
+ */
+
+#ifndef __LIBTRANSLATE_DESCRIPTIONS_H__
+#define __LIBTRANSLATE_DESCRIPTIONS_H__
+
+#include <windows.h>
+#include "libtranslate.h"
+
+
+/** RtlNtStatusToDosError routine prototype.
+ *
+ *  The routine is exported by ntdll library and its purpose is to translate
+ *  NTSTATUS values (STATUS_XXX) to Win32 error values (ERROR_XXX).
+ *
+ *  @param Status A NTSTATUS value to convert.
+ *
+ *  @return
+ *  Returns Win32 error value associated with the given NTSTATUS one.
+ *
+ *  @remark
+ *  If there is no Win32 error value associated with given NTSTATUS one, the routine
+ *  returns ERROR_MR_MID_NOT_FOUND (317) error code. In some cases, the routine
+ *  return the same value as given in its argument.
+ *
+ *  More information can be found at:
+ *  http://msdn.microsoft.com/en-us/library/windows/desktop/ms680600(v=vs.85).aspx.
+ */
+typedef ULONG (WINAPI RTLNTSTATUSTODOSERROR)(NTSTATUS Status);
+
+
+PWCHAR DescriptionGet(ELibTranslateIntegerValueType Type, ULONG32 Code);
+VOID DescriptionFree(PWCHAR Description);
+DWORD DescriptionsSetSource(ELibTranslateDescriptionSource Source, PVOID Blob, ULONG BlobSize);
+
+DWORD DescriptionsModuleInit(VOID);
+VOID DescriptionsModuleFinit(VOID);
+
+
+
+#endif
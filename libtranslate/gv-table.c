@@ -0,0 +1,371 @@
+        
+/**
+ * @file
+ *
+ * Implements a table mapping of system integer constants to their string
+ * representation adn description. Generally speaking, the table maps 32-bit integers
+ * to @link(GENERAL_VALUE) structures. Such type of table is called General Value Table.
+ *
+ * The table is an array of @link(GENERAL_VALUE) structures sorted by the integer
+ * values. Large arrays in translates-arrays.h are stored already sorted, so preparing
+ * the table during library initialization is just a linear pass over the array.
+ * Lookups are binary searches that neither lock, nor allocate anything. Since the
+ * loop body of the search contains no unpredictable branches, its cost depends only
+ * on the table size.
+ *
+ * The searches do not touch the structures themselves. They run over a separate array
+ * holding just the 32-bit values, so the values compared by one search share a few
+ * cache lines (a @link(GENERAL_VALUE) structure takes 24 bytes on 64-bit systems, its
+ * value only 4). The value found leads to a @link(GENERAL_VALUE_RECORD) of 8 bytes
+ * that holds offsets of the name and description in a string pool.
+ *
+ * All tables of the library are prepared together and share one string pool. The pool
+ * is a single memory block of null-terminated strings in which every distinct string
+ * is stored only once (many descriptions, such as the empty ones, repeat across and
+ * within the tables). Strings of the pool are returned to callers as they are, they
+ * need no decoding. Once the tables are prepared, lookups touch only the value arrays,
+ * the records and the pool, which are much smaller than the original arrays and their
+ * string literals.
+ *
+ * When multiple structures share the same integer value, the one that appears
+ * last in the original array is returned by lookups.
+ */
+
+#include <windows.h>
+#include "debug.h"
+#include "allocator.h"
+#include "gv-table.h"
+
+
+/************************************************************************/
+/*                        GLOBAL VARIABLES                              */
+/************************************************************************/
+
+/** The string pool shared by all tables prepared by @link(GVTablesPrepare). */
+static PWCHAR _stringPool = NULL;
+
+
+/************************************************************************/
+/*                        HELPER ROUTINES                               */
+/************************************************************************/
+
+/** Computes hash of a given string, used to find duplicate strings during
+ *  construction of the string pool.
+ *
+ *  @param String The string.
+ *
+ *  @return
+ *  Returns the hash (FNV-1a over the characters).
+ */
+static ULONG32 _StringHash(const WCHAR *String)
+{
+   ULONG32 ret = 2166136261;
+
+   while (*String != L'\0') {
+      ret = (ret ^ (ULONG32)*String) * 16777619;
+      ++String;
+   }
+
+   return ret;
+}
+
+/** Stores a string in the string pool being built, unless the pool already
+ *  contains it.
+ *
+ *  @param Pool The pool.
+ *  @param PoolLength Address of variable holding length of the pool, in characters.
+ *  Updated if the string is appended to the pool.
+ *  @param Slots Open addressing hash table of the strings stored in the pool. Each
+ *  nonzero slot holds offset of a string increased by one.
+ *  @param SlotMask Number of slots minus one, the number of slots is a power of two.
+ *  @param String The string to store.
+ *
+ *  @return
+ *  Returns offset of the string in the pool, in characters.
+ *
+ *  @remark
+ *  The pool must be large enough to hold the string.
+ */
+static ULONG32 _StringPoolInsert(PWCHAR Pool, PULONG32 PoolLength, PULONG32 Slots, ULONG32 SlotMask, const WCHAR *String)
+{
+   ULONG32 index = _StringHash(String) & SlotMask;
+   SIZE_T len = 0;
+   ULONG32 ret = 0;
+
+   while (Slots[index] != 0 && wcscmp(Pool + Slots[index] - 1, String) != 0)
+      index = (index + 1) & SlotMask;
+
+   if (Slots[index] == 0) {
+      len = wcslen(String) + 1;
+      ret = *PoolLength;
+      memcpy(Pool + ret, String, len*sizeof(WCHAR));
+      *PoolLength += (ULONG32)len;
+      Slots[index] = ret + 1;
+   } else ret = Slots[index] - 1;
+
+   return ret;
+}
+
+/** Sorts the array of a given General Value Table by the integer values.
+ *
+ *  @param Table The table.
+ *
+ *  @remark
+ *  Relative order of structures with equal values is kept. Insertion sort is used
+ *  since it does not allocate memory and needs only one pass over arrays that are
+ *  already sorted, which is the case for the large ones. Only small arrays whose
+ *  values are defined by symbolic constants (such as WM_XXX or IRP_MJ_XXX) may
+ *  require some work.
+ */
+static VOID _GVTableSort(PGENERAL_VALUE_TABLE Table)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   GENERAL_VALUE tmp;
+
+   for (i = 1; i < Table->Count; ++i) {
+      if (Table->Items[i - 1].Value > Table->Items[i].Value) {
+         tmp = Table->Items[i];
+         j = i;
+         do {
+            Table->Items[j] = Table->Items[j - 1];
+            --j;
+         } while (j > 0 && Table->Items[j - 1].Value > tmp.Value);
+
+         Table->Items[j] = tmp;
+      }
+   }
+
+   return;
+}
+
+
+/************************************************************************/
+/*                        PUBLIC ROUTINES                               */
+/************************************************************************/
+
+/** Retrieves the @link(GENERAL_VALUE_RECORD) structure corresponding to given integer
+ *  value.
+ *
+ *  @param Table The table in question.
+ *  @param Value The integer value for presence of which the table is queried.
+ *
+ *  @return
+ *  Returns @link(GENERAL_VALUE_RECORD) structure corresponding to the given integer value.
+ *  If the table contains no such structure for the given value, NULL is returned. The
+ *  strings of the record are accessible via @link(GVTableName) and @link(GVTableDescription).
+ *
+ *  @remark
+ *  The routine finds the last array element with value less than or equal to
+ *  the given one. The conditional expression inside the loop is usually compiled
+ *  into a conditional move.
+ */
+PGENERAL_VALUE_RECORD GVTableGet(PGENERAL_VALUE_TABLE Table, ULONG Value)
+{
+   ULONG half = 0;
+   ULONG count = Table->Count;
+   const ULONG32 *base = Table->Keys;
+   PGENERAL_VALUE_RECORD ret = NULL;
+
+   if (count > 0) {
+      while (count > 1) {
+         half = count / 2;
+         base = (base[half] <= Value) ? base + half : base;
+         count -= half;
+      }
+
+      if (*base == Value)
+         ret = Table->Records + (base - Table->Keys);
+   }
+
+   return ret;
+}
+
+/** Retrieves @link(GENERAL_VALUE_RECORD) structures corresponding to an array of
+ *  integer values.
+ *
+ *  @param Table The table in question.
+ *  @param Values Array of the integer values.
+ *  @param Count Number of elements in the Values array.
+ *  @param Records Array that receives addresses of @link(GENERAL_VALUE_RECORD) structures
+ *  corresponding to the values, NULL for values not present in the table. Must have
+ *  room for Count elements.
+ *
+ *  @remark
+ *  The result is the same as calling @link(GVTableGet) for each value. However, the
+ *  values are processed in groups of GV_TABLE_BATCH_WIDTH and the binary searches within
+ *  a group proceed in lockstep. Since the number of search steps depends only on the
+ *  table size, the inner loop has a fixed trip count and no branches, so the compiler
+ *  can vectorize it, and the memory accesses of independent searches overlap.
+ */
+VOID GVTableGetBatch(PGENERAL_VALUE_TABLE Table, const ULONG *Values, ULONG Count, PGENERAL_VALUE_RECORD *Records)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG width = 0;
+   ULONG half = 0;
+   ULONG count = 0;
+   ULONG indices[GV_TABLE_BATCH_WIDTH];
+   const ULONG32 *keys = Table->Keys;
+   DEBUG_ENTER_FUNCTION("Table=0x%p; Values=0x%p; Count=%u; Records=0x%p", Table, Values, Count, Records);
+
+   if (Table->Count > 0) {
+      for (i = 0; i < Count; i += GV_TABLE_BATCH_WIDTH) {
+         width = (Count - i < GV_TABLE_BATCH_WIDTH) ? Count - i : GV_TABLE_BATCH_WIDTH;
+         for (j = 0; j < GV_TABLE_BATCH_WIDTH; ++j)
+            indices[j] = 0;
+
+         count = Table->Count;
+         while (count > 1) {
+            half = count / 2;
+            for (j = 0; j < width; ++j)
+               indices[j] += (keys[indices[j] + half] <= Values[i + j]) ? half : 0;
+
+            count -= half;
+         }
+
+         for (j = 0; j < width; ++j)
+            Records[i + j] = (keys[indices[j]] == Values[i + j]) ? Table->Records + indices[j] : NULL;
+      }
+   } else {
+      for (i = 0; i < Count; ++i)
+         Records[i] = NULL;
+   }
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/** Prepares given General Value Tables for lookups.
+ *
+ *  @param Tables Array of the tables.
+ *  @param Count Number of tables in the array.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, ERROR_NOT_ENOUGH_MEMORY if the arrays of
+ *  values and records, or the string pool cannot be allocated. In the latter case,
+ *  none of the tables is prepared.
+ *
+ *  @remark
+ *  The routine sorts the array of each table by the integer values (see
+ *  @link(_GVTableSort)). Then, the values are copied into the arrays searched
+ *  by lookups and the names and descriptions are stored in a string pool shared
+ *  by all the tables. The pool is built in a temporary block large enough for all
+ *  the strings, duplicates are found through a hash table. The distinct strings
+ *  are then copied to a block of their exact size.
+ *
+ *  Only one group of tables may be prepared at a time.
+ */
+DWORD GVTablesPrepare(PGENERAL_VALUE_TABLE *Tables, ULONG Count)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   SIZE_T totalLength = 0;
+   ULONG stringCount = 0;
+   ULONG32 slotCount = 0;
+   ULONG32 poolLength = 0;
+   PULONG32 slots = NULL;
+   PWCHAR pool = NULL;
+   PGENERAL_VALUE item = NULL;
+   PGENERAL_VALUE_TABLE table = NULL;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Tables=0x%p; Count=%u", Tables, Count);
+
+   for (i = 0; i < Count; ++i) {
+      table = Tables[i];
+      _GVTableSort(table);
+      for (j = 0; j < table->Count; ++j)
+         totalLength += wcslen(table->Items[j].Name) + wcslen(table->Items[j].Description) + 2;
+
+      stringCount += 2*table->Count;
+   }
+
+   slotCount = 1;
+   while (slotCount < 2*stringCount)
+      slotCount *= 2;
+
+   ret = ERROR_NOT_ENOUGH_MEMORY;
+   slots = (PULONG32)HeapMemoryAlloc(slotCount*sizeof(ULONG32));
+   pool = (PWCHAR)HeapMemoryAlloc((totalLength + 1)*sizeof(WCHAR));
+   if (slots != NULL && pool != NULL) {
+      memset(slots, 0, slotCount*sizeof(ULONG32));
+      ret = ERROR_SUCCESS;
+      for (i = 0; i < Count; ++i) {
+         table = Tables[i];
+         table->Keys = (PULONG32)HeapMemoryAlloc((table->Count + 1)*sizeof(ULONG32));
+         table->Records = (PGENERAL_VALUE_RECORD)HeapMemoryAlloc((table->Count + 1)*sizeof(GENERAL_VALUE_RECORD));
+         if (table->Keys == NULL || table->Records == NULL) {
+            ret = ERROR_NOT_ENOUGH_MEMORY;
+            break;
+         }
+
+         for (j = 0; j < table->Count; ++j) {
+            item = table->Items + j;
+            table->Keys[j] = item->Value;
+            table->Records[j].NameOffset = _StringPoolInsert(pool, &poolLength, slots, slotCount - 1, item->Name);
+            table->Records[j].DescriptionOffset = _StringPoolInsert(pool, &poolLength, slots, slotCount - 1, item->Description);
+         }
+      }
+
+      if (ret == ERROR_SUCCESS) {
+         _stringPool = (PWCHAR)HeapMemoryAlloc((poolLength + 1)*sizeof(WCHAR));
+         if (_stringPool != NULL) {
+            memcpy(_stringPool, pool, poolLength*sizeof(WCHAR));
+            for (i = 0; i < Count; ++i)
+               Tables[i]->Strings = _stringPool;
+
+            DEBUG_PRINT_LOCATION("%u strings of %Iu characters pooled into %u characters", stringCount, totalLength, poolLength);
+         } else ret = ERROR_NOT_ENOUGH_MEMORY;
+      }
+
+      if (ret != ERROR_SUCCESS)
+         GVTablesFinit(Tables, Count);
+   }
+
+   if (pool != NULL)
+      HeapMemoryFree(pool);
+
+   if (slots != NULL)
+      HeapMemoryFree(slots);
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Frees resources allocated by @link(GVTablesPrepare).
+ *
+ *  @param Tables Array of the tables.
+ *  @param Count Number of tables in the array.
+ *
+ *  @remark
+ *  The tables must be prepared again before any further lookup.
+ */
+VOID GVTablesFinit(PGENERAL_VALUE_TABLE *Tables, ULONG Count)
+{
+   ULONG i = 0;
+   PGENERAL_VALUE_TABLE table = NULL;
+   DEBUG_ENTER_FUNCTION("Tables=0x%p; Count=%u", Tables, Count);
+
+   for (i = 0; i < Count; ++i) {
+      table = Tables[i];
+      if (table->Keys != NULL) {
+         HeapMemoryFree(table->Keys);
+         table->Keys = NULL;
+      }
+
+      if (table->Records != NULL) {
+         HeapMemoryFree(table->Records);
+         table->Records = NULL;
+      }
+
+      table->Strings = NULL;
+   }
+
+   if (_stringPool != NULL) {
+      HeapMemoryFree(_stringPool);
+      _stringPool = NULL;
+   }
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
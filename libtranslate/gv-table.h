@@ -0,0 +1,74 @@
+   
+/**
+ * @file
+ *
+ * Header file for the the General Value Table implementation.
+ */
+
+#ifndef __LIBTRANSLATE_GENERAL_VALUE_TABLE_H__
+#define __LIBTRANSLATE_GENERAL_VALUE_TABLE_H__
+
+#include <windows.h>
+
+/** Stores human-readable information about an integer value, usually a system-defined
+    constant. */
+typedef struct {
+   /** String representation of the integer value, usually set to the name of constant
+       the value represents. */
+   PWCHAR Name;
+   /** The integer value described by the structure. */
+   ULONG32 Value;
+   /** Meaning of the integer value. */
+   PWCHAR Description;
+} GENERAL_VALUE, *PGENERAL_VALUE;
+
+/** Describes one item of a prepared General Value Table. Its strings reside in the
+    string pool shared by all tables and are referenced by their offsets. */
+typedef struct _GENERAL_VALUE_RECORD {
+   /** Offset of the name in the string pool, in characters. */
+   ULONG32 NameOffset;
+   /** Offset of the description in the string pool, in characters. */
+   ULONG32 DescriptionOffset;
+} GENERAL_VALUE_RECORD, *PGENERAL_VALUE_RECORD;
+
+/** Represents a General Value Table. The table is an array of
+    @link(GENERAL_VALUE) structures sorted by their Value members. Lookups do not
+    touch the array, they search a compact array of the values and return the
+    corresponding @link(GENERAL_VALUE_RECORD) structure. The table can be searched
+    without any locking. */
+typedef struct _GENERAL_VALUE_TABLE {
+   /** The sorted array. */
+   PGENERAL_VALUE Items;
+   /** Number of elements in the array. */
+   ULONG Count;
+   /** Value members of the Items array, in the same order. Allocated when the
+       table is prepared. */
+   PULONG32 Keys;
+   /** Records of the Items array, in the same order. Allocated when the
+       table is prepared. */
+   PGENERAL_VALUE_RECORD Records;
+   /** The string pool, shared by all tables prepared together. */
+   PWCHAR Strings;
+} GENERAL_VALUE_TABLE, *PGENERAL_VALUE_TABLE;
+
+/** Static initializer of a General Value Table over a given array. */
+#define GENERAL_VALUE_TABLE_INIT(aArray)        { (aArray), sizeof(aArray) / sizeof(GENERAL_VALUE), NULL, NULL, NULL }
+
+/** Number of values whose lookups are interleaved by @link(GVTableGetBatch). */
+#define GV_TABLE_BATCH_WIDTH                    8
+
+/** Name of a given record of a given table. */
+#define GVTableName(aTable, aRecord)            ((aTable)->Strings + (aRecord)->NameOffset)
+/** Description of a given record of a given table. */
+#define GVTableDescription(aTable, aRecord)     ((aTable)->Strings + (aRecord)->DescriptionOffset)
+/** Index of a given record (and of its @link(GENERAL_VALUE) structure) in a given table. */
+#define GVTableIndex(aTable, aRecord)           ((ULONG)((aRecord) - (aTable)->Records))
+
+PGENERAL_VALUE_RECORD GVTableGet(PGENERAL_VALUE_TABLE Table, ULONG Value);
+VOID GVTableGetBatch(PGENERAL_VALUE_TABLE Table, const ULONG *Values, ULONG Count, PGENERAL_VALUE_RECORD *Records);
+DWORD GVTablesPrepare(PGENERAL_VALUE_TABLE *Tables, ULONG Count);
+VOID GVTablesFinit(PGENERAL_VALUE_TABLE *Tables, ULONG Count);
+
+
+
+#endif 
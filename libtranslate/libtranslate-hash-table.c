@@ -4,6 +4,18 @@
  *
  * Tento soubor implementuje hashovaci tabulku pro obecne pouziti. Tato
  * datova struktura resi kolize metodou retezeni prvku.
+ *
+ * Number of buckets follows the number of items. When the load factor gets
+ * out of bounds, a new bucket array (twice or half as large) is allocated
+ * and items of the old array are moved to it incrementally by subsequent
+ * insert and delete operations. Lookups search both arrays until all items
+ * are moved. Locks are striped, their number is fixed at creation time
+ * (HASH_TABLE_DEFAULT_LOCK_COUNT) and the number of buckets is always its multiple,
+ * so an item is protected by the same lock in both arrays.
+ *
+ * Tables that are no longer modified can be frozen. Items of a frozen table are
+ * copied to one array ordered by buckets and lookups search it without taking
+ * any lock.
  */
 
 #include <windows.h>
@@ -48,6 +60,228 @@ static VOID HashTableUnlockShared(PHASH_TABLE Table, ULONG32 Index)
 }
 
 
+/** Acquires all locks of the table, in ascending order. Used only when
+ *  the bucket arrays are swapped.
+ */
+static VOID _HashTableLockAll(PHASH_TABLE Table)
+{
+   ULONG32 i = 0;
+
+   for (i = 0; i < Table->LockCount; ++i)
+      EnterCriticalSection(&Table->Lock[i]);
+
+   return;
+}
+
+
+static VOID _HashTableUnlockAll(PHASH_TABLE Table)
+{
+   LONG i = 0;
+
+   for (i = (LONG)Table->LockCount - 1; i >= 0; --i)
+      LeaveCriticalSection(&Table->Lock[i]);
+
+   return;
+}
+
+
+/** Translates a bucket index to address of the bucket. Indices below
+ *  Size refer to the current bucket array, the higher ones to the old
+ *  array used during rehashing. Bucket I is protected by lock I % LockCount.
+ */
+static PHASH_ITEM *_HashTableBucketByIndex(PHASH_TABLE Table, ULONG Index)
+{
+   return (Index < Table->Size) ? &Table->Buckets[Index] : &Table->OldBuckets[Index - Table->Size];
+}
+
+
+/** Searches one bucket for an item with a given key; optionally
+ *  unlinks the item found.
+ */
+static PHASH_ITEM _HashTableBucketFind(PHASH_TABLE Table, PHASH_ITEM *Bucket, ULONG32 HashValue, PVOID Key, BOOLEAN Remove)
+{
+   PHASH_ITEM akt = NULL;
+   PHASH_ITEM prev = NULL;
+
+   akt = *Bucket;
+   while (akt != NULL) {
+      if (akt->HashValue == HashValue && Table->CompareFunction(akt, Key)) {
+         if (Remove) {
+            if (prev != NULL)
+               prev->Next = akt->Next;
+            else *Bucket = akt->Next;
+         }
+
+         break;
+      }
+
+      prev = akt;
+      akt = akt->Next;
+   }
+
+   return akt;
+}
+
+
+/** Searches the table (both bucket arrays during rehashing) for an item
+ *  with a given key. The caller must hold the lock protecting the key.
+ */
+static PHASH_ITEM _HashTableFind(PHASH_TABLE Table, ULONG32 HashValue, PVOID Key, BOOLEAN Remove)
+{
+   PHASH_ITEM ret = NULL;
+
+   ret = _HashTableBucketFind(Table, &Table->Buckets[HashValue % Table->Size], HashValue, Key, Remove);
+   if (ret == NULL && Table->OldBuckets != NULL)
+      ret = _HashTableBucketFind(Table, &Table->OldBuckets[HashValue % Table->OldSize], HashValue, Key, Remove);
+
+   return ret;
+}
+
+
+/** Moves up to Count old buckets protected by a given lock to the current
+ *  bucket array. The caller must hold the lock.
+ *
+ *  @return
+ *  Returns TRUE if the last old bucket of the table has been moved. The caller
+ *  must call _HashTableMigrationFinish after releasing the lock then.
+ */
+static BOOLEAN _HashTableMigrate(PHASH_TABLE Table, ULONG32 LockIndex, ULONG32 Count)
+{
+   ULONG32 index = 0;
+   PHASH_ITEM item = NULL;
+   PHASH_ITEM next = NULL;
+   PHASH_ITEM *bucket = NULL;
+   BOOLEAN ret = FALSE;
+
+   if (Table->OldBuckets != NULL) {
+      index = Table->MigrateCursors[LockIndex];
+      if (index < Table->OldSize) {
+         while (Count > 0 && index < Table->OldSize) {
+            item = Table->OldBuckets[index];
+            while (item != NULL) {
+               next = item->Next;
+               bucket = &Table->Buckets[item->HashValue % Table->Size];
+               item->Next = *bucket;
+               *bucket = item;
+               item = next;
+            }
+
+            Table->OldBuckets[index] = NULL;
+            index += Table->LockCount;
+            --Count;
+         }
+
+         Table->MigrateCursors[LockIndex] = index;
+         if (index >= Table->OldSize)
+            ret = (InterlockedDecrement(&Table->LocksToMigrate) == 0);
+      }
+   }
+
+   return ret;
+}
+
+
+static VOID _HashTableMigrationFinish(PHASH_TABLE Table)
+{
+   PHASH_ITEM *oldBuckets = NULL;
+
+   _HashTableLockAll(Table);
+   if (Table->OldBuckets != NULL && Table->LocksToMigrate == 0) {
+      oldBuckets = Table->OldBuckets;
+      Table->OldBuckets = NULL;
+      Table->OldSize = 0;
+   }
+
+   _HashTableUnlockAll(Table);
+   if (oldBuckets != NULL)
+      HeapMemoryFree(oldBuckets);
+
+   return;
+}
+
+
+/** Called after every insert or delete operation (with no lock held). Helps
+ *  to move old buckets of another lock, and starts rehashing when the load factor
+ *  gets out of bounds. If the new bucket array cannot be allocated, the table keeps
+ *  its size.
+ */
+static VOID _HashTableMaintain(PHASH_TABLE Table, BOOLEAN MigrationFinished)
+{
+   ULONG32 i = 0;
+   ULONG32 lockIndex = 0;
+   ULONG32 oldSize = 0;
+   ULONG32 newSize = 0;
+   ULONG numberOfItems = 0;
+   PHASH_ITEM *newBuckets = NULL;
+
+   if (!MigrationFinished && Table->OldBuckets != NULL) {
+      lockIndex = (ULONG32)InterlockedIncrement(&Table->MigrateHelper) % Table->LockCount;
+      HashTableLockExclusive(Table, lockIndex);
+      MigrationFinished = _HashTableMigrate(Table, lockIndex, HASH_TABLE_MIGRATE_STEP);
+      HashTableUnlockExclusive(Table, lockIndex);
+   }
+
+   if (MigrationFinished)
+      _HashTableMigrationFinish(Table);
+
+   if (Table->OldBuckets == NULL) {
+      oldSize = Table->Size;
+      numberOfItems = (ULONG)Table->NumberOfItems;
+      if (numberOfItems > oldSize*HASH_TABLE_GROW_LOAD_FACTOR && oldSize <= HASH_TABLE_MAX_SIZE / 2)
+         newSize = oldSize * 2;
+      else if (numberOfItems < oldSize / HASH_TABLE_SHRINK_LOAD_DIVISOR && oldSize / 2 >= Table->MinSize)
+         newSize = oldSize / 2;
+
+      if (newSize != 0) {
+         newBuckets = (PHASH_ITEM *)HeapMemoryAlloc(newSize*sizeof(PHASH_ITEM));
+         if (newBuckets != NULL) {
+            memset(newBuckets, 0, newSize*sizeof(PHASH_ITEM));
+            _HashTableLockAll(Table);
+            if (Table->OldBuckets == NULL && Table->Size == oldSize) {
+               Table->OldBuckets = Table->Buckets;
+               Table->OldSize = Table->Size;
+               Table->Buckets = newBuckets;
+               Table->Size = newSize;
+               for (i = 0; i < Table->LockCount; ++i)
+                  Table->MigrateCursors[i] = i;
+
+               Table->LocksToMigrate = (LONG)Table->LockCount;
+               newBuckets = NULL;
+            }
+
+            _HashTableUnlockAll(Table);
+            if (newBuckets != NULL)
+               HeapMemoryFree(newBuckets);
+         }
+      }
+   }
+
+   return;
+}
+
+
+/** Searches a frozen table for an item with a given key. No lock is needed.
+ */
+static PHASH_ITEM _HashTableFrozenFind(PHASH_TABLE Table, ULONG32 HashValue, PVOID Key)
+{
+   ULONG32 i = 0;
+   ULONG32 bucket = 0;
+   PHASH_ITEM akt = NULL;
+   PHASH_ITEM ret = NULL;
+
+   bucket = HashValue % Table->Size;
+   for (i = Table->FrozenBuckets[bucket]; i < Table->FrozenBuckets[bucket + 1]; ++i) {
+      akt = Table->FrozenItems[i];
+      if (akt->HashValue == HashValue && Table->CompareFunction(akt, Key)) {
+         ret = akt;
+         break;
+      }
+   }
+
+   return ret;
+}
+
+
 /************************************************************************/
 /*                                PUBLIC ROUTINES                       */
 /************************************************************************/
@@ -57,7 +291,9 @@ static VOID HashTableUnlockShared(PHASH_TABLE Table, ULONG32 Index)
  * Funkce vytvori hashovaci tabulku se zadanym poctem slotu a se zadanou
  * hashovaci, porovnavaci a uklidovou funkci.
  *
- * @param Size Udava pocet slotu hashovaci tabulky.
+ * @param Size Udava pocet slotu hashovaci tabulky. The value is rounded up
+ * to a multiple of the number of locks. The table grows and shrinks automatically
+ * but never below this value.
  * @param HashFunction Adresa hashovaci funkce. Tato hodnota musi nest
  * platna data.
  * @param CompareFunction Adresa porovnavaci funkce. Tato hodnota musi
@@ -73,42 +309,61 @@ static VOID HashTableUnlockShared(PHASH_TABLE Table, ULONG32 Index)
 DWORD HashTableCreate(IN ULONG32 Size, IN HASH_FUNCTION HashFunction, IN COMPARE_FUNCTION CompareFunction, IN FREE_ITEM_FUNCTION FreeFunction, OUT PHASH_TABLE *Table)
 {
 	ULONG i, j = 0;
+	ULONG32 lockCount = 0;
 	PHASH_TABLE tmpTable = NULL;
 	DWORD ret = ERROR_GEN_FAILURE;
 	DEBUG_ENTER_FUNCTION("Size=%u; HashFunction=0x%p; CompareFunction=0x%p; FreeFunction=0x%p; Table=0x%p", Size, HashFunction, CompareFunction, FreeFunction, Table);
 
-	tmpTable = (PHASH_TABLE)HeapMemoryAlloc(sizeof(HASH_TABLE) + Size * sizeof(PHASH_ITEM));
-	if (tmpTable != NULL) {
-		tmpTable->Size = Size;
-		tmpTable->HashFunction = HashFunction;
-		tmpTable->CompareFunction = CompareFunction;
-		tmpTable->FreeFunction = FreeFunction;
-		tmpTable->Lock = (PCRITICAL_SECTION)HeapMemoryAlloc(Size * sizeof(CRITICAL_SECTION));
-		if (tmpTable->Lock != NULL) {
-			ret = ERROR_SUCCESS;
-			for (i = 0; i < Size; i++) {
-				tmpTable->Buckets[i] = NULL;
-				if (!InitializeCriticalSectionAndSpinCount(&tmpTable->Lock[i], 0x1000))
-					ret = GetLastError();
-
-				if (ret != ERROR_SUCCESS) {
-					for (j = 0; j < i; ++j)
-						DeleteCriticalSection(&tmpTable->Lock[j]);
+	if (Size > 0 && Size <= HASH_TABLE_MAX_SIZE) {
+		lockCount = (Size < HASH_TABLE_DEFAULT_LOCK_COUNT) ? Size : HASH_TABLE_DEFAULT_LOCK_COUNT;
+		Size = ((Size + lockCount - 1) / lockCount)*lockCount;
+		tmpTable = (PHASH_TABLE)HeapMemoryAlloc(sizeof(HASH_TABLE));
+		if (tmpTable != NULL) {
+			memset(tmpTable, 0, sizeof(HASH_TABLE));
+			tmpTable->Size = Size;
+			tmpTable->MinSize = Size;
+			tmpTable->LockCount = lockCount;
+			tmpTable->HashFunction = HashFunction;
+			tmpTable->CompareFunction = CompareFunction;
+			tmpTable->FreeFunction = FreeFunction;
+			tmpTable->Buckets = (PHASH_ITEM *)HeapMemoryAlloc(Size * sizeof(PHASH_ITEM));
+			tmpTable->MigrateCursors = (PULONG32)HeapMemoryAlloc(lockCount * sizeof(ULONG32));
+			tmpTable->Lock = (PCRITICAL_SECTION)HeapMemoryAlloc(lockCount * sizeof(CRITICAL_SECTION));
+			if (tmpTable->Buckets != NULL && tmpTable->MigrateCursors != NULL && tmpTable->Lock != NULL) {
+				ret = ERROR_SUCCESS;
+				for (i = 0; i < Size; i++)
+					tmpTable->Buckets[i] = NULL;
+
+				for (i = 0; i < lockCount; i++) {
+					if (!InitializeCriticalSectionAndSpinCount(&tmpTable->Lock[i], 0x1000))
+						ret = GetLastError();
+
+					if (ret != ERROR_SUCCESS) {
+						for (j = 0; j < i; ++j)
+							DeleteCriticalSection(&tmpTable->Lock[j]);
 					
-					break;
+						break;
+					}
 				}
-			}
 
-			if (ret == ERROR_SUCCESS)
-				*Table = tmpTable;
+				if (ret == ERROR_SUCCESS)
+					*Table = tmpTable;
+			} else ret = ERROR_NOT_ENOUGH_MEMORY;
 
-			if (ret != ERROR_SUCCESS)
-				HeapMemoryFree(tmpTable->Lock);
-		} else ret = ERROR_NOT_ENOUGH_MEMORY;
+			if (ret != ERROR_SUCCESS) {
+				if (tmpTable->Lock != NULL)
+					HeapMemoryFree(tmpTable->Lock);
+
+				if (tmpTable->MigrateCursors != NULL)
+					HeapMemoryFree(tmpTable->MigrateCursors);
+
+				if (tmpTable->Buckets != NULL)
+					HeapMemoryFree(tmpTable->Buckets);
 
-		if (ret != ERROR_SUCCESS)
-			HeapMemoryFree(tmpTable);
-	} else ret = ERROR_NOT_ENOUGH_MEMORY;
+				HeapMemoryFree(tmpTable);
+			}
+		} else ret = ERROR_NOT_ENOUGH_MEMORY;
+	} else ret = ERROR_INVALID_PARAMETER;
 
 	DEBUG_EXIT_FUNCTION("%u, *Table=0x%p\n", ret, *Table);
 	return ret;
@@ -130,8 +385,8 @@ VOID HashTableDestroy(IN PHASH_TABLE Table)
    PHASH_ITEM Bucket = NULL;
    DEBUG_ENTER_FUNCTION("Table=%p", Table);
 
-   for (i = 0; i < Table->Size; i++) {
-      Bucket = Table->Buckets[i];
+   for (i = 0; i < Table->Size + Table->OldSize; i++) {
+      Bucket = *_HashTableBucketByIndex(Table, i);
       if (Bucket != NULL) {
          do {
             Tmp = Bucket;
@@ -141,10 +396,21 @@ VOID HashTableDestroy(IN PHASH_TABLE Table)
             }
          } while (Bucket != NULL);
       }
+   }
 
-	  DeleteCriticalSection(&Table->Lock[i]);
+   for (i = 0; i < Table->LockCount; ++i)
+      DeleteCriticalSection(&Table->Lock[i]);
+
+   if (Table->OldBuckets != NULL)
+      HeapMemoryFree(Table->OldBuckets);
+
+   if (Table->FrozenItems != NULL) {
+      HeapMemoryFree(Table->FrozenBuckets);
+      HeapMemoryFree(Table->FrozenItems);
    }
 
+   HeapMemoryFree(Table->MigrateCursors);
+   HeapMemoryFree(Table->Buckets);
    HeapMemoryFree(Table->Lock);
    HeapMemoryFree(Table);
 
@@ -162,13 +428,20 @@ VOID HashTableDestroy(IN PHASH_TABLE Table)
 VOID HashTableInsert(IN PHASH_TABLE Table, IN PHASH_ITEM Object, IN PVOID Key)
 {
 	ULONG32 Index = 0;
+	PHASH_ITEM *bucket = NULL;
+	BOOLEAN migrationFinished = FALSE;
 	DEBUG_ENTER_FUNCTION("Tabulka=0x%p; Object=0x%p; Key=0x%p", Table, Object, Key);
 
-	Index = Table->HashFunction(Key) % Table->Size;
+	Object->HashValue = Table->HashFunction(Key);
+	Index = Object->HashValue % Table->LockCount;
 	HashTableLockExclusive(Table, Index);
-	Object->Next = Table->Buckets[Index];
-	Table->Buckets[Index] = Object;
+	migrationFinished = _HashTableMigrate(Table, Index, HASH_TABLE_MIGRATE_STEP);
+	bucket = &Table->Buckets[Object->HashValue % Table->Size];
+	Object->Next = *bucket;
+	*bucket = Object;
 	HashTableUnlockExclusive(Table, Index);
+	InterlockedIncrement(&Table->NumberOfItems);
+	_HashTableMaintain(Table, migrationFinished);
 
 	DEBUG_EXIT_FUNCTION_VOID();
 	return;
@@ -188,32 +461,21 @@ VOID HashTableInsert(IN PHASH_TABLE Table, IN PHASH_ITEM Object, IN PVOID Key)
 PHASH_ITEM HashTableDelete(IN PHASH_TABLE Table, IN PVOID Key)
 {
    ULONG32 Index = 0;
+   ULONG32 hashValue = 0;
    PHASH_ITEM Akt = NULL;
-   PHASH_ITEM Prev = NULL;
-   BOOLEAN Ret = FALSE;
+   BOOLEAN migrationFinished = FALSE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Key=0x%p", Table, Key);
 
-   Index = Table->HashFunction(Key) % Table->Size;
+   hashValue = Table->HashFunction(Key);
+   Index = hashValue % Table->LockCount;
    HashTableLockExclusive(Table, Index);
-   Akt = Table->Buckets[Index];
-   Prev = NULL;
-   while (Akt != NULL) {
-      Ret = Table->CompareFunction(Akt, Key);
-      if (Ret) {
-         if (Prev != NULL) {
-            Prev->Next = Akt->Next;
-         } else {
-            Table->Buckets[Index] = Akt->Next;
-         }
-
-         break;
-      }
-
-      Prev = Akt;
-      Akt = Akt->Next;
-   }
-
+   migrationFinished = _HashTableMigrate(Table, Index, HASH_TABLE_MIGRATE_STEP);
+   Akt = _HashTableFind(Table, hashValue, Key, TRUE);
    HashTableUnlockExclusive(Table, Index);
+   if (Akt != NULL)
+      InterlockedDecrement(&Table->NumberOfItems);
+
+   _HashTableMaintain(Table, migrationFinished);
 
    DEBUG_EXIT_FUNCTION("0x%p", Akt);
    return Akt;
@@ -229,27 +491,24 @@ PHASH_ITEM HashTableDelete(IN PHASH_TABLE Table, IN PVOID Key)
  *  @return Funkce vrati adresu objektu, ktery byl do tabulky vlozen pod
  *  zadanym klicem. V pripade, ze objekt se v tabulce nenachazi, rutina
  *  vrati NULL.
+ *
+ *  @remark
+ *  Lookups in a frozen table (see @link(HashTableFreeze)) take no lock.
  */
 PHASH_ITEM HashTableGet(IN PHASH_TABLE Table, IN PVOID Key)
 {
-   BOOLEAN Ret = FALSE;
    ULONG32 Index = 0;
+   ULONG32 hashValue = 0;
    PHASH_ITEM Akt = NULL;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Key=0x%p", Table, Key);
 
-   Index = Table->HashFunction(Key) % Table->Size;
-   HashTableLockShared(Table, Index);
-   Akt = Table->Buckets[Index];
-   while (Akt != NULL) {
-      Ret = Table->CompareFunction(Akt, Key);
-      if (Ret) {
-         break;
-      }
-
-      Akt = Akt->Next;
-   }
-
-   HashTableUnlockShared(Table, Index);
+   hashValue = Table->HashFunction(Key);
+   if (Table->FrozenItems == NULL) {
+      Index = hashValue % Table->LockCount;
+      HashTableLockShared(Table, Index);
+      Akt = _HashTableFind(Table, hashValue, Key, FALSE);
+      HashTableUnlockShared(Table, Index);
+   } else Akt = _HashTableFrozenFind(Table, hashValue, Key);
 
    DEBUG_EXIT_FUNCTION("0x%p", Akt);
    return Akt;
@@ -259,17 +518,20 @@ PHASH_ITEM HashTableGet(IN PHASH_TABLE Table, IN PVOID Key)
 VOID HashTablePerform(PHASH_TABLE Table, HASH_ITEM_CALLBACK Callback, PVOID Context)
 {
    ULONG i = 0;
+   ULONG j = 0;
    PHASH_ITEM tmp = NULL;
    PHASH_ITEM old = NULL;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Callback=0x%p; Context=0x%p", Table, Callback, Context);
 
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockExclusive(Table, i);
-      tmp = Table->Buckets[i];
-      while (tmp != NULL) {
-         old = tmp;
-         tmp = tmp->Next;
-         Callback(old, Context);
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         tmp = *_HashTableBucketByIndex(Table, j);
+         while (tmp != NULL) {
+            old = tmp;
+            tmp = tmp->Next;
+            Callback(old, Context);
+         }
       }
 
       HashTableUnlockExclusive(Table, i);
@@ -282,19 +544,22 @@ VOID HashTablePerform(PHASH_TABLE Table, HASH_ITEM_CALLBACK Callback, PVOID Cont
 DWORD HashTablePerformFeedback(PHASH_TABLE Table, HASH_ITEM_FEEDBACK_CALLBACK *Callback, PVOID Context)
 {
    ULONG i = 0;
+   ULONG j = 0;
    PHASH_ITEM tmp = NULL;
    PHASH_ITEM old = NULL;
    DWORD ret = ERROR_GEN_FAILURE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; Callback=0x%p; Context=0x%p", Table, Callback, Context);
 
    ret = ERROR_SUCCESS;
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockExclusive(Table, i);
-      tmp = Table->Buckets[i];
-      while (ret == ERROR_SUCCESS && tmp != NULL) {
-         old = tmp;
-         tmp = tmp->Next;
-         ret = Callback(old, Context);
+      for (j = i; ret == ERROR_SUCCESS && j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         tmp = *_HashTableBucketByIndex(Table, j);
+         while (ret == ERROR_SUCCESS && tmp != NULL) {
+            old = tmp;
+            tmp = tmp->Next;
+            ret = Callback(old, Context);
+         }
       }
 
       HashTableUnlockExclusive(Table, i);
@@ -312,25 +577,206 @@ DWORD HashTablePerformFeedback(PHASH_TABLE Table, HASH_ITEM_FEEDBACK_CALLBACK *C
 VOID HashTableClear(PHASH_TABLE Table, BOOLEAN CallFreeFunction)
 {
    ULONG i = 0;
+   ULONG j = 0;
    PHASH_ITEM old = NULL;
    PHASH_ITEM akt = NULL;
+   PHASH_ITEM *bucket = NULL;
+   BOOLEAN migrationFinished = FALSE;
    DEBUG_ENTER_FUNCTION("Table=0x%p; CallFreeFunction=%u", Table, CallFreeFunction);
 
-   for (i = 0; i < Table->Size; ++i) {
+   for (i = 0; i < Table->LockCount; ++i) {
       HashTableLockExclusive(Table, i);
-      if (CallFreeFunction && Table->FreeFunction != NULL) {
-         akt = Table->Buckets[i];
-         while (akt != NULL) {
-            old = akt;
-            akt = akt->Next;
-            Table->FreeFunction(old);
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         bucket = _HashTableBucketByIndex(Table, j);
+         if (CallFreeFunction && Table->FreeFunction != NULL) {
+            akt = *bucket;
+            while (akt != NULL) {
+               old = akt;
+               akt = akt->Next;
+               Table->FreeFunction(old);
+            }
          }
+
+         *bucket = NULL;
       }
 
-      Table->Buckets[i] = NULL;
+      // Old buckets of this lock are empty, just mark them as moved
+      if (_HashTableMigrate(Table, i, MAXULONG))
+         migrationFinished = TRUE;
+
       HashTableUnlockExclusive(Table, i);
    }
 
+   Table->NumberOfItems = 0;
+   if (migrationFinished)
+      _HashTableMigrationFinish(Table);
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+
+ULONG HashTableGetItemCount(PHASH_TABLE Table)
+{
+   ULONG ret = 0;
+   DEBUG_ENTER_FUNCTION("Table=0x%p", Table);
+
+   ret = (ULONG)Table->NumberOfItems;
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+
+/** Computes statistics describing distribution of items stored in a given
+ *  hash table.
+ *
+ *  @param Table The table in question.
+ *  @param Statistics Address of a structure that receives the statistics.
+ *
+ *  @remark
+ *  The table is traversed lock by lock. If it is being rehashed, buckets of
+ *  both bucket arrays are counted.
+ */
+VOID HashTableGetStatistics(PHASH_TABLE Table, PLIBTRANSLATE_HASH_TABLE_STATISTICS Statistics)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG chainLength = 0;
+   PHASH_ITEM tmp = NULL;
+   DEBUG_ENTER_FUNCTION("Table=0x%p; Statistics=0x%p", Table, Statistics);
+
+   memset(Statistics, 0, sizeof(LIBTRANSLATE_HASH_TABLE_STATISTICS));
+   for (i = 0; i < Table->LockCount; ++i) {
+      HashTableLockShared(Table, i);
+      for (j = i; j < Table->Size + Table->OldSize; j += Table->LockCount) {
+         chainLength = 0;
+         tmp = *_HashTableBucketByIndex(Table, j);
+         while (tmp != NULL) {
+            ++chainLength;
+            tmp = tmp->Next;
+         }
+
+         if (chainLength > 0)
+            ++Statistics->UsedBuckets;
+
+         if (chainLength > Statistics->MaxChainLength)
+            Statistics->MaxChainLength = chainLength;
+
+         ++Statistics->ChainLengthHistogram[min(chainLength, LIBTRANSLATE_HASH_TABLE_HISTOGRAM_SIZE - 1)];
+         Statistics->NumberOfItems += chainLength;
+      }
+
+      if (i == 0) {
+         Statistics->NumberOfBuckets = Table->Size;
+         Statistics->NumberOfOldBuckets = Table->OldSize;
+      }
+
+      HashTableUnlockShared(Table, i);
+   }
+
+   Statistics->NumberOfLocks = Table->LockCount;
+   if (Statistics->NumberOfBuckets + Statistics->NumberOfOldBuckets > 0)
+      Statistics->LoadFactor = (ULONG)(((ULONG64)Statistics->NumberOfItems * 100) / (Statistics->NumberOfBuckets + Statistics->NumberOfOldBuckets));
+
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
+
+
+/** Freezes a given hash table, making lookups in it lock-free.
+ *
+ *  @param Table The table to freeze.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, ERROR_NOT_ENOUGH_MEMORY if the frozen
+ *  representation cannot be allocated. The table remains usable in the latter
+ *  case, its lookups just keep taking the locks.
+ *
+ *  @remark
+ *  The routine finishes pending rehashing and copies addresses of all items to
+ *  a single array ordered by buckets, so that items of one bucket are adjacent.
+ *  @link(HashTableGet) searches the array without any synchronization afterwards.
+ *
+ *  The routine must not be called concurrently with other operations on the table.
+ *  Once frozen, the table must not be modified (no insert, delete or clear operation
+ *  is allowed) until it is destroyed. Freezing an already frozen table has no effect.
+ */
+DWORD HashTableFreeze(PHASH_TABLE Table)
+{
+   ULONG32 i = 0;
+   ULONG32 index = 0;
+   PHASH_ITEM tmp = NULL;
+   PHASH_ITEM *items = NULL;
+   PULONG32 buckets = NULL;
+   BOOLEAN migrationFinished = FALSE;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Table=0x%p", Table);
+
+   if (Table->FrozenItems == NULL) {
+      for (i = 0; i < Table->LockCount; ++i) {
+         if (_HashTableMigrate(Table, i, MAXULONG))
+            migrationFinished = TRUE;
+      }
+
+      if (migrationFinished)
+         _HashTableMigrationFinish(Table);
+
+      buckets = (PULONG32)HeapMemoryAlloc((Table->Size + 1)*sizeof(ULONG32));
+      items = (PHASH_ITEM *)HeapMemoryAlloc((Table->NumberOfItems + 1)*sizeof(PHASH_ITEM));
+      if (buckets != NULL && items != NULL) {
+         for (i = 0; i < Table->Size; ++i) {
+            buckets[i] = index;
+            tmp = Table->Buckets[i];
+            while (tmp != NULL) {
+               items[index] = tmp;
+               ++index;
+               tmp = tmp->Next;
+            }
+         }
+
+         buckets[Table->Size] = index;
+         Table->FrozenBuckets = buckets;
+         MemoryBarrier();
+         Table->FrozenItems = items;
+         ret = ERROR_SUCCESS;
+      } else ret = ERROR_NOT_ENOUGH_MEMORY;
+
+      if (ret != ERROR_SUCCESS) {
+         if (items != NULL)
+            HeapMemoryFree(items);
+
+         if (buckets != NULL)
+            HeapMemoryFree(buckets);
+      }
+   } else ret = ERROR_SUCCESS;
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+
+/** Hash function for tables keyed by integer values or addresses.
+ *
+ *  @param Key The key to hash.
+ *
+ *  @return
+ *  Returns the hash value.
+ *
+ *  @remark
+ *  The key is mixed by the finalizer of the MurmurHash3 algorithm, so every
+ *  key bit affects all bits of the result. Constants sharing most of their
+ *  bits (such as NTSTATUS codes of one facility) are spread over the buckets.
+ */
+ULONG32 HashTablePointerHash(PVOID Key)
+{
+   ULONG64 k = (ULONG64)(ULONG_PTR)Key;
+
+   k ^= (k >> 33);
+   k *= 0xff51afd7ed558ccdULL;
+   k ^= (k >> 33);
+   k *= 0xc4ceb9fe1a85ec53ULL;
+   k ^= (k >> 33);
+
+   return (ULONG32)k;
+}
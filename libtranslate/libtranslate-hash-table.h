@@ -10,6 +10,7 @@
  */
 
 #include <windows.h>
+#include "libtranslate.h"
 
 
 
@@ -17,6 +18,8 @@
 typedef struct _HASH_ITEM {
    // Odkaz na naslednika ve spojovem seznamu
    struct _HASH_ITEM *Next;
+   // Hash of the key the item was inserted under. Used when the table is resized.
+   ULONG32 HashValue;
 } HASH_ITEM, *PHASH_ITEM;
 
 
@@ -70,10 +73,31 @@ typedef VOID (*HASH_ITEM_CALLBACK)(IN PHASH_ITEM Object, PVOID Context);
 
 typedef DWORD (HASH_ITEM_FEEDBACK_CALLBACK)(PHASH_ITEM Object, PVOID Context);
 
+/** Maximum ratio of number of items to number of buckets. When exceeded,
+    number of buckets is doubled. */
+#define HASH_TABLE_GROW_LOAD_FACTOR            2
+/** When the number of items drops below number of buckets divided by this
+    value, number of buckets is halved (never below the initial size). */
+#define HASH_TABLE_SHRINK_LOAD_DIVISOR         8
+/** Maximum number of buckets a table can grow to. */
+#define HASH_TABLE_MAX_SIZE                    0x4000000
+/** Number of locks (lock stripes) of a table. Tables with fewer buckets
+    have one lock per bucket. */
+#define HASH_TABLE_DEFAULT_LOCK_COUNT          16
+/** Number of old buckets moved to the new bucket array by a single insert
+    or delete operation during incremental rehashing. */
+#define HASH_TABLE_MIGRATE_STEP                2
+
 // Struktura hashovaci tabulky
 typedef struct _HASH_TABLE {
    // Pocet slotu
    ULONG32 Size;
+   // Initial number of buckets, the table never shrinks below it
+   ULONG32 MinSize;
+   // Number of locks (independent of Size); bucket I is protected by lock I % LockCount in both bucket arrays
+   ULONG32 LockCount;
+   // Number of items stored in the table
+   volatile LONG NumberOfItems;
    // Adresa hashovaci funkce
    HASH_FUNCTION HashFunction;
    // Porovnavaci funkce
@@ -83,7 +107,21 @@ typedef struct _HASH_TABLE {
    // Zamky reader-writer pro jednotlive sloty
    PCRITICAL_SECTION Lock;
    // Sloty
-   PHASH_ITEM Buckets[1];
+   PHASH_ITEM *Buckets;
+   // Buckets the items are being moved from during incremental rehashing (NULL if none)
+   PHASH_ITEM *OldBuckets;
+   // Number of buckets in the OldBuckets array
+   ULONG32 OldSize;
+   // For every lock, index of the next old bucket to move to the new array
+   PULONG32 MigrateCursors;
+   // Number of locks whose old buckets have not been moved yet
+   volatile LONG LocksToMigrate;
+   // Selects the lock whose old buckets are moved by operations on other locks
+   volatile LONG MigrateHelper;
+   // Items of a frozen table ordered by buckets (NULL if the table is not frozen)
+   PHASH_ITEM *FrozenItems;
+   // For every bucket of a frozen table, index of its first item in FrozenItems; Size + 1 elements
+   PULONG32 FrozenBuckets;
 } HASH_TABLE, *PHASH_TABLE;
 
 // Vyznam jednotlivych rutin najdete v komentarich u jejich implementace
@@ -97,5 +135,10 @@ PHASH_ITEM HashTableGet(IN PHASH_TABLE Table, IN PVOID Key);
 VOID HashTablePerform(PHASH_TABLE Table, HASH_ITEM_CALLBACK Callback, PVOID Context);
 VOID HashTableClear(PHASH_TABLE Table, BOOLEAN CallFreeFunction);
 DWORD HashTablePerformFeedback(PHASH_TABLE Table, HASH_ITEM_FEEDBACK_CALLBACK *Callback, PVOID Context);
+ULONG HashTableGetItemCount(PHASH_TABLE Table);
+VOID HashTableGetStatistics(PHASH_TABLE Table, PLIBTRANSLATE_HASH_TABLE_STATISTICS Statistics);
+DWORD HashTableFreeze(PHASH_TABLE Table);
+
+ULONG32 HashTablePointerHash(PVOID Key);
 
 #endif
@@ -9,6 +9,7 @@
 #include <windows.h>
 #include "allocator.h"
 #include "debug.h"
+#include "descriptions.h"
 #include "translates.h"
 #include "libtranslate.h"
 
@@ -26,11 +27,26 @@ LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateGeneralIntegerValueToString(ELibTransl
    return GeneralIntegerValueToString(Type, Description, Value);
 }
 
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateEnumerationValuesToStrings(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings)
+{
+	return EnumerationValuesToStrings(Type, Description, Values, Count, Strings);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateGeneralIntegerValuesToStrings(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings)
+{
+	return GeneralIntegerValuesToStrings(Type, Description, Values, Count, Strings);
+}
+
 LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateBitMaskValueToString(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value)
 {
    return BitMaskValueToString(Type, Description, Value);
 }
 
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateBitMaskValueToBuffer(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+	return BitMaskValueToBuffer(Type, Description, Value, Buffer, BufferLength, RequiredLength);
+}
+
 LIBTRANSLATEAPI VOID WINAPI LibTranslateBitMaskValueStringFree(PWCHAR Str)
 {
    BitMaskValueStringFree(Str);
@@ -100,6 +116,51 @@ LIBTRANSLATEAPI PWCHAR WINAPI LibTranslateIRPFLagsToString(UCHAR MajorFunction,
 	return IRPFLagsToString(MajorFunction, MinorFunction, IRPFlags, Description);
 }
 
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateIRPFlagsToBuffer(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+	return IRPFlagsToBuffer(MajorFunction, MinorFunction, IRPFlags, Description, Buffer, BufferLength, RequiredLength);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateHashTableStatistics(ELibTranslateIntegerValueType Type, PLIBTRANSLATE_HASH_TABLE_STATISTICS Statistics)
+{
+	return IntegerValueTableStatistics(Type, Statistics);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateSetDescriptionSource(ELibTranslateDescriptionSource Source, PVOID Blob, ULONG BlobSize)
+{
+	return TranslatesSetDescriptionSource(Source, Blob, BlobSize);
+}
+
+LIBTRANSLATEAPI PCHAR WINAPI LibTranslateEnumerationValueToStringUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value)
+{
+	return EnumerationValueToStringUTF8(Type, Description, Value);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateEnumerationValuesToStringsUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths)
+{
+	return EnumerationValuesToStringsUTF8(Type, Description, Values, Count, Strings, Lengths);
+}
+
+LIBTRANSLATEAPI PCHAR WINAPI LibTranslateGeneralIntegerValueToStringUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value)
+{
+	return GeneralIntegerValueToStringUTF8(Type, Description, Value);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateGeneralIntegerValuesToStringsUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths)
+{
+	return GeneralIntegerValuesToStringsUTF8(Type, Description, Values, Count, Strings, Lengths);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateBitMaskValueToBufferUTF8(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+	return BitMaskValueToBufferUTF8(Type, Description, Value, Buffer, BufferLength, RequiredLength);
+}
+
+LIBTRANSLATEAPI DWORD WINAPI LibTranslateIRPFlagsToBufferUTF8(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+	return IRPFlagsToBufferUTF8(MajorFunction, MinorFunction, IRPFlags, Description, Buffer, BufferLength, RequiredLength);
+}
+
 
 
 /************************************************************************/
@@ -118,7 +179,13 @@ LIBTRANSLATEAPI DWORD WINAPI LibTranslateInitialize(VOID)
 
    ret = DebugAllocatorInit();
    if (ret == ERROR_SUCCESS) {
-      ret = TranslatesModuleInit();
+      ret = DescriptionsModuleInit();
+      if (ret == ERROR_SUCCESS) {
+         ret = TranslatesModuleInit();
+         if (ret != ERROR_SUCCESS)
+            DescriptionsModuleFinit();
+      }
+
       if (ret != ERROR_SUCCESS)
          DebugAllocatorFinit();
    }
@@ -134,12 +201,15 @@ LIBTRANSLATEAPI VOID WINAPI LibTranslateFinalize(VOID)
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
    TranslatesModuleFinit();
+   DescriptionsModuleFinit();
    DebugAllocatorFinit();
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
+#ifdef _WIN32
+
 /************************************************************************/
 /*                     DLLMAIN                                          */
 /************************************************************************/
@@ -161,3 +231,5 @@ BOOL WINAPI DllMain(_In_ HINSTANCE hinstDLL, _In_ DWORD fdwReason, _In_ LPVOID l
    DEBUG_EXIT_FUNCTION("%u", ret);
    return ret;
 }
+
+#endif
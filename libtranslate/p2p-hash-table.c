@@ -12,7 +12,7 @@
 
 static ULONG32 _HashFunction(PVOID Key)
 {
-   return (ULONG32)Key;
+   return HashTablePointerHash(Key);
 }
 
 static BOOLEAN _CompareFunction(PHASH_ITEM Item, PVOID Key)
@@ -108,4 +108,15 @@ VOID P2PHashTableDelete(PHASH_TABLE Table, ULONG_PTR Key)
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
+}
+
+DWORD P2PHashTableFreeze(PHASH_TABLE Table)
+{
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Table=0x%p", Table);
+
+   ret = HashTableFreeze(Table);
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
 }
\ No newline at end of file
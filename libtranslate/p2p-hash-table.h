@@ -18,6 +18,7 @@ DWORD P2PHashTableCreate(ULONG32 Size, PHASH_TABLE *Table);
 DWORD P2PHashTableInsert(PHASH_TABLE Table, ULONG_PTR Key, ULONG_PTR Value);
 VOID P2PHashTableDestroy(PHASH_TABLE Table);
 VOID P2PHashTableDelete(PHASH_TABLE Table, ULONG_PTR Key);
+DWORD P2PHashTableFreeze(PHASH_TABLE Table);
 
 
 #endif 
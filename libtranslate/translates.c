@@ -14,7 +14,9 @@
 #include "allocator.h"
 #include "libtranslate.h"
 #include "libtranslate-hash-table.h"
-#include "gv-hash-table.h"
+#include "gv-table.h"
+#include "descriptions.h"
+#include "utf8.h"
 #include "p2p-hash-table.h"
 #include "translates-arrays.h"
 #include "translates.h"
@@ -23,65 +25,191 @@
 /*                  TYPE DEFINITIONS                                    */
 /************************************************************************/
 
-/** RtlNtStatusToDosError routine prototype. 
- *
- *  The routine is exported by ntdll library and its purpose is to translate 
- *  NTSTATUS values (STATUS_XXX) to Win32 error values (ERROR_XXX). 
- *
- *  @param Status A NTSTATUS value to convert.
- *
- *  @return
- *  Returns Win32 error value associated with the given NTSTATUS one.
- *
- *  @remark
- *  If there is no Win32 error value associated with given NTSTATUS one, the routine
- *  returns ERROR_MR_MID_NOT_FOUND (317) error code. In some cases, the routine 
- *  return the same value as given in its argument.
- *
- *  More information can be found at:
- *  http://msdn.microsoft.com/en-us/library/windows/desktop/ms680600(v=vs.85).aspx.
- */
-typedef ULONG (WINAPI RTLNTSTATUSTODOSERROR)(NTSTATUS Status);
+/** Number of values translated by one @link(GVTableGetBatch) call during
+    batch translations. */
+#define GENERAL_VALUE_BATCH_CHUNK      64
+
+/** Number of entries in the bit mask string cache. */
+#define BITMASK_CACHE_SIZE             128
+/** Maximum length of a string (including the terminating null character) stored
+    in the bit mask string cache, in characters. */
+#define BITMASK_CACHE_MAX_STRING       128
+
+/** Remembers string representation of one bit mask value. */
+typedef struct _BITMASK_CACHE_ENTRY {
+   /** Synchronizes access to the entry. */
+   SRWLOCK Lock;
+   /** Type of the bit mask. */
+   ELibTranslateBitMaskType Type;
+   /** Determines whether the string contains names, or descriptions of the bits. */
+   BOOLEAN Description;
+   /** The bit mask value. */
+   ULONG Value;
+   /** Length of the string, including the terminating null character. Zero if the
+       entry is empty. */
+   ULONG Length;
+   /** The string. */
+   WCHAR String[BITMASK_CACHE_MAX_STRING];
+} BITMASK_CACHE_ENTRY, *PBITMASK_CACHE_ENTRY;
+
+/** Number of slots of the cache of decoded IOCTL codes. */
+#define DEVICE_CONTROL_CACHE_SIZE      4096
+/** Maximum number of slots examined when looking for an IOCTL code in the cache. */
+#define DEVICE_CONTROL_CACHE_PROBES    16
+/** Maximum length of a decoded IOCTL string (including the terminating null character),
+    in characters. */
+#define DEVICE_CONTROL_MAX_STRING      160
+
+/** Represents an IOCTL code not present in the IOCTL table, decoded into its CTL_CODE
+    parts. The strings are stored right after the structure. Once inserted into the cache,
+    the entry is never modified, so it can be read without any synchronization. */
+typedef struct _DEVICE_CONTROL_CACHE_ENTRY {
+   /** The IOCTL code. */
+   ULONG Code;
+   /** The CTL_CODE expression of the code. */
+   PWCHAR Name;
+   /** Human-readable description of the code parts. */
+   PWCHAR Description;
+   /** UTF-8 form of the Name string. */
+   UTF8_STRING NameUTF8;
+   /** UTF-8 form of the Description string. */
+   UTF8_STRING DescriptionUTF8;
+} DEVICE_CONTROL_CACHE_ENTRY, *PDEVICE_CONTROL_CACHE_ENTRY;
 
 
 /************************************************************************/
 /*                  GLOBAL VARIABLES                                    */
 /************************************************************************/
 
+/** UTF-8 forms of names of system constants, indexed by ELibTranslateIntegerValueType
+    (ltivtDeviceControl is the last type). */
+static UTF8_ARRAY _gvUtf8Names[ltivtDeviceControl + 1];
+/** UTF-8 forms of descriptions of system constants, indexed by ELibTranslateIntegerValueType.
+    Descriptions of NTSTATUS values and Windows error codes are converted on demand. */
+static UTF8_ARRAY _gvUtf8Descriptions[ltivtDeviceControl + 1];
+/** UTF-8 forms of system enumeration strings, indexed by ELibTranslateEnumerationType
+    (ltetIRPSystemMinorFunction is the last type) and by the Description flag. */
+static UTF8_ARRAY _enumUtf8Strings[ltetIRPSystemMinorFunction + 1][2];
+/** UTF-8 forms of names and descriptions of bit mask values, indexed by ELibTranslateBitMaskType
+    (ltbtIRPPagingReadWrite is the last type) and by the Description flag. */
+static UTF8_ARRAY _bitMaskUtf8Strings[ltbtIRPPagingReadWrite + 1][2];
+/** UTF-8 form of the L"Unknown" string. */
+static PCHAR _unknownUTF8 = "Unknown";
+/** Recently converted bit mask values. */
+static BITMASK_CACHE_ENTRY _bitMaskCache[BITMASK_CACHE_SIZE];
+/** Separates names (descriptions) of individual bits in bit mask strings. */
+static PWCHAR _bitMaskDelimiter = L", ";
+/** UTF-8 form of the bit mask string delimiter. */
+static PCHAR _bitMaskDelimiterUTF8 = ", ";
+/** Length of the bit mask string delimiter, in characters. */
+static SIZE_T _bitMaskDelimiterLength = 0;
+/** Length of the L"Unknown" string, in characters. */
+static SIZE_T _unknownLength = 0;
 /** Stores string representations of Windows Event Hook values. */
-static PHASH_TABLE htWinEventHookTable = NULL;
+static GENERAL_VALUE_TABLE htWinEventHookTable = GENERAL_VALUE_TABLE_INIT(_winEventHooks);
 /** Stores descriptions and string representations of Windows error codes. */
-static PHASH_TABLE winErrorTable = NULL;
+static GENERAL_VALUE_TABLE winErrorTable = GENERAL_VALUE_TABLE_INIT(_windowsError);
 /** Stores descriptions nad string representations of NTSTATUS values. */
-static PHASH_TABLE ntStatusTable = NULL;
+static GENERAL_VALUE_TABLE ntStatusTable = GENERAL_VALUE_TABLE_INIT(_ntstatus);
 /** Stores string representations of known Windows message codes. */
-static PHASH_TABLE windowsMessagesTable = NULL;
+static GENERAL_VALUE_TABLE windowsMessagesTable = GENERAL_VALUE_TABLE_INIT(_windowsMessages);
 /** Stores network port services for the SCTP protocol. */
-static PHASH_TABLE sctpPortTable = NULL;
+static GENERAL_VALUE_TABLE sctpPortTable = GENERAL_VALUE_TABLE_INIT(_sctpPort);
 /** Stores network port services for the DCCP protocol. */
-static PHASH_TABLE dccpPortTable = NULL;
+static GENERAL_VALUE_TABLE dccpPortTable = GENERAL_VALUE_TABLE_INIT(_dccpPort);
 /** Stores network port services for the TCP protocol. */
-static PHASH_TABLE tcpPortTable = NULL;
+static GENERAL_VALUE_TABLE tcpPortTable = GENERAL_VALUE_TABLE_INIT(_tcpPort);
 /** Stores network port services for the UDP protocol. */
-static PHASH_TABLE udpPortTable = NULL;
+static GENERAL_VALUE_TABLE udpPortTable = GENERAL_VALUE_TABLE_INIT(_udpPort);
 /** Stores string representations of IRP_MJ_XXX constants (IRP types). */
-static PHASH_TABLE irpMajorFunctionTable = NULL;
+static GENERAL_VALUE_TABLE irpMajorFunctionTable = GENERAL_VALUE_TABLE_INIT(_irpMajorFunction);
 /** Stores string representations of volume types. */
-static PHASH_TABLE volumeDeviceTypeTable = NULL;
+static GENERAL_VALUE_TABLE volumeDeviceTypeTable = GENERAL_VALUE_TABLE_INIT(_volumeDeviceType);
 /** Stores string representations of Windows Hook types (WH_XXX contants).*/
-static PHASH_TABLE windowsHookTable = NULL;
+static GENERAL_VALUE_TABLE windowsHookTable = GENERAL_VALUE_TABLE_INIT(_WindowsHook);
 /** Maps Windows errors to NTSTATUS codes. */
 static PHASH_TABLE _ErrorToNTSTATUSTable = NULL;
 /** Maps NTSTATUS codes to Windows errors. */
 static PHASH_TABLE _NTSTATUSToErrorTable = NULL;
 /** Maps IOCTL codes to IOCTL_XXX string constants. */
-static PHASH_TABLE _ioControlCodeTable = NULL;
+static GENERAL_VALUE_TABLE _ioControlCodeTable = GENERAL_VALUE_TABLE_INIT(_ioControlCodes);
+/** Maps device types of IOCTL codes to FILE_DEVICE_XXX string constants. */
+static GENERAL_VALUE_TABLE _deviceTypeTable = GENERAL_VALUE_TABLE_INIT(_deviceType);
+/** Cache of decoded IOCTL codes not present in the IOCTL table. An open-addressing
+    table whose slots are filled by interlocked compare-exchange and never emptied
+    until the library is finalized. */
+static PDEVICE_CONTROL_CACHE_ENTRY volatile _deviceControlCache[DEVICE_CONTROL_CACHE_SIZE];
 
 /************************************************************************/
 /*                    HELPER ROUTINES                                   */
 /************************************************************************/
 
 
+/** Retrieves the General Value Table translating a given type of system constants.
+ *
+ *  @param Type Type of the constants.
+ *
+ *  @return
+ *  Returns address of the table, or NULL if the type is not supported.
+ */
+static PGENERAL_VALUE_TABLE _IntegerValueTypeToTable(ELibTranslateIntegerValueType Type)
+{
+   PGENERAL_VALUE_TABLE table = NULL;
+
+   switch (Type) {
+      case ltivtNTSTATUS:
+         table = &ntStatusTable;
+         break;
+
+      case ltivtFileIRPMajorFunction:
+         table = &irpMajorFunctionTable;
+         break;
+      case ltivtVolumeDeviceType:
+         table = &volumeDeviceTypeTable;
+         break;
+
+      case ltivtSCTPPort:
+         table = &sctpPortTable;
+         break;
+      case ltivtTCPPort:
+         table = &tcpPortTable;
+         break;
+      case ltivtUDPPort:
+         table = &udpPortTable;
+         break;
+      case ltivtDCCPPort:
+         table = &dccpPortTable;
+         break;
+
+      case ltivtWindowsHook:
+         table = &windowsHookTable;
+         break;
+
+      case ltivtWindowsError:
+         table = &winErrorTable;
+         break;
+
+	  case ltivtDeviceControl:
+		  table = &_ioControlCodeTable;
+		  break;
+      default:
+         break;
+   }
+
+   return table;
+}
+
+#ifndef _WIN32
+
+/** Without ntdll.dll, no NTSTATUS value has a known Windows error code and
+ *  the mapping stays empty. */
+static ULONG WINAPI _NoNtStatusToDosError(NTSTATUS Status)
+{
+   return ERROR_MR_MID_NOT_FOUND;
+}
+
+#endif
+
 static DWORD _CreateWindowsErrorToNTSTATUSMapping(VOID)
 {
    ULONG i = 0;
@@ -90,7 +218,11 @@ static DWORD _CreateWindowsErrorToNTSTATUSMapping(VOID)
    RTLNTSTATUSTODOSERROR *_RtlNtStatusToDosError = NULL;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
+#ifdef _WIN32
    _RtlNtStatusToDosError = (RTLNTSTATUSTODOSERROR *)GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlNtStatusToDosError");
+#else
+   _RtlNtStatusToDosError = _NoNtStatusToDosError;
+#endif
    if (_RtlNtStatusToDosError != NULL) {
       ret = P2PHashTableCreate(37, &_ErrorToNTSTATUSTable);
       if (ret == ERROR_SUCCESS) {
@@ -109,6 +241,13 @@ static DWORD _CreateWindowsErrorToNTSTATUSMapping(VOID)
                }
             }
          
+            if (ret == ERROR_SUCCESS) {
+               // The tables are never modified from now on. Lookups stop taking
+               // locks (or keep taking them if there is not enough memory to freeze).
+               P2PHashTableFreeze(_ErrorToNTSTATUSTable);
+               P2PHashTableFreeze(_NTSTATUSToErrorTable);
+            }
+
             if (ret != ERROR_SUCCESS)
                P2PHashTableDestroy(_NTSTATUSToErrorTable);
          }
@@ -132,412 +271,500 @@ static VOID _FreeWindowsErrorToNTSTATUSMapping(VOID)
    return;
 }
 
-/** Attempts to generate human-readable descriptions for all Windows error
- *  codes.
+/** Marks NTSTATUS values and Windows error codes whose description has been looked
+    up with no result (or with an empty one). Distinguished from the initial empty
+    descriptions by its address, so the lookup is never repeated. */
+static WCHAR _noDescription[1] = L"";
+
+/** Retrieves description of a given NTSTATUS value or Windows error code.
+ *
+ *  @param Type Determines whether the Table parameter holds NTSTATUS values
+ *  (ltivtNTSTATUS), or Windows error codes (ltivtWindowsError).
+ *  @param Table The General Value Table.
+ *  @param Record The General Value Table record of the value.
  *
  *  @return
- *  Returns ELibrary error value indicating success or failure of the
- *  operation.
+ *  Returns the description. NTSTATUS values without description are described as
+ *  "N / A", Windows error codes get an empty string.
+ *
+ *  @remark
+ *  The descriptions are looked up on the first request and memoized in the Description
+ *  member of the @link(GENERAL_VALUE) structure of the record (the string pool holds
+ *  just the initial empty descriptions). Threads racing for the same item may all look the description up,
+ *  however, only one of the results is published via an interlocked compare-exchange and
+ *  the others are freed. Published descriptions are never modified until
+ *  @link(_FreeDescriptions) is called.
  */
-static DWORD _CreateWindowsErrorDescriptions(VOID)
+static PWCHAR _GetDescription(ELibTranslateIntegerValueType Type, PGENERAL_VALUE_TABLE Table, PGENERAL_VALUE_RECORD Record)
 {
-   DWORD len = 0;
-   ULONG i = 0;
-   ULONG j = 0;
-   PWCHAR buffer = NULL;
-   DWORD formatMessageFlags = FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS | FORMAT_MESSAGE_ARGUMENT_ARRAY | FORMAT_MESSAGE_ALLOCATE_BUFFER;
-   DWORD ret = ERROR_GEN_FAILURE;
-   DEBUG_ENTER_FUNCTION_NO_ARGS();
-
-   ret = ERROR_SUCCESS;
-   for (i = 0; i < sizeof(_windowsError) / sizeof(GENERAL_VALUE); ++i) {
-      len = FormatMessageW(formatMessageFlags, NULL, _windowsError[i].Value, 0, (LPWSTR)&buffer, 0, NULL);
-      if (len > 0) {
-         _windowsError[i].Description = buffer;
-         buffer = NULL;
-         len = 0;
-      } else {
-         if (GetLastError() != ERROR_MR_MID_NOT_FOUND) {
-            DEBUG_PRINT_LOCATION("Error (%S:%u) has no description (GetLastError=%u)", _windowsError[i].Name, _windowsError[i].Value, GetLastError());
-            ret = ERROR_NOT_ENOUGH_MEMORY;
-         }
-      }
-
-      if (ret != ERROR_SUCCESS) {
-         // Something got wrong. Rollback.
-         for (j = 0; j < i; ++j) {
-            LocalFree(_windowsError[j].Description);
-         }
-
-         break;
+   PWCHAR tmp = NULL;
+   PWCHAR desc = NULL;
+   PWCHAR ret = NULL;
+   PGENERAL_VALUE item = Table->Items + GVTableIndex(Table, Record);
+   DEBUG_ENTER_FUNCTION("Type=%u; Table=0x%p; Record=0x%p", Type, Table, Record);
+
+   ret = *(PWCHAR volatile *)&item->Description;
+   if (*ret == L'\0' && ret != _noDescription) {
+      desc = DescriptionGet(Type, item->Value);
+      if (desc == NULL)
+         desc = (Type == ltivtNTSTATUS) ? notAssociated : _noDescription;
+
+      tmp = (PWCHAR)InterlockedCompareExchangePointer((PVOID volatile *)&item->Description, desc, ret);
+      if (tmp == ret)
+         ret = desc;
+      else {
+         // Another thread has been faster.
+         if (desc != notAssociated && desc != _noDescription)
+            DescriptionFree(desc);
+
+         ret = tmp;
       }
    }
 
-   DEBUG_EXIT_FUNCTION("%u", ret);
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
    return ret;
 }
 
-/** Deallocates memory used to hold human-readable descriptions for Windows error
- *  codes. The routine is an opposite for @link(_CreateWindowsErrorDescriptions).
+/** Releases descriptions memoized in a given General Value Table by
+ *  @link(_GetDescription).
+ *
+ *  @param Table The table, must hold either NTSTATUS values, or Windows error codes.
+ *
+ *  @remark
+ *  The routine must not be called concurrently with lookups of the descriptions.
  */
-static VOID _FreeWindowsErrorDescriptions(VOID)
+static VOID _FreeDescriptions(PGENERAL_VALUE_TABLE Table)
 {
    ULONG i = 0;
-   DEBUG_ENTER_FUNCTION_NO_ARGS();
+   PWCHAR desc = NULL;
+   DEBUG_ENTER_FUNCTION("Table=0x%p", Table);
 
-   for (i = 0; i < sizeof(_windowsError) / sizeof(GENERAL_VALUE); ++i) {
-      if (*(_windowsError[i].Description) != L'\0') {
-         LocalFree(_windowsError[i].Description);
-         _windowsError[i].Description = L"";
-      }
+   for (i = 0; i < Table->Count; ++i) {
+      desc = Table->Items[i].Description;
+      if (*desc != L'\0' && desc != notAssociated)
+         DescriptionFree(desc);
+
+      Table->Items[i].Description = L"";
    }
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
-/** Attempts to add human-readable description for all NTSTATUS values.
+/** Appends a string to a buffer if it fits there.
  *
- *  The routine uses RtlNtStatusToDosError to convert the NTSTATUS value to
- *  associated Win32 error code. Then, it uses FormatMessage function to get 
- *  description for that code.
- *
- *  @return
- *  Returns TRUE on success and FALSE otherwise.
+ *  @param Buffer The buffer.
+ *  @param BufferLength Length of the buffer, in characters.
+ *  @param Position Position in the buffer where the string should be appended. Advanced
+ *  by the string length even if the string does not fit, so it always reflects length of
+ *  the whole result.
+ *  @param String The string to append.
+ *  @param StringLength Length of the string, in characters.
  */
-static DWORD _CreateNTSTATUSDescriptions(VOID)
+static VOID _BufferAppend(PWCHAR Buffer, SIZE_T BufferLength, PSIZE_T Position, PWCHAR String, SIZE_T StringLength)
 {
-   ULONG i = 0;
-   ULONG j = 0;
-   DWORD ret = ERROR_GEN_FAILURE;
-   PWCHAR buffer = NULL;
-   DWORD len = 0;
-   DWORD errCode = 0;
-   SIZE_T notAssociatedLen = wcslen(notAssociated) * sizeof(WCHAR);
-   RTLNTSTATUSTODOSERROR *_RtlNtStatusToDosError = NULL;
-   DWORD formatMessageFlags = FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS | FORMAT_MESSAGE_ARGUMENT_ARRAY | FORMAT_MESSAGE_ALLOCATE_BUFFER;
-   DEBUG_ENTER_FUNCTION_NO_ARGS();
-
-   // RtlNtStatusToDosErrror is a part of any SDK library. It is probably a part of
-   // ntdll.lib provided with WDK. So, it must be found manually.
-   // The GetModuleHandleW call always succeeds because ntdll.dll is always present.
-   _RtlNtStatusToDosError = (RTLNTSTATUSTODOSERROR *)GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlNtStatusToDosError");
-   if (_RtlNtStatusToDosError != NULL) {
-      ret = ERROR_SUCCESS;
-      // Go through all NTSTATUS values...
-      for (i = 0; i < sizeof(_ntstatus) / sizeof(GENERAL_VALUE); ++i) {
-         errCode = _RtlNtStatusToDosError(_ntstatus[i].Value);
-		   // For some NTSTATUS values, the RtlNtStatusToDosError routine
-		   // seems to return NTSTATUS value itself. Example of such value
-		   // is 0xC000001d. However, keep in mind that STATUS_SUCCESS, which is
-         // a constant of zero, translates to ERROR_SUCCESS, which is also a
-         // zero constant, hence there must be an exception for such value
-         // (hope there is not more of them).
-		   if (errCode == 0 || (errCode != ERROR_MR_MID_NOT_FOUND && errCode != _ntstatus[i].Value)) {
-			   len = FormatMessageW(formatMessageFlags, NULL, errCode, 0, (LPWSTR)&buffer, 0, NULL);
-			   if (len > 0) {
-				   _ntstatus[i].Description = buffer;
-				   buffer = NULL;
-				   len = 0;
-			   } else {
-               ret = ERROR_NOT_ENOUGH_MEMORY;
-            }
-		   } else {
-            // No associated Win32 error code found. Fill the desciption with
-            // a string for such situations.
-            buffer = (PWCHAR)LocalAlloc(LMEM_ZEROINIT, notAssociatedLen + sizeof(WCHAR));
-            if (buffer != NULL) {
-               CopyMemory(buffer, notAssociated, notAssociatedLen);
-               _ntstatus[i].Description = buffer;
-            } else {
-               ret = ERROR_NOT_ENOUGH_MEMORY;
-            }
-         }
-
-         if (ret != ERROR_SUCCESS) {
-            // Something got wrong. Rollback.
-            for (j = 0; j < i; ++j) {
-               LocalFree(_ntstatus[j].Description);
-            }
-
-            break;
-         }
-      }
-   } else {
-      ret = GetLastError();
-   }
-
-   DEBUG_EXIT_FUNCTION("%u", ret);
-   return ret;
-}
+   if (*Position + StringLength <= BufferLength)
+      CopyMemory(Buffer + *Position, String, StringLength * sizeof(WCHAR));
 
-/** Deallocates memory used to hold human-readable descriptions for NTSTATUS
- *  values. The routine is an opposite for @link(_CreateNTSTATUSDescriptions).
- */
-static VOID _FreeNTSTATUSDescriptions(VOID)
-{
-   ULONG i = 0;
-   DEBUG_ENTER_FUNCTION_NO_ARGS();
-      
-   for (i = 0; i < sizeof(_ntstatus) / sizeof(GENERAL_VALUE); ++i) {
-		LocalFree(_ntstatus[i].Description);
-		_ntstatus[i].Description = L"";
-   }
+   *Position += StringLength;
 
-   DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
 /** Converts a given bit mask value to a string containing either names for the
- *  nonzero bits, or human-readable descriptions for them.
+ *  nonzero bits, or human-readable descriptions for them, and stores it in a given
+ *  buffer.
  *
  *  @param Value Value to convert.
  *  @param Description Determines whether the routine should produce names of the nonzero
  *  bits (FALSE value) or their human-readable descriptions (TRUE value).
  *  @param BitmaskArray An array of @link(BITMASK_VALUE) structures, each describes
- *  meaning of one bit of the mask, or a group of its bits.
+ *  meaning of one bit of the mask, or a group of its bits. The array must have been
+ *  prepared by @link(_BitMaskArrayPrepare).
  *  @param BitmaskArrayLength Number of entries in the array passed in the third argument.
- *  @param Delimiter A string that is used as a delimiter between names (or descriptions) of
- *  nonzero bits.
- *  @param UnknownString A string that is concatenated to the conversion result if the mask
- *  contains a nonzero bit (or bits) that has no name is description in the BitmaskArray array.
- *  The string is followed by a " (0xX)" suffix where X is a hexadecimal number containing all
- *  such bit values.
+ *  @param Buffer The buffer to receive the null-terminated result.
+ *  @param BufferLength Length of the buffer, in characters.
  *
  *  @return
- *  If the given value contains no nonzero bits, the routine returns an empty string (pointer to a
- *  null character).
- *
- *  If the given value contains nonzero bits, the routine returns a string containing names of that
- *  bits (or their descriptions) separated by a string given in the Delimiter argument. 
- *
- *  The routine returns NULL in case of failure due to insufficient amount of free memory. The routine
- *  cannot fail for any other reason.
+ *  Returns length of the result, in characters, including the terminating null character.
+ *  If the value is greater than BufferLength, the buffer is too small and its content is
+ *  undefined.
  *
  *  @remark
- *  If the given value contains nonzero bits and the routine succeeds (returns non-NULL value), the
- *  returned string must be freed by a call to @link(_BitMaskStringValueFree) procedure. Otherwise
- *  (even in the zero-value case) no countermeasure is needed.
+ *  Names (descriptions) of nonzero bits are separated by L", ". If the mask contains a nonzero
+ *  bit (or bits) that has no name in the BitmaskArray array, L"Unknown (0xX)" is appended to
+ *  the result, X being a hexadecimal number containing all such bits. If no bits have names,
+ *  the result is just L"Unknown". A zero value is converted to an empty string.
+ *
+ *  The array is traversed only once and lengths of names and descriptions are taken
+ *  from the array. No memory is allocated.
  */
-static PWCHAR _BitMaskValueToString(ULONG Value, BOOLEAN Description, PBITMASK_VALUE BitmaskArray, ULONG BitmaskArrayLength, PWCHAR Delimiter, PWCHAR UnknownString)
+static SIZE_T _BitMaskValueToBuffer(ULONG Value, BOOLEAN Description, PBITMASK_VALUE BitmaskArray, ULONG BitmaskArrayLength, PWCHAR Buffer, SIZE_T BufferLength)
 {
    ULONG i = 0;
-   PWCHAR ret = NULL;
-   ULONG tmpValue = Value;
-   ULONG MatchedCombined = 0;
-   SIZE_T stringLength = 0;
-   SIZE_T delimiterLength = 0;
-   SIZE_T unknownStringLength = 0;
-   ULONG LastCombinedIndex = BitmaskArrayLength - 1;
-   DEBUG_ENTER_FUNCTION("Value=0x%x; Description=%u; BitmaskArray=0x%p; BitmaskArrayLength=%u; Delimiter=\"%S\"; UnknownString=\"%S\"", Value, Description, BitmaskArray, BitmaskArrayLength, Delimiter, UnknownString);
-
-/////////////////////////////////////////////////////////////////////////////////
-// At first, compute length of the result, so we can allocate the whole buffer 
-// by one call.
-
-   delimiterLength = wcslen(Delimiter);
+   SIZE_T pos = 0;
+   int suffixLength = 0;
+   WCHAR suffix[sizeof(L" (0x00000000)") / sizeof(WCHAR)];
+   ULONG matchedCombined = 0;
+   PBITMASK_VALUE bv = NULL;
+   DEBUG_ENTER_FUNCTION("Value=0x%x; Description=%u; BitmaskArray=0x%p; BitmaskArrayLength=%u; Buffer=0x%p; BufferLength=%Iu", Value, Description, BitmaskArray, BitmaskArrayLength, Buffer, BufferLength);
 
    // Go through the names (or descriptions) of bit groups. They will be only
-   // on the beginning of the array. 
-   unknownStringLength = wcslen(UnknownString); 
-   for (i = 0; i < BitmaskArrayLength; ++i) {
-      if (!BitmaskArray[i].Combined) {
-         LastCombinedIndex = i - 1;
-         break;
-      }
-
-      // If the value fully contains the bit group, the name (description) wil be
-      // stored in the resulting buffer. 
-      if ((tmpValue & BitmaskArray[i].Value) == BitmaskArray[i].Value) {
-         MatchedCombined |= BitmaskArray[i].Value;
-         stringLength += ( Description ? 
-            wcslen(BitmaskArray[i].Description) :
-            wcslen(BitmaskArray[i].Name)) + delimiterLength;
+   // on the beginning of the array. If the value fully contains the bit group,
+   // the name (description) is stored in the buffer.
+   for (i = 0; i < BitmaskArrayLength && BitmaskArray[i].Combined; ++i) {
+      bv = BitmaskArray + i;
+      if ((Value & bv->Value) == bv->Value) {
+         matchedCombined |= bv->Value;
+         if (pos > 0)
+            _BufferAppend(Buffer, BufferLength, &pos, _bitMaskDelimiter, _bitMaskDelimiterLength);
+
+         if (Description)
+            _BufferAppend(Buffer, BufferLength, &pos, bv->Description, bv->DescriptionLength);
+         else _BufferAppend(Buffer, BufferLength, &pos, bv->Name, bv->NameLength);
       }
    }
 
-   // Remove nonzero bits consumed by bit groups
-   tmpValue &= ~(MatchedCombined);
+   // Remove nonzero bits consumed by bit groups and go through
+   // names (descriptions) of single bits.
+   Value &= ~(matchedCombined);
+   for (; i < BitmaskArrayLength; ++i) {
+      bv = BitmaskArray + i;
+      if ((Value & bv->Value) == bv->Value) {
+         if (pos > 0)
+            _BufferAppend(Buffer, BufferLength, &pos, _bitMaskDelimiter, _bitMaskDelimiterLength);
 
-   // Go through names (descritpions) for single bits
-   for (i = LastCombinedIndex + 1; i < BitmaskArrayLength; ++i) {
-      if ((tmpValue & BitmaskArray[i].Value) == BitmaskArray[i].Value) {
-         stringLength += (Description ?
-            wcslen(BitmaskArray[i].Description) :
-            wcslen(BitmaskArray[i].Name)) + delimiterLength;
-         tmpValue &= ~(BitmaskArray[i].Value);
+         if (Description)
+            _BufferAppend(Buffer, BufferLength, &pos, bv->Description, bv->DescriptionLength);
+         else _BufferAppend(Buffer, BufferLength, &pos, bv->Name, bv->NameLength);
+
+         Value &= ~(bv->Value);
       }
    }
 
    // If the value still contains nonzero bits, that bits have no name (description).
-   // Enlarge the buffer size in order to hold the sufix.
-   if (tmpValue != 0) {
-      stringLength += unknownStringLength + wcslen(L" (0x00000000)") + delimiterLength;
+   if (Value != 0) {
+      if (pos > 0) {
+         _BufferAppend(Buffer, BufferLength, &pos, _bitMaskDelimiter, _bitMaskDelimiterLength);
+         _BufferAppend(Buffer, BufferLength, &pos, unknown, _unknownLength);
+         suffixLength = swprintf(suffix, sizeof(suffix) / sizeof(WCHAR), L" (0x%X)", Value);
+         _BufferAppend(Buffer, BufferLength, &pos, suffix, suffixLength);
+      } else _BufferAppend(Buffer, BufferLength, &pos, unknown, _unknownLength);
    }
 
-//////////////////////////////////////////////////////////////////////////////////
+   if (pos < BufferLength)
+      Buffer[pos] = L'\0';
 
-   if (stringLength > 0) {
-      stringLength *= sizeof(WCHAR);
-      ret = (PWCHAR)HeapMemoryAlloc(stringLength + sizeof(WCHAR));
-      if (ret != NULL) {
-//////////////////////////////////////////////////////////////////////////////////////////
-         // Now, copy the data to the allocated resulting buffer.
-         PWCHAR currentPosition = ret;
-
-         MatchedCombined = 0;
-         LastCombinedIndex = BitmaskArrayLength - 1;
-         // Go through the bit groups
-         for (i = 0; i < BitmaskArrayLength; ++i) {
-            if (!BitmaskArray[i].Combined) {
-               LastCombinedIndex = i - 1;
-               break;
-            }
+   ++pos;
 
-            if ((Value & BitmaskArray[i].Value) == BitmaskArray[i].Value) {
-               SIZE_T memberLen = Description ? wcslen(BitmaskArray[i].Description) : wcslen(BitmaskArray[i].Name);
-               PWCHAR text = Description ? BitmaskArray[i].Description : BitmaskArray[i].Name;
+   DEBUG_EXIT_FUNCTION("%Iu", pos);
+   return pos;
+}
 
-               MatchedCombined |= BitmaskArray[i].Value;
-               CopyMemory(currentPosition, text, memberLen * sizeof(WCHAR));
-               currentPosition += memberLen;
-               CopyMemory(currentPosition, Delimiter, delimiterLength * sizeof(WCHAR));
-               currentPosition += delimiterLength;
-            }
-         }
+/** Appends an UTF-8 string to a buffer, if there is enough room for it.
+ *
+ *  @param Buffer The buffer.
+ *  @param BufferLength Size of the buffer, in bytes.
+ *  @param Position Address of variable holding the current position in the buffer.
+ *  The position is advanced by length of the string even if it does not fit,
+ *  so it ends up equal to the length of the whole result.
+ *  @param String The string to append.
+ *  @param StringLength Length of the string, in bytes.
+ */
+static VOID _BufferAppendUTF8(PCHAR Buffer, SIZE_T BufferLength, PSIZE_T Position, const CHAR *String, SIZE_T StringLength)
+{
+   if (*Position + StringLength <= BufferLength)
+      CopyMemory(Buffer + *Position, String, StringLength);
 
-         // Remove bits consumed by bit groups
-         Value &= ~(MatchedCombined);
-
-         // Go through the remaining single bits
-         for (i = LastCombinedIndex + 1; i < BitmaskArrayLength; ++i) {
-            if ((Value & BitmaskArray[i].Value) == BitmaskArray[i].Value) {
-               SIZE_T memberLen =  Description ? wcslen(BitmaskArray[i].Description) : wcslen(BitmaskArray[i].Name);
-               PWCHAR text = Description ? BitmaskArray[i].Description : BitmaskArray[i].Name;
-               
-               CopyMemory(currentPosition, text, memberLen * sizeof(WCHAR));
-               currentPosition += memberLen;
-               CopyMemory(currentPosition, Delimiter, delimiterLength * sizeof(WCHAR));
-               currentPosition += delimiterLength;
-               Value &= ~(BitmaskArray[i].Value);
-            }
-         }
+   *Position += StringLength;
 
-         // If there are unknown nonzero bits, add the suffix. 
-         if (Value != 0) {
-            CopyMemory(currentPosition, UnknownString, unknownStringLength * sizeof(WCHAR));
-            currentPosition += unknownStringLength;
-            swprintf(currentPosition, wcslen(L" (0x00000000)"), L" (0x%X)%ls", Value, Delimiter);
-            currentPosition += wcslen(currentPosition);
-         }
-         
-         currentPosition -= delimiterLength;
-         *currentPosition = L'\0';
-//////////////////////////////////////////////////////////////////////////////////
+   return;
+}
+
+/** Converts a given bit mask value to an UTF-8 string containing either names for the
+ *  nonzero bits, or human-readable descriptions for them, and stores it in a given
+ *  buffer.
+ *
+ *  @param Value Value to convert.
+ *  @param BitmaskArray An array of @link(BITMASK_VALUE) structures, each describes
+ *  meaning of one bit of the mask, or a group of its bits.
+ *  @param BitmaskArrayLength Number of entries in the array passed in the second argument.
+ *  @param Strings UTF-8 forms of names (or descriptions) of the array entries.
+ *  @param Buffer The buffer to receive the null-terminated result.
+ *  @param BufferLength Size of the buffer, in bytes.
+ *
+ *  @return
+ *  Returns size of the result, in bytes, including the terminating null character.
+ *  If the value is greater than BufferLength, the buffer is too small and its content is
+ *  undefined.
+ *
+ *  @remark
+ *  The result is the UTF-8 form of the one produced by @link(_BitMaskValueToBuffer).
+ *  It is built directly from the UTF-8 strings, so nothing is converted per call.
+ *  The delimiter and the L"Unknown" string are ASCII, so their lengths in characters
+ *  are their UTF-8 lengths as well.
+ */
+static SIZE_T _BitMaskValueToBufferUTF8(ULONG Value, PBITMASK_VALUE BitmaskArray, ULONG BitmaskArrayLength, PUTF8_STRING Strings, PCHAR Buffer, SIZE_T BufferLength)
+{
+   ULONG i = 0;
+   SIZE_T pos = 0;
+   int suffixLength = 0;
+   CHAR suffix[sizeof(" (0x00000000)")];
+   ULONG matchedCombined = 0;
+   DEBUG_ENTER_FUNCTION("Value=0x%x; BitmaskArray=0x%p; BitmaskArrayLength=%u; Strings=0x%p; Buffer=0x%p; BufferLength=%Iu", Value, BitmaskArray, BitmaskArrayLength, Strings, Buffer, BufferLength);
+
+   for (i = 0; i < BitmaskArrayLength && BitmaskArray[i].Combined; ++i) {
+      if ((Value & BitmaskArray[i].Value) == BitmaskArray[i].Value) {
+         matchedCombined |= BitmaskArray[i].Value;
+         if (pos > 0)
+            _BufferAppendUTF8(Buffer, BufferLength, &pos, _bitMaskDelimiterUTF8, _bitMaskDelimiterLength);
+
+         _BufferAppendUTF8(Buffer, BufferLength, &pos, Strings[i].Buffer, Strings[i].Length);
       }
-   } else {
-      // Well, not named bits were found for given bit mask value. There are two
-      // possible explanations for such situation:
-      // 1) The bit mask value is zero. In that case, we return an empty string.
-      // because this is the only situation we do this, we do not allocate and
-      // the deallocation function counts on it.
-      // 2) The bit mask value is not zero but their set bits does not match
-      // any named ones. In such a case, we allocate and return a string meaning
-      // that the value is unknown to us.
-      if (Value != 0) {
-	      ret = (PWCHAR)HeapMemoryAlloc((unknownStringLength + 1) * sizeof(WCHAR));
-         if (ret != NULL) {
-            CopyMemory(ret, UnknownString, unknownStringLength * sizeof(WCHAR));
-            ret[unknownStringLength] = L'\0';
-         }
-      } else {
-         ret = L"";
+   }
+
+   Value &= ~(matchedCombined);
+   for (; i < BitmaskArrayLength; ++i) {
+      if ((Value & BitmaskArray[i].Value) == BitmaskArray[i].Value) {
+         if (pos > 0)
+            _BufferAppendUTF8(Buffer, BufferLength, &pos, _bitMaskDelimiterUTF8, _bitMaskDelimiterLength);
+
+         _BufferAppendUTF8(Buffer, BufferLength, &pos, Strings[i].Buffer, Strings[i].Length);
+         Value &= ~(BitmaskArray[i].Value);
       }
    }
 
-   DEBUG_EXIT_FUNCTION("\"%S\"", ret);
-   return ret;
+   if (Value != 0) {
+      if (pos > 0) {
+         _BufferAppendUTF8(Buffer, BufferLength, &pos, _bitMaskDelimiterUTF8, _bitMaskDelimiterLength);
+         _BufferAppendUTF8(Buffer, BufferLength, &pos, _unknownUTF8, _unknownLength);
+         suffixLength = sprintf_s(suffix, sizeof(suffix), " (0x%X)", Value);
+         _BufferAppendUTF8(Buffer, BufferLength, &pos, suffix, suffixLength);
+      } else _BufferAppendUTF8(Buffer, BufferLength, &pos, _unknownUTF8, _unknownLength);
+   }
+
+   if (pos < BufferLength)
+      Buffer[pos] = '\0';
+
+   ++pos;
+
+   DEBUG_EXIT_FUNCTION("%Iu", pos);
+   return pos;
 }
 
-/** Frees a string returned by the @link(_BitMaskValueToString) function.
+/** Computes lengths of names and descriptions stored in a given array of
+ *  @link(BITMASK_VALUE) structures.
  *
- *  @param Value Address of a string to free.
+ *  @param BitmaskArray The array.
+ *  @param BitmaskArrayLength Number of entries in the array.
  */
-static VOID _BitMaskStringValueFree(PWCHAR Value)
+static VOID _BitMaskArrayPrepare(PBITMASK_VALUE BitmaskArray, ULONG BitmaskArrayLength)
 {
-   DEBUG_ENTER_FUNCTION("Value=\"%S\"", Value);
+   ULONG i = 0;
+   DEBUG_ENTER_FUNCTION("BitmaskArray=0x%p; BitmaskArrayLength=%u", BitmaskArray, BitmaskArrayLength);
 
-   // Do not deallocate an empty string. That strings means "the bit mask value
-   // is zero" and in such a case, the bit mask conversion function does not
-   // allocate the string it returns.
-   if (*Value != L'\0') {
-      HeapMemoryFree(Value);
+   for (i = 0; i < BitmaskArrayLength; ++i) {
+      BitmaskArray[i].NameLength = (ULONG)wcslen(BitmaskArray[i].Name);
+      BitmaskArray[i].DescriptionLength = (ULONG)wcslen(BitmaskArray[i].Description);
    }
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
 }
 
-/************************************************************************/
-/*                     PUBLIC ROUTINES                                  */
-/************************************************************************/
+/** Computes index of the bit mask string cache entry for a given bit mask value.
+ *
+ *  @param Type Type of the bit mask.
+ *  @param Description Determines whether the cache entry holds names, or descriptions.
+ *  @param Value The bit mask value.
+ *
+ *  @return
+ *  Returns index to the @link(_bitMaskCache) array.
+ */
+static ULONG _BitMaskCacheIndex(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value)
+{
+   ULONG32 h = 0;
 
-/** Converts a given system enumeration value to its string representation.
+   h = (Value ^ (((ULONG32)Type << 1) | (Description != FALSE))) * 0x9E3779B1;
+   h ^= (h >> 16);
+
+   return h % BITMASK_CACHE_SIZE;
+}
+
+/** Retrieves the array describing bits of a given bit mask type.
  *
- *  @param Type Type of the system enumeration value.
- *  @param Description Determines whether the routine will return a string representation
- *  of the given value (FALSE value), or a description that contains more information about
- *  its meaning (TRUE value).
- *  @param Value Value to convert.
+ *  @param Type Type of the bit mask.
+ *  @param Count Address of variable that receives number of entries in the array.
  *
  *  @return
- *  Returns either a string representation for the given value, or description of its meaning.
- *  Neither case requires to free the returned string. It is placed inside a read-only memory.
- *  If the user specifies an unknown type of system enumeration, or a value that is not present
- *  within the given system enumeration type, L"unknown" string is returned. Also this string needs
- *  not to be explicitly freed and it is also located in a read-only memory.
+ *  Returns address of the array, or NULL if the type is not supported.
  */
-PWCHAR EnumerationValueToString(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value)
+static PBITMASK_VALUE _BitMaskTypeToArray(ELibTranslateBitMaskType Type, PULONG Count)
 {
-   PWCHAR ret = unknown;
-   ULONG maxConstant = 0;
-   const PWCHAR *array = NULL;
-   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=%u", Type, Description, Value);
+   ULONG vLen = 0;
+   PBITMASK_VALUE v = NULL;
 
    switch (Type) {
-      case ltetRegistryValueType:
-         array = _registryValueTypes;
-         maxConstant = sizeof(_registryValueTypes);
-         break;
-      case ltetRegistryValueInformationClass:
-         array = _keyValueInformationClass;
-         maxConstant = sizeof(_keyValueInformationClass);
-         break;
-      case ltetRegistryKeyInformationClass:
-         array = _keyInformationClass;
-         maxConstant = sizeof(_keyInformationClass);
+      case ltbtProcessAccessRights:
+         v = _processAcessRights;
+         vLen = sizeof(_processAcessRights);
          break;
-      case ltetRegistryKeyCreateDisposition:
-         array = _registryKeyCreateDisposition;
-         maxConstant = sizeof(_registryKeyCreateDisposition);
+
+      case ltbtThreadAccessRights:
+         v = _threadAcessRights;
+         vLen = sizeof(_threadAcessRights);
          break;
 
-      case ltetFileInformationClass:
-         array = _fileInformationClass;
-         maxConstant = sizeof(_fileInformationClass);
+      case ltbtFileAttributes:
+         v = _fileAttributes;
+         vLen = sizeof(_fileAttributes);
          break;
-      case ltetFileVolumeInformationClass:
-         array = _fileVOlumeInformationClass;
-         maxConstant = sizeof(_fileVOlumeInformationClass);
+      case ltbtFileShareAccess:
+         v = _fileShareAccess;
+         vLen = sizeof(_fileShareAccess);
          break;
-      case ltetFileCreateDisposition:
-         array = (Description) ? _fileCreateDispositionDescription : _fileCreateDisposition;
-         maxConstant = Description ? sizeof(_fileCreateDispositionDescription) : sizeof(_fileCreateDisposition);
+      case ltbtFileCreateOptions:
+         v = _fileCreateOptions;
+         vLen = sizeof(_fileCreateOptions);
          break;
-
-      case ltetSectionSyncType:
-         array = _FSFilterSectionSyncType;
-         maxConstant = sizeof(_FSFilterSectionSyncType);
+      case ltbtFileAccessRights:
+         v = _fileAccessRights;
+         vLen = sizeof(_fileAccessRights);
+         break;
+      case ltbtFileIrpFlags:
+         v = _fileIrpFlags;
+         vLen = sizeof(_fileIrpFlags);
+         break;
+      case ltbtFileNotifyFilter:
+         v = _fileNotifyFilter;
+         vLen = sizeof(_fileNotifyFilter);
+         break;
+
+      case ltbtSectionPageProtection:
+         v = _sectionPageProtection;
+         vLen = sizeof(_sectionPageProtection);
+         break;
+      case ltbtSecurityInformationClass:
+         v = _securityInformationClass;
+         vLen = sizeof(_securityInformationClass);
+         break;
+
+      case ltbtRegistryKeyAccessRights:
+         v = _keyAccessRights;
+         vLen = sizeof(_keyAccessRights);
+         break;
+      case ltbtRegistryKeyCreateOptions:
+         v = _registryKeyCreateOptions;
+         vLen = sizeof(_registryKeyCreateOptions);
+         break;
+      case ltbtRegistryKeyRestoreFlags:
+         v = _registryRestoreFlags;
+         vLen = sizeof(_registryRestoreFlags);
+         break;
+      case ltbtRegistryKeyHiveFormat:
+         v = _registryHiveFormat;
+         vLen = sizeof(_registryHiveFormat);
+         break;
+	  case ltbtIRPReadMinorFunction:
+	  case ltbtIRPWriteMinorFunction:
+		  v = _irpReadWriteMinorFunction;
+		  vLen = sizeof(_irpReadWriteMinorFunction);
+		  break;
+
+	  case ltbtIRPReadWriteFlags:
+		  v = _irpReadWriteFlags;
+		  vLen = sizeof(_irpReadWriteFlags);
+		  break;
+	  case ltbtIRPCTLFlags:
+		  v = _irpCTLFlags;
+		  vLen = sizeof(_irpCTLFlags);
+		  break;
+	  case ltbtIRPOtherFlags:
+		  v = _irpOtherFlags;
+		  vLen = sizeof(_irpOtherFlags);
+		  break;
+	  case ltbtIRPPagingReadWrite:
+		  v = _irpPagingReadWriteFlags;
+		  vLen = sizeof(_irpPagingReadWriteFlags);
+		  break;
+      default:
+         break;
+   }
+
+   *Count = vLen / sizeof(BITMASK_VALUE);
+
+   return v;
+}
+
+/** Frees a string returned by the @link(BitMaskValueToString) function.
+ *
+ *  @param Value Address of a string to free.
+ */
+static VOID _BitMaskStringValueFree(PWCHAR Value)
+{
+   DEBUG_ENTER_FUNCTION("Value=\"%S\"", Value);
+
+   // Do not deallocate an empty string. That strings means "the bit mask value
+   // is zero" and in such a case, the bit mask conversion function does not
+   // allocate the string it returns.
+   if (*Value != L'\0') {
+      HeapMemoryFree(Value);
+   }
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/** Retrieves the array of string representations of a given system enumeration.
+ *
+ *  @param Type Type of the system enumeration.
+ *  @param Description Determines whether the array should contain names of the constants
+ *  (FALSE), or their descriptions (TRUE).
+ *  @param Count Address of variable that receives number of elements in the array.
+ *
+ *  @return
+ *  Returns address of the array, indexed by the enumeration values. If the enumeration
+ *  type is not supported, NULL is returned.
+ */
+static const PWCHAR *_EnumerationTypeToArray(ELibTranslateEnumerationType Type, BOOLEAN Description, PULONG Count)
+{
+   ULONG maxConstant = 0;
+   const PWCHAR *array = NULL;
+
+   switch (Type) {
+      case ltetRegistryValueType:
+         array = _registryValueTypes;
+         maxConstant = sizeof(_registryValueTypes);
+         break;
+      case ltetRegistryValueInformationClass:
+         array = _keyValueInformationClass;
+         maxConstant = sizeof(_keyValueInformationClass);
+         break;
+      case ltetRegistryKeyInformationClass:
+         array = _keyInformationClass;
+         maxConstant = sizeof(_keyInformationClass);
+         break;
+      case ltetRegistryKeyCreateDisposition:
+         array = _registryKeyCreateDisposition;
+         maxConstant = sizeof(_registryKeyCreateDisposition);
+         break;
+
+      case ltetFileInformationClass:
+         array = _fileInformationClass;
+         maxConstant = sizeof(_fileInformationClass);
+         break;
+      case ltetFileVolumeInformationClass:
+         array = _fileVOlumeInformationClass;
+         maxConstant = sizeof(_fileVOlumeInformationClass);
+         break;
+      case ltetFileCreateDisposition:
+         array = (Description) ? _fileCreateDispositionDescription : _fileCreateDisposition;
+         maxConstant = Description ? sizeof(_fileCreateDispositionDescription) : sizeof(_fileCreateDisposition);
+         break;
+
+      case ltetSectionSyncType:
+         array = _FSFilterSectionSyncType;
+         maxConstant = sizeof(_FSFilterSectionSyncType);
          break;
 
       case ltetVirtualKeyCode:
@@ -582,88 +809,786 @@ PWCHAR EnumerationValueToString(ELibTranslateEnumerationType Type, BOOLEAN Descr
          break;
    }
 
-   if (array != NULL) {
-      maxConstant /= sizeof(PWCHAR);
-      if (Value < maxConstant) {
-         ret = array[Value];
+   *Count = maxConstant / sizeof(PWCHAR);
+
+   return array;
+}
+
+/** Decodes a given IOCTL code into the parts of its CTL_CODE definition and creates
+ *  a cache entry with its string representation and description.
+ *
+ *  @param Code The IOCTL code.
+ *
+ *  @return
+ *  Returns address of the new entry, or NULL if there is not enough memory.
+ *
+ *  @remark
+ *  CTL_CODE places the device type to bits 16-31, required access to bits 14-15,
+ *  function number to bits 2-13 and the transfer type to bits 0-1. Device types
+ *  from 0x8000 and function numbers from 0x800 are reserved for vendors. FSCTL codes
+ *  use the FILE_DEVICE_FILE_SYSTEM device type.
+ */
+static PDEVICE_CONTROL_CACHE_ENTRY _DeviceControlEntryCreate(ULONG Code)
+{
+   int nameLen = 0;
+   int descriptionLen = 0;
+   ULONG deviceType = (Code >> 16);
+   ULONG access = (Code >> 14) & 0x3;
+   ULONG function = (Code >> 2) & 0xfff;
+   ULONG method = Code & 0x3;
+   PGENERAL_VALUE_RECORD dt = NULL;
+   WCHAR deviceTypeName[16];
+   WCHAR deviceTypeDescription[48];
+   WCHAR name[DEVICE_CONTROL_MAX_STRING];
+   WCHAR description[DEVICE_CONTROL_MAX_STRING];
+   PWCHAR typeName = deviceTypeName;
+   PWCHAR typeDescription = deviceTypeDescription;
+   SIZE_T entrySize = 0;
+   PCHAR strings = NULL;
+   PDEVICE_CONTROL_CACHE_ENTRY ret = NULL;
+   DEBUG_ENTER_FUNCTION("Code=0x%x", Code);
+
+   dt = GVTableGet(&_deviceTypeTable, deviceType);
+   if (dt != NULL) {
+      typeName = GVTableName(&_deviceTypeTable, dt);
+      typeDescription = GVTableDescription(&_deviceTypeTable, dt);
+   } else {
+      swprintf(deviceTypeName, sizeof(deviceTypeName) / sizeof(WCHAR), L"0x%X", deviceType);
+      swprintf(deviceTypeDescription, sizeof(deviceTypeDescription) / sizeof(WCHAR), (deviceType >= 0x8000) ? L"Vendor-defined device type 0x%X" : L"Device type 0x%X", deviceType);
+   }
+
+   nameLen = swprintf(name, sizeof(name) / sizeof(WCHAR), L"CTL_CODE(%s, 0x%X, %s, %s)", typeName, function, _ctlCodeMethod[method], _ctlCodeAccess[access]);
+   descriptionLen = swprintf(description, sizeof(description) / sizeof(WCHAR), L"%s, %sfunction 0x%X, %s, %s", typeDescription, (function >= 0x800) ? L"vendor-defined " : L"", function, _ctlCodeMethodDescription[method], _ctlCodeAccessDescription[access]);
+   if (nameLen >= 0 && descriptionLen >= 0) {
+      // The strings consist of ASCII characters only, so their UTF-8
+      // forms are of the same length.
+      entrySize = sizeof(DEVICE_CONTROL_CACHE_ENTRY) + (nameLen + descriptionLen + 2)*(sizeof(WCHAR) + sizeof(CHAR));
+      ret = (PDEVICE_CONTROL_CACHE_ENTRY)HeapMemoryAlloc(entrySize);
+      if (ret != NULL) {
+         ret->Code = Code;
+         ret->Name = (PWCHAR)(ret + 1);
+         memcpy(ret->Name, name, (nameLen + 1)*sizeof(WCHAR));
+         ret->Description = ret->Name + nameLen + 1;
+         memcpy(ret->Description, description, (descriptionLen + 1)*sizeof(WCHAR));
+         strings = (PCHAR)(ret->Description + descriptionLen + 1);
+         ret->NameUTF8.Buffer = strings;
+         ret->NameUTF8.Length = nameLen;
+         WideCharToMultiByte(CP_UTF8, 0, ret->Name, -1, ret->NameUTF8.Buffer, nameLen + 1, NULL, NULL);
+         ret->DescriptionUTF8.Buffer = strings + nameLen + 1;
+         ret->DescriptionUTF8.Length = descriptionLen;
+         WideCharToMultiByte(CP_UTF8, 0, ret->Description, -1, ret->DescriptionUTF8.Buffer, descriptionLen + 1, NULL, NULL);
+      }
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Retrieves string representation of an IOCTL code not present in the IOCTL table.
+ *
+ *  @param Code The IOCTL code.
+ *
+ *  @return
+ *  Returns the cache entry of the code, decodes the code and inserts the entry into
+ *  the cache if needed. NULL is returned if the cache has no room for the code, or
+ *  if there is not enough memory.
+ *
+ *  @remark
+ *  The cache holds at most DEVICE_CONTROL_CACHE_SIZE codes. A code is searched for in
+ *  at most DEVICE_CONTROL_CACHE_PROBES consecutive slots starting at the one determined
+ *  by its hash. Empty slots are claimed by interlocked compare-exchange, so concurrent
+ *  lookups need no lock and repeated codes cost a single lookup. If two threads decode
+ *  the same code at once, only one entry is kept.
+ */
+static PDEVICE_CONTROL_CACHE_ENTRY _DeviceControlDecode(ULONG Code)
+{
+   ULONG i = 0;
+   ULONG slot = 0;
+   PDEVICE_CONTROL_CACHE_ENTRY entry = NULL;
+   PDEVICE_CONTROL_CACHE_ENTRY newEntry = NULL;
+   PDEVICE_CONTROL_CACHE_ENTRY ret = NULL;
+   DEBUG_ENTER_FUNCTION("Code=0x%x", Code);
+
+   slot = HashTablePointerHash((PVOID)(ULONG_PTR)Code) % DEVICE_CONTROL_CACHE_SIZE;
+   for (i = 0; i < DEVICE_CONTROL_CACHE_PROBES; ++i) {
+      entry = _deviceControlCache[slot];
+      if (entry == NULL) {
+         if (newEntry == NULL) {
+            newEntry = _DeviceControlEntryCreate(Code);
+            if (newEntry == NULL)
+               break;
+         }
+
+         entry = (PDEVICE_CONTROL_CACHE_ENTRY)InterlockedCompareExchangePointer((PVOID volatile *)&_deviceControlCache[slot], newEntry, NULL);
+         if (entry == NULL) {
+            ret = newEntry;
+            newEntry = NULL;
+            break;
+         }
+      }
+
+      if (entry->Code == Code) {
+         ret = entry;
+         break;
+      }
+
+      slot = (slot + 1) % DEVICE_CONTROL_CACHE_SIZE;
+   }
+
+   if (newEntry != NULL)
+      HeapMemoryFree(newEntry);
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Retrieves string representation or description of an IOCTL code not present in the
+ *  IOCTL table.
+ *
+ *  @param Code The IOCTL code.
+ *  @param Description Determines whether to return the CTL_CODE expression (FALSE), or
+ *  the description (TRUE).
+ *
+ *  @return
+ *  Returns the string, or the "Unknown" one if the code cannot be decoded.
+ */
+static PWCHAR _DeviceControlToString(ULONG Code, BOOLEAN Description)
+{
+   PDEVICE_CONTROL_CACHE_ENTRY entry = NULL;
+   PWCHAR ret = unknown;
+
+   entry = _DeviceControlDecode(Code);
+   if (entry != NULL)
+      ret = (Description) ? entry->Description : entry->Name;
+
+   return ret;
+}
+
+/** Retrieves UTF-8 form of string representation or description of an IOCTL code
+ *  not present in the IOCTL table.
+ *
+ *  @param Code The IOCTL code.
+ *  @param Description Determines whether to return the CTL_CODE expression (FALSE), or
+ *  the description (TRUE).
+ *  @param Length Address of variable that receives length of the string, in bytes, not
+ *  including the terminating null character.
+ *
+ *  @return
+ *  Returns the string, or the "Unknown" one if the code cannot be decoded.
+ */
+static PCHAR _DeviceControlToUTF8(ULONG Code, BOOLEAN Description, PULONG Length)
+{
+   PUTF8_STRING str = NULL;
+   PDEVICE_CONTROL_CACHE_ENTRY entry = NULL;
+   PCHAR ret = _unknownUTF8;
+
+   *Length = (ULONG)strlen(_unknownUTF8);
+   entry = _DeviceControlDecode(Code);
+   if (entry != NULL) {
+      str = (Description) ? &entry->DescriptionUTF8 : &entry->NameUTF8;
+      ret = str->Buffer;
+      *Length = str->Length;
+   }
+
+   return ret;
+}
+
+/** Supplies names of General Value Table items for UTF-8 conversion.
+ *
+ *  @param Context The General Value Table.
+ *  @param Index Index of the item.
+ *
+ *  @return
+ *  Returns name of the item.
+ */
+static PWCHAR _GVNameSource(PVOID Context, ULONG Index)
+{
+   PGENERAL_VALUE_TABLE table = (PGENERAL_VALUE_TABLE)Context;
+
+   return GVTableName(table, table->Records + Index);
+}
+
+/** Supplies descriptions of General Value Table items for UTF-8 conversion.
+ *
+ *  @param Context The General Value Table.
+ *  @param Index Index of the item.
+ *
+ *  @return
+ *  Returns description of the item.
+ */
+static PWCHAR _GVDescriptionSource(PVOID Context, ULONG Index)
+{
+   PGENERAL_VALUE_TABLE table = (PGENERAL_VALUE_TABLE)Context;
+
+   return GVTableDescription(table, table->Records + Index);
+}
+
+/** Supplies system enumeration strings for UTF-8 conversion.
+ *
+ *  @param Context The array of strings, indexed by the enumeration values.
+ *  @param Index Index of the string.
+ *
+ *  @return
+ *  Returns the string.
+ */
+static PWCHAR _EnumerationSource(PVOID Context, ULONG Index)
+{
+   return ((const PWCHAR *)Context)[Index];
+}
+
+/** Supplies names of bit mask values for UTF-8 conversion.
+ *
+ *  @param Context The array of @link(BITMASK_VALUE) structures.
+ *  @param Index Index of the structure.
+ *
+ *  @return
+ *  Returns the name.
+ */
+static PWCHAR _BitMaskNameSource(PVOID Context, ULONG Index)
+{
+   return ((PBITMASK_VALUE)Context)[Index].Name;
+}
+
+/** Supplies descriptions of bit mask values for UTF-8 conversion.
+ *
+ *  @param Context The array of @link(BITMASK_VALUE) structures.
+ *  @param Index Index of the structure.
+ *
+ *  @return
+ *  Returns the description.
+ */
+static PWCHAR _BitMaskDescriptionSource(PVOID Context, ULONG Index)
+{
+   return ((PBITMASK_VALUE)Context)[Index].Description;
+}
+
+/** Retrieves UTF-8 form of name or description of a given General Value Table item.
+ *
+ *  @param Type Type of the system constants stored in the table.
+ *  @param Description Determines whether to return the name (FALSE), or the description
+ *  (TRUE).
+ *  @param Table The table.
+ *  @param Record The record of the table.
+ *  @param Length Address of variable that receives length of the string, in bytes, not
+ *  including the terminating null character. Optional.
+ *
+ *  @return
+ *  Returns the UTF-8 string, or NULL if there is not enough memory to convert it.
+ */
+static PCHAR _GeneralValueToUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, PGENERAL_VALUE_TABLE Table, PGENERAL_VALUE_RECORD Record, PULONG Length)
+{
+   ULONG index = GVTableIndex(Table, Record);
+   PUTF8_ARRAY array = NULL;
+   PUTF8_STRING strings = NULL;
+   PCHAR ret = NULL;
+
+   if (Description && (Type == ltivtNTSTATUS || Type == ltivtWindowsError)) {
+      array = _gvUtf8Descriptions + Type;
+      strings = Utf8ArrayGet(array, Table->Count, NULL, NULL);
+      if (strings != NULL) {
+         ret = Utf8ArrayGetLazy(array, index, _GetDescription(Type, Table, Record));
+         if (ret != NULL && Length != NULL)
+            *Length = (ULONG)strlen(ret);
+      }
+   } else {
+      array = (Description) ? _gvUtf8Descriptions + Type : _gvUtf8Names + Type;
+      strings = Utf8ArrayGet(array, Table->Count, (Description) ? _GVDescriptionSource : _GVNameSource, Table);
+      if (strings != NULL) {
+         ret = strings[index].Buffer;
+         if (Length != NULL)
+            *Length = strings[index].Length;
+      }
+   }
+
+   return ret;
+}
+
+/************************************************************************/
+/*                     PUBLIC ROUTINES                                  */
+/************************************************************************/
+
+/** Converts a given system enumeration value to its string representation.
+ *
+ *  @param Type Type of the system enumeration value.
+ *  @param Description Determines whether the routine will return a string representation
+ *  of the given value (FALSE value), or a description that contains more information about
+ *  its meaning (TRUE value).
+ *  @param Value Value to convert.
+ *
+ *  @return
+ *  Returns either a string representation for the given value, or description of its meaning.
+ *  Neither case requires to free the returned string. It is placed inside a read-only memory.
+ *  If the user specifies an unknown type of system enumeration, or a value that is not present
+ *  within the given system enumeration type, L"unknown" string is returned. Also this string needs
+ *  not to be explicitly freed and it is also located in a read-only memory.
+ */
+PWCHAR EnumerationValueToString(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value)
+{
+   PWCHAR ret = unknown;
+   ULONG maxConstant = 0;
+   const PWCHAR *array = NULL;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=%u", Type, Description, Value);
+
+   array = _EnumerationTypeToArray(Type, Description, &maxConstant);
+   if (array != NULL && Value < maxConstant)
+      ret = array[Value];
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Converts an array of system enumeration values to their string representations.
+ *
+ *  @param Type Type of the system enumeration values.
+ *  @param Description Determines whether the routine will return string representations
+ *  of the given values (FALSE value), or descriptions that contain more information about
+ *  their meaning (TRUE value).
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the strings. Must have room for Count elements.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the enumeration type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to L"unknown".
+ *
+ *  @remark
+ *  Each string is the same as the one returned by @link(EnumerationValueToString)
+ *  for the corresponding value, so none of them needs to be freed.
+ */
+DWORD EnumerationValuesToStrings(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings)
+{
+   ULONG i = 0;
+   ULONG maxConstant = 0;
+   const PWCHAR *array = NULL;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Values=0x%p; Count=%u; Strings=0x%p", Type, Description, Values, Count, Strings);
+
+   array = _EnumerationTypeToArray(Type, Description, &maxConstant);
+   if (array != NULL) {
+      for (i = 0; i < Count; ++i)
+         Strings[i] = (Values[i] < maxConstant) ? array[Values[i]] : unknown;
+
+      ret = ERROR_SUCCESS;
+   } else {
+      for (i = 0; i < Count; ++i)
+         Strings[i] = unknown;
+
+      ret = ERROR_INVALID_PARAMETER;
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Converts a given system enumeration value to UTF-8 form of its string representation.
+ *
+ *  @param Type Type of the system enumeration value.
+ *  @param Description Determines whether the routine will return a string representation
+ *  of the given value (FALSE value), or a description of its meaning (TRUE value).
+ *  @param Value Value to convert.
+ *
+ *  @return
+ *  Returns UTF-8 form of the string returned by @link(EnumerationValueToString) for
+ *  the same arguments. The string must not be freed. NULL is returned if there is not
+ *  enough memory to convert the strings of the enumeration.
+ */
+PCHAR EnumerationValueToStringUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value)
+{
+   PCHAR ret = NULL;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=%u", Type, Description, Value);
+
+   EnumerationValuesToStringsUTF8(Type, Description, &Value, 1, &ret, NULL);
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Converts an array of system enumeration values to UTF-8 forms of their string
+ *  representations.
+ *
+ *  @param Type Type of the system enumeration values.
+ *  @param Description Determines whether the routine will return string representations
+ *  of the given values (FALSE value), or descriptions of their meaning (TRUE value).
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the UTF-8 strings. Must have room for Count elements.
+ *  @param Lengths Array that receives lengths of the strings, in bytes, not including the
+ *  terminating null characters. Optional.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the enumeration type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to "Unknown".
+ *  If the strings cannot be converted due to insufficient memory, ERROR_NOT_ENOUGH_MEMORY
+ *  is returned and all strings are set to NULL.
+ */
+DWORD EnumerationValuesToStringsUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths)
+{
+   ULONG i = 0;
+   ULONG maxConstant = 0;
+   const PWCHAR *array = NULL;
+   PUTF8_STRING strings = NULL;
+   UTF8_STRING unknownString;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Values=0x%p; Count=%u; Strings=0x%p; Lengths=0x%p", Type, Description, Values, Count, Strings, Lengths);
+
+   unknownString.Buffer = _unknownUTF8;
+   unknownString.Length = (ULONG)strlen(_unknownUTF8);
+   array = _EnumerationTypeToArray(Type, Description, &maxConstant);
+   if (array != NULL) {
+      strings = Utf8ArrayGet(&_enumUtf8Strings[Type][Description != FALSE], maxConstant, _EnumerationSource, (PVOID)array);
+      if (strings != NULL) {
+         for (i = 0; i < Count; ++i) {
+            Strings[i] = (Values[i] < maxConstant) ? strings[Values[i]].Buffer : unknownString.Buffer;
+            if (Lengths != NULL)
+               Lengths[i] = (Values[i] < maxConstant) ? strings[Values[i]].Length : unknownString.Length;
+         }
+
+         ret = ERROR_SUCCESS;
+      } else {
+         for (i = 0; i < Count; ++i)
+            Strings[i] = NULL;
+
+         ret = ERROR_NOT_ENOUGH_MEMORY;
+      }
+   } else {
+      for (i = 0; i < Count; ++i) {
+         Strings[i] = unknownString.Buffer;
+         if (Lengths != NULL)
+            Lengths[i] = unknownString.Length;
+      }
+
+      ret = ERROR_INVALID_PARAMETER;
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Converts a given system constant value to human readable its string representation.
+ *
+ *  @param Type Type of the constant to convert.
+ *  @param Description If set to FALSE the routine attempts to return string representation of
+ *  the given string constant. If set to TRUE, the routine attempts to return a description for the
+ *  given constant.
+ *  @param Value Value to translate.
+ *
+ *  @return
+ *  Returns either a string representation of the given system constant value, or its
+ *  description. Neither case requires to free the memory occupied by the returned 
+ *  string. The returned string lies in a read-only memory. If the  If either an invalid
+ *  system constant type is specified, or the given system constant is not recognized by
+ *  the library, the routine returns L"unknown" which must not bee freed and is also located
+ *  in a read-only memory.
+ */
+PWCHAR GeneralIntegerValueToString(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value)
+{
+   PGENERAL_VALUE_RECORD ti = NULL;
+   PGENERAL_VALUE_TABLE table = NULL;
+   PWCHAR ret = unknown;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=%u", Type, Description, Value);
+
+   table = _IntegerValueTypeToTable(Type);
+   if (table != NULL) {
+      ti = GVTableGet(table, Value);
+      if (ti != NULL) {
+         if (Description) {
+            ret = (Type == ltivtNTSTATUS || Type == ltivtWindowsError) ?
+               _GetDescription(Type, table, ti) :
+               GVTableDescription(table, ti);
+         } else ret = GVTableName(table, ti);
+      } else if (Type == ltivtDeviceControl)
+         ret = _DeviceControlToString(Value, Description);
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Converts an array of system constant values to their string representations.
+ *
+ *  @param Type Type of the constants.
+ *  @param Description If set to FALSE the routine returns string representations of the
+ *  constants. If set to TRUE, it returns their descriptions.
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the strings. Must have room for Count elements.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the constant type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to L"unknown".
+ *
+ *  @remark
+ *  Each string is the same as the one returned by @link(GeneralIntegerValueToString)
+ *  for the corresponding value, so none of them needs to be freed. The values are
+ *  looked up via @link(GVTableGetBatch) in chunks of GENERAL_VALUE_BATCH_CHUNK.
+ */
+DWORD GeneralIntegerValuesToStrings(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG chunk = 0;
+   PGENERAL_VALUE_RECORD ti = NULL;
+   PGENERAL_VALUE_RECORD items[GENERAL_VALUE_BATCH_CHUNK];
+   PGENERAL_VALUE_TABLE table = NULL;
+   BOOLEAN lazyDescription = FALSE;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Values=0x%p; Count=%u; Strings=0x%p", Type, Description, Values, Count, Strings);
+
+   table = _IntegerValueTypeToTable(Type);
+   if (table != NULL) {
+      lazyDescription = (Description && (Type == ltivtNTSTATUS || Type == ltivtWindowsError));
+      for (i = 0; i < Count; i += chunk) {
+         chunk = (Count - i < GENERAL_VALUE_BATCH_CHUNK) ? Count - i : GENERAL_VALUE_BATCH_CHUNK;
+         GVTableGetBatch(table, Values + i, chunk, items);
+         for (j = 0; j < chunk; ++j) {
+            ti = items[j];
+            if (ti != NULL) {
+               if (Description)
+                  Strings[i + j] = (lazyDescription) ? _GetDescription(Type, table, ti) : GVTableDescription(table, ti);
+               else Strings[i + j] = GVTableName(table, ti);
+            } else if (Type == ltivtDeviceControl)
+               Strings[i + j] = _DeviceControlToString(Values[i + j], Description);
+            else Strings[i + j] = unknown;
+         }
+      }
+
+      ret = ERROR_SUCCESS;
+   } else {
+      for (i = 0; i < Count; ++i)
+         Strings[i] = unknown;
+
+      ret = ERROR_INVALID_PARAMETER;
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Converts a given system constant value to UTF-8 form of its string representation
+ *  or description.
+ *
+ *  @param Type Type of the constant to convert.
+ *  @param Description If set to FALSE the routine returns string representation of
+ *  the constant. If set to TRUE, it returns its description.
+ *  @param Value Value to translate.
+ *
+ *  @return
+ *  Returns UTF-8 form of the string returned by @link(GeneralIntegerValueToString) for
+ *  the same arguments. The string must not be freed. NULL is returned if there is not
+ *  enough memory to convert the string.
+ */
+PCHAR GeneralIntegerValueToStringUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value)
+{
+   ULONG length = 0;
+   PGENERAL_VALUE_RECORD ti = NULL;
+   PGENERAL_VALUE_TABLE table = NULL;
+   PCHAR ret = _unknownUTF8;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=%u", Type, Description, Value);
+
+   table = _IntegerValueTypeToTable(Type);
+   if (table != NULL) {
+      ti = GVTableGet(table, Value);
+      if (ti != NULL)
+         ret = _GeneralValueToUTF8(Type, Description, table, ti, NULL);
+      else if (Type == ltivtDeviceControl)
+         ret = _DeviceControlToUTF8(Value, Description, &length);
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Converts an array of system constant values to UTF-8 forms of their string
+ *  representations or descriptions.
+ *
+ *  @param Type Type of the constants.
+ *  @param Description If set to FALSE the routine returns string representations of the
+ *  constants. If set to TRUE, it returns their descriptions.
+ *  @param Values Array of values to convert.
+ *  @param Count Number of elements in the Values array.
+ *  @param Strings Array that receives the UTF-8 strings. Must have room for Count elements.
+ *  @param Lengths Array that receives lengths of the strings, in bytes, not including the
+ *  terminating null characters. Optional.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success. If the constant type is not supported,
+ *  ERROR_INVALID_PARAMETER is returned and all strings are set to "Unknown".
+ *  If some strings cannot be converted due to insufficient memory, they are set
+ *  to NULL and ERROR_NOT_ENOUGH_MEMORY is returned.
+ */
+DWORD GeneralIntegerValuesToStringsUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths)
+{
+   ULONG i = 0;
+   ULONG j = 0;
+   ULONG chunk = 0;
+   ULONG length = 0;
+   ULONG unknownLength = (ULONG)strlen(_unknownUTF8);
+   PGENERAL_VALUE_RECORD items[GENERAL_VALUE_BATCH_CHUNK];
+   PGENERAL_VALUE_TABLE table = NULL;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Values=0x%p; Count=%u; Strings=0x%p; Lengths=0x%p", Type, Description, Values, Count, Strings, Lengths);
+
+   table = _IntegerValueTypeToTable(Type);
+   if (table != NULL) {
+      ret = ERROR_SUCCESS;
+      for (i = 0; i < Count; i += chunk) {
+         chunk = (Count - i < GENERAL_VALUE_BATCH_CHUNK) ? Count - i : GENERAL_VALUE_BATCH_CHUNK;
+         GVTableGetBatch(table, Values + i, chunk, items);
+         for (j = 0; j < chunk; ++j) {
+            length = unknownLength;
+            Strings[i + j] = _unknownUTF8;
+            if (items[j] != NULL) {
+               length = 0;
+               Strings[i + j] = _GeneralValueToUTF8(Type, Description, table, items[j], &length);
+               if (Strings[i + j] == NULL)
+                  ret = ERROR_NOT_ENOUGH_MEMORY;
+            } else if (Type == ltivtDeviceControl)
+               Strings[i + j] = _DeviceControlToUTF8(Values[i + j], Description, &length);
+
+            if (Lengths != NULL)
+               Lengths[i + j] = length;
+         }
+      }
+   } else {
+      for (i = 0; i < Count; ++i) {
+         Strings[i] = _unknownUTF8;
+         if (Lengths != NULL)
+            Lengths[i] = unknownLength;
       }
+
+      ret = ERROR_INVALID_PARAMETER;
    }
 
-   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   DEBUG_EXIT_FUNCTION("%u", ret);
    return ret;
 }
 
-/** Converts a given system constant value to human readable its string representation.
+/** Retrieves statistics of the hash table keyed by a given type of system
+ *  constants.
  *
- *  @param Type Type of the constant to convert.
- *  @param Description If set to FALSE the routine attempts to return string representation of
- *  the given string constant. If set to TRUE, the routine attempts to return a description for the
- *  given constant.
- *  @param Value Value to translate.
+ *  @param Type Type of the constants. Only NTSTATUS values and Windows error codes
+ *  are supported since they are keys of the tables mapping them to each other.
+ *  Other constants are translated through General Value Tables that are not hash
+ *  tables.
+ *  @param Statistics Address of a structure that receives the statistics.
  *
  *  @return
- *  Returns either a string representation of the given system constant value, or its
- *  description. Neither case requires to free the memory occupied by the returned 
- *  string. The returned string lies in a read-only memory. If the  If either an invalid
- *  system constant type is specified, or the given system constant is not recognized by
- *  the library, the routine returns L"unknown" which must not bee freed and is also located
- *  in a read-only memory.
+ *  Returns ERROR_SUCCESS on success, ERROR_NOT_SUPPORTED if the constant type
+ *  is not a key of any hash table.
  */
-PWCHAR GeneralIntegerValueToString(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value)
+DWORD IntegerValueTableStatistics(ELibTranslateIntegerValueType Type, PLIBTRANSLATE_HASH_TABLE_STATISTICS Statistics)
 {
-   PGENERAL_VALUE ti = NULL;
    PHASH_TABLE table = NULL;
-   PWCHAR ret = unknown;
-   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=%u", Type, Description, Value);
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Statistics=0x%p", Type, Statistics);
 
    switch (Type) {
       case ltivtNTSTATUS:
-         table = ntStatusTable;
-         break;
-
-      case ltivtFileIRPMajorFunction:
-         table = irpMajorFunctionTable;
-         break;
-      case ltivtVolumeDeviceType:
-         table = volumeDeviceTypeTable;
-         break;
-
-      case ltivtSCTPPort:
-         table = sctpPortTable;
-         break;
-      case ltivtTCPPort:
-         table = tcpPortTable;
-         break;
-      case ltivtUDPPort:
-         table = udpPortTable;
-         break;
-      case ltivtDCCPPort:
-         table = dccpPortTable;
-         break;
-
-      case ltivtWindowsHook:
-         table = windowsHookTable;
+         table = _NTSTATUSToErrorTable;
          break;
-
       case ltivtWindowsError:
-         table = winErrorTable;
+         table = _ErrorToNTSTATUSTable;
          break;
-
-	  case ltivtDeviceControl:
-		  table = _ioControlCodeTable;
-		  break;
       default:
          break;
    }
 
    if (table != NULL) {
-      ti = GVHashTableGet(table, Value);
-      if (ti != NULL) {
-         ret = Description ? ti->Description : ti->Name;
+      HashTableGetStatistics(table, Statistics);
+      ret = ERROR_SUCCESS;
+   } else ret = ERROR_NOT_SUPPORTED;
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+/** Retrieves the General Value Table translating a given type of system
+ *  constants. The table is valid while the library is initialized.
+ *
+ *  @param Type Type of the constants.
+ *
+ *  @return
+ *  Returns address of the table, or NULL if the type is not translated through
+ *  a General Value Table.
+ */
+PGENERAL_VALUE_TABLE IntegerValueTable(ELibTranslateIntegerValueType Type)
+{
+   PGENERAL_VALUE_TABLE ret = NULL;
+   DEBUG_ENTER_FUNCTION("Type=%u", Type);
+
+   ret = _IntegerValueTypeToTable(Type);
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Converts a given bit mask value to a string containing either names for the
+ *  nonzero bits, or human-readable descriptions for them, and stores it in a
+ *  caller-supplied buffer.
+ *
+ *  @param Type Type of bit mask to convert.
+ *  @param Description Determines whether the routine should produce names of the nonzero
+ *  bits (FALSE value) or their human-readable descriptions (TRUE value).
+ *  @param Value A bit mask value to convert.
+ *  @param Buffer The buffer to receive the null-terminated string.
+ *  @param BufferLength Length of the buffer, in characters.
+ *  @param RequiredLength Address of variable that receives length of the string, in
+ *  characters, including the terminating null character.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, ERROR_INSUFFICIENT_BUFFER if the buffer is too small
+ *  and ERROR_INVALID_PARAMETER if the bit mask type is not supported.
+ *
+ *  @remark
+ *  Recently converted values whose strings are short enough are remembered in a small
+ *  cache, since the same flag combinations tend to repeat. Cache hits just copy the
+ *  string to the buffer. Entries of the cache are protected by slim reader-writer locks,
+ *  so the routine may be called from multiple threads at once.
+ */
+DWORD BitMaskValueToBuffer(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+   ULONG vLen = 0;
+   PBITMASK_VALUE v = NULL;
+   SIZE_T required = 0;
+   BOOLEAN hit = FALSE;
+   PBITMASK_CACHE_ENTRY entry = NULL;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=0x%x; Buffer=0x%p; BufferLength=%u; RequiredLength=0x%p", Type, Description, Value, Buffer, BufferLength, RequiredLength);
+
+   v = _BitMaskTypeToArray(Type, &vLen);
+   if (v != NULL) {
+      Description = (Description != FALSE);
+      entry = _bitMaskCache + _BitMaskCacheIndex(Type, Description, Value);
+      AcquireSRWLockShared(&entry->Lock);
+      hit = (entry->Length > 0 && entry->Type == Type && entry->Description == Description && entry->Value == Value);
+      if (hit) {
+         required = entry->Length;
+         if (required <= BufferLength)
+            CopyMemory(Buffer, entry->String, required * sizeof(WCHAR));
+      }
+
+      ReleaseSRWLockShared(&entry->Lock);
+      if (!hit) {
+         required = _BitMaskValueToBuffer(Value, Description, v, vLen, Buffer, BufferLength);
+         if (required <= BufferLength && required <= BITMASK_CACHE_MAX_STRING) {
+            AcquireSRWLockExclusive(&entry->Lock);
+            entry->Type = Type;
+            entry->Description = Description;
+            entry->Value = Value;
+            entry->Length = (ULONG)required;
+            CopyMemory(entry->String, Buffer, required * sizeof(WCHAR));
+            ReleaseSRWLockExclusive(&entry->Lock);
+         }
       }
+
+      *RequiredLength = (ULONG)required;
+      ret = (required <= BufferLength) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER;
+   } else {
+      *RequiredLength = 0;
+      ret = ERROR_INVALID_PARAMETER;
    }
 
-   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   DEBUG_EXIT_FUNCTION("%u, *RequiredLength=%u", ret, *RequiredLength);
    return ret;
 }
 
@@ -689,110 +1614,89 @@ PWCHAR GeneralIntegerValueToString(ELibTranslateIntegerValueType Type, BOOLEAN D
  *  If the given value contains nonzero bits and the routine succeeds (returns non-NULL value), the
  *  returned string must be freed by a call to @link(BitMaskValueStringFree) procedure. Otherwise
  *  (even in the zero-value case) no countermeasure is needed.
+ *
+ *  The string is produced by @link(BitMaskValueToBuffer) into a stack buffer and copied to
+ *  a heap block of the exact size.
  */
 PWCHAR BitMaskValueToString(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value)
 {
-   ULONG vLen = 0;
-   PBITMASK_VALUE v = NULL;
+   ULONG required = 0;
+   WCHAR buffer[BITMASK_CACHE_MAX_STRING];
    PWCHAR ret = unknown;
+   DWORD err = ERROR_GEN_FAILURE;
    DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=0x%x", Type, Description, Value);
 
-   switch (Type) {
-      case ltbtProcessAccessRights:
-         v = _processAcessRights;
-         vLen = sizeof(_processAcessRights);
-         break;
-
-      case ltbtThreadAccessRights:
-         v = _threadAcessRights;
-         vLen = sizeof(_threadAcessRights);
-         break;
-
-      case ltbtFileAttributes:
-         v = _fileAttributes;
-         vLen = sizeof(_fileAttributes);
-         break;
-      case ltbtFileShareAccess:
-         v = _fileShareAccess;
-         vLen = sizeof(_fileShareAccess);
-         break;
-      case ltbtFileCreateOptions:
-         v = _fileCreateOptions;
-         vLen = sizeof(_fileCreateOptions);
-         break;
-      case ltbtFileAccessRights:
-         v = _fileAccessRights;
-         vLen = sizeof(_fileAccessRights);
-         break;
-      case ltbtFileIrpFlags:
-         v = _fileIrpFlags;
-         vLen = sizeof(_fileIrpFlags);
-         break;
-      case ltbtFileNotifyFilter:
-         v = _fileNotifyFilter;
-         vLen = sizeof(_fileNotifyFilter);
-         break;
-
-      case ltbtSectionPageProtection:
-         v = _sectionPageProtection;
-         vLen = sizeof(_sectionPageProtection);
-         break;
-      case ltbtSecurityInformationClass:
-         v = _securityInformationClass;
-         vLen = sizeof(_securityInformationClass);
-         break;
-
-      case ltbtRegistryKeyAccessRights:
-         v = _keyAccessRights;
-         vLen = sizeof(_keyAccessRights);
-         break;
-      case ltbtRegistryKeyCreateOptions:
-         v = _registryKeyCreateOptions;
-         vLen = sizeof(_registryKeyCreateOptions);
-         break;
-      case ltbtRegistryKeyRestoreFlags:
-         v = _registryRestoreFlags;
-         vLen = sizeof(_registryRestoreFlags);
+   err = BitMaskValueToBuffer(Type, Description, Value, buffer, sizeof(buffer) / sizeof(WCHAR), &required);
+   switch (err) {
+      case ERROR_SUCCESS:
+         ret = L"";
+         if (required > 1) {
+            ret = (PWCHAR)HeapMemoryAlloc(required * sizeof(WCHAR));
+            if (ret != NULL)
+               CopyMemory(ret, buffer, required * sizeof(WCHAR));
+         }
          break;
-      case ltbtRegistryKeyHiveFormat:
-         v = _registryHiveFormat;
-         vLen = sizeof(_registryHiveFormat);
+      case ERROR_INSUFFICIENT_BUFFER:
+         ret = (PWCHAR)HeapMemoryAlloc(required * sizeof(WCHAR));
+         if (ret != NULL)
+            BitMaskValueToBuffer(Type, Description, Value, ret, required, &required);
          break;
-	  case ltbtIRPReadMinorFunction:
-	  case ltbtIRPWriteMinorFunction:
-		  v = _irpReadWriteMinorFunction;
-		  vLen = sizeof(_irpReadWriteMinorFunction);
-		  break;
-
-	  case ltbtIRPReadWriteFlags:
-		  v = _irpReadWriteFlags;
-		  vLen = sizeof(_irpReadWriteFlags);
-		  break;
-	  case ltbtIRPCTLFlags:
-		  v = _irpCTLFlags;
-		  vLen = sizeof(_irpCTLFlags);
-		  break;
-	  case ltbtIRPOtherFlags:
-		  v = _irpOtherFlags;
-		  vLen = sizeof(_irpOtherFlags);
-		  break;
-	  case ltbtIRPPagingReadWrite:
-		  v = _irpPagingReadWriteFlags;
-		  vLen = sizeof(_irpPagingReadWriteFlags);
-		  break;
       default:
          break;
    }
 
-   if (v != NULL) {
-      vLen /= sizeof(BITMASK_VALUE);
-      ret = _BitMaskValueToString(Value, Description, v, vLen, L", ", unknown);
-   }
-
    DEBUG_EXIT_FUNCTION("0x%p", ret);
    return ret;
 }
 
+/** Converts a given bit mask value to UTF-8 string containing either names for the
+ *  nonzero bits, or human-readable descriptions for them, and stores it in a
+ *  caller-supplied buffer.
+ *
+ *  @param Type Type of bit mask to convert.
+ *  @param Description Determines whether the routine should produce names of the nonzero
+ *  bits (FALSE value) or their human-readable descriptions (TRUE value).
+ *  @param Value A bit mask value to convert.
+ *  @param Buffer The buffer to receive the null-terminated UTF-8 string.
+ *  @param BufferLength Size of the buffer, in bytes.
+ *  @param RequiredLength Address of variable that receives size of the string, in bytes,
+ *  including the terminating null character.
+ *
+ *  @return
+ *  Returns the same values as @link(BitMaskValueToBuffer). ERROR_NOT_ENOUGH_MEMORY is
+ *  returned if UTF-8 forms of the names (descriptions) of the bit mask type cannot be
+ *  built.
+ *
+ *  @remark
+ *  The string is assembled from UTF-8 forms of the names (descriptions), converted
+ *  when the bit mask type is used for the first time, so the routine neither converts
+ *  from UTF-16 nor needs the bit mask string cache.
+ */
+DWORD BitMaskValueToBufferUTF8(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+   ULONG vLen = 0;
+   PBITMASK_VALUE v = NULL;
+   PUTF8_STRING strings = NULL;
+   SIZE_T required = 0;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Type=%u; Description=%u; Value=0x%x; Buffer=0x%p; BufferLength=%u; RequiredLength=0x%p", Type, Description, Value, Buffer, BufferLength, RequiredLength);
+
+   *RequiredLength = 0;
+   v = _BitMaskTypeToArray(Type, &vLen);
+   if (v != NULL) {
+      Description = (Description != FALSE);
+      strings = Utf8ArrayGet(&_bitMaskUtf8Strings[Type][Description], vLen, (Description) ? _BitMaskDescriptionSource : _BitMaskNameSource, v);
+      if (strings != NULL) {
+         required = _BitMaskValueToBufferUTF8(Value, v, vLen, strings, Buffer, BufferLength);
+         *RequiredLength = (ULONG)required;
+         ret = (required <= BufferLength) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER;
+      } else ret = ERROR_NOT_ENOUGH_MEMORY;
+   } else ret = ERROR_INVALID_PARAMETER;
+
+   DEBUG_EXIT_FUNCTION("%u, *RequiredLength=%u", ret, *RequiredLength);
+   return ret;
+}
+
 /** Frees a string returned by the @link(BitMaskValueToString) function.
  *
  *  @param Value Address of a string to free.
@@ -819,15 +1723,15 @@ VOID BitMaskValueStringFree(PWCHAR Str)
 PWCHAR WindowsEventHookToString(ULONG32 WinEventHookValue)
 {
 	PWCHAR ret = unknown;
-   PGENERAL_VALUE ti = NULL;
+   PGENERAL_VALUE_RECORD ti = NULL;
    DEBUG_ENTER_FUNCTION("WinEventHookValue=0x%x", WinEventHookValue);
 
    // At first, try to lookup the type value in the table of Windows Event hook
    // type constants. This may fail because Windows Event Hook types are also
    // defined by ranges.
-   ti = GVHashTableGet(htWinEventHookTable, WinEventHookValue);
+   ti = GVTableGet(&htWinEventHookTable, WinEventHookValue);
 	if (ti != NULL) {
-		ret = ti->Name;
+		ret = GVTableName(&htWinEventHookTable, ti);
 	} else {
 	   // No direct match. Search the ragnes
 		if ((EVENT_AIA_START < WinEventHookValue) && (WinEventHookValue <  EVENT_AIA_END )){
@@ -867,15 +1771,15 @@ PWCHAR WindowsEventHookToString(ULONG32 WinEventHookValue)
 PWCHAR WindowsEventHookDescriptionToString(ULONG32 WinEventHookValue)
 {
 	PWCHAR ret = unknown;
-   PGENERAL_VALUE ti = NULL;
+   PGENERAL_VALUE_RECORD ti = NULL;
    DEBUG_ENTER_FUNCTION("WinEventHookValue=0x%x", WinEventHookValue);
 
    // At first, try to lookup the value description in the table of Windows Event hook
    // type constants. This may fail because Windows Event Hook types are also
    // defined by ranges.
-   ti = GVHashTableGet(htWinEventHookTable, WinEventHookValue);
+   ti = GVTableGet(&htWinEventHookTable, WinEventHookValue);
 	if (ti != NULL) {
-		ret = ti->Description;
+		ret = GVTableDescription(&htWinEventHookTable, ti);
 	} else {
       // No direct match. Search the ragnes		
 		if ((EVENT_AIA_START < WinEventHookValue) && (WinEventHookValue <  EVENT_AIA_END )){
@@ -927,7 +1831,7 @@ PWCHAR WindowsEventHookDescriptionToString(ULONG32 WinEventHookValue)
 PWCHAR WindowsMessagesToString(ULONG32 WindowsMessage)
 {
 	PWCHAR ret = unknown;
-   PGENERAL_VALUE ti = NULL;
+   PGENERAL_VALUE_RECORD ti = NULL;
    SIZE_T wmUserStrLen = wcslen(L"WM_USER + ");
    SIZE_T wmAppStrlen = wcslen(L"WM_APP + ");
    SIZE_T bytesToAlloc = (10 + 1) * sizeof(WCHAR);
@@ -935,9 +1839,9 @@ PWCHAR WindowsMessagesToString(ULONG32 WindowsMessage)
 
    // Attempt to lookup the string representation in the table mapping WM_XXX
    // constants to strings.
-   ti = GVHashTableGet(windowsMessagesTable, WindowsMessage);
+   ti = GVTableGet(&windowsMessagesTable, WindowsMessage);
 	if (ti != NULL) {
-		ret = ti->Name;
+		ret = GVTableName(&windowsMessagesTable, ti);
 	} else if ((WM_USER < WindowsMessage) && (WindowsMessage < WM_APP)) {
 		// The given constant is not in the mapping table and lies between
       // WM_USER and WM_APP. Return the L"WM_USER + X" string.
@@ -1019,7 +1923,6 @@ PWCHAR IPV4ToString(ULONG IPV4Address)
  */
 PWCHAR IPV6ToString(PUCHAR IPV6Address)
 {
-   ULONG i = 0;
    PWCHAR ret = NULL;
    PUINT16 field = (PUINT16)IPV6Address;
    DEBUG_ENTER_FUNCTION("IPV6Address", IPV6Address);
@@ -1049,29 +1952,26 @@ PWCHAR IPV6ToString(PUCHAR IPV6Address)
  */
 PWCHAR NetworkPortToString(USHORT Port, ULONG Protocol)
 {
-   ELibTranslateIntegerValueType t;
    PWCHAR ret = unknown;
    DEBUG_ENTER_FUNCTION("Port=%u; Protocol=%u", Port, Protocol);
 
    switch (Protocol) {
       case 6:
-         t = ltivtTCPPort;
+         ret = GeneralIntegerValueToString(ltivtTCPPort, FALSE, Port);
          break;
       case 17:
-         t = ltivtUDPPort;
+         ret = GeneralIntegerValueToString(ltivtUDPPort, FALSE, Port);
          break;
       case 33:
-         t = ltivtDCCPPort;
+         ret = GeneralIntegerValueToString(ltivtDCCPPort, FALSE, Port);
          break;
       case 132:
-         t = ltivtSCTPPort;
+         ret = GeneralIntegerValueToString(ltivtSCTPPort, FALSE, Port);
          break;
       default:
          break;
    }
 
-   ret = GeneralIntegerValueToString(t, FALSE, Port);
-
    DEBUG_EXIT_FUNCTION("\"%S\"", ret);
    return ret;
 }
@@ -1100,131 +2000,152 @@ DWORD NTSTATUSCodeToWindowsError(NTSTATUS Status)
 	return (DWORD)ret;
 }
 
-PWCHAR IRPFLagsToString(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description)
+/** Determines which bit mask type describes IRP flags of a given request.
+ *
+ *  @param MajorFunction Major function of the request.
+ *  @param MinorFunction Minor function of the request.
+ *  @param IRPFlags The IRP flags.
+ *
+ *  @return
+ *  Returns the bit mask type.
+ */
+static ELibTranslateBitMaskType _IRPFlagsBitMaskType(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags)
 {
-	PWCHAR ret = NULL;
-	ELibTranslateBitMaskType bType = ltbtIRPOtherFlags;
+	ELibTranslateBitMaskType ret = ltbtIRPOtherFlags;
 
 	switch (MajorFunction) {
 		case IRP_MJ_READ:
 		case IRP_MJ_WRITE:
-			bType = ltbtIRPReadWriteFlags;
+			ret = ltbtIRPReadWriteFlags;
 			if (IRPFlags & IRP_PAGING_IO)
-				bType = ltbtIRPPagingReadWrite;
+				ret = ltbtIRPPagingReadWrite;
 			break;
 		case IRP_MJ_DEVICE_CONTROL:
 		case IRP_MJ_INTERNAL_DEVICE_CONTROL:
-			bType = ltbtIRPCTLFlags;
+			ret = ltbtIRPCTLFlags;
 			break;
 		case IRP_MJ_FILE_SYSTEM_CONTROL:
 			if (MinorFunction == IRP_MN_USER_FS_REQUEST || MinorFunction == IRP_MN_KERNEL_CALL)
-				bType = ltbtIRPCTLFlags;
-			else bType = ltbtIRPOtherFlags;
+				ret = ltbtIRPCTLFlags;
+			else ret = ltbtIRPOtherFlags;
 			break;
 		default:
-			bType = ltbtIRPOtherFlags;
+			ret = ltbtIRPOtherFlags;
 			break;
 	}
 
-	ret = BitMaskValueToString(bType, Description, IRPFlags);
-
 	return ret;
 }
 
+PWCHAR IRPFLagsToString(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description)
+{
+	return BitMaskValueToString(_IRPFlagsBitMaskType(MajorFunction, MinorFunction, IRPFlags), Description, IRPFlags);
+}
+
+DWORD IRPFlagsToBuffer(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+	return BitMaskValueToBuffer(_IRPFlagsBitMaskType(MajorFunction, MinorFunction, IRPFlags), Description, IRPFlags, Buffer, BufferLength, RequiredLength);
+}
+
+DWORD IRPFlagsToBufferUTF8(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+	return BitMaskValueToBufferUTF8(_IRPFlagsBitMaskType(MajorFunction, MinorFunction, IRPFlags), Description, IRPFlags, Buffer, BufferLength, RequiredLength);
+}
+
 /************************************************************************/
 /*                 INITIALIZATION AND FINALIZATION                      */
 /************************************************************************/
 
-/** Contains information to initialize the hash tables (each element is here for one
-    hash table). The array allows to perform the initialization and finalization in a
+/** Contains all General Value Tables. The array allows to prepare them in a
     (for) loop. 
   */
-static GENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE _hashTableInitializationArray [] = {
-   {&htWinEventHookTable, 233, _winEventHooks, sizeof(_winEventHooks) / sizeof(GENERAL_VALUE)},
-   {&ntStatusTable, 233, _ntstatus, sizeof(_ntstatus) / sizeof(GENERAL_VALUE)},
-   {&winErrorTable, 233, _windowsError, sizeof(_windowsError) / sizeof(GENERAL_VALUE)},
-   {&windowsMessagesTable, 233, _windowsMessages, sizeof(_windowsMessages) / sizeof(GENERAL_VALUE)},
-   {&sctpPortTable, 7, _sctpPort, sizeof(_sctpPort) / sizeof(GENERAL_VALUE)},
-   {&dccpPortTable, 11, _dccpPort, sizeof(_dccpPort) / sizeof(GENERAL_VALUE)},
-   {&tcpPortTable, 797, _tcpPort, sizeof(_tcpPort) / sizeof(GENERAL_VALUE)},
-   {&udpPortTable, 797, _udpPort, sizeof(_udpPort) / sizeof(GENERAL_VALUE)},
-   {&irpMajorFunctionTable, 31, _irpMajorFunction, sizeof(_irpMajorFunction) / sizeof(GENERAL_VALUE)},
-   {&volumeDeviceTypeTable, 31, _volumeDeviceType, sizeof(_volumeDeviceType) / sizeof(GENERAL_VALUE)},
-   {&windowsHookTable, 31, _WindowsHook, sizeof(_WindowsHook) / sizeof(GENERAL_VALUE)},
-   {&_ioControlCodeTable, 31, _ioControlCodes, sizeof(_ioControlCodes) / sizeof(GENERAL_VALUE)},
+static PGENERAL_VALUE_TABLE _generalValueTables [] = {
+   &htWinEventHookTable,
+   &ntStatusTable,
+   &winErrorTable,
+   &windowsMessagesTable,
+   &sctpPortTable,
+   &dccpPortTable,
+   &tcpPortTable,
+   &udpPortTable,
+   &irpMajorFunctionTable,
+   &volumeDeviceTypeTable,
+   &windowsHookTable,
+   &_ioControlCodeTable,
+   &_deviceTypeTable,
 };
 
 /** Initializes the Translation Library.
  *
- *  The initialization stage consists mainly from creating various hash tables and filling them
- *  with information. The hash tables are then used to translate information of certain
- *  kinds to corresponding string representation.
+ *  The General Value Tables used to translate various system constants to their string
+ *  representations are arrays sorted at build time, so their preparation just checks
+ *  the order (small arrays defined via symbolic constants may be reordered). Their names
+ *  and descriptions are stored in one string pool, each distinct string only once. Hash tables
+ *  mapping Windows error codes and NTSTATUS values to each other are created since
+ *  the mapping is provided by the system.
+ *
+ *  Lengths of names and descriptions of bit mask values are computed, so bit mask
+ *  conversions do not need to compute them repeatedly.
  *
- *  The routine also calls _CreateNTSTATUSDescriptions function in order to fill
- *  descriptions for NTSTATUS codes.
+ *  Descriptions of NTSTATUS values and Windows error codes are not looked up here,
+ *  @link(_GetDescription) does that when they are requested for the first time.
  *
  *  @return
  *  Returns ELibraryError value indication success or failure of the operation.
  */
 DWORD TranslatesModuleInit(VOID)
 {
-   ULONG i = 0;
    ULONG j = 0;
-   const ULONG numberOfTablesToInitialize = sizeof(_hashTableInitializationArray) / sizeof(GENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE);
-   PGENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE item = &_hashTableInitializationArray[0];
+   ULONG vLen = 0;
+   PBITMASK_VALUE v = NULL;
    DWORD ret = ERROR_GEN_FAILURE;
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
-   // Lookup descriptions for NTSTATUS values.
-   ret = _CreateNTSTATUSDescriptions();
+   ret = GVTablesPrepare(_generalValueTables, sizeof(_generalValueTables) / sizeof(PGENERAL_VALUE_TABLE));
    if (ret == ERROR_SUCCESS) {
-      // Lookup descriptions for Windows error codes.
-      ret = _CreateWindowsErrorDescriptions();
-      if (ret == ERROR_SUCCESS) {
-         // Create hash tables to hold all types of system constants supported by
-         // the library
-         for (i = 0; i < numberOfTablesToInitialize; ++i) {
-            ret = GVHashTableCreate(item->Size, item->HashTable);
-            if (ret != ERROR_SUCCESS) {
-               --item;
-               for (j = 0; j < i; ++j) {
-                  HashTableDestroy(*(item->HashTable));
-                  --item;
-               }
-
-               break;
-            }
-
-            ++item;
-         }
+      // ltbtIRPPagingReadWrite is the last bit mask type.
+      for (j = ltbtProcessAccessRights; j <= ltbtIRPPagingReadWrite; ++j) {
+         v = _BitMaskTypeToArray((ELibTranslateBitMaskType)j, &vLen);
+         if (v != NULL)
+            _BitMaskArrayPrepare(v, vLen);
+      }
 
-         if (ret == ERROR_SUCCESS) {
-            // Fill the hash tables created above with the integer-to-string mapping
-            // for the system constants.
-            item = &_hashTableInitializationArray[0];
-            for (i = 0; i < numberOfTablesToInitialize; ++i) {
-               PGENERAL_VALUE textItem = item->ItemArray;
-
-               for (j = 0; j < item->NumberOfItems; ++j) {
-                  GVHashTableInsert(*(item->HashTable), textItem);
-                  ++textItem;
-               }
+      _bitMaskDelimiterLength = wcslen(_bitMaskDelimiter);
+      _unknownLength = wcslen(unknown);
+      memset(_bitMaskCache, 0, sizeof(_bitMaskCache));
+      ret = _CreateWindowsErrorToNTSTATUSMapping();
+      if (ret != ERROR_SUCCESS)
+         GVTablesFinit(_generalValueTables, sizeof(_generalValueTables) / sizeof(PGENERAL_VALUE_TABLE));
+   }
 
-               ++item;
-            }   
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
 
-            ret = _CreateWindowsErrorToNTSTATUSMapping();
-         }
-      
-         if (ret != ERROR_SUCCESS) {
-            _FreeWindowsErrorDescriptions();
-         }
-      }
+/** Changes the source of NTSTATUS value and Windows error code descriptions.
+ *
+ *  @param Source The new source.
+ *  @param Blob Address of a description blob, used only for the ltdsBlob source.
+ *  @param BlobSize Size of the blob, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, an error code on failure.
+ *
+ *  @remark
+ *  Descriptions memoized so far are released, so they are looked up from the
+ *  new source on the next request. If the source cannot be changed, they will
+ *  be looked up again from the current one.
+ */
+DWORD TranslatesSetDescriptionSource(ELibTranslateDescriptionSource Source, PVOID Blob, ULONG BlobSize)
+{
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("Source=%u; Blob=0x%p; BlobSize=%u", Source, Blob, BlobSize);
 
-      if (ret != ERROR_SUCCESS) {
-         _FreeNTSTATUSDescriptions();
-      }
-   }
+   Utf8ArrayFree(_gvUtf8Descriptions + ltivtNTSTATUS);
+   Utf8ArrayFree(_gvUtf8Descriptions + ltivtWindowsError);
+   _FreeDescriptions(&ntStatusTable);
+   _FreeDescriptions(&winErrorTable);
+   ret = DescriptionsSetSource(Source, Blob, BlobSize);
 
    DEBUG_EXIT_FUNCTION("%u", ret);
    return ret;
@@ -1232,28 +2153,42 @@ DWORD TranslatesModuleInit(VOID)
 
 /** Cleans up resources used by the Translation Library.
  *
- *  The library allocates only resources related to hash tables and NTSTATUS
- *  description. The routine destroys all the hash tables and deallocates
- *  the descriptions for the NTSTATUS values.
+ *  The library allocates only resources related to error code mapping hash tables
+ *  and NTSTATUS and Windows error descriptions. The routine destroys the hash tables
+ *  and deallocates the descriptions memoized so far, as well as UTF-8 forms of the
+ *  string tables.
  */
 VOID TranslatesModuleFinit(VOID)
 {
    ULONG i = 0;
-   PGENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE item = &_hashTableInitializationArray[0];
    DEBUG_ENTER_FUNCTION_NO_ARGS();
 
-   _FreeWindowsErrorToNTSTATUSMapping();
-   // Destroy all the hash tables
-   for (i = 0; i < sizeof(_hashTableInitializationArray) / sizeof(GENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE); ++i) {
-      HashTableDestroy(*(item->HashTable));
-      ++item;
+   for (i = 0; i < sizeof(_gvUtf8Names) / sizeof(UTF8_ARRAY); ++i) {
+      Utf8ArrayFree(_gvUtf8Names + i);
+      Utf8ArrayFree(_gvUtf8Descriptions + i);
+   }
+
+   for (i = 0; i < sizeof(_enumUtf8Strings) / sizeof(_enumUtf8Strings[0]); ++i) {
+      Utf8ArrayFree(&_enumUtf8Strings[i][0]);
+      Utf8ArrayFree(&_enumUtf8Strings[i][1]);
+   }
+
+   for (i = 0; i < sizeof(_bitMaskUtf8Strings) / sizeof(_bitMaskUtf8Strings[0]); ++i) {
+      Utf8ArrayFree(&_bitMaskUtf8Strings[i][0]);
+      Utf8ArrayFree(&_bitMaskUtf8Strings[i][1]);
    }
 
-   // Delete Windows error descriptions
-   _FreeWindowsErrorDescriptions();
+   for (i = 0; i < DEVICE_CONTROL_CACHE_SIZE; ++i) {
+      if (_deviceControlCache[i] != NULL) {
+         HeapMemoryFree(_deviceControlCache[i]);
+         _deviceControlCache[i] = NULL;
+      }
+   }
 
-   // Delete NTSTATUS descriptions
-   _FreeNTSTATUSDescriptions();
+   _FreeWindowsErrorToNTSTATUSMapping();
+   _FreeDescriptions(&winErrorTable);
+   _FreeDescriptions(&ntStatusTable);
+   GVTablesFinit(_generalValueTables, sizeof(_generalValueTables) / sizeof(PGENERAL_VALUE_TABLE));
 
    DEBUG_EXIT_FUNCTION_VOID();
    return;
@@ -11,7 +11,7 @@
 
 #include <windows.h>
 #include "libtranslate-hash-table.h"
-#include "gv-hash-table.h"
+#include "gv-table.h"
 #include "libtranslate.h"
 
 /** Represents a string information about a value that is a part of a system
@@ -34,28 +34,26 @@ typedef struct {
    PWCHAR Description;
    /** Set to TRUE when the structure represent combined bit mask value. */
    BOOLEAN Combined;
+   /** Length of the name, in characters. Computed during library initialization. */
+   ULONG NameLength;
+   /** Length of the description, in characters. Computed during library initialization. */
+   ULONG DescriptionLength;
 } BITMASK_VALUE, *PBITMASK_VALUE;
 
 
-/** Contains information about one hash table and its contents. The structure
-    is used during library initialization and finalization stages to create or
-    destroy corresponding hash table. 
-  */
-typedef struct {
-   /** Address that receives address of newly created hash tablei nstance. */
-   PHASH_TABLE *HashTable;
-   /** Size of the hash table to create, in buckets. */
-   ULONG Size;
-   /** Pointer to an array of TEXT_ITEM structures the hash table will be filled
-       with after its successful creation. */
-   PGENERAL_VALUE ItemArray;
-   /** Number of elements in the array pointed by the ItemArray member. */
-   ULONG NumberOfItems;
-} GENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE, *PGENERAL_VALUE_HASH_TABLE_INIT_STRUCTURE;
-
 PWCHAR EnumerationValueToString(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value);
 PWCHAR GeneralIntegerValueToString(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value);
+DWORD EnumerationValuesToStrings(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings);
+DWORD GeneralIntegerValuesToStrings(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PWCHAR *Strings);
+PCHAR EnumerationValueToStringUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, ULONG Value);
+DWORD EnumerationValuesToStringsUTF8(ELibTranslateEnumerationType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths);
+PCHAR GeneralIntegerValueToStringUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, ULONG Value);
+DWORD GeneralIntegerValuesToStringsUTF8(ELibTranslateIntegerValueType Type, BOOLEAN Description, const ULONG *Values, ULONG Count, PCHAR *Strings, PULONG Lengths);
+DWORD IntegerValueTableStatistics(ELibTranslateIntegerValueType Type, PLIBTRANSLATE_HASH_TABLE_STATISTICS Statistics);
+PGENERAL_VALUE_TABLE IntegerValueTable(ELibTranslateIntegerValueType Type);
 PWCHAR BitMaskValueToString(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value);
+DWORD BitMaskValueToBuffer(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+DWORD BitMaskValueToBufferUTF8(ELibTranslateBitMaskType Type, BOOLEAN Description, ULONG Value, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
 VOID BitMaskValueStringFree(PWCHAR Str);
 
 PWCHAR WindowsMessagesToString(ULONG32 Key);
@@ -71,7 +69,11 @@ NTSTATUS WindowsErrorCodeToNTSTATUS(DWORD ErrorCode);
 DWORD NTSTATUSCodeToWindowsError(NTSTATUS Status);
 
 PWCHAR IRPFLagsToString(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description);
+DWORD IRPFlagsToBuffer(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PWCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+DWORD IRPFlagsToBufferUTF8(UCHAR MajorFunction, UCHAR MinorFunction, ULONG IRPFlags, BOOLEAN Description, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+
 
+DWORD TranslatesSetDescriptionSource(ELibTranslateDescriptionSource Source, PVOID Blob, ULONG BlobSize);
 
 DWORD TranslatesModuleInit(VOID);
 VOID TranslatesModuleFinit(VOID);
@@ -0,0 +1,249 @@
+
+/**
+ * @file
+ *
+ * Converts string tables of the library to UTF-8.
+ *
+ * The UTF-8 strings are produced from the same tables as their UTF-16
+ * counterparts, so both representations never diverge. A table is converted
+ * when an UTF-8 string from it is requested for the first time. All strings
+ * of the table are stored in one memory block, together with their lengths,
+ * so the callers can copy them to output buffers without any further work.
+ *
+ * Strings that are not known in advance (such as descriptions of NTSTATUS
+ * values looked up on demand) are converted one by one and memoized.
+ */
+
+#include <windows.h>
+#include "debug.h"
+#include "allocator.h"
+#include "utf8.h"
+
+
+/************************************************************************/
+/*                  TYPE DEFINITIONS                                    */
+/************************************************************************/
+
+/** Parameters of an UTF-8 array construction. */
+typedef struct _UTF8_ARRAY_BUILD_CONTEXT {
+   /** The array being built. */
+   PUTF8_ARRAY Array;
+   /** Number of strings. */
+   ULONG Count;
+   /** Supplies the UTF-16 strings. NULL if the strings are converted on demand. */
+   UTF8_ARRAY_SOURCE *Source;
+   /** Passed to the Source routine. */
+   PVOID Context;
+} UTF8_ARRAY_BUILD_CONTEXT, *PUTF8_ARRAY_BUILD_CONTEXT;
+
+
+/************************************************************************/
+/*                  HELPER FUNCTIONS                                    */
+/************************************************************************/
+
+/** Builds an UTF-8 array. Invoked via InitOnceExecuteOnce.
+ *
+ *  @param InitOnce The one-time initialization structure of the array.
+ *  @param Parameter Address of @link(UTF8_ARRAY_BUILD_CONTEXT) structure.
+ *  @param Context Not used.
+ *
+ *  @return
+ *  Returns TRUE on success, FALSE on failure. In the latter case, construction
+ *  of the array is attempted again on the next request.
+ *
+ *  @remark
+ *  The first pass computes size of the UTF-8 form of all the strings, the second
+ *  one converts them into a single memory block.
+ */
+static BOOL CALLBACK _Utf8ArrayBuild(PINIT_ONCE InitOnce, PVOID Parameter, PVOID *Context)
+{
+   ULONG i = 0;
+   int len = 0;
+   SIZE_T poolSize = 0;
+   PCHAR pool = NULL;
+   PCHAR position = NULL;
+   PUTF8_STRING strings = NULL;
+   PUTF8_ARRAY_BUILD_CONTEXT ctx = (PUTF8_ARRAY_BUILD_CONTEXT)Parameter;
+   BOOL ret = FALSE;
+   DEBUG_ENTER_FUNCTION("InitOnce=0x%p; Parameter=0x%p; Context=0x%p", InitOnce, Parameter, Context);
+
+   strings = (PUTF8_STRING)HeapMemoryAlloc((ctx->Count + 1) * sizeof(UTF8_STRING));
+   if (strings != NULL) {
+      ret = TRUE;
+      if (ctx->Source != NULL) {
+         for (i = 0; i < ctx->Count; ++i) {
+            len = WideCharToMultiByte(CP_UTF8, 0, ctx->Source(ctx->Context, i), -1, NULL, 0, NULL, NULL);
+            ret = (len > 0);
+            if (!ret)
+               break;
+
+            strings[i].Length = len - 1;
+            poolSize += len;
+         }
+
+         if (ret) {
+            pool = (PCHAR)HeapMemoryAlloc(poolSize + 1);
+            ret = (pool != NULL);
+            if (ret) {
+               position = pool;
+               for (i = 0; i < ctx->Count; ++i) {
+                  len = strings[i].Length + 1;
+                  WideCharToMultiByte(CP_UTF8, 0, ctx->Source(ctx->Context, i), -1, position, len, NULL, NULL);
+                  strings[i].Buffer = position;
+                  position += len;
+               }
+            }
+         }
+      }
+
+      if (ret) {
+         ctx->Array->Count = ctx->Count;
+         ctx->Array->Strings = strings;
+         ctx->Array->Pool = pool;
+      } else HeapMemoryFree(strings);
+   }
+
+   DEBUG_EXIT_FUNCTION("%u", ret);
+   return ret;
+}
+
+
+/************************************************************************/
+/*                  PUBLIC FUNCTIONS                                    */
+/************************************************************************/
+
+/** Retrieves strings of a given UTF-8 array, builds the array if necessary.
+ *
+ *  @param Array The array.
+ *  @param Count Number of strings in the array.
+ *  @param Source Routine supplying the UTF-16 strings to convert. If set to NULL,
+ *  the array is created empty and its strings must be retrieved by @link(Utf8ArrayGetLazy).
+ *  @param Context Passed to the Source routine.
+ *
+ *  @return
+ *  Returns address of the first string of the array, or NULL if the array cannot be
+ *  built due to insufficient memory.
+ *
+ *  @remark
+ *  The routine may be called concurrently from multiple threads. The array is built
+ *  only once and all the threads wait for its construction to complete.
+ */
+PUTF8_STRING Utf8ArrayGet(PUTF8_ARRAY Array, ULONG Count, UTF8_ARRAY_SOURCE *Source, PVOID Context)
+{
+   UTF8_ARRAY_BUILD_CONTEXT ctx;
+   PUTF8_STRING ret = NULL;
+   DEBUG_ENTER_FUNCTION("Array=0x%p; Count=%u; Source=0x%p; Context=0x%p", Array, Count, Source, Context);
+
+   ctx.Array = Array;
+   ctx.Count = Count;
+   ctx.Source = Source;
+   ctx.Context = Context;
+   if (InitOnceExecuteOnce(&Array->InitOnce, _Utf8ArrayBuild, &ctx, NULL))
+      ret = Array->Strings;
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Retrieves an UTF-8 string of an array created for on-demand conversions.
+ *
+ *  @param Array The array, must have been obtained via @link(Utf8ArrayGet) with
+ *  the Source argument set to NULL.
+ *  @param Index Index of the string.
+ *  @param String The UTF-16 form of the string, converted if the string has not been
+ *  requested yet.
+ *
+ *  @return
+ *  Returns the UTF-8 string, or NULL if there is not enough memory to convert it.
+ *
+ *  @remark
+ *  The converted string is published via an interlocked compare-exchange. If multiple
+ *  threads convert the same string at once, only one result is kept.
+ */
+PCHAR Utf8ArrayGetLazy(PUTF8_ARRAY Array, ULONG Index, PWCHAR String)
+{
+   int len = 0;
+   PCHAR tmp = NULL;
+   PCHAR ret = NULL;
+   DEBUG_ENTER_FUNCTION("Array=0x%p; Index=%u; String=\"%S\"", Array, Index, String);
+
+   ret = *(PCHAR volatile *)&Array->Strings[Index].Buffer;
+   if (ret == NULL) {
+      len = WideCharToMultiByte(CP_UTF8, 0, String, -1, NULL, 0, NULL, NULL);
+      if (len > 0) {
+         tmp = (PCHAR)HeapMemoryAlloc(len);
+         if (tmp != NULL) {
+            WideCharToMultiByte(CP_UTF8, 0, String, -1, tmp, len, NULL, NULL);
+            ret = (PCHAR)InterlockedCompareExchangePointer((PVOID volatile *)&Array->Strings[Index].Buffer, tmp, NULL);
+            if (ret != NULL)
+               HeapMemoryFree(tmp);
+            else ret = tmp;
+         }
+      }
+   }
+
+   DEBUG_EXIT_FUNCTION("0x%p", ret);
+   return ret;
+}
+
+/** Frees an UTF-8 array. The array can be built again afterwards.
+ *
+ *  @param Array The array to free.
+ *
+ *  @remark
+ *  The routine must not be called concurrently with other routines accessing the array.
+ */
+VOID Utf8ArrayFree(PUTF8_ARRAY Array)
+{
+   ULONG i = 0;
+   DEBUG_ENTER_FUNCTION("Array=0x%p", Array);
+
+   if (Array->Strings != NULL) {
+      if (Array->Pool == NULL) {
+         for (i = 0; i < Array->Count; ++i) {
+            if (Array->Strings[i].Buffer != NULL)
+               HeapMemoryFree(Array->Strings[i].Buffer);
+         }
+      } else HeapMemoryFree(Array->Pool);
+
+      HeapMemoryFree(Array->Strings);
+   }
+
+   memset(Array, 0, sizeof(UTF8_ARRAY));
+   InitOnceInitialize(&Array->InitOnce);
+
+   DEBUG_EXIT_FUNCTION_VOID();
+   return;
+}
+
+/** Converts a given UTF-16 string to UTF-8 and stores it in a given buffer.
+ *
+ *  @param String The string to convert.
+ *  @param Buffer Buffer to receive the null-terminated UTF-8 string.
+ *  @param BufferLength Size of the buffer, in bytes.
+ *  @param RequiredLength Address of variable that receives size of the UTF-8 string,
+ *  including the terminating null character, in bytes.
+ *
+ *  @return
+ *  Returns ERROR_SUCCESS on success, ERROR_INSUFFICIENT_BUFFER if the buffer is too small.
+ */
+DWORD Utf8FromWide(PWCHAR String, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength)
+{
+   int len = 0;
+   DWORD ret = ERROR_GEN_FAILURE;
+   DEBUG_ENTER_FUNCTION("String=\"%S\"; Buffer=0x%p; BufferLength=%u; RequiredLength=0x%p", String, Buffer, BufferLength, RequiredLength);
+
+   *RequiredLength = 0;
+   len = WideCharToMultiByte(CP_UTF8, 0, String, -1, NULL, 0, NULL, NULL);
+   if (len > 0) {
+      *RequiredLength = len;
+      ret = ERROR_INSUFFICIENT_BUFFER;
+      if ((ULONG)len <= BufferLength) {
+         WideCharToMultiByte(CP_UTF8, 0, String, -1, Buffer, len, NULL, NULL);
+         ret = ERROR_SUCCESS;
+      }
+   } else ret = GetLastError();
+
+   DEBUG_EXIT_FUNCTION("%u, *RequiredLength=%u", ret, *RequiredLength);
+   return ret;
+}
@@ -0,0 +1,54 @@
+
+/**
+ * @file
+ *
+ * Header file of the module converting string tables of the library to UTF-8.
+ */
+
+#ifndef __LIBTRANSLATE_UTF8_H__
+#define __LIBTRANSLATE_UTF8_H__
+
+#include <windows.h>
+
+
+/** Represents one UTF-8 string. */
+typedef struct _UTF8_STRING {
+   /** The null-terminated string. */
+   PCHAR Buffer;
+   /** Length of the string, in bytes, not including the terminating null character. */
+   ULONG Length;
+} UTF8_STRING, *PUTF8_STRING;
+
+/** Prototype of a routine supplying strings to be converted into an UTF-8 array.
+ *
+ *  @param Context Value passed to @link(Utf8ArrayGet).
+ *  @param Index Index of the string.
+ *
+ *  @return
+ *  Returns the UTF-16 string with the given index.
+ */
+typedef PWCHAR (UTF8_ARRAY_SOURCE)(PVOID Context, ULONG Index);
+
+/** Array of UTF-8 strings built from an array of UTF-16 strings when accessed
+    for the first time. Static instances are ready for use (initialized to zero). */
+typedef struct _UTF8_ARRAY {
+   /** Ensures the array is built only once. */
+   INIT_ONCE InitOnce;
+   /** Number of strings in the array. */
+   ULONG Count;
+   /** The strings. */
+   PUTF8_STRING Strings;
+   /** Memory block holding all strings of the array. NULL if the strings are
+       converted one by one on demand (see @link(Utf8ArrayGet)). */
+   PCHAR Pool;
+} UTF8_ARRAY, *PUTF8_ARRAY;
+
+
+PUTF8_STRING Utf8ArrayGet(PUTF8_ARRAY Array, ULONG Count, UTF8_ARRAY_SOURCE *Source, PVOID Context);
+PCHAR Utf8ArrayGetLazy(PUTF8_ARRAY Array, ULONG Index, PWCHAR String);
+VOID Utf8ArrayFree(PUTF8_ARRAY Array);
+DWORD Utf8FromWide(PWCHAR String, PCHAR Buffer, ULONG BufferLength, PULONG RequiredLength);
+
+
+
+#endif